@@ -1,7 +1,41 @@
+#include "hlt/bench.hpp"
 #include "hlt/hlt.hpp"
 #include "hlt/navigation.hpp"
 
-int main() {
+/// The moves for a turn. Kept apart from main so that it can be timed
+/// offline too: MyBot --bench (see hlt/bench.hpp).
+static void play_turn(const hlt::Map& map, const hlt::PlayerId player_id, std::vector<hlt::Move>& moves) {
+    for (const hlt::Ship& ship : map.ships.at(player_id)) {
+        if (ship.docking_status != hlt::ShipDockingStatus::Undocked) {
+            continue;
+        }
+
+        for (const hlt::Planet& planet : map.planets) {
+            if (planet.owned) {
+                continue;
+            }
+
+            if (ship.can_dock(planet)) {
+                moves.push_back(hlt::Move::dock(ship.entity_id, planet.entity_id));
+                break;
+            }
+
+            const hlt::possibly<hlt::Move> move =
+                    hlt::navigation::navigate_ship_to_dock(map, ship, planet, hlt::constants::MAX_SPEED / 2);
+            if (move.second) {
+                moves.push_back(move.first);
+            }
+
+            break;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (hlt::bench::is_bench(argc, argv)) {
+        return hlt::bench::main(argc, argv, play_turn);
+    }
+
     const hlt::Metadata metadata = hlt::initialize("IvanTheTerrible");
     const hlt::PlayerId player_id = metadata.player_id;
 
@@ -20,32 +54,9 @@ int main() {
     std::vector<hlt::Move> moves;
     for (;;) {
         moves.clear();
-        const hlt::Map map = hlt::in::get_map();
-
-        for (const hlt::Ship& ship : map.ships.at(player_id)) {
-            if (ship.docking_status != hlt::ShipDockingStatus::Undocked) {
-                continue;
-            }
+        const hlt::Map& map = hlt::in::update_map();
 
-            for (const hlt::Planet& planet : map.planets) {
-                if (planet.owned) {
-                    continue;
-                }
-
-                if (ship.can_dock(planet)) {
-                    moves.push_back(hlt::Move::dock(ship.entity_id, planet.entity_id));
-                    break;
-                }
-
-                const hlt::possibly<hlt::Move> move =
-                        hlt::navigation::navigate_ship_to_dock(map, ship, planet, hlt::constants::MAX_SPEED / 2);
-                if (move.second) {
-                    moves.push_back(move.first);
-                }
-
-                break;
-            }
-        }
+        play_turn(map, player_id, moves);
 
         if (!hlt::out::send_moves(moves)) {
             hlt::Log::log("send_moves failed; exiting");
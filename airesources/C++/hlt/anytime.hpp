@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "hlt_in.hpp"
+#include "hlt_out.hpp"
+#include "move.hpp"
+#include "turn_clock.hpp"
+
+namespace hlt {
+    namespace anytime {
+        /// How long before the deadline to stop searching, to leave time to
+        /// send the moves and for the game to read them.
+        constexpr std::chrono::milliseconds DEFAULT_SAFETY_MARGIN(200);
+
+        /**
+         * Call improve() until it returns false, or until margin before the
+         * clock's deadline. A call isn't started unless it should finish in
+         * time, going by the longest one so far, so keep each call short:
+         * one step of the search, rather than all of it.
+         *
+         * @return The number of calls made.
+         */
+        template<typename Improve>
+        static unsigned int improve_until_deadline(
+                const TurnClock& clock,
+                Improve improve,
+                const TurnClock::Clock::duration margin = DEFAULT_SAFETY_MARGIN)
+        {
+            unsigned int calls = 0;
+            TurnClock::Clock::duration longest_call = TurnClock::Clock::duration::zero();
+            while (!clock.expired(margin + longest_call)) {
+                const TurnClock::Clock::time_point call_start = TurnClock::Clock::now();
+                const bool again = improve();
+                longest_call = std::max(longest_call, TurnClock::Clock::now() - call_start);
+                ++calls;
+                if (!again) {
+                    break;
+                }
+            }
+            return calls;
+        }
+
+        /**
+         * Search for better moves until margin before this turn's deadline,
+         * then send the best found. improve(best) is called repeatedly (see
+         * improve_until_deadline), and may replace best with better moves
+         * each time; it returns whether it has more to try. Start best off
+         * with moves that are fine to send if there's no time to improve them.
+         *
+         * @return Whether the moves were sent.
+         */
+        template<typename Improve>
+        static bool send_best_moves(
+                std::vector<Move>& best,
+                Improve improve,
+                const TurnClock::Clock::duration margin = DEFAULT_SAFETY_MARGIN)
+        {
+            improve_until_deadline(in::turn_clock(), [&]() { return improve(best); }, margin);
+            return out::send_moves(best);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace hlt {
+    void* Arena::allocate(const size_t bytes, const size_t alignment) {
+        const auto aligned = [&]() {
+            const uintptr_t address = reinterpret_cast<uintptr_t>(top);
+            return reinterpret_cast<char*>((address + alignment - 1) & ~(uintptr_t(alignment) - 1));
+        };
+        char* start = aligned();
+        if (top == nullptr || start > end || static_cast<size_t>(end - start) < bytes) {
+            add_block(bytes + alignment);
+            start = aligned();
+        }
+        top = start + bytes;
+        return start;
+    }
+
+    void Arena::reset() {
+        if (blocks.size() > 1) {
+            size_t total = 0;
+            for (const Block& block : blocks) {
+                total += block.size;
+            }
+            blocks.clear();
+            add_block(total);
+        }
+        if (!blocks.empty()) {
+            top = blocks.back().data.get();
+        }
+        used_before = 0;
+    }
+
+    void Arena::add_block(const size_t min_size) {
+        size_t size = BLOCK_SIZE;
+        if (!blocks.empty()) {
+            used_before += static_cast<size_t>(top - blocks.back().data.get());
+            size = blocks.back().size * 2;
+        }
+        size = std::max(size, min_size);
+        blocks.push_back(Block{ std::unique_ptr<char[]>(new char[size]), size });
+        top = blocks.back().data.get();
+        end = top + size;
+    }
+
+    namespace arena {
+        namespace {
+            std::atomic<uint64_t> g_turn{0};
+        }
+
+        Arena& turn_arena() {
+            static thread_local Arena thread_arena;
+            static thread_local uint64_t thread_turn = 0;
+            const uint64_t turn = g_turn.load(std::memory_order_acquire);
+            if (thread_turn != turn) {
+                thread_arena.reset();
+                thread_turn = turn;
+            }
+            return thread_arena;
+        }
+
+        void next_turn() {
+            g_turn.fetch_add(1, std::memory_order_release);
+        }
+    }
+}
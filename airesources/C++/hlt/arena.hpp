@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace hlt {
+    /**
+     * Memory handed out by bumping a pointer and given back all at once, for
+     * what only lives for a turn. Freeing single allocations does nothing.
+     *
+     * When a block runs out, another (at least twice as large) is added;
+     * reset replaces them with one block as large as all of them, so once a
+     * bot has seen its busiest turn the arena stops allocating at all.
+     */
+    class Arena {
+    public:
+        /// The size of the first block.
+        static constexpr size_t BLOCK_SIZE = 64 << 10;
+
+        Arena() = default;
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(size_t bytes, size_t alignment);
+
+        /// Give back everything allocated, keeping the memory.
+        void reset();
+
+        /// The bytes handed out since the last reset, counting padding.
+        size_t used() const {
+            return used_before + (blocks.empty() ? 0 : static_cast<size_t>(top - blocks.back().data.get()));
+        }
+
+    private:
+        struct Block {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        std::vector<Block> blocks;
+        /// Where the next allocation goes in the latest block, and its end.
+        char* top = nullptr;
+        char* end = nullptr;
+        /// What was used of the blocks before the latest.
+        size_t used_before = 0;
+
+        void add_block(size_t min_size);
+    };
+
+    namespace arena {
+        /**
+         * The calling thread's arena for this turn. in::update_map (and so
+         * get_map) starts a new turn, after which each thread's arena is
+         * reset the next time it asks for it, so anything allocated in them
+         * is only valid until the next map is read, like the map itself.
+         */
+        Arena& turn_arena();
+
+        /// Start a new turn; in::update_map calls this.
+        void next_turn();
+    }
+
+    /**
+     * An allocator for the standard containers that allocates in an arena,
+     * by default the calling thread's turn_arena.
+     */
+    template<typename T>
+    class ArenaAllocator {
+    public:
+        typedef T value_type;
+
+        ArenaAllocator() : arena(&arena::turn_arena()) {
+        }
+
+        explicit ArenaAllocator(Arena& arena_) : arena(&arena_) {
+        }
+
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {
+        }
+
+        T* allocate(const size_t count) {
+            if (count > static_cast<size_t>(-1) / sizeof(T)) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, size_t) {
+        }
+
+        template<typename U>
+        bool operator==(const ArenaAllocator<U>& other) const {
+            return arena == other.arena;
+        }
+
+        template<typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const {
+            return arena != other.arena;
+        }
+
+    private:
+        template<typename U>
+        friend class ArenaAllocator;
+
+        Arena* arena;
+    };
+
+    /// A vector for this turn only; see arena::turn_arena.
+    template<typename T>
+    using arena_vector = std::vector<T, ArenaAllocator<T>>;
+}
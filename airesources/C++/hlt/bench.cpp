@@ -0,0 +1,402 @@
+#include "bench.hpp"
+#include "arena.hpp"
+#include "constants.hpp"
+#include "hlt_in.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+#ifdef HLT_COUNT_ALLOCATIONS
+// GCC can't tell that these operators pair malloc with free themselves
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+    std::atomic<unsigned long long> g_allocations{0};
+    std::atomic<unsigned long long> g_allocated_bytes{0};
+
+    void* counted_allocate(const size_t size) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+}
+
+// Every thread's allocations count, for bots that use a TaskPool
+void* operator new(size_t size) {
+    void* pointer = counted_allocate(size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+#endif
+
+namespace hlt {
+    namespace bench {
+        namespace {
+            const char* const FRAME_FILE_MAGIC = "halite-frames 1";
+
+            typedef std::chrono::steady_clock Clock;
+
+            double millis_between(const Clock::time_point from, const Clock::time_point to) {
+                return std::chrono::duration<double, std::milli>(to - from).count();
+            }
+
+            void count_allocations(unsigned long long& allocations, unsigned long long& bytes) {
+#ifdef HLT_COUNT_ALLOCATIONS
+                allocations = g_allocations.load(std::memory_order_relaxed);
+                bytes = g_allocated_bytes.load(std::memory_order_relaxed);
+#else
+                allocations = 0;
+                bytes = 0;
+#endif
+            }
+
+            /// The given percentile (0 to 100) of sorted values, by nearest rank.
+            double percentile(const std::vector<double>& sorted, const double percent) {
+                if (sorted.empty()) {
+                    return 0.0;
+                }
+                const size_t rank = static_cast<size_t>(percent / 100.0 * (sorted.size() - 1) + 0.5);
+                return sorted[std::min(rank, sorted.size() - 1)];
+            }
+
+            void print_percentiles(std::ostream& out, const std::string& label, std::vector<double> values) {
+                std::sort(values.begin(), values.end());
+                out << "  " << std::left << std::setw(8) << label << std::right
+                    << " p50 " << std::setw(9) << percentile(values, 50)
+                    << "  p90 " << std::setw(9) << percentile(values, 90)
+                    << "  p99 " << std::setw(9) << percentile(values, 99)
+                    << "  max " << std::setw(9) << (values.empty() ? 0.0 : values.back()) << " ms\n";
+            }
+        }
+
+        FrameFile read_frame_file(const std::string& filename) {
+            std::ifstream input(filename, std::ios::binary);
+            if (!input) {
+                throw std::runtime_error("Could not read " + filename);
+            }
+            std::string line;
+            FrameFile file;
+            if (!std::getline(input, line) || line != FRAME_FILE_MAGIC ||
+                    !(input >> file.map_width >> file.map_height) || !std::getline(input, line)) {
+                throw std::runtime_error(filename + " is not a frame file (see halite --export-frames)");
+            }
+            while (std::getline(input, line)) {
+                file.frames.push_back(line);
+            }
+            if (file.frames.empty()) {
+                throw std::runtime_error(filename + " has no frames");
+            }
+            return file;
+        }
+
+        Report run_in_process(const FrameFile& frames, const PlayerId player_id, const PlayTurn& play_turn,
+                              const unsigned int repetitions) {
+            Report report;
+            report.description = "in process, as player " + std::to_string(player_id) + ", " +
+                    std::to_string(repetitions) + (repetitions == 1 ? " run" : " runs");
+            report.in_process = true;
+#ifdef HLT_COUNT_ALLOCATIONS
+            report.counted_allocations = true;
+#endif
+
+            std::vector<Move> moves;
+            for (unsigned int repetition = 0; repetition < repetitions; ++repetition) {
+                Map map(frames.map_width, frames.map_height);
+                const std::string& initial = frames.frames.front();
+                in::parse_map(initial.data(), initial.data() + initial.size(), map);
+
+                // Turn t is sent the map after turn t - 1, the first the
+                // initial one again; the last frame isn't sent at all
+                for (size_t turn = 0; turn + 1 < frames.frames.size(); ++turn) {
+                    const std::string& frame = frames.frames[turn];
+                    arena::next_turn();
+
+                    TurnSample sample;
+                    sample.turn = static_cast<unsigned int>(turn + 1);
+                    const Clock::time_point read_at = Clock::now();
+                    in::start_turn_clock(read_at, constants::FRAME_TIME_LIMIT_MILLIS);
+                    in::parse_map(frame.data(), frame.data() + frame.size(), map);
+                    const Clock::time_point parsed_at = Clock::now();
+
+                    unsigned long long allocations_before, bytes_before;
+                    count_allocations(allocations_before, bytes_before);
+                    moves.clear();
+                    play_turn(map, player_id, moves);
+                    const Clock::time_point done_at = Clock::now();
+                    count_allocations(sample.allocations, sample.allocated_bytes);
+                    sample.allocations -= allocations_before;
+                    sample.allocated_bytes -= bytes_before;
+
+                    sample.parse_millis = millis_between(read_at, parsed_at);
+                    sample.turn_millis = millis_between(parsed_at, done_at);
+                    report.turns.push_back(sample);
+                }
+            }
+            return report;
+        }
+
+#ifdef _WIN32
+        Report run_binary(const FrameFile&, PlayerId, const std::string&) {
+            throw std::runtime_error("--bench-binary is not supported on Windows");
+        }
+#else
+        namespace {
+            /// A bot process, talked to over pipes as the game does.
+            class BotProcess {
+            public:
+                explicit BotProcess(const std::string& command) {
+                    int to_bot[2], from_bot[2];
+                    if (pipe(to_bot) == -1 || pipe(from_bot) == -1) {
+                        throw std::runtime_error("Could not create pipes for the bot");
+                    }
+                    pid = fork();
+                    if (pid == -1) {
+                        throw std::runtime_error("Could not start the bot");
+                    }
+                    if (pid == 0) {
+                        dup2(to_bot[0], STDIN_FILENO);
+                        dup2(from_bot[1], STDOUT_FILENO);
+                        close(to_bot[0]);
+                        close(to_bot[1]);
+                        close(from_bot[0]);
+                        close(from_bot[1]);
+                        execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+                        _exit(127);
+                    }
+                    close(to_bot[0]);
+                    close(from_bot[1]);
+                    input = to_bot[1];
+                    output = from_bot[0];
+                    // Writing to a bot that has died shouldn't kill us
+                    std::signal(SIGPIPE, SIG_IGN);
+                }
+
+                ~BotProcess() {
+                    close(input);
+                    close(output);
+                    // Bots exit at the end of their input; wait a little
+                    // for that, then make sure
+                    for (int tries = 0; tries < 100; ++tries) {
+                        if (waitpid(pid, nullptr, WNOHANG) == pid) {
+                            return;
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                    kill(pid, SIGKILL);
+                    waitpid(pid, nullptr, 0);
+                }
+
+                BotProcess(const BotProcess&) = delete;
+                BotProcess& operator=(const BotProcess&) = delete;
+
+                void send(const std::string& text) {
+                    size_t sent = 0;
+                    while (sent < text.size()) {
+                        const ssize_t bytes = write(input, text.data() + sent, text.size() - sent);
+                        if (bytes < 0 && errno == EINTR) {
+                            continue;
+                        }
+                        if (bytes <= 0) {
+                            throw std::runtime_error("The bot stopped reading its input");
+                        }
+                        sent += static_cast<size_t>(bytes);
+                    }
+                }
+
+                /// The next line the bot sends, without its newline.
+                std::string receive_line() {
+                    while (true) {
+                        const size_t newline = received.find('\n');
+                        if (newline != std::string::npos) {
+                            std::string line = received.substr(0, newline);
+                            received.erase(0, newline + 1);
+                            if (!line.empty() && line.back() == '\r') {
+                                line.pop_back();
+                            }
+                            return line;
+                        }
+                        char buffer[1 << 14];
+                        const ssize_t bytes = read(output, buffer, sizeof(buffer));
+                        if (bytes < 0 && errno == EINTR) {
+                            continue;
+                        }
+                        if (bytes <= 0) {
+                            throw std::runtime_error("The bot exited or closed its output");
+                        }
+                        received.append(buffer, static_cast<size_t>(bytes));
+                    }
+                }
+
+            private:
+                pid_t pid;
+                int input = -1;
+                int output = -1;
+                std::string received;
+            };
+        }
+
+        Report run_binary(const FrameFile& frames, const PlayerId player_id, const std::string& command) {
+            Report report;
+            report.description = "\"" + command + "\" over pipes, as player " + std::to_string(player_id);
+
+            BotProcess bot(command);
+            bot.send(std::to_string(player_id) + "\n" + std::to_string(frames.map_width) + " " +
+                     std::to_string(frames.map_height) + " \n" + frames.frames.front() + "\n");
+            const std::string name = bot.receive_line();
+            if (name.find('\t') != std::string::npos) {
+                throw std::runtime_error("The bot asked for " + name.substr(name.find('\t') + 1) +
+                                         ", but the bench only sends text frames");
+            }
+
+            for (size_t turn = 0; turn + 1 < frames.frames.size(); ++turn) {
+                TurnSample sample = {};
+                sample.turn = static_cast<unsigned int>(turn + 1);
+                const Clock::time_point sent_at = Clock::now();
+                bot.send(frames.frames[turn] + "\n");
+                bot.receive_line();
+                sample.turn_millis = millis_between(sent_at, Clock::now());
+                report.turns.push_back(sample);
+            }
+            return report;
+        }
+#endif
+
+        void print_report(std::ostream& out, const Report& report) {
+            out << report.turns.size() << " turns, " << report.description << ":\n";
+            if (report.turns.empty()) {
+                return;
+            }
+
+            std::vector<double> parse, turn;
+            for (const TurnSample& sample : report.turns) {
+                parse.push_back(sample.parse_millis);
+                turn.push_back(sample.turn_millis);
+            }
+            out << std::fixed << std::setprecision(3);
+            if (report.in_process) {
+                print_percentiles(out, "parse", parse);
+            }
+            print_percentiles(out, "turn", turn);
+
+            const size_t over_limit = static_cast<size_t>(std::count_if(
+                    report.turns.begin(), report.turns.end(), [](const TurnSample& sample) {
+                        return sample.parse_millis + sample.turn_millis > constants::FRAME_TIME_LIMIT_MILLIS;
+                    }));
+            out << "  turns over the " << constants::FRAME_TIME_LIMIT_MILLIS << " ms limit: " << over_limit << "\n";
+
+            std::vector<TurnSample> slowest = report.turns;
+            const size_t shown = std::min<size_t>(5, slowest.size());
+            std::partial_sort(slowest.begin(), slowest.begin() + shown, slowest.end(),
+                              [](const TurnSample& a, const TurnSample& b) {
+                                  return a.parse_millis + a.turn_millis > b.parse_millis + b.turn_millis;
+                              });
+            out << "  slowest turns:";
+            for (size_t i = 0; i < shown; ++i) {
+                out << " " << slowest[i].turn << " (" << slowest[i].parse_millis + slowest[i].turn_millis << " ms)";
+            }
+            out << "\n";
+
+            if (report.counted_allocations) {
+                unsigned long long total = 0, total_bytes = 0, most = 0;
+                for (const TurnSample& sample : report.turns) {
+                    total += sample.allocations;
+                    total_bytes += sample.allocated_bytes;
+                    most = std::max(most, sample.allocations);
+                }
+                out << std::setprecision(1)
+                    << "  allocations per turn: average " << static_cast<double>(total) / report.turns.size()
+                    << ", max " << most
+                    << "; bytes per turn: average " << static_cast<double>(total_bytes) / report.turns.size()
+                    << "\n";
+            } else if (report.in_process) {
+                out << "  allocations: not counted (build with HLT_COUNT_ALLOCATIONS defined)\n";
+            }
+            out << std::defaultfloat << std::setprecision(6);
+        }
+
+        bool is_bench(const int argc, const char* const* argv) {
+            if (argc < 2) {
+                return false;
+            }
+            const std::string mode = argv[1];
+            return mode == "--bench" || mode == "--bench-binary";
+        }
+
+        int main(const int argc, const char* const* argv, const PlayTurn& play_turn) {
+            const std::string mode = argc > 1 ? argv[1] : "";
+            const bool binary = mode == "--bench-binary";
+            if (!is_bench(argc, argv) || argc < (binary ? 4 : 3)) {
+                std::cerr << "Usage: " << argv[0] << " --bench FRAMES [PLAYER [REPETITIONS]]\n"
+                          << "       " << argv[0] << " --bench-binary FRAMES COMMAND [PLAYER]\n"
+                          << "FRAMES is written from a replay by halite --export-frames.\n";
+                return 2;
+            }
+
+            try {
+                const FrameFile frames = read_frame_file(argv[2]);
+                Report report;
+                if (binary) {
+                    const PlayerId player_id = argc > 4 ? std::atoi(argv[4]) : 0;
+                    report = run_binary(frames, player_id, argv[3]);
+                } else {
+                    const PlayerId player_id = argc > 3 ? std::atoi(argv[3]) : 0;
+                    const int repetitions = argc > 4 ? std::max(1, std::atoi(argv[4])) : 1;
+                    report = run_in_process(frames, player_id, play_turn, static_cast<unsigned int>(repetitions));
+                }
+                print_report(std::cout, report);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << "\n";
+                return 1;
+            }
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "map.hpp"
+#include "move.hpp"
+#include "types.hpp"
+
+namespace hlt {
+    /**
+     * Replaying a recorded game to a bot offline, turn by turn, to see how
+     * long its turns take on real (and late, crowded) states without
+     * playing whole games. The bot is fed the game's frames whatever moves
+     * it makes, so every run sees exactly the same states.
+     *
+     * The frames come from a frame file, which the game environment writes
+     * from a replay:
+     *
+     *     halite --export-frames replay.hlt        # writes replay.frames
+     *
+     * A bot that does its turns in a function can time them in-process,
+     * with allocations counted if built with HLT_COUNT_ALLOCATIONS; any bot
+     * binary can be timed from the outside, over pipes, as the game runs
+     * it. bench::main handles the command lines for both:
+     *
+     *     MyBot --bench replay.frames [PLAYER [REPETITIONS]]
+     *     MyBot --bench-binary replay.frames COMMAND [PLAYER]
+     */
+    namespace bench {
+        /// The frames of a game, as bots are sent them.
+        struct FrameFile {
+            int map_width, map_height;
+            /// The initial map, then the map after each turn.
+            std::vector<std::string> frames;
+        };
+
+        /// Throws std::runtime_error if the file can't be read or isn't one.
+        FrameFile read_frame_file(const std::string& filename);
+
+        /// A bot's turn: the moves for the map, added to moves (which is empty).
+        typedef std::function<void(const Map& map, PlayerId player_id, std::vector<Move>& moves)> PlayTurn;
+
+        struct TurnSample {
+            unsigned int turn;
+            /// Parsing the frame, which the bot's own reader does in-process;
+            /// 0 from the outside.
+            double parse_millis;
+            /// The turn itself in-process; from the outside, from sending
+            /// the frame to the reply's newline.
+            double turn_millis;
+            /// Made during the turn, if counted.
+            unsigned long long allocations, allocated_bytes;
+        };
+
+        struct Report {
+            std::string description;
+            std::vector<TurnSample> turns;
+            bool in_process = false;
+            /// Whether TurnSample's allocations were counted.
+            bool counted_allocations = false;
+        };
+
+        /// Feed every turn's frame to play_turn, the whole game repetitions
+        /// times, as player_id.
+        Report run_in_process(const FrameFile& frames, PlayerId player_id, const PlayTurn& play_turn,
+                              unsigned int repetitions = 1);
+
+        /// Run command (through /bin/sh) as player_id and feed it every
+        /// turn's frame as the game would, waiting for its reply to each.
+        /// The bot has to take text frames. Throws std::runtime_error if it
+        /// can't be run or stops replying; POSIX only.
+        Report run_binary(const FrameFile& frames, PlayerId player_id, const std::string& command);
+
+        /// Latency percentiles, the slowest turns, turns over the game's
+        /// time limit and allocations.
+        void print_report(std::ostream& out, const Report& report);
+
+        /// Whether the command line asks for a bench run.
+        bool is_bench(int argc, const char* const* argv);
+
+        /// Run and report the bench the command line asks for. Returns the
+        /// exit status for main.
+        int main(int argc, const char* const* argv, const PlayTurn& play_turn);
+    }
+}
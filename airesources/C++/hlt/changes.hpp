@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vector>
+
+#include "map.hpp"
+#include "types.hpp"
+
+namespace hlt {
+    /// Something that happened to a ship or planet between one map and the next.
+    struct MapChange {
+        enum class Kind {
+            ShipSpawned,
+            ShipDestroyed,
+            /// The ship's docking status changed to Docking, Docked,
+            /// Undocking or Undocked, in turn.
+            ShipDocking,
+            ShipDocked,
+            ShipUndocking,
+            ShipUndocked,
+            /// Owned by another player, or by no one, or newly by someone.
+            PlanetOwnerChanged,
+            PlanetDestroyed,
+        };
+
+        Kind kind;
+        EntityId entity_id;
+        /// The ship's owner, or the planet's owner after the change (-1 for
+        /// no one).
+        PlayerId owner_id;
+        /// The planet's owner before the change; the ship's owner again.
+        PlayerId previous_owner_id;
+    };
+
+    /// The changes from one map to the next: ships first, then planets.
+    typedef std::vector<MapChange> MapChanges;
+
+    static MapChange::Kind docking_change(const ShipDockingStatus status) {
+        switch (status) {
+            case ShipDockingStatus::Docking:
+                return MapChange::Kind::ShipDocking;
+            case ShipDockingStatus::Docked:
+                return MapChange::Kind::ShipDocked;
+            case ShipDockingStatus::Undocking:
+                return MapChange::Kind::ShipUndocking;
+            default:
+                return MapChange::Kind::ShipUndocked;
+        }
+    }
+
+    /**
+     * Works out the changes between the maps it's given in turn, from what
+     * it kept from the last one: each ship's owner and docking status, and
+     * each planet's owner, in tables indexed by ID (the game hands out IDs
+     * to ships of all players from one counter). This costs a pass over the
+     * entities and doesn't allocate once the tables have grown.
+     */
+    class ChangeTracker {
+    public:
+        /// Remember map without reporting anything, as the first map.
+        void reset(const Map& map) {
+            for (const EntityId ship_id : ship_ids) {
+                ships[ship_id].present = false;
+            }
+            for (const EntityId planet_id : planet_ids) {
+                planets[planet_id].present = false;
+            }
+            remember(map);
+        }
+
+        /// The changes from the map last given to this one, into changes
+        /// (which is cleared first).
+        void update(const Map& map, MapChanges& changes) {
+            changes.clear();
+
+            for (const auto& player_ships : map.ships) {
+                for (const Ship& ship : player_ships.second) {
+                    if (ship.entity_id >= ships.size() || !ships[ship.entity_id].present) {
+                        changes.push_back({ MapChange::Kind::ShipSpawned, ship.entity_id, ship.owner_id, ship.owner_id });
+                    } else if (ships[ship.entity_id].docking_status != ship.docking_status) {
+                        changes.push_back({ docking_change(ship.docking_status), ship.entity_id, ship.owner_id,
+                                            ship.owner_id });
+                    }
+                }
+            }
+            for (const EntityId ship_id : ship_ids) {
+                const PlayerId owner_id = ships[ship_id].owner_id;
+                const auto ship_map = map.ship_map.find(owner_id);
+                if (ship_map == map.ship_map.end() || ship_map->second.count(ship_id) == 0) {
+                    changes.push_back({ MapChange::Kind::ShipDestroyed, ship_id, owner_id, owner_id });
+                }
+                ships[ship_id].present = false;
+            }
+
+            for (const Planet& planet : map.planets) {
+                if (planet.entity_id >= planets.size() || !planets[planet.entity_id].present) {
+                    continue;
+                }
+                const PlayerId previous_owner_id = planets[planet.entity_id].owner_id;
+                const PlayerId owner_id = static_cast<PlayerId>(planet.owner_id);
+                if (owner_id != previous_owner_id) {
+                    changes.push_back({ MapChange::Kind::PlanetOwnerChanged, planet.entity_id, owner_id,
+                                        previous_owner_id });
+                }
+            }
+            for (const EntityId planet_id : planet_ids) {
+                if (map.planet_map.count(planet_id) == 0) {
+                    const PlayerId owner_id = planets[planet_id].owner_id;
+                    changes.push_back({ MapChange::Kind::PlanetDestroyed, planet_id, owner_id, owner_id });
+                }
+                planets[planet_id].present = false;
+            }
+
+            remember(map);
+        }
+
+    private:
+        struct Seen {
+            bool present = false;
+            PlayerId owner_id = -1;
+            ShipDockingStatus docking_status = ShipDockingStatus::Undocked;
+        };
+
+        //! What was seen of each entity in the last map, by ID, and the IDs
+        //! that were in it.
+        std::vector<Seen> ships;
+        std::vector<Seen> planets;
+        std::vector<EntityId> ship_ids;
+        std::vector<EntityId> planet_ids;
+
+        static Seen& seen(std::vector<Seen>& table, const EntityId entity_id) {
+            if (entity_id >= table.size()) {
+                table.resize(entity_id + 1);
+            }
+            return table[entity_id];
+        }
+
+        void remember(const Map& map) {
+            ship_ids.clear();
+            for (const auto& player_ships : map.ships) {
+                for (const Ship& ship : player_ships.second) {
+                    Seen& ship_seen = seen(ships, ship.entity_id);
+                    ship_seen.present = true;
+                    ship_seen.owner_id = ship.owner_id;
+                    ship_seen.docking_status = ship.docking_status;
+                    ship_ids.push_back(ship.entity_id);
+                }
+            }
+
+            planet_ids.clear();
+            for (const Planet& planet : map.planets) {
+                Seen& planet_seen = seen(planets, planet.entity_id);
+                planet_seen.present = true;
+                planet_seen.owner_id = static_cast<PlayerId>(planet.owner_id);
+                planet_ids.push_back(planet.entity_id);
+            }
+        }
+    };
+}
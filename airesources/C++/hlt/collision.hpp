@@ -1,6 +1,16 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HLT_COLLISION_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HLT_COLLISION_NEON
+#endif
 
 #include "entity.hpp"
 #include "location.hpp"
@@ -16,53 +26,178 @@ namespace hlt {
          *
          * @param start  The start of the segment.
          * @param end    The end of the segment.
-         * @param circle The circle to test against.
+         * @param center_x, center_y, radius The circle to test against.
          * @param fudge  An additional safety zone to leave when looking for collisions. Probably set it to ship radius.
          * @return true if the segment intersects, false otherwise
          */
         static bool segment_circle_intersect(
                 const Location& start,
                 const Location& end,
-                const Entity& circle,
+                const double center_x,
+                const double center_y,
+                const double radius,
                 const double fudge)
         {
-            // Parameterize the segment as start + t * (end - start),
-            // and substitute into the equation of a circle
-            // Solve for t
-            const double circle_radius = circle.radius;
-            const double start_x = start.pos_x;
-            const double start_y = start.pos_y;
-            const double end_x = end.pos_x;
-            const double end_y = end.pos_y;
-            const double center_x = circle.location.pos_x;
-            const double center_y = circle.location.pos_y;
-            const double dx = end_x - start_x;
-            const double dy = end_y - start_y;
-
+            // Parameterize the segment as start + t * (end - start), and
+            // find the t of the point closest to the circle's center
+            const double dx = end.pos_x - start.pos_x;
+            const double dy = end.pos_y - start.pos_y;
             const double a = square(dx) + square(dy);
 
-            const double b =
-                    -2 * (square(start_x) - (start_x * end_x)
-                    - (start_x * center_x) + (end_x * center_x)
-                    + square(start_y) - (start_y * end_y)
-                    - (start_y * center_y) + (end_y * center_y));
-
             if (a == 0.0) {
                 // Start and end are the same point
-                return start.get_distance_to(circle.location) <= circle_radius + fudge;
+                return start.get_distance_to({ center_x, center_y }) <= radius + fudge;
             }
 
-            // Time along segment when closest to the circle (vertex of the quadratic)
-            const double t = std::min(-b / (2 * a), 1.0);
+            const double t = std::min(((center_x - start.pos_x) * dx + (center_y - start.pos_y) * dy) / a, 1.0);
             if (t < 0) {
+                // The circle is behind the start
                 return false;
             }
 
-            const double closest_x = start_x + dx * t;
-            const double closest_y = start_y + dy * t;
-            const double closest_distance = Location{ closest_x, closest_y }.get_distance_to(circle.location);
+            const Location closest = { start.pos_x + dx * t, start.pos_y + dy * t };
+            return closest.get_distance_to({ center_x, center_y }) <= radius + fudge;
+        }
 
-            return closest_distance <= circle_radius + fudge;
+        static bool segment_circle_intersect(
+                const Location& start,
+                const Location& end,
+                const Entity& circle,
+                const double fudge)
+        {
+            return segment_circle_intersect(
+                    start, end, circle.location.pos_x, circle.location.pos_y, circle.radius, fudge);
+        }
+
+        /// Circles to test a segment against all at once, with their
+        /// centers and radii in separate arrays so they load straight into
+        /// SIMD registers.
+        struct CircleBatch {
+            std::vector<double> center_x;
+            std::vector<double> center_y;
+            std::vector<double> radius;
+
+            size_t size() const {
+                return radius.size();
+            }
+
+            void clear() {
+                center_x.clear();
+                center_y.clear();
+                radius.clear();
+            }
+
+            void add(const Entity& circle) {
+                center_x.push_back(circle.location.pos_x);
+                center_y.push_back(circle.location.pos_y);
+                radius.push_back(circle.radius);
+            }
+        };
+
+        /**
+         * Test a segment against up to 64 circles of a batch, starting at
+         * first, as segment_circle_intersect does with each.
+         *
+         * @return A mask with bit i set if circle first + i intersects.
+         */
+        static uint64_t segment_circles_intersect(
+                const Location& start,
+                const Location& end,
+                const CircleBatch& circles,
+                const size_t first,
+                const double fudge)
+        {
+            const size_t count = first < circles.size() ? std::min<size_t>(circles.size() - first, 64) : 0;
+            const double* const center_x = circles.center_x.data() + first;
+            const double* const center_y = circles.center_y.data() + first;
+            const double* const radius = circles.radius.data() + first;
+            uint64_t hits = 0;
+            size_t i = 0;
+
+            const double dx = end.pos_x - start.pos_x;
+            const double dy = end.pos_y - start.pos_y;
+            if (square(dx) + square(dy) != 0.0) {
+                // The same steps as segment_circle_intersect, two circles at
+                // a time, so the results are exactly the same
+#if defined(HLT_COLLISION_SSE2)
+                const __m128d start_x = _mm_set1_pd(start.pos_x);
+                const __m128d start_y = _mm_set1_pd(start.pos_y);
+                const __m128d segment_dx = _mm_set1_pd(dx);
+                const __m128d segment_dy = _mm_set1_pd(dy);
+                const __m128d a = _mm_set1_pd(square(dx) + square(dy));
+                const __m128d zero = _mm_setzero_pd();
+                const __m128d one = _mm_set1_pd(1.0);
+                const __m128d margin = _mm_set1_pd(fudge);
+                for (; i + 2 <= count; i += 2) {
+                    const __m128d cx = _mm_loadu_pd(center_x + i);
+                    const __m128d cy = _mm_loadu_pd(center_y + i);
+                    const __m128d dot = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(cx, start_x), segment_dx),
+                                                   _mm_mul_pd(_mm_sub_pd(cy, start_y), segment_dy));
+                    const __m128d t = _mm_min_pd(_mm_div_pd(dot, a), one);
+                    const __m128d offset_x = _mm_sub_pd(_mm_add_pd(start_x, _mm_mul_pd(segment_dx, t)), cx);
+                    const __m128d offset_y = _mm_sub_pd(_mm_add_pd(start_y, _mm_mul_pd(segment_dy, t)), cy);
+                    const __m128d distance = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(offset_x, offset_x),
+                                                                    _mm_mul_pd(offset_y, offset_y)));
+                    const __m128d reach = _mm_add_pd(_mm_loadu_pd(radius + i), margin);
+                    const int mask = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(t, zero),
+                                                                _mm_cmple_pd(distance, reach)));
+                    hits |= static_cast<uint64_t>(mask) << i;
+                }
+#elif defined(HLT_COLLISION_NEON)
+                const float64x2_t start_x = vdupq_n_f64(start.pos_x);
+                const float64x2_t start_y = vdupq_n_f64(start.pos_y);
+                const float64x2_t segment_dx = vdupq_n_f64(dx);
+                const float64x2_t segment_dy = vdupq_n_f64(dy);
+                const float64x2_t a = vdupq_n_f64(square(dx) + square(dy));
+                const float64x2_t zero = vdupq_n_f64(0.0);
+                const float64x2_t one = vdupq_n_f64(1.0);
+                const float64x2_t margin = vdupq_n_f64(fudge);
+                for (; i + 2 <= count; i += 2) {
+                    const float64x2_t cx = vld1q_f64(center_x + i);
+                    const float64x2_t cy = vld1q_f64(center_y + i);
+                    const float64x2_t dot = vaddq_f64(vmulq_f64(vsubq_f64(cx, start_x), segment_dx),
+                                                      vmulq_f64(vsubq_f64(cy, start_y), segment_dy));
+                    const float64x2_t t = vminq_f64(vdivq_f64(dot, a), one);
+                    const float64x2_t offset_x = vsubq_f64(vaddq_f64(start_x, vmulq_f64(segment_dx, t)), cx);
+                    const float64x2_t offset_y = vsubq_f64(vaddq_f64(start_y, vmulq_f64(segment_dy, t)), cy);
+                    const float64x2_t distance = vsqrtq_f64(vaddq_f64(vmulq_f64(offset_x, offset_x),
+                                                                      vmulq_f64(offset_y, offset_y)));
+                    const float64x2_t reach = vaddq_f64(vld1q_f64(radius + i), margin);
+                    const uint64x2_t mask = vandq_u64(vcgeq_f64(t, zero), vcleq_f64(distance, reach));
+                    hits |= (vgetq_lane_u64(mask, 0) & 1) << i;
+                    hits |= (vgetq_lane_u64(mask, 1) & 1) << (i + 1);
+                }
+#endif
+            }
+
+            for (; i < count; ++i) {
+                if (segment_circle_intersect(start, end, center_x[i], center_y[i], radius[i], fudge)) {
+                    hits |= uint64_t(1) << i;
+                }
+            }
+            return hits;
+        }
+
+        /// The first circle of the batch, from first on, that the segment
+        /// intersects, or circles.size() if none does.
+        static size_t segment_first_circle_intersect(
+                const Location& start,
+                const Location& end,
+                const CircleBatch& circles,
+                const double fudge,
+                size_t first = 0)
+        {
+            for (; first < circles.size(); first += 64) {
+                uint64_t hits = segment_circles_intersect(start, end, circles, first, fudge);
+                if (hits != 0) {
+                    size_t hit = first;
+                    for (; (hits & 1) == 0; hits >>= 1) {
+                        ++hit;
+                    }
+                    return hit;
+                }
+            }
+            return circles.size();
         }
     }
 }
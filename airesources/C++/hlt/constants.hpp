@@ -41,9 +41,33 @@ namespace hlt {
         /** Number of production units per turn contributed by each docked ship */
         constexpr int BASE_PRODUCTIVITY = 6;
 
+        /** Additional production units per turn for each docked ship after the first */
+        constexpr int ADDITIONAL_PRODUCTIVITY = 6;
+
+        /** Production units it takes to make a ship */
+        constexpr int PRODUCTION_PER_SHIP = 72;
+
+        /** Whether planets never run out of production */
+        constexpr bool INFINITE_RESOURCES = true;
+
+        /** Health docked ships regain each turn */
+        constexpr int DOCKED_SHIP_REGENERATION = 0;
+
         /** Distance from the planets edge at which new ships are created */
         constexpr int SPAWN_RADIUS = 2;
 
+        /** The most thrust a ship can be given in one turn */
+        constexpr int MAX_ACCELERATION = 7;
+
+        /** Speed ships lose at the end of each turn, which is enough to stop them */
+        constexpr double DRAG = 10.0;
+
+        /** Milliseconds bots have to send their name, from getting the initial map */
+        constexpr int INIT_TIME_LIMIT_MILLIS = 60000;
+
+        /** Milliseconds bots have to reply to each map after that */
+        constexpr int FRAME_TIME_LIMIT_MILLIS = 2000;
+
         ////////////////////////////////////////////////////////////////////////
         // Implementation-specific constants
 
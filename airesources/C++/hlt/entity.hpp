@@ -4,12 +4,13 @@
 #include "types.hpp"
 
 namespace hlt {
+    /// With HLT_COMPACT_ENTITIES, fields are stored narrower (see types.hpp).
     struct Entity {
         EntityId entity_id;
-        PlayerId owner_id;
         Location location;
-        int health;
-        double radius;
+        Coordinate radius;
+        StoredPlayerId owner_id;
+        StoredHealth health;
 
         bool is_alive() const {
             return health > 0;
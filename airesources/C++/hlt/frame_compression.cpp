@@ -0,0 +1,83 @@
+#include "frame_compression.hpp"
+#include "log.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef HLT_ZSTD_FRAMES
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#endif
+
+namespace hlt {
+    namespace in {
+#ifdef HLT_ZSTD_FRAMES
+        //! The game's stream, which runs through the whole game.
+        static ZSTD_DStream* g_stream = nullptr;
+        static std::string g_dictionary;
+
+        bool start_decompressing(const FrameCompression& compression) {
+            g_dictionary.clear();
+            if (!compression.dictionary_path.empty()) {
+                std::ifstream file(compression.dictionary_path, std::ios::binary);
+                std::stringstream contents;
+                contents << file.rdbuf();
+                if (!file) {
+                    Log::log("Could not read the frame dictionary " + compression.dictionary_path);
+                    return false;
+                }
+                g_dictionary = contents.str();
+            }
+
+            if (g_stream == nullptr) {
+                g_stream = ZSTD_createDStream();
+            }
+#if ZSTD_VERSION_NUMBER >= 10400
+            // Loading a dictionary into a stream only became stable in 1.4
+            const bool started = g_stream != nullptr &&
+                    !ZSTD_isError(ZSTD_DCtx_reset(g_stream, ZSTD_reset_session_and_parameters)) &&
+                    !ZSTD_isError(ZSTD_DCtx_loadDictionary(g_stream, g_dictionary.data(), g_dictionary.size()));
+#else
+            const bool started = g_stream != nullptr &&
+                    !ZSTD_isError(ZSTD_initDStream_usingDict(g_stream, g_dictionary.data(), g_dictionary.size()));
+#endif
+            if (!started) {
+                Log::log("Could not start decompressing frames");
+            }
+            return started;
+        }
+
+        void decompress_frame(const std::string& compressed, std::string& out) {
+            out.clear();
+            ZSTD_inBuffer input = { compressed.data(), compressed.size(), 0 };
+            size_t filled = 0;
+            // Until all input is taken, and zstd has room to spare for the rest
+            // of what it has
+            while (true) {
+                out.resize(filled + ZSTD_DStreamOutSize());
+                ZSTD_outBuffer output = { &out[filled], out.size() - filled, 0 };
+                const size_t result = ZSTD_decompressStream(g_stream, &output, &input);
+                if (ZSTD_isError(result)) {
+                    throw std::runtime_error(std::string("Could not decompress a frame: ") +
+                                             ZSTD_getErrorName(result));
+                }
+                filled += output.pos;
+                if (input.pos == input.size && output.pos < output.size) {
+                    break;
+                }
+            }
+            out.resize(filled);
+        }
+#else
+        bool start_decompressing(const FrameCompression&) {
+            Log::log("Compressed frames need the kit built with HLT_ZSTD_FRAMES; asking for them as they are");
+            return false;
+        }
+
+        void decompress_frame(const std::string&, std::string&) {
+            throw std::runtime_error("The kit was built without HLT_ZSTD_FRAMES");
+        }
+#endif
+    }
+}
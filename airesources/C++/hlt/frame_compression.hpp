@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+namespace hlt {
+    namespace in {
+        /**
+         * Having the game compress every map after the initial one with
+         * zstd, for bots far from it, e.g. connected over the network (see
+         * ZSTD_FRAMES_OPTION in the game environment's Networking.hpp). It
+         * works with any frame format, but not through shared memory.
+         *
+         * This needs the kit built with HLT_ZSTD_FRAMES, which links it
+         * with zstd (see CMakeLists.txt); otherwise maps are sent as they
+         * are.
+         */
+        struct FrameCompression {
+            /// The zstd level to ask for, or 0 for none.
+            int level = 0;
+            /// The dictionary the game was given with --frame-dictionary,
+            /// if any.
+            std::string dictionary_path;
+        };
+
+        /// Get ready to decompress the game's stream. False, after logging
+        /// why, if that can't be done.
+        bool start_decompressing(const FrameCompression& compression);
+
+        /// Decompress the next part of the stream (a frame's bytes, after
+        /// their length) into out. Throws std::runtime_error if it's not
+        /// what a frame compressed by the game looks like.
+        void decompress_frame(const std::string& compressed, std::string& out);
+    }
+}
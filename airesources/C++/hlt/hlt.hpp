@@ -1,6 +1,12 @@
 #pragma once
 
 #include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 #include "log.hpp"
 #include "hlt_in.hpp"
@@ -13,8 +19,23 @@ namespace hlt {
     };
 
     /// Initialize our bot with the given name, getting back some metadata.
-    static Metadata initialize(const std::string& bot_name) {
+    ///
+    /// The frame format chooses how the game sends every map after the
+    /// initial one (see in::FrameFormat). With use_shared_memory, they are
+    /// passed through shared memory if the game offers it (see
+    /// shared_memory.hpp). With compression, they are compressed, for bots
+    /// far from the game (see frame_compression.hpp).
+    static Metadata initialize(const std::string& bot_name,
+                               in::FrameFormat frame_format = in::FrameFormat::Text,
+                               bool use_shared_memory = false,
+                               const in::FrameCompression& compression = in::FrameCompression()) {
         std::cout.sync_with_stdio(false);
+#ifdef _WIN32
+        if (frame_format == in::FrameFormat::Binary || compression.level > 0) {
+            // Don't let the C runtime translate line endings in binary frames.
+            _setmode(_fileno(stdin), _O_BINARY);
+        }
+#endif
 
         std::stringstream iss1(in::get_string());
         int player_id;
@@ -27,7 +48,7 @@ namespace hlt {
 
         Log::open(std::to_string(player_id) + "_" + bot_name + ".log");
 
-        in::setup(bot_name, map_width, map_height);
+        in::setup(bot_name, map_width, map_height, frame_format, use_shared_memory, compression);
 
         return {
                 static_cast<PlayerId>(player_id),
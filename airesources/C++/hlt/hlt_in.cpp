@@ -1,40 +1,279 @@
 #include "hlt_in.hpp"
+#include "arena.hpp"
+#include "constants.hpp"
 #include "log.hpp"
 #include "hlt_out.hpp"
+#include "shared_memory.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace hlt {
     namespace in {
+        /// Reads stdin in large blocks, handing out lines and frames from
+        /// where they landed rather than through iostreams.
+        class StdinBuffer {
+        public:
+            /// Find the next line, without its newline. The line is only
+            /// valid until the next read. False at the end of input.
+            bool line(const char*& begin, const char*& end) {
+                // How much of what's left is known to have no newline
+                size_t scanned = 0;
+                while (true) {
+                    const char* left = buffer.data() + start;
+                    const char* newline = static_cast<const char*>(
+                            std::memchr(left + scanned, '\n', filled - start - scanned));
+                    if (newline != nullptr) {
+                        begin = left;
+                        end = newline;
+                        start = static_cast<size_t>(newline - buffer.data()) + 1;
+                        if (end != begin && end[-1] == '\r') {
+                            --end;
+                        }
+                        return true;
+                    }
+                    scanned = filled - start;
+                    if (!fill()) {
+                        return false;
+                    }
+                }
+            }
+
+            /// When the next byte to hand out was read, waiting for it if
+            /// need be. False at the end of input.
+            bool wait(std::chrono::steady_clock::time_point& read_at) {
+                if (filled == start && !fill()) {
+                    return false;
+                }
+                // Anything left over came in with the latest read
+                read_at = last_read;
+                return true;
+            }
+
+            /// Read exactly count bytes into out.
+            bool bytes(size_t count, std::string& out) {
+                while (filled - start < count) {
+                    if (!fill()) {
+                        return false;
+                    }
+                }
+                out.assign(buffer.data() + start, count);
+                start += count;
+                return true;
+            }
+
+        private:
+            std::vector<char> buffer = std::vector<char>(1 << 16);
+            //! What's been read but not handed out is [start, filled).
+            size_t start = 0;
+            size_t filled = 0;
+            std::chrono::steady_clock::time_point last_read;
+
+            /// Read more, after moving what's left to the front of the buffer
+            /// and growing it if that's full. False at the end of input.
+            bool fill() {
+                if (start > 0) {
+                    std::memmove(buffer.data(), buffer.data() + start, filled - start);
+                    filled -= start;
+                    start = 0;
+                }
+                if (filled == buffer.size()) {
+                    buffer.resize(buffer.size() * 2);
+                }
+                while (true) {
+#ifdef _WIN32
+                    const int result = _read(0, buffer.data() + filled, static_cast<unsigned int>(buffer.size() - filled));
+#else
+                    const ssize_t result = read(0, buffer.data() + filled, buffer.size() - filled);
+#endif
+                    if (result > 0) {
+                        last_read = std::chrono::steady_clock::now();
+                        filled += static_cast<size_t>(result);
+                        return true;
+                    }
+                    if (result == 0 || errno != EINTR) {
+                        return false;
+                    }
+                }
+            }
+        };
+
+        static StdinBuffer g_stdin;
+        static TurnClock g_turn_clock;
+        static bool g_turn_clock_started = false;
+
+        void start_turn_clock(const std::chrono::steady_clock::time_point start, const int limit_millis) {
+            g_turn_clock.start = start;
+            g_turn_clock.deadline = start + std::chrono::milliseconds(limit_millis);
+            g_turn_clock_started = true;
+        }
+
+        std::string get_string() {
+            const char* begin;
+            const char* end;
+            std::chrono::steady_clock::time_point read_at;
+            if (!g_turn_clock_started && g_stdin.wait(read_at)) {
+                // The player ID, the first the game sends us
+                start_turn_clock(read_at, constants::INIT_TIME_LIMIT_MILLIS);
+            }
+            if (!g_stdin.line(begin, end)) {
+                return std::string();
+            }
+            return std::string(begin, end);
+        }
+
+        bool get_binary_frame(std::string& payload) {
+            std::string header;
+            if (!g_stdin.bytes(4, header)) {
+                return false;
+            }
+            BinaryReader reader { header.data(), header.data() + header.size() };
+            return g_stdin.bytes(reader.u32(), payload);
+        }
+
         static std::string g_bot_name;
-        static int g_map_width;
-        static int g_map_height;
+        static FrameFormat g_frame_format;
         static int g_turn = 0;
+        //! The last map we got, which every frame is parsed into.
+        static Map g_map(0, 0);
+        //! Frames that aren't parsed straight from g_stdin, kept to reuse
+        //! its memory.
+        static std::string g_input;
+        //! Whether frames after the initial map come compressed, and the
+        //! latest as it came.
+        static bool g_compressed_frames = false;
+        static std::string g_compressed;
+        static ChangeTracker g_change_tracker;
+        static MapChanges g_changes;
 
-        void setup(const std::string& bot_name, int map_width, int map_height) {
+        void setup(const std::string& bot_name, int map_width, int map_height, FrameFormat frame_format,
+                   bool use_shared_memory, const FrameCompression& compression) {
             g_bot_name = bot_name;
-            g_map_width = map_width;
-            g_map_height = map_height;
+            g_map.map_width = map_width;
+            g_map.map_height = map_height;
+            g_frame_format = frame_format;
+
+            if (use_shared_memory && shared_memory::open()) {
+                g_bot_name += "\tshared-memory";
+            }
+            // Frames through shared memory aren't compressed
+            g_compressed_frames = compression.level > 0 && !shared_memory::is_open() &&
+                                  start_decompressing(compression);
+            if (g_compressed_frames) {
+                g_bot_name += "\tzstd-frames=" + std::to_string(compression.level);
+            }
         }
 
-        const Map get_map() {
+        const Map& update_map() {
+            // What was allocated for the last turn goes with the last map
+            arena::next_turn();
+
             if (g_turn == 1) {
-                out::send_string(g_bot_name);
+                // Ask for another frame format after our name, if wanted
+                switch (g_frame_format) {
+                    case FrameFormat::Binary:
+                        out::send_string(g_bot_name + "\tbinary-frames");
+                        break;
+                    case FrameFormat::Delta:
+                        out::send_string(g_bot_name + "\tdelta-frames");
+                        break;
+                    default:
+                        out::send_string(g_bot_name);
+                        break;
+                }
             }
 
-            const std::string input = get_string();
+            // The initial map is always sent as text. Text frames from stdin
+            // are parsed where they were read; the rest land in g_input.
+            const FrameFormat format = g_turn > 0 ? g_frame_format : FrameFormat::Text;
+            const char* begin = nullptr;
+            const char* end = nullptr;
+            std::chrono::steady_clock::time_point read_at;
+            bool got_frame;
+            if (g_turn > 0 && shared_memory::is_open()) {
+                got_frame = shared_memory::get_frame(format, g_input);
+                read_at = std::chrono::steady_clock::now();
+            } else if (!g_stdin.wait(read_at)) {
+                got_frame = false;
+            } else if (g_turn > 0 && g_compressed_frames) {
+                // Framed like a binary frame, and decompressed into what
+                // would have been sent otherwise
+                got_frame = get_binary_frame(g_compressed);
+                if (got_frame) {
+                    try {
+                        decompress_frame(g_compressed, g_input);
+                    } catch (const std::runtime_error& e) {
+                        // e.g. without the game's dictionary
+                        Log::log(e.what());
+                        std::exit(1);
+                    }
+                    if (format == FrameFormat::Binary) {
+                        // Drop its length
+                        g_input.erase(0, std::min<size_t>(4, g_input.size()));
+                    }
+                }
+            } else if (format == FrameFormat::Binary) {
+                got_frame = get_binary_frame(g_input);
+            } else {
+                got_frame = g_stdin.line(begin, end);
+            }
 
-            if (!std::cin.good()) {
+            if (!got_frame) {
                 // This is needed on Windows to detect that game engine is done.
                 std::exit(0);
             }
+            if (begin == nullptr) {
+                begin = g_input.data();
+                end = g_input.data() + g_input.size();
+            }
 
             if (g_turn == 0) {
                 Log::log("--- PRE-GAME ---");
             } else {
+                // The initial map's clock runs until we send our name
+                start_turn_clock(read_at, constants::FRAME_TIME_LIMIT_MILLIS);
                 Log::log("--- TURN " + std::to_string(g_turn) + " ---");
             }
             ++g_turn;
 
-            return parse_map(input, g_map_width, g_map_height);
+            switch (format) {
+                case FrameFormat::Binary:
+                    parse_binary_map(g_input, g_map);
+                    break;
+                case FrameFormat::Delta:
+                    apply_delta(g_map, begin, end, &g_changes);
+                    return g_map;
+                default:
+                    parse_map(begin, end, g_map);
+                    break;
+            }
+
+            if (g_turn == 1) {
+                g_change_tracker.reset(g_map);
+                g_changes.clear();
+            } else {
+                g_change_tracker.update(g_map, g_changes);
+            }
+            return g_map;
+        }
+
+        const Map get_map() {
+            return update_map();
+        }
+
+        const MapChanges& changes() {
+            return g_changes;
+        }
+
+        const TurnClock& turn_clock() {
+            return g_turn_clock;
         }
     }
 }
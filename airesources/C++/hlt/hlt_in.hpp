@@ -1,127 +1,455 @@
 #pragma once
 
-#include <sstream>
-#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
 
+#include "changes.hpp"
+#include "frame_compression.hpp"
 #include "map.hpp"
+#include "turn_clock.hpp"
 
 namespace hlt {
     namespace in {
-        static std::string get_string() {
-            std::string result;
-            std::getline(std::cin, result);
-            return result;
-        }
+        /// Read the next line from the game, without its newline. Empty at
+        /// the end of input.
+        std::string get_string();
 
-        static std::pair<EntityId, Ship> parse_ship(std::stringstream& iss, const PlayerId owner_id) {
-            Ship ship;
+        /// Parses the fields of a text frame in order, straight from where
+        /// it was read, without copying it into a stream first.
+        struct TextReader {
+            const char* cursor;
+            const char* end;
 
-            iss >> ship.entity_id;
-            iss >> ship.location.pos_x;
-            iss >> ship.location.pos_y;
-            iss >> ship.health;
+            void skip_space() {
+                while (cursor != end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n')) {
+                    ++cursor;
+                }
+            }
 
-            // No longer in the game, but still part of protocol.
-            double vel_x_deprecated, vel_y_deprecated;
-            iss >> vel_x_deprecated;
-            iss >> vel_y_deprecated;
+            long long integer() {
+                skip_space();
+                const bool negative = cursor != end && *cursor == '-';
+                if (negative || (cursor != end && *cursor == '+')) {
+                    ++cursor;
+                }
+                long long value = 0;
+                while (cursor != end && *cursor >= '0' && *cursor <= '9') {
+                    value = value * 10 + (*cursor - '0');
+                    ++cursor;
+                }
+                return negative ? -value : value;
+            }
 
-            int docking_status;
-            iss >> docking_status;
-            ship.docking_status = static_cast<ShipDockingStatus>(docking_status);
+            /// The next integer, without moving past it.
+            long long peek_integer() const {
+                TextReader copy = *this;
+                return copy.integer();
+            }
 
-            iss >> ship.docked_planet;
-            iss >> ship.docking_progress;
-            iss >> ship.weapon_cooldown;
+            double real() {
+                skip_space();
+                const char* const start = cursor;
+                const bool negative = cursor != end && *cursor == '-';
+                if (negative || (cursor != end && *cursor == '+')) {
+                    ++cursor;
+                }
+
+                // The game writes plain decimals like "123.456". While the
+                // digits fit in a double's 53 bits and there are at most 22
+                // after the point, mantissa / 10^n is exact up to the one
+                // rounding of the division, so it's the same as strtod.
+                static const double POWERS_OF_TEN[] = {
+                    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+                };
+                const uint64_t MAX_EXACT = uint64_t(1) << 53;
+                uint64_t mantissa = 0;
+                int fraction_digits = 0;
+                bool exact = true;
+                for (; cursor != end && *cursor >= '0' && *cursor <= '9'; ++cursor) {
+                    mantissa = mantissa * 10 + (*cursor - '0');
+                    exact = exact && mantissa <= MAX_EXACT;
+                }
+                if (cursor != end && *cursor == '.') {
+                    for (++cursor; cursor != end && *cursor >= '0' && *cursor <= '9'; ++cursor) {
+                        mantissa = mantissa * 10 + (*cursor - '0');
+                        ++fraction_digits;
+                        exact = exact && mantissa <= MAX_EXACT;
+                    }
+                }
+                const bool has_exponent = cursor != end && (*cursor == 'e' || *cursor == 'E');
+                if (exact && !has_exponent && fraction_digits <= 22) {
+                    const double value = static_cast<double>(mantissa) / POWERS_OF_TEN[fraction_digits];
+                    return negative ? -value : value;
+                }
+                return slow_real(start);
+            }
+
+        private:
+            /// strtod, for numbers the fast path can't do exactly.
+            double slow_real(const char* start) {
+                // The frame isn't null-terminated, so copy the number out
+                char number[64];
+                size_t length = 0;
+                cursor = start;
+                while (cursor != end && length + 1 < sizeof(number) &&
+                       *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n') {
+                    number[length++] = *cursor++;
+                }
+                number[length] = '\0';
+                while (cursor != end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n') {
+                    ++cursor;
+                }
+                return std::strtod(number, nullptr);
+            }
+        };
+
+        static void parse_ship(TextReader& reader, const PlayerId owner_id, Ship& ship) {
+            ship.entity_id = static_cast<EntityId>(reader.integer());
+            ship.location.pos_x = reader.real();
+            ship.location.pos_y = reader.real();
+            ship.health = static_cast<int>(reader.integer());
+
+            // No longer in the game, but still part of protocol.
+            reader.real();
+            reader.real();
+
+            ship.docking_status = static_cast<ShipDockingStatus>(reader.integer());
+            ship.docked_planet = static_cast<EntityId>(reader.integer());
+            ship.docking_progress = static_cast<int>(reader.integer());
+            ship.weapon_cooldown = static_cast<int>(reader.integer());
 
             ship.owner_id = owner_id;
             ship.radius = constants::SHIP_RADIUS;
+        }
 
-            return std::make_pair(ship.entity_id, ship);
+        /// Parse a planet, reusing the memory of its docked_ships.
+        static void parse_planet(TextReader& reader, Planet& planet) {
+            planet.entity_id = static_cast<EntityId>(reader.integer());
+            planet.location.pos_x = reader.real();
+            planet.location.pos_y = reader.real();
+            planet.health = static_cast<int>(reader.integer());
+            planet.radius = reader.real();
+            planet.docking_spots = static_cast<unsigned int>(reader.integer());
+            planet.current_production = static_cast<int>(reader.integer());
+            planet.remaining_production = static_cast<int>(reader.integer());
+
+            planet.owned = reader.integer() == 1;
+            const long long owner = reader.integer();
+            planet.owner_id = planet.owned ? static_cast<PlayerId>(owner) : -1;
+
+            const long long num_docked_ships = reader.integer();
+            planet.docked_ships.clear();
+            for (long long i = 0; i < num_docked_ships; ++i) {
+                planet.docked_ships.push_back(static_cast<EntityId>(reader.integer()));
+            }
         }
 
-        static std::pair<EntityId, Planet> parse_planet(std::istream& iss) {
-            Planet planet;
-
-            iss >> planet.entity_id;
-            iss >> planet.location.pos_x;
-            iss >> planet.location.pos_y;
-            iss >> planet.health;
-            iss >> planet.radius;
-            iss >> planet.docking_spots;
-            iss >> planet.current_production;
-            iss >> planet.remaining_production;
-
-            int owned;
-            iss >> owned;
-            if (owned == 1) {
-                planet.owned = true;
-                int owner;
-                iss >> owner;
-                planet.owner_id = static_cast<PlayerId>(owner);
-            } else {
-                planet.owned = false;
-                int false_owner;
-                iss >> false_owner;
-                planet.owner_id = -1;
-            }
-
-            unsigned int num_docked_ships;
-            iss >> num_docked_ships;
-
-            planet.docked_ships.reserve(num_docked_ships);
-            for (unsigned int i = 0; i < num_docked_ships; ++i) {
-                EntityId ship_id;
-                iss >> ship_id;
-                planet.docked_ships.push_back(ship_id);
-            }
-
-            return std::make_pair(planet.entity_id, planet);
+        /// Parse a whole text frame into map, reusing the memory it already
+        /// has for ships, planets and lookup tables.
+        static void parse_map(const char* begin, const char* end, Map& map) {
+            TextReader reader { begin, end };
+
+            for (auto& player_ships : map.ships) {
+                player_ships.second.clear();
+            }
+            for (auto& player_ship_map : map.ship_map) {
+                player_ship_map.second.clear();
+            }
+
+            const long long num_players = reader.integer();
+            for (long long i = 0; i < num_players; ++i) {
+                const PlayerId player_id = static_cast<PlayerId>(reader.integer());
+                const long long num_ships = reader.integer();
+
+                std::vector<Ship>& ship_vec = map.ships[player_id];
+                EntityTable& ship_map = map.ship_map[player_id];
+
+                ship_vec.resize(static_cast<size_t>(std::max(num_ships, 0LL)));
+                for (unsigned int j = 0; j < ship_vec.size(); ++j) {
+                    parse_ship(reader, player_id, ship_vec[j]);
+                    ship_map.set(ship_vec[j].entity_id, j);
+                }
+            }
+
+            const long long num_planets = reader.integer();
+            map.planets.resize(static_cast<size_t>(std::max(num_planets, 0LL)));
+            map.planet_map.clear();
+            for (unsigned int i = 0; i < map.planets.size(); ++i) {
+                parse_planet(reader, map.planets[i]);
+                map.planet_map.set(map.planets[i].entity_id, i);
+            }
+
+            map.index_ships();
         }
 
         static Map parse_map(const std::string& input, const int map_width, const int map_height) {
-            std::stringstream iss(input);
+            Map map = Map(map_width, map_height);
+            parse_map(input.data(), input.data() + input.size(), map);
+            return map;
+        }
 
-            int num_players;
-            iss >> num_players;
+        /// Reads the little-endian fields of a binary frame in order.
+        struct BinaryReader {
+            const char* cursor;
+            const char* end;
 
-            Map map = Map(map_width, map_height);
+            uint32_t u32() {
+                uint32_t value = 0;
+                if (end - cursor >= 4) {
+                    for (int byte = 0; byte < 4; ++byte) {
+                        value |= static_cast<uint32_t>(static_cast<unsigned char>(cursor[byte])) << (8 * byte);
+                    }
+                }
+                cursor += 4;
+                return value;
+            }
+
+            double f64() {
+                uint64_t bits = 0;
+                if (end - cursor >= 8) {
+                    for (int byte = 0; byte < 8; ++byte) {
+                        bits |= static_cast<uint64_t>(static_cast<unsigned char>(cursor[byte])) << (8 * byte);
+                    }
+                }
+                cursor += 8;
+                double value;
+                std::memcpy(&value, &bits, sizeof(value));
+                return value;
+            }
+        };
+
+        /// Read the payload of one binary frame (see BINARY_FRAMES_OPTION in
+        /// the game environment's Networking.hpp).
+        bool get_binary_frame(std::string& payload);
 
-            for (int i = 0; i < num_players; ++i) {
-                PlayerId player_id;
-                int player_id_int;
-                iss >> player_id_int;
+        /// Parse a binary frame into map, reusing its memory like parse_map.
+        static void parse_binary_map(const std::string& payload, Map& map) {
+            BinaryReader reader { payload.data(), payload.data() + payload.size() };
 
-                player_id = static_cast<PlayerId>(player_id_int);
+            for (auto& player_ships : map.ships) {
+                player_ships.second.clear();
+            }
+            for (auto& player_ship_map : map.ship_map) {
+                player_ship_map.second.clear();
+            }
 
-                unsigned int num_ships;
-                iss >> num_ships;
+            const uint32_t num_players = reader.u32();
+            for (uint32_t i = 0; i < num_players; ++i) {
+                const PlayerId player_id = static_cast<PlayerId>(reader.u32());
+                const uint32_t num_ships = reader.u32();
 
                 std::vector<Ship>& ship_vec = map.ships[player_id];
-                entity_map<unsigned int>& ship_map = map.ship_map[player_id];
+                EntityTable& ship_map = map.ship_map[player_id];
+
+                ship_vec.resize(num_ships);
+                for (uint32_t j = 0; j < num_ships; ++j) {
+                    Ship& ship = ship_vec[j];
+                    ship.entity_id = reader.u32();
+                    ship.health = static_cast<int>(reader.u32());
+                    ship.location.pos_x = reader.f64();
+                    ship.location.pos_y = reader.f64();
+                    // Velocity: no longer in the game, but still part of protocol.
+                    reader.f64();
+                    reader.f64();
+                    ship.docking_status = static_cast<ShipDockingStatus>(reader.u32());
+                    ship.docked_planet = reader.u32();
+                    ship.docking_progress = static_cast<int>(reader.u32());
+                    ship.weapon_cooldown = static_cast<int>(reader.u32());
+                    ship.owner_id = player_id;
+                    ship.radius = constants::SHIP_RADIUS;
 
-                ship_vec.reserve(num_ships);
-                for (unsigned int j = 0; j < num_ships; ++j) {
-                    const auto& ship_pair = parse_ship(iss, player_id);
-                    ship_vec.push_back(ship_pair.second);
-                    ship_map[ship_pair.first] = j;
+                    ship_map.set(ship.entity_id, j);
                 }
             }
 
-            unsigned int num_planets;
-            iss >> num_planets;
+            const uint32_t num_planets = reader.u32();
+            map.planets.resize(num_planets);
+            map.planet_map.clear();
+            for (uint32_t i = 0; i < num_planets; ++i) {
+                Planet& planet = map.planets[i];
+                planet.entity_id = reader.u32();
+                planet.health = static_cast<int>(reader.u32());
+                planet.location.pos_x = reader.f64();
+                planet.location.pos_y = reader.f64();
+                planet.radius = reader.f64();
+                planet.docking_spots = reader.u32();
+                planet.current_production = static_cast<int>(reader.u32());
+                planet.remaining_production = static_cast<int>(reader.u32());
+                planet.owned = reader.u32() == 1;
+                const uint32_t owner = reader.u32();
+                planet.owner_id = planet.owned ? static_cast<PlayerId>(owner) : -1;
+
+                const uint32_t num_docked_ships = reader.u32();
+                planet.docked_ships.clear();
+                for (uint32_t j = 0; j < num_docked_ships; ++j) {
+                    planet.docked_ships.push_back(reader.u32());
+                }
 
-            map.planets.reserve(num_planets);
-            for (unsigned int i = 0; i < num_planets; ++i) {
-                const auto& planet_pair = parse_planet(iss);
-                map.planets.push_back(planet_pair.second);
-                map.planet_map[planet_pair.first] = i;
+                map.planet_map.set(planet.entity_id, i);
             }
 
+            map.index_ships();
+        }
+
+        static Map parse_binary_map(const std::string& payload, const int map_width, const int map_height) {
+            Map map = Map(map_width, map_height);
+            parse_binary_map(payload, map);
             return map;
         }
 
-        void setup(const std::string& bot_name, int map_width, int map_height);
+        /// Update a map with a delta frame (see DELTA_FRAMES_OPTION in the
+        /// game environment's Networking.hpp), in place. With changes, also
+        /// list what changed there (after clearing it), as ChangeTracker
+        /// would.
+        static void apply_delta(Map& map, const char* begin, const char* end, MapChanges* changes = nullptr) {
+            TextReader reader { begin, end };
+            if (changes != nullptr) {
+                changes->clear();
+            }
+
+            const long long num_players = reader.integer();
+            for (long long i = 0; i < num_players; ++i) {
+                const PlayerId player_id = static_cast<PlayerId>(reader.integer());
+
+                std::vector<Ship>& ship_vec = map.ships[player_id];
+                EntityTable& ship_map = map.ship_map[player_id];
+
+                // Destroyed ships are marked dead, then dropped below
+                const long long num_destroyed = reader.integer();
+                for (long long j = 0; j < num_destroyed; ++j) {
+                    const EntityId ship_id = static_cast<EntityId>(reader.integer());
+                    if (ship_map.count(ship_id) != 0) {
+                        ship_vec[ship_map.at(ship_id)].health = 0;
+                        if (changes != nullptr) {
+                            changes->push_back({ MapChange::Kind::ShipDestroyed, ship_id, player_id, player_id });
+                        }
+                    }
+                }
+
+                bool added = false;
+                const long long num_changed = reader.integer();
+                for (long long j = 0; j < num_changed; ++j) {
+                    Ship ship;
+                    parse_ship(reader, player_id, ship);
+                    if (ship_map.count(ship.entity_id) != 0) {
+                        Ship& previous = ship_vec[ship_map.at(ship.entity_id)];
+                        if (changes != nullptr && previous.docking_status != ship.docking_status) {
+                            changes->push_back({ docking_change(ship.docking_status), ship.entity_id, player_id,
+                                                 player_id });
+                        }
+                        previous = ship;
+                    } else {
+                        ship_vec.push_back(ship);
+                        added = true;
+                        if (changes != nullptr) {
+                            changes->push_back({ MapChange::Kind::ShipSpawned, ship.entity_id, player_id, player_id });
+                        }
+                    }
+                }
+
+                if (num_destroyed == 0 && !added) {
+                    continue;
+                }
+
+                ship_vec.erase(std::remove_if(ship_vec.begin(), ship_vec.end(), [](const Ship& ship) {
+                    return !ship.is_alive();
+                }), ship_vec.end());
+                if (added) {
+                    std::sort(ship_vec.begin(), ship_vec.end(), [](const Ship& a, const Ship& b) {
+                        return a.entity_id < b.entity_id;
+                    });
+                }
+
+                ship_map.clear();
+                for (unsigned int j = 0; j < ship_vec.size(); ++j) {
+                    ship_map.set(ship_vec[j].entity_id, j);
+                }
+            }
+
+            const long long num_destroyed = reader.integer();
+            for (long long i = 0; i < num_destroyed; ++i) {
+                const EntityId planet_id = static_cast<EntityId>(reader.integer());
+                if (map.planet_map.count(planet_id) != 0) {
+                    Planet& planet = map.planets[map.planet_map.at(planet_id)];
+                    planet.health = 0;
+                    if (changes != nullptr) {
+                        const PlayerId owner_id = planet.owner_id;
+                        changes->push_back({ MapChange::Kind::PlanetDestroyed, planet_id, owner_id, owner_id });
+                    }
+                }
+            }
+
+            const long long num_changed = reader.integer();
+            for (long long i = 0; i < num_changed; ++i) {
+                const EntityId planet_id = static_cast<EntityId>(reader.peek_integer());
+                Planet& planet = map.planets.at(map.planet_map.at(planet_id));
+                const PlayerId previous_owner_id = planet.owner_id;
+                parse_planet(reader, planet);
+                if (changes != nullptr && planet.owner_id != previous_owner_id) {
+                    changes->push_back({ MapChange::Kind::PlanetOwnerChanged, planet_id, planet.owner_id,
+                                         previous_owner_id });
+                }
+            }
+
+            if (num_destroyed != 0) {
+                map.planets.erase(std::remove_if(map.planets.begin(), map.planets.end(), [](const Planet& planet) {
+                    return !planet.is_alive();
+                }), map.planets.end());
+
+                map.planet_map.clear();
+                for (unsigned int i = 0; i < map.planets.size(); ++i) {
+                    map.planet_map.set(map.planets[i].entity_id, i);
+                }
+            }
+
+            map.index_ships();
+        }
+
+        static void apply_delta(Map& map, const std::string& input, MapChanges* changes = nullptr) {
+            apply_delta(map, input.data(), input.data() + input.size(), changes);
+        }
+
+        /// How the game should send us each map after the initial one.
+        enum class FrameFormat {
+            /// The same text format as the initial map.
+            Text,
+            /// Binary, which is faster to read than text.
+            Binary,
+            /// Only what changed since the last turn, which is much smaller
+            /// late in the game.
+            Delta,
+        };
+
+        void setup(const std::string& bot_name, int map_width, int map_height, FrameFormat frame_format,
+                   bool use_shared_memory, const FrameCompression& compression = FrameCompression());
+
+        /// Read the next map into the one the starter kit keeps, and return
+        /// it. It's updated in place every turn, reusing its memory, so once
+        /// the game has warmed up this doesn't allocate; the reference stays
+        /// the same, but only holds the latest map.
+        const Map& update_map();
+
+        /// A copy of the next map, for bots that keep old ones around. Both
+        /// start a new turn for arena::turn_arena.
         const Map get_map();
+
+        /// What changed from the previous map update_map read to the latest:
+        /// straight from delta frames, otherwise by comparing the two. Empty
+        /// for the initial map.
+        const MapChanges& changes();
+
+        /// The time we have to reply to the latest map, from when its first
+        /// byte was read (or, through shared memory, when it was handed
+        /// over). Until we've sent our name, that's the time we have to
+        /// analyse the initial map.
+        const TurnClock& turn_clock();
+
+        /// Start the turn clock at the given time, as reading a frame does,
+        /// for bots fed frames some other way (see bench.hpp).
+        void start_turn_clock(std::chrono::steady_clock::time_point start, int limit_millis);
     }
 }
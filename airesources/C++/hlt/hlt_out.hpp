@@ -1,42 +1,109 @@
 #pragma once
 
-#include <iostream>
-#include <sstream>
+#include <cerrno>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "log.hpp"
 #include "move.hpp"
+#include "shared_memory.hpp"
 
 namespace hlt {
     namespace out {
+        /// Write all of data to stdout, which is the game, bypassing
+        /// iostreams: don't also write to it through std::cout.
+        static bool write_stdout(const char* data, size_t size) {
+            while (size > 0) {
+#ifdef _WIN32
+                const int written = _write(1, data, static_cast<unsigned int>(size));
+#else
+                const ssize_t written = write(1, data, size);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+#endif
+                if (written <= 0) {
+                    return false;
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+
         static bool send_string(const std::string& text) {
-            // note that std::endl flushes
-            std::cout << text << std::endl;
-            return std::cout.good();
+            std::string line;
+            line.reserve(text.size() + 1);
+            line += text;
+            line += '\n';
+            return write_stdout(line.data(), line.size());
         }
 
-        /// Send all queued moves to the game engine.
-        static bool send_moves(const std::vector<Move>& moves) {
-            std::ostringstream oss;
+        /// Append the decimal digits of value, and a space.
+        static void append_int(std::string& out, const long long value) {
+            char digits[21];
+            char* first = digits + sizeof(digits);
+            unsigned long long magnitude = value < 0
+                    ? 0ull - static_cast<unsigned long long>(value)
+                    : static_cast<unsigned long long>(value);
+            do {
+                *--first = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude > 0);
+            if (value < 0) {
+                *--first = '-';
+            }
+            out.append(first, digits + sizeof(digits));
+            out += ' ';
+        }
+
+        /// The line of commands for moves, as the game reads it (without the
+        /// newline), into reply (which is cleared first).
+        template<typename Allocator>
+        static void format_moves(const std::vector<Move, Allocator>& moves, std::string& reply) {
+            reply.clear();
             for (const Move& move : moves) {
                 switch (move.type) {
                     case MoveType::Noop:
                         continue;
                     case MoveType::Undock:
-                        oss << "u " << move.ship_id << " ";
+                        reply += "u ";
+                        append_int(reply, move.ship_id);
                         break;
                     case MoveType::Dock:
-                        oss << "d " << move.ship_id << " "
-                            << move.dock_to << " ";
+                        reply += "d ";
+                        append_int(reply, move.ship_id);
+                        append_int(reply, move.dock_to);
                         break;
                     case MoveType::Thrust:
-                        oss << "t " << move.ship_id << " "
-                            << move.move_thrust << " "
-                            << move.move_angle_deg << " ";
+                        reply += "t ";
+                        append_int(reply, move.ship_id);
+                        append_int(reply, move.move_thrust);
+                        append_int(reply, move.move_angle_deg);
                         break;
                 }
             }
+        }
+
+        /// Send all queued moves to the game engine, from a std::vector or
+        /// an arena_vector.
+        template<typename Allocator>
+        static bool send_moves(const std::vector<Move, Allocator>& moves) {
+            // Formatted straight into a buffer kept between turns
+            static std::string reply;
+            format_moves(moves, reply);
 
-            return send_string(oss.str());
+            if (shared_memory::is_open()) {
+                return shared_memory::send_moves(reply);
+            }
+            reply += '\n';
+            return write_stdout(reply.data(), reply.size());
         }
     }
 }
@@ -0,0 +1,97 @@
+#include "local_game.hpp"
+#include "hlt_in.hpp"
+#include "hlt_out.hpp"
+#include "parallel.hpp"
+
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+#ifdef HLT_LOCAL_GAMES
+#include "core/LocalGameApi.hpp"
+#endif
+
+namespace hlt {
+    namespace local {
+#ifdef HLT_LOCAL_GAMES
+        GameResult play_game(const GameSetup& setup) {
+            const unsigned int num_players = static_cast<unsigned int>(setup.players.size());
+            const std::unique_ptr<HaliteLocalGame, void (*)(HaliteLocalGame*)> game(
+                    halite_local_game_create(static_cast<unsigned int>(setup.map_width),
+                                             static_cast<unsigned int>(setup.map_height),
+                                             setup.seed, num_players),
+                    halite_local_game_destroy);
+            if (!game) {
+                throw std::runtime_error(std::string("Could not start a game: ") + halite_local_game_error(nullptr));
+            }
+
+            GameResult result;
+            result.seed = setup.seed;
+            result.players.resize(num_players);
+            for (unsigned int player = 0; player < num_players; ++player) {
+                const Player& player_setup = setup.players[player];
+                result.players[player].name = player_setup.name;
+                if (!player_setup.builtin.empty() &&
+                        halite_local_game_set_builtin(game.get(), player,
+                                                      ("builtin:" + player_setup.builtin).c_str()) != 0) {
+                    throw std::runtime_error(halite_local_game_error(game.get()));
+                }
+            }
+
+            // Parsed once a turn for all of the game's bots
+            Map map(setup.map_width, setup.map_height);
+            std::vector<Move> moves;
+            std::string reply;
+            do {
+                const char* const frame = halite_local_game_frame(game.get());
+                in::parse_map(frame, frame + std::strlen(frame), map);
+
+                for (unsigned int player = 0; player < num_players; ++player) {
+                    const Player& player_setup = setup.players[player];
+                    if (!player_setup.builtin.empty() || !halite_local_game_is_alive(game.get(), player)) {
+                        continue;
+                    }
+                    moves.clear();
+                    try {
+                        player_setup.play_turn(map, static_cast<PlayerId>(player), moves);
+                    } catch (const std::exception& e) {
+                        result.players[player].error = e.what();
+                        halite_local_game_eliminate(game.get(), player);
+                        continue;
+                    }
+                    out::format_moves(moves, reply);
+                    if (halite_local_game_set_moves(game.get(), player, reply.c_str()) != 0) {
+                        result.players[player].error = halite_local_game_error(game.get());
+                    }
+                }
+            } while (halite_local_game_step(game.get()) == 0);
+
+            std::vector<HaliteLocalGameResult> results(num_players);
+            halite_local_game_results(game.get(), results.data());
+            result.turns = halite_local_game_turn(game.get());
+            for (unsigned int player = 0; player < num_players; ++player) {
+                PlayerResult& player_result = result.players[player];
+                player_result.rank = results[player].rank;
+                player_result.last_turn_alive = results[player].last_turn_alive;
+                player_result.total_ship_count = results[player].total_ship_count;
+                player_result.damage_dealt = results[player].damage_dealt;
+            }
+            return result;
+        }
+#else
+        GameResult play_game(const GameSetup&) {
+            throw std::runtime_error("The kit was built without HLT_LOCAL_GAMES");
+        }
+#endif
+
+        std::vector<GameResult> play_games(const std::vector<GameSetup>& setups, const unsigned int threads) {
+            std::vector<GameResult> results(setups.size());
+            TaskPool pool(threads);
+            pool.run(setups.size(), [&](const size_t index, unsigned int) {
+                results[index] = play_game(setups[index]);
+            });
+            return results;
+        }
+    }
+}
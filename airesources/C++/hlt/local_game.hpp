@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+
+namespace hlt {
+    /**
+     * Playing whole games in-process, against copies of a bot or the
+     * game's built-in bots, to tune a bot's parameters over many games
+     * without starting the game or any processes:
+     *
+     *     local::GameSetup setup;
+     *     setup.seed = 42;
+     *     setup.players = { local::Player::bot("tuned", play_turn),
+     *                       local::Player::builtin_bot("rush") };
+     *     const local::GameResult result = local::play_game(setup);
+     *
+     * The game environment plays the games, through its C interface
+     * (core/LocalGameApi.hpp in the environment), and each bot is given the
+     * text frames the game would send it and answers with moves, which are
+     * checked as the game checks a bot's commands. There are no time
+     * limits, and nothing is logged or kept for replays.
+     *
+     * This needs the kit built with HLT_LOCAL_GAMES, which links it with
+     * the environment's libhalite (see CMakeLists.txt); otherwise playing a
+     * game throws std::runtime_error.
+     */
+    namespace local {
+        /// One of a game's players.
+        struct Player {
+            std::string name;
+            /// Plays the player's turns, called on the thread playing the
+            /// game.
+            bench::PlayTurn play_turn;
+            /// Or the policy of the game's built-in bot playing instead:
+            /// "random", "rush" or "idle" (see the environment's
+            /// BuiltinBot.hpp).
+            std::string builtin;
+
+            static Player bot(const std::string& name, const bench::PlayTurn& play_turn) {
+                Player player;
+                player.name = name;
+                player.play_turn = play_turn;
+                return player;
+            }
+
+            static Player builtin_bot(const std::string& policy) {
+                Player player;
+                player.name = "builtin:" + policy;
+                player.builtin = policy;
+                return player;
+            }
+        };
+
+        struct GameSetup {
+            /// The map is generated as halite -d "WIDTH HEIGHT" -s SEED would.
+            int map_width = 240;
+            int map_height = 160;
+            unsigned int seed = 0;
+            /// 2 or 4 players.
+            std::vector<Player> players;
+        };
+
+        struct PlayerResult {
+            std::string name;
+            /// 1 for the winner.
+            unsigned int rank;
+            /// The last turn the player had ships on.
+            unsigned int last_turn_alive;
+            /// The ships the player has had, its first ones included, and
+            /// the damage it dealt, which ties are broken by.
+            unsigned int total_ship_count;
+            unsigned int damage_dealt;
+            /// Why the player was taken out of the game (its strategy threw,
+            /// or made an invalid move), if it was.
+            std::string error;
+        };
+
+        struct GameResult {
+            unsigned int seed;
+            unsigned int turns;
+            /// In the order of the setup's players.
+            std::vector<PlayerResult> players;
+        };
+
+        /// Play a game to the end. Throws std::runtime_error if it can't be
+        /// set up.
+        GameResult play_game(const GameSetup& setup);
+
+        /**
+         * Play games at once, on threads of a TaskPool (see parallel.hpp),
+         * returning their results in the order of setups. Each game is
+         * played on one thread, but the strategies of different games are
+         * called at the same time: one that keeps state between turns
+         * should be a separate one in each setup.
+         */
+        std::vector<GameResult> play_games(const std::vector<GameSetup>& setups,
+                                           unsigned int threads = std::thread::hardware_concurrency());
+    }
+}
@@ -3,15 +3,23 @@
 #include <ostream>
 
 #include "constants.hpp"
+#include "types.hpp"
 #include "util.hpp"
 
 namespace hlt {
     struct Location {
-        double pos_x, pos_y;
+        /// float with HLT_COMPACT_ENTITIES (see types.hpp).
+        Coordinate pos_x, pos_y;
+
+        Location() = default;
+
+        Location(const double x, const double y)
+                : pos_x(static_cast<Coordinate>(x)), pos_y(static_cast<Coordinate>(y)) {
+        }
 
         double get_distance_to(const Location& target) const {
-            const double dx = pos_x - target.pos_x;
-            const double dy = pos_y - target.pos_y;
+            const double dx = static_cast<double>(pos_x) - target.pos_x;
+            const double dy = static_cast<double>(pos_y) - target.pos_y;
             return std::sqrt(dx*dx + dy*dy);
         }
 
@@ -20,8 +28,8 @@ namespace hlt {
         }
 
         double orient_towards_in_rad(const Location& target) const {
-            const double dx = target.pos_x - pos_x;
-            const double dy = target.pos_y - pos_y;
+            const double dx = static_cast<double>(target.pos_x) - pos_x;
+            const double dy = static_cast<double>(target.pos_y) - pos_y;
 
             return std::atan2(dy, dx) + 2 * M_PI;
         }
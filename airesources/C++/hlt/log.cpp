@@ -0,0 +1,262 @@
+#include "log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <csignal>
+#include <cerrno>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace hlt {
+    namespace {
+        /// How much can be waiting to be written before messages are dropped.
+        constexpr size_t BUFFER_SIZE = 1 << 20;
+
+        /// How long the writer sleeps when there's nothing to write.
+        constexpr std::chrono::milliseconds WRITE_INTERVAL(1);
+
+        const char* prefix(const Log::Level level) {
+            switch (level) {
+                case Log::Level::Debug:
+                    return "DEBUG: ";
+                case Log::Level::Warning:
+                    return "WARNING: ";
+                case Log::Level::Error:
+                    return "ERROR: ";
+                default:
+                    return "";
+            }
+        }
+
+        void write_fully(const int fd, const char* data, size_t size) {
+            while (size > 0) {
+#ifdef _WIN32
+                const int written = _write(fd, data, static_cast<unsigned int>(size));
+#else
+                const ssize_t written = ::write(fd, data, size);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+#endif
+                if (written <= 0) {
+                    return;
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+        }
+
+        /**
+         * A ring buffer of bytes with one producer (whoever logs) and one
+         * consumer at a time (the writer thread, or the signal handler).
+         * head and tail only ever grow; their difference is what's waiting.
+         */
+        struct LogState {
+            char buffer[BUFFER_SIZE];
+            std::atomic<size_t> head{0};
+            std::atomic<size_t> tail{0};
+            std::atomic<int> fd{-1};
+            std::atomic<int> min_level{0};
+            /// Held by whoever is writing the buffer out: the writer thread, or
+            /// a signal handler, which runs on another thread.
+            std::atomic_flag draining = ATOMIC_FLAG_INIT;
+            /// Only touched by the producer.
+            size_t dropped = 0;
+
+            std::atomic<bool> running{false};
+            std::thread writer;
+
+            ~LogState() {
+                if (writer.joinable()) {
+                    running.store(false);
+                    writer.join();
+                }
+                close_file();
+            }
+
+            /// Copy a line in whole, or nothing if it doesn't fit.
+            bool push(const char* prefix, const char* message, const size_t message_size) {
+                const size_t prefix_size = std::strlen(prefix);
+                const size_t size = prefix_size + message_size + 1;
+                const size_t at = head.load(std::memory_order_relaxed);
+                if (BUFFER_SIZE - (at - tail.load(std::memory_order_acquire)) < size) {
+                    return false;
+                }
+                copy_in(at, prefix, prefix_size);
+                copy_in(at + prefix_size, message, message_size);
+                copy_in(at + prefix_size + message_size, "\n", 1);
+                head.store(at + size, std::memory_order_release);
+                return true;
+            }
+
+            void copy_in(const size_t at, const char* data, const size_t size) {
+                const size_t offset = at % BUFFER_SIZE;
+                const size_t first = std::min(size, BUFFER_SIZE - offset);
+                std::memcpy(buffer + offset, data, first);
+                std::memcpy(buffer, data + first, size - first);
+            }
+
+            /// Write out everything logged so far. Safe in a signal handler.
+            void drain() {
+                while (draining.test_and_set(std::memory_order_acquire)) {
+                }
+                const size_t from = tail.load(std::memory_order_relaxed);
+                const size_t to = head.load(std::memory_order_acquire);
+                const int file = fd.load();
+                if (to != from && file >= 0) {
+                    const size_t offset = from % BUFFER_SIZE;
+                    const size_t first = std::min(to - from, BUFFER_SIZE - offset);
+                    write_fully(file, buffer + offset, first);
+                    write_fully(file, buffer, to - from - first);
+                }
+                tail.store(to, std::memory_order_release);
+                draining.clear(std::memory_order_release);
+            }
+
+            void close_file() {
+                const int file = fd.exchange(-1);
+                if (file >= 0) {
+#ifdef _WIN32
+                    _close(file);
+#else
+                    ::close(file);
+#endif
+                }
+            }
+
+            void run() {
+                while (running.load()) {
+                    drain();
+                    std::this_thread::sleep_for(WRITE_INTERVAL);
+                }
+                drain();
+            }
+        };
+
+        LogState& state() {
+            static LogState instance;
+            return instance;
+        }
+
+#ifndef _WIN32
+        const int FLUSHED_SIGNALS[] = { SIGTERM, SIGINT };
+        struct sigaction previous_actions[sizeof(FLUSHED_SIGNALS) / sizeof(FLUSHED_SIGNALS[0])];
+
+        /// Write out the log, then die of the signal as we would have.
+        void on_signal(const int signal) {
+            state().drain();
+            for (size_t i = 0; i < sizeof(FLUSHED_SIGNALS) / sizeof(FLUSHED_SIGNALS[0]); ++i) {
+                if (FLUSHED_SIGNALS[i] == signal) {
+                    sigaction(signal, &previous_actions[i], nullptr);
+                }
+            }
+            // Delivered once this handler returns
+            raise(signal);
+        }
+
+        void install_signal_handlers() {
+            struct sigaction action;
+            std::memset(&action, 0, sizeof(action));
+            action.sa_handler = on_signal;
+            sigemptyset(&action.sa_mask);
+            for (const int signal : FLUSHED_SIGNALS) {
+                sigaddset(&action.sa_mask, signal);
+            }
+            for (size_t i = 0; i < sizeof(FLUSHED_SIGNALS) / sizeof(FLUSHED_SIGNALS[0]); ++i) {
+                // Signals we were told to ignore stay ignored
+                sigaction(FLUSHED_SIGNALS[i], nullptr, &previous_actions[i]);
+                if (previous_actions[i].sa_handler != SIG_IGN) {
+                    sigaction(FLUSHED_SIGNALS[i], &action, nullptr);
+                }
+            }
+        }
+#endif
+
+        void start_writer(LogState& log) {
+            log.running.store(true);
+#ifdef _WIN32
+            log.writer = std::thread(&LogState::run, &log);
+#else
+            // The writer inherits this mask, so the handler always runs on
+            // another thread and can't wait on a drain it interrupted.
+            sigset_t blocked;
+            sigset_t previous;
+            sigemptyset(&blocked);
+            for (const int signal : FLUSHED_SIGNALS) {
+                sigaddset(&blocked, signal);
+            }
+            pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+            log.writer = std::thread(&LogState::run, &log);
+            pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+            install_signal_handlers();
+#endif
+        }
+    }
+
+    void Log::open(const std::string& filename) {
+        LogState& log = state();
+#ifdef _WIN32
+        const int file = _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC, _S_IREAD | _S_IWRITE);
+#else
+        const int file = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (file < 0) {
+            return;
+        }
+
+        if (log.writer.joinable()) {
+            flush();
+            log.close_file();
+            log.fd.store(file);
+        } else {
+            log.fd.store(file);
+            start_writer(log);
+        }
+    }
+
+    void Log::set_level(const Level level) {
+        state().min_level.store(static_cast<int>(level));
+    }
+
+    void Log::write(const Level level, const std::string& message) {
+        LogState& log = state();
+        if (log.fd.load(std::memory_order_relaxed) < 0
+            || static_cast<int>(level) < log.min_level.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        if (log.dropped > 0) {
+            const std::string note = std::to_string(log.dropped) + " messages dropped";
+            if (!log.push(prefix(Level::Warning), note.data(), note.size())) {
+                ++log.dropped;
+                return;
+            }
+            log.dropped = 0;
+        }
+        if (!log.push(prefix(level), message.data(), message.size())) {
+            ++log.dropped;
+        }
+    }
+
+    void Log::flush() {
+        LogState& log = state();
+        if (!log.writer.joinable()) {
+            return;
+        }
+        const size_t logged = log.head.load(std::memory_order_acquire);
+        while (log.tail.load(std::memory_order_acquire) < logged) {
+            std::this_thread::sleep_for(WRITE_INTERVAL);
+        }
+    }
+}
@@ -1,30 +1,81 @@
 #pragma once
 
-#include <fstream>
-#include <iostream>
 #include <string>
 
+/// The least important messages the HLT_LOG_* macros keep: 0 for debug, 1
+/// info, 2 warning, 3 error and 4 for none. Messages below it are compiled
+/// out, along with building them, so define it (e.g. -DHLT_LOG_LEVEL=2) to
+/// make a quiet build for the real game.
+#ifndef HLT_LOG_LEVEL
+#define HLT_LOG_LEVEL 0
+#endif
+
+#define HLT_LOG_AT(level, message) \
+    do { \
+        if (static_cast<int>(level) >= HLT_LOG_LEVEL) { \
+            ::hlt::Log::write(level, message); \
+        } \
+    } while (0)
+
+#define HLT_LOG_DEBUG(message) HLT_LOG_AT(::hlt::Log::Level::Debug, message)
+#define HLT_LOG_INFO(message) HLT_LOG_AT(::hlt::Log::Level::Info, message)
+#define HLT_LOG_WARNING(message) HLT_LOG_AT(::hlt::Log::Level::Warning, message)
+#define HLT_LOG_ERROR(message) HLT_LOG_AT(::hlt::Log::Level::Error, message)
+
 namespace hlt {
+    /**
+     * The bot's log file. Logging only copies the message into a ring
+     * buffer; a background thread writes it out, so the turn never waits
+     * for the disk. If the buffer is full, messages are dropped (and the
+     * number dropped logged once there's room) rather than waiting.
+     *
+     * The buffer has a single producer, so log from one thread at a time.
+     *
+     * The writer empties the buffer every millisecond or so, and what it
+     * has written survives the bot being killed: the game ejects bots with
+     * SIGKILL, which nothing can catch, so only the last moments of the log
+     * can be lost then. On SIGTERM or SIGINT (which the bot gets if the game
+     * itself dies), and on exit, the rest is written out first.
+     */
     struct Log {
-    private:
-        std::ofstream file;
+        enum class Level {
+            Debug = 0,
+            Info,
+            Warning,
+            Error,
+        };
+
+        /// Start logging to the given file, replacing it.
+        static void open(const std::string& filename);
+
+        /// Drop messages below the given level from now on (on top of
+        /// HLT_LOG_LEVEL, which drops them at compile time).
+        static void set_level(Level level);
+
+        /// Log a line. Does nothing if the log isn't open.
+        static void write(Level level, const std::string& message);
 
-        void initialize(const std::string& filename) {
-            file.open(filename, std::ios::trunc | std::ios::out);
+        static void log(const std::string& message) {
+            write(Level::Info, message);
         }
 
-    public:
-        static Log& get() {
-            static Log instance{};
-            return instance;
+        static void debug(const std::string& message) {
+            write(Level::Debug, message);
         }
 
-        static void open(const std::string& filename) {
-            get().initialize(filename);
+        static void info(const std::string& message) {
+            write(Level::Info, message);
         }
 
-        static void log(const std::string& message) {
-            get().file << message << std::endl;
+        static void warning(const std::string& message) {
+            write(Level::Warning, message);
         }
+
+        static void error(const std::string& message) {
+            write(Level::Error, message);
+        }
+
+        /// Wait until everything logged so far is in the file.
+        static void flush();
     };
 }
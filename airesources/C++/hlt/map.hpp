@@ -4,6 +4,7 @@
 #include "types.hpp"
 #include "ship.hpp"
 #include "planet.hpp"
+#include "spatial_index.hpp"
 
 namespace hlt {
     class Map {
@@ -11,13 +12,22 @@ namespace hlt {
         int map_width, map_height;
 
         std::unordered_map<PlayerId, std::vector<Ship>> ships;
-        std::unordered_map<PlayerId, entity_map<unsigned int>> ship_map;
+        std::unordered_map<PlayerId, EntityTable> ship_map;
 
         std::vector<Planet> planets;
-        entity_map<unsigned int> planet_map;
+        EntityTable planet_map;
+
+        /// Where the ships are, for finding those near a path. Kept up to
+        /// date by the parsers in hlt_in.hpp; call index_ships after
+        /// changing ships otherwise.
+        SpatialIndex ship_index;
 
         Map(int width, int height);
 
+        void index_ships() {
+            ship_index.build(ships, map_width, map_height);
+        }
+
         const Ship& get_ship(const PlayerId player_id, const EntityId ship_id) const {
             return ships.at(player_id).at(ship_map.at(player_id).at(ship_id));
         }
@@ -1,14 +1,16 @@
 #pragma once
 
+#include "arena.hpp"
 #include "collision.hpp"
 #include "map.hpp"
 #include "move.hpp"
+#include "planet_geometry.hpp"
 #include "util.hpp"
 
 namespace hlt {
     namespace navigation {
         static void check_and_add_entity_between(
-                std::vector<const Entity *>& entities_found,
+                arena_vector<const Entity *>& entities_found,
                 const Location& start,
                 const Location& target,
                 const Entity& entity_to_check)
@@ -22,20 +24,70 @@ namespace hlt {
             }
         }
 
-        static std::vector<const Entity *> objects_between(const Map& map, const Location& start, const Location& target) {
-            std::vector<const Entity *> entities_found;
+        /// The planets and ships in the way of a path, allocated in this
+        /// turn's arena, so only valid until the next map is read.
+        static arena_vector<const Entity *> objects_between(const Map& map, const Location& start, const Location& target) {
+            arena_vector<const Entity *> entities_found;
 
             for (const Planet& planet : map.planets) {
                 check_and_add_entity_between(entities_found, start, target, planet);
             }
 
-            for (const auto& player_ship : map.ships) {
-                for (const Ship& ship : player_ship.second) {
-                    check_and_add_entity_between(entities_found, start, target, ship);
+            // Only ships whose centers are near the path can be in the way
+            const double margin = constants::SHIP_RADIUS + constants::FORECAST_FUDGE_FACTOR;
+            map.ship_index.for_each_ship_near_segment(start, target, margin, [&](const SpatialIndex::ShipRef& ref) {
+                check_and_add_entity_between(entities_found, start, target, map.ships.at(ref.owner_id)[ref.index]);
+            });
+
+            return entities_found;
+        }
+
+        /**
+         * Every planet and ship that could be in the way of a path of the
+         * given length from start, in any direction, as a batch to test paths
+         * against. The entity at start, usually the ship moving, is left out.
+         */
+        static void obstacles_around(
+                const Map& map,
+                const Location& start,
+                const double distance,
+                collision::CircleBatch& obstacles)
+        {
+            obstacles.clear();
+
+            for (const Planet& planet : map.planets) {
+                if (!(planet.location == start)) {
+                    obstacles.add(planet);
                 }
             }
 
-            return entities_found;
+            // Allow for the rounding of the corrected targets' distances
+            const double margin = distance + 1.0 + constants::SHIP_RADIUS + constants::FORECAST_FUDGE_FACTOR;
+            map.ship_index.for_each_ship_near_segment(start, start, margin, [&](const SpatialIndex::ShipRef& ref) {
+                const Ship& ship = map.ships.at(ref.owner_id)[ref.index];
+                if (!(ship.location == start)) {
+                    obstacles.add(ship);
+                }
+            });
+        }
+
+        /// Whether the path from start to target is clear of the obstacles,
+        /// like objects_between(...).empty().
+        static bool path_clear(
+                const collision::CircleBatch& obstacles,
+                const Location& start,
+                const Location& target)
+        {
+            size_t hit = 0;
+            while ((hit = collision::segment_first_circle_intersect(
+                    start, target, obstacles, constants::FORECAST_FUDGE_FACTOR, hit)) < obstacles.size()) {
+                // objects_between ignores entities right at the target
+                if (!(Location{ obstacles.center_x[hit], obstacles.center_y[hit] } == target)) {
+                    return false;
+                }
+                ++hit;
+            }
+            return true;
         }
 
         static possibly<Move> navigate_ship_towards_target(
@@ -47,33 +99,112 @@ namespace hlt {
                 const int max_corrections,
                 const double angular_step_rad)
         {
-            if (max_corrections <= 0) {
-                return { Move::noop(), false };
+            // Everything that might be in the way of any of the corrections,
+            // found once rather than for each (per thread, for
+            // parallel_for_ships)
+            static thread_local collision::CircleBatch obstacles;
+            if (avoid_obstacles) {
+                obstacles_around(map, ship.location, ship.location.get_distance_to(target), obstacles);
             }
 
-            const double distance = ship.location.get_distance_to(target);
-            const double angle_rad = ship.location.orient_towards_in_rad(target);
+            // Turn the target by angular_step_rad around the ship until the
+            // path there is clear, up to max_corrections times
+            Location corrected_target = target;
+            for (int corrections_left = max_corrections; corrections_left > 0; --corrections_left) {
+                const double distance = ship.location.get_distance_to(corrected_target);
+                const double angle_rad = ship.location.orient_towards_in_rad(corrected_target);
 
-            if (avoid_obstacles && !objects_between(map, ship.location, target).empty()) {
-                const double new_target_dx = cos(angle_rad + angular_step_rad) * distance;
-                const double new_target_dy = sin(angle_rad + angular_step_rad) * distance;
-                const Location new_target = { ship.location.pos_x + new_target_dx, ship.location.pos_y + new_target_dy };
+                if (avoid_obstacles && !path_clear(obstacles, ship.location, corrected_target)) {
+                    const double new_target_dx = cos(angle_rad + angular_step_rad) * distance;
+                    const double new_target_dy = sin(angle_rad + angular_step_rad) * distance;
+                    corrected_target = { ship.location.pos_x + new_target_dx, ship.location.pos_y + new_target_dy };
+                    continue;
+                }
+
+                int thrust;
+                if (distance < max_thrust) {
+                    // Do not round up, since overshooting might cause collision.
+                    thrust = (int) distance;
+                } else {
+                    thrust = max_thrust;
+                }
 
-                return navigate_ship_towards_target(
-                        map, ship, new_target, max_thrust, true, (max_corrections - 1), angular_step_rad);
+                const int angle_deg = util::angle_rad_to_deg_clipped(angle_rad);
+
+                return { Move::thrust(ship.entity_id, thrust, angle_deg), true };
             }
 
-            int thrust;
-            if (distance < max_thrust) {
-                // Do not round up, since overshooting might cause collision.
-                thrust = (int) distance;
-            } else {
-                thrust = max_thrust;
+            return { Move::noop(), false };
+        }
+
+        /// Where one unit of thrust goes at each of the integer headings
+        /// the game takes, computed once.
+        static const Location& unit_heading(const int angle_deg) {
+            static const std::vector<Location> headings = [] {
+                std::vector<Location> result(360);
+                for (int deg = 0; deg < 360; ++deg) {
+                    const double angle_rad = deg * M_PI / 180.0;
+                    result[deg] = { std::cos(angle_rad), std::sin(angle_rad) };
+                }
+                return result;
+            }();
+            return headings[((angle_deg % 360) + 360) % 360];
+        }
+
+        /**
+         * Move towards target along the heading nearest the direct one on
+         * which this turn's move is clear of planets and ships: the direct
+         * heading, then one degree either side, then two, and so on.
+         *
+         * @param max_deviation_deg How far to turn from the direct heading at most.
+         * @param max_headings      How many headings to test at most, which bounds the cost of the call.
+         * @return The move, or false if every heading tried was blocked.
+         */
+        static possibly<Move> navigate_ship_avoiding_obstacles(
+                const Map& map,
+                const Ship& ship,
+                const Location& target,
+                const int max_thrust,
+                const int max_deviation_deg = 90,
+                const int max_headings = 181)
+        {
+            const double distance = ship.location.get_distance_to(target);
+            // Do not round up, since overshooting might cause collision.
+            const int thrust = distance < max_thrust ? static_cast<int>(distance) : max_thrust;
+            const int direct_deg = util::angle_rad_to_deg_clipped(ship.location.orient_towards_in_rad(target));
+            if (thrust == 0) {
+                return { Move::thrust(ship.entity_id, 0, direct_deg), true };
             }
 
-            const int angle_deg = util::angle_rad_to_deg_clipped(angle_rad);
+            static thread_local collision::CircleBatch obstacles;
+            obstacles_around(map, ship.location, thrust, obstacles);
+
+            int headings_tried = 0;
+            for (int deviation = 0; deviation <= max_deviation_deg && deviation < 180; ++deviation) {
+                for (const int side : { 1, -1 }) {
+                    if (headings_tried == max_headings) {
+                        return { Move::noop(), false };
+                    }
+                    ++headings_tried;
+
+                    const int angle_deg = (direct_deg + side * deviation + 360) % 360;
+                    const Location& heading = unit_heading(angle_deg);
+                    const Location end = {
+                            ship.location.pos_x + heading.pos_x * thrust,
+                            ship.location.pos_y + heading.pos_y * thrust,
+                    };
+                    if (path_clear(obstacles, ship.location, end)) {
+                        return { Move::thrust(ship.entity_id, thrust, angle_deg), true };
+                    }
 
-            return { Move::thrust(ship.entity_id, thrust, angle_deg), true };
+                    if (deviation == 0) {
+                        // Straight ahead has no other side
+                        break;
+                    }
+                }
+            }
+
+            return { Move::noop(), false };
         }
 
         static possibly<Move> navigate_ship_to_dock(
@@ -82,13 +213,23 @@ namespace hlt {
                 const Entity& dock_target,
                 const int max_thrust)
         {
-            const int max_corrections = constants::MAX_NAVIGATION_CORRECTIONS;
-            const bool avoid_obstacles = true;
-            const double angular_step_rad = M_PI / 180.0;
             const Location& target = ship.location.get_closest_point(dock_target.location, dock_target.radius);
 
-            return navigate_ship_towards_target(
-                    map, ship, target, max_thrust, avoid_obstacles, max_corrections, angular_step_rad);
+            return navigate_ship_avoiding_obstacles(map, ship, target, max_thrust);
+        }
+
+        /// navigate_ship_to_dock, with the point to approach the planet at
+        /// looked up in the planets' geometry.
+        static possibly<Move> navigate_ship_to_dock(
+                const Map& map,
+                const PlanetGeometry& geometry,
+                const Ship& ship,
+                const Planet& planet,
+                const int max_thrust)
+        {
+            const Location target = geometry.approach_point(planet.entity_id, ship.location);
+
+            return navigate_ship_avoiding_obstacles(map, ship, target, max_thrust);
         }
     }
 }
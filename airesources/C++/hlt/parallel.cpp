@@ -0,0 +1,139 @@
+#include "parallel.hpp"
+
+namespace hlt {
+    namespace {
+        uint64_t pack(const uint64_t begin, const uint64_t end) {
+            return begin << 32 | end;
+        }
+
+        uint64_t begin_of(const uint64_t range) {
+            return range >> 32;
+        }
+
+        uint64_t end_of(const uint64_t range) {
+            return range & 0xffffffffu;
+        }
+    }
+
+    TaskPool::TaskPool(const unsigned int threads)
+            : thread_count(std::max(1u, threads)), shares(new Share[thread_count]) {
+        for (unsigned int thread = 1; thread < thread_count; ++thread) {
+            workers.emplace_back(&TaskPool::work_loop, this, thread);
+        }
+    }
+
+    TaskPool::~TaskPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        job_started.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void TaskPool::run(const size_t count, const std::function<void(size_t, unsigned int)>& task) {
+        if (count == 0) {
+            return;
+        }
+        for (unsigned int thread = 0; thread < thread_count; ++thread) {
+            const uint64_t begin = count * thread / thread_count;
+            const uint64_t end = count * (thread + 1) / thread_count;
+            shares[thread].range.store(pack(begin, end), std::memory_order_relaxed);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job_task = &task;
+            threads_working = thread_count;
+            ++job;
+        }
+        job_started.notify_all();
+
+        do_share(0);
+
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_finished.wait(lock, [this]() { return threads_working == 0; });
+            job_task = nullptr;
+            std::swap(error, job_error);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void TaskPool::work_loop(const unsigned int thread) {
+        uint64_t done = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                job_started.wait(lock, [&]() { return stopping || job != done; });
+                if (stopping) {
+                    return;
+                }
+                done = job;
+            }
+            do_share(thread);
+        }
+    }
+
+    void TaskPool::do_share(const unsigned int thread) {
+        while (true) {
+            size_t index;
+            if (!take(thread, index)) {
+                if (!steal(thread)) {
+                    break;
+                }
+                continue;
+            }
+            try {
+                (*job_task)(index, thread);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!job_error) {
+                    job_error = std::current_exception();
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--threads_working == 0) {
+            job_finished.notify_all();
+        }
+    }
+
+    /// Take the next index from the front of our own share.
+    bool TaskPool::take(const unsigned int thread, size_t& index) {
+        std::atomic<uint64_t>& range = shares[thread].range;
+        uint64_t current = range.load(std::memory_order_acquire);
+        while (begin_of(current) < end_of(current)) {
+            if (range.compare_exchange_weak(current, pack(begin_of(current) + 1, end_of(current)),
+                                            std::memory_order_acq_rel)) {
+                index = static_cast<size_t>(begin_of(current));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Move the back half of another thread's share into our own, which is
+    /// empty. False if every share is.
+    bool TaskPool::steal(const unsigned int thread) {
+        for (unsigned int offset = 1; offset < thread_count; ++offset) {
+            std::atomic<uint64_t>& victim = shares[(thread + offset) % thread_count].range;
+            uint64_t current = victim.load(std::memory_order_acquire);
+            while (begin_of(current) < end_of(current)) {
+                const uint64_t middle = begin_of(current) + (end_of(current) - begin_of(current)) / 2;
+                if (victim.compare_exchange_weak(current, pack(begin_of(current), middle),
+                                                 std::memory_order_acq_rel)) {
+                    shares[thread].range.store(pack(middle, end_of(current)), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "map.hpp"
+#include "move.hpp"
+#include "types.hpp"
+
+namespace hlt {
+    /**
+     * Threads that run a loop's iterations between them. Each thread starts
+     * with an even share of the iterations, and one that runs out steals
+     * half of what's left of another's share, so uneven work still keeps
+     * every thread busy.
+     *
+     * The thread calling run takes a share too, so a pool of one thread
+     * starts none of its own.
+     */
+    class TaskPool {
+    public:
+        /// For the whole machine by default.
+        explicit TaskPool(unsigned int threads = std::thread::hardware_concurrency());
+        ~TaskPool();
+
+        TaskPool(const TaskPool&) = delete;
+        TaskPool& operator=(const TaskPool&) = delete;
+
+        /// How many threads run tasks, counting the one calling run.
+        unsigned int size() const {
+            return thread_count;
+        }
+
+        /**
+         * Call task(index, thread) for every index below count, where thread
+         * (below size()) says which thread it's on, and return once all are
+         * done. If any throw, one of the exceptions is rethrown here.
+         */
+        void run(size_t count, const std::function<void(size_t index, unsigned int thread)>& task);
+
+    private:
+        /// What's left of a thread's share of the indices, [begin, end),
+        /// packed as begin << 32 | end so that it's taken from atomically.
+        struct Share {
+            std::atomic<uint64_t> range{0};
+            /// Keeps each share on a cache line of its own.
+            char padding[64 - sizeof(std::atomic<uint64_t>)];
+        };
+
+        const unsigned int thread_count;
+        std::unique_ptr<Share[]> shares;
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable job_started;
+        std::condition_variable job_finished;
+        /// Counts jobs, so workers can tell a new one from the one they did.
+        uint64_t job = 0;
+        bool stopping = false;
+        unsigned int threads_working = 0;
+        const std::function<void(size_t, unsigned int)>* job_task = nullptr;
+        std::exception_ptr job_error;
+
+        void work_loop(unsigned int thread);
+        void do_share(unsigned int thread);
+        bool take(unsigned int thread, size_t& index);
+        bool steal(unsigned int thread);
+    };
+
+    /**
+     * Find the moves of each of a player's ships on the pool's threads, and
+     * append them to moves ordered by ship ID, so that the result doesn't
+     * depend on which thread got which ship. ship_moves(ship, ship_moves_out)
+     * appends what it decides for the ship to ship_moves_out, which is that
+     * thread's own buffer.
+     *
+     * ship_moves runs on several threads at once, so may only read the map
+     * and shared state. Note that logging (see log.hpp) is for one thread at
+     * a time. The navigation functions are fine to call.
+     */
+    template<typename ShipMoves>
+    static void parallel_for_ships(TaskPool& pool, const Map& map, const PlayerId player_id,
+                                   std::vector<Move>& moves, ShipMoves ship_moves) {
+        const auto player_ships = map.ships.find(player_id);
+        if (player_ships == map.ships.end()) {
+            return;
+        }
+        const std::vector<Ship>& ships = player_ships->second;
+
+        // Kept between calls to reuse their memory. The workers have
+        // instances of their own, so they're handed this thread's.
+        static thread_local std::vector<std::vector<Move>> thread_buffers;
+        std::vector<std::vector<Move>>& buffers = thread_buffers;
+        buffers.resize(std::max<size_t>(buffers.size(), pool.size()));
+        for (std::vector<Move>& buffer : buffers) {
+            buffer.clear();
+        }
+
+        pool.run(ships.size(), [&](const size_t index, const unsigned int thread) {
+            ship_moves(ships[index], buffers[thread]);
+        });
+
+        const size_t first_new = moves.size();
+        for (const std::vector<Move>& buffer : buffers) {
+            moves.insert(moves.end(), buffer.begin(), buffer.end());
+        }
+        // Each ship's moves were all found by one thread, so stay in order
+        std::stable_sort(moves.begin() + first_new, moves.end(), [](const Move& a, const Move& b) {
+            return a.ship_id < b.ship_id;
+        });
+    }
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "constants.hpp"
+#include "location.hpp"
+#include "map.hpp"
+#include "types.hpp"
+
+namespace hlt {
+    /**
+     * What doesn't change about the planets over a game, worked out once
+     * from the initial map: the distances and headings between them, which
+     * other planets are nearest each, the points to approach each from to
+     * dock, and a grid to find those near a path.
+     *
+     * Planets never move or change size, so only their deaths need keeping
+     * up with: call update with each turn's map, which is cheap unless a
+     * planet has died since the last. Planets are looked up by EntityId,
+     * and queries leave out the dead ones.
+     *
+     *     hlt::PlanetGeometry geometry(metadata.initial_map);
+     *     for (;;) {
+     *         const hlt::Map& map = hlt::in::update_map();
+     *         geometry.update(map);
+     *         ...
+     *     }
+     */
+    class PlanetGeometry {
+    public:
+        /// The approach points around each planet, one per integer heading.
+        static constexpr int APPROACH_POINTS = 360;
+        /// The width and height of each cell of the grid. Planets are large,
+        /// so each is in every cell its circle's bounding box overlaps.
+        static constexpr double CELL_SIZE = 16.0;
+
+        PlanetGeometry() = default;
+
+        explicit PlanetGeometry(const Map& initial_map) {
+            build(initial_map);
+        }
+
+        void build(const Map& initial_map) {
+            // Planet IDs are handed out from 0, so tables are indexed by them
+            size_t num_ids = 0;
+            for (const Planet& planet : initial_map.planets) {
+                num_ids = std::max<size_t>(num_ids, planet.entity_id + 1);
+            }
+            centers.assign(num_ids, Location{ 0.0, 0.0 });
+            radii.assign(num_ids, 0.0);
+            living.assign(num_ids, false);
+            ids.clear();
+            for (const Planet& planet : initial_map.planets) {
+                centers[planet.entity_id] = planet.location;
+                radii[planet.entity_id] = planet.radius;
+                living[planet.entity_id] = true;
+                ids.push_back(planet.entity_id);
+            }
+            num_living = ids.size();
+
+            distances.assign(num_ids * num_ids, 0.0);
+            angles.assign(num_ids * num_ids, 0.0);
+            for (const EntityId from : ids) {
+                for (const EntityId to : ids) {
+                    distances[from * num_ids + to] = centers[from].get_distance_to(centers[to]);
+                    angles[from * num_ids + to] = centers[from].orient_towards_in_rad(centers[to]);
+                }
+            }
+
+            neighbors.assign(num_ids, std::vector<EntityId>());
+            for (const EntityId from : ids) {
+                std::vector<EntityId>& nearest = neighbors[from];
+                for (const EntityId to : ids) {
+                    if (to != from) {
+                        nearest.push_back(to);
+                    }
+                }
+                std::stable_sort(nearest.begin(), nearest.end(), [&](const EntityId a, const EntityId b) {
+                    return distance(from, a) < distance(from, b);
+                });
+            }
+
+            approach_points.assign(num_ids * APPROACH_POINTS, Location{ 0.0, 0.0 });
+            for (const EntityId id : ids) {
+                const double radius = radii[id] + constants::MIN_DISTANCE_FOR_CLOSEST_POINT;
+                for (int deg = 0; deg < APPROACH_POINTS; ++deg) {
+                    const double angle_rad = deg * M_PI / 180.0;
+                    approach_points[id * APPROACH_POINTS + deg] = {
+                            centers[id].pos_x + radius * std::cos(angle_rad),
+                            centers[id].pos_y + radius * std::sin(angle_rad),
+                    };
+                }
+            }
+
+            build_grid(initial_map.map_width, initial_map.map_height);
+        }
+
+        /**
+         * Forget the planets that are no longer on the map.
+         *
+         * @return Whether any had died since the last update.
+         */
+        bool update(const Map& map) {
+            if (map.planet_map.size() == num_living) {
+                return false;
+            }
+
+            bool died = false;
+            for (const EntityId id : ids) {
+                if (living[id] && map.planet_map.count(id) == 0) {
+                    living[id] = false;
+                    --num_living;
+                    died = true;
+                }
+            }
+            if (died) {
+                for (const EntityId id : ids) {
+                    std::vector<EntityId>& nearest = neighbors[id];
+                    nearest.erase(std::remove_if(nearest.begin(), nearest.end(), [&](const EntityId other) {
+                        return !living[other];
+                    }), nearest.end());
+                }
+            }
+            return died;
+        }
+
+        /// Whether the planet with the given ID was on the initial map and
+        /// hasn't died.
+        bool is_alive(const EntityId planet_id) const {
+            return planet_id < living.size() && living[planet_id];
+        }
+
+        /// The number of planets still alive.
+        size_t size() const {
+            return num_living;
+        }
+
+        /// The distance between two planets' centers.
+        double distance(const EntityId from, const EntityId to) const {
+            return distances[from * centers.size() + to];
+        }
+
+        /// The heading from one planet's center to another's, as
+        /// Location::orient_towards_in_rad gives it.
+        double angle_rad(const EntityId from, const EntityId to) const {
+            return angles[from * centers.size() + to];
+        }
+
+        /// The other living planets, nearest the given one first.
+        const std::vector<EntityId>& nearest_planets(const EntityId planet_id) const {
+            return neighbors[planet_id];
+        }
+
+        /// The point MIN_DISTANCE_FOR_CLOSEST_POINT from the planet's edge
+        /// at the given heading from its center.
+        const Location& approach_point(const EntityId planet_id, const int angle_deg) const {
+            const int heading = ((angle_deg % APPROACH_POINTS) + APPROACH_POINTS) % APPROACH_POINTS;
+            return approach_points[planet_id * APPROACH_POINTS + heading];
+        }
+
+        /// The point to approach the planet at from the given location, as
+        /// from.get_closest_point(planet.location, planet.radius) gives it,
+        /// but without the trigonometry.
+        Location approach_point(const EntityId planet_id, const Location& from) const {
+            const Location& center = centers[planet_id];
+            const double dx = from.pos_x - center.pos_x;
+            const double dy = from.pos_y - center.pos_y;
+            const double length = std::sqrt(dx * dx + dy * dy);
+            if (length == 0.0) {
+                return approach_point(planet_id, 0);
+            }
+            const double scale = (radii[planet_id] + constants::MIN_DISTANCE_FOR_CLOSEST_POINT) / length;
+            return { center.pos_x + dx * scale, center.pos_y + dy * scale };
+        }
+
+        /**
+         * Call visit(EntityId) once for every living planet that may be
+         * within margin of the segment from start to end (or of start, if
+         * they're the same). Some further away may be visited too, so
+         * callers still need an exact test.
+         */
+        template<typename Visit>
+        void for_each_planet_near_segment(const Location& start, const Location& end, const double margin,
+                                          Visit visit) const {
+            if (cell_starts.empty()) {
+                return;
+            }
+
+            const int first_column = column_of(std::min(start.pos_x, end.pos_x) - margin);
+            const int last_column = column_of(std::max(start.pos_x, end.pos_x) + margin);
+            const int first_row = row_of(std::min(start.pos_y, end.pos_y) - margin);
+            const int last_row = row_of(std::max(start.pos_y, end.pos_y) + margin);
+
+            for (int row = first_row; row <= last_row; ++row) {
+                for (int column = first_column; column <= last_column; ++column) {
+                    const int cell = row * columns + column;
+                    for (unsigned int i = cell_starts[cell]; i < cell_starts[cell + 1]; ++i) {
+                        const EntityId id = entries[i];
+                        // A planet in several of the cells looked at is
+                        // visited from the first of them only
+                        const CellRange& range = cell_ranges[id];
+                        if (living[id] &&
+                                column == std::max(range.first_column, first_column) &&
+                                row == std::max(range.first_row, first_row)) {
+                            visit(id);
+                        }
+                    }
+                }
+            }
+        }
+
+    private:
+        struct CellRange {
+            int first_column, first_row;
+        };
+
+        /// By planet ID, whether or not the planet is alive.
+        std::vector<Location> centers;
+        std::vector<double> radii;
+        std::vector<bool> living;
+        /// The IDs of the planets on the initial map.
+        std::vector<EntityId> ids;
+        size_t num_living = 0;
+
+        /// By the two planets' IDs, from * centers.size() + to.
+        std::vector<double> distances;
+        std::vector<double> angles;
+        std::vector<std::vector<EntityId>> neighbors;
+        /// By planet ID, then heading in degrees.
+        std::vector<Location> approach_points;
+
+        int columns = 0;
+        int rows = 0;
+        /// The planets in cell c are entries[cell_starts[c]] up to
+        /// entries[cell_starts[c + 1]]; cells are in rows.
+        std::vector<unsigned int> cell_starts;
+        std::vector<EntityId> entries;
+        /// By planet ID, the first cell it is in.
+        std::vector<CellRange> cell_ranges;
+        /// Scratch space for build_grid.
+        std::vector<unsigned int> fill_positions;
+
+        void build_grid(const int map_width, const int map_height) {
+            columns = std::max(1, static_cast<int>(std::ceil(map_width / CELL_SIZE)));
+            rows = std::max(1, static_cast<int>(std::ceil(map_height / CELL_SIZE)));
+
+            // A counting sort of the planets by the cells they overlap
+            cell_starts.assign(static_cast<size_t>(columns * rows) + 1, 0);
+            cell_ranges.assign(centers.size(), CellRange{ 0, 0 });
+            for (int pass = 0; pass < 2; ++pass) {
+                for (const EntityId id : ids) {
+                    const Location& center = centers[id];
+                    const int first_column = column_of(center.pos_x - radii[id]);
+                    const int last_column = column_of(center.pos_x + radii[id]);
+                    const int first_row = row_of(center.pos_y - radii[id]);
+                    const int last_row = row_of(center.pos_y + radii[id]);
+                    cell_ranges[id] = { first_column, first_row };
+                    for (int row = first_row; row <= last_row; ++row) {
+                        for (int column = first_column; column <= last_column; ++column) {
+                            const int cell = row * columns + column;
+                            if (pass == 0) {
+                                ++cell_starts[cell + 1];
+                            } else {
+                                entries[fill_positions[cell]++] = id;
+                            }
+                        }
+                    }
+                }
+                if (pass == 0) {
+                    for (size_t cell = 1; cell < cell_starts.size(); ++cell) {
+                        cell_starts[cell] += cell_starts[cell - 1];
+                    }
+                    entries.resize(cell_starts.back());
+                    fill_positions.assign(cell_starts.begin(), cell_starts.end() - 1);
+                }
+            }
+            fill_positions.clear();
+        }
+
+        /// The cell a coordinate is in, with anything off the map in the
+        /// nearest one.
+        int column_of(const double x) const {
+            return clamp(static_cast<int>(std::floor(x / CELL_SIZE)), columns);
+        }
+
+        int row_of(const double y) const {
+            return clamp(static_cast<int>(std::floor(y / CELL_SIZE)), rows);
+        }
+
+        static int clamp(const int cell, const int count) {
+            return cell < 0 ? 0 : (cell >= count ? count - 1 : cell);
+        }
+    };
+}
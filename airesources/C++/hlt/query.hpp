@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HLT_QUERY_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HLT_QUERY_NEON
+#endif
+
+#include "location.hpp"
+#include "map.hpp"
+#include "spatial_index.hpp"
+#include "types.hpp"
+
+namespace hlt {
+    /**
+     * The questions strategies ask about every ship, every turn: the
+     * nearest enemy ship, the enemies within weapon range, the nearest
+     * unowned planet.
+     *
+     * Ship queries run on the positions Map::ship_index copies out each
+     * turn, computing distances with SIMD. On maps with few ships they scan
+     * them all; with many, only the cells of the index near the location.
+     * Ships are found by their centers; the ship at the location itself, if
+     * any, is found like any other.
+     */
+    namespace query {
+        /// Above this many ships, queries look in the index's cells rather
+        /// than at every ship.
+        static constexpr size_t GRID_THRESHOLD = 128;
+
+        /// Which owners' ships or planets a query wants.
+        struct Owners {
+            enum class Mode { Any, Player, Enemies, Unowned };
+            Mode mode;
+            PlayerId player_id;
+
+            static Owners any() {
+                return { Mode::Any, -1 };
+            }
+
+            /// Owned by the given player.
+            static Owners of(const PlayerId player_id) {
+                return { Mode::Player, player_id };
+            }
+
+            /// Owned by anyone but the given player.
+            static Owners enemies_of(const PlayerId player_id) {
+                return { Mode::Enemies, player_id };
+            }
+
+            /// Planets owned by no one (there are no such ships).
+            static Owners unowned() {
+                return { Mode::Unowned, -1 };
+            }
+
+            bool matches(const PlayerId owner_id, const bool owned = true) const {
+                switch (mode) {
+                    case Mode::Player:
+                        return owned && owner_id == player_id;
+                    case Mode::Enemies:
+                        return owned && owner_id != player_id;
+                    case Mode::Unowned:
+                        return !owned;
+                    default:
+                        return true;
+                }
+            }
+        };
+
+        /// A ship found, and the square of its distance from the location.
+        struct ShipDistance {
+            SpatialIndex::ShipRef ref;
+            double distance_squared;
+        };
+
+        static const Ship& ship(const Map& map, const SpatialIndex::ShipRef& ref) {
+            return map.ships.at(ref.owner_id)[ref.index];
+        }
+
+        /**
+         * The squares of the distances from (x, y) to count of the index's
+         * ships, from first on, into out, or infinity for those whose owners
+         * don't match.
+         */
+        static void distances_squared(
+                const SpatialIndex& index,
+                const size_t first,
+                const size_t count,
+                const Location& location,
+                const Owners& owners,
+                double* const out)
+        {
+            const double* const xs = index.xs() + first;
+            const double* const ys = index.ys() + first;
+            const double* const owner_ids = index.owners() + first;
+            const double player = owners.player_id;
+            const bool filter = owners.mode == Owners::Mode::Player || owners.mode == Owners::Mode::Enemies;
+            const bool none = owners.mode == Owners::Mode::Unowned;
+            const bool want_player = owners.mode == Owners::Mode::Player;
+            size_t i = 0;
+
+#if defined(HLT_QUERY_SSE2)
+            const __m128d x = _mm_set1_pd(location.pos_x);
+            const __m128d y = _mm_set1_pd(location.pos_y);
+            const __m128d player_id = _mm_set1_pd(player);
+            const __m128d infinity = _mm_set1_pd(std::numeric_limits<double>::infinity());
+            // Lanes to drop: those of other owners, or of the player
+            const __m128d drop_all = _mm_castsi128_pd(_mm_set1_epi32(none ? -1 : 0));
+            for (; i + 2 <= count; i += 2) {
+                const __m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + i), x);
+                const __m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + i), y);
+                const __m128d distance = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+                __m128d drop = drop_all;
+                if (filter) {
+                    const __m128d owner = _mm_loadu_pd(owner_ids + i);
+                    drop = want_player ? _mm_cmpneq_pd(owner, player_id) : _mm_cmpeq_pd(owner, player_id);
+                }
+                _mm_storeu_pd(out + i, _mm_or_pd(_mm_andnot_pd(drop, distance), _mm_and_pd(drop, infinity)));
+            }
+#elif defined(HLT_QUERY_NEON)
+            const float64x2_t x = vdupq_n_f64(location.pos_x);
+            const float64x2_t y = vdupq_n_f64(location.pos_y);
+            const float64x2_t player_id = vdupq_n_f64(player);
+            const float64x2_t infinity = vdupq_n_f64(std::numeric_limits<double>::infinity());
+            const uint64x2_t drop_all = vdupq_n_u64(none ? ~uint64_t(0) : 0);
+            for (; i + 2 <= count; i += 2) {
+                const float64x2_t dx = vsubq_f64(vld1q_f64(xs + i), x);
+                const float64x2_t dy = vsubq_f64(vld1q_f64(ys + i), y);
+                const float64x2_t distance = vaddq_f64(vmulq_f64(dx, dx), vmulq_f64(dy, dy));
+                uint64x2_t drop = drop_all;
+                if (filter) {
+                    const uint64x2_t same = vceqq_f64(vld1q_f64(owner_ids + i), player_id);
+                    drop = want_player ? veorq_u64(same, vdupq_n_u64(~uint64_t(0))) : same;
+                }
+                vst1q_f64(out + i, vbslq_f64(drop, infinity, distance));
+            }
+#endif
+
+            for (; i < count; ++i) {
+                const double dx = xs[i] - location.pos_x;
+                const double dy = ys[i] - location.pos_y;
+                const bool drop = none || (filter && ((owner_ids[i] == player) != want_player));
+                out[i] = drop ? std::numeric_limits<double>::infinity() : dx * dx + dy * dy;
+            }
+        }
+
+        /**
+         * Call visit(first, distances, count) for the index's ships in
+         * blocks, distances holding the squares of their distances from
+         * location as distances_squared gives them: every ship, or with
+         * margin at least 0, at least those within margin.
+         */
+        template<typename Visit>
+        static void for_each_block(
+                const SpatialIndex& index,
+                const Location& location,
+                const Owners& owners,
+                const double margin,
+                Visit visit)
+        {
+            static constexpr size_t BLOCK = 64;
+            double distances[BLOCK];
+            const auto scan = [&](const size_t begin, const size_t end) {
+                for (size_t first = begin; first < end; first += BLOCK) {
+                    const size_t count = std::min(BLOCK, end - first);
+                    distances_squared(index, first, count, location, owners, distances);
+                    visit(first, static_cast<const double*>(distances), count);
+                }
+            };
+            if (margin < 0 || index.size() <= GRID_THRESHOLD) {
+                scan(0, index.size());
+            } else {
+                index.for_each_run_near(location, margin, scan);
+            }
+        }
+
+        /**
+         * The ships whose centers are within radius of location, added to
+         * found in no particular order.
+         */
+        static void ships_within(
+                const Map& map,
+                const Location& location,
+                const double radius,
+                const Owners& owners,
+                std::vector<ShipDistance>& found)
+        {
+            const SpatialIndex& index = map.ship_index;
+            const double radius_squared = radius * radius;
+            for_each_block(index, location, owners, radius, [&](const size_t first, const double* distances,
+                                                                 const size_t count) {
+                for (size_t i = 0; i < count; ++i) {
+                    if (distances[i] <= radius_squared) {
+                        found.push_back({ index.refs()[first + i], distances[i] });
+                    }
+                }
+            });
+        }
+
+        /**
+         * The k ships nearest location, nearest first, into found (which is
+         * cleared first). Fewer if there aren't k that match. Ties go to the
+         * lower owner ID, then to the earlier ship in Map::ships.
+         */
+        static void nearest_ships(
+                const Map& map,
+                const Location& location,
+                const size_t k,
+                const Owners& owners,
+                std::vector<ShipDistance>& found)
+        {
+            found.clear();
+            const SpatialIndex& index = map.ship_index;
+            if (k == 0 || index.size() == 0) {
+                return;
+            }
+
+            const auto nearer = [](const ShipDistance& a, const ShipDistance& b) {
+                if (a.distance_squared != b.distance_squared) {
+                    return a.distance_squared < b.distance_squared;
+                }
+                if (a.ref.owner_id != b.ref.owner_id) {
+                    return a.ref.owner_id < b.ref.owner_id;
+                }
+                return a.ref.index < b.ref.index;
+            };
+            const auto keep_nearest = [&]() {
+                const size_t kept = std::min(k, found.size());
+                std::partial_sort(found.begin(), found.begin() + kept, found.end(), nearer);
+                found.resize(kept);
+            };
+
+            if (index.size() <= GRID_THRESHOLD) {
+                for_each_block(index, location, owners, -1.0, [&](const size_t first, const double* distances,
+                                                                  const size_t count) {
+                    for (size_t i = 0; i < count; ++i) {
+                        if (distances[i] != std::numeric_limits<double>::infinity()) {
+                            found.push_back({ index.refs()[first + i], distances[i] });
+                        }
+                    }
+                });
+                keep_nearest();
+                return;
+            }
+
+            // Look ever further until k ships are within the distance looked
+            // at, which no ship further away can be nearer than
+            for (double radius = SpatialIndex::CELL_SIZE; ; radius *= 2) {
+                found.clear();
+                const bool everywhere = index.covers_map(location, radius);
+                const double radius_squared = everywhere ? std::numeric_limits<double>::infinity() : radius * radius;
+                for_each_block(index, location, owners, radius, [&](const size_t first, const double* distances,
+                                                                    const size_t count) {
+                    for (size_t i = 0; i < count; ++i) {
+                        if (distances[i] <= radius_squared &&
+                                distances[i] != std::numeric_limits<double>::infinity()) {
+                            found.push_back({ index.refs()[first + i], distances[i] });
+                        }
+                    }
+                });
+                if (found.size() >= k || everywhere) {
+                    keep_nearest();
+                    return;
+                }
+            }
+        }
+
+        /// The ship nearest location, or false if none matches.
+        static possibly<ShipDistance> nearest_ship(const Map& map, const Location& location, const Owners& owners) {
+            static thread_local std::vector<ShipDistance> found;
+            nearest_ships(map, location, 1, owners, found);
+            if (found.empty()) {
+                return { ShipDistance{ SpatialIndex::ShipRef{ -1, 0 }, 0.0 }, false };
+            }
+            return { found.front(), true };
+        }
+
+        /**
+         * The living planet whose edge is nearest location (the distance to
+         * its center less its radius), or nullptr if none matches. There
+         * are few planets, so this looks at each.
+         */
+        static const Planet* nearest_planet(const Map& map, const Location& location, const Owners& owners) {
+            const Planet* nearest = nullptr;
+            double nearest_distance = std::numeric_limits<double>::infinity();
+            for (const Planet& planet : map.planets) {
+                if (!owners.matches(planet.owner_id, planet.owned)) {
+                    continue;
+                }
+                const double distance = location.get_distance_to(planet.location) - planet.radius;
+                if (distance < nearest_distance) {
+                    nearest = &planet;
+                    nearest_distance = distance;
+                }
+            }
+            return nearest;
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#include "shared_memory.hpp"
+#include "hlt_in.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <sstream>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace hlt {
+    namespace shared_memory {
+        /// Must match SHARED_FRAME_CAPACITY and friends in the game
+        /// environment's Networking.hpp.
+        static const size_t FRAME_CAPACITY = 64 << 20;
+        static const size_t MOVES_CAPACITY = 1 << 20;
+
+        struct FrameHeader {
+            uint32_t sequence;
+            uint32_t text_offset, text_length;
+            uint32_t binary_offset, binary_length;
+            uint32_t delta_offset, delta_length;
+        };
+
+#ifdef __linux__
+        static const char* g_frame = nullptr;
+        static char* g_moves = nullptr;
+        static int g_frame_ready = -1;
+        static int g_moves_ready = -1;
+
+        bool open() {
+            const char* channel = std::getenv("HALITE_SHARED_MEMORY");
+            if (channel == nullptr) {
+                return false;
+            }
+
+            int frame_fd, moves_fd;
+            std::istringstream iss(channel);
+            if (!(iss >> frame_fd >> moves_fd >> g_frame_ready >> g_moves_ready)) {
+                return false;
+            }
+
+            void* frame = mmap(nullptr, FRAME_CAPACITY, PROT_READ, MAP_SHARED, frame_fd, 0);
+            void* moves = mmap(nullptr, MOVES_CAPACITY, PROT_READ | PROT_WRITE, MAP_SHARED, moves_fd, 0);
+            if (frame == MAP_FAILED || moves == MAP_FAILED) {
+                return false;
+            }
+            g_frame = static_cast<const char*>(frame);
+            g_moves = static_cast<char*>(moves);
+            return true;
+        }
+
+        bool is_open() {
+            return g_frame != nullptr;
+        }
+
+        bool get_frame(in::FrameFormat format, std::string& frame) {
+            uint64_t signals;
+            if (read(g_frame_ready, &signals, sizeof(signals)) != sizeof(signals)) {
+                return false;
+            }
+
+            FrameHeader header;
+            std::memcpy(&header, g_frame, sizeof(header));
+
+            // Strip what the pipe protocol adds around each frame: the
+            // newline after text, and the length before binary
+            switch (format) {
+                case in::FrameFormat::Binary:
+                    frame.assign(g_frame + header.binary_offset + 4, header.binary_length - 4);
+                    break;
+                case in::FrameFormat::Delta:
+                    frame.assign(g_frame + header.delta_offset, header.delta_length - 1);
+                    break;
+                default:
+                    frame.assign(g_frame + header.text_offset, header.text_length - 1);
+                    break;
+            }
+            return true;
+        }
+
+        bool send_moves(const std::string& moves) {
+            const uint32_t length = static_cast<uint32_t>(moves.size());
+            if (length > MOVES_CAPACITY - sizeof(length)) {
+                return false;
+            }
+            std::memcpy(g_moves, &length, sizeof(length));
+            std::memcpy(g_moves + sizeof(length), moves.data(), length);
+
+            const uint64_t signal = 1;
+            return write(g_moves_ready, &signal, sizeof(signal)) == sizeof(signal);
+        }
+#else
+        bool open() {
+            return false;
+        }
+
+        bool is_open() {
+            return false;
+        }
+
+        bool get_frame(in::FrameFormat, std::string&) {
+            return false;
+        }
+
+        bool send_moves(const std::string&) {
+            return false;
+        }
+#endif
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+namespace hlt {
+    namespace in {
+        enum class FrameFormat;
+    }
+
+    /// The shared memory transport the game offers with --shared-memory
+    /// (Linux only). Frames and moves are then passed through memory shared
+    /// with the game instead of stdin and stdout.
+    namespace shared_memory {
+        /// Map the channel the game offered us, if any.
+        bool open();
+        bool is_open();
+
+        /// Wait for the next frame, and get it in the given format.
+        bool get_frame(in::FrameFormat format, std::string& frame);
+        bool send_moves(const std::string& moves);
+    }
+}
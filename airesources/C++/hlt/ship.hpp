@@ -6,7 +6,7 @@
 
 namespace hlt {
     /// The states a ship can be in regarding docking.
-    enum class ShipDockingStatus {
+    enum class ShipDockingStatus : StoredCounter {
         Undocked = 0,
         Docking = 1,
         Docked = 2,
@@ -15,12 +15,12 @@ namespace hlt {
 
     struct Ship : Entity {
         /// The turns left before the ship can fire again.
-        int weapon_cooldown;
+        StoredCounter weapon_cooldown;
 
         ShipDockingStatus docking_status;
 
         /// The number of turns left to complete (un)docking.
-        int docking_progress;
+        StoredCounter docking_progress;
 
         /// The id of the planet this ship is docked to. Only valid if
         /// Ship::docking_status is -not- DockingStatus::Undocked.
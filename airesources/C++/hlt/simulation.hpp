@@ -0,0 +1,1094 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "map.hpp"
+#include "move.hpp"
+
+namespace hlt {
+    /**
+     * The game's rules, for bots that want to look ahead: Simulator::step
+     * plays the moves of one turn on a Map and leaves it as the next frame
+     * would show it.
+     *
+     * This is a port of the engine's turn (Halite::simulate_turn and
+     * SimulationEvent.cpp in the environment), down to the order things
+     * happen in, so ties between events come out as they do in the game.
+     * Names follow the engine's; keep the two in step. The game's default
+     * constants are assumed, under which drag stops every ship at the end of
+     * a turn, so every ship starts a turn at rest.
+     *
+     * Results are exact against an engine built with HALITE_DOUBLE_PRECISION.
+     * The default build computes in long double, and frames round its
+     * positions to double, so there locations only agree to the last few
+     * bits, and an event that close to a tie can go the other way.
+     */
+    namespace simulation {
+        struct Velocity {
+            double vel_x, vel_y;
+
+            double magnitude() const {
+                return std::sqrt(vel_x * vel_x + vel_y * vel_y);
+            }
+
+            /// Add the given thrust, clipping the result to MAX_SPEED.
+            void accelerate_by(const double thrust, const double angle_rad) {
+                vel_x = vel_x + thrust * std::cos(angle_rad);
+                vel_y = vel_y + thrust * std::sin(angle_rad);
+                if (magnitude() > constants::MAX_SPEED) {
+                    const double scale = constants::MAX_SPEED / magnitude();
+                    vel_x *= scale;
+                    vel_y *= scale;
+                }
+            }
+        };
+
+        /// The engine's distance, which squares with std::pow; kept so that
+        /// the rounding is the same.
+        static double distance2(const Location& l1, const Location& l2) {
+            return std::pow(l2.pos_x - l1.pos_x, 2) + std::pow(l2.pos_y - l1.pos_y, 2);
+        }
+
+        static double distance(const Location& l1, const Location& l2) {
+            return std::sqrt(distance2(l1, l2));
+        }
+
+        /**
+         * The first time in the turn at which two moving circles are r
+         * apart, if they ever are; {true, t} with t possibly outside [0, 1].
+         */
+        static std::pair<bool, double> collision_time(
+                const double r,
+                const Location& loc1, const Location& loc2,
+                const Velocity& vel1, const Velocity& vel2)
+        {
+            const double dx = loc1.pos_x - loc2.pos_x;
+            const double dy = loc1.pos_y - loc2.pos_y;
+            const double dvx = vel1.vel_x - vel2.vel_x;
+            const double dvy = vel1.vel_y - vel2.vel_y;
+
+            const double a = std::pow(dvx, 2) + std::pow(dvy, 2);
+            const double b = 2 * (dx * dvx + dy * dvy);
+            const double c = std::pow(dx, 2) + std::pow(dy, 2) - std::pow(r, 2);
+
+            const double disc = std::pow(b, 2) - 4 * a * c;
+
+            if (a == 0.0) {
+                if (b == 0.0) {
+                    return { c <= 0.0, 0.0 };
+                }
+                const double t = -c / b;
+                return t >= 0.0 ? std::make_pair(true, t) : std::make_pair(false, 0.0);
+            }
+            else if (disc == 0.0) {
+                return { true, -b / (2 * a) };
+            }
+            else if (disc > 0) {
+                const double t1 = -b + std::sqrt(disc);
+                const double t2 = -b - std::sqrt(disc);
+
+                if (t1 >= 0.0 && t2 >= 0.0) {
+                    return { true, std::min(t1, t2) / (2 * a) };
+                }
+                else if (t1 <= 0.0 && t2 <= 0.0) {
+                    return { true, std::max(t1, t2) / (2 * a) };
+                }
+                return { true, 0.0 };
+            }
+            return { false, 0.0 };
+        }
+
+        /// Events that happen within a ten-thousandth of a turn of each
+        /// other happen together.
+        static double round_event_time(const double t) {
+            return std::round(t * 10000) / 10000;
+        }
+
+        /// A ship, as its owner and where it is in Map::ships, or a planet
+        /// (owner -1), as where it is in Map::planets. Ordered as the game
+        /// orders entity IDs.
+        struct EntityRef {
+            PlayerId owner;
+            unsigned int index;
+
+            bool is_planet() const {
+                return owner < 0;
+            }
+        };
+
+        static bool operator==(const EntityRef& r1, const EntityRef& r2) {
+            return r1.owner == r2.owner && r1.index == r2.index;
+        }
+
+        static bool operator!=(const EntityRef& r1, const EntityRef& r2) {
+            return !(r1 == r2);
+        }
+
+        static bool operator<(const EntityRef& r1, const EntityRef& r2) {
+            return r1.owner != r2.owner ? r1.owner < r2.owner : r1.index < r2.index;
+        }
+
+        enum class EventType {
+            Attack,
+            Collision,
+            /// A ship flying off the edge of the map.
+            Desertion,
+        };
+
+        struct Event {
+            EventType type;
+            EntityRef first, second;
+            double time;
+
+            /// The same event, whichever of the two found it.
+            bool operator==(const Event& other) const {
+                return type == other.type &&
+                    ((first == other.first && second == other.second) ||
+                     (first == other.second && second == other.first));
+            }
+
+            bool operator!=(const Event& other) const {
+                return !(*this == other);
+            }
+
+            /// Order by type and unordered pair of entities, ignoring time,
+            /// so that duplicates end up next to each other.
+            bool key_less(const Event& other) const {
+                if (type != other.type) {
+                    return type < other.type;
+                }
+                const EntityRef& low = std::min(first, second);
+                const EntityRef& other_low = std::min(other.first, other.second);
+                if (low != other_low) {
+                    return low < other_low;
+                }
+                return std::max(first, second) < std::max(other.first, other.second);
+            }
+        };
+
+        /**
+         * Drop all but the first of each event, then sort the rest by time,
+         * latest first, so that they can be popped off the back in the
+         * order they were found.
+         */
+        static void sort_events(std::vector<Event>& events) {
+            std::vector<size_t> order(events.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                order[i] = i;
+            }
+            std::stable_sort(order.begin(), order.end(), [&](const size_t i1, const size_t i2) {
+                return events[i1].key_less(events[i2]);
+            });
+
+            std::vector<bool> keep(events.size(), false);
+            for (size_t i = 0; i < order.size(); ++i) {
+                keep[order[i]] = i == 0 || events[order[i - 1]] != events[order[i]];
+            }
+
+            size_t kept = 0;
+            for (size_t i = 0; i < events.size(); ++i) {
+                if (keep[i]) {
+                    events[kept++] = events[i];
+                }
+            }
+            events.erase(events.begin() + kept, events.end());
+
+            std::reverse(events.begin(), events.end());
+            std::stable_sort(events.begin(), events.end(), [](const Event& e1, const Event& e2) {
+                return e1.time > e2.time;
+            });
+        }
+
+        /**
+         * Plays turns on a Map. Reuses its memory from step to step, so
+         * keep one around when searching.
+         */
+        class Simulator {
+        public:
+            /// The ID the next ship made gets. IDs count up from 0 across all
+            /// players, so step never uses one at or below the highest on the
+            /// map; this only needs setting if the newest ships have died.
+            EntityId next_ship_id = 0;
+
+            /**
+             * Play one turn of moves, for any or all players' ships, on map.
+             * Moves are matched to ships by ID, and only a ship's first move
+             * counts. Moves the game would reject with an error (a second
+             * move for a ship, or thrust above MAX_ACCELERATION) are not
+             * checked for.
+             */
+            void step(Map& map, const std::vector<Move>& moves) {
+                start(map, moves);
+
+                process_docking();
+                auto simultaneous_docking = process_moves();
+                process_dock_fighting(simultaneous_docking);
+                process_events();
+                process_movement();
+                process_production();
+                // Drag would stop every ship here: ships can't go faster
+                // than MAX_SPEED, which is below DRAG.
+                process_cooldowns();
+
+                finish();
+            }
+
+        private:
+            /// The ships of every player trying to dock to each planet
+            /// where more than one ship is, by planet index. Hash maps, as
+            /// in the engine: the order players are visited in is the order
+            /// their damage is added up in, which can change the rounding.
+            typedef std::unordered_map<unsigned int, std::unordered_map<PlayerId, std::vector<EntityRef>>>
+                SimultaneousDockMap;
+
+            /// The planets and ships caught up in an attack, or an explosion.
+            struct Attack {
+                EntityRef attacker;
+                std::vector<EntityRef> targets;
+            };
+
+            Map* map = nullptr;
+            /// The players with ships, in order, and their ships and the
+            /// ships' velocities, by PlayerId.
+            std::vector<PlayerId> players;
+            std::vector<std::vector<Ship>*> fleets;
+            std::vector<std::vector<Velocity>> velocities;
+            /// The move of each ship, by ship ID.
+            std::vector<const Move*> ship_moves;
+            /// Planets that two players tried to dock to at once this turn.
+            std::vector<bool> frozen;
+
+            /// Where each ship is in the grid of CollisionMap in the engine
+            /// (see build_collision_map), so that candidates come out in the
+            /// same order.
+            int cell_size = 0;
+            int grid_width = 0;
+            int grid_height = 0;
+            std::vector<unsigned int> cell_offsets;
+            std::vector<EntityRef> cell_ships;
+            std::vector<std::pair<int, EntityRef>> staging;
+            std::vector<int> cells;
+            std::vector<unsigned int> marks;
+            unsigned int stamp = 0;
+            std::vector<EntityRef> candidates;
+
+            std::vector<Event> events;
+            std::vector<Event> simultaneous_events;
+            /// Damage to be dealt at once, by target in the order added,
+            /// and where each ship is in it by ID (plus one).
+            std::vector<std::pair<EntityRef, double>> damage;
+            std::vector<unsigned int> damage_slots;
+            /// The attacks made at once, in the order made, likewise.
+            std::vector<Attack> attacks;
+            size_t num_attacks = 0;
+            std::vector<unsigned int> attack_slots;
+
+            Ship& ship(const EntityRef& ref) {
+                return (*fleets[ref.owner])[ref.index];
+            }
+
+            Planet& planet(const EntityRef& ref) {
+                return map->planets[ref.index];
+            }
+
+            Entity& entity(const EntityRef& ref) {
+                if (ref.is_planet()) {
+                    return planet(ref);
+                }
+                return ship(ref);
+            }
+
+            Velocity& velocity(const EntityRef& ref) {
+                return velocities[ref.owner][ref.index];
+            }
+
+            Planet& planet_with_id(const EntityId planet_id) {
+                return map->planets[map->planet_map.at(planet_id)];
+            }
+
+            static EntityRef planet_ref(const unsigned int index) {
+                return { -1, index };
+            }
+
+            /// Dead entities stay on the map, with no health, until finish.
+            bool is_valid(const EntityRef& ref) {
+                return entity(ref).is_alive();
+            }
+
+            template<typename Visit>
+            void for_each_ship(Visit visit) {
+                for (const PlayerId player_id : players) {
+                    for (unsigned int i = 0; i < fleets[player_id]->size(); ++i) {
+                        visit(EntityRef{ player_id, i });
+                    }
+                }
+            }
+
+            void add_player(const PlayerId player_id, std::vector<Ship>& ships) {
+                if (static_cast<size_t>(player_id) >= fleets.size()) {
+                    fleets.resize(player_id + 1, nullptr);
+                    velocities.resize(player_id + 1);
+                }
+                fleets[player_id] = &ships;
+                velocities[player_id].assign(ships.size(), Velocity{ 0, 0 });
+            }
+
+            void start(Map& game_map, const std::vector<Move>& moves) {
+                map = &game_map;
+
+                players.clear();
+                std::fill(fleets.begin(), fleets.end(), nullptr);
+                EntityId max_ship_id = 0;
+                bool any_ships = false;
+                for (auto& player_ships : game_map.ships) {
+                    players.push_back(player_ships.first);
+                    add_player(player_ships.first, player_ships.second);
+                    for (const Ship& ship : player_ships.second) {
+                        max_ship_id = std::max(max_ship_id, ship.entity_id);
+                        any_ships = true;
+                    }
+                }
+                std::sort(players.begin(), players.end());
+                if (any_ships) {
+                    next_ship_id = std::max(next_ship_id, max_ship_id + 1);
+                }
+
+                ship_moves.assign(next_ship_id, nullptr);
+                for (const Move& move : moves) {
+                    if (move.ship_id < ship_moves.size() && ship_moves[move.ship_id] == nullptr) {
+                        ship_moves[move.ship_id] = &move;
+                    }
+                }
+
+                frozen.assign(game_map.planets.size(), false);
+            }
+
+            void finish() {
+                for (const PlayerId player_id : players) {
+                    std::vector<Ship>& ships = *fleets[player_id];
+                    ships.erase(std::remove_if(ships.begin(), ships.end(), [](const Ship& ship) {
+                        return !ship.is_alive();
+                    }), ships.end());
+
+                    EntityTable& ship_map = map->ship_map[player_id];
+                    ship_map.clear();
+                    for (unsigned int i = 0; i < ships.size(); ++i) {
+                        ship_map.set(ships[i].entity_id, i);
+                    }
+                }
+
+                map->planets.erase(std::remove_if(map->planets.begin(), map->planets.end(), [](const Planet& planet) {
+                    return !planet.is_alive();
+                }), map->planets.end());
+                map->planet_map.clear();
+                for (unsigned int i = 0; i < map->planets.size(); ++i) {
+                    map->planet_map.set(map->planets[i].entity_id, i);
+                }
+
+                map->index_ships();
+            }
+
+            static void remove_docked_ship(Planet& planet, const EntityId ship_id) {
+                const auto pos = std::find(planet.docked_ships.begin(), planet.docked_ships.end(), ship_id);
+                if (pos != planet.docked_ships.end()) {
+                    planet.docked_ships.erase(pos);
+                }
+                if (planet.docked_ships.empty()) {
+                    planet.owned = false;
+                    planet.owner_id = -1;
+                }
+            }
+
+            static void reset_docking_status(Ship& ship) {
+                ship.docking_status = ShipDockingStatus::Undocked;
+                ship.docking_progress = 0;
+                ship.docked_planet = 0;
+            }
+
+            void process_docking() {
+                for_each_ship([&](const EntityRef& ref) {
+                    Ship& ship = this->ship(ref);
+                    if (ship.docking_status == ShipDockingStatus::Docking) {
+                        if (--ship.docking_progress == 0) {
+                            ship.docking_status = ShipDockingStatus::Docked;
+                        }
+                    }
+                    else if (ship.docking_status == ShipDockingStatus::Undocking) {
+                        if (--ship.docking_progress == 0) {
+                            ship.docking_status = ShipDockingStatus::Undocked;
+                            remove_docked_ship(planet_with_id(ship.docked_planet), ship.entity_id);
+                        }
+                    }
+                    else if (ship.docking_status == ShipDockingStatus::Docked) {
+                        ship.health = std::min(constants::MAX_SHIP_HEALTH,
+                                               ship.health + constants::DOCKED_SHIP_REGENERATION);
+                    }
+                });
+            }
+
+            bool can_dock(const EntityRef& ref, const Planet& planet) {
+                const Ship& ship = this->ship(ref);
+                const Velocity& velocity = this->velocity(ref);
+                return ship.docking_status == ShipDockingStatus::Undocked &&
+                    velocity.vel_x == 0.0 && velocity.vel_y == 0.0 &&
+                    distance(ship.location, planet.location) <= constants::DOCK_RADIUS + planet.radius + ship.radius;
+            }
+
+            void process_docking_move(const EntityRef& ref, const EntityId planet_id,
+                                      SimultaneousDockMap& simultaneous_docking) {
+                if (map->planet_map.count(planet_id) == 0) {
+                    return;
+                }
+                const unsigned int planet_index = map->planet_map.at(planet_id);
+                Planet& planet = map->planets[planet_index];
+                if (!planet.is_alive() || !can_dock(ref, planet)) {
+                    return;
+                }
+
+                if (frozen[planet_index]) {
+                    simultaneous_docking[planet_index][ref.owner].push_back(ref);
+                    return;
+                }
+
+                if (!planet.owned) {
+                    planet.owned = true;
+                    planet.owner_id = ref.owner;
+                    planet.current_production = 0;
+                }
+
+                Ship& ship = this->ship(ref);
+                if (planet.owner_id == ref.owner && planet.docked_ships.size() < planet.docking_spots) {
+                    ship.docked_planet = planet_id;
+                    ship.docking_status = ShipDockingStatus::Docking;
+                    ship.docking_progress = constants::DOCK_TURNS;
+                    planet.docked_ships.push_back(ship.entity_id);
+                }
+                else if (planet.owner_id != ref.owner) {
+                    // If the owner's ships all just started docking, both
+                    // players tried to dock this turn, and nobody gets to
+                    const PlayerId owner = planet.owner_id;
+                    const EntityTable& owner_ship_map = map->ship_map.at(owner);
+                    const bool all_just_docking = std::all_of(
+                        planet.docked_ships.begin(), planet.docked_ships.end(), [&](const EntityId ship_id) {
+                            const Ship& docked = (*fleets[owner])[owner_ship_map.at(ship_id)];
+                            return docked.docking_status == ShipDockingStatus::Docking &&
+                                docked.docking_progress == static_cast<int>(constants::DOCK_TURNS);
+                        });
+                    if (all_just_docking) {
+                        frozen[planet_index] = true;
+
+                        for (const EntityId ship_id : planet.docked_ships) {
+                            const unsigned int index = owner_ship_map.at(ship_id);
+                            reset_docking_status((*fleets[owner])[index]);
+                            simultaneous_docking[planet_index][owner].push_back(EntityRef{ owner, index });
+                        }
+
+                        planet.docked_ships.clear();
+                        planet.owned = false;
+                        planet.owner_id = -1;
+
+                        simultaneous_docking[planet_index][ref.owner].push_back(ref);
+                    }
+                }
+                else {
+                    // Too many of the owner's ships are trying to dock, in
+                    // case it comes to a fight
+                    simultaneous_docking[planet_index][ref.owner].push_back(ref);
+                }
+            }
+
+            SimultaneousDockMap process_moves() {
+                SimultaneousDockMap simultaneous_docking;
+
+                for_each_ship([&](const EntityRef& ref) {
+                    Ship& ship = this->ship(ref);
+                    if (ship.entity_id >= ship_moves.size() || ship_moves[ship.entity_id] == nullptr) {
+                        return;
+                    }
+
+                    const Move& move = *ship_moves[ship.entity_id];
+                    switch (move.type) {
+                        case MoveType::Noop:
+                            break;
+                        case MoveType::Thrust:
+                            if (ship.docking_status == ShipDockingStatus::Undocked) {
+                                velocity(ref).accelerate_by(move.move_thrust, move.move_angle_deg * M_PI / 180.0);
+                            }
+                            break;
+                        case MoveType::Dock:
+                            process_docking_move(ref, move.dock_to, simultaneous_docking);
+                            break;
+                        case MoveType::Undock:
+                            if (ship.docking_status == ShipDockingStatus::Docked) {
+                                ship.docking_status = ShipDockingStatus::Undocking;
+                                ship.docking_progress = constants::DOCK_TURNS;
+                            }
+                            break;
+                    }
+                });
+
+                return simultaneous_docking;
+            }
+
+            void add_damage(const EntityRef& target, const double amount) {
+                const EntityId ship_id = ship(target).entity_id;
+                if (ship_id >= damage_slots.size()) {
+                    damage_slots.resize(ship_id + 1, 0);
+                }
+                if (damage_slots[ship_id] == 0) {
+                    damage.emplace_back(target, 0.0);
+                    damage_slots[ship_id] = static_cast<unsigned int>(damage.size());
+                }
+                damage[damage_slots[ship_id] - 1].second += amount;
+            }
+
+            /// Deal the damage added since the last time, in the order added.
+            void process_damage() {
+                for (const auto& entry : damage) {
+                    damage_slots[ship(entry.first).entity_id] = 0;
+                }
+                for (const auto& entry : damage) {
+                    damage_entity(entry.first, static_cast<unsigned short>(entry.second));
+                }
+                damage.clear();
+            }
+
+            void process_dock_fighting(const SimultaneousDockMap& simultaneous_docking) {
+                for (const auto& planet_entry : simultaneous_docking) {
+                    // Only the owner trying to dock too many ships
+                    if (planet_entry.second.size() == 1) {
+                        continue;
+                    }
+
+                    size_t total = 0;
+                    for (const auto& player_entry : planet_entry.second) {
+                        total += player_entry.second.size();
+                    }
+
+                    for (const auto& player_entry : planet_entry.second) {
+                        const double split_damage = static_cast<double>(constants::WEAPON_DAMAGE) /
+                            (total - player_entry.second.size());
+                        for (const EntityRef& ref : player_entry.second) {
+                            Ship& ship = this->ship(ref);
+                            if (!ship.is_alive() || ship.weapon_cooldown != 0) {
+                                continue;
+                            }
+
+                            ship.weapon_cooldown = constants::WEAPON_COOLDOWN;
+                            for (const auto& other_player : planet_entry.second) {
+                                if (other_player.first == player_entry.first) {
+                                    continue;
+                                }
+                                for (const EntityRef& other_ship : other_player.second) {
+                                    add_damage(other_ship, split_damage);
+                                }
+                            }
+                        }
+                    }
+
+                    process_damage();
+                }
+            }
+
+            static unsigned short planet_explosion_damage(const Planet& planet, const double distance,
+                                                          const double max_distance) {
+                if (distance < planet.radius) {
+                    return std::numeric_limits<unsigned short>::max();
+                }
+
+                // Ranges linearly from 5x max ship health (at the crust) to
+                // 0.5x max ship health (at the maximum distance)
+                const double distance_from_crust = distance - planet.radius;
+                const double min_damage = 0.5 * constants::MAX_SHIP_HEALTH;
+                const double max_damage = 5.0 * constants::MAX_SHIP_HEALTH;
+                return static_cast<unsigned short>(
+                    min_damage + (1.0 - distance_from_crust / max_distance) * (max_damage - min_damage));
+            }
+
+            void damage_entity(const EntityRef& ref, const int amount) {
+                Entity& entity = this->entity(ref);
+                if (entity.health <= amount) {
+                    kill_entity(ref);
+                }
+                else {
+                    entity.health -= amount;
+                }
+            }
+
+            void kill_entity(const EntityRef& ref) {
+                Entity& entity = this->entity(ref);
+                if (!entity.is_alive()) {
+                    return;
+                }
+                entity.health = 0;
+
+                if (!ref.is_planet()) {
+                    Ship& ship = this->ship(ref);
+                    if (ship.docking_status != ShipDockingStatus::Undocked) {
+                        remove_docked_ship(planet_with_id(ship.docked_planet), ship.entity_id);
+                        ship.docking_status = ShipDockingStatus::Undocked;
+                        ship.docked_planet = 0;
+                    }
+                    return;
+                }
+
+                Planet& planet = this->planet(ref);
+                for (const EntityId ship_id : planet.docked_ships) {
+                    reset_docking_status((*fleets[planet.owner_id])[map->ship_map.at(planet.owner_id).at(ship_id)]);
+                }
+
+                // Everything near enough is damaged: planets, then ships,
+                // each in ID order. Explosions can chain, so this can't be a
+                // member buffer.
+                const double max_distance = std::max(static_cast<double>(planet.radius), constants::DOCK_RADIUS);
+                const double explosion_radius = planet.radius + max_distance;
+                std::vector<EntityRef> caught_in_explosion;
+                for (unsigned int i = 0; i < map->planets.size(); ++i) {
+                    const Planet& target = map->planets[i];
+                    if (target.is_alive() &&
+                        distance2(planet.location, target.location) <= std::pow(explosion_radius + target.radius, 2)) {
+                        caught_in_explosion.push_back(planet_ref(i));
+                    }
+                }
+                for_each_ship([&](const EntityRef& target_ref) {
+                    const Ship& target = ship(target_ref);
+                    if (target.is_alive() &&
+                        distance2(planet.location, target.location) <= std::pow(explosion_radius + target.radius, 2)) {
+                        caught_in_explosion.push_back(target_ref);
+                    }
+                });
+
+                for (const EntityRef& target_ref : caught_in_explosion) {
+                    if (target_ref != ref) {
+                        const Entity& target = this->entity(target_ref);
+                        const double target_distance = distance(planet.location, target.location);
+                        damage_entity(target_ref, planet_explosion_damage(
+                            planet, target_distance - target.radius, max_distance));
+                    }
+                }
+            }
+
+            /// How far a ship can reach this turn, to hit or shoot at things.
+            double event_horizon(const EntityRef& ref) {
+                return ship(ref).radius + velocity(ref).magnitude() + constants::WEAPON_RADIUS;
+            }
+
+            static bool test_aabb_circle(const int rect_x, const int rect_y, const int rect_w, const int rect_h,
+                                         const Location& center, const double radius) {
+                const double x_half_rect = rect_w / 2.0;
+                const double y_half_rect = rect_h / 2.0;
+                const double x_dist = std::abs(center.pos_x - rect_x - x_half_rect);
+                const double y_dist = std::abs(center.pos_y - rect_y - y_half_rect);
+
+                if (x_dist > x_half_rect + radius) return false;
+                if (y_dist > y_half_rect + radius) return false;
+
+                if (x_dist <= x_half_rect) return true;
+                if (y_dist <= y_half_rect) return true;
+
+                const double dx = x_dist - x_half_rect;
+                const double dy = y_dist - y_half_rect;
+                return std::pow(dx, 2) + std::pow(dy, 2) <= std::pow(radius, 2);
+            }
+
+            /// The cells of the collision grid a circle overlaps, as the
+            /// engine lists them.
+            void overlapping_cells(const Location& location, const double radius) {
+                cells.clear();
+
+                const double low_x = std::ceil((location.pos_x - radius) / cell_size) - 1;
+                const double low_y = std::ceil((location.pos_y - radius) / cell_size) - 1;
+                const double high_x = std::floor((location.pos_x + radius) / cell_size);
+                const double high_y = std::floor((location.pos_y + radius) / cell_size);
+
+                if (high_x < 0 || high_y < 0 || low_x >= grid_width || low_y >= grid_height) {
+                    return;
+                }
+
+                const int min_x = static_cast<int>(std::max(0.0, low_x));
+                const int min_y = static_cast<int>(std::max(0.0, low_y));
+                const int max_x = static_cast<int>(std::min<double>(grid_width - 1, high_x));
+                const int max_y = static_cast<int>(std::min<double>(grid_height - 1, high_y));
+
+                for (int cell_x = min_x; cell_x <= max_x; ++cell_x) {
+                    for (int cell_y = min_y; cell_y <= max_y; ++cell_y) {
+                        if (test_aabb_circle(cell_x * cell_size, cell_y * cell_size,
+                                             cell_size, cell_size, location, radius)) {
+                            cells.push_back(cell_x * grid_height + cell_y);
+                        }
+                    }
+                }
+            }
+
+            /**
+             * Bucket the living ships' event horizons in a grid sized as the
+             * engine's CollisionMap is, whose queries decide the order
+             * events are found in, and so the order of simultaneous ones.
+             */
+            void build_collision_map() {
+                staging.clear();
+                double max_radius = 0;
+                size_t num_ships = 0;
+                for_each_ship([&](const EntityRef& ref) {
+                    if (ship(ref).is_alive()) {
+                        max_radius = std::max(max_radius, event_horizon(ref));
+                        ++num_ships;
+                    }
+                });
+
+                // Circles cover about 2x2 cells, unless that makes more
+                // than 4 cells per ship
+                double size = std::max(4.0, std::ceil(2 * max_radius));
+                const size_t max_cells = std::max<size_t>(16, 4 * num_ships);
+                const double area = static_cast<double>(map->map_width) * map->map_height;
+                size = std::max(size, std::ceil(std::sqrt(area / max_cells)));
+                cell_size = static_cast<int>(size);
+                grid_width = static_cast<int>(std::ceil(static_cast<double>(map->map_width) / cell_size));
+                grid_height = static_cast<int>(std::ceil(static_cast<double>(map->map_height) / cell_size));
+
+                for_each_ship([&](const EntityRef& ref) {
+                    if (!ship(ref).is_alive()) {
+                        return;
+                    }
+                    overlapping_cells(ship(ref).location, event_horizon(ref));
+                    for (const int cell : cells) {
+                        staging.emplace_back(cell, ref);
+                    }
+                });
+
+                // A stable counting sort, so each cell lists its ships in ID
+                // order
+                cell_offsets.assign(static_cast<size_t>(grid_width * grid_height) + 1, 0);
+                for (const auto& entry : staging) {
+                    ++cell_offsets[entry.first + 1];
+                }
+                for (size_t cell = 1; cell < cell_offsets.size(); ++cell) {
+                    cell_offsets[cell] += cell_offsets[cell - 1];
+                }
+                cell_ships.resize(staging.size());
+                std::vector<unsigned int> cursors(cell_offsets.begin(), cell_offsets.end() - 1);
+                for (const auto& entry : staging) {
+                    cell_ships[cursors[entry.first]++] = entry.second;
+                }
+            }
+
+            /// The ships sharing a cell with the circle, each once, in the
+            /// engine's order.
+            void query_collision_map(const Location& location, const double radius) {
+                candidates.clear();
+                if (++stamp == 0) {
+                    std::fill(marks.begin(), marks.end(), 0);
+                    stamp = 1;
+                }
+
+                overlapping_cells(location, radius);
+                for (const int cell : cells) {
+                    for (unsigned int i = cell_offsets[cell]; i < cell_offsets[cell + 1]; ++i) {
+                        const EntityId ship_id = ship(cell_ships[i]).entity_id;
+                        if (ship_id >= marks.size()) {
+                            marks.resize(ship_id + 1, 0);
+                        }
+                        if (marks[ship_id] != stamp) {
+                            marks[ship_id] = stamp;
+                            candidates.push_back(cell_ships[i]);
+                        }
+                    }
+                }
+            }
+
+            void find_events(const EntityRef& ref1, const EntityRef& ref2) {
+                const Ship& ship1 = ship(ref1);
+                const Ship& ship2 = ship(ref2);
+                const Velocity& vel1 = velocity(ref1);
+                const Velocity& vel2 = velocity(ref2);
+                const double ship_distance = distance(ship1.location, ship2.location);
+                const double reach = vel1.magnitude() + vel2.magnitude() + ship1.radius + ship2.radius;
+
+                if (ref1.owner != ref2.owner && ship_distance <= reach + constants::WEAPON_RADIUS) {
+                    const double attack_radius = ship1.radius + ship2.radius + constants::WEAPON_RADIUS;
+                    const auto t = collision_time(attack_radius, ship1.location, ship2.location, vel1, vel2);
+                    if (t.first && t.second >= 0 && t.second <= 1) {
+                        events.push_back({ EventType::Attack, ref1, ref2, round_event_time(t.second) });
+                    }
+                    else if (ship_distance < attack_radius) {
+                        events.push_back({ EventType::Attack, ref1, ref2, 0 });
+                    }
+                }
+
+                if (ref1 != ref2 && ship_distance <= reach) {
+                    const double collision_radius = ship1.radius + ship2.radius;
+                    const auto t = collision_time(collision_radius, ship1.location, ship2.location, vel1, vel2);
+                    if (t.first && t.second >= 0 && t.second <= 1) {
+                        events.push_back({ EventType::Collision, ref1, ref2, round_event_time(t.second) });
+                    }
+                }
+            }
+
+            void find_ship_events(const EntityRef& ref1) {
+                const Ship& ship1 = ship(ref1);
+                const Velocity& vel1 = velocity(ref1);
+
+                query_collision_map(ship1.location, event_horizon(ref1));
+                for (const EntityRef& ref2 : candidates) {
+                    find_events(ref1, ref2);
+                }
+
+                for (unsigned int i = 0; i < map->planets.size(); ++i) {
+                    const Planet& planet = map->planets[i];
+                    if (!planet.is_alive()) {
+                        continue;
+                    }
+                    const double planet_distance = distance(ship1.location, planet.location);
+                    if (planet_distance <= vel1.magnitude() + ship1.radius + planet.radius) {
+                        const auto t = collision_time(ship1.radius + planet.radius, ship1.location, planet.location,
+                                                      vel1, Velocity{ 0, 0 });
+                        if (t.first && t.second >= 0 && t.second <= 1) {
+                            events.push_back({ EventType::Collision, ref1, planet_ref(i), round_event_time(t.second) });
+                        }
+                    }
+                }
+
+                // Ships flying off the map crash at the edge
+                const double final_x = ship1.location.pos_x + vel1.vel_x;
+                const double final_y = ship1.location.pos_y + vel1.vel_y;
+                if (final_x < 0 || final_y < 0 || final_x >= map->map_width || final_y >= map->map_height) {
+                    double time = 1000000.0;
+                    if (vel1.vel_x != 0.0) {
+                        const double t1 = -ship1.location.pos_x / vel1.vel_x;
+                        if (t1 < time && t1 >= 0) time = t1;
+                        const double t2 = (map->map_width - ship1.location.pos_x) / vel1.vel_x;
+                        if (t2 < time && t2 >= 0) time = t2;
+                    }
+                    if (vel1.vel_y != 0.0) {
+                        const double t3 = -ship1.location.pos_y / vel1.vel_y;
+                        if (t3 < time && t3 >= 0) time = t3;
+                        const double t4 = (map->map_height - ship1.location.pos_y) / vel1.vel_y;
+                        if (t4 < time && t4 >= 0) time = t4;
+                    }
+                    events.push_back({ EventType::Desertion, ref1, ref1, round_event_time(time) });
+                }
+            }
+
+            void add_target(const EntityRef& attacker_ref, const EntityRef& target) {
+                const Ship& attacker = ship(attacker_ref);
+                if (!attacker.is_alive() || attacker.weapon_cooldown > 0 ||
+                    attacker.docking_status != ShipDockingStatus::Undocked) {
+                    return;
+                }
+
+                if (attacker.entity_id >= attack_slots.size()) {
+                    attack_slots.resize(attacker.entity_id + 1, 0);
+                }
+                if (attack_slots[attacker.entity_id] == 0) {
+                    if (num_attacks == attacks.size()) {
+                        attacks.emplace_back();
+                    }
+                    attacks[num_attacks].attacker = attacker_ref;
+                    attacks[num_attacks].targets.clear();
+                    attack_slots[attacker.entity_id] = static_cast<unsigned int>(++num_attacks);
+                }
+                attacks[attack_slots[attacker.entity_id] - 1].targets.push_back(target);
+            }
+
+            void process_events() {
+                build_collision_map();
+                events.clear();
+                for_each_ship([&](const EntityRef& ref) {
+                    if (ship(ref).is_alive()) {
+                        find_ship_events(ref);
+                    }
+                });
+                sort_events(events);
+
+                while (!events.empty()) {
+                    simultaneous_events.clear();
+                    simultaneous_events.push_back(events.back());
+                    events.pop_back();
+                    while (!events.empty() && events.back().time == simultaneous_events.back().time) {
+                        simultaneous_events.push_back(events.back());
+                        events.pop_back();
+                    }
+
+                    simultaneous_events.erase(std::remove_if(
+                        simultaneous_events.begin(), simultaneous_events.end(), [&](const Event& event) {
+                            return !is_valid(event.first) || !is_valid(event.second);
+                        }), simultaneous_events.end());
+
+                    num_attacks = 0;
+                    for (const Event& event : simultaneous_events) {
+                        switch (event.type) {
+                            case EventType::Collision: {
+                                // A ship takes all its own health; a planet
+                                // takes as much as the ship had left
+                                const int first_health = entity(event.first).health;
+                                const int second_health = entity(event.second).health;
+                                const int second_damage = event.second.is_planet()
+                                    ? std::min(first_health, second_health) : second_health;
+                                damage_entity(event.first, first_health);
+                                damage_entity(event.second, second_damage);
+                                break;
+                            }
+                            case EventType::Desertion:
+                                damage_entity(event.first, entity(event.first).health);
+                                break;
+                            case EventType::Attack:
+                                add_target(event.first, event.second);
+                                add_target(event.second, event.first);
+                                break;
+                        }
+                    }
+
+                    // Cooldowns only change now, so every attack at this
+                    // time was made
+                    for (size_t i = 0; i < num_attacks; ++i) {
+                        const Attack& attack = attacks[i];
+                        Ship& attacker = ship(attack.attacker);
+                        attack_slots[attacker.entity_id] = 0;
+                        attacker.weapon_cooldown = constants::WEAPON_COOLDOWN;
+                        for (const EntityRef& target : attack.targets) {
+                            add_damage(target, static_cast<double>(constants::WEAPON_DAMAGE) / attack.targets.size());
+                        }
+                    }
+
+                    process_damage();
+                }
+            }
+
+            void process_movement() {
+                for_each_ship([&](const EntityRef& ref) {
+                    Ship& ship = this->ship(ref);
+                    const Velocity& velocity = this->velocity(ref);
+                    ship.location.pos_x += velocity.vel_x;
+                    ship.location.pos_y += velocity.vel_y;
+                });
+            }
+
+            /// Where a planet makes ships, best first: the points up to
+            /// SPAWN_RADIUS out from its surface that are on the map, nearest
+            /// the center of the map first.
+            void spawn_locations(const Planet& planet, std::vector<Location>& locations) const {
+                const Location center = { map->map_width / 2.0, map->map_height / 2.0 };
+                std::vector<std::pair<double, Location>> spots;
+                for (int dx = -constants::SPAWN_RADIUS; dx <= constants::SPAWN_RADIUS; ++dx) {
+                    for (int dy = -constants::SPAWN_RADIUS; dy <= constants::SPAWN_RADIUS; ++dy) {
+                        const double offset_angle = std::atan2(dy, dx);
+                        const double pos_x = planet.location.pos_x + (dx + planet.radius * std::cos(offset_angle));
+                        const double pos_y = planet.location.pos_y + (dy + planet.radius * std::sin(offset_angle));
+                        if (pos_x < 0 || pos_x >= map->map_width || pos_y < 0 || pos_y >= map->map_height) {
+                            continue;
+                        }
+                        const Location location = { pos_x, pos_y };
+                        spots.emplace_back(distance(location, center), location);
+                    }
+                }
+                std::stable_sort(spots.begin(), spots.end(), [](const std::pair<double, Location>& a,
+                                                                const std::pair<double, Location>& b) {
+                    return a.first < b.first;
+                });
+
+                locations.clear();
+                for (const auto& spot : spots) {
+                    locations.push_back(spot.second);
+                }
+            }
+
+            bool is_occupied(const Location& location, const double open_radius) {
+                for (const Planet& planet : map->planets) {
+                    if (planet.is_alive() &&
+                        distance2(location, planet.location) <= std::pow(open_radius + planet.radius, 2)) {
+                        return true;
+                    }
+                }
+                bool occupied = false;
+                for_each_ship([&](const EntityRef& ref) {
+                    const Ship& ship = this->ship(ref);
+                    if (!occupied && ship.is_alive() &&
+                        distance2(location, ship.location) <= std::pow(open_radius + ship.radius, 2)) {
+                        occupied = true;
+                    }
+                });
+                return occupied;
+            }
+
+            void spawn_ship(const Location& location, const PlayerId owner) {
+                if (static_cast<size_t>(owner) >= fleets.size() || fleets[owner] == nullptr) {
+                    add_player(owner, map->ships[owner]);
+                    players.insert(std::upper_bound(players.begin(), players.end(), owner), owner);
+                }
+
+                Ship ship;
+                ship.entity_id = next_ship_id++;
+                ship.owner_id = owner;
+                ship.location = location;
+                ship.health = constants::BASE_SHIP_HEALTH;
+                ship.radius = constants::SHIP_RADIUS;
+                ship.weapon_cooldown = 0;
+                ship.docking_status = ShipDockingStatus::Undocked;
+                ship.docking_progress = 0;
+                ship.docked_planet = 0;
+                fleets[owner]->push_back(ship);
+                velocities[owner].push_back(Velocity{ 0, 0 });
+            }
+
+            void process_production() {
+                const double open_radius = constants::SHIP_RADIUS * 3;
+                std::vector<Location> locations;
+
+                for (Planet& planet : map->planets) {
+                    if (!planet.is_alive() || !planet.owned) {
+                        continue;
+                    }
+
+                    const std::vector<Ship>& owner_ships = *fleets[planet.owner_id];
+                    const EntityTable& owner_ship_map = map->ship_map.at(planet.owner_id);
+                    const long num_docked_ships = std::count_if(
+                        planet.docked_ships.begin(), planet.docked_ships.end(), [&](const EntityId ship_id) {
+                            return owner_ships[owner_ship_map.at(ship_id)].docking_status == ShipDockingStatus::Docked;
+                        });
+                    if (num_docked_ships == 0) {
+                        continue;
+                    }
+
+                    const int production = std::min(
+                        planet.remaining_production,
+                        static_cast<int>(constants::BASE_PRODUCTIVITY +
+                                         (num_docked_ships - 1) * constants::ADDITIONAL_PRODUCTIVITY));
+                    if (!constants::INFINITE_RESOURCES) {
+                        planet.remaining_production -= production;
+                    }
+                    planet.current_production += production;
+
+                    if (planet.current_production >= constants::PRODUCTION_PER_SHIP) {
+                        spawn_locations(planet, locations);
+                    }
+                    while (planet.current_production >= constants::PRODUCTION_PER_SHIP) {
+                        const auto free = std::find_if(locations.begin(), locations.end(), [&](const Location& location) {
+                            return !is_occupied(location, open_radius);
+                        });
+                        if (free == locations.end()) {
+                            // Keep the production for later
+                            break;
+                        }
+                        planet.current_production -= constants::PRODUCTION_PER_SHIP;
+                        spawn_ship(*free, planet.owner_id);
+                    }
+                }
+            }
+
+            void process_cooldowns() {
+                for_each_ship([&](const EntityRef& ref) {
+                    Ship& ship = this->ship(ref);
+                    if (ship.weapon_cooldown > 0) {
+                        --ship.weapon_cooldown;
+                    }
+                });
+            }
+        };
+    }
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#include "location.hpp"
+#include "ship.hpp"
+#include "types.hpp"
+
+namespace hlt {
+    /**
+     * The ships on the map, bucketed by location in a uniform grid, so that
+     * finding those near a line segment doesn't mean looking at all of them.
+     *
+     * Ships are small, so each is only in the cell of its center, and
+     * queries widen the area they look at by the margin they're given.
+     * Ships are referred to by where they are in Map::ships, which keeps the
+     * index valid in copies of the map. The parsers in hlt_in.hpp rebuild
+     * it every turn, reusing its memory.
+     *
+     * The ships' positions and owners are copied out in the index's order,
+     * each in an array of its own, so that a run of cells can be scanned
+     * with SIMD (see query.hpp).
+     */
+    class SpatialIndex {
+    public:
+        /// The width and height of each cell.
+        static constexpr double CELL_SIZE = 8.0;
+
+        /// Where a ship is: Map::ships.at(owner_id)[index].
+        struct ShipRef {
+            PlayerId owner_id;
+            unsigned int index;
+        };
+
+        void build(const std::unordered_map<PlayerId, std::vector<Ship>>& ships,
+                   const int map_width, const int map_height) {
+            columns = std::max(1, static_cast<int>(std::ceil(map_width / CELL_SIZE)));
+            rows = std::max(1, static_cast<int>(std::ceil(map_height / CELL_SIZE)));
+
+            // A counting sort of the ships by cell
+            cell_starts.assign(static_cast<size_t>(columns * rows) + 1, 0);
+            ship_cells.clear();
+            for (const auto& player_ships : ships) {
+                for (const Ship& ship : player_ships.second) {
+                    const int cell = row_of(ship.location.pos_y) * columns + column_of(ship.location.pos_x);
+                    ship_cells.push_back(cell);
+                    ++cell_starts[cell + 1];
+                }
+            }
+            for (size_t cell = 1; cell < cell_starts.size(); ++cell) {
+                cell_starts[cell] += cell_starts[cell - 1];
+            }
+
+            entries.resize(ship_cells.size());
+            entry_x.resize(ship_cells.size());
+            entry_y.resize(ship_cells.size());
+            entry_owner.resize(ship_cells.size());
+            fill_positions.assign(cell_starts.begin(), cell_starts.end() - 1);
+            size_t ship_number = 0;
+            for (const auto& player_ships : ships) {
+                for (unsigned int i = 0; i < player_ships.second.size(); ++i) {
+                    const int cell = ship_cells[ship_number++];
+                    const unsigned int entry = fill_positions[cell]++;
+                    entries[entry] = { player_ships.first, i };
+                    entry_x[entry] = player_ships.second[i].location.pos_x;
+                    entry_y[entry] = player_ships.second[i].location.pos_y;
+                    entry_owner[entry] = player_ships.first;
+                }
+            }
+        }
+
+        /// The number of ships indexed.
+        size_t size() const {
+            return entries.size();
+        }
+
+        /// The ships in the index's order, with their centers and owners
+        /// (as doubles, to compare alongside the centers) at the same
+        /// places in the arrays below.
+        const ShipRef* refs() const {
+            return entries.data();
+        }
+
+        const double* xs() const {
+            return entry_x.data();
+        }
+
+        const double* ys() const {
+            return entry_y.data();
+        }
+
+        const double* owners() const {
+            return entry_owner.data();
+        }
+
+        /**
+         * Call visit(begin, end) with runs of the index's entries, between
+         * them holding every ship whose center may be within margin of
+         * location: one run per row of cells. Some further away may be in
+         * them too, so callers still need an exact test.
+         */
+        template<typename Visit>
+        void for_each_run_near(const Location& location, const double margin, Visit visit) const {
+            if (entries.empty()) {
+                return;
+            }
+
+            const int first_row = row_of(location.pos_y - margin);
+            const int last_row = row_of(location.pos_y + margin);
+            const int first_column = column_of(location.pos_x - margin);
+            const int last_column = column_of(location.pos_x + margin);
+            for (int row = first_row; row <= last_row; ++row) {
+                // A row's cells are next to each other in entries
+                const unsigned int* const cells = cell_starts.data() + row * columns;
+                if (cells[first_column] < cells[last_column + 1]) {
+                    visit(static_cast<size_t>(cells[first_column]), static_cast<size_t>(cells[last_column + 1]));
+                }
+            }
+        }
+
+        /// Whether a square of the given half-width around location covers
+        /// the whole map, so a larger one wouldn't find any more ships.
+        bool covers_map(const Location& location, const double half_width) const {
+            return row_of(location.pos_y - half_width) == 0 && row_of(location.pos_y + half_width) == rows - 1 &&
+                   column_of(location.pos_x - half_width) == 0 && column_of(location.pos_x + half_width) == columns - 1;
+        }
+
+        /**
+         * Call visit(ShipRef) for every ship whose center may be within
+         * margin of the segment from start to end. Some further away may be
+         * visited too, so callers still need an exact test.
+         */
+        template<typename Visit>
+        void for_each_ship_near_segment(const Location& start, const Location& end, const double margin,
+                                        Visit visit) const {
+            if (entries.empty()) {
+                return;
+            }
+
+            const double dx = end.pos_x - start.pos_x;
+            const double dy = end.pos_y - start.pos_y;
+            const int first_row = row_of(std::min(start.pos_y, end.pos_y) - margin);
+            const int last_row = row_of(std::max(start.pos_y, end.pos_y) + margin);
+
+            for (int row = first_row; row <= last_row; ++row) {
+                // The part of the segment that can be within margin of this
+                // row's cells, and so the columns it spans. The edge rows
+                // also hold the ships off the map, so go on forever.
+                const double band_bottom = row == 0 ? -HUGE_VAL : row * CELL_SIZE - margin;
+                const double band_top = row == rows - 1 ? HUGE_VAL : (row + 1) * CELL_SIZE + margin;
+                double t_from = 0.0;
+                double t_to = 1.0;
+                if (dy != 0.0) {
+                    const double t_bottom = (band_bottom - start.pos_y) / dy;
+                    const double t_top = (band_top - start.pos_y) / dy;
+                    t_from = std::max(t_from, std::min(t_bottom, t_top));
+                    t_to = std::min(t_to, std::max(t_bottom, t_top));
+                    if (t_from > t_to) {
+                        continue;
+                    }
+                }
+                const double x_from = start.pos_x + dx * t_from;
+                const double x_to = start.pos_x + dx * t_to;
+                const int first_column = column_of(std::min(x_from, x_to) - margin);
+                const int last_column = column_of(std::max(x_from, x_to) + margin);
+
+                const unsigned int* const cells = cell_starts.data() + row * columns;
+                for (unsigned int i = cells[first_column]; i < cells[last_column + 1]; ++i) {
+                    visit(entries[i]);
+                }
+            }
+        }
+
+    private:
+        int columns = 0;
+        int rows = 0;
+        /// The ships in cell c are entries[cell_starts[c]] up to
+        /// entries[cell_starts[c + 1]]; cells are in rows.
+        std::vector<unsigned int> cell_starts;
+        std::vector<ShipRef> entries;
+        std::vector<double> entry_x;
+        std::vector<double> entry_y;
+        std::vector<double> entry_owner;
+        /// Scratch space for build.
+        std::vector<int> ship_cells;
+        std::vector<unsigned int> fill_positions;
+
+        /// The cell a coordinate is in, with anything off the map in the
+        /// nearest one.
+        int column_of(const double x) const {
+            return clamp(static_cast<int>(std::floor(x / CELL_SIZE)), columns);
+        }
+
+        int row_of(const double y) const {
+            return clamp(static_cast<int>(std::floor(y / CELL_SIZE)), rows);
+        }
+
+        static int clamp(const int cell, const int count) {
+            return cell < 0 ? 0 : (cell >= count ? count - 1 : cell);
+        }
+    };
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <chrono>
+
+namespace hlt {
+    /// How long we have left to reply to the game; see in::turn_clock.
+    struct TurnClock {
+        typedef std::chrono::steady_clock Clock;
+
+        /// When the game started waiting for our reply.
+        Clock::time_point start;
+        /// When it stops waiting, and we're out of the game.
+        Clock::time_point deadline;
+
+        Clock::duration elapsed() const {
+            return Clock::now() - start;
+        }
+
+        Clock::duration remaining() const {
+            return deadline - Clock::now();
+        }
+
+        /// Whether we're within margin of the deadline, or past it.
+        bool expired(const Clock::duration margin = Clock::duration::zero()) const {
+            return Clock::now() + margin >= deadline;
+        }
+    };
+}
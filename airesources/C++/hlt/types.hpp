@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace hlt {
     /// Uniquely identifies each player.
@@ -18,6 +23,74 @@ namespace hlt {
     template<typename T>
     using entity_map = std::unordered_map<EntityId, T>;
 
+    /**
+     * How entities store their fields. Define HLT_COMPACT_ENTITIES (e.g.
+     * -DHLT_COMPACT_ENTITIES, or the CMake option) to store them in about
+     * half the memory, for bots that copy maps to search ahead: locations
+     * and radii as float, which keeps the game's positions to within a
+     * ten-thousandth of a unit or so, and health, counters and owners in the
+     * narrowest types that hold them. Entities' methods still compute in
+     * double.
+     */
+#ifdef HLT_COMPACT_ENTITIES
+    typedef float Coordinate;
+    typedef int16_t StoredPlayerId;
+    typedef uint16_t StoredHealth;
+    typedef uint8_t StoredCounter;
+#else
+    typedef double Coordinate;
+    typedef PlayerId StoredPlayerId;
+    typedef int StoredHealth;
+    typedef int StoredCounter;
+#endif
+
+    /**
+     * Where each entity is in a vector, looked up by its EntityId. The game
+     * hands out IDs in order from 0, so this is a table indexed by ID rather
+     * than a hash map, and clearing it keeps its memory.
+     */
+    class EntityTable {
+    public:
+        /// The index of the entity with the given ID. Throws
+        /// std::out_of_range if there isn't one.
+        unsigned int at(const EntityId entity_id) const {
+            if (count(entity_id) == 0) {
+                throw std::out_of_range("no entity with ID " + std::to_string(entity_id));
+            }
+            return slots[entity_id] - 1;
+        }
+
+        /// 1 if there's an entity with the given ID, else 0.
+        size_t count(const EntityId entity_id) const {
+            return entity_id < slots.size() && slots[entity_id] != 0 ? 1 : 0;
+        }
+
+        /// The number of entities.
+        size_t size() const {
+            return entries;
+        }
+
+        void set(const EntityId entity_id, const unsigned int index) {
+            if (entity_id >= slots.size()) {
+                slots.resize(entity_id + 1);
+            }
+            if (slots[entity_id] == 0) {
+                ++entries;
+            }
+            slots[entity_id] = index + 1;
+        }
+
+        void clear() {
+            std::fill(slots.begin(), slots.end(), 0);
+            entries = 0;
+        }
+
+    private:
+        /// One more than each entity's index, so 0 is none.
+        std::vector<unsigned int> slots;
+        size_t entries = 0;
+    };
+
     /// A poor man's std::optional.
     template<typename T>
     using possibly = std::pair<T, bool>;
@@ -38,7 +38,14 @@ mkdir obj 2> nul
 
 cl.exe /FeMyBot.exe /std:c++14 /O2 /MT /EHsc /I . /Fo.\obj\ ^
  /D_USE_MATH_DEFINES ^
+ .\hlt\arena.cpp ^
+ .\hlt\bench.cpp ^
+ .\hlt\frame_compression.cpp ^
  .\hlt\hlt_in.cpp ^
+ .\hlt\local_game.cpp ^
  .\hlt\location.cpp ^
+ .\hlt\log.cpp ^
  .\hlt\map.cpp ^
+ .\hlt\parallel.cpp ^
+ .\hlt\shared_memory.cpp ^
  .\MyBot.cpp ^
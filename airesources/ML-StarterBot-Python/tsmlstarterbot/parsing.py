@@ -117,6 +117,45 @@ def serialize_data(data, dump_features_location):
     training_data_to_store.to_hdf(dump_features_location, "training_data")
 
 
+def expand_delta_frames(data):
+    """
+    Turn the delta frames of a replay (version 32 and up, when it has a keyframe_interval) back into full frames,
+    in place. Each delta frame only holds the ships and planets that changed since the frame before, and the IDs of
+    those destroyed.
+    :param data: json of a game
+    :return: the full frames
+    """
+    if not data.get("keyframe_interval"):
+        return data["frames"]
+
+    frames = []
+    for frame in data["frames"]:
+        if frame.get("keyframe"):
+            frames.append(frame)
+            continue
+
+        previous = frames[-1]
+        ships = {}
+        for player, player_ships in (previous["ships"] or {}).items():
+            ships[player] = dict(player_ships)
+            ships[player].update(frame["ships"].get(player, {}))
+            for ship_id in frame["destroyed_ships"].get(player, []):
+                ships[player].pop(str(ship_id), None)
+
+        planets = dict(previous["planets"] or {})
+        planets.update(frame["planets"])
+        for planet_id in frame["destroyed_planets"]:
+            planets.pop(str(planet_id), None)
+
+        expanded = {"ships": ships, "planets": planets}
+        if "events" in frame:
+            expanded["events"] = frame["events"]
+        frames.append(expanded)
+
+    data["frames"] = frames
+    return frames
+
+
 def parse(all_games_json_data, bot_to_imitate=None, dump_features_location=None):
     """
     Parse the games to compute features. This method computes PER_PLANET_FEATURES features for each planet in each frame
@@ -148,7 +187,7 @@ def parse(all_games_json_data, bot_to_imitate=None, dump_features_location=None)
 
     for json_data in all_games_json_data:
 
-        frames = json_data['frames']
+        frames = expand_delta_frames(json_data)
         moves = json_data['moves']
         width = json_data['width']
         height = json_data['height']
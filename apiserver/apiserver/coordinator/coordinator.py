@@ -359,6 +359,7 @@ def decode_replay(replay_file_obj):
     try:
         decoded_data = decoder.decompress(replay_data)
         json_data = json.loads(decoded_data.decode('utf-8').strip())
+        expand_delta_frames(json_data)
         return json_data
     except zstd.ZstdError:
         # The replay file can't be decoded.
@@ -368,6 +369,47 @@ def decode_replay(replay_file_obj):
         replay_file_obj.seek(0)
 
 
+def expand_delta_frames(replay):
+    """
+    Turn the delta frames of a replay (version 32 and up, when it has a
+    keyframe_interval) back into full frames, in place. Each delta frame
+    only holds the ships and planets that changed since the frame before,
+    and the IDs of those destroyed.
+
+    :param replay: Decoded replay data
+    :return: The full frames
+    """
+    if not replay.get("keyframe_interval"):
+        return replay["frames"]
+
+    frames = []
+    for frame in replay["frames"]:
+        if frame.get("keyframe"):
+            frames.append(frame)
+            continue
+
+        previous = frames[-1]
+        ships = {}
+        for player, player_ships in (previous["ships"] or {}).items():
+            ships[player] = dict(player_ships)
+            ships[player].update(frame["ships"].get(player, {}))
+            for ship_id in frame["destroyed_ships"].get(player, []):
+                ships[player].pop(str(ship_id), None)
+
+        planets = dict(previous["planets"] or {})
+        planets.update(frame["planets"])
+        for planet_id in frame["destroyed_planets"]:
+            planets.pop(str(planet_id), None)
+
+        expanded = {"ships": ships, "planets": planets}
+        if "events" in frame:
+            expanded["events"] = frame["events"]
+        frames.append(expanded)
+
+    replay["frames"] = frames
+    return frames
+
+
 def parse_replay(replay):
     """
     Read replay (turn by turn) and compute stats for a match.
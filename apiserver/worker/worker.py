@@ -171,11 +171,12 @@ def executeCompileTask(user_id, bot_id, backend):
 def runGame(width, height, users):
     with tempfile.TemporaryDirectory(dir=TEMP_DIR) as temp_dir:
         shutil.copy(ENVIRONMENT, os.path.join(temp_dir, ENVIRONMENT))
+        results_file = os.path.join(temp_dir, "results.json")
 
         command = [
             "./" + ENVIRONMENT,
             "-d", "{} {}".format(width, height),
-            "-q", "-o",
+            "-o", "--results-file", results_file,
         ]
 
         # Make sure bots have access to the temp dir as a whole
@@ -220,11 +221,13 @@ def runGame(width, height, users):
 
         logging.debug("Run game command %s\n" % command)
         logging.debug("Waiting for game output...\n")
-        lines = subprocess.Popen(
-            command,
-            stdout=subprocess.PIPE).stdout.read().decode('utf-8').split('\n')
+        # The engine prints nothing with --results-file; what it reports
+        # goes in the file
+        subprocess.call(command, stdout=subprocess.DEVNULL)
+        with open(results_file) as results:
+            output = results.read()
         logging.debug("\n-----Here is game output: -----")
-        logging.debug("\n".join(lines))
+        logging.debug(output)
         logging.debug("--------------------------------\n")
         # tempdir will automatically be cleaned up, but we need to do things
         # manually because the bot might have made files it owns
@@ -236,7 +239,7 @@ def runGame(width, height, users):
             # let's do it ourselves
             util.kill_processes_as(bot_user)
 
-        return lines
+        return output
 
 
 def parseGameOutput(output, users):
@@ -265,7 +268,7 @@ def executeGameTask(width, height, users, challenge, backend):
     logging.debug("Running game with width %d, height %d\n" % (width, height))
     logging.debug("Users objects %s\n" % (str(users)))
 
-    raw_output = '\n'.join(runGame(width, height, users))
+    raw_output = runGame(width, height, users)
     users, parsed_output = parseGameOutput(raw_output, users)
 
     backend.gameResult(users, parsed_output, challenge)
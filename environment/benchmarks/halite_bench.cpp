@@ -0,0 +1,332 @@
+/**
+ * Microbenchmarks for the engine's hot paths, on synthetic maps: the
+ * collision grid, event detection, whole turns of dense battles, frame
+ * serialization, move parsing, replay output and map generation.
+ *
+ * Most benchmarks take a ship count (per player) and a map size (the
+ * height; the width is 3:2 like generated maps), e.g.
+ *
+ *     halite_bench --benchmark_filter='Step/1000/'
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include "core/Halite.hpp"
+#include "core/SimulationEvent.hpp"
+#include "core/mapgen/MapCache.hpp"
+#include "core/util/distributions.hpp"
+
+namespace {
+    constexpr unsigned short NUM_PLAYERS = 4;
+    constexpr unsigned int SEED = 42;
+    //! The tournament rules, which every benchmark plays by.
+    const hlt::GameConstants constants{};
+
+    auto map_width(unsigned short height) -> unsigned short {
+        return static_cast<unsigned short>(height * 3 / 2);
+    }
+
+    /**
+     * A generated map with ships_per_player more ships for every player,
+     * scattered over the central third of the map (away from planets), so
+     * that they are close enough to fight.
+     */
+    auto battle_map(int ships_per_player, unsigned short height) -> hlt::Map {
+        const auto width = map_width(height);
+        auto map = mapgen::generate_map(mapgen::MapKey::current(
+            mapgen::DEFAULT_GENERATOR, SEED, width, height,
+            NUM_PLAYERS, NUM_PLAYERS, constants), constants).map;
+
+        util::xoshiro256starstar engine(SEED);
+        util::uniform_real_distribution<double> x_dist(width / 3.0, 2 * width / 3.0);
+        util::uniform_real_distribution<double> y_dist(height / 3.0, 2 * height / 3.0);
+        for (hlt::PlayerId player = 0; player < NUM_PLAYERS; player++) {
+            for (int placed = 0; placed < ships_per_player;) {
+                const auto location = hlt::Location{ x_dist(engine), y_dist(engine) };
+                if (map.any_planet_collision(location, 1)) continue;
+                map.spawn_ship(location, player, constants);
+                placed++;
+            }
+        }
+        return map;
+    }
+
+    //! Moves thrusting every ship at random.
+    auto random_moves(const hlt::Map& map) -> hlt::MoveQueue {
+        util::xoshiro256starstar engine(SEED);
+        util::uniform_int_distribution<unsigned short> thrust_dist(
+            0, static_cast<unsigned short>(constants.MAX_ACCELERATION));
+        util::uniform_int_distribution<unsigned short> angle_dist(0, 359);
+
+        hlt::MoveQueue moves(NUM_PLAYERS);
+        for (hlt::PlayerId player = 0; player < NUM_PLAYERS; player++) {
+            moves[player].reset(map.ship_index_limit());
+            for (const auto& ship_pair : map.ships[player]) {
+                hlt::Move move = {};
+                move.type = hlt::MoveType::Thrust;
+                move.shipId = ship_pair.first;
+                move.move.thrust.thrust = thrust_dist(engine);
+                move.move.thrust.angle = angle_dist(engine);
+                moves[player].push(move);
+            }
+        }
+        return moves;
+    }
+
+    auto ship_radius(const hlt::Ship& ship) -> double {
+        return ship.radius;
+    }
+
+    auto ship_count(const hlt::Map& map) -> int64_t {
+        int64_t count = 0;
+        for (const auto& player_ships : map.ships) count += player_ships.size();
+        return count;
+    }
+
+    //! A Networking with NUM_PLAYERS players that have no processes, for
+    //! (de)serializing frames without bots.
+    auto botless_networking() -> Networking {
+        Networking networking;
+        Networking::BotProcess bot = {};
+#ifdef _WIN32
+        bot.process = NULL;
+#else
+        bot.connection = { -1, -1, -1, -1 };
+        bot.process = -1;
+#endif
+        for (hlt::PlayerId player = 0; player < NUM_PLAYERS; player++) {
+            networking.adopt_bot(bot);
+        }
+        return networking;
+    }
+
+    auto ship_args(benchmark::internal::Benchmark* bench) -> void {
+        for (const int ships : { 10, 100, 1000 }) {
+            for (const int height : { 160, 256 }) {
+                bench->Args({ ships, height });
+            }
+        }
+    }
+}
+
+static void CollisionMapRebuild(benchmark::State& state) {
+    const auto map = battle_map(state.range(0), state.range(1));
+    const auto max_radius = constants.WEAPON_RADIUS;
+    CollisionMap collision_map;
+    for (auto _ : state) {
+        collision_map.rebuild(map, ship_radius, max_radius);
+        benchmark::DoNotOptimize(collision_map.cells.data());
+    }
+    state.SetItemsProcessed(state.iterations() * ship_count(map));
+}
+BENCHMARK(CollisionMapRebuild)->Apply(ship_args);
+
+//! Updating the grid as every ship moves back and forth by one unit, as
+//! ships do from one turn to the next.
+static void CollisionMapUpdate(benchmark::State& state) {
+    auto map = battle_map(state.range(0), state.range(1));
+    const auto max_radius = constants.WEAPON_RADIUS;
+    CollisionMap collision_map(map, ship_radius, max_radius);
+    double step = 1;
+    for (auto _ : state) {
+        for (auto& player_ships : map.ships) {
+            for (auto& ship_pair : player_ships) {
+                ship_pair.second.location.pos_x += step;
+            }
+        }
+        step = -step;
+        collision_map.update(map, ship_radius, max_radius);
+        benchmark::DoNotOptimize(collision_map.cells.data());
+    }
+    state.SetItemsProcessed(state.iterations() * ship_count(map));
+}
+BENCHMARK(CollisionMapUpdate)->Apply(ship_args);
+
+static void CollisionMapQuery(benchmark::State& state) {
+    const auto map = battle_map(state.range(0), state.range(1));
+    const auto max_radius = constants.WEAPON_RADIUS;
+    const CollisionMap collision_map(map, ship_radius, max_radius);
+    CollisionMap::QueryScratch scratch;
+    std::vector<hlt::EntityId> found;
+    for (auto _ : state) {
+        for (const auto& player_ships : map.ships) {
+            for (const auto& ship_pair : player_ships) {
+                found.clear();
+                collision_map.query_into(ship_pair.second.location, max_radius, found, scratch);
+                benchmark::DoNotOptimize(found.data());
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * ship_count(map));
+}
+BENCHMARK(CollisionMapQuery)->Apply(ship_args);
+
+//! Pairs of moving ships, some colliding and some not.
+static auto ship_pairs(size_t count) -> std::vector<std::pair<hlt::Ship, hlt::Ship>> {
+    util::xoshiro256starstar engine(SEED);
+    util::uniform_real_distribution<double> offset(-10, 10);
+    util::uniform_real_distribution<double> velocity(-7, 7);
+    std::vector<std::pair<hlt::Ship, hlt::Ship>> pairs;
+    for (size_t i = 0; i < count; i++) {
+        hlt::Ship ship1 = {}, ship2 = {};
+        ship1.revive({ 100, 100 }, constants);
+        ship2.revive({ 100 + offset(engine), 100 + offset(engine) }, constants);
+        ship1.velocity = { velocity(engine), velocity(engine) };
+        ship2.velocity = { velocity(engine), velocity(engine) };
+        pairs.push_back({ ship1, ship2 });
+    }
+    return pairs;
+}
+
+static void CollisionTime(benchmark::State& state) {
+    const auto pairs = ship_pairs(1024);
+    const hlt::Scalar radius = 2 * constants.SHIP_RADIUS;
+    for (auto _ : state) {
+        for (const auto& pair : pairs) {
+            benchmark::DoNotOptimize(collision_time(radius, pair.first, pair.second));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+BENCHMARK(CollisionTime);
+
+static void FindEvents(benchmark::State& state) {
+    const auto pairs = ship_pairs(1024);
+    std::vector<SimulationEvent> events;
+    const auto id1 = hlt::EntityId::for_ship(0, 0);
+    const auto id2 = hlt::EntityId::for_ship(1, 1);
+    for (auto _ : state) {
+        events.clear();
+        for (const auto& pair : pairs) {
+            find_events(events, id1, id2, pair.first, pair.second, hlt::TournamentConstants{});
+        }
+        benchmark::DoNotOptimize(events.data());
+    }
+    state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+BENCHMARK(FindEvents);
+
+//! A whole turn of an in-process game with every ship thrusting at
+//! random, from the same state every time.
+static void Step(benchmark::State& state) {
+    const auto height = static_cast<unsigned short>(state.range(1));
+    Halite game(map_width(height), height, SEED, NUM_PLAYERS);
+    game.reset(battle_map(state.range(0), height), 0);
+    const auto moves = random_moves(game.get_map());
+    Halite::Snapshot start;
+    game.save(start);
+    for (auto _ : state) {
+        game.restore(start);
+        benchmark::DoNotOptimize(game.step(moves).size());
+    }
+    state.SetItemsProcessed(state.iterations() * ship_count(game.get_map()));
+}
+BENCHMARK(Step)->Apply(ship_args)->Unit(benchmark::kMicrosecond);
+
+static void SerializeMap(benchmark::State& state) {
+    const auto map = battle_map(state.range(0), state.range(1));
+    auto networking = botless_networking();
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        networking.serialize_map(map, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * out.size());
+}
+BENCHMARK(SerializeMap)->Apply(ship_args);
+
+static void DeserializeMoveSet(benchmark::State& state) {
+    const auto map = battle_map(state.range(0), state.range(1));
+    std::string line;
+    for (const auto& ship_pair : map.ships[0]) {
+        line += "t " + std::to_string(ship_pair.first) + " 7 " +
+            std::to_string(ship_pair.first % 360) + ' ';
+    }
+    auto networking = botless_networking();
+    hlt::PlayerMoveQueue moves;
+    for (auto _ : state) {
+        moves.reset(map.ship_index_limit());
+        networking.deserialize_move_set(0, line, map, moves);
+    }
+    state.SetBytesProcessed(state.iterations() * line.size());
+}
+BENCHMARK(DeserializeMoveSet)->Apply(ship_args);
+
+//! Writing the replay of a game of the given number of turns.
+static void ReplayOutput(benchmark::State& state) {
+    const auto turns = state.range(0);
+    const auto binary = state.range(1) != 0;
+    const unsigned short height = 160;
+    Halite game(map_width(height), height, SEED, NUM_PLAYERS);
+    game.reset(battle_map(50, height), 0);
+
+    hlt::FrameHistory frames;
+    EventLog events;
+    hlt::MoveHistory moves;
+    frames.record(game.get_map());
+    events.start_frame();
+    for (int turn = 0; turn < turns; turn++) {
+        const auto turn_moves = random_moves(game.get_map());
+        game.step(turn_moves);
+        frames.record(game.get_map());
+        events.start_frame();
+        moves.start_turn();
+        for (hlt::PlayerId player = 0; player < NUM_PLAYERS; player++) {
+            for (const auto& ship_pair : game.get_map().ships[player]) {
+                const auto move = turn_moves[player].find(ship_pair.first, 0);
+                if (move) moves.add(player, 0, *move);
+            }
+        }
+    }
+
+    GameStatistics stats;
+    stats.player_statistics.resize(NUM_PLAYERS);
+    std::vector<std::string> names(NUM_PLAYERS, "bench");
+    std::vector<mapgen::PointOfInterest> points_of_interest;
+    ReplayOptions options;
+    options.format = binary ? ReplayFormat::Binary : ReplayFormat::Json;
+    options.compression_level = 3;
+    const std::string path = "halite_bench_replay.hlt";
+    for (auto _ : state) {
+        Replay replay{
+            stats, NUM_PLAYERS, names, SEED, mapgen::DEFAULT_GENERATOR,
+            points_of_interest, map_width(height), height, constants,
+            frames, events, moves, options,
+        };
+        std::ofstream file(path, std::ios_base::binary);
+        replay.output(file);
+    }
+    std::remove(path.c_str());
+    state.SetItemsProcessed(state.iterations() * turns);
+}
+BENCHMARK(ReplayOutput)
+    ->Args({ 100, 0 })->Args({ 100, 1 })->Args({ 300, 0 })->Args({ 300, 1 })
+    ->Unit(benchmark::kMillisecond);
+
+//! Every registered generator, at a few map sizes.
+static void Generate(benchmark::State& state, const std::string& generator) {
+    const auto height = static_cast<unsigned short>(state.range(0));
+    const auto width = map_width(height);
+    unsigned int seed = 0;
+    for (auto _ : state) {
+        hlt::Map map(width, height, NUM_PLAYERS);
+        mapgen::make_generator(generator, ++seed)->generate(map, NUM_PLAYERS, NUM_PLAYERS, constants);
+        benchmark::DoNotOptimize(map.planets.data());
+    }
+}
+
+int main(int argc, char** argv) {
+    for (const auto& generator : mapgen::generator_names()) {
+        benchmark::RegisterBenchmark(("Generate/" + generator).c_str(), Generate, generator)
+            ->Arg(160)->Arg(256)->Unit(benchmark::kMicrosecond);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
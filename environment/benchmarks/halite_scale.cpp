@@ -0,0 +1,379 @@
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "version.hpp"
+#include "core/Halite.hpp"
+#include "core/json.hpp"
+#include "core/mapgen/MapCache.hpp"
+#include "core/util/distributions.hpp"
+
+#include <tclap/CmdLine.h>
+
+/**
+ * Plays in-process games with many more ships than real games have, moved
+ * by simple built-in policies instead of bots, to find where the engine
+ * stops keeping up. For every policy, ship count and map size, it reports
+ * the turns played per second, the peak resident size, and the largest
+ * frame sent to bots and written to replays.
+ *
+ *     halite-scale --ships 100 --ships 1000 --ships 5000 --policy swarm
+ */
+
+namespace {
+    enum class Policy {
+        //! Every ship thrusts in a random direction at a random speed.
+        Random,
+        //! Every ship heads for the center of the map at full speed, so
+        //! that they pile up and fight.
+        Swarm,
+        //! Every ship heads for the nearest planet it could dock to, and
+        //! docks once it is close enough.
+        Dock,
+    };
+
+    const std::vector<std::string> POLICY_NAMES = { "random", "swarm", "dock" };
+
+    auto policy_by_name(const std::string& name) -> Policy {
+        return name == "swarm" ? Policy::Swarm : name == "dock" ? Policy::Dock : Policy::Random;
+    }
+
+    //! The thrust angle toward a target, in the whole degrees moves take.
+    auto degrees_to(const hlt::Location& from, const hlt::Location& to) -> unsigned short {
+        const auto degrees = static_cast<int>(std::round(from.angle_to(to) * 180 / M_PI));
+        return static_cast<unsigned short>((degrees % 360 + 360) % 360);
+    }
+
+    auto thrust_move(hlt::EntityIndex ship, unsigned short thrust,
+                     unsigned short angle) -> hlt::Move {
+        hlt::Move move = {};
+        move.type = hlt::MoveType::Thrust;
+        move.shipId = ship;
+        move.move.thrust.thrust = thrust;
+        move.move.thrust.angle = angle;
+        return move;
+    }
+
+    //! The nearest living planet the player could dock to, or nullptr.
+    auto nearest_open_planet(const hlt::Map& map, hlt::PlayerId player,
+                             const hlt::Ship& ship) -> const hlt::Planet* {
+        const hlt::Planet* nearest = nullptr;
+        auto nearest_distance = std::numeric_limits<double>::infinity();
+        for (const auto& planet : map.planets) {
+            if (!planet.is_alive() || (planet.owned && planet.owner != player) ||
+                planet.docked_ships.size() >= planet.docking_spots) {
+                continue;
+            }
+            const auto distance = static_cast<double>(ship.location.distance(planet.location));
+            if (distance < nearest_distance) {
+                nearest = &planet;
+                nearest_distance = distance;
+            }
+        }
+        return nearest;
+    }
+
+    auto policy_moves(Policy policy, const hlt::Map& map, unsigned short num_players,
+                      const hlt::GameConstants& constants,
+                      util::xoshiro256starstar& engine, hlt::MoveQueue& moves) -> void {
+        const auto max_thrust = static_cast<unsigned short>(constants.MAX_ACCELERATION);
+        util::uniform_int_distribution<unsigned short> thrust_dist(0, max_thrust);
+        util::uniform_int_distribution<unsigned short> angle_dist(0, 359);
+        const hlt::Location center = { map.map_width / 2.0, map.map_height / 2.0 };
+
+        for (hlt::PlayerId player = 0; player < num_players; player++) {
+            moves[player].reset(map.ship_index_limit());
+            for (const auto& ship_pair : map.ships[player]) {
+                const auto id = ship_pair.first;
+                const auto& ship = ship_pair.second;
+                switch (policy) {
+                    case Policy::Random:
+                        moves[player].push(thrust_move(id, thrust_dist(engine), angle_dist(engine)));
+                        break;
+                    case Policy::Swarm:
+                        moves[player].push(thrust_move(id, max_thrust, degrees_to(ship.location, center)));
+                        break;
+                    case Policy::Dock: {
+                        if (ship.docking_status != hlt::DockingStatus::Undocked) break;
+                        const auto planet = nearest_open_planet(map, player, ship);
+                        if (planet == nullptr) break;
+                        if (ship.can_dock(*planet, constants)) {
+                            hlt::Move move = {};
+                            move.type = hlt::MoveType::Dock;
+                            move.shipId = id;
+                            move.move.dock_to = static_cast<hlt::EntityIndex>(planet - map.planets.data());
+                            moves[player].push(move);
+                            break;
+                        }
+                        // Stop short of the surface, in reach of docking
+                        const auto gap = static_cast<double>(ship.location.distance(planet->location)) -
+                            planet->radius - constants.DOCK_RADIUS / 2;
+                        const auto thrust = static_cast<unsigned short>(
+                            std::max(0.0, std::min<double>(max_thrust, std::floor(gap))));
+                        moves[player].push(thrust_move(id, thrust, degrees_to(ship.location, planet->location)));
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * A generated map with ships_per_player ships for every player
+     * (including the map's own), scattered over the whole map away from
+     * planets.
+     */
+    auto crowded_map(unsigned int ships_per_player, unsigned short width, unsigned short height,
+                     unsigned short num_players, unsigned int seed,
+                     const hlt::GameConstants& constants) -> mapgen::GeneratedMap {
+        auto map = mapgen::generate_map(mapgen::MapKey::current(
+            mapgen::DEFAULT_GENERATOR, seed, width, height,
+            num_players, num_players, constants), constants);
+
+        util::xoshiro256starstar engine(seed);
+        util::uniform_real_distribution<double> x_dist(1, width - 1);
+        util::uniform_real_distribution<double> y_dist(1, height - 1);
+        for (hlt::PlayerId player = 0; player < num_players; player++) {
+            while (map.map.ships[player].size() < ships_per_player) {
+                const auto location = hlt::Location{ x_dist(engine), y_dist(engine) };
+                if (map.map.any_planet_collision(location, 1)) continue;
+                map.map.spawn_ship(location, player, constants);
+            }
+        }
+        return map;
+    }
+
+    //! A Networking for the given number of players without processes,
+    //! for serializing frames as bots would get them.
+    auto botless_networking(unsigned short num_players) -> Networking {
+        Networking networking;
+        Networking::BotProcess bot = {};
+#ifdef _WIN32
+        bot.process = NULL;
+#else
+        bot.connection = { -1, -1, -1, -1 };
+        bot.process = -1;
+#endif
+        for (hlt::PlayerId player = 0; player < num_players; player++) {
+            networking.adopt_bot(bot);
+        }
+        return networking;
+    }
+
+    //! The size of a frame as a JSON replay writes it (without events).
+    auto replay_frame_size(const hlt::FrameHistory::Frame& frame, unsigned short num_players,
+                           std::string& out) -> size_t {
+        out.clear();
+        JsonWriter json(out);
+        json.begin_object();
+        json.key("planets").begin_object();
+        for (const auto& planet : frame.living_planets()) {
+            json.key(planet.id);
+            planet.write_json(json);
+        }
+        json.end_object();
+        json.key("ships").begin_object();
+        for (hlt::PlayerId player = 0; player < num_players; player++) {
+            json.key(player).begin_object();
+            for (const auto& ship : frame.player_ships(player)) {
+                json.key(ship.id);
+                ship.write_json(json);
+            }
+            json.end_object();
+        }
+        json.end_object();
+        json.end_object();
+        return out.size();
+    }
+
+    /**
+     * Forget the peak resident size so far, so that the next run reports
+     * its own. Only Linux can; elsewhere the peak carries over from
+     * earlier runs.
+     */
+    auto reset_peak_memory() -> void {
+#ifdef __linux__
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+#endif
+    }
+
+    //! The peak resident size in KiB, or 0 if unknown.
+    auto peak_memory_kb() -> long {
+#ifdef __linux__
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                return std::stol(line.substr(6));
+            }
+        }
+#endif
+#ifndef _WIN32
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+            return usage.ru_maxrss / 1024;
+#else
+            return usage.ru_maxrss;
+#endif
+        }
+#endif
+        return 0;
+    }
+
+    struct RunResult {
+        unsigned int turns = 0;
+        //! Time spent in Halite::step.
+        double seconds = 0;
+        long peak_memory_kb = 0;
+        size_t max_bot_frame = 0;
+        size_t max_replay_frame = 0;
+        size_t ships_left = 0;
+    };
+
+    auto run(Policy policy, unsigned int ships_per_player, unsigned short height,
+             unsigned short num_players, unsigned int turns, unsigned int seed,
+             const hlt::GameConstants& constants) -> RunResult {
+        reset_peak_memory();
+        const auto width = static_cast<unsigned short>(height * 3 / 2);
+        GameOptions options;
+        options.constants = constants;
+        Halite game(crowded_map(ships_per_player, width, height, num_players, seed, constants),
+                    options);
+
+        auto networking = botless_networking(num_players);
+        hlt::FrameHistory history;
+        history.keep_latest_only();
+        std::string bot_frame;
+        std::string replay_frame;
+        util::xoshiro256starstar engine(seed);
+        hlt::MoveQueue moves(num_players);
+
+        RunResult result;
+        for (; result.turns < turns && !game.is_over(); result.turns++) {
+            networking.serialize_map(game.get_map(), bot_frame);
+            result.max_bot_frame = std::max(result.max_bot_frame, bot_frame.size());
+            history.record(game.get_map());
+            result.max_replay_frame = std::max(
+                result.max_replay_frame, replay_frame_size(history.back(), num_players, replay_frame));
+
+            policy_moves(policy, game.get_map(), num_players, constants, engine, moves);
+            const auto begin = std::chrono::steady_clock::now();
+            game.step(moves);
+            result.seconds += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin).count();
+        }
+        for (const auto& player_ships : game.get_map().ships) {
+            result.ships_left += player_ships.size();
+        }
+        result.peak_memory_kb = peak_memory_kb();
+        return result;
+    }
+}
+
+int main(int argc, char** argv) {
+    TCLAP::CmdLine cmd("Halite Scalability Test", ' ', HALITE_VERSION);
+
+    auto policy_names = POLICY_NAMES;
+    TCLAP::ValuesConstraint<std::string> policyConstraint(policy_names);
+    TCLAP::MultiArg<std::string> policyArg(
+        "p", "policy", "How the ships are moved: random thrust, swarm to the center, or dock to the nearest planet (may be repeated; default: all).",
+        false, &policyConstraint, cmd);
+    TCLAP::MultiArg<unsigned int> shipsArg(
+        "", "ships", "Ships per player at the start (may be repeated; default: 100, 1000 and 5000).",
+        false, "positive integer", cmd);
+    TCLAP::MultiArg<unsigned int> heightArg(
+        "", "height", "Map height; the width is 3:2 like generated maps (may be repeated; default: 160 and 256).",
+        false, "positive integer", cmd);
+    TCLAP::ValueArg<unsigned int> nPlayersArg(
+        "n", "nplayers", "The number of players.",
+        false, 4, "{2,4}", cmd);
+    TCLAP::ValueArg<unsigned int> turnsArg(
+        "t", "turns", "The most turns to play in each game.",
+        false, 100, "positive integer", cmd);
+    TCLAP::ValueArg<unsigned int> seedArg(
+        "s", "seed", "The seed of the maps and of the random policy.",
+        false, 42, "positive integer", cmd);
+    TCLAP::ValueArg<std::string> constantsArg(
+        "", "constantsfile", "JSON file containing runtime constants to use.",
+        false, "", "path to file", cmd);
+    TCLAP::SwitchArg jsonSwitch(
+        "", "json", "Print the results as JSON, one object per game, instead of a table.",
+        cmd, false);
+
+    cmd.parse(argc, argv);
+
+    const auto num_players = static_cast<unsigned short>(nPlayersArg.getValue());
+    if (!mapgen::supports_players(mapgen::DEFAULT_GENERATOR, num_players)) {
+        std::cerr << "The " << mapgen::DEFAULT_GENERATOR << " map generator can't make maps for "
+                  << num_players << " players.\n";
+        return 1;
+    }
+
+    hlt::GameConstants constants;
+    if (constantsArg.isSet()) {
+        std::ifstream constants_file(constantsArg.getValue());
+        nlohmann::json constants_json;
+        constants_file >> constants_json;
+        constants.from_json(constants_json);
+    }
+
+    auto policies = policyArg.getValue();
+    if (policies.empty()) policies = POLICY_NAMES;
+    auto ship_counts = shipsArg.getValue();
+    if (ship_counts.empty()) ship_counts = { 100, 1000, 5000 };
+    auto heights = heightArg.getValue();
+    if (heights.empty()) heights = { 160, 256 };
+
+    if (!jsonSwitch.getValue()) {
+        std::cout << "policy\tships/player\theight\tturns\tturns/s\tms/turn\tpeak RSS (MB)"
+                     "\tmax bot frame (KB)\tmax replay frame (KB)\tships left\n";
+    }
+    for (const auto& policy_name : policies) {
+        for (const auto ships : ship_counts) {
+            for (const auto height : heights) {
+                const auto result = run(policy_by_name(policy_name), ships,
+                                        static_cast<unsigned short>(height), num_players,
+                                        turnsArg.getValue(), seedArg.getValue(), constants);
+                const auto turns_per_second = result.seconds > 0 ? result.turns / result.seconds : 0.0;
+                if (jsonSwitch.getValue()) {
+                    std::cout << nlohmann::json{
+                        { "policy", policy_name },
+                        { "ships_per_player", ships },
+                        { "height", height },
+                        { "turns", result.turns },
+                        { "seconds", result.seconds },
+                        { "turns_per_second", turns_per_second },
+                        { "peak_memory_kb", result.peak_memory_kb },
+                        { "max_bot_frame_bytes", result.max_bot_frame },
+                        { "max_replay_frame_bytes", result.max_replay_frame },
+                        { "ships_left", result.ships_left },
+                    }.dump() << std::endl;
+                    continue;
+                }
+                std::ostringstream row;
+                row.setf(std::ios::fixed);
+                row.precision(1);
+                row << policy_name << '\t' << ships << '\t' << height << '\t' << result.turns
+                    << '\t' << turns_per_second
+                    << '\t' << (result.turns > 0 ? 1000 * result.seconds / result.turns : 0.0)
+                    << '\t' << result.peak_memory_kb / 1024.0
+                    << '\t' << result.max_bot_frame / 1024.0
+                    << '\t' << result.max_replay_frame / 1024.0
+                    << '\t' << result.ships_left;
+                std::cout << row.str() << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,387 @@
+#include "Batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "Halite.hpp"
+
+auto from_json(const nlohmann::json& json, BatchGame& game) -> void {
+    if (!json.is_object()) {
+        throw std::invalid_argument("expected a JSON object");
+    }
+    if (json.count("bots") == 0 || !json["bots"].is_array()) {
+        throw std::invalid_argument("\"bots\" must be a list of start commands");
+    }
+
+    game.seed = json.value("seed", 0U);
+    game.width = json.value("width", static_cast<unsigned short>(0));
+    game.height = json.value("height", static_cast<unsigned short>(0));
+    game.bots = json["bots"].get<std::vector<std::string>>();
+    game.names = json.value("names", std::vector<std::string>());
+    game.n_players = json.value("n_players", static_cast<unsigned short>(0));
+    game.id = json.value("id", 0U);
+    game.constants = json.value("constants", nlohmann::json::object());
+    game.remote_bots = json.value("remote_bots", 0U);
+    game.listen = json.value("listen", std::string());
+    game.token = json.value("token", std::string());
+    game.connect_timeout = json.value("connect_timeout", 60000U);
+
+    const auto players = game.bots.size() + game.remote_bots;
+    // Whether the map generator can make a map for them is only known
+    // once the game is played
+    const auto max_players = std::to_string(hlt::MAX_PLAYERS);
+    if (players != 1 && (players < 2 || players > hlt::MAX_PLAYERS)) {
+        throw std::invalid_argument("must have between 2 and " + max_players + " players, or a solo player");
+    }
+    if (players == 1) {
+        if (json.count("n_players") == 0) game.n_players = 2;
+        if (game.n_players < 2 || game.n_players > hlt::MAX_PLAYERS) {
+            throw std::invalid_argument("must have between 2 and " + max_players + " players for map creation");
+        }
+    }
+    else if (json.count("n_players") == 0) {
+        game.n_players = static_cast<unsigned short>(players);
+    }
+    else if (game.n_players != players) {
+        throw std::invalid_argument("\"n_players\" is only valid with a solo player");
+    }
+    if (!game.constants.is_object()) {
+        throw std::invalid_argument("\"constants\" must be an object");
+    }
+    if (game.remote_bots > 0 && game.listen.empty()) {
+        throw std::invalid_argument("\"remote_bots\" needs a \"listen\" address");
+    }
+    if (!game.names.empty() && game.names.size() != players) {
+        throw std::invalid_argument("\"names\" must have one entry per bot");
+    }
+    if ((game.width == 0) != (game.height == 0)) {
+        throw std::invalid_argument("specify both \"width\" and \"height\", or neither");
+    }
+}
+
+auto read_batch_manifest(std::istream& manifest, unsigned int first_id)
+    -> std::vector<BatchGame> {
+    std::vector<BatchGame> games;
+    std::string line;
+    unsigned int line_number = 0;
+    while (std::getline(manifest, line)) {
+        line_number++;
+        const auto start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+
+        BatchGame game;
+        try {
+            from_json(nlohmann::json::parse(line), game);
+        }
+        catch (const std::exception& e) {
+            std::stringstream error_msg;
+            error_msg << "Invalid game on line " << line_number
+                      << " of the batch manifest: " << e.what();
+            throw std::invalid_argument(error_msg.str());
+        }
+
+        fill_batch_defaults(game, first_id + games.size());
+        games.push_back(game);
+    }
+    return games;
+}
+
+auto fill_batch_defaults(BatchGame& game, unsigned int default_id) -> void {
+    if (game.id == 0) {
+        game.id = default_id;
+    }
+    if (game.seed == 0) {
+        game.seed = static_cast<unsigned int>(
+            (std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count()
+                + default_id) % 4294967295);
+    }
+    if (game.width == 0) {
+        const auto size = mapgen::default_map_size(game.seed);
+        game.width = size.first;
+        game.height = size.second;
+    }
+}
+
+auto BotPool::take(const std::string& command, Networking& networking) -> bool {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto& idle = idle_bots[command];
+    if (idle.empty()) {
+        return false;
+    }
+    networking.adopt_bot(idle.back());
+    idle.pop_back();
+    return true;
+}
+
+auto BotPool::give(const std::string& command, const Networking::BotProcess& bot) -> void {
+    std::lock_guard<std::mutex> guard(mutex);
+    idle_bots[command].push_back(bot);
+}
+
+auto BotPool::shut_down(bool quiet_output) -> void {
+    std::lock_guard<std::mutex> guard(mutex);
+    Networking leftover_bots;
+    leftover_bots.set_quiet(quiet_output);
+    for (const auto& command_bots : idle_bots) {
+        for (const auto& bot : command_bots.second) {
+            leftover_bots.adopt_bot(bot);
+        }
+    }
+    idle_bots.clear();
+    for (int player = 0; player < leftover_bots.player_count(); player++) {
+        leftover_bots.kill_player(player);
+    }
+    leftover_bots.finish_teardowns();
+}
+
+SharedMap::SharedMap(unsigned int uses_) : uses(uses_) {}
+
+auto SharedMap::take(const BatchGame& game, const GameOptions& game_options)
+    -> std::shared_ptr<const mapgen::GeneratedMap> {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto result = map;
+    if (!result) {
+        const auto key = mapgen::MapKey::current(
+            game_options.map_generator_name, game.seed, game.width, game.height,
+            static_cast<unsigned short>(game.bots.size() + game.remote_bots),
+            game.n_players, game_options.constants);
+        result = std::make_shared<const mapgen::GeneratedMap>(
+            game_options.map_cache_directory.empty()
+            ? mapgen::generate_map(key, game_options.constants)
+            : mapgen::MapCache(game_options.map_cache_directory).get(key, game_options.constants));
+    }
+    // The last play of the map frees it when it's done
+    uses--;
+    map = uses > 0 ? result : nullptr;
+    return result;
+}
+
+auto duplicate_count(const BatchGame& game) -> unsigned int {
+    return game.remote_bots > 0 || game.bots.size() < 2
+           ? 1 : static_cast<unsigned int>(game.bots.size());
+}
+
+auto duplicate_seats(const BatchGame& game, unsigned int rotation,
+                     unsigned int id) -> BatchGame {
+    auto rotated = game;
+    const auto seats = game.bots.size();
+    for (size_t seat = 0; seat < seats; seat++) {
+        rotated.bots[seat] = game.bots[(seat + rotation) % seats];
+        if (!game.names.empty()) {
+            rotated.names[seat] = game.names[(seat + rotation) % seats];
+        }
+    }
+    rotated.id = id;
+    return rotated;
+}
+
+auto place_batch_thread(const BatchOptions& options,
+                        const std::vector<CpuDomain>& domains,
+                        size_t thread, CpuDomain& domain) -> BatchOptions {
+    auto thread_options = options;
+    domain = CpuDomain();
+    if (options.pin_games && !domains.empty() &&
+        pin_thread(domains[thread % domains.size()].cpus)) {
+        domain = domains[thread % domains.size()];
+        thread_options.game_options.sandbox.cpu_domain = domain.cpus;
+    }
+    return thread_options;
+}
+
+auto play_batch_game(const BatchGame& game, const BatchOptions& options,
+                     BotPool& bot_pool, std::future<void>& replay,
+                     SharedMap* shared_map)
+    -> nlohmann::json {
+    nlohmann::json result;
+    try {
+        auto game_options = options.game_options;
+        if (!game.constants.empty()) {
+            game_options.constants.from_json(game.constants);
+        }
+        game_options.log_tag = "game " + std::to_string(game.id);
+        // Before launching any bots, in case the map can't be made
+        const auto map = shared_map ? shared_map->take(game, game_options) : nullptr;
+
+        Networking networking;
+        networking.set_quiet(game_options.quiet_output);
+        networking.set_log_tag(game_options.log_tag);
+        networking.set_sandbox(game_options.sandbox);
+#ifdef HALITE_SHARED_MEMORY
+        if (options.shared_memory && !networking.enable_shared_memory()) {
+            throw std::runtime_error("Could not set up shared memory.");
+        }
+#endif
+        for (const auto& bot : game.bots) {
+            if (!options.persistent_bots || !bot_pool.take(bot, networking)) {
+                networking.launch_bot(bot);
+            }
+        }
+        if (game.remote_bots > 0) {
+#ifdef _WIN32
+            throw std::runtime_error("Remote bots are not supported on Windows.");
+#else
+            const auto connected = networking.accept_remote_bots(
+                game.listen, game.token, game.remote_bots,
+                std::chrono::milliseconds(game.connect_timeout));
+            if (connected < game.remote_bots) {
+                throw std::runtime_error("Only " + std::to_string(connected) + " of " +
+                                         std::to_string(game.remote_bots) +
+                                         " remote bots connected in time.");
+            }
+#endif
+        }
+
+        auto names = game.names;
+        std::unique_ptr<Halite> halite(
+            map ? new Halite(*map, std::move(networking), game_options)
+                : new Halite(game.width, game.height, game.seed,
+                             game.n_players, std::move(networking),
+                             game_options));
+        const auto stats = halite->run_game(
+            names.empty() ? nullptr : &names, game.id,
+            options.enable_replay, options.replay_options,
+            options.replay_directory);
+        result = halite->results_json(stats);
+        replay = halite->take_replay_job();
+
+        if (options.persistent_bots) {
+            for (hlt::PlayerId player = 0; player < game.bots.size(); player++) {
+                const auto bot = halite->release_bot(player);
+                if (bot.second) {
+                    bot_pool.give(game.bots[player], bot.first);
+                }
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        result["error"] = e.what();
+    }
+    catch (...) {
+        // launch_bot signals failure by throwing an int
+        result["error"] = "One or more bot launch command strings failed.";
+    }
+    result["id"] = game.id;
+    return result;
+}
+
+auto run_batch(const std::vector<BatchGame>& games,
+               const BatchOptions& options,
+               std::ostream& output) -> unsigned int {
+    // Each game, or each rotation of each game with options.duplicate,
+    // with the map the rotations share
+    struct BatchPlay {
+        size_t index;
+        unsigned int rotation;
+    };
+    std::vector<BatchPlay> plays;
+    std::vector<std::unique_ptr<SharedMap>> shared_maps(games.size());
+    unsigned int max_id = 0;
+    for (const auto& game : games) {
+        max_id = std::max(max_id, game.id);
+    }
+    for (size_t index = 0; index < games.size(); index++) {
+        const auto count = options.duplicate ? duplicate_count(games[index]) : 1;
+        if (count > 1) {
+            shared_maps[index].reset(new SharedMap(count));
+        }
+        for (unsigned int rotation = 0; rotation < count; rotation++) {
+            plays.push_back(BatchPlay{ index, rotation });
+        }
+    }
+
+    const auto num_threads = std::max<size_t>(
+        1, std::min<size_t>(options.threads, plays.size()));
+    if (num_threads > 1) {
+        // Games run from a quick elimination to the turn limit, so starting
+        // the likeliest long ones (by map area and players) first keeps
+        // threads from idling while the last ones finish
+        auto cost = [&](const BatchPlay& play) -> size_t {
+            const auto& game = games[play.index];
+            return static_cast<size_t>(game.width) * game.height * game.n_players;
+        };
+        std::stable_sort(plays.begin(), plays.end(),
+                         [&](const BatchPlay& a, const BatchPlay& b) -> bool {
+                             return cost(a) > cost(b);
+                         });
+    }
+
+    std::atomic<size_t> next_play(0);
+    std::atomic<unsigned int> failures(0);
+    std::mutex output_mutex;
+    BotPool bot_pool;
+    const auto domains = options.pin_games ? cpu_domains() : std::vector<CpuDomain>();
+
+    auto play_games = [&](size_t thread) -> void {
+        CpuDomain domain;
+        const auto thread_options = place_batch_thread(options, domains, thread, domain);
+        // The replay of this thread's last game, left to be written in the
+        // background while the next one is played (see
+        // ReplayOptions::asynchronous). Replacing it waits for it.
+        std::future<void> last_replay;
+        while (true) {
+            const size_t play_index = next_play++;
+            if (play_index >= plays.size()) {
+                return;
+            }
+            const auto& play = plays[play_index];
+            const auto& game = games[play.index];
+
+            std::future<void> replay;
+            const auto id = play.rotation == 0
+                ? game.id
+                : static_cast<unsigned int>(max_id + (play.rotation - 1) * games.size() + play.index + 1);
+            auto result = play_batch_game(duplicate_seats(game, play.rotation, id),
+                                          thread_options, bot_pool, replay,
+                                          shared_maps[play.index].get());
+            if (result.count("error") != 0) {
+                failures++;
+            }
+            result["game"] = play.index;
+            if (options.duplicate) {
+                result["rotation"] = play.rotation;
+                auto seats = nlohmann::json::array();
+                for (size_t seat = 0; seat < game.bots.size() + game.remote_bots; seat++) {
+                    seats.push_back(play.rotation == 0
+                                    ? seat : (seat + play.rotation) % game.bots.size());
+                }
+                result["seats"] = seats;
+            }
+            if (!domain.cpus.empty()) {
+                result["cpu_domain"] = domain;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(output_mutex);
+                output << result.dump() << std::endl;
+            }
+            last_replay = std::move(replay);
+        }
+    };
+
+    // A pinned thread stays pinned, so then this one only waits
+    std::vector<std::thread> workers;
+    const size_t first_worker = options.pin_games ? 0 : 1;
+    for (size_t i = first_worker; i < num_threads; i++) {
+        workers.emplace_back(play_games, i);
+    }
+    if (first_worker == 1) {
+        play_games(0);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    bot_pool.shut_down(options.game_options.quiet_output);
+
+    return failures;
+}
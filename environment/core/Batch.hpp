@@ -0,0 +1,201 @@
+#ifndef HALITE_BATCH_HPP
+#define HALITE_BATCH_HPP
+
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "CpuTopology.hpp"
+#include "GameOptions.hpp"
+#include "mapgen/MapCache.hpp"
+#include "Replay.hpp"
+
+/**
+ * One game of a batch, as described by one line of the manifest.
+ */
+struct BatchGame {
+    //! Map seed. If 0 (or omitted), a seed is picked from the clock.
+    unsigned int seed;
+    //! Map dimensions. If 0 (or omitted), picked from the seed as for a
+    //! single game.
+    unsigned short width, height;
+    //! Start commands for the bots (1, or 2 up to hlt::MAX_PLAYERS).
+    std::vector<std::string> bots;
+    //! Names to use instead of the ones the bots send, if not empty.
+    std::vector<std::string> names;
+    //! The number of players to generate a single-player map for.
+    unsigned short n_players;
+    //! ID used for the replay and log file names.
+    unsigned int id;
+    //! Constants to change from those of the batch, if any (as in a
+    //! --constantsfile).
+    nlohmann::json constants;
+    /**
+     * The number of bots running elsewhere that join the game after the
+     * launched ones, their address and token, and how long they have to
+     * connect (see Networking::accept_remote_bots).
+     */
+    unsigned int remote_bots;
+    std::string listen;
+    std::string token;
+    unsigned int connect_timeout;
+};
+
+auto from_json(const nlohmann::json& json, BatchGame& game) -> void;
+
+/**
+ * Settings shared by all games of a batch.
+ */
+struct BatchOptions {
+    //! The maximum number of games played at once.
+    unsigned int threads;
+    //! The options every game is played with.
+    GameOptions game_options;
+    bool enable_replay;
+    ReplayOptions replay_options;
+    std::string replay_directory;
+    //! Keep bots running between games instead of starting them afresh for
+    //! each one. Bots must understand NEW_GAME_SENTINEL.
+    bool persistent_bots;
+    //! Offer bots a shared memory transport (see SHARED_MEMORY_OPTION).
+    bool shared_memory;
+    /**
+     * Play every game once per rotation of its seats, so that each bot
+     * plays from each seat on the same map (see duplicate_seats). Games
+     * with a solo player or remote bots are played once.
+     */
+    bool duplicate;
+    /**
+     * Pin each thread playing games, and the bots of its games, to one
+     * L3 cache domain (or NUMA node), taking the domains in turn, so that
+     * games don't contend for caches or disturb each other's timing.
+     */
+    bool pin_games;
+};
+
+/**
+ * The options one thread of a batch or server (the thread'th) plays its
+ * games with. With options.pin_games, the calling thread is pinned to the
+ * thread'th of domains (wrapping around), and so are the bots of its
+ * games; domain is set to the one it was pinned to, or left empty.
+ */
+auto place_batch_thread(const BatchOptions& options,
+                        const std::vector<CpuDomain>& domains,
+                        size_t thread, CpuDomain& domain) -> BatchOptions;
+
+/**
+ * Pick what a game left unset: its ID (default_id), a seed from the clock,
+ * and the map size from the seed.
+ */
+auto fill_batch_defaults(BatchGame& game, unsigned int default_id) -> void;
+
+/**
+ * Bots kept running between games (see BatchOptions::persistent_bots), by
+ * start command. Any number of games may use it at once.
+ */
+class BotPool {
+public:
+    //! Add an idle bot with the given start command to networking, if
+    //! there is one.
+    auto take(const std::string& command, Networking& networking) -> bool;
+    //! Keep a bot released from a game for a later one.
+    auto give(const std::string& command, const Networking::BotProcess& bot) -> void;
+    //! Kill the bots that are left.
+    auto shut_down(bool quiet_output) -> void;
+
+private:
+    std::map<std::string, std::vector<Networking::BotProcess>> idle_bots;
+    std::mutex mutex;
+};
+
+/**
+ * The map of a game played several times (see BatchOptions::duplicate),
+ * generated by whichever play of it comes first and shared by the others.
+ * Any number of games may use it at once.
+ */
+class SharedMap {
+public:
+    //! The map is let go once it has been used this many times.
+    explicit SharedMap(unsigned int uses_);
+
+    /**
+     * The map of the given game, played with the given options, generated
+     * (or read from the map cache) on first use. Throws as
+     * mapgen::generate_map does, and again on the next use.
+     */
+    auto take(const BatchGame& game, const GameOptions& game_options)
+        -> std::shared_ptr<const mapgen::GeneratedMap>;
+
+private:
+    unsigned int uses;
+    std::shared_ptr<const mapgen::GeneratedMap> map;
+    std::mutex mutex;
+};
+
+/**
+ * The given rotation of a game's seats, with the given ID (which each
+ * rotation needs its own of, so that their replays and logs don't
+ * overwrite each other's): the bot and name in seat i are those of seat
+ * (i + rotation) % seats.
+ */
+auto duplicate_seats(const BatchGame& game, unsigned int rotation,
+                     unsigned int id) -> BatchGame;
+//! The number of times BatchOptions::duplicate plays a game.
+auto duplicate_count(const BatchGame& game) -> unsigned int;
+
+/**
+ * Play one game with the options of a batch, returning its results as
+ * written by run_batch (without "game"). Bots come from and go back to
+ * bot_pool with options.persistent_bots. The map comes from shared_map if
+ * given.
+ *
+ * The replay may still be being written by the job left in replay.
+ */
+auto play_batch_game(const BatchGame& game, const BatchOptions& options,
+                     BotPool& bot_pool, std::future<void>& replay,
+                     SharedMap* shared_map = nullptr)
+    -> nlohmann::json;
+
+/**
+ * Read a manifest of games: one JSON object per line, for example
+ *
+ *     {"seed": 42, "width": 240, "height": 160, "bots": ["./MyBot", "./MyBot"]}
+ *
+ * Blank lines and lines starting with # are skipped. Games without an "id"
+ * are numbered from first_id upwards.
+ *
+ * @throws std::invalid_argument if a line is not a valid game.
+ */
+auto read_batch_manifest(std::istream& manifest, unsigned int first_id)
+    -> std::vector<BatchGame>;
+
+/**
+ * Play all the games of a batch, up to options.threads at a time. Each
+ * thread takes the next game as soon as it is done with one, and with
+ * more than one thread, games are started largest map first, so that a
+ * long game isn't left to run alone at the end.
+ *
+ * Writes one line of JSON per game to output as soon as the game finishes,
+ * so lines are in order of completion: each carries the index of its game
+ * in the manifest ("game") along with the usual quiet-mode results, or an
+ * "error" message if the game could not be played. With
+ * options.duplicate, they also carry the "rotation" played, and which of
+ * the manifest's bots sat in each seat ("seats"); with options.pin_games,
+ * the "cpu_domain" the game was played on.
+ *
+ * With options.persistent_bots, a bot still running at the end of a game
+ * is kept, and seated in a later game with the same start command.
+ *
+ * @return The number of games that could not be played.
+ */
+auto run_batch(const std::vector<BatchGame>& games,
+               const BatchOptions& options,
+               std::ostream& output) -> unsigned int;
+
+#endif //HALITE_BATCH_HPP
@@ -0,0 +1,156 @@
+#include "BatchApi.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "BatchHalite.hpp"
+
+struct HaliteBatch {
+    std::unique_ptr<BatchHalite> batch;
+    std::vector<float> observations;
+    std::vector<hlt::MoveQueue> moves;
+    std::string error;
+};
+
+namespace {
+    //! Only touched by callers that create batches on one thread.
+    std::string create_error;
+
+    //! Queue one command of halite_batch_step, or throw
+    //! std::invalid_argument.
+    auto queue_command(HaliteBatch& batch, const int32_t* command) -> void {
+        const auto game = command[HALITE_BATCH_MOVE_GAME];
+        if (game < 0 || static_cast<size_t>(game) >= batch.moves.size()) {
+            throw std::invalid_argument("Command for game " + std::to_string(game) +
+                                        ", which isn't in the batch");
+        }
+        auto& queues = batch.moves[game];
+        const auto player = command[HALITE_BATCH_MOVE_PLAYER];
+        if (player < 0 || static_cast<size_t>(player) >= queues.size()) {
+            throw std::invalid_argument("Command for player " + std::to_string(player) +
+                                        ", who isn't in the game");
+        }
+
+        hlt::Move move = {};
+        move.shipId = static_cast<hlt::EntityIndex>(command[HALITE_BATCH_MOVE_SHIP]);
+        const auto arg1 = command[HALITE_BATCH_MOVE_ARG1];
+        const auto arg2 = command[HALITE_BATCH_MOVE_ARG2];
+        switch (command[HALITE_BATCH_MOVE_TYPE]) {
+            case static_cast<int32_t>(hlt::MoveType::Thrust):
+                if (arg1 < 0 || arg1 > 0xffff || arg2 < 0 || arg2 > 0xffff) {
+                    throw std::invalid_argument("Thrust out of range for ship " +
+                                                std::to_string(move.shipId));
+                }
+                move.type = hlt::MoveType::Thrust;
+                move.move.thrust.thrust = static_cast<unsigned short>(arg1);
+                move.move.thrust.angle = static_cast<unsigned short>(arg2);
+                break;
+            case static_cast<int32_t>(hlt::MoveType::Dock):
+                move.type = hlt::MoveType::Dock;
+                move.move.dock_to = static_cast<hlt::EntityIndex>(arg1);
+                break;
+            case static_cast<int32_t>(hlt::MoveType::Undock):
+                move.type = hlt::MoveType::Undock;
+                break;
+            default:
+                throw std::invalid_argument("Unknown command type " +
+                                            std::to_string(command[HALITE_BATCH_MOVE_TYPE]) +
+                                            " for ship " + std::to_string(move.shipId));
+        }
+        if (!queues[player].push(move)) {
+            throw std::invalid_argument("Too many commands for ship " +
+                                        std::to_string(move.shipId));
+        }
+    }
+}
+
+HaliteBatch* halite_batch_create(unsigned int num_games,
+                                 unsigned int width, unsigned int height,
+                                 unsigned int num_players, unsigned int first_seed,
+                                 unsigned int max_ships, unsigned int max_planets,
+                                 unsigned int threads) {
+    try {
+        std::unique_ptr<HaliteBatch> batch(new HaliteBatch);
+        batch->batch.reset(new BatchHalite(
+            num_games, static_cast<unsigned short>(width), static_cast<unsigned short>(height),
+            static_cast<unsigned short>(num_players), first_seed, max_ships, max_planets,
+            threads));
+        batch->observations.resize(batch->batch->size() * batch->batch->observation_size());
+        batch->moves.resize(batch->batch->size());
+        batch->batch->observe(batch->observations.data());
+        return batch.release();
+    }
+    catch (const std::exception& e) {
+        create_error = e.what();
+        return nullptr;
+    }
+}
+
+void halite_batch_destroy(HaliteBatch* batch) {
+    delete batch;
+}
+
+unsigned int halite_batch_size(const HaliteBatch* batch) {
+    return static_cast<unsigned int>(batch->batch->size());
+}
+
+void halite_batch_layout(const HaliteBatch* batch, size_t layout[6]) {
+    const auto& games = *batch->batch;
+    layout[0] = games.observation_size();
+    layout[1] = games.ship_rows();
+    layout[2] = BatchHalite::SHIP_FEATURES;
+    layout[3] = games.planet_rows();
+    layout[4] = BatchHalite::PLANET_FEATURES;
+    layout[5] = games.game_features();
+}
+
+const float* halite_batch_observations(const HaliteBatch* batch) {
+    return batch->observations.data();
+}
+
+int halite_batch_step(HaliteBatch* batch, const int32_t* moves, size_t num_moves) {
+    auto& games = *batch->batch;
+    for (size_t index = 0; index < games.size(); index++) {
+        const auto& map = games.game(index).get_map();
+        auto& queues = batch->moves[index];
+        queues.resize(map.player_count());
+        for (auto& queue : queues) {
+            queue.reset(map.ship_index_limit());
+        }
+    }
+    try {
+        for (size_t i = 0; i < num_moves; i++) {
+            queue_command(*batch, moves + i * HALITE_BATCH_MOVE_FIELDS);
+        }
+    }
+    catch (const std::exception& e) {
+        batch->error = e.what();
+        return 1;
+    }
+
+    games.step(batch->moves, batch->observations.data());
+    return 0;
+}
+
+int halite_batch_reset(HaliteBatch* batch, unsigned int index, unsigned int seed) {
+    auto& games = *batch->batch;
+    if (index >= games.size()) {
+        batch->error = "No game " + std::to_string(index) + " in the batch";
+        return 1;
+    }
+    try {
+        games.reset(index, seed);
+    }
+    catch (const std::exception& e) {
+        batch->error = e.what();
+        return 1;
+    }
+    games.observe_game(index, batch->observations.data() + index * games.observation_size());
+    return 0;
+}
+
+const char* halite_batch_error(const HaliteBatch* batch) {
+    return batch == nullptr ? create_error.c_str() : batch->error.c_str();
+}
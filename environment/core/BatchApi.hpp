@@ -0,0 +1,88 @@
+#ifndef HALITE_BATCHAPI_HPP
+#define HALITE_BATCHAPI_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A C interface to batches of in-process games (see BatchHalite), for
+ * learners outside C++: mainly Python, through ctypes (see
+ * python/halite_batch.py), which releases the GIL for every call.
+ *
+ * Nothing is serialized: moves go in as an array of integers, and every
+ * game's observation is written in place into one array owned by the
+ * batch, which a caller can keep a view of instead of copying it.
+ * Functions that can fail return null or nonzero, and leave a message for
+ * halite_batch_error, like those of SimulationApi.hpp.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HaliteBatch HaliteBatch;
+
+//! The int32 values of each command given to halite_batch_step.
+enum {
+    //! The game, player and ship the command is for.
+    HALITE_BATCH_MOVE_GAME,
+    HALITE_BATCH_MOVE_PLAYER,
+    HALITE_BATCH_MOVE_SHIP,
+    //! 1 to thrust, 2 to dock, 3 to undock (as hlt::MoveType).
+    HALITE_BATCH_MOVE_TYPE,
+    //! The thrust, or the planet to dock to.
+    HALITE_BATCH_MOVE_ARG1,
+    //! The angle of a thrust, in degrees.
+    HALITE_BATCH_MOVE_ARG2,
+    HALITE_BATCH_MOVE_FIELDS,
+};
+
+/**
+ * Start num_games games (see the BatchHalite constructor), stepped on up
+ * to threads threads, and write their first observations; or return null.
+ */
+HaliteBatch* halite_batch_create(unsigned int num_games,
+                                 unsigned int width, unsigned int height,
+                                 unsigned int num_players, unsigned int first_seed,
+                                 unsigned int max_ships, unsigned int max_planets,
+                                 unsigned int threads);
+void halite_batch_destroy(HaliteBatch* batch);
+
+unsigned int halite_batch_size(const HaliteBatch* batch);
+/**
+ * The layout of an observation: floats per game, then the number of ship
+ * rows and their columns (BatchHalite::ShipFeature), then the number of
+ * planet rows and their columns (BatchHalite::PlanetFeature), then the
+ * game values after them (BatchHalite::GameFeature), in that order.
+ */
+void halite_batch_layout(const HaliteBatch* batch, size_t layout[6]);
+/**
+ * The observations of all games, one after the other, as of the last
+ * step or reset. The array doesn't move for the life of the batch.
+ */
+const float* halite_batch_observations(const HaliteBatch* batch);
+
+/**
+ * Play a turn of every game that isn't over, with num_moves commands of
+ * HALITE_BATCH_MOVE_FIELDS values each (a ship's are queued in the order
+ * given), then update the observations. As with Halite::step, moves are
+ * taken as they are, and commands for ships a player doesn't have are
+ * ignored. Returns 0, or nonzero if a command can't be queued (a game,
+ * player or type out of range, or too many for one ship), in which case
+ * nothing is played.
+ */
+int halite_batch_step(HaliteBatch* batch, const int32_t* moves, size_t num_moves);
+//! Start a new game in the given slot, and update its observation.
+int halite_batch_reset(HaliteBatch* batch, unsigned int index, unsigned int seed);
+
+/**
+ * What went wrong in the last call that failed with the given batch, or
+ * (given null) in the last halite_batch_create that did.
+ */
+const char* halite_batch_error(const HaliteBatch* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //HALITE_BATCHAPI_HPP
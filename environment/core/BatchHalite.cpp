@@ -0,0 +1,119 @@
+#include "BatchHalite.hpp"
+
+#include <algorithm>
+
+BatchHalite::BatchHalite(size_t num_games,
+                         unsigned short width_, unsigned short height_,
+                         unsigned short n_players_, unsigned int first_seed,
+                         size_t max_ships_, size_t max_planets_,
+                         unsigned int threads_)
+    : width(width_), height(height_), n_players(n_players_),
+      max_ships(max_ships_), max_planets(max_planets_),
+      threads(std::max(1U, threads_)), workers(new WorkerPool(threads)) {
+    for (size_t i = 0; i < num_games; i++) {
+        games.emplace_back(new Halite(
+            width, height, first_seed + static_cast<unsigned int>(i), n_players));
+    }
+}
+
+auto BatchHalite::observation_size() const -> size_t {
+    return max_ships * SHIP_FEATURES + max_planets * PLANET_FEATURES + game_features();
+}
+
+auto BatchHalite::game_features() const -> size_t {
+    return GAME_ALIVE + std::max<size_t>(n_players, hlt::CLASSIC_MAX_PLAYERS);
+}
+
+auto BatchHalite::for_each_game(const std::function<void(size_t)>& job) const -> void {
+    const auto num_chunks = std::max<size_t>(1, std::min<size_t>(threads, games.size()));
+    auto run_chunk = [&](size_t chunk) -> void {
+        const auto begin = games.size() * chunk / num_chunks;
+        const auto end = games.size() * (chunk + 1) / num_chunks;
+        for (auto i = begin; i < end; i++) {
+            job(i);
+        }
+    };
+
+    workers->run(num_chunks, run_chunk);
+}
+
+auto BatchHalite::step(const std::vector<hlt::MoveQueue>& moves, float* observations) -> void {
+    for_each_game([&](size_t index) -> void {
+        auto& game = *games[index];
+        if (!game.is_over()) {
+            game.step(moves[index]);
+        }
+        if (observations) {
+            observe_game(index, observations + index * observation_size());
+        }
+    });
+}
+
+auto BatchHalite::observe(float* observations) const -> void {
+    for_each_game([&](size_t index) -> void {
+        observe_game(index, observations + index * observation_size());
+    });
+}
+
+auto BatchHalite::reset(size_t index, unsigned int seed) -> void {
+    games[index].reset(new Halite(width, height, seed, n_players));
+}
+
+auto BatchHalite::observe_game(size_t index, float* observation) const -> void {
+    const auto& game = *games[index];
+    const auto& game_map = game.get_map();
+    std::fill(observation, observation + observation_size(), 0.0f);
+
+    auto row = observation;
+    size_t num_ships = 0;
+    for (hlt::PlayerId player = 0; player < game_map.player_count(); player++) {
+        for (const auto& pair : game_map.ships[player]) {
+            num_ships++;
+            if (num_ships > max_ships) continue;
+
+            const auto& ship = pair.second;
+            row[SHIP_PRESENT] = 1;
+            row[SHIP_ID] = pair.first;
+            row[SHIP_OWNER] = player;
+            row[SHIP_X] = static_cast<float>(ship.location.pos_x);
+            row[SHIP_Y] = static_cast<float>(ship.location.pos_y);
+            row[SHIP_VEL_X] = static_cast<float>(ship.velocity.vel_x);
+            row[SHIP_VEL_Y] = static_cast<float>(ship.velocity.vel_y);
+            row[SHIP_HEALTH] = ship.health;
+            row[SHIP_DOCKING_STATUS] = static_cast<float>(ship.docking_status);
+            row[SHIP_DOCKED_PLANET] = ship.docking_status == hlt::DockingStatus::Undocked
+                ? -1.0f : static_cast<float>(ship.docked_planet);
+            row[SHIP_WEAPON_COOLDOWN] = ship.weapon_cooldown;
+            row += SHIP_FEATURES;
+        }
+    }
+
+    row = observation + max_ships * SHIP_FEATURES;
+    const auto num_planets = std::min(max_planets, game_map.planets.size());
+    for (size_t planet_idx = 0; planet_idx < num_planets; planet_idx++) {
+        const auto& planet = game_map.planets[planet_idx];
+        if (planet.is_alive()) {
+            row[PLANET_ALIVE] = 1;
+            row[PLANET_X] = static_cast<float>(planet.location.pos_x);
+            row[PLANET_Y] = static_cast<float>(planet.location.pos_y);
+            row[PLANET_RADIUS] = static_cast<float>(planet.radius);
+            row[PLANET_HEALTH] = planet.health;
+            row[PLANET_OWNED] = planet.owned;
+            row[PLANET_OWNER] = planet.owned ? planet.owner : -1.0f;
+            row[PLANET_DOCKED_SHIPS] = planet.docked_ships.size();
+            row[PLANET_DOCKING_SPOTS] = planet.docking_spots;
+            row[PLANET_REMAINING_PRODUCTION] = planet.remaining_production;
+            row[PLANET_CURRENT_PRODUCTION] = planet.current_production;
+        }
+        row += PLANET_FEATURES;
+    }
+
+    row = observation + max_ships * SHIP_FEATURES + max_planets * PLANET_FEATURES;
+    row[GAME_TURN] = game.get_turn_number();
+    row[GAME_OVER] = game.is_over();
+    row[GAME_SHIPS] = num_ships;
+    const auto& alive = game.get_living_players();
+    for (hlt::PlayerId player = 0; player < game.get_player_count(); player++) {
+        row[GAME_ALIVE + player] = alive[player];
+    }
+}
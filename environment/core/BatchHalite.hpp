@@ -0,0 +1,130 @@
+#ifndef HALITE_BATCHHALITE_HPP
+#define HALITE_BATCHHALITE_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Halite.hpp"
+
+/**
+ * Many independent in-process games, stepped together (e.g. as the
+ * environments of a reinforcement learning trainer). Each step plays a
+ * turn of every game, split over worker threads, and writes what every
+ * game looks like afterwards into one caller-provided array.
+ *
+ * Games follow the same rules as in run_game, without replays or logs.
+ */
+class BatchHalite {
+public:
+    //! The columns of a ship's row in an observation.
+    enum ShipFeature {
+        //! 1 for a ship, 0 for a padding row.
+        SHIP_PRESENT,
+        SHIP_ID,
+        SHIP_OWNER,
+        SHIP_X,
+        SHIP_Y,
+        SHIP_VEL_X,
+        SHIP_VEL_Y,
+        SHIP_HEALTH,
+        //! A hlt::DockingStatus.
+        SHIP_DOCKING_STATUS,
+        //! -1 if the ship is undocked.
+        SHIP_DOCKED_PLANET,
+        SHIP_WEAPON_COOLDOWN,
+        SHIP_FEATURES,
+    };
+
+    //! The columns of a planet's row in an observation.
+    enum PlanetFeature {
+        //! 1 for a living planet, 0 for a dead one or padding.
+        PLANET_ALIVE,
+        PLANET_X,
+        PLANET_Y,
+        PLANET_RADIUS,
+        PLANET_HEALTH,
+        PLANET_OWNED,
+        //! -1 if the planet is unowned.
+        PLANET_OWNER,
+        PLANET_DOCKED_SHIPS,
+        PLANET_DOCKING_SPOTS,
+        PLANET_REMAINING_PRODUCTION,
+        PLANET_CURRENT_PRODUCTION,
+        PLANET_FEATURES,
+    };
+
+    //! The values after the ship and planet rows of an observation.
+    enum GameFeature {
+        GAME_TURN,
+        //! 1 once the game has ended.
+        GAME_OVER,
+        //! The number of ships, including any past the max_ships rows.
+        GAME_SHIPS,
+        //! 1 for each player still alive, then 0 for the unused seats.
+        GAME_ALIVE,
+    };
+
+    /**
+     * Start num_games games, with seeds first_seed, first_seed + 1 and so
+     * on. Observations have room for max_ships ships (of all players
+     * together) and max_planets planets per game; ships past that are
+     * left out, in order of owner then ID.
+     */
+    BatchHalite(size_t num_games,
+                unsigned short width_, unsigned short height_,
+                unsigned short n_players_, unsigned int first_seed,
+                size_t max_ships_, size_t max_planets_,
+                unsigned int threads_ = 1);
+
+    auto size() const -> size_t { return games.size(); }
+    auto game(size_t index) const -> const Halite& { return *games[index]; }
+    //! The ships and planets an observation has rows for.
+    auto ship_rows() const -> size_t { return max_ships; }
+    auto planet_rows() const -> size_t { return max_planets; }
+
+    /**
+     * Floats per game in an observation: max_ships rows of SHIP_FEATURES,
+     * then max_planets rows of PLANET_FEATURES, then game_features() values.
+     * Observations of all games are laid out one after the other.
+     */
+    auto observation_size() const -> size_t;
+    /**
+     * The values after the ship and planet rows: those of GameFeature, with
+     * a seat for each player, but at least CLASSIC_MAX_PLAYERS seats so
+     * that 2- and 4-player observations line up.
+     */
+    auto game_features() const -> size_t;
+
+    /**
+     * Play a turn of every game that isn't over, game i with moves[i]
+     * (which must have an entry for every game), then write the
+     * observations of all games to observations, if not null. Games that
+     * are over are left as they are, until reset.
+     */
+    auto step(const std::vector<hlt::MoveQueue>& moves, float* observations) -> void;
+    //! Write the observations of all games, without playing a turn.
+    auto observe(float* observations) const -> void;
+    //! Write the observation of one game (observation_size() floats).
+    auto observe_game(size_t index, float* observation) const -> void;
+    //! Start a new game in the given slot.
+    auto reset(size_t index, unsigned int seed) -> void;
+
+private:
+    unsigned short width, height, n_players;
+    size_t max_ships, max_planets;
+    unsigned int threads;
+    //! Halite isn't movable (it owns futures and logs), so games are held
+    //! by pointer.
+    std::vector<std::unique_ptr<Halite>> games;
+
+    //! The threads games are stepped on besides the caller's, kept for the
+    //! whole batch.
+    std::unique_ptr<WorkerPool> workers;
+
+    //! Call job for every game, in contiguous chunks on up to threads
+    //! threads.
+    auto for_each_game(const std::function<void(size_t)>& job) const -> void;
+};
+
+#endif //HALITE_BATCHHALITE_HPP
@@ -0,0 +1,623 @@
+#include "BinaryReplay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "json.hpp"
+
+namespace binary_replay {
+    //! How each column entry is stored: enums as their underlying byte,
+    //! everything else as is.
+    template<typename T>
+    using WireType = typename std::conditional<std::is_enum<T>::value, uint8_t, T>::type;
+
+    static auto put(std::string& out, uint8_t value) -> void {
+        out.push_back(static_cast<char>(value));
+    }
+
+    static auto put(std::string& out, uint32_t value) -> void {
+        for (int shift = 0; shift < 32; shift += 8) {
+            out.push_back(static_cast<char>((value >> shift) & 0xff));
+        }
+    }
+
+    static auto put(std::string& out, uint64_t value) -> void {
+        for (int shift = 0; shift < 64; shift += 8) {
+            out.push_back(static_cast<char>((value >> shift) & 0xff));
+        }
+    }
+
+    static auto put(std::string& out, double value) -> void {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int shift = 0; shift < 64; shift += 8) {
+            out.push_back(static_cast<char>((bits >> shift) & 0xff));
+        }
+    }
+
+    static auto get(const char* in, uint8_t& value) -> void {
+        value = static_cast<uint8_t>(*in);
+    }
+
+    static auto get(const char* in, uint32_t& value) -> void {
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            value |= uint32_t(static_cast<uint8_t>(in[i])) << (8 * i);
+        }
+    }
+
+    static auto get(const char* in, uint64_t& value) -> void {
+        value = 0;
+        for (int i = 0; i < 8; i++) {
+            value |= uint64_t(static_cast<uint8_t>(in[i])) << (8 * i);
+        }
+    }
+
+    static auto get(const char* in, double& value) -> void {
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; i++) {
+            bits |= uint64_t(static_cast<uint8_t>(in[i])) << (8 * i);
+        }
+        std::memcpy(&value, &bits, sizeof(value));
+    }
+
+    template<typename T>
+    static auto append_column(std::string& out, const std::vector<T>& column) -> void {
+        for (const auto& value : column) {
+            put(out, static_cast<WireType<T>>(value));
+        }
+    }
+
+    auto ShipTable::clear() -> void {
+        id.clear();
+        owner.clear();
+        x.clear();
+        y.clear();
+        vel_x.clear();
+        vel_y.clear();
+        health.clear();
+        cooldown.clear();
+        docking_status.clear();
+        docked_planet.clear();
+        docking_progress.clear();
+    }
+
+    auto PlanetTable::clear() -> void {
+        id.clear();
+        owner.clear();
+        health.clear();
+        remaining_production.clear();
+        current_production.clear();
+        docked_offset.assign(1, 0);
+        docked_ships.clear();
+    }
+
+    auto EventTable::clear() -> void {
+        type.clear();
+        entity_type.clear();
+        entity_owner.clear();
+        entity_id.clear();
+        x.clear();
+        y.clear();
+        time.clear();
+        radius.clear();
+        related_offset.assign(1, 0);
+        related_type.clear();
+        related_owner.clear();
+        related_id.clear();
+        related_x.clear();
+        related_y.clear();
+    }
+
+    auto EventTable::add(EventType event_type, EntityType type, uint8_t owner,
+                         uint32_t id, double x, double y, double time,
+                         double radius) -> size_t {
+        if (related_offset.empty()) related_offset.push_back(0);
+
+        this->type.push_back(event_type);
+        entity_type.push_back(type);
+        entity_owner.push_back(owner);
+        entity_id.push_back(id);
+        this->x.push_back(x);
+        this->y.push_back(y);
+        this->time.push_back(time);
+        this->radius.push_back(radius);
+        related_offset.push_back(related_offset.back());
+        return this->type.size() - 1;
+    }
+
+    auto EventTable::add_related(EntityType type, uint8_t owner, uint32_t id,
+                                 double x, double y) -> void {
+        related_type.push_back(type);
+        related_owner.push_back(owner);
+        related_id.push_back(id);
+        related_x.push_back(x);
+        related_y.push_back(y);
+        related_offset.back()++;
+    }
+
+    auto MoveTable::clear() -> void {
+        owner.clear();
+        ship_id.clear();
+        queue_number.clear();
+        type.clear();
+        magnitude_or_planet.clear();
+        angle.clear();
+    }
+
+    auto Frame::clear() -> void {
+        ships.clear();
+        planets.clear();
+        events.clear();
+        moves.clear();
+    }
+
+    auto append_header(std::string& out, const nlohmann::json& header,
+                       uint32_t num_frames) -> void {
+        out.append(MAGIC, sizeof(MAGIC));
+        put(out, FORMAT_VERSION);
+        const auto header_text = header.dump();
+        put(out, static_cast<uint32_t>(header_text.size()));
+        out += header_text;
+        put(out, num_frames);
+    }
+
+    //! An offsets column as stored: {0} if empty.
+    static auto append_offsets(std::string& out, const std::vector<uint32_t>& offsets) -> void {
+        if (offsets.empty()) {
+            put(out, uint32_t(0));
+            return;
+        }
+        append_column(out, offsets);
+    }
+
+    auto append_frame(std::string& out, const Frame& frame) -> void {
+        const auto& ships = frame.ships;
+        put(out, static_cast<uint32_t>(ships.size()));
+        append_column(out, ships.id);
+        append_column(out, ships.owner);
+        append_column(out, ships.x);
+        append_column(out, ships.y);
+        append_column(out, ships.vel_x);
+        append_column(out, ships.vel_y);
+        append_column(out, ships.health);
+        append_column(out, ships.cooldown);
+        append_column(out, ships.docking_status);
+        append_column(out, ships.docked_planet);
+        append_column(out, ships.docking_progress);
+
+        const auto& planets = frame.planets;
+        put(out, static_cast<uint32_t>(planets.size()));
+        append_column(out, planets.id);
+        append_column(out, planets.owner);
+        append_column(out, planets.health);
+        append_column(out, planets.remaining_production);
+        append_column(out, planets.current_production);
+        append_offsets(out, planets.docked_offset);
+        append_column(out, planets.docked_ships);
+
+        const auto& events = frame.events;
+        put(out, static_cast<uint32_t>(events.size()));
+        append_column(out, events.type);
+        append_column(out, events.entity_type);
+        append_column(out, events.entity_owner);
+        append_column(out, events.entity_id);
+        append_column(out, events.x);
+        append_column(out, events.y);
+        append_column(out, events.time);
+        append_column(out, events.radius);
+        append_offsets(out, events.related_offset);
+        append_column(out, events.related_type);
+        append_column(out, events.related_owner);
+        append_column(out, events.related_id);
+        append_column(out, events.related_x);
+        append_column(out, events.related_y);
+
+        const auto& moves = frame.moves;
+        put(out, static_cast<uint32_t>(moves.size()));
+        append_column(out, moves.owner);
+        append_column(out, moves.ship_id);
+        append_column(out, moves.queue_number);
+        append_column(out, moves.type);
+        append_column(out, moves.magnitude_or_planet);
+        append_column(out, moves.angle);
+    }
+
+    //! ZSTD_MAGIC_SKIPPABLE_START, which is only in zstd's static API.
+    constexpr uint32_t SKIPPABLE_MAGIC = 0x184D2A50;
+    //! The size of an index without any chunks.
+    constexpr size_t EMPTY_INDEX_SIZE = 4 + 4 + sizeof(INDEX_MAGIC) + 4 + 4 + 4;
+
+    auto append_index(std::string& out, uint32_t chunk_frames,
+                      const std::vector<uint64_t>& chunk_offsets) -> void {
+        const auto size = static_cast<uint32_t>(
+            EMPTY_INDEX_SIZE + chunk_offsets.size() * sizeof(uint64_t));
+        put(out, SKIPPABLE_MAGIC);
+        put(out, size - 8);
+        out.append(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        put(out, chunk_frames);
+        put(out, static_cast<uint32_t>(chunk_offsets.size()));
+        for (const auto offset : chunk_offsets) {
+            put(out, offset);
+        }
+        put(out, size);
+    }
+
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& filename) {
+        std::ifstream file(filename, std::ios_base::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open replay " + filename);
+        }
+        contents.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        bytes = contents.data();
+        length = contents.size();
+    }
+
+    MappedFile::~MappedFile() {}
+#else
+    MappedFile::MappedFile(const std::string& filename) : bytes(nullptr), length(0) {
+        const auto fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open replay " + filename);
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            close(fd);
+            throw std::runtime_error("Could not read replay " + filename);
+        }
+        length = static_cast<size_t>(status.st_size);
+        // An empty file can't be mapped, and is no replay either way
+        if (length > 0) {
+            const auto data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Could not map replay " + filename);
+            }
+            bytes = static_cast<const char*>(data);
+            // Frames are mostly read in order
+            madvise(const_cast<char*>(bytes), length, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    MappedFile::~MappedFile() {
+        if (bytes != nullptr) munmap(const_cast<char*>(bytes), length);
+    }
+#endif
+
+    Reader::Reader(const std::string& filename)
+        : file(filename), stream(nullptr), input_pos(0), buffer_pos(0),
+          frame_count(0), frames_read(0), chunk_frames(0) {
+        read_index();
+
+        // Uncompressed replays start with the magic, and are read straight
+        // from the file; anything else should be a zstd stream
+        if (file.size() < sizeof(MAGIC) ||
+            std::memcmp(file.data(), MAGIC, sizeof(MAGIC)) != 0) {
+            stream = ZSTD_createDStream();
+            if (stream == nullptr || ZSTD_isError(ZSTD_initDStream(stream))) {
+                throw std::runtime_error("Could not start decompressing replay");
+            }
+        }
+        read_header();
+    }
+
+    auto Reader::read_header() -> void {
+        if (std::memcmp(read_bytes(sizeof(MAGIC)), MAGIC, sizeof(MAGIC)) != 0) {
+            throw std::runtime_error("Not a binary replay");
+        }
+        // Version 1 only lacks the index
+        const auto version = read_u32();
+        if (version != 1 && version != FORMAT_VERSION) {
+            throw std::runtime_error(
+                "Unsupported binary replay version " + std::to_string(version));
+        }
+        const auto header_length = read_u32();
+        const auto header_text = read_bytes(header_length);
+        header_json.reset(new nlohmann::json(
+            nlohmann::json::parse(header_text, header_text + header_length)));
+        frame_count = read_u32();
+    }
+
+    Reader::~Reader() {
+        ZSTD_freeDStream(stream);
+    }
+
+    auto Reader::read_index() -> void {
+        // Anything that doesn't look like an index means there is none (for
+        // example, in a replay decompressed with the zstd command)
+        const auto file_size = static_cast<uint64_t>(file.size());
+        if (file_size < EMPTY_INDEX_SIZE) return;
+
+        uint32_t size;
+        get(file.data() + file_size - sizeof(size), size);
+        if (size < EMPTY_INDEX_SIZE || size > file_size ||
+            (size - EMPTY_INDEX_SIZE) % sizeof(uint64_t) != 0) {
+            return;
+        }
+
+        const auto index = file.data() + (file_size - size);
+        uint32_t magic, length, frames, chunks;
+        get(&index[0], magic);
+        get(&index[4], length);
+        get(&index[8 + sizeof(INDEX_MAGIC)], frames);
+        get(&index[12 + sizeof(INDEX_MAGIC)], chunks);
+        if (magic != SKIPPABLE_MAGIC || length != size - 8 ||
+            std::memcmp(&index[8], INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+            frames == 0 || chunks != (size - EMPTY_INDEX_SIZE) / sizeof(uint64_t)) {
+            return;
+        }
+
+        std::vector<uint64_t> offsets(chunks);
+        for (uint32_t i = 0; i < chunks; i++) {
+            get(&index[16 + sizeof(INDEX_MAGIC) + i * sizeof(uint64_t)], offsets[i]);
+            if (offsets[i] >= file_size - size) {
+                return;
+            }
+        }
+        chunk_frames = frames;
+        chunk_offsets = std::move(offsets);
+    }
+
+    auto Reader::restart(uint64_t offset, uint32_t first_frame) -> void {
+        input_pos = static_cast<size_t>(offset);
+        buffer.clear();
+        buffer_pos = 0;
+        frames_read = first_frame;
+        if (stream != nullptr && ZSTD_isError(ZSTD_initDStream(stream))) {
+            throw std::runtime_error("Could not start decompressing replay");
+        }
+    }
+
+    auto Reader::seek(uint32_t frame_index) -> void {
+        if (frame_index > frame_count) {
+            throw std::runtime_error("Frame " + std::to_string(frame_index) +
+                                     " is not in the replay");
+        }
+
+        if (has_index()) {
+            const auto chunk = std::min<size_t>(frame_index / chunk_frames,
+                                                chunk_offsets.size() - 1);
+            // Keep reading the current chunk if the frame is ahead in it
+            if (frame_index < frames_read || chunk > frames_read / chunk_frames) {
+                restart(chunk_offsets[chunk], static_cast<uint32_t>(chunk * chunk_frames));
+            }
+        }
+        else if (frame_index < frames_read) {
+            restart(0, 0);
+            read_header();
+        }
+
+        Frame skipped;
+        while (frames_read < frame_index) {
+            next_frame(skipped, 0);
+        }
+    }
+
+    auto Reader::read_frame(uint32_t frame_index, Frame& frame, unsigned tables) -> void {
+        if (frame_index >= frame_count) {
+            throw std::runtime_error("Frame " + std::to_string(frame_index) +
+                                     " is not in the replay");
+        }
+        seek(frame_index);
+        next_frame(frame, tables);
+    }
+
+    auto Reader::fill(size_t size) -> void {
+        // Drop what was already parsed, once it is most of the buffer
+        if (buffer_pos > 0 && buffer_pos >= buffer.size() / 2) {
+            buffer.erase(0, buffer_pos);
+            buffer_pos = 0;
+        }
+
+        const auto chunk = ZSTD_DStreamOutSize();
+        while (buffer.size() - buffer_pos < size) {
+            if (input_pos == file.size()) {
+                throw std::runtime_error("Unexpected end of replay");
+            }
+
+            // Decompress straight into the end of the buffer
+            const auto filled = buffer.size();
+            buffer.resize(filled + chunk);
+            ZSTD_inBuffer in = { file.data(), file.size(), input_pos };
+            ZSTD_outBuffer out = { &buffer[filled], chunk, 0 };
+            const auto result = ZSTD_decompressStream(stream, &out, &in);
+            buffer.resize(filled + out.pos);
+            if (ZSTD_isError(result)) {
+                throw std::runtime_error(
+                    std::string("Could not decompress replay: ") + ZSTD_getErrorName(result));
+            }
+            input_pos = in.pos;
+        }
+    }
+
+    auto Reader::read_bytes(size_t size) -> const char* {
+        if (stream == nullptr) {
+            if (file.size() - input_pos < size) {
+                throw std::runtime_error("Unexpected end of replay");
+            }
+            const auto result = file.data() + input_pos;
+            input_pos += size;
+            return result;
+        }
+
+        fill(size);
+        const auto result = &buffer[buffer_pos];
+        buffer_pos += size;
+        return result;
+    }
+
+    auto Reader::read_u32() -> uint32_t {
+        uint32_t value;
+        get(read_bytes(sizeof(value)), value);
+        return value;
+    }
+
+    template<typename T>
+    auto Reader::read_column(std::vector<T>& column, size_t size) -> void {
+        typedef WireType<T> Wire;
+        const auto data = read_bytes(size * sizeof(Wire));
+        column.resize(size);
+        for (size_t i = 0; i < size; i++) {
+            Wire value;
+            get(data + i * sizeof(Wire), value);
+            column[i] = static_cast<T>(value);
+        }
+    }
+
+    template<typename T>
+    auto Reader::skip_column(size_t size) -> void {
+        read_bytes(size * sizeof(WireType<T>));
+    }
+
+    //! Check that an offsets column is valid, returning its last entry.
+    static auto offsets_end(const std::vector<uint32_t>& offsets) -> uint32_t {
+        if (offsets.front() != 0) {
+            throw std::runtime_error("Invalid binary replay offsets");
+        }
+        for (size_t i = 1; i < offsets.size(); i++) {
+            if (offsets[i] < offsets[i - 1]) {
+                throw std::runtime_error("Invalid binary replay offsets");
+            }
+        }
+        return offsets.back();
+    }
+
+    auto Reader::skip_offsets(size_t size) -> uint32_t {
+        const auto data = read_bytes((size + 1) * sizeof(uint32_t));
+        uint32_t first, last;
+        get(data, first);
+        get(data + size * sizeof(uint32_t), last);
+        if (first != 0) {
+            throw std::runtime_error("Invalid binary replay offsets");
+        }
+        return last;
+    }
+
+    auto Reader::next_frame(Frame& frame, unsigned tables) -> bool {
+        if (frames_read == frame_count) return false;
+        frames_read++;
+
+        auto& ships = frame.ships;
+        const size_t num_ships = read_u32();
+        if (tables & SHIP_TABLE) {
+            read_column(ships.id, num_ships);
+            read_column(ships.owner, num_ships);
+            read_column(ships.x, num_ships);
+            read_column(ships.y, num_ships);
+            read_column(ships.vel_x, num_ships);
+            read_column(ships.vel_y, num_ships);
+            read_column(ships.health, num_ships);
+            read_column(ships.cooldown, num_ships);
+            read_column(ships.docking_status, num_ships);
+            read_column(ships.docked_planet, num_ships);
+            read_column(ships.docking_progress, num_ships);
+        }
+        else {
+            ships.clear();
+            skip_column<uint32_t>(num_ships);
+            skip_column<uint8_t>(num_ships);
+            skip_column<double>(4 * num_ships);
+            skip_column<uint32_t>(2 * num_ships);
+            skip_column<DockingStatus>(num_ships);
+            skip_column<uint32_t>(2 * num_ships);
+        }
+
+        auto& planets = frame.planets;
+        const size_t num_planets = read_u32();
+        if (tables & PLANET_TABLE) {
+            read_column(planets.id, num_planets);
+            read_column(planets.owner, num_planets);
+            read_column(planets.health, num_planets);
+            read_column(planets.remaining_production, num_planets);
+            read_column(planets.current_production, num_planets);
+            read_column(planets.docked_offset, num_planets + 1);
+            read_column(planets.docked_ships, offsets_end(planets.docked_offset));
+        }
+        else {
+            planets.clear();
+            skip_column<uint32_t>(num_planets);
+            skip_column<uint8_t>(num_planets);
+            skip_column<uint32_t>(3 * num_planets);
+            skip_column<uint32_t>(skip_offsets(num_planets));
+        }
+
+        auto& events = frame.events;
+        const size_t num_events = read_u32();
+        if (tables & EVENT_TABLE) {
+            read_column(events.type, num_events);
+            read_column(events.entity_type, num_events);
+            read_column(events.entity_owner, num_events);
+            read_column(events.entity_id, num_events);
+            read_column(events.x, num_events);
+            read_column(events.y, num_events);
+            read_column(events.time, num_events);
+            read_column(events.radius, num_events);
+            read_column(events.related_offset, num_events + 1);
+            const size_t num_related = offsets_end(events.related_offset);
+            read_column(events.related_type, num_related);
+            read_column(events.related_owner, num_related);
+            read_column(events.related_id, num_related);
+            read_column(events.related_x, num_related);
+            read_column(events.related_y, num_related);
+        }
+        else {
+            events.clear();
+            skip_column<EventType>(num_events);
+            skip_column<EntityType>(num_events);
+            skip_column<uint8_t>(num_events);
+            skip_column<uint32_t>(num_events);
+            skip_column<double>(4 * num_events);
+            const size_t num_related = skip_offsets(num_events);
+            skip_column<EntityType>(num_related);
+            skip_column<uint8_t>(num_related);
+            skip_column<uint32_t>(num_related);
+            skip_column<double>(2 * num_related);
+        }
+
+        auto& moves = frame.moves;
+        const size_t num_moves = read_u32();
+        if (tables & MOVE_TABLE) {
+            read_column(moves.owner, num_moves);
+            read_column(moves.ship_id, num_moves);
+            read_column(moves.queue_number, num_moves);
+            read_column(moves.type, num_moves);
+            read_column(moves.magnitude_or_planet, num_moves);
+            read_column(moves.angle, num_moves);
+        }
+        else {
+            moves.clear();
+            skip_column<uint8_t>(num_moves);
+            skip_column<uint32_t>(num_moves);
+            skip_column<uint8_t>(num_moves);
+            skip_column<MoveType>(num_moves);
+            skip_column<uint32_t>(2 * num_moves);
+        }
+
+        return true;
+    }
+
+    auto read_all(const std::string& filename,
+                  nlohmann::json& header, std::vector<Frame>& frames) -> void {
+        Reader reader(filename);
+        header = reader.header();
+        frames.resize(reader.num_frames());
+        for (auto& frame : frames) {
+            reader.next_frame(frame);
+        }
+    }
+}
@@ -0,0 +1,400 @@
+#ifndef HALITE_BINARYREPLAY_HPP
+#define HALITE_BINARYREPLAY_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "json_fwd.hpp"
+#include "../zstd-1.3.0/lib/zstd.h"
+
+/**
+ * The binary replay format (--replay-format=binary), and a reader for it.
+ *
+ * This only depends on json.hpp and zstd, so tools can link against it
+ * (the halite_replay library) without the rest of the engine.
+ *
+ * A binary replay is a zstd stream (or, with --no-compression, the raw
+ * bytes) of:
+ *
+ *     "HLTB" magic, u32 FORMAT_VERSION
+ *     u32 length, then the replay header as JSON: everything in a JSON
+ *         replay except "frames" and "moves"
+ *     u32 number of frames, then for each frame:
+ *         the ship table, planet table and event table of the frame, and
+ *         the move table of the moves made after it (empty for the last
+ *         frame)
+ *
+ * followed by the index. Every chunk of frames (DEFAULT_CHUNK_FRAMES, or
+ * --replay-keyframe-interval) starts a new zstd frame, so decompression
+ * can start at any chunk. The index is a zstd skippable frame (which
+ * decompressors ignore), also written without compression:
+ *
+ *     u32 ZSTD_MAGIC_SKIPPABLE_START, u32 length of the rest
+ *     "HLTI" magic, u32 frames per chunk, u32 number of chunks
+ *     u64 file offset of each chunk
+ *     u32 size of the whole index, so that it can be found from the end
+ *
+ * Version 1 replays have neither chunks nor an index.
+ *
+ * Each table is a u32 row count, followed by each column in turn as a
+ * contiguous array, in the order of the fields of its struct below. A
+ * column of offsets has one more entry than there are rows, and indexes
+ * into the columns after it. Numbers are little-endian; floats are IEEE
+ * doubles.
+ */
+namespace binary_replay {
+    constexpr char MAGIC[4] = { 'H', 'L', 'T', 'B' };
+    constexpr uint32_t FORMAT_VERSION = 2;
+    constexpr char INDEX_MAGIC[4] = { 'H', 'L', 'T', 'I' };
+    constexpr uint32_t DEFAULT_CHUNK_FRAMES = 32;
+
+    //! Stored in place of a planet's owner when it has none.
+    constexpr uint8_t NO_OWNER = 0xff;
+
+    //! The values of hlt::EntityType.
+    enum class EntityType : uint8_t {
+        Invalid = 0,
+        Ship = 1,
+        Planet = 2,
+    };
+
+    //! The values of hlt::DockingStatus.
+    enum class DockingStatus : uint8_t {
+        Undocked = 0,
+        Docking = 1,
+        Docked = 2,
+        Undocking = 3,
+    };
+
+    enum class EventType : uint8_t {
+        Destroyed = 0,
+        Attack = 1,
+        Contention = 2,
+        Spawned = 3,
+    };
+
+    enum class MoveType : uint8_t {
+        Thrust = 0,
+        Dock = 1,
+        Undock = 2,
+    };
+
+    /**
+     * The rows of a table, for iterating over them as structs (a
+     * Table::Row made from the columns of each) instead of column by column.
+     */
+    template<typename Table>
+    struct Rows {
+        struct Iterator {
+            const Table* table;
+            size_t index;
+
+            auto operator*() const -> typename Table::Row { return (*table)[index]; }
+            auto operator++() -> Iterator& { ++index; return *this; }
+            auto operator!=(const Iterator& other) const -> bool { return index != other.index; }
+        };
+
+        const Table* table;
+
+        auto begin() const -> Iterator { return { table, 0 }; }
+        auto end() const -> Iterator { return { table, table->size() }; }
+        auto size() const -> size_t { return table->size(); }
+    };
+
+    //! The living ships of a frame. The entity ID of a ship is its owner
+    //! and its ID.
+    struct ShipTable {
+        struct Row {
+            uint32_t id;
+            uint8_t owner;
+            double x, y;
+            double vel_x, vel_y;
+            uint32_t health;
+            uint32_t cooldown;
+            DockingStatus docking_status;
+            uint32_t docked_planet;
+            uint32_t docking_progress;
+        };
+
+        std::vector<uint32_t> id;
+        std::vector<uint8_t> owner;
+        std::vector<double> x, y;
+        std::vector<double> vel_x, vel_y;
+        std::vector<uint32_t> health;
+        std::vector<uint32_t> cooldown;
+        std::vector<DockingStatus> docking_status;
+        //! Meaningless for undocked ships.
+        std::vector<uint32_t> docked_planet;
+        std::vector<uint32_t> docking_progress;
+
+        auto size() const -> size_t { return id.size(); }
+        auto clear() -> void;
+        auto operator[](size_t i) const -> Row {
+            return { id[i], owner[i], x[i], y[i], vel_x[i], vel_y[i], health[i],
+                     cooldown[i], docking_status[i], docked_planet[i], docking_progress[i] };
+        }
+        auto rows() const -> Rows<ShipTable> { return { this }; }
+    };
+
+    //! The living planets of a frame. Their positions and sizes don't
+    //! change, so they are only in the header.
+    struct PlanetTable {
+        struct Row {
+            uint32_t id;
+            uint8_t owner;
+            uint32_t health;
+            uint32_t remaining_production;
+            uint32_t current_production;
+            //! Points into docked_ships.
+            const uint32_t* docked_ships;
+            uint32_t num_docked;
+        };
+
+        std::vector<uint32_t> id;
+        //! NO_OWNER for unowned planets.
+        std::vector<uint8_t> owner;
+        std::vector<uint32_t> health;
+        std::vector<uint32_t> remaining_production;
+        std::vector<uint32_t> current_production;
+        //! Planet i's docked ships are docked_ships[docked_offset[i]] up to
+        //! docked_ships[docked_offset[i + 1]].
+        std::vector<uint32_t> docked_offset;
+        std::vector<uint32_t> docked_ships;
+
+        auto size() const -> size_t { return id.size(); }
+        auto clear() -> void;
+        auto operator[](size_t i) const -> Row {
+            return { id[i], owner[i], health[i], remaining_production[i],
+                     current_production[i], docked_ships.data() + docked_offset[i],
+                     docked_offset[i + 1] - docked_offset[i] };
+        }
+        auto rows() const -> Rows<PlanetTable> { return { this }; }
+    };
+
+    /**
+     * The events of a frame. Fields an event type doesn't have are NaN
+     * (time, radius) or empty (related entities).
+     *
+     * The related entities are the targets of an attack, the participants
+     * of a contention, and the planet a ship spawned from.
+     */
+    struct EventTable {
+        struct Row {
+            EventType type;
+            EntityType entity_type;
+            uint8_t entity_owner;
+            uint32_t entity_id;
+            double x, y;
+            double time;
+            double radius;
+            //! The event's related entities are related(related_begin) up
+            //! to related(related_end).
+            uint32_t related_begin, related_end;
+        };
+        struct Related {
+            EntityType type;
+            uint8_t owner;
+            uint32_t id;
+            double x, y;
+        };
+
+        std::vector<EventType> type;
+        std::vector<EntityType> entity_type;
+        //! The owner of a ship, 0 for a planet.
+        std::vector<uint8_t> entity_owner;
+        std::vector<uint32_t> entity_id;
+        std::vector<double> x, y;
+        std::vector<double> time;
+        std::vector<double> radius;
+        //! Event i's related entities are entries related_offset[i] up to
+        //! related_offset[i + 1] of the related_ columns.
+        std::vector<uint32_t> related_offset;
+        std::vector<EntityType> related_type;
+        std::vector<uint8_t> related_owner;
+        std::vector<uint32_t> related_id;
+        std::vector<double> related_x, related_y;
+
+        auto size() const -> size_t { return type.size(); }
+        auto clear() -> void;
+        /**
+         * Add a row, returning its index. Its related entities are those
+         * added with add_related until the next call.
+         */
+        auto add(EventType event_type, EntityType type, uint8_t owner,
+                 uint32_t id, double x, double y, double time,
+                 double radius) -> size_t;
+        auto add_related(EntityType type, uint8_t owner, uint32_t id,
+                         double x, double y) -> void;
+
+        auto operator[](size_t i) const -> Row {
+            return { type[i], entity_type[i], entity_owner[i], entity_id[i], x[i], y[i],
+                     time[i], radius[i], related_offset[i], related_offset[i + 1] };
+        }
+        auto rows() const -> Rows<EventTable> { return { this }; }
+        auto related(size_t i) const -> Related {
+            return { related_type[i], related_owner[i], related_id[i],
+                     related_x[i], related_y[i] };
+        }
+    };
+
+    //! The moves made after a frame, in queue order for each ship.
+    struct MoveTable {
+        struct Row {
+            uint8_t owner;
+            uint32_t ship_id;
+            uint8_t queue_number;
+            MoveType type;
+            uint32_t magnitude_or_planet;
+            uint32_t angle;
+        };
+
+        std::vector<uint8_t> owner;
+        std::vector<uint32_t> ship_id;
+        std::vector<uint8_t> queue_number;
+        std::vector<MoveType> type;
+        //! Thrust magnitude, or the planet docked to; 0 for undocking.
+        std::vector<uint32_t> magnitude_or_planet;
+        //! Thrust angle in degrees; 0 for other moves.
+        std::vector<uint32_t> angle;
+
+        auto size() const -> size_t { return owner.size(); }
+        auto clear() -> void;
+        auto operator[](size_t i) const -> Row {
+            return { owner[i], ship_id[i], queue_number[i], type[i],
+                     magnitude_or_planet[i], angle[i] };
+        }
+        auto rows() const -> Rows<MoveTable> { return { this }; }
+    };
+
+    struct Frame {
+        ShipTable ships;
+        PlanetTable planets;
+        EventTable events;
+        MoveTable moves;
+
+        auto clear() -> void;
+    };
+
+    //! The tables of a frame, or'ed together to pick which ones
+    //! Reader::next_frame decodes.
+    constexpr unsigned SHIP_TABLE = 1 << 0;
+    constexpr unsigned PLANET_TABLE = 1 << 1;
+    constexpr unsigned EVENT_TABLE = 1 << 2;
+    constexpr unsigned MOVE_TABLE = 1 << 3;
+    constexpr unsigned ALL_TABLES = SHIP_TABLE | PLANET_TABLE | EVENT_TABLE | MOVE_TABLE;
+
+    //! Append the FORMAT_VERSION file header (up to the frame count).
+    auto append_header(std::string& out, const nlohmann::json& header,
+                       uint32_t num_frames) -> void;
+    //! Append a frame in the format above.
+    auto append_frame(std::string& out, const Frame& frame) -> void;
+    //! Append the index, given where each chunk starts in the file.
+    auto append_index(std::string& out, uint32_t chunk_frames,
+                      const std::vector<uint64_t>& chunk_offsets) -> void;
+
+    //! A file mapped into memory (or, where that isn't supported, read
+    //! into it). Throws std::runtime_error if it can't be.
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& filename);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+        auto data() const -> const char* { return bytes; }
+        auto size() const -> size_t { return length; }
+
+    private:
+        const char* bytes;
+        size_t length;
+        //! Only used without mmap.
+        std::string contents;
+    };
+
+    /**
+     * Reads a binary replay, one frame at a time, so that only the current
+     * frame needs to be in memory. Throws std::runtime_error if the file
+     * can't be read or is not a valid binary replay.
+     *
+     * The file is memory-mapped: an uncompressed replay is decoded straight
+     * from the mapping, and a compressed one is decompressed from it a
+     * frame at a time. Tables that aren't asked for are skipped over
+     * without being decoded, which is the bulk of the work for tools that
+     * only look at some of them.
+     */
+    class Reader {
+    public:
+        explicit Reader(const std::string& filename);
+        ~Reader();
+        Reader(const Reader&) = delete;
+        auto operator=(const Reader&) -> Reader& = delete;
+
+        //! Everything in a JSON replay but the frames and moves.
+        auto header() const -> const nlohmann::json& { return *header_json; }
+        auto num_frames() const -> uint32_t { return frame_count; }
+        /**
+         * Read the next frame into the given one, reusing its storage.
+         * Only the given tables (see ALL_TABLES) are decoded; the others
+         * are left empty.
+         *
+         * @return false (leaving frame alone) once all frames were read.
+         */
+        auto next_frame(Frame& frame, unsigned tables = ALL_TABLES) -> bool;
+        //! Whether the file has an index, so that seek doesn't need to
+        //! read every frame before the one wanted.
+        auto has_index() const -> bool { return !chunk_offsets.empty(); }
+        /**
+         * Make the given frame (up to num_frames) the next one read. With
+         * an index, this decompresses at most a chunk of frames before
+         * it; without one, every frame before it. Either way, the frames
+         * skipped over aren't decoded.
+         */
+        auto seek(uint32_t frame_index) -> void;
+        //! Read the given frame (below num_frames), as seek and next_frame.
+        auto read_frame(uint32_t frame_index, Frame& frame,
+                        unsigned tables = ALL_TABLES) -> void;
+
+    private:
+        MappedFile file;
+        ZSTD_DStream* stream;
+        //! Where reading the file continues.
+        size_t input_pos;
+        //! Decompressed bytes not yet parsed start at buffer[buffer_pos].
+        std::string buffer;
+        size_t buffer_pos;
+
+        //! Behind a pointer, so that this header can do without json.hpp.
+        std::unique_ptr<nlohmann::json> header_json;
+        uint32_t frame_count;
+        uint32_t frames_read;
+
+        //! From the index, if any.
+        uint32_t chunk_frames;
+        std::vector<uint64_t> chunk_offsets;
+
+        auto read_index() -> void;
+        //! Start reading from the given file offset, at frame first_frame.
+        auto restart(uint64_t offset, uint32_t first_frame) -> void;
+        auto read_header() -> void;
+        //! Make sure at least size bytes are buffered.
+        auto fill(size_t size) -> void;
+        //! The next size bytes, valid until the next read.
+        auto read_bytes(size_t size) -> const char*;
+        auto read_u32() -> uint32_t;
+        template<typename T>
+        auto read_column(std::vector<T>& column, size_t size) -> void;
+        //! Skip a column of size entries of type T.
+        template<typename T>
+        auto skip_column(size_t size) -> void;
+        //! Skip a column of size + 1 offsets, returning the last.
+        auto skip_offsets(size_t size) -> uint32_t;
+    };
+
+    //! Read a whole binary replay.
+    auto read_all(const std::string& filename,
+                  nlohmann::json& header, std::vector<Frame>& frames) -> void;
+}
+
+#endif //HALITE_BINARYREPLAY_HPP
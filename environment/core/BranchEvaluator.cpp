@@ -0,0 +1,113 @@
+#include "BranchEvaluator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+BranchEvaluator::BranchEvaluator(unsigned short width_, unsigned short height_,
+                                 unsigned int seed_, unsigned short n_players_,
+                                 unsigned int threads_,
+                                 const GameOptions& options_)
+    : threads(std::max(1U, threads_)) {
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back(new Halite(width_, height_, seed_, n_players_, options_));
+    }
+}
+
+auto BranchEvaluator::record_start(const hlt::Map& map) -> void {
+    start_ships = map.ships;
+    start_owned.resize(map.planets.size());
+    start_owner.resize(map.planets.size());
+    for (size_t planet_idx = 0; planet_idx < map.planets.size(); planet_idx++) {
+        const auto& planet = map.planets[planet_idx];
+        start_owned[planet_idx] = planet.is_alive() && planet.owned;
+        start_owner[planet_idx] = planet.owner;
+    }
+}
+
+auto BranchEvaluator::summarize(const Halite& game, unsigned short turns_played,
+                                Outcome& outcome) const -> void {
+    const auto& map = game.get_map();
+    outcome.turns_played = turns_played;
+    outcome.game_over = game.is_over();
+    outcome.state_hash = map.state_hash();
+    outcome.players.assign(map.player_count(), PlayerOutcome{});
+
+    const auto& alive = game.get_living_players();
+    for (hlt::PlayerId player = 0; player < map.player_count(); player++) {
+        auto& result = outcome.players[player];
+        const auto& ships = map.ships[player];
+        result.ships = static_cast<unsigned int>(ships.size());
+        result.alive = alive[player];
+
+        for (const auto& pair : start_ships[player]) {
+            const auto end = ships.find(pair.first);
+            if (end == ships.end()) {
+                result.ships_lost++;
+                result.damage_taken += pair.second.health;
+            }
+            else if (end->second.health < pair.second.health) {
+                result.damage_taken += pair.second.health - end->second.health;
+            }
+        }
+        for (const auto& pair : ships) {
+            if (!start_ships[player].count(pair.first)) {
+                result.ships_spawned++;
+            }
+        }
+    }
+
+    for (size_t planet_idx = 0; planet_idx < map.planets.size(); planet_idx++) {
+        const auto& planet = map.planets[planet_idx];
+        const auto owned = planet.is_alive() && planet.owned;
+        const auto was_owned = start_owned[planet_idx];
+        if (owned) {
+            outcome.players[planet.owner].planets++;
+        }
+        if (owned && (!was_owned || start_owner[planet_idx] != planet.owner)) {
+            outcome.players[planet.owner].planets_gained++;
+        }
+        if (was_owned && (!owned || start_owner[planet_idx] != planet.owner)) {
+            outcome.players[start_owner[planet_idx]].planets_lost++;
+        }
+    }
+}
+
+auto BranchEvaluator::evaluate(const Halite::Snapshot& from,
+                               const std::vector<Branch>& branches,
+                               unsigned short turns,
+                               std::vector<Outcome>& outcomes) -> void {
+    outcomes.resize(branches.size());
+    if (branches.empty()) return;
+
+    workers[0]->restore(from);
+    record_start(workers[0]->get_map());
+
+    // Branches can end at different turns, so they are handed out one at
+    // a time rather than in chunks
+    std::atomic<size_t> next_branch(0);
+    const hlt::MoveQueue no_moves;
+    auto run_worker = [&](size_t worker) -> void {
+        auto& game = *workers[worker];
+        for (auto index = next_branch++; index < branches.size(); index = next_branch++) {
+            const auto& branch = branches[index];
+            game.restore(from);
+            unsigned short played = 0;
+            while (played < turns && !game.is_over()) {
+                game.step(played < branch.size() ? branch[played] : no_moves);
+                played++;
+            }
+            summarize(game, played, outcomes[index]);
+        }
+    };
+
+    const auto num_workers = std::min<size_t>(workers.size(), branches.size());
+    std::vector<std::thread> pool;
+    for (size_t worker = 1; worker < num_workers; worker++) {
+        pool.emplace_back(run_worker, worker);
+    }
+    run_worker(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
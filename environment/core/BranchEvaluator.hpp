@@ -0,0 +1,94 @@
+#ifndef HALITE_BRANCHEVALUATOR_HPP
+#define HALITE_BRANCHEVALUATOR_HPP
+
+#include <memory>
+#include <vector>
+
+#include "Halite.hpp"
+
+/**
+ * Plays out alternative moves from one state of an in-process game (e.g.
+ * the candidate moves of a search bot), in parallel, and sums up how each
+ * alternative went.
+ *
+ * Each worker thread has a game of its own, built like the one being
+ * analysed, which it restores to the given snapshot before playing each
+ * branch; the game the snapshot came from isn't touched.
+ */
+class BranchEvaluator {
+public:
+    /**
+     * The moves of one branch, turn by turn: turn i is played with
+     * branch[i], and turns past the end of it with no moves. Each
+     * MoveQueue is as for Halite::step, so players past its end make no
+     * moves, and a branch can give moves for any subset of players.
+     */
+    typedef std::vector<hlt::MoveQueue> Branch;
+
+    //! How one player did in a branch, compared to the starting state.
+    struct PlayerOutcome {
+        //! Ships the player had at the start that died.
+        unsigned int ships_lost;
+        //! Ships the player has at the end that it didn't have at the start.
+        unsigned int ships_spawned;
+        unsigned int ships;
+        //! Health lost by the ships the player had at the start, counting
+        //! all of a lost ship's health.
+        unsigned int damage_taken;
+        //! Planets owned at the end, and how many of them were gained and
+        //! lost since the start.
+        unsigned int planets;
+        unsigned int planets_gained;
+        unsigned int planets_lost;
+        bool alive;
+    };
+
+    //! How a branch went.
+    struct Outcome {
+        //! Fewer than asked for if the game ended.
+        unsigned short turns_played;
+        bool game_over;
+        //! The Map::state_hash the branch ended in, e.g. to merge
+        //! transpositions.
+        uint64_t state_hash;
+        //! By the players' tags.
+        std::vector<PlayerOutcome> players;
+    };
+
+    /**
+     * Evaluate branches of in-process games built with the same arguments
+     * (see Halite's in-process constructor), on up to threads threads.
+     * Each thread's game is built here, so this costs a map generation
+     * per thread, once.
+     */
+    BranchEvaluator(unsigned short width_, unsigned short height_,
+                    unsigned int seed_, unsigned short n_players_,
+                    unsigned int threads_ = 1,
+                    const GameOptions& options_ = GameOptions{});
+
+    /**
+     * Play turns turns of each branch from the given state (see
+     * Halite::save), stopping early if the game ends, and write outcomes[i]
+     * for branches[i]. The outcomes' storage is reused from call to call.
+     */
+    auto evaluate(const Halite::Snapshot& from,
+                  const std::vector<Branch>& branches,
+                  unsigned short turns,
+                  std::vector<Outcome>& outcomes) -> void;
+
+private:
+    unsigned int threads;
+    //! One per thread. Halite isn't movable, so they are held by pointer.
+    std::vector<std::unique_ptr<Halite>> workers;
+
+    //! The ships and planet owners at the start of the branches.
+    std::vector<hlt::ShipTable> start_ships;
+    std::vector<bool> start_owned;
+    std::vector<hlt::PlayerId> start_owner;
+
+    auto record_start(const hlt::Map& map) -> void;
+    auto summarize(const Halite& game, unsigned short turns_played,
+                   Outcome& outcome) const -> void;
+};
+
+#endif //HALITE_BRANCHEVALUATOR_HPP
@@ -0,0 +1,95 @@
+#include "ConsoleLog.hpp"
+
+auto ConsoleLog::instance() -> ConsoleLog& {
+    static ConsoleLog log(std::cout);
+    return log;
+}
+
+ConsoleLog::ConsoleLog(std::ostream& output_, size_t max_queued_bytes_)
+    : output(output_), max_queued_bytes(max_queued_bytes_),
+      level(static_cast<int>(LogLevel::Info)) {
+    writer = std::thread(&ConsoleLog::run, this);
+}
+
+ConsoleLog::~ConsoleLog() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    ready.notify_one();
+    writer.join();
+}
+
+auto ConsoleLog::write(LogLevel level_, const std::string& tag, const std::string& message) -> void {
+    if (!enabled(level_)) return;
+
+    // Formatted here, so that the writer only writes
+    std::string text;
+    text.reserve(message.size() + 1);
+    size_t start = 0;
+    while (start < message.size()) {
+        auto end = message.find('\n', start);
+        if (end == std::string::npos) end = message.size();
+        if (!tag.empty()) {
+            text += '[';
+            text += tag;
+            text += "] ";
+        }
+        text.append(message, start, end - start);
+        text += '\n';
+        start = end + 1;
+    }
+    if (message.empty()) text = "\n";
+
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (queued_bytes + text.size() > max_queued_bytes && !queue.empty()) {
+            num_dropped++;
+            unreported_drops++;
+            return;
+        }
+        queued_bytes += text.size();
+        queue.push_back(std::move(text));
+        num_queued++;
+    }
+    ready.notify_one();
+}
+
+auto ConsoleLog::flush() -> void {
+    std::unique_lock<std::mutex> lock(mutex);
+    const auto target = num_queued;
+    written.wait(lock, [&]() { return num_written >= target; });
+}
+
+auto ConsoleLog::dropped() -> uint64_t {
+    std::lock_guard<std::mutex> guard(mutex);
+    return num_dropped;
+}
+
+auto ConsoleLog::run() -> void {
+    std::deque<std::string> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        ready.wait(lock, [&]() { return stopping || !queue.empty(); });
+        if (queue.empty()) return;
+
+        batch.swap(queue);
+        queued_bytes = 0;
+        const auto drops = unreported_drops;
+        unreported_drops = 0;
+        lock.unlock();
+
+        for (const auto& text : batch) {
+            output.write(text.data(), static_cast<std::streamsize>(text.size()));
+        }
+        if (drops > 0) {
+            output << "(" << drops << " console messages dropped)\n";
+        }
+        output.flush();
+
+        lock.lock();
+        num_written += batch.size();
+        batch.clear();
+        written.notify_all();
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef HALITE_CONSOLELOG_HPP
+#define HALITE_CONSOLELOG_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class LogLevel {
+    Debug,
+    //! What a game prints as it goes, e.g. "Turn 12".
+    Info,
+    //! Something went wrong with a bot (it timed out, errored or died).
+    Warning,
+    //! Something went wrong with the engine.
+    Error,
+};
+
+/**
+ * Where games print their progress and diagnostics, written out by a
+ * thread of its own, so that game and bot I/O threads neither wait on the
+ * terminal nor on each other to print.
+ *
+ * Messages are written in the order they were logged, each line prefixed
+ * with the tag it was logged with (a game's GameOptions::log_tag). The
+ * queue is bounded: a message that doesn't fit is dropped rather than
+ * waited for, and how many were dropped is printed once there is room.
+ */
+class ConsoleLog {
+public:
+    //! What may be waiting to be written before messages are dropped.
+    constexpr static size_t MAX_QUEUED_BYTES = 1 << 20;
+
+    //! The engine's, writing to std::cout.
+    static auto instance() -> ConsoleLog&;
+
+    explicit ConsoleLog(std::ostream& output_, size_t max_queued_bytes_ = MAX_QUEUED_BYTES);
+    //! Writes whatever is still queued.
+    ~ConsoleLog();
+    ConsoleLog(const ConsoleLog&) = delete;
+    auto operator=(const ConsoleLog&) -> ConsoleLog& = delete;
+
+    //! Leave out messages below the given level (Info by default).
+    auto set_level(LogLevel level_) -> void { level = static_cast<int>(level_); }
+    auto enabled(LogLevel level_) const -> bool { return static_cast<int>(level_) >= level; }
+
+    /**
+     * Queue a message of one or more lines (a final newline is optional)
+     * from any thread, without waiting for it to be written.
+     */
+    auto write(LogLevel level_, const std::string& tag, const std::string& message) -> void;
+    //! Wait until every message queued so far has been written, e.g. before
+    //! printing to the same stream directly.
+    auto flush() -> void;
+    //! The number of messages dropped so far, as the queue was full.
+    auto dropped() -> uint64_t;
+
+private:
+    std::ostream& output;
+    size_t max_queued_bytes;
+    std::atomic<int> level;
+
+    std::mutex mutex;
+    std::condition_variable ready, written;
+    std::deque<std::string> queue;
+    size_t queued_bytes = 0;
+    //! Messages queued and written so far, for flush.
+    uint64_t num_queued = 0, num_written = 0;
+    uint64_t num_dropped = 0, unreported_drops = 0;
+    bool stopping = false;
+    std::thread writer;
+
+    auto run() -> void;
+};
+
+#endif //HALITE_CONSOLELOG_HPP
@@ -4,12 +4,18 @@
 
 #include "Constants.hpp"
 
+#include <stdexcept>
+#include <string>
+
+#include "json.hpp"
+
 auto hlt::GameConstants::to_json() const -> nlohmann::json {
     return {
         { "SHIPS_PER_PLAYER", SHIPS_PER_PLAYER },
         { "PLANETS_PER_PLAYER", PLANETS_PER_PLAYER },
         { "EXTRA_PLANETS", EXTRA_PLANETS },
         { "MAX_TURNS", MAX_TURNS },
+        { "MAX_QUEUED_MOVES", MAX_QUEUED_MOVES },
 
         { "DRAG", DRAG },
         { "MAX_SPEED", MAX_SPEED },
@@ -35,6 +41,8 @@ auto hlt::GameConstants::to_json() const -> nlohmann::json {
         { "ADDITIONAL_PRODUCTIVITY", ADDITIONAL_PRODUCTIVITY },
 
         { "SPAWN_RADIUS", SPAWN_RADIUS },
+
+        { "PHYSICS_VERSION", PHYSICS_VERSION },
     };
 }
 
@@ -43,6 +51,11 @@ auto hlt::GameConstants::from_json(const nlohmann::json& json) -> void {
     PLANETS_PER_PLAYER = json.value("PLANETS_PER_PLAYER", PLANETS_PER_PLAYER);
     EXTRA_PLANETS = json.value("EXTRA_PLANETS", EXTRA_PLANETS);
     MAX_TURNS = json.value("MAX_TURNS", MAX_TURNS);
+    MAX_QUEUED_MOVES = json.value("MAX_QUEUED_MOVES", MAX_QUEUED_MOVES);
+    if (MAX_QUEUED_MOVES < 1 || MAX_QUEUED_MOVES > MAX_QUEUED_MOVES_LIMIT) {
+        throw std::invalid_argument("MAX_QUEUED_MOVES must be between 1 and " +
+                                    std::to_string(MAX_QUEUED_MOVES_LIMIT));
+    }
 
     DRAG = json.value("DRAG", DRAG);
     MAX_SPEED = json.value("MAX_SPEED", MAX_SPEED);
@@ -68,4 +81,10 @@ auto hlt::GameConstants::from_json(const nlohmann::json& json) -> void {
     ADDITIONAL_PRODUCTIVITY = json.value("ADDITIONAL_PRODUCTIVITY", ADDITIONAL_PRODUCTIVITY);
 
     SPAWN_RADIUS = json.value("SPAWN_RADIUS", SPAWN_RADIUS);
+
+    PHYSICS_VERSION = json.value("PHYSICS_VERSION", PHYSICS_VERSION);
+}
+
+auto hlt::GameConstants::is_default() const -> bool {
+    return to_json() == GameConstants{}.to_json();
 }
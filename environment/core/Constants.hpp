@@ -5,21 +5,42 @@
 #ifndef ENVIRONMENT_CONSTANTS_HPP
 #define ENVIRONMENT_CONSTANTS_HPP
 
-#include "json.hpp"
+#include "json_fwd.hpp"
 
 namespace hlt {
-    constexpr auto MAX_PLAYERS = 4;
-    constexpr auto MAX_QUEUED_MOVES = 1;
+    /**
+     * The most players a game can have. Per-player storage is sized by the
+     * game's own number of players, so a game with few players pays
+     * nothing for this being large.
+     */
+    constexpr auto MAX_PLAYERS = 16;
+    /**
+     * The most players games could have before MAX_PLAYERS was raised.
+     * Formats that always had room for this many players (the moves of
+     * JSON replays, frame checksums, batch observations) still do, so that
+     * they come out the same for these games.
+     */
+    constexpr auto CLASSIC_MAX_PLAYERS = 4;
+    //! The most GameConstants::MAX_QUEUED_MOVES may be (replays store a
+    //! move's place in its ship's queue in a byte).
+    constexpr auto MAX_QUEUED_MOVES_LIMIT = 255;
 
     /**
      * Gameplay constants that may be tweaked (though they should be at their
-     * default values in a tournament setting).
+     * default values in a tournament setting). Each game has its own (see
+     * Halite's constructors), so games with different rules can run side by
+     * side; a default-constructed GameConstants is the tournament ruleset.
      */
     struct GameConstants {
         int SHIPS_PER_PLAYER = 3;
         int PLANETS_PER_PLAYER = 6;
         unsigned int EXTRA_PLANETS = 4;
         unsigned int MAX_TURNS = 300;
+        //! Commands a ship may be given each turn. A turn is played in that
+        //! many substeps, each applying every ship's next command and
+        //! resolving what happens as ships move by their velocity; drag is
+        //! only applied after the last.
+        unsigned int MAX_QUEUED_MOVES = 1;
 
         double DRAG = 10.0;
         double MAX_SPEED = 7.0;
@@ -46,18 +67,40 @@ namespace hlt {
 
         int SPAWN_RADIUS = 2;
 
-        static auto get_mut() -> GameConstants& {
-            // Guaranteed initialized only once by C++11
-            static GameConstants instance;
-            return instance;
-        }
-
-        static auto get() -> const GameConstants& {
-            return get_mut();
-        }
+        //! Which revision of the physics is simulated. 1 slows ships down
+        //! along the angle of their velocity, as in the tournament; 2 just
+        //! scales the velocity, which needs no trigonometry but can differ
+        //! from 1 in the last bits, and so change the outcome of games.
+        unsigned int PHYSICS_VERSION = 1;
 
         auto to_json() const -> nlohmann::json;
+        //! Throws std::invalid_argument if MAX_QUEUED_MOVES is out of range.
         auto from_json(const nlohmann::json& json) -> void;
+        //! Whether every constant is at its tournament (default) value.
+        auto is_default() const -> bool;
+    };
+
+    /**
+     * Constants policies, for simulation code templated on where its
+     * constants come from. Both have a get() returning the GameConstants.
+     *
+     * With TournamentConstants, every constant is known at compile time, so
+     * kernels instantiated with it fold them in; ConfiguredConstants refers
+     * to a game's (possibly --constantsfile) values at runtime. Which one a
+     * game uses is picked once, from GameConstants::is_default.
+     */
+    struct TournamentConstants {
+        constexpr auto get() const -> GameConstants {
+            return GameConstants{};
+        }
+    };
+
+    struct ConfiguredConstants {
+        const GameConstants& constants;
+
+        auto get() const -> const GameConstants& {
+            return constants;
+        }
     };
 }
 
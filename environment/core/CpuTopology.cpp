@@ -0,0 +1,179 @@
+#include "CpuTopology.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "json.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+auto to_json(nlohmann::json& json, const CpuDomain& domain) -> void {
+    json = nlohmann::json{ { "name", domain.name }, { "cpus", domain.cpus } };
+}
+
+bool parse_cpu_list(const std::string& list, std::vector<int>& cpus) {
+    std::istringstream input(list);
+    std::string item;
+    while (std::getline(input, item, ',')) {
+        int first, last;
+        char dash;
+        std::istringstream range(item);
+        if (!(range >> first) || first < 0) return false;
+        last = first;
+        if (range >> dash && (dash != '-' || !(range >> last) || last < first)) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return true;
+}
+
+#ifdef _WIN32
+//! The CPUs of a mask of processor group 0 that the process may run on.
+static auto mask_cpus(KAFFINITY mask) -> std::vector<int> {
+    DWORD_PTR process_mask, system_mask;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+        mask &= process_mask;
+    }
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < static_cast<int>(sizeof(KAFFINITY) * 8); cpu++) {
+        if (mask & (KAFFINITY(1) << cpu)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+static auto find_domains(LOGICAL_PROCESSOR_RELATIONSHIP relationship,
+                         const std::string& prefix) -> std::vector<CpuDomain> {
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(relationship, nullptr, &length);
+    std::vector<char> buffer(length);
+    std::vector<CpuDomain> domains;
+    if (length == 0 || !GetLogicalProcessorInformationEx(
+            relationship,
+            reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()),
+            &length)) {
+        return domains;
+    }
+
+    for (DWORD offset = 0; offset < length;) {
+        const auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+            buffer.data() + offset);
+        offset += info->Size;
+        // Only group 0 (the first 64 CPUs), which a process runs in
+        // unless it asks otherwise
+        const GROUP_AFFINITY* group = nullptr;
+        if (info->Relationship == RelationCache && info->Cache.Level == 3) {
+            group = &info->Cache.GroupMask;
+        }
+        else if (info->Relationship == RelationNumaNode) {
+            group = &info->NumaNode.GroupMask;
+        }
+        if (group == nullptr || group->Group != 0) continue;
+
+        auto cpus = mask_cpus(group->Mask);
+        if (!cpus.empty()) {
+            domains.push_back(CpuDomain{ prefix + std::to_string(domains.size()), cpus });
+        }
+    }
+    return domains;
+}
+
+auto cpu_domains() -> std::vector<CpuDomain> {
+    auto domains = find_domains(RelationCache, "L3 ");
+    if (domains.empty()) {
+        domains = find_domains(RelationNumaNode, "node ");
+    }
+    return domains;
+}
+
+auto pin_thread(const std::vector<int>& cpus) -> bool {
+    DWORD_PTR mask = 0;
+    for (const auto cpu : cpus) {
+        if (cpu < static_cast<int>(sizeof(mask) * 8)) mask |= DWORD_PTR(1) << cpu;
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+#elif defined(__linux__)
+//! The CPUs of a list in sysfs (as shared_cpu_list and cpulist are
+//! written), or none if it can't be read.
+static auto read_cpu_list(const std::string& path) -> std::vector<int> {
+    std::ifstream file(path);
+    std::string list;
+    std::vector<int> cpus;
+    if (!std::getline(file, list) || !parse_cpu_list(list, cpus)) {
+        cpus.clear();
+    }
+    return cpus;
+}
+
+//! Add the domain of the given CPUs, less those the process can't run on,
+//! unless it is empty or already there.
+static auto add_domain(std::vector<CpuDomain>& domains, const std::string& prefix,
+                       std::vector<int> cpus, const cpu_set_t& allowed) -> void {
+    cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu) -> bool {
+        return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed);
+    }), cpus.end());
+    if (cpus.empty()) return;
+    for (const auto& domain : domains) {
+        if (domain.cpus == cpus) return;
+    }
+    domains.push_back(CpuDomain{ prefix + std::to_string(domains.size()), cpus });
+}
+
+auto cpu_domains() -> std::vector<CpuDomain> {
+    std::vector<CpuDomain> domains;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        return domains;
+    }
+
+    const std::string cpu_root = "/sys/devices/system/cpu/cpu";
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        // Caches are index0 up, the L3 usually last
+        for (int index = 0; ; index++) {
+            const auto cache = cpu_root + std::to_string(cpu) + "/cache/index" + std::to_string(index);
+            std::ifstream level_file(cache + "/level");
+            int level;
+            if (!(level_file >> level)) break;
+            if (level == 3) {
+                add_domain(domains, "L3 ", read_cpu_list(cache + "/shared_cpu_list"), allowed);
+                break;
+            }
+        }
+    }
+    if (!domains.empty()) return domains;
+
+    for (const auto node : read_cpu_list("/sys/devices/system/node/online")) {
+        add_domain(domains, "node ",
+                   read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"),
+                   allowed);
+    }
+    return domains;
+}
+
+auto pin_thread(const std::vector<int>& cpus) -> bool {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (const auto cpu : cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpu_set);
+    }
+    return CPU_COUNT(&cpu_set) > 0 &&
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+#else
+auto cpu_domains() -> std::vector<CpuDomain> {
+    return std::vector<CpuDomain>();
+}
+
+auto pin_thread(const std::vector<int>&) -> bool {
+    return false;
+}
+#endif
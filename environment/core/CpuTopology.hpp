@@ -0,0 +1,38 @@
+#ifndef HALITE_CPUTOPOLOGY_HPP
+#define HALITE_CPUTOPOLOGY_HPP
+
+#include <string>
+#include <vector>
+
+#include "json_fwd.hpp"
+
+/**
+ * CPUs that share a last-level cache (or failing that, a NUMA node), so
+ * that a game and its bots placed on them don't contend with games
+ * elsewhere for cache or memory bandwidth.
+ */
+struct CpuDomain {
+    //! E.g. "L3 0" or "node 1", numbered in the order found.
+    std::string name;
+    std::vector<int> cpus;
+};
+
+auto to_json(nlohmann::json& json, const CpuDomain& domain) -> void;
+
+/**
+ * The L3 cache domains of the CPUs this process may run on, or else their
+ * NUMA nodes, or else nothing (where neither can be found, e.g. on macOS).
+ */
+auto cpu_domains() -> std::vector<CpuDomain>;
+
+/**
+ * Keep the calling thread (and on Linux, the threads it starts from now
+ * on) to the given CPUs. Returns false if it can't be, e.g. where threads
+ * can't be pinned at all.
+ */
+auto pin_thread(const std::vector<int>& cpus) -> bool;
+
+//! Parse a list of CPUs and ranges of them, like "0,2-4"; empty means none.
+bool parse_cpu_list(const std::string& list, std::vector<int>& cpus);
+
+#endif //HALITE_CPUTOPOLOGY_HPP
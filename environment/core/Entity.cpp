@@ -2,13 +2,50 @@
 #include "hlt.hpp"
 
 namespace hlt {
-    auto Location::distance(const Location &other) const -> long double {
+#ifndef HALITE_FIXED_POINT
+    namespace {
+        /**
+         * cos and sin of every whole degree a ship can be commanded to
+         * thrust at, worked out once with the same expressions
+         * accelerate_by uses on the angle in radians, so that a lookup gives
+         * bit for bit the values it would. (They are filled in at startup
+         * rather than at compile time, as C++11 can't evaluate std::cos in
+         * a constant expression, and the library's own values are the ones
+         * that have to match.)
+         */
+        struct DegreeTable {
+            double cos[360];
+            double sin[360];
+
+            DegreeTable() {
+                for (unsigned int degrees = 0; degrees < 360; degrees++) {
+                    const double angle = degrees * M_PI / 180.0;
+                    cos[degrees] = std::cos(angle);
+                    sin[degrees] = std::sin(angle);
+                }
+            }
+        };
+
+        auto degree_table() -> const DegreeTable& {
+            static const DegreeTable table;
+            return table;
+        }
+    }
+#endif
+
+    auto Location::distance(const Location &other) const -> Scalar {
         return sqrt(distance2(other));
     }
 
-    auto Location::distance2(const Location &other) const -> long double {
+    auto Location::distance2(const Location &other) const -> Scalar {
+#ifdef HALITE_FIXED_POINT
+        const double dx = other.pos_x - pos_x;
+        const double dy = other.pos_y - pos_y;
+        return dx * dx + dy * dy;
+#else
         return std::pow(other.pos_x - pos_x, 2) +
             std::pow(other.pos_y - pos_y, 2);
+#endif
     }
 
     auto Location::move_by(const Velocity& velocity, double time) -> void {
@@ -35,11 +72,11 @@ namespace hlt {
     }
 
     auto Velocity::accelerate_by(double magnitude,
-                                 double angle) -> void {
+                                 double angle,
+                                 double max_speed) -> void {
         vel_x = vel_x + magnitude * std::cos(angle);
         vel_y = vel_y + magnitude * std::sin(angle);
 
-        const auto max_speed = GameConstants::get().MAX_SPEED;
         if (this->magnitude() > max_speed) {
             double scale = max_speed / this->magnitude();
             vel_x *= scale;
@@ -47,55 +84,49 @@ namespace hlt {
         }
     }
 
-    auto Velocity::magnitude() const -> long double {
-        return sqrt(vel_x * vel_x + vel_y * vel_y);
-    }
-
-    auto Velocity::angle() const -> double {
-        return atan2(vel_y, vel_x);
-    }
-
-    EntityId::EntityId() {
-        type = EntityType::InvalidEntity;
-        _player_id = -1;
-        _entity_index = -1;
-    }
-
-    auto EntityId::is_valid() const -> bool {
-        return type != EntityType::InvalidEntity &&
-            _player_id >= -1 && _entity_index >= 0;
-    }
-
-    auto EntityId::invalid() -> EntityId {
-        return EntityId();
-    }
+    auto Velocity::accelerate_toward(double magnitude,
+                                     unsigned int degrees,
+                                     double max_speed) -> void {
+#ifdef HALITE_FIXED_POINT
+        const auto direction = unit_vector_degrees(degrees);
+        vel_x += magnitude * direction.first;
+        vel_y += magnitude * direction.second;
 
-    auto EntityId::player_id() const -> PlayerId {
-        return static_cast<PlayerId>(_player_id);
-    }
+        if (this->magnitude() > max_speed) {
+            double scale = max_speed / this->magnitude();
+            vel_x *= scale;
+            vel_y *= scale;
+        }
+#else
+        // Angles of a turn or more don't come out the same in radians as
+        // the angle less a turn does, so only those below one are looked up
+        if (degrees >= 360) {
+            accelerate_by(magnitude, degrees * M_PI / 180.0, max_speed);
+            return;
+        }
+        const auto& table = degree_table();
+        vel_x = vel_x + magnitude * table.cos[degrees];
+        vel_y = vel_y + magnitude * table.sin[degrees];
 
-    auto EntityId::entity_index() const -> EntityIndex {
-        return static_cast<EntityIndex>(_entity_index);
+        if (this->magnitude() > max_speed) {
+            double scale = max_speed / this->magnitude();
+            vel_x *= scale;
+            vel_y *= scale;
+        }
+#endif
     }
 
-    auto EntityId::for_planet(EntityIndex index) -> EntityId {
-        auto result = EntityId();
-        result.type = EntityType::PlanetEntity;
-        result._entity_index = static_cast<int>(index);
-        return result;
+    auto Velocity::magnitude() const -> Scalar {
+        return sqrt(vel_x * vel_x + vel_y * vel_y);
     }
 
-    auto EntityId::for_ship(PlayerId player_id, EntityIndex index) -> EntityId {
-        auto result = EntityId();
-        result.type = EntityType::ShipEntity;
-        result._player_id = player_id;
-        result._entity_index = static_cast<int>(index);
-        return result;
+    auto Velocity::angle() const -> double {
+        return atan2(vel_y, vel_x);
     }
 
     auto operator<<(std::ostream &ostream,
                     const EntityId &id) -> std::ostream & {
-        switch (id.type) {
+        switch (id.type()) {
             case EntityType::InvalidEntity:ostream << "[Invalid ID]";
                 break;
             case EntityType::PlanetEntity:
@@ -110,76 +141,30 @@ namespace hlt {
         return ostream;
     }
 
-    auto operator==(const EntityId &id1, const EntityId &id2) -> bool {
-        return id1._player_id == id2._player_id
-            && id1._entity_index == id2._entity_index;
-    }
-
-    auto operator!=(const EntityId &id1, const EntityId &id2) -> bool {
-        return !(id1 == id2);
-    }
-
     auto Ship::reset_docking_status() -> void {
         docking_status = DockingStatus::Undocked;
         docking_progress = 0;
         docked_planet = 0;
     }
 
-    auto Ship::revive(const Location& loc) -> void {
-        health = GameConstants::get().BASE_SHIP_HEALTH;
+    auto Ship::revive(const Location& loc, const GameConstants& constants) -> void {
+        health = constants.BASE_SHIP_HEALTH;
         location = loc;
         weapon_cooldown = 0;
-        radius = GameConstants::get().SHIP_RADIUS;
+        radius = constants.SHIP_RADIUS;
         velocity = { 0, 0 };
         docking_status = DockingStatus::Undocked;
         docking_progress = 0;
         docked_planet = 0;
     }
 
-    auto Ship::output_json(const hlt::PlayerId player_id, const hlt::EntityIndex ship_idx) const -> nlohmann::json {
-        nlohmann::json docking;
-
-        switch (docking_status) {
-            case hlt::DockingStatus::Undocked:
-                docking["status"] = "undocked";
-                break;
-            case hlt::DockingStatus::Docking:
-                docking["status"] = "docking";
-                docking["planet_id"] = docked_planet;
-                docking["turns_left"] = docking_progress;
-                break;
-            case hlt::DockingStatus::Undocking:
-                docking["status"] = "undocking";
-                docking["planet_id"] = docked_planet;
-                docking["turns_left"] = docking_progress;
-                break;
-            case hlt::DockingStatus::Docked:
-                docking["status"] = "docked";
-                docking["planet_id"] = docked_planet;
-                break;
-        }
-
-        auto record = nlohmann::json{
-            { "id", ship_idx },
-            { "owner", (int) player_id },
-            { "x", location.pos_x },
-            { "y", location.pos_y },
-            { "vel_x", velocity.vel_x },
-            { "vel_y", velocity.vel_y },
-            { "health", health },
-            { "docking", docking },
-            { "cooldown", weapon_cooldown },
-        };
-
-        return record;
-    }
-
     auto Planet::add_ship(EntityIndex ship) -> void {
         assert(docked_ships.size() < docking_spots);
         docked_ships.push_back(ship);
     }
 
-    auto Planet::remove_ship(EntityIndex ship_id) -> void {
+    auto Planet::remove_ship(EntityIndex ship_id, DockingStatus status) -> void {
+        // At most docking_spots ships, kept in the order they docked in
         auto pos = std::find(
             docked_ships.begin(),
             docked_ships.end(),
@@ -187,6 +172,9 @@ namespace hlt {
         );
         if (pos != docked_ships.end()) {
             docked_ships.erase(pos);
+            if (status == DockingStatus::Docked) {
+                num_fully_docked--;
+            }
         }
 
         if (docked_ships.size() == 0) {
@@ -195,56 +183,37 @@ namespace hlt {
         }
     }
 
-    auto Planet::num_docked_ships(const Map& game_map) const -> long {
-        return std::count_if(
-            docked_ships.begin(),
-            docked_ships.end(),
-            [&](hlt::EntityIndex ship_idx) -> bool {
-                const auto& ship = game_map.get_ship(owner, ship_idx);
-                return ship.docking_status == hlt::DockingStatus::Docked;
-            }
-        );
+    auto Planet::clear_ships() -> void {
+        docked_ships.clear();
+        num_fully_docked = 0;
     }
 
-    auto Planet::output_json(const hlt::EntityIndex planet_id) const -> nlohmann::json {
-        auto record = nlohmann::json{
-            { "id", planet_id },
-            { "health", health },
-            { "docked_ships", docked_ships },
-            { "remaining_production", remaining_production },
-            { "current_production", current_production },
-        };
-
-        if (owned) {
-            record["owner"] = owner;
-        } else {
-            record["owner"] = nullptr;
-        }
-
-        return record;
+    auto Planet::ship_docked() -> void {
+        assert(num_fully_docked < docked_ships.size());
+        num_fully_docked++;
     }
 
-    auto to_json(nlohmann::json& json, const hlt::Location& location) -> void {
-        json["x"] = location.pos_x;
-        json["y"] = location.pos_y;
+    auto Planet::ship_undocking() -> void {
+        assert(num_fully_docked > 0);
+        num_fully_docked--;
     }
 
-    auto to_json(nlohmann::json& json, const hlt::EntityId& id) -> void {
-        switch (id.type) {
-            case hlt::EntityType::ShipEntity: {
-                json["type"] = "ship";
-                json["owner"] = id.player_id();
-                json["id"] = id.entity_index();
+    auto write_json(JsonWriter& json, const hlt::EntityId& id) -> void {
+        json.begin_object();
+        switch (id.type()) {
+            case hlt::EntityType::ShipEntity:
+                json.key("id").value(id.entity_index());
+                json.key("owner").value(id.player_id());
+                json.key("type").value("ship");
                 break;
-            }
             case hlt::EntityType::InvalidEntity:
-                json["type"] = "invalid";
+                json.key("type").value("invalid");
                 break;
-            case hlt::EntityType::PlanetEntity: {
-                json["type"] = "planet";
-                json["id"] = id.entity_index();
+            case hlt::EntityType::PlanetEntity:
+                json.key("id").value(id.entity_index());
+                json.key("type").value("planet");
                 break;
-            }
         }
+        json.end_object();
     }
 }
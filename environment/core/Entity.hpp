@@ -11,13 +11,16 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <utility>
 #include <vector>
 
 #include "Constants.hpp"
+#include "FixedPoint.hpp"
+#include "JsonWriter.hpp"
 
-#include "json.hpp"
+#include "json_fwd.hpp"
 
 namespace hlt {
     /**
@@ -39,11 +42,42 @@ namespace hlt {
     template<typename T>
     using possibly = std::pair<T, bool>;
 
+    /**
+     * The floating point type used for positions and velocities.
+     *
+     * By default this is long double, which matches the engine's historical
+     * results on x86 (80-bit x87 arithmetic), but is slow and is only 64 bits
+     * wide with MSVC and on most ARM targets. Defining
+     * HALITE_DOUBLE_PRECISION (the CMake option of the same name) switches
+     * to double, which is much faster and, as the build also disables
+     * floating point contraction, gives bit-identical results for the same
+     * binary on the same platform. Games played in the two modes may
+     * diverge from each other.
+     *
+     * HALITE_FIXED_POINT instead stores them as Fixed, 32.32 fixed point,
+     * and keeps the C library's trigonometry out of the simulation: thrust
+     * directions come from a table, drag always scales the velocity (as
+     * PHYSICS_VERSION 2), and the terms of the collision quadratic are
+     * exact integers. Games then play out the same on any platform with
+     * IEEE 754 doubles, x86 and ARM alike, but again not the same as in
+     * the other modes. This needs __int128 (GCC or Clang).
+     */
+#if defined(HALITE_FIXED_POINT)
+    typedef Fixed Scalar;
+#elif defined(HALITE_DOUBLE_PRECISION)
+    typedef double Scalar;
+#else
+    typedef long double Scalar;
+#endif
+
     struct Velocity {
-        long double vel_x, vel_y;
+        Scalar vel_x, vel_y;
 
-        auto accelerate_by(double magnitude, double angle) -> void;
-        auto magnitude() const -> long double;
+        //! Add thrust, then slow down to max_speed if over it.
+        auto accelerate_by(double magnitude, double angle, double max_speed) -> void;
+        //! accelerate_by, with the angle in degrees, as ships are commanded.
+        auto accelerate_toward(double magnitude, unsigned int degrees, double max_speed) -> void;
+        auto magnitude() const -> Scalar;
         auto angle() const -> double;
     };
 
@@ -51,10 +85,10 @@ namespace hlt {
      * A location in Halatian space.
      */
     struct Location {
-        long double pos_x, pos_y;
+        Scalar pos_x, pos_y;
 
-        auto distance(const Location& other) const -> long double;
-        auto distance2(const Location& other) const -> long double;
+        auto distance(const Location& other) const -> Scalar;
+        auto distance2(const Location& other) const -> Scalar;
 
         auto move_by(const Velocity& velocity, double time) -> void;
         auto angle_to(const Location& target) const -> double;
@@ -84,8 +118,8 @@ namespace hlt {
             return health > 0;
         }
 
-        auto heal(unsigned short points) -> void {
-            health = std::min(GameConstants::get().MAX_SHIP_HEALTH,
+        auto heal(unsigned short points, const GameConstants& constants) -> void {
+            health = std::min(constants.MAX_SHIP_HEALTH,
                               static_cast<unsigned short>(health + points));
         }
 
@@ -131,27 +165,41 @@ namespace hlt {
         //! Contains IDs of all ships in the process of docking or undocking,
         //! as well as docked ships.
         std::vector<EntityIndex> docked_ships;
+        //! How many of docked_ships are fully docked. Kept up to date as ships
+        //! change state, so production needn't look the ships up.
+        unsigned short num_fully_docked;
 
-        Planet(double x, double y, double radius) {
+        Planet(double x, double y, double radius, const GameConstants& constants) {
             location.pos_x = x;
             location.pos_y = y;
             this->radius = radius;
             docking_spots = static_cast<unsigned short>(std::max(1.0, std::ceil(radius / 3.0)));
             remaining_production = static_cast<unsigned short>(
-                radius * GameConstants::get().RESOURCES_PER_RADIUS);
+                radius * constants.RESOURCES_PER_RADIUS);
             current_production = 0;
             health = static_cast<unsigned short>(
-                radius * GameConstants::get().MAX_SHIP_HEALTH);
+                radius * constants.MAX_SHIP_HEALTH);
             docked_ships = std::vector<EntityIndex>();
+            num_fully_docked = 0;
 
             owned = false;
             frozen = false;
         }
 
+        //! Add a ship that starts docking.
         auto add_ship(EntityIndex ship) -> void;
-        auto remove_ship(EntityIndex ship) -> void;
-        auto num_docked_ships(const Map& game_map) const -> long;
-        auto output_json(const hlt::EntityIndex planet_id) const -> nlohmann::json;
+        //! Remove a ship, which had the given status until now.
+        auto remove_ship(EntityIndex ship, DockingStatus status) -> void;
+        //! Remove every ship.
+        auto clear_ships() -> void;
+        //! Record that one of docked_ships finished docking.
+        auto ship_docked() -> void;
+        //! Record that one of docked_ships started undocking.
+        auto ship_undocking() -> void;
+        //! The number of fully docked ships.
+        auto num_docked_ships() const -> long {
+            return num_fully_docked;
+        }
     };
 
     struct Ship : Entity {
@@ -168,18 +216,16 @@ namespace hlt {
         EntityIndex docked_planet;
 
         auto reset_docking_status() -> void;
-        auto revive(const Location& loc) -> void;
-        auto output_json(
-            const hlt::PlayerId player_id,
-            const hlt::EntityIndex ship_idx) const -> nlohmann::json;
+        //! Reset to a new ship at the given location.
+        auto revive(const Location& loc, const GameConstants& constants) -> void;
 
         /**
          * Check if this ship is close enough to dock to the given planet.
          * @param planet
          * @return
          */
-        auto can_dock(const Planet& planet) const -> bool {
-            const auto dock_radius = GameConstants::get().DOCK_RADIUS + planet.radius + radius;
+        auto can_dock(const Planet& planet, const GameConstants& constants) const -> bool {
+            const auto dock_radius = constants.DOCK_RADIUS + planet.radius + radius;
             return docking_status == DockingStatus::Undocked &&
                 velocity.vel_x == 0.0 &&
                 velocity.vel_y == 0.0 &&
@@ -197,47 +243,90 @@ namespace hlt {
         PlanetEntity,
     };
 
-    //! A way to uniquely identify an Entity, regardless of its type.
+    /**
+     * A way to uniquely identify an Entity, regardless of its type.
+     *
+     * Packed into one integer, so that comparing and hashing IDs is a
+     * single integer operation: the owner of a ship, plus one, in the high
+     * 32 bits (zero for planets), and the entity index, plus one, in the
+     * low 32 bits (zero for an invalid ID). The packed values sort in the
+     * order operator< has always used: planets first, then ships by owner
+     * and index.
+     */
     struct EntityId {
     private:
-        //! Planets are unowned, and have player ID == -1.
-        int _player_id;
-        int _entity_index;
-        EntityId();
+        uint64_t packed;
+
+        constexpr explicit EntityId(uint64_t packed_) : packed(packed_) {}
 
     public:
-        EntityType type;
+        constexpr auto type() const -> EntityType {
+            return (packed >> 32) != 0 ? EntityType::ShipEntity
+                : packed != 0 ? EntityType::PlanetEntity
+                : EntityType::InvalidEntity;
+        }
 
-        auto is_valid() const -> bool;
+        constexpr auto is_valid() const -> bool {
+            return static_cast<uint32_t>(packed) != 0;
+        }
 
-        auto player_id() const -> PlayerId;
-        auto entity_index() const -> EntityIndex;
+        //! The owner of a ship (255 for a planet).
+        constexpr auto player_id() const -> PlayerId {
+            return static_cast<PlayerId>((packed >> 32) - 1);
+        }
+        constexpr auto entity_index() const -> EntityIndex {
+            return static_cast<EntityIndex>(
+                static_cast<int32_t>(static_cast<uint32_t>(packed) - 1));
+        }
 
         //! Construct an entity ID representing an invalid entity.
-        static auto invalid() -> EntityId;
+        static constexpr auto invalid() -> EntityId {
+            return EntityId(0);
+        }
         //! Construct an entity ID for the given planet.
-        static auto for_planet(EntityIndex index) -> EntityId;
+        static constexpr auto for_planet(EntityIndex index) -> EntityId {
+            return EntityId(static_cast<uint32_t>(index + 1));
+        }
         //! Construct an entity ID for the given ship.
-        static auto for_ship(PlayerId player_id, EntityIndex index) -> EntityId;
+        static constexpr auto for_ship(PlayerId player_id, EntityIndex index) -> EntityId {
+            return EntityId((static_cast<uint64_t>(player_id) + 1) << 32
+                            | static_cast<uint32_t>(index + 1));
+        }
 
         friend auto operator<< (std::ostream& ostream, const EntityId& id) -> std::ostream&;
-        friend auto operator== (const EntityId& id1, const EntityId& id2) -> bool;
-        friend auto operator!= (const EntityId& id1, const EntityId& id2) -> bool;
+        friend constexpr auto operator== (const EntityId& id1, const EntityId& id2) -> bool {
+            return id1.packed == id2.packed;
+        }
+        friend constexpr auto operator!= (const EntityId& id1, const EntityId& id2) -> bool {
+            return id1.packed != id2.packed;
+        }
+        //! An arbitrary but fixed total order, for sorting.
+        friend constexpr auto operator< (const EntityId& id1, const EntityId& id2) -> bool {
+            return id1.packed < id2.packed;
+        }
 
         friend struct std::hash<EntityId>;
     };
 
     auto to_json(nlohmann::json& json, const hlt::EntityId& id) -> void;
     auto to_json(nlohmann::json& json, const hlt::Location& location) -> void;
+    //! Write the same JSON as to_json.
+    auto write_json(JsonWriter& json, const hlt::EntityId& id) -> void;
 }
 
 namespace std {
     template<> struct hash<hlt::EntityId> {
     public:
+        //! The packed ID, mixed (with the MurmurHash3 finalizer) so that
+        //! owners and indices spread over all the bits.
         auto operator()(const hlt::EntityId& id) const -> size_t {
-            return static_cast<size_t>(
-                (id._entity_index << 8) |
-                    (id._player_id & 0xFF));
+            uint64_t hash = id.packed;
+            hash ^= hash >> 33;
+            hash *= 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 33;
+            hash *= 0xc4ceb9fe1a85ec53ULL;
+            hash ^= hash >> 33;
+            return static_cast<size_t>(hash);
         }
     };
 }
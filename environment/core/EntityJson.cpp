@@ -0,0 +1,57 @@
+#include "FrameHistory.hpp"
+#include "hlt.hpp"
+
+#include "json.hpp"
+
+// The nlohmann::json conversions of the entities, kept apart from the rest
+// of their code so that the simulation doesn't have to include json.hpp.
+namespace hlt {
+    auto to_json(nlohmann::json& json, const Fixed& value) -> void {
+        json = static_cast<double>(value);
+    }
+
+    auto to_json(nlohmann::json& json, const hlt::Location& location) -> void {
+        json["x"] = location.pos_x;
+        json["y"] = location.pos_y;
+    }
+
+    auto to_json(nlohmann::json& json, const hlt::EntityId& id) -> void {
+        switch (id.type()) {
+            case hlt::EntityType::ShipEntity: {
+                json["type"] = "ship";
+                json["owner"] = id.player_id();
+                json["id"] = id.entity_index();
+                break;
+            }
+            case hlt::EntityType::InvalidEntity:
+                json["type"] = "invalid";
+                break;
+            case hlt::EntityType::PlanetEntity: {
+                json["type"] = "planet";
+                json["id"] = id.entity_index();
+                break;
+            }
+        }
+    }
+
+    auto Move::output_json(hlt::PlayerId player_id, int move_no) const -> nlohmann::json {
+        std::string text;
+        JsonWriter json(text);
+        write_json(json, player_id, move_no);
+        return nlohmann::json::parse(text);
+    }
+
+    auto ShipSnapshot::output_json() const -> nlohmann::json {
+        std::string text;
+        JsonWriter json(text);
+        write_json(json);
+        return nlohmann::json::parse(text);
+    }
+
+    auto PlanetSnapshot::output_json() const -> nlohmann::json {
+        std::string text;
+        JsonWriter json(text);
+        write_json(json);
+        return nlohmann::json::parse(text);
+    }
+}
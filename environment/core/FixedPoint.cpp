@@ -0,0 +1,48 @@
+#include "FixedPoint.hpp"
+
+namespace hlt {
+    //! sin(d degrees) * 2^32 for d from 0 to 90, correctly rounded.
+    static const int64_t SINE_TABLE[91] = {
+        0, 74957515, 149892197, 224781220,
+        299601773, 374331065, 448946331, 523424844,
+        597743917, 671880911, 745813244, 819518395,
+        892973913, 966157422, 1039046630, 1111619334,
+        1183853429, 1255726910, 1327217885, 1398304576,
+        1468965330, 1539178623, 1608923068, 1678177418,
+        1746920580, 1815131613, 1882789739, 1949874349,
+        2016365009, 2082241464, 2147483648, 2212071688,
+        2275985909, 2339206844, 2401715233, 2463492036,
+        2524518436, 2584775843, 2644245902, 2702910498,
+        2760751762, 2817752074, 2873894071, 2929160652,
+        2983534983, 3037000500, 3089540917, 3141140230,
+        3191782722, 3241452965, 3290135830, 3337816489,
+        3384480416, 3430113397, 3474701533, 3518231241,
+        3560689261, 3602062661, 3642338838, 3681505524,
+        3719550787, 3756463039, 3792231035, 3826843882,
+        3860291035, 3892562305, 3923647864, 3953538241,
+        3982224333, 4009697400, 4035949075, 4060971360,
+        4084756634, 4107297652, 4128587547, 4148619834,
+        4167388412, 4184887562, 4201111956, 4216056650,
+        4229717092, 4242089121, 4253168970, 4262953261,
+        4271439016, 4278623649, 4284504972, 4289081193,
+        4292350918, 4294313152, 4294967296,
+    };
+
+    auto unit_vector_degrees(unsigned int degrees) -> std::pair<Fixed, Fixed> {
+        degrees %= 360;
+        // Fold every angle into the first quadrant
+        const auto quadrant_angle = degrees % 90;
+        const auto sine = SINE_TABLE[quadrant_angle];
+        const auto cosine = SINE_TABLE[90 - quadrant_angle];
+        switch (degrees / 90) {
+            case 0:
+                return { Fixed::from_raw(cosine), Fixed::from_raw(sine) };
+            case 1:
+                return { Fixed::from_raw(-sine), Fixed::from_raw(cosine) };
+            case 2:
+                return { Fixed::from_raw(-cosine), Fixed::from_raw(-sine) };
+            default:
+                return { Fixed::from_raw(sine), Fixed::from_raw(-cosine) };
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef HALITE_FIXEDPOINT_HPP
+#define HALITE_FIXEDPOINT_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+#include "json_fwd.hpp"
+
+namespace hlt {
+    /**
+     * A 32.32 fixed point number: a signed count of 2^-32ths.
+     *
+     * This is the Scalar of HALITE_FIXED_POINT builds (see Entity.hpp). It
+     * reads as a double, so that expressions mixing it with doubles keep
+     * compiling unchanged; those are evaluated in double precision, and
+     * their result is rounded to the nearest 2^-32th when stored back. Any
+     * value below 2^21 in magnitude converts to a double exactly, so as
+     * long as the arithmetic on the way is limited to what IEEE 754 rounds
+     * correctly (+, -, *, / and sqrt), the stored state is the same on
+     * every platform.
+     */
+    class Fixed {
+    public:
+        constexpr static int FRACTION_BITS = 32;
+        constexpr static double ONE = 4294967296.0;
+
+        //! Uninitialized, like a double.
+        Fixed() = default;
+        Fixed(double value) : raw_value(to_raw(value)) {}
+
+        static auto from_raw(int64_t raw) -> Fixed {
+            Fixed result;
+            result.raw_value = raw;
+            return result;
+        }
+
+        auto raw() const -> int64_t { return raw_value; }
+
+        operator double() const {
+            return static_cast<double>(raw_value) / ONE;
+        }
+
+        auto operator=(double value) -> Fixed& {
+            raw_value = to_raw(value);
+            return *this;
+        }
+        //! Adding is exact, the value added being rounded first.
+        auto operator+=(double value) -> Fixed& {
+            raw_value += to_raw(value);
+            return *this;
+        }
+        auto operator-=(double value) -> Fixed& {
+            raw_value -= to_raw(value);
+            return *this;
+        }
+        auto operator*=(double value) -> Fixed& {
+            return *this = static_cast<double>(*this) * value;
+        }
+        auto operator/=(double value) -> Fixed& {
+            return *this = static_cast<double>(*this) / value;
+        }
+
+    private:
+        int64_t raw_value;
+
+        //! To the nearest, ties to even (the default rounding mode), in
+        //! a single instruction where llround would be a library call.
+        static auto to_raw(double value) -> int64_t {
+            return std::llrint(value * ONE);
+        }
+    };
+
+    auto to_json(nlohmann::json& json, const Fixed& value) -> void;
+
+    /**
+     * The cosine and sine of a whole number of degrees, rounded to the
+     * nearest 2^-32th from a table rather than computed by the C library,
+     * whose last bits differ between platforms.
+     */
+    auto unit_vector_degrees(unsigned int degrees) -> std::pair<Fixed, Fixed>;
+}
+
+#endif //HALITE_FIXEDPOINT_HPP
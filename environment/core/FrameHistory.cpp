@@ -0,0 +1,294 @@
+#include "FrameHistory.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace hlt {
+    auto ShipSnapshot::write_json(JsonWriter& json) const -> void {
+        // Keys in sorted order, as a nlohmann::json object keeps them
+        json.begin_object();
+        json.key("cooldown").value(weapon_cooldown);
+        json.key("docking").begin_object();
+        switch (docking_status) {
+            case hlt::DockingStatus::Undocked:
+                json.key("status").value("undocked");
+                break;
+            case hlt::DockingStatus::Docking:
+                json.key("planet_id").value(docked_planet);
+                json.key("status").value("docking");
+                json.key("turns_left").value(docking_progress);
+                break;
+            case hlt::DockingStatus::Undocking:
+                json.key("planet_id").value(docked_planet);
+                json.key("status").value("undocking");
+                json.key("turns_left").value(docking_progress);
+                break;
+            case hlt::DockingStatus::Docked:
+                json.key("planet_id").value(docked_planet);
+                json.key("status").value("docked");
+                break;
+        }
+        json.end_object();
+        json.key("health").value(health);
+        json.key("id").value(id);
+        json.key("owner").value(static_cast<int>(owner));
+        json.key("vel_x").value(vel_x);
+        json.key("vel_y").value(vel_y);
+        json.key("x").value(x);
+        json.key("y").value(y);
+        json.end_object();
+    }
+
+    auto ShipSnapshot::same_json(const ShipSnapshot& other) const -> bool {
+        if (docking_status != other.docking_status) return false;
+        if (docking_status != hlt::DockingStatus::Undocked &&
+            docked_planet != other.docked_planet) return false;
+        if ((docking_status == hlt::DockingStatus::Docking ||
+             docking_status == hlt::DockingStatus::Undocking) &&
+            docking_progress != other.docking_progress) return false;
+        return weapon_cooldown == other.weapon_cooldown &&
+            health == other.health && id == other.id && owner == other.owner &&
+            vel_x == other.vel_x && vel_y == other.vel_y &&
+            x == other.x && y == other.y;
+    }
+
+    auto PlanetSnapshot::write_json(JsonWriter& json) const -> void {
+        json.begin_object();
+        json.key("current_production").value(current_production);
+        json.key("docked_ships").begin_array();
+        for (uint32_t i = 0; i < num_docked; i++) {
+            json.value(docked_ships[i]);
+        }
+        json.end_array();
+        json.key("health").value(health);
+        json.key("id").value(id);
+        json.key("owner");
+        if (owned) {
+            json.value(owner);
+        } else {
+            json.null();
+        }
+        json.key("remaining_production").value(remaining_production);
+        json.end_object();
+    }
+
+    auto PlanetSnapshot::same_json(const PlanetSnapshot& other) const -> bool {
+        // Frames share the snapshots of planets that didn't change
+        if (this == &other) return true;
+        if (owned != other.owned || (owned && owner != other.owner)) return false;
+        return current_production == other.current_production &&
+            health == other.health && id == other.id &&
+            remaining_production == other.remaining_production &&
+            same_docked_ships(other);
+    }
+
+    auto PlanetSnapshot::same_docked_ships(const PlanetSnapshot& other) const -> bool {
+        return num_docked == other.num_docked &&
+            (docked_ships == other.docked_ships ||
+             std::equal(docked_ships, docked_ships + num_docked, other.docked_ships));
+    }
+
+    namespace {
+        //! One step of FNV-1a, a byte at a time.
+        template<typename T>
+        auto hash_value(uint32_t hash, T value) -> uint32_t {
+            unsigned char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            for (const auto byte : bytes) {
+                hash = (hash ^ byte) * 16777619u;
+            }
+            return hash;
+        }
+    }
+
+    auto FrameHistory::Frame::checksum() const -> uint32_t {
+        uint32_t hash = 2166136261u;
+        // Every game had room for CLASSIC_MAX_PLAYERS, whose counts were
+        // hashed whether they played or not
+        const auto hashed_players = std::max<int>(num_players, CLASSIC_MAX_PLAYERS);
+        for (PlayerId player = 0; player < hashed_players; player++) {
+            // The count separates the players' ships
+            hash = hash_value(hash, static_cast<uint32_t>(player_ships(player).size()));
+            for (const auto& ship : player_ships(player)) {
+                hash = hash_value(hash, ship.id);
+                hash = hash_value(hash, ship.x);
+                hash = hash_value(hash, ship.y);
+                hash = hash_value(hash, ship.vel_x);
+                hash = hash_value(hash, ship.vel_y);
+                hash = hash_value(hash, ship.health);
+                hash = hash_value(hash, ship.weapon_cooldown);
+                hash = hash_value(hash, static_cast<int>(ship.docking_status));
+                // Like the replay, skip what the status leaves meaningless
+                if (ship.docking_status != DockingStatus::Undocked) {
+                    hash = hash_value(hash, ship.docked_planet);
+                    hash = hash_value(hash, ship.docking_progress);
+                }
+            }
+        }
+        for (const auto& planet : living_planets()) {
+            hash = hash_value(hash, planet.id);
+            hash = hash_value(hash, planet.health);
+            hash = hash_value(hash, planet.owned);
+            if (planet.owned) {
+                hash = hash_value(hash, planet.owner);
+            }
+            hash = hash_value(hash, planet.remaining_production);
+            hash = hash_value(hash, planet.current_production);
+            hash = hash_value(hash, planet.num_docked);
+            for (uint32_t i = 0; i < planet.num_docked; i++) {
+                hash = hash_value(hash, planet.docked_ships[i]);
+            }
+        }
+        return hash;
+    }
+
+    auto FrameHistory::keep_latest_only() -> void {
+        latest_only = true;
+        frames.clear();
+        first_planets.clear();
+        clear_arenas();
+    }
+
+    auto FrameHistory::keep_summaries_only() -> void {
+        if (summarized) return;
+        summaries.reserve(frames.size());
+        for (const auto& frame : frames) {
+            summaries.push_back(Summary{ frame.state_hash, frame.checksum() });
+        }
+        summarized = true;
+        std::vector<Frame>().swap(frames);
+        clear_arenas();
+    }
+
+    auto FrameHistory::clear_arenas() -> void {
+        ship_arena.clear();
+        planet_arena.clear();
+        planet_list_arena.clear();
+        docked_arena.clear();
+        offset_arena.clear();
+        latest_planets.clear();
+    }
+
+    auto FrameHistory::state_hash(size_t index) const -> uint64_t {
+        return summarized ? summaries[index].state_hash : frames[index].state_hash;
+    }
+
+    auto FrameHistory::checksum(size_t index) const -> uint32_t {
+        return summarized ? summaries[index].checksum : frames[index].checksum();
+    }
+
+    auto FrameHistory::memory_usage() const -> size_t {
+        return frames.capacity() * sizeof(Frame) +
+            summaries.capacity() * sizeof(Summary) +
+            first_planets.capacity() * sizeof(Planet) +
+            latest_planets.capacity() * sizeof(const PlanetSnapshot*) +
+            ship_arena.memory_usage() + planet_arena.memory_usage() +
+            planet_list_arena.memory_usage() +
+            docked_arena.memory_usage() + offset_arena.memory_usage();
+    }
+
+    auto FrameHistory::record(const Map& map) -> void {
+        if (latest_only || summarized) {
+            frames.clear();
+            clear_arenas();
+        }
+        else if (frames.empty()) {
+            first_planets = map.planets;
+        }
+
+        Frame frame;
+        size_t num_ships = 0;
+        for (const auto& player_ships : map.ships) {
+            num_ships += player_ships.size();
+        }
+        auto ships = ship_arena.allocate(num_ships);
+        frame.ships = ships;
+
+        frame.num_players = map.player_count();
+        auto ship_offsets = offset_arena.allocate(frame.num_players + 1u);
+        frame.ship_offsets = ship_offsets;
+
+        uint32_t ship_offset = 0;
+        for (PlayerId player = 0; player < frame.num_players; player++) {
+            ship_offsets[player] = ship_offset;
+            for (const auto& ship_pair : map.ships[player]) {
+                const auto& ship = ship_pair.second;
+                auto& snapshot = ships[ship_offset++];
+                snapshot.x = static_cast<double>(ship.location.pos_x);
+                snapshot.y = static_cast<double>(ship.location.pos_y);
+                snapshot.vel_x = static_cast<double>(ship.velocity.vel_x);
+                snapshot.vel_y = static_cast<double>(ship.velocity.vel_y);
+                snapshot.id = static_cast<uint32_t>(ship_pair.first);
+                snapshot.docked_planet = static_cast<uint32_t>(ship.docked_planet);
+                snapshot.docking_progress = ship.docking_progress;
+                snapshot.weapon_cooldown = ship.weapon_cooldown;
+                snapshot.health = ship.health;
+                snapshot.owner = player;
+                snapshot.docking_status = ship.docking_status;
+            }
+        }
+        ship_offsets[frame.num_players] = ship_offset;
+
+        latest_planets.resize(map.planets.size(), nullptr);
+        const auto previous_list = frames.empty() ? nullptr : frames.back().planets;
+        const auto previous_count = frames.empty() ? 0 : frames.back().num_planets;
+
+        // Look up the snapshot of each living planet, making a new one
+        // if it changed, into the list scratch space
+        planet_list.clear();
+        for (EntityIndex planet_index = 0; planet_index < map.planets.size(); planet_index++) {
+            const auto& planet = map.planets[planet_index];
+            auto& latest = latest_planets[planet_index];
+            if (!planet.is_alive()) {
+                latest = nullptr;
+                continue;
+            }
+
+            PlanetSnapshot snapshot;
+            snapshot.id = static_cast<uint32_t>(planet_index);
+            snapshot.num_docked = static_cast<uint16_t>(planet.docked_ships.size());
+            snapshot.health = planet.health;
+            snapshot.remaining_production = planet.remaining_production;
+            snapshot.current_production = planet.current_production;
+            snapshot.owner = planet.owner;
+            snapshot.owned = planet.owned;
+            docked_scratch.clear();
+            for (const auto ship_index : planet.docked_ships) {
+                docked_scratch.push_back(static_cast<uint32_t>(ship_index));
+            }
+            snapshot.docked_ships = docked_scratch.data();
+
+            if (latest == nullptr || !latest->same_json(snapshot)) {
+                if (latest != nullptr && latest->same_docked_ships(snapshot)) {
+                    snapshot.docked_ships = latest->docked_ships;
+                }
+                else {
+                    auto docked_ships = docked_arena.allocate(snapshot.num_docked);
+                    std::copy(docked_scratch.begin(), docked_scratch.end(), docked_ships);
+                    snapshot.docked_ships = docked_ships;
+                }
+                auto stored = planet_arena.allocate(1);
+                *stored = snapshot;
+                latest = stored;
+            }
+            planet_list.push_back(latest);
+        }
+
+        frame.num_planets = static_cast<uint32_t>(planet_list.size());
+        if (previous_list != nullptr && previous_count == planet_list.size() &&
+            std::equal(planet_list.begin(), planet_list.end(), previous_list)) {
+            frame.planets = previous_list;
+        }
+        else {
+            auto planets = planet_list_arena.allocate(planet_list.size());
+            std::copy(planet_list.begin(), planet_list.end(), planets);
+            frame.planets = planets;
+        }
+
+        frame.state_hash = map.state_hash();
+        frames.push_back(frame);
+        if (summarized) {
+            summaries.push_back(Summary{ frame.state_hash, frame.checksum() });
+        }
+    }
+}
@@ -0,0 +1,317 @@
+#ifndef HALITE_FRAMEHISTORY_HPP
+#define HALITE_FRAMEHISTORY_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "json_fwd.hpp"
+
+#include "Constants.hpp"
+#include "Entity.hpp"
+#include "JsonWriter.hpp"
+#include "hlt.hpp"
+
+namespace hlt {
+    /**
+     * Append-only storage that grows by chunks instead of reallocating, so
+     * that adding to it never copies what is already there (or needs twice
+     * its memory while doing so). Elements never move.
+     */
+    template<typename T>
+    class ChunkedArena {
+    public:
+        //! Chunks hold at least this many elements.
+        constexpr static size_t CHUNK_SIZE = 4096;
+
+        //! Space for n contiguous elements.
+        auto allocate(size_t n) -> T* {
+            if (chunks.empty() || chunks.back().used + n > chunks.back().capacity) {
+                const size_t capacity = n > CHUNK_SIZE ? n : CHUNK_SIZE;
+                chunks.push_back(Chunk{ std::unique_ptr<T[]>(new T[capacity]), capacity, 0 });
+                reserved += capacity;
+            }
+            auto& chunk = chunks.back();
+            const auto result = chunk.data.get() + chunk.used;
+            chunk.used += n;
+            return result;
+        }
+
+        //! Forget every element, keeping the last chunk to allocate from
+        //! again. Invalidates everything allocated so far.
+        auto clear() -> void {
+            if (chunks.size() > 1) {
+                chunks.erase(chunks.begin(), chunks.end() - 1);
+            }
+            if (!chunks.empty()) {
+                chunks.back().used = 0;
+                reserved = chunks.back().capacity;
+            }
+        }
+
+        //! The memory held by the chunks, in bytes.
+        auto memory_usage() const -> size_t {
+            return reserved * sizeof(T) + chunks.capacity() * sizeof(Chunk);
+        }
+
+    private:
+        struct Chunk {
+            std::unique_ptr<T[]> data;
+            size_t capacity;
+            size_t used;
+        };
+        std::vector<Chunk> chunks;
+        //! The elements the chunks have room for.
+        size_t reserved = 0;
+    };
+
+    /**
+     * The state of a ship at the end of a turn, as recorded for replays.
+     * Positions and velocities are doubles, which is what replays have
+     * always stored.
+     */
+    struct ShipSnapshot {
+        double x, y;
+        double vel_x, vel_y;
+        uint32_t id;
+        //! Only meaningful if the ship is not undocked.
+        uint32_t docked_planet;
+        uint32_t docking_progress;
+        uint32_t weapon_cooldown;
+        uint16_t health;
+        PlayerId owner;
+        DockingStatus docking_status;
+
+        //! The ship as recorded in replay frames and player logs.
+        auto write_json(JsonWriter& json) const -> void;
+        auto output_json() const -> nlohmann::json;
+        //! Whether both ships write the same JSON.
+        auto same_json(const ShipSnapshot& other) const -> bool;
+    };
+
+    /**
+     * The state of a living planet at the end of a turn. Its position and
+     * size don't change, so they are only in FrameHistory::initial_planets.
+     * Frames in which a planet didn't change share its snapshot, and
+     * snapshots whose docked ships didn't change share their list.
+     */
+    struct PlanetSnapshot {
+        //! The IDs of the num_docked ships docked to the planet.
+        const uint32_t* docked_ships;
+        uint32_t id;
+        uint16_t num_docked;
+        uint16_t health;
+        uint16_t remaining_production;
+        uint16_t current_production;
+        PlayerId owner;
+        bool owned;
+
+        auto write_json(JsonWriter& json) const -> void;
+        auto output_json() const -> nlohmann::json;
+        //! Whether both planets write the same JSON.
+        auto same_json(const PlanetSnapshot& other) const -> bool;
+        //! Whether both planets have the same ships docked, in order.
+        auto same_docked_ships(const PlanetSnapshot& other) const -> bool;
+    };
+
+    //! A pair of pointers that can be iterated over.
+    template<typename T>
+    struct Span {
+        const T* first;
+        const T* last;
+
+        auto begin() const -> const T* { return first; }
+        auto end() const -> const T* { return last; }
+        auto size() const -> size_t { return static_cast<size_t>(last - first); }
+    };
+
+    //! Like Span, over an array of pointers, iterating over what they
+    //! point to.
+    template<typename T>
+    struct IndirectSpan {
+        struct Iterator {
+            const T* const* at;
+
+            auto operator*() const -> const T& { return **at; }
+            auto operator++() -> Iterator& { ++at; return *this; }
+            auto operator!=(const Iterator& other) const -> bool { return at != other.at; }
+        };
+
+        const T* const* first;
+        const T* const* last;
+
+        auto begin() const -> Iterator { return { first }; }
+        auto end() const -> Iterator { return { last }; }
+        auto size() const -> size_t { return static_cast<size_t>(last - first); }
+    };
+
+    /**
+     * The game state at the end of every turn, for the replay and the
+     * player logs. Frames are packed into arenas rather than kept as copies
+     * of the whole Map (each with its own hash tables), since this is
+     * most of the memory a game uses. Most planets don't change from one
+     * turn to the next, so a frame only points to the snapshot of each
+     * planet, and a new snapshot is only made once the planet's health,
+     * owner, production or docked ships change. A frame in which no
+     * planet changed shares the previous frame's whole list.
+     */
+    class FrameHistory {
+    public:
+        struct Frame {
+            //! Grouped by owner, then in the order of Map::ships.
+            const ShipSnapshot* ships;
+            //! The ships of player p are ships[ship_offsets[p]] up to
+            //! ships[ship_offsets[p + 1]], for num_players + 1 offsets.
+            const uint32_t* ship_offsets;
+            PlayerId num_players;
+            //! Only the living planets, by ID.
+            const PlanetSnapshot* const* planets;
+            uint32_t num_planets;
+            //! Map::state_hash of the map recorded.
+            uint64_t state_hash;
+
+            auto all_ships() const -> Span<ShipSnapshot> {
+                return { ships, ships + ship_offsets[num_players] };
+            }
+            //! Empty for players past the game's.
+            auto player_ships(PlayerId player) const -> Span<ShipSnapshot> {
+                if (player >= num_players) return { ships, ships };
+                return { ships + ship_offsets[player], ships + ship_offsets[player + 1] };
+            }
+            auto living_planets() const -> IndirectSpan<PlanetSnapshot> {
+                return { planets, planets + num_planets };
+            }
+
+            /**
+             * A 32-bit FNV-1a hash of everything recorded about the ships
+             * and planets, positions included (as their bits), for checking
+             * that a game plays out the same again (see
+             * ReplayFormat::Moves). It fits in a JavaScript number.
+             */
+            auto checksum() const -> uint32_t;
+        };
+
+        //! Add a frame with the current state of the map.
+        auto record(const Map& map) -> void;
+        /**
+         * Forget every frame, and from now on only keep the one recorded
+         * last, reusing its storage (for the player logs, when there is no
+         * replay). initial_planets is then left empty.
+         */
+        auto keep_latest_only() -> void;
+        /**
+         * Forget the ships and planets of every frame, and from now on
+         * only keep the state hash and checksum of each frame recorded,
+         * besides the whole of the last one: what a moves-only replay
+         * needs (see ReplayFormat::Moves). Only size, state_hash,
+         * checksum, back (once a frame has been recorded again) and
+         * initial_planets may be used afterwards.
+         */
+        auto keep_summaries_only() -> void;
+        auto is_summarized() const -> bool { return summarized; }
+
+        auto size() const -> size_t { return summarized ? summaries.size() : frames.size(); }
+        auto operator[](size_t index) const -> const Frame& { return frames[index]; }
+        auto back() const -> const Frame& { return frames.back(); }
+        //! The planets of the first frame, including their positions.
+        auto initial_planets() const -> const std::vector<Planet>& { return first_planets; }
+        //! Frame::state_hash and Frame::checksum of a frame, which are kept
+        //! even once the frame itself is forgotten.
+        auto state_hash(size_t index) const -> uint64_t;
+        auto checksum(size_t index) const -> uint32_t;
+
+        //! The memory held, in bytes (see MemoryReport).
+        auto memory_usage() const -> size_t;
+
+    private:
+        //! What keep_summaries_only keeps of a frame.
+        struct Summary {
+            uint64_t state_hash;
+            uint32_t checksum;
+        };
+
+        std::vector<Frame> frames;
+        std::vector<Summary> summaries;
+        std::vector<Planet> first_planets;
+        ChunkedArena<ShipSnapshot> ship_arena;
+        ChunkedArena<PlanetSnapshot> planet_arena;
+        ChunkedArena<const PlanetSnapshot*> planet_list_arena;
+        ChunkedArena<uint32_t> docked_arena;
+        ChunkedArena<uint32_t> offset_arena;
+        //! The last snapshot of each planet, by index, while it lives.
+        std::vector<const PlanetSnapshot*> latest_planets;
+        //! Scratch space for record.
+        std::vector<const PlanetSnapshot*> planet_list;
+        std::vector<uint32_t> docked_scratch;
+
+        //! Forget every frame's ships and planets.
+        auto clear_arenas() -> void;
+        bool latest_only = false;
+        bool summarized = false;
+    };
+
+    //! A move executed during some turn, as recorded for the replay.
+    struct RecordedMove {
+        PlayerId player;
+        uint8_t move_no;
+        Move move;
+    };
+
+    /**
+     * The moves executed in every turn, for the replay, in one flat array
+     * rather than hash tables per turn and player. A turn's moves are in
+     * the order they were executed: by queue number, then player, then
+     * ship ID.
+     *
+     * It also lists the players taken out of the game (for errors and
+     * timeouts), which the moves alone don't show.
+     */
+    class MoveHistory {
+    public:
+        //! A player taken out before the moves of a turn were executed.
+        struct Elimination {
+            size_t turn;
+            PlayerId player;
+        };
+
+        //! Start recording the moves of another turn.
+        auto start_turn() -> void {
+            offsets.push_back(moves.size());
+        }
+        //! Record a move of the current turn.
+        auto add(PlayerId player, int move_no, const Move& move) -> void {
+            moves.push_back(RecordedMove{ player, static_cast<uint8_t>(move_no), move });
+        }
+
+        //! Record that a player was taken out before the given turn.
+        auto eliminate(size_t turn, PlayerId player) -> void {
+            eliminated.push_back(Elimination{ turn, player });
+        }
+
+        //! The number of turns recorded.
+        auto size() const -> size_t { return offsets.size(); }
+        auto operator[](size_t turn) const -> Span<RecordedMove> {
+            const auto end = turn + 1 < offsets.size() ? offsets[turn + 1] : moves.size();
+            return { moves.data() + offsets[turn], moves.data() + end };
+        }
+
+        //! In the order they happened.
+        auto eliminations() const -> const std::vector<Elimination>& { return eliminated; }
+
+        //! The memory held, in bytes (see MemoryReport).
+        auto memory_usage() const -> size_t {
+            return moves.capacity() * sizeof(RecordedMove) +
+                offsets.capacity() * sizeof(size_t) +
+                eliminated.capacity() * sizeof(Elimination);
+        }
+
+    private:
+        std::vector<RecordedMove> moves;
+        //! Turn i's moves start at moves[offsets[i]].
+        std::vector<size_t> offsets;
+        std::vector<Elimination> eliminated;
+    };
+}
+
+#endif //HALITE_FRAMEHISTORY_HPP
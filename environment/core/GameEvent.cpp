@@ -3,3 +3,204 @@
 //
 
 #include "GameEvent.hpp"
+
+#include <algorithm>
+
+//! Stands in for the fields an event doesn't have.
+static auto none() -> double {
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+static auto binary_type(const hlt::EntityId& id) -> binary_replay::EntityType {
+    switch (id.type()) {
+        case hlt::EntityType::ShipEntity:
+            return binary_replay::EntityType::Ship;
+        case hlt::EntityType::PlanetEntity:
+            return binary_replay::EntityType::Planet;
+        default:
+            return binary_replay::EntityType::Invalid;
+    }
+}
+
+static auto binary_owner(const hlt::EntityId& id) -> uint8_t {
+    return id.type() == hlt::EntityType::ShipEntity ? id.player_id() : 0;
+}
+
+auto EventLog::start_frame() -> void {
+    frame_offsets.push_back(events.size());
+}
+
+auto EventLog::add(binary_replay::EventType type, const hlt::EntityId& id,
+                   const hlt::Location& location, double time,
+                   double radius) -> void {
+    events.push_back(Event{
+        type, id,
+        static_cast<double>(location.pos_x), static_cast<double>(location.pos_y),
+        time, radius,
+        static_cast<uint32_t>(related.size()), 0,
+    });
+}
+
+auto EventLog::add_related(const hlt::EntityId& id,
+                           const hlt::Location& location) -> void {
+    related.push_back(id);
+    related_locations.emplace_back(
+        static_cast<double>(location.pos_x), static_cast<double>(location.pos_y));
+    events.back().num_related++;
+}
+
+auto EventLog::destroyed(const hlt::EntityId& id, const hlt::Location& location,
+                         double radius, double time) -> void {
+    add(binary_replay::EventType::Destroyed, id, location, time, radius);
+}
+
+auto EventLog::attack(const hlt::EntityId& id, const hlt::Location& location,
+                      double time, const std::vector<hlt::EntityId>& targets,
+                      const std::vector<hlt::Location>& target_locations) -> void {
+    add(binary_replay::EventType::Attack, id, location, time, none());
+    for (size_t i = 0; i < targets.size(); i++) {
+        add_related(targets[i], target_locations[i]);
+    }
+}
+
+auto EventLog::contention(const hlt::EntityId& planet,
+                          const hlt::Location& planet_location,
+                          const std::vector<hlt::EntityId>& participants,
+                          const std::vector<hlt::Location>& participant_locations) -> void {
+    add(binary_replay::EventType::Contention, planet, planet_location, none(), none());
+    for (size_t i = 0; i < participants.size(); i++) {
+        add_related(participants[i], participant_locations[i]);
+    }
+}
+
+auto EventLog::spawned(const hlt::EntityId& id, const hlt::EntityId& planet,
+                       const hlt::Location& location,
+                       const hlt::Location& planet_location) -> void {
+    add(binary_replay::EventType::Spawned, id, location, none(), none());
+    add_related(planet, planet_location);
+}
+
+auto EventLog::frame_events(size_t frame) const -> std::pair<const Event*, const Event*> {
+    const auto first = events.data() + frame_offsets[frame];
+    const auto last = frame + 1 < frame_offsets.size()
+        ? events.data() + frame_offsets[frame + 1]
+        : events.data() + events.size();
+    return { first, last };
+}
+
+auto EventLog::write_event(JsonWriter& json, const Event& event) const -> void {
+    const auto first = related.begin() + event.related_offset;
+    const auto last = first + event.num_related;
+    auto write_ids = [&]() -> void {
+        json.begin_array();
+        for (auto id = first; id != last; ++id) {
+            write_json(json, *id);
+        }
+        json.end_array();
+    };
+
+    json.begin_object();
+    json.key("entity");
+    write_json(json, event.entity);
+    switch (event.type) {
+        case binary_replay::EventType::Destroyed:
+            json.key("event").value("destroyed");
+            json.key("radius").value(event.radius);
+            json.key("time").value(event.time);
+            break;
+        case binary_replay::EventType::Attack:
+            json.key("event").value("attack");
+            // Replays have always listed the targets themselves here,
+            // rather than their locations
+            json.key("target_locations");
+            write_ids();
+            json.key("targets");
+            write_ids();
+            json.key("time").value(event.time);
+            break;
+        case binary_replay::EventType::Contention:
+            json.key("event").value("contention");
+            json.key("participant_locations").begin_array();
+            for (uint32_t i = 0; i < event.num_related; i++) {
+                const auto& location = related_locations[event.related_offset + i];
+                json.begin_object();
+                json.key("x").value(location.first);
+                json.key("y").value(location.second);
+                json.end_object();
+            }
+            json.end_array();
+            json.key("participants");
+            write_ids();
+            break;
+        case binary_replay::EventType::Spawned: {
+            const auto& planet_location = related_locations[event.related_offset];
+            json.key("event").value("spawned");
+            json.key("planet");
+            write_json(json, *first);
+            json.key("planet_x").value(planet_location.first);
+            json.key("planet_y").value(planet_location.second);
+            break;
+        }
+    }
+    json.key("x").value(event.x);
+    json.key("y").value(event.y);
+    json.end_object();
+}
+
+auto EventLog::write_frame_json(JsonWriter& json, size_t frame) const -> void {
+    json.begin_array();
+    const auto range = frame_events(frame);
+    for (auto event = range.first; event != range.second; event++) {
+        write_event(json, *event);
+    }
+    json.end_array();
+}
+
+auto EventTally::clear() -> void {
+    std::fill(ships_destroyed.begin(), ships_destroyed.end(), 0);
+    std::fill(ships_spawned.begin(), ships_spawned.end(), 0);
+    planets_destroyed.clear();
+    attacks = 0;
+    contentions = 0;
+}
+
+auto EventLog::tally_frame(size_t frame, EventTally& tally) const -> void {
+    const auto range = frame_events(frame);
+    for (auto event = range.first; event != range.second; event++) {
+        switch (event->type) {
+            case binary_replay::EventType::Destroyed:
+                if (event->entity.type() == hlt::EntityType::PlanetEntity) {
+                    tally.planets_destroyed.push_back(event->entity.entity_index());
+                }
+                else {
+                    tally.ships_destroyed[event->entity.player_id()]++;
+                }
+                break;
+            case binary_replay::EventType::Attack:
+                tally.attacks++;
+                break;
+            case binary_replay::EventType::Contention:
+                tally.contentions++;
+                break;
+            case binary_replay::EventType::Spawned:
+                tally.ships_spawned[event->entity.player_id()]++;
+                break;
+        }
+    }
+}
+
+auto EventLog::add_frame_to(size_t frame, binary_replay::EventTable& table) const -> void {
+    const auto range = frame_events(frame);
+    for (auto event = range.first; event != range.second; event++) {
+        table.add(event->type, binary_type(event->entity), binary_owner(event->entity),
+                  static_cast<uint32_t>(event->entity.entity_index()),
+                  event->x, event->y, event->time, event->radius);
+        for (uint32_t i = 0; i < event->num_related; i++) {
+            const auto& id = related[event->related_offset + i];
+            const auto& location = related_locations[event->related_offset + i];
+            table.add_related(binary_type(id), binary_owner(id),
+                              static_cast<uint32_t>(id.entity_index()),
+                              location.first, location.second);
+        }
+    }
+}
@@ -5,127 +5,107 @@
 #ifndef ENVIRONMENT_GAMEEVENT_HPP
 #define ENVIRONMENT_GAMEEVENT_HPP
 
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "BinaryReplay.hpp"
 #include "Entity.hpp"
+#include "JsonWriter.hpp"
 #include "hlt.hpp"
 
-#include "json.hpp"
-
 /**
  * An event that happens during game simulation. Recorded for the replay, so
  * that visualizers have more information to use.
+ *
+ * Every type of event is stored in the same record, so that events don't
+ * need to be allocated one by one. The entities an event involves besides
+ * its own (the targets of an attack, the participants of a contention, and
+ * the planet a ship spawned from) are kept by the EventLog.
  */
 struct Event {
-    virtual auto serialize() -> nlohmann::json = 0;
-
-    Event() {};
-};
-
-struct DestroyedEvent : Event {
-    hlt::EntityId id;
-    hlt::Location location;
+    binary_replay::EventType type;
+    //! The entity destroyed, attacking or spawned, or the planet contended.
+    hlt::EntityId entity;
+    double x, y;
+    //! NaN for events that don't have one.
     double time;
     double radius;
-
-    DestroyedEvent(hlt::EntityId id_, hlt::Location location_,
-                   double radius_, double time_)
-        : id(id_), location(location_), time(time_), radius(radius_) {};
-
-    auto serialize() -> nlohmann::json override {
-        return nlohmann::json{
-            { "event", "destroyed" },
-            { "entity", id },
-            { "x", location.pos_x },
-            { "y", location.pos_y },
-            { "radius", radius },
-            { "time", time },
-        };
-    }
+    //! The related entities are entries related_offset up to
+    //! related_offset + num_related of the EventLog's.
+    uint32_t related_offset;
+    uint32_t num_related;
 };
 
-struct AttackEvent : Event {
-    hlt::EntityId id;
-    hlt::Location location;
-    double time;
-
-    std::vector<hlt::EntityId> targets;
-    std::vector<hlt::Location> target_locations;
-
-    AttackEvent(hlt::EntityId id_, hlt::Location location_, double time_,
-                std::vector<hlt::EntityId> targets_,
-                std::vector<hlt::Location> target_locations_) :
-        id(id_), location(location_), time(time_), targets(targets_),
-        target_locations(target_locations_) {};
-
-    auto serialize() -> nlohmann::json override {
-        std::vector<nlohmann::json> target_locations;
-        target_locations.reserve(targets.size());
-        for (auto& location : targets) {
-            target_locations.push_back(location);
-        }
-        return nlohmann::json{
-            { "event", "attack" },
-            { "entity", id },
-            { "x", location.pos_x },
-            { "y", location.pos_y },
-            { "targets", targets },
-            { "target_locations", target_locations },
-            { "time", time },
-        };
-    }
+/**
+ * How many events of each kind happened over some frames, for replay
+ * previews (see ReplayOptions::preview_interval).
+ */
+struct EventTally {
+    //! By player.
+    std::vector<uint32_t> ships_destroyed;
+    std::vector<uint32_t> ships_spawned;
+    std::vector<hlt::EntityIndex> planets_destroyed;
+    uint32_t attacks;
+    uint32_t contentions;
+
+    explicit EventTally(hlt::PlayerId num_players)
+        : ships_destroyed(num_players), ships_spawned(num_players) { clear(); }
+    auto clear() -> void;
 };
 
 /**
- * Ships that simultaneously dock to a planet attack each other.
+ * The events of every frame of a game, for the replay. All events, and all
+ * the entities they involve, are stored in a few flat arrays.
  */
-struct ContentionAttackEvent : Event {
-    hlt::EntityId planet;
-    hlt::Location planet_location;
-
-    std::vector<hlt::EntityId> participants;
-    std::vector<hlt::Location> participant_locations;
-
-    ContentionAttackEvent(
-        hlt::EntityId planet, hlt::Location planet_location,
-        std::vector<hlt::EntityId> participants,
-        std::vector<hlt::Location> participant_locations
-    ) : planet(planet), planet_location(planet_location),
-        participants(participants),
-        participant_locations(participant_locations) {};
-
-    auto serialize() -> nlohmann::json override {
-        return nlohmann::json{
-            { "event", "contention" },
-            { "entity", planet },
-            { "x", planet_location.pos_x },
-            { "y", planet_location.pos_y },
-            { "participants", participants },
-            { "participant_locations", participant_locations },
-        };
+class EventLog {
+public:
+    //! Start recording the events of a new frame.
+    auto start_frame() -> void;
+    auto num_frames() const -> size_t { return frame_offsets.size(); }
+
+    auto destroyed(const hlt::EntityId& id, const hlt::Location& location,
+                   double radius, double time) -> void;
+    auto attack(const hlt::EntityId& id, const hlt::Location& location,
+                double time, const std::vector<hlt::EntityId>& targets,
+                const std::vector<hlt::Location>& target_locations) -> void;
+    //! Ships that simultaneously dock to a planet attack each other.
+    auto contention(const hlt::EntityId& planet,
+                    const hlt::Location& planet_location,
+                    const std::vector<hlt::EntityId>& participants,
+                    const std::vector<hlt::Location>& participant_locations) -> void;
+    auto spawned(const hlt::EntityId& id, const hlt::EntityId& planet,
+                 const hlt::Location& location,
+                 const hlt::Location& planet_location) -> void;
+
+    //! Write the events of a frame, as stored in a JSON replay frame.
+    auto write_frame_json(JsonWriter& json, size_t frame) const -> void;
+    //! Count the events of a frame into tally.
+    auto tally_frame(size_t frame, EventTally& tally) const -> void;
+    //! Add the events of a frame to the event table of a binary replay frame.
+    auto add_frame_to(size_t frame, binary_replay::EventTable& table) const -> void;
+
+    //! The memory held, in bytes (see MemoryReport).
+    auto memory_usage() const -> size_t {
+        return events.capacity() * sizeof(Event) +
+            frame_offsets.capacity() * sizeof(size_t) +
+            related.capacity() * sizeof(hlt::EntityId) +
+            related_locations.capacity() * sizeof(std::pair<double, double>);
     }
-};
-
-struct SpawnEvent : Event {
-    hlt::EntityId id;
-    hlt::EntityId planet;
-    hlt::Location location;
-    hlt::Location planet_location;
 
-    SpawnEvent(hlt::EntityId id_, hlt::EntityId planet_,
-               hlt::Location location_, hlt::Location planet_location_)
-        : id(id_), planet(planet_),
-          location(location_), planet_location(planet_location_) {}
-
-    auto serialize() -> nlohmann::json override {
-        return nlohmann::json{
-            { "event", "spawned" },
-            { "entity", id },
-            { "planet", planet },
-            { "x", location.pos_x },
-            { "y", location.pos_y },
-            { "planet_x", planet_location.pos_x },
-            { "planet_y", planet_location.pos_y },
-        };
-    }
+private:
+    std::vector<Event> events;
+    //! Where the events of each frame start in events.
+    std::vector<size_t> frame_offsets;
+    std::vector<hlt::EntityId> related;
+    std::vector<std::pair<double, double>> related_locations;
+
+    auto add(binary_replay::EventType type, const hlt::EntityId& id,
+             const hlt::Location& location, double time, double radius) -> void;
+    auto add_related(const hlt::EntityId& id, const hlt::Location& location) -> void;
+    auto write_event(JsonWriter& json, const Event& event) const -> void;
+    auto frame_events(size_t frame) const -> std::pair<const Event*, const Event*>;
 };
 
 #endif //ENVIRONMENT_GAMEEVENT_HPP
@@ -0,0 +1,101 @@
+#ifndef HALITE_GAMEOPTIONS_HPP
+#define HALITE_GAMEOPTIONS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "Constants.hpp"
+#include "PlayerLog.hpp"
+#include "mapgen/Generator.hpp"
+#include "../networking/Networking.hpp"
+
+class LiveStream;
+class OutputWriter;
+
+/**
+ * How a game is played and what it records. Every Halite keeps its own
+ * copy, so games with different options (or constants) can run on several
+ * threads of one process without sharing any settings.
+ */
+struct GameOptions {
+    //! The rules of the game.
+    hlt::GameConstants constants;
+    //! Print nothing to stdout (the caller reports the results).
+    bool quiet_output = false;
+    //! What every line the game prints is prefixed with, if anything (see
+    //! ConsoleLog), e.g. to tell games apart that run together.
+    std::string log_tag;
+    //! If set, the game is streamed to it as it is played, and keeps every
+    //! frame as for a replay, even without one. Not owned.
+    LiveStream* live_stream = nullptr;
+    //! If set, the game's replay and logs are finished on its thread, and
+    //! laid out as its options say (see OutputOptions). Not owned.
+    OutputWriter* output_writer = nullptr;
+    /**
+     * If set, write a checkpoint of the game to this file every
+     * checkpoint_interval turns (see Halite::resume_from), i.e. a moves-only
+     * replay of it so far, along with what is needed to play on from there.
+     * The game keeps every frame as for a replay, even without one.
+     */
+    std::string checkpoint_file;
+    unsigned int checkpoint_interval = 100;
+    //! Keep the logs of every player, not just those that errored.
+    bool always_log = false;
+    //! How much of every turn the player logs record.
+    LogDetail log_detail = LogDetail::Full;
+    //! End the game once its ranking is decided (see Halite::is_decided).
+    bool adjudicate_games = false;
+    //! Let bots take as long as they like to respond.
+    bool ignore_timeout = false;
+    //! How long bots have to initialize. Every bot gets the same deadline,
+    //! and the game starts as soon as all have replied.
+    std::chrono::milliseconds init_time_limit = INIT_TIME_LIMIT;
+    //! How long bots have to reply each turn.
+    std::chrono::milliseconds frame_time_limit = FRAME_TIME_LIMIT;
+    //! If nonzero, the most time a bot can save up from turns where it
+    //! replied early, to spend on later ones (see Networking::set_time_limits).
+    std::chrono::milliseconds time_bank = std::chrono::milliseconds::zero();
+    //! The limits bots are launched with (see Networking::set_sandbox).
+    BotSandbox sandbox;
+    /**
+     * If nonzero, stop asking bots for moves once every living bot has
+     * sent none for this many turns in a row: the rest of the game is
+     * played out as if they kept sending none, without sending frames.
+     * This changes the outcome of a game whose bots would have woken up
+     * again, so it is off by default.
+     */
+    unsigned int fast_forward_turns = 0;
+    //! The maximum number of threads used for event detection.
+    unsigned int event_threads = 1;
+    //! Where generated maps are kept (see mapgen::MapCache), if anywhere.
+    std::string map_cache_directory;
+    //! The generator new maps are made with (see mapgen::make_generator).
+    std::string map_generator_name = mapgen::DEFAULT_GENERATOR;
+    //! Time the phases of every turn (see TurnProfile), for GameStatistics.
+    bool profile_turns = false;
+    //! If set, write each turn's profile to this CSV file.
+    std::string profile_file;
+    //! If set, write a timeline of the game to this file (see TraceFile).
+    std::string trace_file;
+    /**
+     * Measure the wall time the engine adds to every turn beyond the think
+     * time of the bot it waited for (see TurnOverhead), for
+     * GameStatistics, and warn about turns over overhead_budget
+     * microseconds, unless it is 0.
+     */
+    bool measure_overhead = false;
+    unsigned int overhead_budget = 0;
+    /**
+     * If nonzero, a soft cap on the memory a game holds, in bytes, as
+     * counted for MemoryReport. Once a game goes over it, it turns lean: it
+     * only keeps what a moves-only replay needs, and writes its replay in
+     * that format instead (without a preview), and player logs only record
+     * timing. The game itself plays out the same. Either way, the replay is
+     * compressed within what is left of the cap (see
+     * ReplayOptions::memory_budget).
+     */
+    uint64_t memory_cap = 0;
+};
+
+#endif //HALITE_GAMEOPTIONS_HPP
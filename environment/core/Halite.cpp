@@ -1,16 +1,20 @@
 #include "Halite.hpp"
 #include "hlt.hpp"
+#include <array>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <chrono>
-#include <unordered_set>
 #include <ostream>
 #include <ctime>
+#include <cstdio>
+#include <sstream>
 
-#include "mapgen/AsteroidCluster.hpp"
-#include "mapgen/SolarSystem.hpp"
+#include "mapgen/MapCache.hpp"
+#include "OutputWriter.hpp"
 #include "SimulationEvent.hpp"
 #include "Replay.hpp"
+#include "ReplayPlayback.hpp"
 
 /**
  * Format the current time (to use for the replay file name) in a way
@@ -20,10 +24,17 @@
 auto put_time() -> std::string {
     // While compilers like G++4.8 report C++11 compatibility, they do not
     // support std::put_time, so we have to use strftime instead.
+    // std::localtime shares one buffer between threads, which matters when
+    // several games run at once in batch mode.
     auto time = std::time(nullptr);
-    auto localtime = std::localtime(&time);
+    std::tm localtime;
+#ifdef _WIN32
+    localtime_s(&localtime, &time);
+#else
+    localtime_r(&time, &localtime);
+#endif
     char result[30];
-    std::strftime(result, 30, "%Y%m%d-%H%M%S%z-", localtime);
+    std::strftime(result, 30, "%Y%m%d-%H%M%S%z-", &localtime);
     return std::string(result);
 }
 
@@ -38,12 +49,22 @@ auto Halite::compare_rankings(const hlt::PlayerId& player1,
     return total_ship_count[player1] < total_ship_count[player2];
 }
 
+auto Halite::rank_together(std::vector<hlt::PlayerId>& players, std::mt19937& rng) const -> void {
+    // Shuffle the players first, to ensure that in the case of a tie, a
+    // random winner is chosen.
+    std::shuffle(players.begin(), players.end(), rng);
+    std::stable_sort(players.begin(), players.end(),
+                     [this](const hlt::PlayerId& player1, const hlt::PlayerId& player2) -> bool {
+                         return compare_rankings(player1, player2);
+                     });
+}
+
 auto Halite::compute_damage(hlt::EntityId self_id, hlt::EntityId other_id)
 -> std::pair<unsigned short, unsigned short> {
     unsigned short self_damage = 0;
     unsigned short other_damage = 0;
 
-    switch (self_id.type) {
+    switch (self_id.type()) {
         case hlt::EntityType::PlanetEntity: {
             const auto& self = game_map.get_planet(self_id);
             const auto& other = game_map.get_ship(other_id);
@@ -54,7 +75,7 @@ auto Halite::compute_damage(hlt::EntityId self_id, hlt::EntityId other_id)
         case hlt::EntityType::ShipEntity: {
             const auto& self = game_map.get_ship(self_id);
             self_damage = self.health;
-            if (other_id.type == hlt::EntityType::ShipEntity) {
+            if (other_id.type() == hlt::EntityType::ShipEntity) {
                 other_damage = game_map.get_ship(other_id).health;
             }
             else {
@@ -71,7 +92,8 @@ auto Halite::compute_damage(hlt::EntityId self_id, hlt::EntityId other_id)
 }
 
 auto planet_explosion_damage(hlt::Planet& planet, double distance,
-                             double max_distance) -> unsigned short {
+                             double max_distance,
+                             const hlt::GameConstants& constants) -> unsigned short {
     if (distance < planet.radius) {
         return std::numeric_limits<unsigned short>::max();
     }
@@ -79,7 +101,7 @@ auto planet_explosion_damage(hlt::Planet& planet, double distance,
     const auto distance_from_crust = distance - planet.radius;
     // Ranges linearly from 5x max ship health (at distance 0) to 0.5x
     // max ship health (at the maximum distance)
-    const auto max_ship_hp = hlt::GameConstants::get().MAX_SHIP_HEALTH;
+    const auto max_ship_hp = constants.MAX_SHIP_HEALTH;
     const auto min_damage = 0.5 * max_ship_hp;
     const auto max_damage = 5 * max_ship_hp;
     const auto damage = min_damage +
@@ -106,24 +128,24 @@ auto Halite::kill_entity(hlt::EntityId id, double time) -> void {
     entity.kill();
 
     auto location = entity.location;
-    if (id.type == hlt::EntityType::ShipEntity) {
+    if (id.type() == hlt::EntityType::ShipEntity) {
         // Make sure destruction location reflects the entity position at time
         // of death, not start of frame
         const auto& ship = game_map.get_ship(id);
         location.move_by(ship.velocity, time);
     }
 
-    full_frame_events.back().push_back(
-        std::unique_ptr<Event>(
-            new DestroyedEvent(id, location, entity.radius, time)));
+    if (record_events) {
+        full_frame_events.destroyed(id, location, entity.radius, time);
+    }
 
-    switch (id.type) {
+    switch (id.type()) {
         case hlt::EntityType::ShipEntity: {
             hlt::Ship& ship = game_map.get_ship(id);
 
             if (ship.docking_status != hlt::DockingStatus::Undocked) {
                 auto& planet = game_map.planets.at(ship.docked_planet);
-                planet.remove_ship(id.entity_index());
+                planet.remove_ship(id.entity_index(), ship.docking_status);
                 ship.docking_status = hlt::DockingStatus::Undocked;
                 ship.docked_planet = 0;
             }
@@ -138,35 +160,106 @@ auto Halite::kill_entity(hlt::EntityId id, double time) -> void {
                 ship.reset_docking_status();
             }
 
+            exploding_planets.push_back(id.entity_index());
+            if (!resolving_explosions) {
+                explode_planets(time);
+            }
+            break;
+        }
+        case hlt::EntityType::InvalidEntity: {
+            assert(false);
+        }
+    }
+
+    game_map.unsafe_kill_entity(id);
+}
+
+auto Halite::explode_planets(double time) -> void {
+    resolving_explosions = true;
+    if (explosion_planet_damage.size() < game_map.planets.size()) {
+        explosion_planet_damage.resize(game_map.planets.size(), 0);
+    }
+
+    while (!exploding_planets.empty()) {
+        explosion_wave.swap(exploding_planets);
+        exploding_planets.clear();
+        explosion_ship_damage.clear();
+
+        for (const auto planet_index : explosion_wave) {
+            auto& planet = game_map.planets[planet_index];
             const auto max_distance = std::max(
-                planet.radius, hlt::GameConstants::get().DOCK_RADIUS);
-            auto caught_in_explosion = game_map.test(
-                planet.location, planet.radius + max_distance, time);
+                planet.radius, options.constants.DOCK_RADIUS);
+            const auto explosion_radius = planet.radius + max_distance;
+
+            // Planets only die while events are resolved, when the
+            // collision map holds every ship at its current location (the
+            // dead ones, including this wave's planets, are skipped by
+            // test_planets and test_ids).
+            explosion_nearby_ships.clear();
+            collision_map.query_into(planet.location, explosion_radius,
+                                     explosion_nearby_ships);
+            caught_in_explosion.clear();
+            game_map.test_planets(planet.location, explosion_radius, caught_in_explosion);
+            game_map.test_ids(planet.location, explosion_radius,
+                              explosion_nearby_ships, caught_in_explosion);
 
             for (const auto& target_id : caught_in_explosion) {
-                if (target_id != id) {
-                    const auto& target = game_map.get_entity(target_id);
-                    const auto distance = planet.location.distance(target.location);
-                    const auto damage = planet_explosion_damage(
-                        planet, distance - target.radius, max_distance);
-                    damage_entity(target_id, damage, time);
+                const auto& target = game_map.get_entity(target_id);
+                const auto distance = planet.location.distance(target.location);
+                const auto damage = planet_explosion_damage(
+                    planet, distance - target.radius, max_distance, options.constants);
+                if (target_id.type() == hlt::EntityType::PlanetEntity) {
+                    auto& total = explosion_planet_damage[target_id.entity_index()];
+                    if (total == 0) {
+                        explosion_planets_hit.push_back(target_id.entity_index());
+                    }
+                    total += damage;
+                }
+                else {
+                    auto added = explosion_ship_damage.add(target_id);
+                    if (added.second) added.first = 0;
+                    added.first += damage;
                 }
             }
+        }
 
-            break;
+        // Damage ships in ID order, as when every ship was scanned. Planets
+        // destroyed here go into exploding_planets, for the next wave.
+        const auto deal = [&](hlt::EntityId target_id, unsigned int total) {
+            const auto damage = static_cast<unsigned short>(std::min<unsigned int>(
+                total, std::numeric_limits<unsigned short>::max()));
+            damage_entity(target_id, damage, time);
+        };
+        for (const auto planet_index : explosion_planets_hit) {
+            deal(hlt::EntityId::for_planet(planet_index),
+                 explosion_planet_damage[planet_index]);
+            explosion_planet_damage[planet_index] = 0;
         }
-        case hlt::EntityType::InvalidEntity: {
-            assert(false);
+        explosion_planets_hit.clear();
+        explosion_nearby_ships.assign(explosion_ship_damage.ships().begin(),
+                                      explosion_ship_damage.ships().end());
+        std::sort(explosion_nearby_ships.begin(), explosion_nearby_ships.end());
+        for (const auto& ship_id : explosion_nearby_ships) {
+            deal(ship_id, explosion_ship_damage.at(ship_id));
         }
     }
 
-    game_map.unsafe_kill_entity(id);
+    resolving_explosions = false;
 }
 
-void Halite::kill_player(hlt::PlayerId player) {
+void Halite::kill_player(hlt::PlayerId player, bool before_turn) {
     networking.kill_player(player);
     error_tags.insert((unsigned short)player);
+    remove_player(player);
+    if (record_history) {
+        // Bots are killed while the moves of the current turn are read,
+        // or before the first turn (of the game, or since it was resumed)
+        full_player_moves.eliminate(
+            before_turn || turn_number == 0 ? turn_number : turn_number - 1, player);
+    }
+}
 
+auto Halite::remove_player(hlt::PlayerId player) -> void {
     // Kill player's ships (don't process any side effects)
     for (auto& ship : game_map.ships.at(player)) {
         game_map.unsafe_kill_entity(hlt::EntityId::for_ship(player, ship.first));
@@ -177,42 +270,83 @@ void Halite::kill_player(hlt::PlayerId player) {
     for (auto& planet : game_map.planets) {
         if (planet.owned && planet.owner == player) {
             planet.owned = false;
-            planet.docked_ships.clear();
+            planet.clear_ships();
         }
     }
 }
 
 auto Halite::retrieve_moves(std::vector<bool> alive) -> void {
-    // Create threads to send/receive data to/from players. The threads should
-    // return a float of how much time passed between the end of their message
-    // being sent and the end of the AI's message being received.
-    std::vector<std::future<int>> frame_threads(alive.size());
+    for (auto& queue : player_moves) {
+        queue.reset(game_map.ship_index_limit(), options.constants.MAX_QUEUED_MOVES);
+    }
+
+    // Once every bot idles, the game just plays out
+    moves_start = waited_bot_sent = waited_bot_replied = overhead_clock();
+    if (fast_forwarding) {
+        response_times.assign(number_of_players, -1);
+        response_timings.assign(number_of_players, Networking::ResponseTiming());
+        turn_overhead.serialize = 0;
+        return;
+    }
 
-    for (auto& row : player_moves) {
-        for (auto& subrow : row) {
-            subrow.clear();
+    // Every bot gets the same frame, so serialize it only once
+    {
+        PhaseTimer timer(profile(), TurnPhase::SerializeFrame);
+        networking.serialize_frame(game_map, frame);
+    }
+    if (options.measure_overhead) {
+        const auto serialized = overhead_clock();
+        turn_overhead.serialize = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(serialized - moves_start).count());
+        moves_start = waited_bot_sent = waited_bot_replied = serialized;
+    }
+
+    // Get the messages sent by bots this frame. The times are how much time
+    // passed between the end of their message being sent and the end of the
+    // AI's message being received.
+    PhaseTimer timer(profile(), TurnPhase::RetrieveMoves);
+    response_times = networking.handle_frames_networking(
+        turn_number, game_map, frame, alive, options.ignore_timeout, player_moves,
+        response_timings);
+    const auto& times = response_times;
+
+    if (options.measure_overhead) {
+        // The turn waited for whichever bot replied last
+        const Networking::ResponseTiming* waited = nullptr;
+        for (hlt::PlayerId player_id = 0; player_id < response_timings.size(); player_id++) {
+            const auto& timing = response_timings[player_id];
+            if (timing.reply_read == std::chrono::steady_clock::time_point()) continue;
+            if (waited == nullptr || timing.reply_read > waited->reply_read) waited = &timing;
+        }
+        if (waited != nullptr) {
+            waited_bot_sent = waited->sent;
+            waited_bot_replied = waited->reply_read;
         }
     }
 
-    // Get the messages sent by bots this frame
-    for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
-        if (alive[player_id]) {
-            hlt::PlayerMoveQueue& moves = player_moves.at(player_id);
-            frame_threads[player_id] = std::async(
-                std::launch::async,
-                [&, player_id]() -> int {
-                    return networking.handle_frame_networking(
-                        player_id, turn_number, game_map, ignore_timeout,
-                        moves);
-                });
+    if (trace) {
+        for (hlt::PlayerId player_id = 0; player_id < response_timings.size(); player_id++) {
+            const auto& timing = response_timings[player_id];
+            const auto thread = TraceFile::bot_thread(player_id);
+            const auto args = nlohmann::json{ { "turn", turn_number } };
+            const TraceFile::clock::time_point never;
+            if (timing.sent != never) {
+                trace->span(thread, "send", timing.send_start, timing.sent, args);
+            }
+            if (timing.reply_read != never) {
+                trace->span(thread, "think", timing.sent, timing.reply_read, args);
+            }
+            if (timing.reply_parsed != never) {
+                trace->span(thread, "receive", timing.reply_read, timing.reply_parsed, args);
+            }
         }
     }
 
-    // Join threads. Figure out if the player responded in an allowable amount
-    // of time or if the player has timed out.
+    // Figure out if the player responded in an allowable amount of time or
+    // if the player has timed out.
     for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
         if (alive[player_id]) {
-            int time = frame_threads[player_id].get();
+            int time = times[player_id];
             if (time == -1) {
                 kill_player(player_id);
             }
@@ -221,9 +355,27 @@ auto Halite::retrieve_moves(std::vector<bool> alive) -> void {
                 if (time > max_frame_response_times[player_id]) {
                     max_frame_response_times[player_id] = time;
                 }
+                frame_think_times[player_id].add(response_timings[player_id].think_micros);
+                frame_send_times[player_id].add(response_timings[player_id].send_micros);
+
+                idle_turns[player_id] = player_moves[player_id].empty()
+                    ? idle_turns[player_id] + 1 : 0;
             }
         }
     }
+
+    if (options.fast_forward_turns != 0) {
+        fast_forwarding = true;
+        for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
+            if (alive[player_id] && !networking.is_process_dead(player_id) &&
+                idle_turns[player_id] < options.fast_forward_turns) {
+                fast_forwarding = false;
+            }
+        }
+        if (fast_forwarding) {
+            log(LogLevel::Info, "Every bot is idle; playing out the game without them.");
+        }
+    }
 }
 
 auto Halite::process_docking() -> void {
@@ -240,6 +392,7 @@ auto Halite::process_docking() -> void {
                 ship.docking_progress--;
                 if (ship.docking_progress == 0) {
                     ship.docking_status = hlt::DockingStatus::Docked;
+                    game_map.planets.at(ship.docked_planet).ship_docked();
                 }
             }
             else if (ship.docking_status == hlt::DockingStatus::Undocking) {
@@ -247,11 +400,11 @@ auto Halite::process_docking() -> void {
                 if (ship.docking_progress == 0) {
                     ship.docking_status = hlt::DockingStatus::Undocked;
                     auto& planet = game_map.planets.at(ship.docked_planet);
-                    planet.remove_ship(ship_idx);
+                    planet.remove_ship(ship_idx, hlt::DockingStatus::Undocking);
                 }
             }
             else if (ship.docking_status == hlt::DockingStatus::Docked) {
-                ship.heal(hlt::GameConstants::get().DOCKED_SHIP_REGENERATION);
+                ship.heal(options.constants.DOCKED_SHIP_REGENERATION, options.constants);
             }
         }
     }
@@ -262,19 +415,84 @@ auto Halite::process_docking() -> void {
     }
 }
 
+auto Halite::prepare_spawn_locations() -> void {
+    if (spawn_locations.size() == game_map.planets.size()) {
+        return;
+    }
+
+    const auto& center = hlt::Location{
+        game_map.map_width / 2.0, game_map.map_height / 2.0};
+    const auto max_delta = options.constants.SPAWN_RADIUS;
+
+    // The direction of each offset from the planet's center
+    std::vector<std::pair<int, int>> deltas;
+    std::vector<double> cosines, sines;
+    for (int dx = -max_delta; dx <= max_delta; dx++) {
+        for (int dy = -max_delta; dy <= max_delta; dy++) {
+            deltas.emplace_back(dx, dy);
+#ifdef HALITE_FIXED_POINT
+            // The same direction, without the C library's trigonometry
+            const auto length = std::sqrt(static_cast<double>(dx * dx + dy * dy));
+            cosines.push_back(length == 0 ? 1.0 : dx / length);
+            sines.push_back(length == 0 ? 0.0 : dy / length);
+#else
+            const auto offset_angle = std::atan2(dy, dx);
+            cosines.push_back(std::cos(offset_angle));
+            sines.push_back(std::sin(offset_angle));
+#endif
+        }
+    }
+
+    spawn_locations.resize(game_map.planets.size());
+    std::vector<std::pair<double, hlt::Location>> candidates;
+    for (hlt::EntityIndex planet_idx = 0;
+         planet_idx < game_map.planets.size(); planet_idx++) {
+        const auto& planet = game_map.planets[planet_idx];
+
+        candidates.clear();
+        for (size_t i = 0; i < deltas.size(); i++) {
+            const auto offset_x = deltas[i].first + planet.radius * cosines[i];
+            const auto offset_y = deltas[i].second + planet.radius * sines[i];
+            const auto location = game_map.location_with_delta(
+                planet.location, offset_x, offset_y);
+            if (location.second) {
+                candidates.emplace_back(location.first.distance(center), location.first);
+            }
+        }
+
+        // Stable, so that spots as far from the center are tried in the
+        // order of their offsets
+        std::stable_sort(
+            candidates.begin(), candidates.end(),
+            [](const std::pair<double, hlt::Location>& a,
+               const std::pair<double, hlt::Location>& b) -> bool {
+                return a.first < b.first;
+            });
+
+        auto& locations = spawn_locations[planet_idx];
+        locations.clear();
+        for (const auto& candidate : candidates) {
+            locations.push_back(candidate.second);
+        }
+    }
+}
+
 auto Halite::process_production() -> void {
     // Update productions
     // We do this after processing moves so that a bot can't try to guess the
     // resulting ship ID and issue commands to it immediately
-    CollisionMap collision_map = CollisionMap(
+    const auto open_radius = options.constants.SHIP_RADIUS * 3;
+    spawn_map.update(
         game_map,
         [](const hlt::Ship& ship) -> double {
             return ship.radius;
-        }
+        },
+        open_radius
     );
     std::vector<hlt::EntityId> occupants;
+    prepare_spawn_locations();
 
-    const auto infinite_resources = hlt::GameConstants::get().INFINITE_RESOURCES;
+    const auto infinite_resources = options.constants.INFINITE_RESOURCES;
 
     for (hlt::EntityIndex planet_idx = 0;
          planet_idx < game_map.planets.size(); planet_idx++) {
@@ -283,14 +501,13 @@ auto Halite::process_production() -> void {
             continue;
         }
 
-        const auto num_docked_ships = planet.num_docked_ships(game_map);
+        const auto num_docked_ships = planet.num_docked_ships();
         if (num_docked_ships == 0){
             continue;
         }
 
-        const auto& constants = hlt::GameConstants::get();
-        const auto base_productivity = constants.BASE_PRODUCTIVITY;
-        const auto additional_productivity = constants.ADDITIONAL_PRODUCTIVITY;
+        const auto base_productivity = options.constants.BASE_PRODUCTIVITY;
+        const auto additional_productivity = options.constants.ADDITIONAL_PRODUCTIVITY;
         const auto production = std::min(
             planet.remaining_production,
             static_cast<unsigned short>(base_productivity +
@@ -301,54 +518,35 @@ auto Halite::process_production() -> void {
         }
         planet.current_production += production;
 
-        const auto production_per_ship = hlt::GameConstants::get().PRODUCTION_PER_SHIP;
+        const auto production_per_ship = options.constants.PRODUCTION_PER_SHIP;
         while (planet.current_production >= production_per_ship) {
-            // Try to spawn the ship
+            // Try to spawn the ship at the free spot nearest to the center
             auto best_location = std::make_pair(planet.location, false);
-            auto best_distance = std::numeric_limits<double>::max();
-            const auto& center = hlt::Location{
-                game_map.map_width / 2.0, game_map.map_height / 2.0};
-
-            const auto max_delta = constants.SPAWN_RADIUS;
-            const auto open_radius = constants.SHIP_RADIUS * 3;
-            for (int dx = -max_delta; dx <= max_delta; dx++) {
-                for (int dy = -max_delta; dy <= max_delta; dy++) {
-                    double offset_angle = std::atan2(dy, dx);
-                    double offset_x = dx + planet.radius * std::cos(offset_angle);
-                    double offset_y = dy + planet.radius * std::sin(offset_angle);
-                    auto location = game_map.location_with_delta(
-                        planet.location, offset_x, offset_y);
-
-                    if (!location.second){
-                        continue;
-                    }
-
-                    const auto distance = location.first.distance(center);
-
-                    occupants.clear();
-                    collision_map.test(location.first, open_radius, occupants);
-                    const auto has_occupants =
-                        game_map.any_planet_collision(location.first, open_radius) ||
-                        game_map.any_collision(location.first, open_radius, occupants);
-
-                    if (distance < best_distance && !has_occupants) {
-                        best_distance = distance;
-                        best_location = location;
-                    }
+            for (const auto& location : spawn_locations[planet_idx]) {
+                occupants.clear();
+                spawn_map.query_into(location, open_radius, occupants);
+                const auto has_occupants =
+                    game_map.any_planet_collision(location, open_radius) ||
+                    game_map.any_collision(location, open_radius, occupants);
+                if (!has_occupants) {
+                    best_location = std::make_pair(location, true);
+                    break;
                 }
             }
 
             if (best_location.second) {
                 planet.current_production -= production_per_ship;
                 const auto ship_idx =
-                    game_map.spawn_ship(best_location.first, planet.owner);
+                    game_map.spawn_ship(best_location.first, planet.owner, options.constants);
                 total_ship_count[planet.owner]++;
                 const auto id = hlt::EntityId::for_ship(planet.owner, ship_idx);
-                full_frame_events.back().emplace_back(new SpawnEvent(
-                    id, hlt::EntityId::for_planet(planet_idx),
-                    best_location.first, planet.location));
+                if (record_events) {
+                    full_frame_events.spawned(
+                        id, hlt::EntityId::for_planet(planet_idx),
+                        best_location.first, planet.location);
+                }
 
-                collision_map.add(best_location.first, game_map.get_ship(id).radius, id);
+                spawn_map.add(best_location.first, game_map.get_ship(id).radius, id);
             }
             else {
                 // Can't spawn any more - just keep the production there
@@ -358,42 +556,15 @@ auto Halite::process_production() -> void {
     }
 }
 
-auto Halite::process_drag() -> void {
-    // Update inertia/implement drag
-    const auto drag = hlt::GameConstants::get().DRAG;
-    for (auto& player_ships : game_map.ships) {
-        for (auto& pair : player_ships) {
-            auto& ship = pair.second;
-
-            const auto magnitude = ship.velocity.magnitude();
-            if (magnitude <= drag) {
-                ship.velocity.vel_x = ship.velocity.vel_y = 0;
-            }
-            else {
-                ship.velocity.accelerate_by(drag, ship.velocity.angle() + M_PI);
-            }
-        }
-    }
-}
-
-auto Halite::process_cooldowns() -> void {
-    for (auto& player_ships : game_map.ships) {
-        for (auto& pair : player_ships) {
-            auto& ship = pair.second;
-
-            if (ship.weapon_cooldown > 0) {
-                ship.weapon_cooldown--;
-            }
-        }
-    }
-}
-
 auto Halite::process_docking_move(
     hlt::EntityId ship_id, hlt::Ship& ship,
     hlt::EntityIndex planet_id,
-    SimultaneousDockMap& simultaenous_docking) -> void {
+    SimultaneousDocking& simultaneous_docking) -> void {
     const auto player_id = ship_id.player_id();
     const auto ship_idx = ship_id.entity_index();
+    const auto attempt = [&](hlt::PlayerId player, hlt::EntityId ship) -> void {
+        simultaneous_docking.push_back({ planet_id, player, ship, simultaneous_docking.size() });
+    };
 
     if (planet_id >= game_map.planets.size()) {
         // Planet is invalid, do nothing
@@ -401,14 +572,14 @@ auto Halite::process_docking_move(
     }
 
     auto& planet = game_map.planets.at(planet_id);
-    if (!planet.is_alive() || !ship.can_dock(planet)) {
+    if (!planet.is_alive() || !ship.can_dock(planet, options.constants)) {
         // Ship too far/not stationary/etc
         return;
     }
 
     if (planet.frozen) {
         // Planet is frozen, accumulate damage
-        simultaenous_docking[planet_id][player_id].push_back(ship_id);
+        attempt(player_id, ship_id);
         return;
     }
 
@@ -422,7 +593,7 @@ auto Halite::process_docking_move(
         planet.docked_ships.size() < planet.docking_spots) {
         ship.docked_planet = planet_id;
         ship.docking_status = hlt::DockingStatus::Docking;
-        ship.docking_progress = hlt::GameConstants::get().DOCK_TURNS;
+        ship.docking_progress = options.constants.DOCK_TURNS;
         planet.add_ship(ship_idx);
     }
     else if (planet.owner != player_id) {
@@ -434,7 +605,7 @@ auto Halite::process_docking_move(
             [&](hlt::EntityIndex ship_idx) -> bool {
                 const auto& ship = game_map.get_ship(planet.owner, ship_idx);
                 return ship.docking_status == hlt::DockingStatus::Docking &&
-                    ship.docking_progress == hlt::GameConstants::get().DOCK_TURNS;
+                    ship.docking_progress == options.constants.DOCK_TURNS;
             })) {
             // In that case, nobody gets to dock
             assert(!planet.frozen);
@@ -443,28 +614,27 @@ auto Halite::process_docking_move(
             for (auto& docked_ship_index : planet.docked_ships) {
                 auto& ship = game_map.get_ship(planet.owner, docked_ship_index);
                 ship.reset_docking_status();
-                simultaenous_docking[planet_id][planet.owner].push_back(
-                    hlt::EntityId::for_ship(planet.owner, docked_ship_index)
-                );
+                attempt(planet.owner, hlt::EntityId::for_ship(planet.owner, docked_ship_index));
             }
 
-            planet.docked_ships.clear();
+            planet.clear_ships();
             planet.owned = false;
             planet.owner = 0;
 
             // Accumulate damage
-            simultaenous_docking[planet_id][player_id].push_back(ship_id);
+            attempt(player_id, ship_id);
         }
     } else {
         // Too many of the owner's ships are trying to dock. Add them to the
         // simultaneous docking list in case a contention fight starts.
-        simultaenous_docking[planet_id][player_id].push_back(ship_id);
+        attempt(player_id, ship_id);
     }
 }
 
-auto Halite::process_moves(std::vector<bool>& alive, int move_no) -> SimultaneousDockMap {
+auto Halite::process_moves(std::vector<bool>& alive, int move_no,
+                           SimultaneousDocking& simultaneous_docking) -> void {
     // Keep track of which ships docked simultaneously
-    SimultaneousDockMap simulataneous_docking;
+    simultaneous_docking.clear();
 
     for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
         if (!alive[player_id]){
@@ -476,11 +646,12 @@ auto Halite::process_moves(std::vector<bool>& alive, int move_no) -> Simultaneou
             const auto ship_idx = pair.first;
             auto& ship = pair.second;
 
-            if (player_moves[player_id][move_no].count(ship_idx) == 0){
+            const auto queued_move = player_moves[player_id].find(ship_idx, move_no);
+            if (queued_move == nullptr) {
                 continue;
             }
 
-            auto move = player_moves[player_id][move_no][ship_idx];
+            auto move = *queued_move;
             switch (move.type) {
                 case hlt::MoveType::Noop: break;
                 case hlt::MoveType::Error: break;
@@ -489,8 +660,8 @@ auto Halite::process_moves(std::vector<bool>& alive, int move_no) -> Simultaneou
                         break;
                     }
 
-                    auto angle = move.move.thrust.angle * M_PI / 180.0;
-                    ship.velocity.accelerate_by(move.move.thrust.thrust, angle);
+                    ship.velocity.accelerate_toward(
+                        move.move.thrust.thrust, move.move.thrust.angle, options.constants.MAX_SPEED);
                     break;
                 }
                 case hlt::MoveType::Dock: {
@@ -499,7 +670,7 @@ auto Halite::process_moves(std::vector<bool>& alive, int move_no) -> Simultaneou
                         hlt::EntityId::for_ship(player_id, ship_idx),
                         ship,
                         planet_id,
-                        simulataneous_docking);
+                        simultaneous_docking);
                     break;
                 }
 
@@ -508,19 +679,17 @@ auto Halite::process_moves(std::vector<bool>& alive, int move_no) -> Simultaneou
                         break;
 
                     ship.docking_status = hlt::DockingStatus::Undocking;
-                    ship.docking_progress = hlt::GameConstants::get().DOCK_TURNS;
+                    ship.docking_progress = options.constants.DOCK_TURNS;
+                    game_map.planets.at(ship.docked_planet).ship_undocking();
                     break;
                 }
             }
 
-            auto& move_set = full_player_moves.back();
-            auto& player_moves = move_set[player_id];
-            auto& ship_moves = player_moves[move_no];
-            ship_moves[ship_idx] = move;
+            if (record_history) {
+                full_player_moves.add(player_id, move_no, move);
+            }
         }
     }
-
-    return simulataneous_docking;
 }
 
 auto Halite::find_living_players() -> std::vector<bool> {
@@ -545,7 +714,7 @@ auto Halite::find_living_players() -> std::vector<bool> {
         total_planets++;
         if (planet.owned && !planet.docked_ships.empty()) {
             // Only count a planet as owned if a ship has completed docking
-            const auto num_docked_ships = planet.num_docked_ships(game_map);
+            const auto num_docked_ships = planet.num_docked_ships();
             if (num_docked_ships > 0) {
                 owned_planets[planet.owner]++;
             }
@@ -567,138 +736,253 @@ auto Halite::find_living_players() -> std::vector<bool> {
     return still_alive;
 }
 
-auto Halite::process_events() -> void {
-    std::unordered_set<SimulationEvent> unsorted_events;
-
-    const auto event_horizon = [](const hlt::Ship& ship) -> double {
-        // The size of the ship's event horizon
-        return ship.radius + ship.velocity.magnitude() +
-            hlt::GameConstants::get().WEAPON_RADIUS;
-    };
+/**
+ * The size of a ship's event horizon: anything it could hit or shoot at
+ * this substep is within this distance.
+ */
+template<typename Constants>
+static auto event_horizon(const hlt::Ship& ship, const Constants& policy) -> double {
+    return ship.radius + ship.velocity.magnitude() +
+        policy.get().WEAPON_RADIUS;
+}
 
-    CollisionMap collision_map = CollisionMap(game_map, event_horizon);
-    std::vector<hlt::EntityId> potential_collisions;
+template<typename Constants>
+auto Halite::find_ship_pair_events(hlt::EntityId id1, const hlt::Ship& ship1,
+                                   std::vector<SimulationEvent>& events,
+                                   DetectionScratch& scratch,
+                                   const Constants& policy) const -> void {
+    // Ships that only share inactive cells with ship1 can't interact with it
+    scratch.potential_collisions.clear();
+    collision_map.query_active_into(
+        ship1.location, event_horizon(ship1, policy),
+        scratch.potential_collisions, scratch.grid);
+    // Every pair of ships is only looked at by the first of the two in
+    // detection order, which is ID order. Ships share one radius, so both
+    // would find the same events, and those of the first are what
+    // sort_events would keep anyway.
+    auto& candidates = scratch.potential_collisions;
+    candidates.erase(
+        std::remove_if(candidates.begin(), candidates.end(),
+                       [&id1](const hlt::EntityId& id2) -> bool {
+                           return !(id1 < id2);
+                       }),
+        candidates.end());
+    // Screen all candidates at once, and only run the exact (and much more
+    // expensive) solver on those that can actually be reached this turn
+    scratch.candidates.clear();
+    collision_map.gather_candidates(scratch.potential_collisions, game_map,
+                                    scratch.candidates);
+    screen_candidates(ship1, policy.get().WEAPON_RADIUS,
+                      scratch.candidates);
+    scratch.candidates_tested += scratch.potential_collisions.size();
+    for (size_t i = 0; i < scratch.potential_collisions.size(); i++) {
+        if (!scratch.candidates.reachable[i]) {
+            continue;
+        }
+        scratch.candidates_solved++;
+        const auto& id2 = scratch.potential_collisions[i];
+        const auto& ship2 = game_map.get_ship(id2.player_id(), id2.entity_index());
+        find_events(events, id1, id2, ship1, ship2, policy);
+    }
+}
 
-    for (hlt::PlayerId player1 = 0; player1 < number_of_players; player1++) {
-        for (const auto& pair1 : game_map.ships.at(player1)) {
-            const auto& id1 = hlt::EntityId::for_ship(player1, pair1.first);
-            const auto& ship1 = pair1.second;
-
-            potential_collisions.clear();
-            collision_map.test(
-                pair1.second.location, event_horizon(pair1.second),
-                potential_collisions);
-            for (const auto& id2 : potential_collisions) {
-                const auto& ship2 = game_map.get_ship(id2);
-                find_events(unsorted_events, id1, id2, ship1, ship2);
-            }
+template<typename Constants>
+auto Halite::find_ship_events(hlt::EntityId id1, const hlt::Ship& ship1,
+                              std::vector<SimulationEvent>& events,
+                              DetectionScratch& scratch,
+                              const Constants& policy) const -> void {
+    // Broad phase: unless some cell holds two ships that may interact, no
+    // pair of ships needs testing this turn
+    if (collision_map.num_active_cells > 0) {
+        find_ship_pair_events(id1, ship1, events, scratch, policy);
+    }
 
-            // Possible ship-planet collisions
-            for (hlt::EntityIndex planet_idx = 0; planet_idx < game_map.planets.size(); planet_idx++) {
-                const auto& planet = game_map.planets[planet_idx];
-                if (!planet.is_alive()) {
-                    continue;
-                }
+    // A ship at rest can reach neither a planet nor the map edge
+    if (ship1.velocity.vel_x == 0 && ship1.velocity.vel_y == 0) {
+        return;
+    }
 
-                const auto distance = ship1.location.distance(planet.location);
-
-                if (distance <= ship1.velocity.magnitude() + ship1.radius + planet.radius) {
-                    const auto collision_radius = ship1.radius + planet.radius;
-                    const auto t = collision_time(collision_radius, ship1, planet);
-                    if (t.first) {
-                        if (t.second >= 0 && t.second <= 1) {
-                            unsorted_events.insert(SimulationEvent{
-                                SimulationEventType::Collision,
-                                id1, hlt::EntityId::for_planet(planet_idx),
-                                round_event_time(t.second),
-                            });
-                        }
-                    }
-                    else if (distance <= collision_radius) {
-                        // This should never happen - they should already have
-                        // collided
-                        assert(false);
-                    }
+    // Possible ship-planet collisions
+    game_map.planets_near(
+        ship1.location, ship1.velocity.magnitude() + ship1.radius,
+        scratch.planets);
+    for (const auto planet_idx : scratch.planets) {
+        const auto& planet = game_map.planets[planet_idx];
+        if (!planet.is_alive()) {
+            continue;
+        }
+        // As for ships, skip the exact solver for planets out of reach
+        scratch.planets_tested++;
+        if (!screen_planet(ship1, planet)) {
+            continue;
+        }
+        scratch.planets_solved++;
+
+        const auto distance = ship1.location.distance(planet.location);
+
+        if (distance <= ship1.velocity.magnitude() + ship1.radius + planet.radius) {
+            const auto collision_radius = ship1.radius + planet.radius;
+            const auto t = collision_time(collision_radius, ship1, planet);
+            if (t.first) {
+                if (t.second >= 0 && t.second <= 1) {
+                    events.push_back(SimulationEvent{
+                        SimulationEventType::Collision,
+                        id1, hlt::EntityId::for_planet(planet_idx),
+                        round_event_time(t.second),
+                    });
                 }
             }
+            else if (distance <= collision_radius) {
+                // This should never happen - they should already have
+                // collided
+                assert(false);
+            }
+        }
+    }
 
-            // Look for ships trying to desert (final location is off map edge)
-            // No case where the ship can be off the map edge in the middle of a
-            // turn but end inside the map (map is convex) given that they start
-            // within the boundaries
-            auto final_location = ship1.location;
-            final_location.move_by(ship1.velocity, 1.0);
-
-            if (!game_map.within_bounds(final_location)) {
-                auto time = 1000000.0;
-                if (ship1.velocity.vel_x != 0.0) {
-                    const auto t1 = -ship1.location.pos_x / ship1.velocity.vel_x;
-                    if (t1 < time && t1 >= 0) time = t1;
-                    const auto t2 = (game_map.map_width - ship1.location.pos_x)
-                        / ship1.velocity.vel_x;
-                    if (t2 < time && t2 >= 0) time = t2;
-                }
+    // Look for ships trying to desert (final location is off map edge)
+    // No case where the ship can be off the map edge in the middle of a
+    // turn but end inside the map (map is convex) given that they start
+    // within the boundaries
+    auto final_location = ship1.location;
+    final_location.move_by(ship1.velocity, 1.0);
+
+    if (!game_map.within_bounds(final_location)) {
+        auto time = 1000000.0;
+        if (ship1.velocity.vel_x != 0.0) {
+            const auto t1 = -ship1.location.pos_x / ship1.velocity.vel_x;
+            if (t1 < time && t1 >= 0) time = t1;
+            const auto t2 = (game_map.map_width - ship1.location.pos_x)
+                / ship1.velocity.vel_x;
+            if (t2 < time && t2 >= 0) time = t2;
+        }
 
-                if (ship1.velocity.vel_y != 0.0) {
-                    const auto t3 = -ship1.location.pos_y / ship1.velocity.vel_y;
-                    if (t3 < time && t3 >= 0) time = t3;
-                    const auto t4 = (game_map.map_height - ship1.location.pos_y)
-                        / ship1.velocity.vel_y;
-                    if (t4 < time && t4 >= 0) time = t4;
-                }
+        if (ship1.velocity.vel_y != 0.0) {
+            const auto t3 = -ship1.location.pos_y / ship1.velocity.vel_y;
+            if (t3 < time && t3 >= 0) time = t3;
+            const auto t4 = (game_map.map_height - ship1.location.pos_y)
+                / ship1.velocity.vel_y;
+            if (t4 < time && t4 >= 0) time = t4;
+        }
+
+        // The time here might actually be slightly off. Example:
+        // pos_y is 156.5, map_height is 160, and vel_y is
+        // -3.4999999999999996. When added, pos_y + vel_y is 160, but
+        // (map_height - pos_y) / vel_y is 1.0000000000000002.
 
-                // The time here might actually be slightly off. Example:
-                // pos_y is 156.5, map_height is 160, and vel_y is
-                // -3.4999999999999996. When added, pos_y + vel_y is 160, but
-                // (map_height - pos_y) / vel_y is 1.0000000000000002.
+        // I have chosen to let the ship crash, allowing the rounding
+        // to take care of the time, since we know the final location
+        // would be definitively out of bounds.
+
+        events.push_back(SimulationEvent{
+            SimulationEventType::Desertion,
+            id1, id1, round_event_time(time),
+        });
+    }
+}
 
-                // I have chosen to let the ship crash, allowing the rounding
-                // to take care of the time, since we know the final location
-                // would be definitively out of bounds.
+auto Halite::process_events() -> void {
+    PhaseTimer detection_timer(profile(), TurnPhase::EventDetection);
+    pending_events.clear();
 
-                unsorted_events.insert(SimulationEvent{
-                    SimulationEventType::Desertion,
-                    id1, id1, round_event_time(time),
-                });
+    if (tournament_constants) {
+        collision_map.update(game_map, [](const hlt::Ship& ship) {
+            return event_horizon(ship, hlt::TournamentConstants{});
+        });
+    }
+    else {
+        const hlt::ConfiguredConstants configured{ options.constants };
+        collision_map.update(game_map, [&configured](const hlt::Ship& ship) {
+            return event_horizon(ship, configured);
+        });
+    }
+    game_map.prepare_planet_index();
+
+    detection_ships.clear();
+    for (hlt::PlayerId player1 = 0; player1 < number_of_players; player1++) {
+        for (const auto& pair1 : game_map.ships.at(player1)) {
+            detection_ships.emplace_back(
+                hlt::EntityId::for_ship(player1, pair1.first), &pair1.second);
+        }
+    }
+
+    // Detection only reads the map, so ships can be split into contiguous
+    // chunks handled in parallel. Concatenating the per-chunk results in
+    // order yields exactly the sequential result.
+    const auto num_ships = detection_ships.size();
+    const auto max_chunks = (num_ships + MIN_SHIPS_PER_DETECTION_THREAD - 1)
+        / MIN_SHIPS_PER_DETECTION_THREAD;
+    const auto num_chunks = std::max<size_t>(1, std::min<size_t>(options.event_threads, max_chunks));
+    detection_scratch.resize(num_chunks);
+    detection_events.resize(num_chunks);
+
+    auto detect_chunk = [&](size_t chunk) -> void {
+        const auto begin = num_ships * chunk / num_chunks;
+        const auto end = num_ships * (chunk + 1) / num_chunks;
+        auto& events = chunk == 0 ? pending_events : detection_events[chunk];
+        events.clear();
+        for (auto i = begin; i < end; i++) {
+            if (tournament_constants) {
+                find_ship_events(
+                    detection_ships[i].first, *detection_ships[i].second,
+                    events, detection_scratch[chunk], hlt::TournamentConstants{});
+            }
+            else {
+                find_ship_events(
+                    detection_ships[i].first, *detection_ships[i].second,
+                    events, detection_scratch[chunk], hlt::ConfiguredConstants{ options.constants });
             }
         }
+    };
+
+    if (num_chunks > 1) {
+        detection_workers->run(num_chunks, detect_chunk);
+    }
+    else {
+        detect_chunk(0);
+    }
+    // Queued in the order they were found, which breaks ties
+    event_queue.clear();
+    for (const auto& event : pending_events) {
+        event_queue.push(event);
+    }
+    for (size_t chunk = 1; chunk < num_chunks; chunk++) {
+        for (const auto& event : detection_events[chunk]) {
+            event_queue.push(event);
+        }
     }
 
-    std::vector<SimulationEvent> sorted_events(unsorted_events.begin(),
-                                               unsorted_events.end());
-    std::sort(
-        sorted_events.begin(), sorted_events.end(),
-        [](const SimulationEvent& ev1, const SimulationEvent& ev2) -> bool {
-            // Sort in reverse since we're using as a queue
-            return ev1.time > ev2.time;
-        });
+    if (profiling) {
+        turn_profile.events_found += event_queue.size();
+        for (auto& scratch : detection_scratch) {
+            turn_profile.candidates_tested += scratch.candidates_tested;
+            turn_profile.candidates_solved += scratch.candidates_solved;
+            turn_profile.planets_tested += scratch.planets_tested;
+            turn_profile.planets_solved += scratch.planets_solved;
+        }
+    }
+    for (auto& scratch : detection_scratch) {
+        scratch.candidates_tested = 0;
+        scratch.candidates_solved = 0;
+        scratch.planets_tested = 0;
+        scratch.planets_solved = 0;
+    }
+    detection_timer.finish();
+    PhaseTimer resolution_timer(profile(), TurnPhase::EventResolution);
 
-    while (!sorted_events.empty()) {
-        // Gather all events that occurred simultaneously
-        std::vector<SimulationEvent> simultaneous_events{ sorted_events.back() };
-        sorted_events.pop_back();
-
-        while (!sorted_events.empty() &&
-            sorted_events.back().time == simultaneous_events.back().time) {
-            simultaneous_events.push_back(sorted_events.back());
-            sorted_events.pop_back();
-        }
-
-        // Get rid of events involving dead entities
-        simultaneous_events.erase(
-            std::remove_if(
-                simultaneous_events.begin(), simultaneous_events.end(),
-                [&](const SimulationEvent& ev) -> bool {
-                    return !game_map.is_valid(ev.id1) || !game_map.is_valid(ev.id2);
-                }),
-            simultaneous_events.end());
+    // Events involving entities that died in an earlier group are dropped
+    // as they come up
+    const auto is_stale = [&](const SimulationEvent& ev) -> bool {
+        return !game_map.is_valid(ev.id1) || !game_map.is_valid(ev.id2);
+    };
+    // Gather all events that occurred simultaneously
+    while (event_queue.pop_simultaneous(simultaneous_events, is_stale)) {
         if (simultaneous_events.empty()){
             continue;
         }
 
-        DamageMap damage_map;
-        std::unordered_map<hlt::EntityId, int> target_count;
-        std::unordered_map<hlt::EntityId, AttackEvent> attackers;
+        damage_map.clear();
+        attacks.clear();
 
         auto update_targets = [&](hlt::EntityId src, hlt::EntityId target, double time) -> void {
             auto& attacker = game_map.get_ship(src);
@@ -708,20 +992,18 @@ auto Halite::process_events() -> void {
                 return;
             }
             // Don't update the actual cooldown until later
-            if (attackers.count(src) == 0) {
-                attackers.insert({src, AttackEvent(src, attacker.location, time, {}, {})});
+            const auto added = attacks.add(src);
+            auto& attack_event = added.first;
+            if (added.second) {
+                // Reset the slot without giving up its storage
+                attack_event.location = attacker.location;
+                attack_event.time = time;
+                attack_event.targets.clear();
+                attack_event.target_locations.clear();
             }
-            auto& attack_event = attackers.at(src);
             attack_event.targets.push_back(target);
             attack_event.target_locations.push_back(
                 game_map.get_ship(target).location);
-
-            auto num_prev_targets = 0;
-            if (target_count.count(src) > 0) {
-                num_prev_targets = target_count[src];
-            }
-
-            target_count[src] = num_prev_targets + 1;
         };
 
         auto credit_damage = [&](hlt::EntityId source,
@@ -729,7 +1011,7 @@ auto Halite::process_events() -> void {
                                  int damage) -> void {
             hlt::PlayerId dealer = 0;
             hlt::PlayerId receiver = 0;
-            switch (source.type) {
+            switch (source.type()) {
             case hlt::EntityType::ShipEntity: {
                 dealer = source.player_id();
                 break;
@@ -739,7 +1021,7 @@ auto Halite::process_events() -> void {
                 return;
             }
 
-            switch (target.type) {
+            switch (target.type()) {
             case hlt::EntityType::PlanetEntity: {
                 const auto& planet = game_map.get_planet(target);
                 if (!planet.owned) return;
@@ -785,55 +1067,52 @@ auto Halite::process_events() -> void {
             }
         }
 
-        auto update_damage = [&](hlt::EntityId src, hlt::EntityId target) -> void {
+        auto update_damage = [&](hlt::EntityId src, hlt::EntityId target,
+                                 size_t num_targets) -> void {
             auto& attacker = game_map.get_ship(src);
 
             // This sets the cooldown too eagerly, but we don't check
             // it again in this frame anyways. There's no need to
             // validate any properties of the attacker - we've already
             // verified them above.
-            attacker.weapon_cooldown = hlt::GameConstants::get().WEAPON_COOLDOWN;
+            attacker.weapon_cooldown = options.constants.WEAPON_COOLDOWN;
 
-            auto prev_damage = 0.0;
-            if (damage_map[target.player_id()].count(target.entity_index()) > 0) {
-                prev_damage = damage_map[target.player_id()][target.entity_index()];
-            }
-            const auto new_damage = hlt::GameConstants::get().WEAPON_DAMAGE / static_cast<double>(target_count[src]);
-            damage_map[target.player_id()][target.entity_index()] = prev_damage + new_damage;
+            const auto added = damage_map.add(target);
+            const auto prev_damage = added.second ? 0.0 : added.first;
+            const auto new_damage = options.constants.WEAPON_DAMAGE / static_cast<double>(num_targets);
+            added.first = prev_damage + new_damage;
         };
 
-        for (const auto& pair : attackers) {
-            full_frame_events.back().push_back(
-                std::unique_ptr<Event>(new AttackEvent(pair.second)));
+        for (const auto& attacker_id : attacks.ships()) {
+            const auto& attack = attacks.at(attacker_id);
+            if (record_events) {
+                full_frame_events.attack(attacker_id, attack.location, attack.time,
+                                         attack.targets, attack.target_locations);
+            }
             // Track damage dealt here so each attacker's damage is only
             // counted once.
-            damage_dealt[pair.first.player_id()] += hlt::GameConstants::get().WEAPON_DAMAGE;
-            // Use the AttackEvents generated above to actually
+            damage_dealt[attacker_id.player_id()] += options.constants.WEAPON_DAMAGE;
+            // Use the attacks found above to actually
             // perform attack calculations. This way, we only perform
             // damage calculations when we're sure there was actually
             // an attack.
-            for (const auto& target: pair.second.targets) {
-                update_damage(pair.first, target);
+            for (const auto& target: attack.targets) {
+                update_damage(attacker_id, target, attack.targets.size());
             }
         }
 
-        process_damage(damage_map, simultaneous_events.back().time);
-
-        game_map.cleanup_entities();
+        process_damage(simultaneous_events.back().time);
     }
-}
-
-auto Halite::process_damage(DamageMap& ship_damage, double time) -> void {
-    for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
-        const auto player_damage = ship_damage[player_id];
 
-        for (const auto& pair : player_damage) {
-            const auto ship_idx = pair.first;
-            const auto damage = static_cast<unsigned short>(pair.second);
+    // Ships killed above stay in the map (dead) until now, so that they
+    // are only removed once; is_valid already skips them.
+    game_map.cleanup_entities();
+}
 
-            damage_entity(hlt::EntityId::for_ship(player_id, ship_idx),
-                          damage, time);
-        }
+auto Halite::process_damage(double time) -> void {
+    for (const auto& ship_id : damage_map.ships()) {
+        const auto damage = static_cast<unsigned short>(damage_map.at(ship_id));
+        damage_entity(ship_id, damage, time);
     }
 }
 
@@ -847,46 +1126,100 @@ auto Halite::process_movement() -> void {
     }
 }
 
-auto Halite::process_dock_fighting(SimultaneousDockMap simultaneous_docking) -> void {
+template<typename Constants>
+auto Halite::update_ships(const Constants& policy) -> void {
+    const auto drag = policy.get().DRAG;
+    const auto max_speed = policy.get().MAX_SPEED;
+#ifdef HALITE_FIXED_POINT
+    const auto scale_drag = true;
+#else
+    const auto scale_drag = policy.get().PHYSICS_VERSION >= 2;
+#endif
+    for (hlt::PlayerId player_id = 0; player_id < number_of_players;
+         player_id++) {
+        for (auto& ship_pair : game_map.ships.at(player_id)) {
+            auto& ship = ship_pair.second;
+            ship.location.move_by(ship.velocity, 1.0);
+
+            // Update inertia/implement drag
+            const auto magnitude = ship.velocity.magnitude();
+            if (magnitude <= drag) {
+                ship.velocity.vel_x = ship.velocity.vel_y = 0;
+            }
+            else if (scale_drag) {
+                const auto scale = std::min<hlt::Scalar>(magnitude - drag, max_speed) / magnitude;
+                ship.velocity.vel_x *= scale;
+                ship.velocity.vel_y *= scale;
+            }
+            else {
+                ship.velocity.accelerate_by(drag, ship.velocity.angle() + M_PI, max_speed);
+            }
+
+            if (ship.weapon_cooldown > 0) {
+                ship.weapon_cooldown--;
+            }
+        }
+    }
+}
+
+auto Halite::process_dock_fighting(SimultaneousDocking& simultaneous_docking) -> void {
     // Have ships that tried to dock simultaneously fight each other
-    const auto damage = hlt::GameConstants::get().WEAPON_DAMAGE;
-    const auto cooldown = hlt::GameConstants::get().WEAPON_COOLDOWN;
+    const auto damage = options.constants.WEAPON_DAMAGE;
+    const auto cooldown = options.constants.WEAPON_COOLDOWN;
 
-    // Process each planet separately
-    for (const auto& planet_entry : simultaneous_docking) {
-        DamageMap damage_map;
+    // Each planet's attempts next to each other, player by player
+    std::sort(simultaneous_docking.begin(), simultaneous_docking.end(),
+              [](const DockingAttempt& a, const DockingAttempt& b) -> bool {
+                  if (a.planet != b.planet) return a.planet < b.planet;
+                  if (a.player != b.player) return a.player < b.player;
+                  return a.order < b.order;
+              });
 
-        std::vector<hlt::EntityId> participants;
-        std::vector<hlt::Location> participant_locations;
+    // Process each planet separately
+    const auto attempts_end = simultaneous_docking.end();
+    for (auto planet_begin = simultaneous_docking.begin(); planet_begin != attempts_end;) {
+        const auto planet_id = planet_begin->planet;
+        const auto planet_end = std::find_if(
+            planet_begin, attempts_end,
+            [&](const DockingAttempt& attempt) -> bool { return attempt.planet != planet_id; });
+        const auto planet_attempts_begin = planet_begin;
+        planet_begin = planet_end;
 
         // If the planet owner was just trying to dock too many ships
         // we can continue, there is no fight occurring.
-        if (planet_entry.second.size() == 1){
+        if (planet_attempts_begin->player == std::prev(planet_end)->player) {
             continue;
         }
 
-        auto damage_others = [&](hlt::PlayerId src_player, double split_damage) {
-            for (auto& other_player : planet_entry.second) {
-                if (other_player.first == src_player){
-                    continue;
-                }
+        damage_map.clear();
+        participants.clear();
+        participant_locations.clear();
 
-                for (auto& other_ship : other_player.second) {
-                    damage_map[other_player.first][other_ship.entity_index()] += split_damage;
-                }
-            }
+        // The ships of each player here, and how many of them fired
+        struct PlayerAttempts {
+            hlt::PlayerId player;
+            std::vector<DockingAttempt>::const_iterator begin, end;
+            unsigned int fired;
+            long total_enemies;
         };
-
-        auto total = 0;
-        for (const auto& player_entry : planet_entry.second) {
-            total += player_entry.second.size();
-        }
-
-        // Process each player individually, summing the damage from enemy ships
-        for (const auto& player_entry : planet_entry.second) {
-            const auto total_enemies = total - player_entry.second.size();
-            const auto split_damage = ((double) damage) / total_enemies;
-            for (const auto& ship_id : player_entry.second) {
+        std::array<PlayerAttempts, hlt::MAX_PLAYERS> players;
+        size_t num_players = 0;
+
+        const auto total = std::distance(planet_attempts_begin, planet_end);
+
+        // Every ship that can fire does, at all the enemy ships here
+        for (auto player_begin = planet_attempts_begin; player_begin != planet_end;) {
+            const auto player_id = player_begin->player;
+            const auto player_end = std::find_if(
+                player_begin, planet_end,
+                [&](const DockingAttempt& attempt) -> bool { return attempt.player != player_id; });
+            auto& attempts = players[num_players++];
+            attempts = PlayerAttempts{
+                player_id, player_begin, player_end, 0,
+                static_cast<long>(total - std::distance(player_begin, player_end)),
+            };
+            for (; player_begin != player_end; ++player_begin) {
+                const auto ship_id = player_begin->ship;
                 if (!game_map.is_valid(ship_id)){
                     continue;
                 }
@@ -900,22 +1233,229 @@ auto Halite::process_dock_fighting(SimultaneousDockMap simultaneous_docking) ->
                 participant_locations.push_back(ship.location);
 
                 ship.weapon_cooldown = cooldown;
-                damage_others(player_entry.first, split_damage);
+                attempts.fired++;
+            }
+        }
+
+        // Each player's fire is split evenly among its enemies here, and
+        // worked out once per player, in player order, so that the damage
+        // a ship takes (truncated by process_damage) doesn't depend on the
+        // order the attempts were made in
+        std::array<double, hlt::MAX_PLAYERS> incoming;
+        const PlayerAttempts* first_fired = nullptr;
+        const PlayerAttempts* second_fired = nullptr;
+        for (size_t target = 0; target < num_players; target++) {
+            incoming[target] = 0.0;
+            for (size_t source = 0; source < num_players; source++) {
+                const auto& attempts = players[source];
+                if (source == target || attempts.fired == 0) continue;
+                incoming[target] += static_cast<double>(attempts.fired * damage) / attempts.total_enemies;
             }
+            if (players[target].fired == 0) continue;
+            if (!first_fired) first_fired = &players[target];
+            else if (!second_fired) second_fired = &players[target];
         }
 
-        process_damage(damage_map, 0.0);
+        // Ships are hit in the order the first player to fire at them
+        // comes in
+        for (size_t source = 0; source < num_players; source++) {
+            const auto& attempts = players[source];
+            if (attempts.fired == 0) continue;
+            for (size_t target = 0; target < num_players; target++) {
+                const auto& targets = players[target];
+                const auto hit_by = &targets == first_fired ? second_fired : first_fired;
+                if (hit_by != &attempts) continue;
+                for (auto other = targets.begin; other != targets.end; ++other) {
+                    const auto added = damage_map.add(other->ship);
+                    added.first = (added.second ? 0.0 : added.first) + incoming[target];
+                }
+            }
+        }
+
+        process_damage(0.0);
         game_map.cleanup_entities();
 
-        const auto planet_id = hlt::EntityId::for_planet(planet_entry.first);
-        full_frame_events.back().emplace_back(
-            std::unique_ptr<Event>(new ContentionAttackEvent(
-                planet_id,
-                game_map.get_planet(planet_id).location,
+        if (record_events) {
+            const auto planet_entity = hlt::EntityId::for_planet(planet_id);
+            full_frame_events.contention(
+                planet_entity,
+                game_map.get_planet(planet_entity).location,
                 participants,
-                participant_locations
-            ))
-        );
+                participant_locations);
+        }
+    }
+}
+
+auto Halite::start_turn_log(const std::vector<bool>& alive) -> void {
+    turn_log.turn = turn_number;
+    turn_log.players.clear();
+    turn_log.times.clear();
+    for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
+        if (!alive[player_id] || error_tags.find(player_id) != error_tags.end() ||
+            !player_logs[player_id]) {
+            continue;
+        }
+        turn_log.players.push_back(player_id);
+        turn_log.times.push_back(response_times[player_id]);
+    }
+    std::swap(logged_moves, player_moves);
+
+    // Only the full log needs the frame, but the commands are listed in the
+    // order of its ships
+    hlt::FrameHistory::Frame frame{};
+    if (turn_detail >= LogDetail::Commands) {
+        frame = full_frames.back();
+    }
+    turn_log_job = std::async(std::launch::async, [this, frame]() -> void {
+        const auto num_logged = turn_log.players.size();
+        turn_log.entries.resize(num_logged);
+
+        for (size_t i = 0; i < num_logged; i++) {
+            const auto player_id = turn_log.players[i];
+            auto& entry = turn_log.entries[i];
+            entry.clear();
+            JsonWriter json(entry);
+            json.begin_object();
+
+            if (turn_detail >= LogDetail::Commands) {
+                const auto player_ships = frame.player_ships(player_id);
+                json.key("Commands").begin_array();
+                for (unsigned int move_no = 0; move_no < options.constants.MAX_QUEUED_MOVES; move_no++) {
+                    for (const auto &ship : player_ships) {
+                        const auto move = logged_moves[player_id].find(ship.id, move_no);
+                        if (move == nullptr) {
+                            continue;
+                        }
+                        move->write_json(json, player_id, move_no);
+                    }
+                }
+                json.end_array();
+
+                if (turn_detail == LogDetail::Full) {
+                    json.key("Planets").begin_array();
+                    for (const auto &planet : frame.living_planets()) {
+                        if (planet.owned && planet.owner == player_id) {
+                            planet.write_json(json);
+                        }
+                    }
+                    json.end_array();
+                    json.key("Ships").begin_array();
+                    for (const auto &ship : player_ships) {
+                        ship.write_json(json);
+                    }
+                    json.end_array();
+                }
+            }
+
+            json.key("Time").value(turn_log.times[i]);
+            json.key("Turn").value(turn_log.turn);
+            json.end_object();
+        }
+    });
+}
+
+auto Halite::finish_turn_log() -> void {
+    if (!turn_log_job.valid()) return;
+    turn_log_job.get();
+
+    for (size_t i = 0; i < turn_log.players.size(); i++) {
+        player_logs[turn_log.players[i]]->write(turn_log.entries[i]);
+    }
+}
+
+auto Halite::simulate_turn(std::vector<bool>& alive) -> void {
+    {
+        PhaseTimer timer(profile(), TurnPhase::Docking);
+        process_docking();
+    }
+
+    // Process queue of moves
+    // Substeps share the collision grid (which only moves the ships that
+    // changed cells) and all the scratch space of event detection
+    const auto num_substeps = static_cast<int>(options.constants.MAX_QUEUED_MOVES);
+    for (int move_no = 0; move_no < num_substeps; move_no++) {
+        PhaseTimer moves_timer(profile(), TurnPhase::Moves);
+        process_moves(alive, move_no, simultaneous_docking);
+        moves_timer.finish();
+        {
+            PhaseTimer timer(profile(), TurnPhase::DockFighting);
+            process_dock_fighting(simultaneous_docking);
+        }
+
+        process_events();
+        if (move_no + 1 < num_substeps) {
+            PhaseTimer timer(profile(), TurnPhase::Movement);
+            process_movement();
+        }
+    }
+
+    {
+        // The last move is made along with drag and cooldowns. Production
+        // doesn't look at velocities or cooldowns, and new ships have
+        // neither, so this can happen before it.
+        PhaseTimer timer(profile(), TurnPhase::Movement);
+        if (tournament_constants) {
+            update_ships(hlt::TournamentConstants{});
+        }
+        else {
+            update_ships(hlt::ConfiguredConstants{ options.constants });
+        }
+    }
+
+    {
+        PhaseTimer timer(profile(), TurnPhase::Production);
+        process_production();
+    }
+#ifdef HALITE_VALIDATE
+    game_map.check_consistency();
+#endif
+}
+
+auto Halite::start_turn_profile() -> void {
+    if (!profiling) return;
+    turn_profile.clear();
+    turn_start_allocations = allocation_count();
+    if (trace) turn_start = TraceFile::clock::now();
+}
+
+auto Halite::finish_turn_profile() -> void {
+    if (!profiling) return;
+    turn_profile.allocations = allocation_count() - turn_start_allocations;
+    game_profile.add(turn_profile);
+    if (profile_csv.is_open()) {
+        profile_csv << turn_profile_csv_row(turn_number, turn_profile) << '\n';
+    }
+    if (trace) {
+        trace->span(TraceFile::ENGINE_THREAD, "turn " + std::to_string(turn_number),
+                    turn_start, TraceFile::clock::now());
+    }
+}
+
+auto Halite::finish_turn_overhead(std::chrono::steady_clock::time_point simulate_start,
+                                  std::chrono::steady_clock::time_point capture_start) -> void {
+    const auto end = overhead_clock();
+    const auto micros = [](std::chrono::steady_clock::time_point from,
+                           std::chrono::steady_clock::time_point to) -> uint32_t {
+        return to > from ? static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(to - from).count()) : 0;
+    };
+    turn_overhead.send = micros(moves_start, waited_bot_sent);
+    turn_overhead.receive = micros(waited_bot_replied, simulate_start);
+    turn_overhead.simulate = micros(simulate_start, capture_start);
+    turn_overhead.capture = micros(capture_start, end);
+    overhead.turns.push_back(turn_overhead);
+
+    if (overhead.budget > 0 && turn_overhead.total() > overhead.budget) {
+        overhead.turns_over_budget++;
+        std::ostringstream message;
+        message << "Turn " << turn_number << ": the engine took " << turn_overhead.total()
+                << " us beyond the bots' think time, over its budget of " << overhead.budget
+                << " us (serialize " << turn_overhead.serialize
+                << ", send " << turn_overhead.send
+                << ", receive " << turn_overhead.receive
+                << ", simulate " << turn_overhead.simulate
+                << ", capture " << turn_overhead.capture << ")";
+        log(LogLevel::Warning, message.str());
     }
 }
 
@@ -924,80 +1464,297 @@ std::vector<bool> Halite::process_next_frame(std::vector<bool> alive) {
     for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++)
         if (alive[player_id]) alive_frame_count[player_id]++;
 
-    full_frame_events.emplace_back();
-    full_player_moves.push_back({ { { } } });
+    if (record_events) {
+        full_frame_events.start_frame();
+    }
+    if (record_history) {
+        full_player_moves.start_turn();
+    }
 
+    start_turn_profile();
     retrieve_moves(alive);
-    process_docking();
-
-    // Process queue of moves
-    for (int move_no = 0; move_no < hlt::MAX_QUEUED_MOVES; move_no++) {
-        auto simultaneous_docked = process_moves(alive, move_no);
-        process_dock_fighting(simultaneous_docked);
+    const auto simulate_start = overhead_clock();
+    simulate_turn(alive);
+    const auto capture_start = overhead_clock();
+
+    // Save map for the replay, once the last turn's log has been built
+    // from the previous one
+    {
+        PhaseTimer timer(profile(), TurnPhase::TurnLog);
+        finish_turn_log();
+    }
+    track_memory();
+    {
+        PhaseTimer timer(profile(), TurnPhase::FrameRecord);
+        if (record_history || turn_detail >= LogDetail::Commands) {
+            full_frames.record(game_map);
+        }
+        if (options.live_stream) stream_frame(false);
+        record_turn_series();
+    }
 
-        process_events();
-        process_movement();
+    // Log game state for the turn
+    if (turn_detail != LogDetail::None) {
+        PhaseTimer timer(profile(), TurnPhase::TurnLog);
+        start_turn_log(alive);
     }
+    finish_turn_profile();
+    if (options.measure_overhead) finish_turn_overhead(simulate_start, capture_start);
 
-    process_production();
-    process_drag();
-    process_cooldowns();
+    // Check if the game is over
+    return find_living_players();
+}
 
-    // Save map for the replay
-    full_frames.push_back(hlt::Map(game_map));
+auto Halite::memory_usage() const -> MemoryUsage {
+    MemoryUsage usage;
+    usage.history = full_frames.memory_usage() + full_frame_events.memory_usage() +
+        full_player_moves.memory_usage() + turn_series.memory_usage();
+    for (const auto& entry : turn_log.entries) {
+        usage.logs += entry.capacity();
+    }
+    usage.networking = networking.memory_usage() + frame.text.capacity() +
+        frame.binary.capacity() + frame.delta.capacity();
+    for (const auto& compressed : frame.compressed) {
+        usage.networking += compressed.capacity();
+    }
+    return usage;
+}
 
-    // Log game state for the turn
-    for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
-        if (!alive[player_id] || error_tags.find(player_id) != error_tags.end()) {
-            continue;
+auto Halite::record_turn_series() -> void {
+    auto& series = turn_series;
+    const auto first = series.ships.size();
+    for (auto values : { &series.ships, &series.health, &series.planets,
+                         &series.ships_produced, &series.damage_dealt }) {
+        values->resize(first + number_of_players, 0);
+    }
+
+    for (hlt::PlayerId player = 0; player < number_of_players; player++) {
+        const auto& ships = game_map.ships[player];
+        series.ships[first + player] = static_cast<uint32_t>(ships.size());
+        uint32_t health = 0;
+        for (const auto& pair : ships) {
+            health += pair.second.health;
         }
+        series.health[first + player] = health;
+        series.ships_produced[first + player] = total_ship_count[player];
+        series.damage_dealt[first + player] = damage_dealt[player];
+    }
+    for (const auto& planet : game_map.planets) {
+        if (planet.is_alive() && planet.owned) {
+            series.planets[first + planet.owner]++;
+        }
+    }
+}
 
-        const auto &player_ships = game_map.ships.at(player_id);
-        const auto &planets = game_map.planets;
+auto Halite::track_memory() -> void {
+    const auto usage = memory_usage();
+    memory.add(usage);
+    if (memory.cap > 0 && memory.lean_turn == 0 && usage.total() > memory.cap) {
+        turn_lean();
+    }
+}
 
-        nlohmann::json ships_json;
-        nlohmann::json commands_json;
-        nlohmann::json planets_json;
+auto Halite::log(LogLevel level, const std::string& message) const -> void {
+    if (!options.quiet_output) ConsoleLog::instance().write(level, options.log_tag, message);
+}
 
-        for (const auto &ship : player_ships) {
-            ships_json += ship.second.output_json(player_id, ship.first);
-        }
+auto Halite::stream_frame(bool start) -> void {
+    // Only what the header and frames need of a replay
+    GameStatistics stats;
+    ReplayOptions replay_options;
+    replay_options.keyframe_interval = LiveStream::KEYFRAME_INTERVAL;
+    Replay replay = {
+        stats,
+        number_of_players,
+        player_names,
+        seed, map_generator, points_of_interest,
+        game_map.map_width, game_map.map_height,
+        options.constants,
+        full_frames, full_frame_events, full_player_moves,
+        replay_options,
+    };
+    if (start) {
+        auto header = replay.live_header();
+        header["type"] = "header";
+        options.live_stream->start_game(header.dump());
+    }
+    // A game that turned lean has no frames left to send
+    if (full_frames.is_summarized()) return;
+
+    // A resumed game starts from a keyframe too
+    const auto frame_idx = full_frames.size() - 1;
+    const auto keyframe = start || frame_idx % LiveStream::KEYFRAME_INTERVAL == 0;
+    std::string text;
+    JsonWriter json(text);
+    json.begin_object();
+    json.key("type").value("frame");
+    json.key("turn").value(frame_idx);
+    json.key("frame");
+    replay.write_live_frame(json, frame_idx, keyframe);
+    json.end_object();
+    options.live_stream->add_frame(std::move(text), keyframe);
+}
 
-        unsigned short planet_count = 0;
+auto Halite::turn_lean() -> void {
+    memory.lean_turn = turn_number;
+    log(LogLevel::Warning, "Over the memory cap; keeping only a moves-only replay and timing logs.");
+    if (record_history) {
+        full_frames.keep_summaries_only();
+        full_frame_events = EventLog();
+        record_events = false;
+    }
+    turn_detail = std::min(turn_detail, LogDetail::Timing);
+}
 
-        for (const auto &planet : planets) {
-            if (planet.owned && planet.owner == player_id && planet.is_alive()) {
-                planet_count++;
-            }
-        }
+auto Halite::write_checkpoint(const std::vector<bool>& living_players,
+                              const std::vector<hlt::PlayerId>& rankings,
+                              const std::mt19937& rng) -> void {
+    auto histograms = [](const std::vector<LatencyHistogram>& histograms_) -> nlohmann::json {
+        auto json = nlohmann::json::array();
+        for (const auto& histogram : histograms_) json.push_back(histogram.to_checkpoint());
+        return json;
+    };
+    std::ostringstream rng_state;
+    rng_state << rng;
+    auto errors = nlohmann::json::array();
+    for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
+        errors.push_back(networking.player_logs_json[player_id]["Error"]);
+    }
+    const nlohmann::json checkpoint{
+        { "turn", turn_number },
+        { "map_players", map_players },
+        { "living_players", living_players },
+        { "rankings", rankings },
+        { "rng", rng_state.str() },
+        { "alive_frame_count", alive_frame_count },
+        { "init_response_times", init_response_times },
+        { "total_frame_response_times", total_frame_response_times },
+        { "max_frame_response_times", max_frame_response_times },
+        { "frame_think_times", histograms(frame_think_times) },
+        { "frame_send_times", histograms(frame_send_times) },
+        { "idle_turns", idle_turns },
+        { "fast_forwarding", fast_forwarding },
+        { "error_tags", error_tags },
+        { "errors", errors },
+    };
 
-        for (hlt::EntityIndex planet_idx = 0;
-            planet_idx < planets.size(); planet_idx++) {
-            const auto &planet = planets[planet_idx];
-            if (planet.owned && planet.owner == player_id && planet.is_alive()) {
-                planets_json += planet.output_json(planet_idx);
-            }
+    GameStatistics stats;
+    ReplayOptions replay_options;
+    replay_options.format = ReplayFormat::Moves;
+    Replay replay = {
+        stats,
+        number_of_players,
+        player_names,
+        seed, map_generator, points_of_interest,
+        game_map.map_width, game_map.map_height,
+        options.constants,
+        full_frames, full_frame_events, full_player_moves,
+        replay_options,
+    };
+
+    // Written next to the last one first, so that a game stopped while
+    // writing it can still be resumed from that one
+    const auto temporary = options.checkpoint_file + ".tmp";
+    try {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) throw std::runtime_error("could not open " + temporary);
+        replay.output_checkpoint(file, checkpoint);
+        file.close();
+        if (!file) throw std::runtime_error("could not write " + temporary);
+#ifdef _WIN32
+        const auto renamed = MoveFileExA(temporary.c_str(), options.checkpoint_file.c_str(),
+                                         MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        const auto renamed = std::rename(temporary.c_str(), options.checkpoint_file.c_str()) == 0;
+#endif
+        if (!renamed) throw std::runtime_error("could not replace " + options.checkpoint_file);
+    }
+    catch (const std::exception& e) {
+        // The game plays on; only resuming it from here is lost
+        log(LogLevel::Error, "Could not write a checkpoint at turn " +
+            std::to_string(turn_number) + ": " + e.what());
+    }
+}
+
+auto Halite::resume_from(const nlohmann::json& checkpoint) -> void {
+    RecordedMoves recorded;
+    try {
+        recorded = read_recorded_moves(checkpoint, number_of_players);
+    }
+    catch (const std::runtime_error& e) {
+        throw std::runtime_error(std::string("Invalid checkpoint: ") + e.what());
+    }
+    if (checkpoint.value("num_players", 0) != number_of_players) {
+        throw std::runtime_error("The checkpoint is of a game with another number of players.");
+    }
+    if (turn_number != 0 || full_frames.size() != 1 ||
+        full_frames.back().checksum() != recorded.checksums.front()) {
+        throw std::runtime_error("The checkpoint is of another game: frame 0 does not match its checksum.");
+    }
+
+    // Play the game out again as it was, up to the checkpoint
+    std::vector<bool> alive(number_of_players, true);
+    for (size_t turn = 0; turn < recorded.moves.size(); turn++) {
+        for (const auto player : recorded.eliminated[turn]) {
+            remove_player(player);
+            alive[player] = false;
+            full_player_moves.eliminate(turn, player);
+        }
+        turn_number++;
+        full_frame_events.start_frame();
+        full_player_moves.start_turn();
+        queue_moves(recorded.moves[turn], game_map, player_moves);
+        simulate_turn(alive);
+        full_frames.record(game_map);
+        record_turn_series();
+        if (full_frames.back().checksum() != recorded.checksums[turn + 1]) {
+            throw std::runtime_error("The checkpoint does not play out the same: frame " +
+                                     std::to_string(turn + 1) + " does not match its checksum.");
         }
+        alive = find_living_players();
+    }
 
-        for (int move_no = 0; move_no < hlt::MAX_QUEUED_MOVES; move_no++) {
-            for (const auto &pair : player_ships) {
-                const auto ship_idx = pair.first;
-                if (player_moves[player_id][move_no].count(ship_idx) == 0){
-                    continue;
-                }
-                const auto &move = player_moves[player_id][move_no][ship_idx];
-                commands_json += move.output_json(player_id, move_no);
+    const auto& state = checkpoint.at("checkpoint");
+    try {
+        // Everything kept for each player must be there for each player
+        auto per_player = [&](const char* key) -> const nlohmann::json& {
+            const auto& value = state.at(key);
+            if (!value.is_array() || value.size() != number_of_players) {
+                throw std::out_of_range(std::string("bad ") + key);
             }
+            return value;
+        };
+        if (state.at("turn").get<unsigned int>() != turn_number) {
+            throw std::out_of_range("bad turn");
         }
-
-        networking.player_logs_json[player_id]["Frames"].back()["Turn"] = turn_number;
-        networking.player_logs_json[player_id]["Frames"].back()["Ships"] = ships_json;
-        networking.player_logs_json[player_id]["Frames"].back()["Planets"] = planets_json;
-        networking.player_logs_json[player_id]["Frames"].back()["Commands"] = commands_json;
+        per_player("living_players");
+        per_player("errors");
+        state.at("rankings").get<std::vector<hlt::PlayerId>>();
+        state.at("rng").get<std::string>();
+
+        alive_frame_count = per_player("alive_frame_count").get<std::vector<unsigned short>>();
+        init_response_times = per_player("init_response_times").get<std::vector<unsigned int>>();
+        total_frame_response_times =
+            per_player("total_frame_response_times").get<std::vector<unsigned int>>();
+        max_frame_response_times =
+            per_player("max_frame_response_times").get<std::vector<unsigned int>>();
+        frame_think_times.clear();
+        for (const auto& histogram : per_player("frame_think_times")) {
+            frame_think_times.push_back(LatencyHistogram::from_checkpoint(histogram));
+        }
+        frame_send_times.clear();
+        for (const auto& histogram : per_player("frame_send_times")) {
+            frame_send_times.push_back(LatencyHistogram::from_checkpoint(histogram));
+        }
+        idle_turns = per_player("idle_turns").get<std::vector<unsigned int>>();
+        fast_forwarding = state.at("fast_forwarding").get<bool>();
+        error_tags = state.at("error_tags").get<std::set<unsigned short>>();
     }
-
-    // Check if the game is over
-    return find_living_players();
+    catch (const std::logic_error& e) {
+        // What the JSON library throws for malformed checkpoints
+        throw std::runtime_error(std::string("Invalid checkpoint: ") + e.what());
+    }
+    resumed = state;
 }
 
 /*
@@ -1007,41 +1764,94 @@ std::vector<bool> Halite::process_next_frame(std::vector<bool> alive) {
 GameStatistics Halite::run_game(std::vector<std::string>* names_,
                                 unsigned int id,
                                 bool enable_replay,
-                                bool enable_compression,
+                                const ReplayOptions& replay_options_,
                                 std::string replay_directory) {
     // For rankings
     std::vector<bool> living_players(number_of_players, true);
     std::vector<hlt::PlayerId> rankings;
 
+    // Resumed from a checkpoint, as it was when written
+    if (!resumed.is_null()) {
+        living_players = resumed["living_players"].get<std::vector<bool>>();
+        rankings = resumed["rankings"].get<std::vector<hlt::PlayerId>>();
+    }
+
+    // Without a replay, only keep what will be output
+    record_history = enable_replay || options.live_stream || !options.checkpoint_file.empty();
+    record_events = record_history;
+    memory = MemoryReport();
+    memory.cap = options.memory_cap;
+    turn_detail = enable_replay || options.always_log ? options.log_detail : LogDetail::None;
+    if (!record_history) {
+        full_frames.keep_latest_only();
+    }
+
     // Game state logs for each player
     for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
         nlohmann::json playerJson;
-        playerJson["Frames"] = nlohmann::json::array();
-        playerJson["Error"] = nlohmann::json::object();
+        playerJson["Error"] = resumed.is_null()
+            ? nlohmann::json::object() : resumed["errors"][player_id];
         networking.player_logs_json += playerJson;
 
     }
 
-    // Send initial package
-    std::vector<std::future<int> > initThreads(number_of_players);
-    for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
-        initThreads[player_id] = std::async(
-            std::launch::async,
-            &Networking::handle_init_networking,
-            &networking,
-            player_id, game_map, ignore_timeout, &player_names[player_id]);
+    // Logs go into the game's shard, unless they are archived
+    auto* const writer = options.output_writer;
+    const auto log_directory = writer != nullptr && writer->options().log_archive.empty()
+        ? writer->game_directory("", id) : std::string();
+    auto log_filename = [&](hlt::PlayerId player_id) -> std::string {
+        return log_directory + std::to_string(player_id) + '-' + std::to_string(id) + ".log";
+    };
+    auto init_entry = [&](hlt::PlayerId player_id) -> nlohmann::json {
+        auto entry = networking.player_logs_json[player_id];
+        entry.erase("Error");
+        return entry;
+    };
+
+    // Write the logs as the game goes if they record every turn; otherwise
+    // they are only written at the end, for the players that need them
+    player_logs.clear();
+    player_logs.resize(number_of_players);
+    if (turn_detail != LogDetail::None) {
+        for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
+            player_logs[player_id].reset(new PlayerLog(log_filename(player_id), writer));
+        }
     }
 
+    if (profiling && !options.profile_file.empty()) {
+        profile_csv.open(options.profile_file);
+        if (!profile_csv.is_open()) {
+            throw std::runtime_error("Could not open profile file " + options.profile_file);
+        }
+        profile_csv << turn_profile_csv_header() << '\n';
+    }
+    if (profiling && !options.trace_file.empty()) {
+        trace.reset(new TraceFile(options.trace_file));
+        trace->name_thread(TraceFile::ENGINE_THREAD, "engine");
+        turn_profile.trace = trace.get();
+    }
+
+    // Send initial package
+    networking.set_delta_base(game_map);
+    const auto init_times = networking.handle_inits_networking(
+        game_map, options.ignore_timeout, options.init_time_limit, player_names);
     for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
-        int time = initThreads[player_id].get();
-        if (time == -1) {
-            kill_player(player_id);
+        const int time = init_times[player_id];
+        if (!living_players[player_id]) {
+            // Out of the game before it was resumed
+            networking.kill_player(player_id);
+        }
+        else if (time == -1) {
+            kill_player(player_id, true);
             living_players[player_id] = false;
             rankings.push_back(player_id);
         }
-        else {
+        else if (resumed.is_null()) {
             init_response_times[player_id] = time;
         }
+        if (player_logs[player_id]) {
+            player_logs[player_id]->write(init_entry(player_id));
+        }
     }
 
     // Override player names with the provided ones
@@ -1049,28 +1859,30 @@ GameStatistics Halite::run_game(std::vector<std::string>* names_,
         player_names.clear();
         for (const auto a : *names_) player_names.push_back(a.substr(0, 30));
     }
+    if (trace) {
+        for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
+            trace->name_thread(TraceFile::bot_thread(player_id),
+                               "bot " + std::to_string(player_id) + ": " + player_names[player_id]);
+        }
+    }
 
-    const auto& constants = hlt::GameConstants::get();
-    const unsigned int max_turn_number = std::min(
-        constants.MAX_TURNS, 100U + (int) (sqrt(game_map.map_width * game_map.map_height)));
+    if (options.live_stream) stream_frame(true);
 
     auto game_complete = [&]() -> bool {
-        const auto num_living_players = std::count(living_players.begin(), living_players.end(), true);
-        return turn_number >= max_turn_number ||
-            (num_living_players <= 1 && number_of_players > 1) ||
-            (num_living_players == 0 && number_of_players == 1);
+        return is_game_over(living_players);
     };
 
-    // Sort ranking by number of ships, using total ship health to break ties.
-    std::function<bool(const hlt::PlayerId&, const hlt::PlayerId&)> comparator =
-        std::bind(&Halite::compare_rankings, this, std::placeholders::_1, std::placeholders::_2);
-
     auto rng = std::mt19937(seed);
+    if (!resumed.is_null()) {
+        std::istringstream rng_state(resumed["rng"].get<std::string>());
+        rng_state >> rng;
+    }
+    auto adjudicated = false;
 
     try {
         while (!game_complete()) {
             turn_number++;
-            if (!quiet_output) std::cout << "Turn " << turn_number << std::endl;
+            log(LogLevel::Info, "Turn " + std::to_string(turn_number));
 
             // Frame logic.
             auto new_living_players = process_next_frame(living_players);
@@ -1083,20 +1895,28 @@ GameStatistics Halite::run_game(std::vector<std::string>* names_,
                 }
             }
 
-            // Shuffle the rankings first, to ensure that in the case of a
-            // tie, a random winner is chosen.
-            std::shuffle(new_rankings.begin(), new_rankings.end(), rng);
-            std::stable_sort(new_rankings.begin(), new_rankings.end(), comparator);
+            rank_together(new_rankings, rng);
             rankings.insert(rankings.end(), new_rankings.begin(), new_rankings.end());
 
             living_players = new_living_players;
+
+            if (options.adjudicate_games && !game_complete() && is_decided(living_players)) {
+                log(LogLevel::Info, "Ranking decided; ending the game.");
+                adjudicated = true;
+                break;
+            }
+            if (!options.checkpoint_file.empty() && options.checkpoint_interval > 0 &&
+                turn_number % options.checkpoint_interval == 0 && !game_complete()) {
+                write_checkpoint(living_players, rankings, rng);
+            }
         }
     }
     catch (hlt::GameAbort err) {
         // early abort in single-player mode
         // (used for evaluating partial games for tutorial mode)
-        std::cout << "Game aborted by player." << std::endl;
+        log(LogLevel::Info, "Game aborted by player.");
     }
+    finish_turn_log();
 
     // Add remaining players to the ranking. Break ties using the same
     // comparison function.
@@ -1104,8 +1924,7 @@ GameStatistics Halite::run_game(std::vector<std::string>* names_,
     for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
         if (living_players[player_id]) new_rankings.push_back(player_id);
     }
-    std::shuffle(new_rankings.begin(), new_rankings.end(), rng);
-    std::stable_sort(new_rankings.begin(), new_rankings.end(), comparator);
+    rank_together(new_rankings, rng);
     rankings.insert(rankings.end(), new_rankings.begin(), new_rankings.end());
 
     // Best player first rather than last.
@@ -1126,11 +1945,23 @@ GameStatistics Halite::run_game(std::vector<std::string>* names_,
         p.average_frame_response_time = total_frame_response_times[player_id]
             / double(alive_frame_count[player_id]); //In milliseconds.
         p.max_frame_response_time = max_frame_response_times[player_id];
+        p.frame_think_times = frame_think_times[player_id];
+        p.frame_send_times = frame_send_times[player_id];
         p.total_ship_count = total_ship_count[player_id];
         p.damage_dealt = damage_dealt[player_id];
+        p.cpu_time = networking.cpu_time(player_id);
         stats.player_statistics.push_back(p);
     }
     stats.error_tags = error_tags;
+    stats.adjudicated = adjudicated;
+    stats.profiled = profiling;
+    stats.profile = game_profile;
+    stats.measured_overhead = options.measure_overhead;
+    stats.overhead = overhead;
+    stats.turns = turn_series;
+    profile_csv.close();
+    turn_profile.trace = nullptr;
+    trace.reset();
 
     // Output gamefile. First try the replays folder; if that fails, just use the straight filename.
     std::stringstream filename_buf;
@@ -1138,118 +1969,352 @@ GameStatistics Halite::run_game(std::vector<std::string>* names_,
     filename_buf << "-" << seed;
     filename_buf << "-" << game_map.map_width;
     filename_buf << "-" << game_map.map_height;
-    filename_buf << "-" << id << ".hlt";
-    auto filename = filename_buf.str();
+    filename_buf << "-" << id;
+    const auto basename = filename_buf.str();
+    // A game that turned lean only kept what a moves-only replay needs
+    auto replay_options = replay_options_;
+    if (memory.lean_turn > 0) {
+        replay_options.format = ReplayFormat::Moves;
+        replay_options.preview_interval = 0;
+    }
+    if (memory.cap > 0) {
+        // Compress the replay within what the game leaves of the cap
+        const auto held = memory_usage().total();
+        replay_options.memory_budget = held < memory.cap ? memory.cap - held : 1;
+    }
+    const auto filename = basename + replay_extension(replay_options.format);
 
     if (enable_replay) {
         // Don't bother writing the replay if someone errored right away,
         // except if verbose output is disabled, in which case the game
         // coordinator would still like the info.
-        if (turn_number <= 1 && !quiet_output && error_tags.size() > 0) {
-            std::cout << "Skipping replay (bot errored on first turn).\n";
+        if (turn_number <= 1 && !options.quiet_output && error_tags.size() > 0) {
+            log(LogLevel::Info, "Skipping replay (bot errored on first turn).");
         }
         else {
-            Replay replay = {
-                stats,
-                number_of_players,
-                player_names,
-                seed, map_generator, points_of_interest,
-                game_map.map_width, game_map.map_height,
-                full_frames, full_frame_events, full_player_moves,
-            };
-            stats.output_filename = replay_directory + "Replays/" + filename;
-            try {
-                replay.output(stats.output_filename, enable_compression);
+            // Open the file right away, so that its name is known even if
+            // the replay is written in the background
+            std::unique_ptr<ReplaySink> file;
+            // The preview goes next to the replay, always as JSON
+            std::unique_ptr<ReplaySink> preview_file;
+            const auto preview_name = basename + ".preview.hlt";
+            if (!replay_options.sink_command.empty()) {
+                stats.output_filename = filename;
+                file = ReplaySink::command(replay_options.sink_command, filename);
+                if (replay_options.preview_interval > 0) {
+                    stats.preview_filename = preview_name;
+                    preview_file = ReplaySink::command(replay_options.sink_command, preview_name);
+                }
             }
-            catch (std::runtime_error& e) {
-                stats.output_filename = replay_directory + filename;
-                replay.output(stats.output_filename, enable_compression);
+            else {
+                auto game_directory = [&](const std::string& directory) -> std::string {
+                    return writer != nullptr ? writer->game_directory(directory, id) : directory;
+                };
+                stats.output_filename = game_directory(replay_directory + "Replays/") + filename;
+                try {
+                    file = ReplaySink::file(stats.output_filename);
+                }
+                catch (const std::runtime_error&) {
+                    stats.output_filename = game_directory(replay_directory) + filename;
+                    file = ReplaySink::file(stats.output_filename);
+                }
+                if (replay_options.preview_interval > 0) {
+                    stats.preview_filename = stats.output_filename.substr(
+                        0, stats.output_filename.size() - filename.size()) + preview_name;
+                    preview_file = ReplaySink::file(stats.preview_filename);
+                }
             }
-            if (!quiet_output) {
-                std::cout << "Map seed was " << seed << std::endl
-                          << "Opening a file at " << stats.output_filename
-                          << std::endl;
+
+            if (replay_options.asynchronous) {
+                start_replay_job(stats, std::move(file), std::move(preview_file),
+                                 replay_options);
             }
+            else {
+                Replay replay = {
+                    stats,
+                    number_of_players,
+                    player_names,
+                    seed, map_generator, points_of_interest,
+                    game_map.map_width, game_map.map_height,
+                    options.constants,
+                    full_frames, full_frame_events, full_player_moves,
+                    replay_options,
+                };
+                auto usage = memory_usage();
+                // What is left of a file is flushed on the writer's thread
+                auto close = [&](std::unique_ptr<ReplaySink>& sink, const std::string& name) {
+                    if (writer != nullptr && replay_options.sink_command.empty()) {
+                        writer->close(std::move(sink), name);
+                    }
+                    else {
+                        sink->close();
+                    }
+                };
+                try {
+                    usage.replay = replay.output(file->stream());
+                    close(file, stats.output_filename);
+                    if (preview_file) {
+                        usage.replay = std::max(
+                            usage.replay, uint64_t(replay.output_preview(preview_file->stream())));
+                        close(preview_file, stats.preview_filename);
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Could not write replay " << stats.output_filename
+                              << ": " << e.what() << '\n';
+                }
+                memory.add(usage);
+            }
+            log(LogLevel::Info, "Map seed was " + std::to_string(seed) + "\n"
+                "Opening a file at " + stats.output_filename);
         }
     }
 
-    // Output logs for players that timed out or errored.
-    auto logs = nlohmann::json::object();
+    stats.memory = memory;
+
+    // Keep the logs of players that timed out or errored.
+    error_logs = nlohmann::json::object();
 
     for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
-        if (!always_log && error_tags.find(player_id) == error_tags.end()) {
+        auto& log = player_logs[player_id];
+        if (!options.always_log && error_tags.find(player_id) == error_tags.end()) {
+            if (log) log->discard();
             continue;
         }
 
-        auto log_filename =
-            std::to_string(player_id) + '-' + std::to_string(id) + ".log";
+        if (!log) {
+            log.reset(new PlayerLog(log_filename(player_id), writer));
+            log->write(init_entry(player_id));
+        }
+        const auto& error = networking.player_logs_json[player_id]["Error"];
+        if (!error.empty()) {
+            log->write(nlohmann::json{ { "Error", error } });
+        }
+        uint64_t dropped = 0;
+        const auto error_output = networking.stderr_output(player_id, &dropped);
+        if (!error_output.empty()) {
+            nlohmann::json entry{ { "Stderr", error_output } };
+            if (dropped != 0) entry["StderrDropped"] = dropped;
+            log->write(entry);
+        }
+        log->close();
 
-        stats.log_filenames.push_back(log_filename);
-        logs[std::to_string((int) player_id)] = log_filename;
-        std::ofstream file(log_filename,
-                           std::ios_base::binary);
-        file << networking.player_logs_json.dump(1) << std::endl;
-        file.flush();
-        file.close();
+        stats.log_filenames.push_back(log->filename());
+        error_logs[std::to_string((int) player_id)] = log->filename();
     }
 
-    if (quiet_output) {
-        // Write out machine-readable log of what happened
-        nlohmann::json results;
-        results["replay"] = stats.output_filename;
-        results["map_seed"] = seed;
-        results["map_generator"] = map_generator;
-        results["map_width"] = game_map.map_width;
-        results["map_height"] = game_map.map_height;
-        results["gameplay_parameters"] = hlt::GameConstants::get().to_json();
-        results["error_logs"] = logs;
-        results["stats"] = stats;
-
-        std::cout << results.dump(4) << std::endl;
+    if (options.live_stream) {
+        options.live_stream->end_game(nlohmann::json{
+            { "type", "end" }, { "results", results_json(stats) } }.dump());
     }
 
+    // So that the caller can print to the same stream after it
+    ConsoleLog::instance().flush();
     return stats;
 }
 
+//! What a replay written in the background needs, moved out of the game.
+struct ReplayJob {
+    GameStatistics stats;
+    std::vector<std::string> player_names;
+    std::vector<mapgen::PointOfInterest> points_of_interest;
+    hlt::FrameHistory full_frames;
+    EventLog full_frame_events;
+    hlt::MoveHistory full_player_moves;
+    ReplayOptions options;
+    std::unique_ptr<ReplaySink> file;
+    //! Only set if a preview is written.
+    std::unique_ptr<ReplaySink> preview_file;
+};
+
+auto Halite::start_replay_job(const GameStatistics& stats, std::unique_ptr<ReplaySink> file,
+                              std::unique_ptr<ReplaySink> preview_file,
+                              const ReplayOptions& replay_options) -> void {
+    auto job = std::make_shared<ReplayJob>();
+    job->stats = stats;
+    job->player_names = player_names;
+    job->points_of_interest = points_of_interest;
+    job->full_frames = std::move(full_frames);
+    job->full_frame_events = std::move(full_frame_events);
+    job->full_player_moves = std::move(full_player_moves);
+    job->options = replay_options;
+    job->file = std::move(file);
+    job->preview_file = std::move(preview_file);
+
+    const auto players = number_of_players;
+    const auto game_seed = seed;
+    const auto generator = map_generator;
+    const auto width = game_map.map_width;
+    const auto height = game_map.map_height;
+    const auto game_constants = options.constants;
+    // Only files are synced, not what commands are sent
+    auto* const writer = replay_options.sink_command.empty() ? options.output_writer : nullptr;
+    replay_job = std::async(std::launch::async, [=]() {
+        Replay replay = {
+            job->stats,
+            players,
+            job->player_names,
+            game_seed, generator, job->points_of_interest,
+            width, height,
+            game_constants,
+            job->full_frames, job->full_frame_events, job->full_player_moves,
+            job->options,
+        };
+        try {
+            replay.output(job->file->stream());
+            job->file->close();
+            if (writer != nullptr) writer->sync(job->stats.output_filename);
+            if (job->preview_file) {
+                replay.output_preview(job->preview_file->stream());
+                job->preview_file->close();
+                if (writer != nullptr) writer->sync(job->stats.preview_filename);
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Could not write replay " << job->stats.output_filename
+                      << ": " << e.what() << '\n';
+        }
+    });
+}
+
+auto Halite::take_replay_job() -> std::future<void> {
+    return std::move(replay_job);
+}
+
+auto Halite::results_json(const GameStatistics& stats) const -> nlohmann::json {
+    nlohmann::json results;
+    results["replay"] = stats.output_filename;
+    if (!stats.preview_filename.empty()) {
+        results["replay_preview"] = stats.preview_filename;
+    }
+    results["map_seed"] = seed;
+    results["map_generator"] = map_generator;
+    results["map_width"] = game_map.map_width;
+    results["map_height"] = game_map.map_height;
+    results["gameplay_parameters"] = options.constants.to_json();
+    results["error_logs"] = error_logs;
+    results["stats"] = stats;
+    results["adjudicated"] = stats.adjudicated;
+    if (stats.profiled) {
+        results["profile"] = stats.profile;
+    }
+    if (stats.measured_overhead) {
+        results["engine_overhead"] = stats.overhead;
+    }
+    results["memory"] = stats.memory;
+    return results;
+}
+
 std::string Halite::get_name(hlt::PlayerId player_tag) {
     return player_names[player_tag];
 }
 
+auto Halite::release_bot(hlt::PlayerId player_tag) -> hlt::possibly<Networking::BotProcess> {
+    return networking.release_bot(player_tag);
+}
+
 //Public Functions -------------------
 Halite::Halite(unsigned short width_,
                unsigned short height_,
                unsigned int seed_,
                unsigned short n_players_for_map_creation,
                Networking networking_,
-               bool should_ignore_timeout) {
-    networking = networking_;
+               const GameOptions& options_) {
+    networking = std::move(networking_);
+    init_options(options_);
     // number_of_players is the number of active bots to start the match; it
     // is constant throughout game
     number_of_players = networking.player_count();
 
+    init_game(width_, height_, seed_, n_players_for_map_creation);
+}
+
+Halite::Halite(mapgen::GeneratedMap map_,
+               Networking networking_,
+               const GameOptions& options_) {
+    networking = std::move(networking_);
+    init_options(options_);
+    number_of_players = networking.player_count();
+
+    init_game(std::move(map_));
+}
+
+Halite::Halite(unsigned short width_,
+               unsigned short height_,
+               unsigned int seed_,
+               unsigned short n_players,
+               const GameOptions& options_) {
+    init_options(options_);
+    // There's nobody to read what it prints
+    options.quiet_output = true;
+    number_of_players = n_players;
+
+    init_game(width_, height_, seed_, n_players);
+    init_in_process();
+}
+
+Halite::Halite(mapgen::GeneratedMap map_, const GameOptions& options_) {
+    init_options(options_);
+    options.quiet_output = true;
+    number_of_players = map_.key.num_players;
+
+    init_game(std::move(map_));
+    init_in_process();
+}
+
+auto Halite::init_options(const GameOptions& options_) -> void {
+    options = options_;
+    options.event_threads = std::max(1U, options.event_threads);
+    overhead.budget = options.overhead_budget;
+    detection_workers.reset(options.event_threads > 1 ? new WorkerPool(options.event_threads) : nullptr);
+    tournament_constants = options.constants.is_default();
+    networking.set_quiet(options.quiet_output);
+    networking.set_log_tag(options.log_tag);
+    networking.set_constants(options.constants);
+    networking.set_time_limits(options.frame_time_limit, options.time_bank);
+}
+
+auto Halite::init_in_process() -> void {
+    record_history = false;
+    record_events = false;
+    turn_detail = LogDetail::None;
+    full_frames.keep_latest_only();
+    stepped_alive = std::vector<bool>(number_of_players, true);
+}
+
+auto Halite::init_game(unsigned short width_, unsigned short height_,
+                       unsigned int seed_,
+                       unsigned short n_players_for_map_creation) -> void {
     //Initialize map
-    if (!quiet_output) {
-        std::cout
-            << "Seed: " << seed_
-            << " Dimensions: " << width_ << 'x' << height_ << std::endl;
-    }
+    log(LogLevel::Info, "Seed: " + std::to_string(seed_) + " Dimensions: "
+        + std::to_string(width_) + 'x' + std::to_string(height_));
+
+    const auto key = mapgen::MapKey::current(
+        options.map_generator_name, seed_, width_, height_, number_of_players, n_players_for_map_creation,
+        options.constants);
+    init_game(options.map_cache_directory.empty()
+              ? mapgen::generate_map(key, options.constants)
+              : mapgen::MapCache(options.map_cache_directory).get(key, options.constants));
+}
 
-    auto generator = mapgen::SolarSystem(seed_);
-    seed = seed_;
-    map_generator = generator.name();
-    game_map = hlt::Map(width_, height_);
-    points_of_interest = generator.generate(game_map, number_of_players, n_players_for_map_creation);
+auto Halite::init_game(mapgen::GeneratedMap map) -> void {
+    seed = map.key.seed;
+    map_generator = map.key.generator;
+    map_players = map.key.effective_players;
+    game_map = std::move(map.map);
+    points_of_interest = std::move(map.points_of_interest);
 
     // Default initialize
-    player_moves = { { { {} } } };
+    player_moves = hlt::MoveQueue(number_of_players);
+    logged_moves = hlt::MoveQueue(number_of_players);
     turn_number = 0;
     player_names = std::vector<std::string>(number_of_players);
 
     // Add to full game:
-    full_frames.push_back({ hlt::Map(game_map) });
-
-    // Check if timeout should be ignored.
-    ignore_timeout = should_ignore_timeout;
+    record_history = true;
+    record_events = true;
+    turn_detail = LogDetail::Full;
+    full_frames.record(game_map);
 
     // Init statistics
     alive_frame_count = std::vector<unsigned short>(number_of_players, 1);
@@ -1259,14 +2324,274 @@ Halite::Halite(unsigned short width_,
     total_ship_count = std::vector<unsigned int>(number_of_players);
     kill_count = std::vector<unsigned int>(number_of_players);
     damage_dealt = std::vector<unsigned int>(number_of_players);
+    turn_series = TurnSeries();
+    turn_series.num_players = number_of_players;
+    record_turn_series();
     total_frame_response_times = std::vector<unsigned int>(number_of_players);
     max_frame_response_times = std::vector<unsigned int>(number_of_players);
+    frame_think_times = std::vector<LatencyHistogram>(number_of_players);
+    frame_send_times = std::vector<LatencyHistogram>(number_of_players);
+    idle_turns = std::vector<unsigned int>(number_of_players);
+    fast_forwarding = false;
     error_tags = std::set<unsigned short>();
+
+    profiling = options.profile_turns;
+    game_profile = GameProfile();
+}
+
+auto Halite::max_turn_number() const -> unsigned int {
+    return std::min(
+        options.constants.MAX_TURNS, 100U + (int) (sqrt(game_map.map_width * game_map.map_height)));
+}
+
+auto Halite::is_game_over(const std::vector<bool>& living_players) const -> bool {
+    const auto num_living_players = std::count(living_players.begin(), living_players.end(), true);
+    return turn_number >= max_turn_number() ||
+        (num_living_players <= 1 && number_of_players > 1) ||
+        (num_living_players == 0 && number_of_players == 1);
+}
+
+auto Halite::is_decided(const std::vector<bool>& living_players) const -> bool {
+    const auto turns_left = static_cast<unsigned long>(max_turn_number() - turn_number);
+
+    // Every living planet producing as fast as it can, for every turn left
+    unsigned long production = 0;
+    for (const auto& planet : game_map.planets) {
+        if (!planet.is_alive()) continue;
+
+        const auto rate = options.constants.BASE_PRODUCTIVITY +
+            (planet.docking_spots - 1) * options.constants.ADDITIONAL_PRODUCTIVITY;
+        auto planet_production = rate * turns_left;
+        if (!options.constants.INFINITE_RESOURCES) {
+            planet_production = std::min<unsigned long>(
+                planet_production, planet.remaining_production);
+        }
+        production += planet.current_production + planet_production;
+    }
+    const auto max_new_ships = production / options.constants.PRODUCTION_PER_SHIP;
+
+    // Fewest ships produced first
+    std::vector<hlt::PlayerId> ranked;
+    for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
+        if (living_players[player_id]) ranked.push_back(player_id);
+    }
+    if (ranked.size() < 2) {
+        // Nothing to rank (and single-player games always play on)
+        return false;
+    }
+    std::sort(ranked.begin(), ranked.end(),
+              [this](hlt::PlayerId a, hlt::PlayerId b) -> bool {
+                  return total_ship_count[a] < total_ship_count[b];
+              });
+    for (size_t i = 1; i < ranked.size(); i++) {
+        if (total_ship_count[ranked[i]] - total_ship_count[ranked[i - 1]] <= max_new_ships) {
+            return false;
+        }
+    }
+
+    // Players eliminated before the limit rank below the rest whatever
+    // they produced, so the order only stands if no one but the last can
+    // be eliminated: by losing every ship, or by another player coming to
+    // own every planet.
+    const auto reach = turns_left * options.constants.MAX_SPEED;
+    for (size_t i = 0; i < ranked.size(); i++) {
+        if (i > 0 && !has_untouchable_ship(ranked[i], reach)) {
+            return false;
+        }
+        if (i + 1 < ranked.size() && could_own_all_planets(ranked[i], turns_left, max_new_ships)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+auto Halite::has_untouchable_ship(hlt::PlayerId player, double reach) const -> bool {
+    const auto& constants = options.constants;
+    // Spawn spots are up to SPAWN_RADIUS off the crust on either axis
+    const auto spawn_offset = 2.0 * constants.SPAWN_RADIUS;
+
+    for (const auto& pair : game_map.ships.at(player)) {
+        const auto& ship = pair.second;
+        const auto x = static_cast<double>(ship.location.pos_x);
+        const auto y = static_cast<double>(ship.location.pos_y);
+        const auto margin = reach + ship.radius;
+        if (x <= margin || y <= margin ||
+            x >= game_map.map_width - margin || y >= game_map.map_height - margin) {
+            continue;
+        }
+
+        // Both ships may close in on each other every turn
+        const auto ship_reach = 2 * reach + 2 * ship.radius + constants.WEAPON_RADIUS;
+        auto touchable = false;
+        for (hlt::PlayerId other = 0; other < number_of_players && !touchable; other++) {
+            for (const auto& other_pair : game_map.ships.at(other)) {
+                if (other == player && other_pair.first == pair.first) continue;
+                if (static_cast<double>(ship.location.distance(other_pair.second.location)) <= ship_reach) {
+                    touchable = true;
+                    break;
+                }
+            }
+        }
+
+        for (const auto& planet : game_map.planets) {
+            if (touchable) break;
+            if (!planet.is_alive()) continue;
+            const auto distance = static_cast<double>(ship.location.distance(planet.location));
+            // Its explosion (which reaches further than the planet itself),
+            // or a ship it spawns
+            const auto explosion_reach = reach + ship.radius + planet.radius +
+                std::max(planet.radius, constants.DOCK_RADIUS);
+            const auto spawn_reach = planet.radius + spawn_offset + ship_reach;
+            touchable = distance <= std::max(explosion_reach, spawn_reach);
+        }
+
+        if (!touchable) return true;
+    }
+    return false;
+}
+
+auto Halite::could_own_all_planets(hlt::PlayerId player, unsigned long turns_left,
+                                   unsigned long max_new_ships) const -> bool {
+    const auto& constants = options.constants;
+    const auto reach = turns_left * constants.MAX_SPEED;
+    const auto spawn_offset = 2.0 * constants.SPAWN_RADIUS;
+    const auto ship_radius = constants.SHIP_RADIUS;
+
+    for (hlt::EntityIndex planet_idx = 0; planet_idx < game_map.planets.size(); planet_idx++) {
+        const auto& planet = game_map.planets[planet_idx];
+        if (!planet.is_alive()) continue;
+        if (planet.owned && planet.owner == player && !planet.docked_ships.empty()) continue;
+
+        // Ships that could ram it, and the player's ships that could dock
+        // at it (new ones included)
+        unsigned long rammers = max_new_ships;
+        auto dockable = false;
+        for (hlt::PlayerId other = 0; other < number_of_players; other++) {
+            for (const auto& pair : game_map.ships.at(other)) {
+                const auto distance = static_cast<double>(pair.second.location.distance(planet.location));
+                if (distance <= reach + ship_radius + planet.radius) rammers++;
+                if (other == player &&
+                    distance <= reach + ship_radius + planet.radius + constants.DOCK_RADIUS) {
+                    dockable = true;
+                }
+            }
+        }
+
+        // Other planets could explode onto it, or spawn ships next to it
+        auto explodable = false;
+        for (hlt::EntityIndex other_idx = 0; other_idx < game_map.planets.size(); other_idx++) {
+            const auto& other = game_map.planets[other_idx];
+            if (other_idx == planet_idx || !other.is_alive()) continue;
+            const auto distance = static_cast<double>(planet.location.distance(other.location));
+            if (distance <= planet.radius + other.radius + std::max(other.radius, constants.DOCK_RADIUS)) {
+                explodable = true;
+            }
+            if (distance <= other.radius + spawn_offset + ship_radius + reach +
+                constants.DOCK_RADIUS + planet.radius) {
+                dockable = true;
+            }
+        }
+
+        // Docking takes DOCK_TURNS, counting the turn it is ordered
+        if (turns_left < constants.DOCK_TURNS) dockable = false;
+        const auto indestructible = !explodable &&
+            planet.health > rammers * constants.MAX_SHIP_HEALTH;
+        if (!dockable && indestructible) {
+            // The player can't take this planet, so can't take them all
+            return false;
+        }
+    }
+    return true;
+}
+
+auto Halite::step(const hlt::MoveQueue& moves) -> const std::vector<bool>& {
+    turn_number++;
+    for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
+        if (stepped_alive[player_id]) alive_frame_count[player_id]++;
+    }
+
+    if (record_events) {
+        full_frame_events.start_frame();
+    }
+    if (record_history) {
+        full_player_moves.start_turn();
+    }
+
+    player_moves = moves;
+    // Players the caller left out make no moves
+    player_moves.resize(number_of_players);
+    start_turn_profile();
+    simulate_turn(stepped_alive);
+    finish_turn_profile();
+    if (record_history) {
+        full_frames.record(game_map);
+    }
+    record_turn_series();
+    stepped_alive = find_living_players();
+    return stepped_alive;
+}
+
+auto Halite::eliminate_player(hlt::PlayerId player) -> void {
+    remove_player(player);
+    stepped_alive[player] = false;
+    if (record_history) {
+        full_player_moves.eliminate(turn_number, player);
+    }
+}
+
+auto Halite::record_replay() -> void {
+    record_history = true;
+    record_events = true;
+    full_frames = hlt::FrameHistory();
+    full_frames.record(game_map);
+    // Keep a frame of the series for each of the replay's
+    turn_series = TurnSeries();
+    turn_series.num_players = number_of_players;
+    record_turn_series();
+}
+
+auto Halite::write_replay(std::ostream& file, const ReplayOptions& replay_options,
+                          const std::vector<std::string>& names,
+                          const nlohmann::json& stats_json) -> void {
+    player_names = names;
+    player_names.resize(number_of_players);
+    GameStatistics stats;
+    Replay replay = {
+        stats,
+        number_of_players,
+        player_names,
+        seed, map_generator, points_of_interest,
+        game_map.map_width, game_map.map_height,
+        options.constants,
+        full_frames, full_frame_events, full_player_moves,
+        replay_options,
+    };
+    replay.output(file, stats_json);
+}
+
+auto Halite::reset(const hlt::Map& map, unsigned short turn) -> void {
+    game_map = map;
+    turn_number = turn;
+    stepped_alive = find_living_players();
+}
+
+auto Halite::save(Snapshot& snapshot) const -> void {
+    game_map.save(snapshot.map);
+    snapshot.turn_number = turn_number;
+    snapshot.alive = stepped_alive;
+}
+
+auto Halite::restore(const Snapshot& snapshot) -> void {
+    game_map.restore(snapshot.map);
+    turn_number = snapshot.turn_number;
+    stepped_alive = snapshot.alive;
 }
 
 Halite::~Halite() {
-    // Get rid of dynamically allocated memory:
-    for (hlt::PlayerId a = 0; a < number_of_players; a++) {
+    // Get rid of dynamically allocated memory (in-process games have no
+    // bots to kill)
+    for (hlt::PlayerId a = 0; a < networking.player_count(); a++) {
         networking.kill_player(a);
     }
+    networking.finish_teardowns();
 }
@@ -19,38 +19,151 @@
 #include <iostream>
 #include <thread>
 #include <future>
+#include <random>
 
 #include "json.hpp"
 
 #include "hlt.hpp"
+#include "FrameHistory.hpp"
+#include "GameOptions.hpp"
 #include "GameEvent.hpp"
+#include "PlayerLog.hpp"
+#include "ShipScratch.hpp"
+#include "SimulationEvent.hpp"
+#include "LiveStream.hpp"
+#include "Replay.hpp"
+#include "ReplaySink.hpp"
 #include "Statistics.hpp"
+#include "TurnProfile.hpp"
+#include "WorkerPool.hpp"
 #include "mapgen/Generator.hpp"
+#include "mapgen/MapCache.hpp"
 #include "../networking/Networking.hpp"
 
-extern bool quiet_output;
-extern bool always_log;
 
-
-typedef std::array<hlt::entity_map<double>, hlt::MAX_PLAYERS> DamageMap;
-// Map from planet ID to (player ID to list of ships)
-typedef std::unordered_map<hlt::EntityIndex, std::unordered_map<hlt::PlayerId, std::vector<hlt::EntityId>>> SimultaneousDockMap;
+typedef hlt::ShipScratch<double> DamageMap;
+//! A ship that tried to dock to a planet at the same time as others, and
+//! when it did, among the substep's attempts.
+struct DockingAttempt {
+    hlt::EntityIndex planet;
+    hlt::PlayerId player;
+    hlt::EntityId ship;
+    size_t order;
+};
+//! The docking attempts of a substep, in one flat list that is sorted by
+//! planet, player and order, to fight out each planet over a slice of it.
+typedef std::vector<DockingAttempt> SimultaneousDocking;
 
 class Halite {
 private:
     // Networking
     Networking networking;
+    //! How this game is played, including its constants. Nothing else
+    //! about a game is shared with others in the process.
+    GameOptions options;
 
     // Game state
     unsigned short turn_number;
     unsigned short number_of_players;
-    bool ignore_timeout;
     hlt::Map game_map;
     std::vector<std::string> player_names;
     hlt::MoveQueue player_moves;
+    //! The serialized map sent to bots this turn, kept to reuse its storage.
+    Networking::SerializedFrame frame;
+    //! Spatial index of ships for event detection, with their event
+    //! horizons, brought up to date (see CollisionMap::update) for every
+    //! substep.
+    CollisionMap collision_map;
+    //! The ships that docked at once in each substep, kept to reuse its
+    //! storage.
+    SimultaneousDocking simultaneous_docking;
+    //! Spatial index of ships for finding free spawn locations, with their
+    //! actual radii, brought up to date every turn.
+    CollisionMap spawn_map;
+    //! Events found in the current substep (by the first detection
+    //! chunk), kept to reuse its storage.
+    std::vector<SimulationEvent> pending_events;
+    //! The events of the current substep, waiting to be resolved.
+    EventQueue event_queue;
+    //! The group of events being resolved by process_events.
+    std::vector<SimulationEvent> simultaneous_events;
+    //! For each planet, the spots around it where a ship may spawn, nearest
+    //! to the map center first. Planets never move or change size, so these
+    //! are only computed once (see prepare_spawn_locations).
+    std::vector<std::vector<hlt::Location>> spawn_locations;
+
+    //! A ship attacking during a substep, and who it attacks.
+    struct Attack {
+        hlt::Location location;
+        double time;
+        std::vector<hlt::EntityId> targets;
+        std::vector<hlt::Location> target_locations;
+    };
+    //! The damage to each ship, for the group of events or the contended
+    //! planet being resolved; cleared before each.
+    DamageMap damage_map;
+    //! The attacks of the group of events being resolved, by attacker.
+    hlt::ShipScratch<Attack> attacks;
+    //! Planets destroyed whose explosions haven't been resolved yet; they
+    //! explode together, in waves, once the outermost kill_entity call
+    //! gets to them (see explode_planets).
+    std::vector<hlt::EntityIndex> exploding_planets;
+    //! The wave of planets exploding, and what they catch.
+    std::vector<hlt::EntityIndex> explosion_wave;
+    std::vector<hlt::EntityId> explosion_nearby_ships;
+    std::vector<hlt::EntityId> caught_in_explosion;
+    //! The total damage a wave deals to each ship and planet it hits.
+    //! Planets are listed in the order they were first hit; the totals
+    //! can go past what an unsigned short holds.
+    hlt::ShipScratch<unsigned int> explosion_ship_damage;
+    std::vector<unsigned int> explosion_planet_damage;
+    std::vector<hlt::EntityIndex> explosion_planets_hit;
+    bool resolving_explosions = false;
+    //! The ships fighting over the planet being resolved.
+    std::vector<hlt::EntityId> participants;
+    std::vector<hlt::Location> participant_locations;
+
+    //! Working space for finding the events of one ship; one per thread.
+    struct DetectionScratch {
+        CollisionMap::QueryScratch grid;
+        std::vector<hlt::EntityId> potential_collisions;
+        CandidateBatch candidates;
+        std::vector<hlt::EntityIndex> planets;
+        //! See TurnProfile.
+        uint64_t candidates_tested = 0;
+        uint64_t candidates_solved = 0;
+        uint64_t planets_tested = 0;
+        uint64_t planets_solved = 0;
+    };
+
+    //! Don't split event detection into chunks smaller than this, since
+    //! handing a chunk to another thread costs more than checking a few
+    //! ships.
+    constexpr static size_t MIN_SHIPS_PER_DETECTION_THREAD = 64;
+    //! Whether the game constants are the tournament defaults, in which case
+    //! the simulation kernels use their compile-time instantiations.
+    bool tournament_constants;
+    std::vector<std::pair<hlt::EntityId, const hlt::Ship*>> detection_ships;
+    std::vector<DetectionScratch> detection_scratch;
+    //! Events found by each chunk but the first (which writes to
+    //! pending_events directly).
+    std::vector<std::vector<SimulationEvent>> detection_events;
+    //! The threads detection chunks run on besides the game's own, kept
+    //! for the whole game; none with one event thread.
+    std::unique_ptr<WorkerPool> detection_workers;
 
     unsigned int seed;
     std::string map_generator;
+    //! The number of players the map was made for (see mapgen::MapKey).
+    unsigned short map_players;
+    //! The "checkpoint" of the checkpoint the game was resumed from (see
+    //! resume_from), or null.
+    nlohmann::json resumed;
+    //! Log file written for each player that errored (or every player, with
+    //! options.always_log), by player ID.
+    nlohmann::json error_logs;
+    //! The log of each player, if it is written as the game goes.
+    std::vector<std::unique_ptr<PlayerLog>> player_logs;
 
     // Statistics
     std::vector<unsigned short> alive_frame_count;
@@ -60,49 +173,243 @@ private:
     std::vector<unsigned int> total_ship_count;
     std::vector<unsigned int> kill_count;
     std::vector<unsigned int> damage_dealt;
+    //! What each player had at the end of every frame recorded.
+    TurnSeries turn_series;
+    //! Add the current frame to turn_series.
+    auto record_turn_series() -> void;
     std::vector<unsigned int> total_frame_response_times;
     std::vector<unsigned int> max_frame_response_times;
+    std::vector<LatencyHistogram> frame_think_times;
+    std::vector<LatencyHistogram> frame_send_times;
+    //! The microsecond timings of the last turn's responses.
+    std::vector<Networking::ResponseTiming> response_timings;
+    //! The milliseconds each bot took to respond last turn, or -1.
+    std::vector<int> response_times;
+    //! How many turns in a row each bot has sent no moves, and whether
+    //! they are no longer asked for any (see GameOptions::fast_forward_turns).
+    std::vector<unsigned int> idle_turns;
+    bool fast_forwarding;
     std::set<unsigned short> error_tags;
 
     // Full game
+    //! Whether to keep the frames, events and moves of the whole game, for
+    //! the replay. Without a replay, full_frames only holds the latest
+    //! frame (if the player logs need it), and the events and moves aren't
+    //! kept at all.
+    bool record_history;
+    //! Whether to keep the events, for the replay: as record_history,
+    //! until the game turns lean.
+    bool record_events;
+    //! How much of every turn to add to the player logs: options.log_detail,
+    //! or nothing without a replay unless options.always_log is set.
+    LogDetail turn_detail;
     //! A record of the game state at every turn, used for replays.
-    std::vector<hlt::Map> full_frames;
-    std::vector<std::vector<std::unique_ptr<Event>>> full_frame_events;
+    hlt::FrameHistory full_frames;
+    EventLog full_frame_events;
 
     std::vector<mapgen::PointOfInterest> points_of_interest;
-    std::vector<hlt::MoveQueue> full_player_moves;
+    hlt::MoveHistory full_player_moves;
+
+    //! Whether the turns are profiled (see GameOptions::profile_turns), and the profile
+    //! of the current turn and of the game so far.
+    bool profiling;
+    TurnProfile turn_profile;
+    GameProfile game_profile;
+    //! allocation_count() when the current turn started.
+    uint64_t turn_start_allocations;
+    //! The per-turn profile, if written.
+    std::ofstream profile_csv;
+    //! The game's timeline, if written, and when the current turn started.
+    std::unique_ptr<TraceFile> trace;
+    TraceFile::clock::time_point turn_start;
+    //! The profile to add the current turn to, or null if not profiling.
+    auto profile() -> TurnProfile* { return profiling ? &turn_profile : nullptr; }
+    //! Start profiling a turn.
+    auto start_turn_profile() -> void;
+    //! Add the turn profiled to the game's, and write it out.
+    auto finish_turn_profile() -> void;
+
+    //! The engine's overhead on every turn so far, if measured (see
+    //! GameOptions::measure_overhead), and the current turn's.
+    OverheadReport overhead;
+    TurnOverhead turn_overhead;
+    /**
+     * When the current turn's frame started being sent, and when the bot
+     * the turn waited for was sent it and replied (the same time, if no
+     * bot replied), taken by retrieve_moves.
+     */
+    std::chrono::steady_clock::time_point moves_start, waited_bot_sent, waited_bot_replied;
+    //! The time now, if measuring the overhead.
+    auto overhead_clock() const -> std::chrono::steady_clock::time_point {
+        return options.measure_overhead ? std::chrono::steady_clock::now()
+                                        : std::chrono::steady_clock::time_point();
+    }
+    //! Work out the turn's overhead from when simulating it and recording it
+    //! started, add it to overhead, and warn if it is over the budget.
+    auto finish_turn_overhead(std::chrono::steady_clock::time_point simulate_start,
+                              std::chrono::steady_clock::time_point capture_start) -> void;
+
+    //! The high-water marks of the game's memory (see GameOptions::memory_cap).
+    MemoryReport memory;
+    //! What the game holds now; the replay's part is 0.
+    auto memory_usage() const -> MemoryUsage;
+    //! Add the memory held now to memory, and turn lean if it is over the
+    //! cap. Only called between turns, when no job is building log entries.
+    auto track_memory() -> void;
+    //! Keep only what a moves-only replay and timing logs need from now
+    //! on (see GameOptions::memory_cap).
+    auto turn_lean() -> void;
+    //! Print a message through the console log, unless quiet.
+    auto log(LogLevel level, const std::string& message) const -> void;
+    //! Send the frame recorded last to options.live_stream, after the
+    //! game's header if start is set.
+    auto stream_frame(bool start) -> void;
+    //! Write a checkpoint of the game so far to options.checkpoint_file,
+    //! replacing the last one only once it is complete.
+    auto write_checkpoint(const std::vector<bool>& living_players,
+                          const std::vector<hlt::PlayerId>& rankings,
+                          const std::mt19937& rng) -> void;
+
+    //! The players still alive, in an in-process game (see step).
+    std::vector<bool> stepped_alive;
+
+    //! The player log entries for a turn (see start_turn_log).
+    struct TurnLog {
+        unsigned short turn;
+        //! The players logged, and their response times.
+        std::vector<hlt::PlayerId> players;
+        std::vector<int> times;
+        //! The serialized entry for each player.
+        std::vector<std::string> entries;
+    };
+    TurnLog turn_log;
+    //! The moves of the turn being logged. Swapped with player_moves, so
+    //! that the next turn's moves can be read in the meantime.
+    hlt::MoveQueue logged_moves;
 
     //! Grab the next set of moves from the bots
     auto retrieve_moves(std::vector<bool> alive) -> void;
 
     std::vector<bool> process_next_frame(std::vector<bool> alive);
-    void kill_player(hlt::PlayerId player);
+    //! Carry out player_moves: everything in a turn after getting the moves
+    //! and before recording it.
+    auto simulate_turn(std::vector<bool>& alive) -> void;
+    /**
+     * Start building the player log entries for the turn just simulated,
+     * on a background thread, so that it overlaps with the bots thinking
+     * about the next turn.
+     *
+     * The job only reads full_frames.back() and logged_moves, and only
+     * writes turn_log, so those must be left alone until finish_turn_log.
+     */
+    auto start_turn_log(const std::vector<bool>& alive) -> void;
+    //! Wait for the job from start_turn_log, if any, and write its entries
+    //! to the player logs.
+    auto finish_turn_log() -> void;
+    //! Take out a player whose bot errored or timed out, while the moves of
+    //! the current turn are read or, if before_turn is set, before it.
+    void kill_player(hlt::PlayerId player, bool before_turn = false);
+    //! Remove a player's ships (without side effects) and make its planets
+    //! unowned, as when its bot is killed.
+    auto remove_player(hlt::PlayerId player) -> void;
+    //! Finish setting up an in-process game.
+    auto init_in_process() -> void;
+    //! Keep the options (with at least one event thread), and pass what
+    //! Networking needs of them on to it.
+    auto init_options(const GameOptions& options_) -> void;
 
     //! Compute the damage between two colliding ships
     auto compute_damage(hlt::EntityId self_id, hlt::EntityId other_id)
         -> std::pair<unsigned short, unsigned short>;
 
     // Subparts of game loop
-    auto process_damage(DamageMap& ship_damage, double time) -> void;
+    auto process_damage(double time) -> void;
     auto process_docking() -> void;
     auto process_production() -> void;
-    auto process_drag() -> void;
-    auto process_cooldowns() -> void;
+    auto prepare_spawn_locations() -> void;
     auto process_docking_move(
         hlt::EntityId ship_id, hlt::Ship& ship,
         hlt::EntityIndex planet_id,
-        SimultaneousDockMap& simultaenous_docking) -> void;
-    auto process_moves(std::vector<bool>& alive, int move_no) -> SimultaneousDockMap;
-    auto process_dock_fighting(SimultaneousDockMap simultaneous_docking) -> void;
+        SimultaneousDocking& simultaneous_docking) -> void;
+    //! Apply every ship's move_no'th move, noting which ships docked at
+    //! once in simultaneous_docking.
+    auto process_moves(std::vector<bool>& alive, int move_no,
+                       SimultaneousDocking& simultaneous_docking) -> void;
+    //! Have the players that docked to the same planet at once fight for
+    //! it, sorting simultaneous_docking by planet and player to do so.
+    auto process_dock_fighting(SimultaneousDocking& simultaneous_docking) -> void;
     auto process_events() -> void;
+    //! Find all events involving the given ship. Only reads the game state
+    //! and the collision map, so it is safe to call from several threads.
+    //! Constants is a policy from Constants.hpp (see tournament_constants).
+    template<typename Constants>
+    auto find_ship_events(hlt::EntityId id1, const hlt::Ship& ship1,
+                          std::vector<SimulationEvent>& events,
+                          DetectionScratch& scratch,
+                          const Constants& policy) const -> void;
+    //! The part of find_ship_events that looks at other ships.
+    template<typename Constants>
+    auto find_ship_pair_events(hlt::EntityId id1, const hlt::Ship& ship1,
+                               std::vector<SimulationEvent>& events,
+                               DetectionScratch& scratch,
+                               const Constants& policy) const -> void;
     auto process_movement() -> void;
+    //! Move every ship, apply drag and cool down its weapon, in one pass:
+    //! the end-of-turn update, none of which depends on other ships.
+    template<typename Constants>
+    auto update_ships(const Constants& policy) -> void;
     auto find_living_players() -> std::vector<bool>;
+    //! Whether the game ends after this turn: the turn limit was reached,
+    //! or at most one player is left.
+    auto is_game_over(const std::vector<bool>& living_players) const -> bool;
+    auto max_turn_number() const -> unsigned int;
+    /**
+     * Whether the ranking of the players still alive can no longer change
+     * before the turn limit, whatever the bots do: every two of them are
+     * further apart in ships produced than the number of ships all living
+     * planets could still produce, and none but the last can be
+     * eliminated.
+     */
+    auto is_decided(const std::vector<bool>& living_players) const -> bool;
+    //! Whether a ship of player is so far from the edges, every other ship
+    //! and every planet that nothing can reach it within reach of travel.
+    auto has_untouchable_ship(hlt::PlayerId player, double reach) const -> bool;
+    //! Whether player might own every living planet before the turn limit:
+    //! false if one of them can neither be docked at by the player in
+    //! time nor destroyed.
+    auto could_own_all_planets(hlt::PlayerId player, unsigned long turns_left,
+                               unsigned long max_new_ships) const -> bool;
+    //! Generate the map (or get it from the map cache) and set up the
+    //! game, once number_of_players is set.
+    auto init_game(unsigned short width_, unsigned short height_,
+                   unsigned int seed_,
+                   unsigned short n_players_for_map_creation) -> void;
+    //! Set up the game on the given map.
+    auto init_game(mapgen::GeneratedMap map) -> void;
 
     //! Helper to damage an entity and kill it if necessary
     auto damage_entity(hlt::EntityId id, unsigned short damage, double time) -> void;
     //! Helper to kill an entity and clean up any dependents (planet
     //! explosions, docked ships, etc.)
     auto kill_entity(hlt::EntityId id, double time) -> void;
+    /**
+     * Explode the planets in exploding_planets, and any they destroy, one
+     * wave at a time: every planet in a wave damages what is around it,
+     * and only then is the summed damage dealt, so that the planets it
+     * destroys make up the next wave. This kills exactly what exploding
+     * each planet as soon as it died would, since an entity dies once the
+     * damage dealt to it adds up to its health, whatever the order.
+     */
+    auto explode_planets(double time) -> void;
+
+    /**
+     * Write the replay on a background thread (see
+     * ReplayOptions::asynchronous). The frames, events and moves are moved
+     * to the job, so that the game can be destroyed before it finishes.
+     */
+    auto start_replay_job(const GameStatistics& stats, std::unique_ptr<ReplaySink> file,
+                          std::unique_ptr<ReplaySink> preview_file,
+                          const ReplayOptions& replay_options) -> void;
 
     //! Comparison function to rank two players, based on the number of ships
     //! and their total health.
@@ -114,16 +421,145 @@ public:
            unsigned int seed_,
            unsigned short n_players_for_map_creation,
            Networking networking_,
-           bool should_ignore_timeout);
+           const GameOptions& options_);
+    //! A game on a pre-built map (see mapgen::read_map_file), which must
+    //! be for as many players as networking_ has.
+    Halite(mapgen::GeneratedMap map_,
+           Networking networking_,
+           const GameOptions& options_);
+    /**
+     * An in-process game, with no bots: the caller plays every turn with
+     * step. Nothing is kept for replays or logs, so a game only costs its
+     * map and some scratch space. It prints nothing, whatever
+     * options_.quiet_output says.
+     */
+    Halite(unsigned short width_,
+           unsigned short height_,
+           unsigned int seed_,
+           unsigned short n_players,
+           const GameOptions& options_ = GameOptions{});
+    //! An in-process game on a pre-built map (e.g. from mapgen::generate_map),
+    //! for as many players as it was made for.
+    explicit Halite(mapgen::GeneratedMap map_,
+                    const GameOptions& options_ = GameOptions{});
+
+    /**
+     * Play one turn of an in-process game with the given moves, returning
+     * the players still alive.
+     *
+     * The moves are taken as they are, without the checks Networking makes
+     * on bot commands (e.g. thrust is not clamped to MAX_ACCELERATION).
+     * Bots with no ships left are not stopped from moving, but have
+     * nothing to move; whether the game is over is up to the caller.
+     * Players past the end of moves make no moves.
+     */
+    auto step(const hlt::MoveQueue& moves) -> const std::vector<bool>&;
+    /**
+     * Take a player out of an in-process game before the next step, as
+     * run_game does when its bot errors or times out: its ships vanish
+     * without exploding, and its planets are left unowned.
+     */
+    auto eliminate_player(hlt::PlayerId player) -> void;
+    //! The state of the game. Copy it to come back to it later with reset
+    //! (e.g. to explore several moves from one turn).
+    auto get_map() const -> const hlt::Map& { return game_map; }
+    auto get_turn_number() const -> unsigned short { return turn_number; }
+    auto get_player_count() const -> unsigned short { return number_of_players; }
+    //! The players still alive in an in-process game.
+    auto get_living_players() const -> const std::vector<bool>& { return stepped_alive; }
+    //! Whether an in-process game has ended, as run_game would decide.
+    auto is_over() const -> bool { return is_game_over(stepped_alive); }
+    //! The ships a player has had in the game (its first ones included)
+    //! and the damage it has dealt, which run_game ranks players by.
+    auto get_total_ship_count(hlt::PlayerId player) const -> unsigned int { return total_ship_count[player]; }
+    auto get_damage_dealt(hlt::PlayerId player) const -> unsigned int { return damage_dealt[player]; }
+    /**
+     * Order players who went out of the game together (in the same turn,
+     * or by lasting to the end) as run_game ranks them, worst first: by
+     * get_total_ship_count, then get_damage_dealt, with ties broken at
+     * random by rng.
+     */
+    auto rank_together(std::vector<hlt::PlayerId>& players, std::mt19937& rng) const -> void;
+    /**
+     * Put an in-process game back in the given state, which must come from
+     * this game (or another with the same seed and size, since the spawn
+     * spots of planets are kept). Statistics aren't rewound.
+     */
+    auto reset(const hlt::Map& map, unsigned short turn) -> void;
+
+    /**
+     * Keep what a replay holds (every frame, event and move) as an
+     * in-process game is played, starting before its first step. Not to
+     * be combined with reset or restore.
+     */
+    auto record_replay() -> void;
+    /**
+     * Write the replay of an in-process game recorded with record_replay,
+     * with the given player names and "stats" (which in-process games
+     * don't keep).
+     */
+    auto write_replay(std::ostream& file, const ReplayOptions& replay_options,
+                      const std::vector<std::string>& names,
+                      const nlohmann::json& stats_json) -> void;
+
+    /**
+     * Everything that affects how an in-process game plays on from a turn:
+     * the changing parts of the map, the turn number and who is alive.
+     * Replay data, logs and statistics are left out.
+     */
+    struct Snapshot {
+        hlt::MapSnapshot map;
+        unsigned short turn_number;
+        std::vector<bool> alive;
+    };
+    //! Save the state of the game. Reusing a snapshot reuses its storage,
+    //! so forking a search from the same state doesn't allocate.
+    auto save(Snapshot& snapshot) const -> void;
+    //! Go back to a state saved from this game (like reset, statistics
+    //! aren't rewound).
+    auto restore(const Snapshot& snapshot) -> void;
+
+    /**
+     * Pick up a game from a checkpoint of it (see read_checkpoint), before
+     * run_game: replay its turns, checking every frame against the
+     * checkpoint's checksums, and restore what run_game had of the game
+     * when it was written. The game must have been set up as the
+     * checkpointed one was (the same seed, size, constants, generator and
+     * number of players). Throws std::runtime_error if it can't be resumed.
+     *
+     * The bots, newly launched, are sent the current map to initialize
+     * with, as if the game started there; those already out of the game
+     * are killed once they have.
+     */
+    auto resume_from(const nlohmann::json& checkpoint) -> void;
 
     GameStatistics run_game(std::vector<std::string>* names_,
                             unsigned int id,
                             bool enable_replay,
-                            bool enable_compression,
+                            const ReplayOptions& replay_options,
                             std::string replay_directory);
+    //! Machine-readable summary of a finished game, as printed in quiet
+    //! mode.
+    auto results_json(const GameStatistics& stats) const -> nlohmann::json;
     std::string get_name(hlt::PlayerId player_tag);
+    /**
+     * The job writing the replay in the background, if any; waiting for
+     * it (or destroying it) waits for the replay to be written. Otherwise,
+     * the destructor waits for it.
+     */
+    auto take_replay_job() -> std::future<void>;
+    //! Detach a bot that is still running once the game is over, so that
+    //! it can play another game (see Networking::release_bot).
+    auto release_bot(hlt::PlayerId player_tag) -> hlt::possibly<Networking::BotProcess>;
 
     ~Halite();
+
+private:
+    //! Declared last, so that it is destroyed (waiting for the job) before
+    //! anything the job uses.
+    std::future<void> turn_log_job;
+    //! See start_replay_job.
+    std::future<void> replay_job;
 };
 
 #endif
@@ -0,0 +1,142 @@
+#include "JsonWriter.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+auto JsonWriter::key(const char* name) -> JsonWriter& {
+    separate();
+    write_string(name);
+    output += ':';
+    need_comma = false;
+    return *this;
+}
+
+auto JsonWriter::key(uint64_t number) -> JsonWriter& {
+    separate();
+    output += '"';
+    write_unsigned(number);
+    output += "\":";
+    need_comma = false;
+    return *this;
+}
+
+auto JsonWriter::value(double number) -> JsonWriter& {
+    separate();
+    need_comma = true;
+    // As nlohmann::json formats floats (in the C locale): zero is special,
+    // everything else round-trips, and ".0" marks numbers that would read
+    // as integers
+    if (number == 0) {
+        output += std::signbit(number) ? "-0.0" : "0.0";
+        return *this;
+    }
+    char buffer[64];
+    const auto length = std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+    output.append(buffer, static_cast<size_t>(length));
+    if (std::strpbrk(buffer, ".eE") == nullptr) {
+        output += ".0";
+    }
+    return *this;
+}
+
+auto JsonWriter::value(bool flag) -> JsonWriter& {
+    separate();
+    output += flag ? "true" : "false";
+    need_comma = true;
+    return *this;
+}
+
+auto JsonWriter::value(const char* text) -> JsonWriter& {
+    separate();
+    write_string(text);
+    need_comma = true;
+    return *this;
+}
+
+auto JsonWriter::null() -> JsonWriter& {
+    separate();
+    output += "null";
+    need_comma = true;
+    return *this;
+}
+
+auto JsonWriter::raw(const std::string& json) -> JsonWriter& {
+    separate();
+    output += json;
+    need_comma = true;
+    return *this;
+}
+
+auto JsonWriter::write_signed(int64_t number) -> void {
+    if (number < 0) {
+        output += '-';
+        // Negate in unsigned arithmetic, which also works for the minimum
+        write_unsigned(0 - static_cast<uint64_t>(number));
+        return;
+    }
+    write_unsigned(static_cast<uint64_t>(number));
+}
+
+auto JsonWriter::write_unsigned(uint64_t number) -> void {
+    char buffer[20];
+    auto start = buffer + sizeof(buffer);
+    do {
+        *--start = static_cast<char>('0' + number % 10);
+        number /= 10;
+    } while (number != 0);
+    output.append(start, buffer + sizeof(buffer));
+}
+
+auto JsonWriter::write_string(const char* text) -> void {
+    static const char HEX[] = "0123456789abcdef";
+    output += '"';
+    for (auto c = text; *c != '\0'; c++) {
+        switch (*c) {
+            case '"': output += "\\\""; break;
+            case '\\': output += "\\\\"; break;
+            case '\b': output += "\\b"; break;
+            case '\f': output += "\\f"; break;
+            case '\n': output += "\\n"; break;
+            case '\r': output += "\\r"; break;
+            case '\t': output += "\\t"; break;
+            default:
+                if (*c >= 0 && *c < 0x20) {
+                    output += "\\u00";
+                    output += HEX[*c >> 4];
+                    output += HEX[*c & 0x0f];
+                }
+                else {
+                    output += *c;
+                }
+        }
+    }
+    output += '"';
+}
+
+auto decimal_key_less(uint64_t a, uint64_t b) -> bool {
+    auto digits = [](uint64_t number) -> int {
+        auto result = 1;
+        while (number >= 10) {
+            number /= 10;
+            result++;
+        }
+        return result;
+    };
+    const auto digits_a = digits(a);
+    const auto digits_b = digits(b);
+    if (digits_a == digits_b) {
+        return a < b;
+    }
+    // Pad the shorter one with zeros; if it is then equal to the other, it
+    // was a prefix of it. Numbers this long can't be padded, but IDs never
+    // get there.
+    if (digits_a < digits_b) {
+        auto padded = a;
+        for (auto i = digits_a; i < digits_b; i++) padded *= 10;
+        return padded <= b;
+    }
+    auto padded = b;
+    for (auto i = digits_b; i < digits_a; i++) padded *= 10;
+    return a < padded;
+}
@@ -0,0 +1,81 @@
+#ifndef HALITE_JSONWRITER_HPP
+#define HALITE_JSONWRITER_HPP
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+/**
+ * Writes compact JSON text straight into a string, for the bulk of the
+ * replay and the player logs, without building a nlohmann::json document
+ * first.
+ *
+ * The text is exactly what nlohmann::json::dump() would produce for the
+ * same document, numbers included, as long as object keys are written in
+ * sorted order (the order a document's std::map keeps them in). Nothing
+ * checks that the calls make a well-formed document.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& output) : output(output), need_comma(false) {}
+
+    auto begin_object() -> JsonWriter& { return open('{'); }
+    auto end_object() -> JsonWriter& { return close('}'); }
+    auto begin_array() -> JsonWriter& { return open('['); }
+    auto end_array() -> JsonWriter& { return close(']'); }
+
+    auto key(const char* name) -> JsonWriter&;
+    //! A key that is a number, as the replay uses for IDs.
+    auto key(uint64_t number) -> JsonWriter&;
+
+    auto value(double number) -> JsonWriter&;
+    auto value(bool flag) -> JsonWriter&;
+    auto value(const char* text) -> JsonWriter&;
+    auto null() -> JsonWriter&;
+    template<typename T>
+    auto value(T number) ->
+        typename std::enable_if<std::is_integral<T>::value, JsonWriter&>::type {
+        separate();
+        if (std::is_signed<T>::value) {
+            write_signed(static_cast<int64_t>(number));
+        }
+        else {
+            write_unsigned(static_cast<uint64_t>(number));
+        }
+        need_comma = true;
+        return *this;
+    }
+    //! Already serialized JSON, as a value.
+    auto raw(const std::string& json) -> JsonWriter&;
+
+private:
+    std::string& output;
+    //! Whether the next value or key follows another one.
+    bool need_comma;
+
+    auto separate() -> void {
+        if (need_comma) output += ',';
+    }
+    auto open(char bracket) -> JsonWriter& {
+        separate();
+        output += bracket;
+        need_comma = false;
+        return *this;
+    }
+    auto close(char bracket) -> JsonWriter& {
+        output += bracket;
+        need_comma = true;
+        return *this;
+    }
+    auto write_signed(int64_t number) -> void;
+    auto write_unsigned(uint64_t number) -> void;
+    auto write_string(const char* text) -> void;
+};
+
+/**
+ * Whether a is before b when both are written as decimal strings, which is
+ * how a document sorts object keys that are IDs ("10" comes before "2").
+ */
+auto decimal_key_less(uint64_t a, uint64_t b) -> bool;
+
+#endif //HALITE_JSONWRITER_HPP
@@ -0,0 +1,266 @@
+#include "LiveStream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "../zstd-1.3.0/lib/zstd.h"
+#include "../networking/Networking.hpp"
+
+auto LiveStream::start_game(std::string header) -> void {
+    queue(Kind::Header, std::move(header));
+}
+
+auto LiveStream::add_frame(std::string frame, bool keyframe) -> void {
+    queue(keyframe ? Kind::Keyframe : Kind::Delta, std::move(frame));
+}
+
+auto LiveStream::end_game(std::string results) -> void {
+    queue(Kind::End, std::move(results));
+}
+
+auto LiveStream::dropped() -> uint64_t {
+    std::lock_guard<std::mutex> guard(mutex);
+    return num_dropped;
+}
+
+#ifdef _WIN32
+LiveStream::LiveStream(const std::string&, size_t max_backlog_)
+    : max_backlog(max_backlog_) {
+    throw std::runtime_error("Live streaming is not supported on Windows.");
+}
+
+LiveStream::~LiveStream() {}
+
+auto LiveStream::queue(Kind, std::string) -> void {}
+#else
+LiveStream::LiveStream(const std::string& address_, size_t max_backlog_)
+    : max_backlog(max_backlog_) {
+    listener = listen_socket(address_, unix_path, tcp);
+    int wake[2];
+    if (pipe(wake) == -1) {
+        close(listener);
+        if (!unix_path.empty()) remove_socket_file(unix_path);
+        throw std::runtime_error("Could not create a pipe for the live stream.");
+    }
+    wake_read = wake[0];
+    wake_write = wake[1];
+    for (const auto fd : { listener, wake_read, wake_write }) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    sender = std::thread(&LiveStream::run, this);
+}
+
+LiveStream::~LiveStream() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    const char wake = 0;
+    ssize_t ignored = write(wake_write, &wake, 1);
+    (void) ignored;
+    sender.join();
+
+    for (const auto& spectator : spectators) {
+        close(spectator.socket);
+    }
+    close(listener);
+    close(wake_read);
+    close(wake_write);
+    if (!unix_path.empty()) remove_socket_file(unix_path);
+}
+
+auto LiveStream::queue(Kind kind, std::string json) -> void {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        pending.push_back(Pending{ kind, std::move(json) });
+    }
+    // If the pipe is full, the sender is already awake
+    const char wake = 0;
+    ssize_t ignored = write(wake_write, &wake, 1);
+    (void) ignored;
+}
+
+//! The message for a JSON object: its length, then itself compressed.
+//! Empty if it can't be compressed.
+static auto compress_message(ZSTD_CCtx* context, const std::string& json) -> std::string {
+    if (context == nullptr) return std::string();
+    std::string message(4 + ZSTD_compressBound(json.size()), '\0');
+    const auto size = ZSTD_compressCCtx(context, &message[4], message.size() - 4,
+                                        json.data(), json.size(),
+                                        LiveStream::COMPRESSION_LEVEL);
+    if (ZSTD_isError(size)) return std::string();
+    for (int byte = 0; byte < 4; byte++) {
+        message[byte] = static_cast<char>((size >> (8 * byte)) & 0xff);
+    }
+    message.resize(4 + size);
+    return message;
+}
+
+auto LiveStream::send_queued(Spectator& spectator) -> bool {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (!spectator.queue.empty()) {
+        const auto& message = *spectator.queue.front();
+        const auto bytes = send(spectator.socket, message.data() + spectator.offset,
+                                message.size() - spectator.offset, flags);
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        spectator.offset += static_cast<size_t>(bytes);
+        if (spectator.offset == message.size()) {
+            spectator.queued_bytes -= message.size();
+            spectator.queue.pop_front();
+            spectator.offset = 0;
+        }
+    }
+    return true;
+}
+
+auto LiveStream::accept_spectators() -> void {
+    while (true) {
+        const int socket = accept(listener, nullptr, nullptr);
+        if (socket == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+        fcntl(socket, F_SETFD, FD_CLOEXEC);
+        const int on = 1;
+        if (tcp) {
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+#ifdef SO_NOSIGPIPE
+        setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        Spectator spectator{ socket, {}, 0, 0 };
+        for (const auto& message : catch_up) {
+            spectator.queue.push_back(message);
+            spectator.queued_bytes += message->size();
+        }
+        spectators.push_back(std::move(spectator));
+    }
+}
+
+auto LiveStream::run() -> void {
+    std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    std::vector<Pending> batch;
+    std::vector<struct pollfd> fds;
+    bool linger = false;
+    auto linger_until = std::chrono::steady_clock::now();
+
+    while (true) {
+        fds.clear();
+        fds.push_back(pollfd{ wake_read, POLLIN, 0 });
+        fds.push_back(pollfd{ listener, static_cast<short>(linger ? 0 : POLLIN), 0 });
+        for (const auto& spectator : spectators) {
+            const short events = spectator.queue.empty() ? POLLIN : POLLIN | POLLOUT;
+            fds.push_back(pollfd{ spectator.socket, events, 0 });
+        }
+        int timeout = -1;
+        if (linger) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                linger_until - std::chrono::steady_clock::now()).count();
+            timeout = static_cast<int>(std::max<long long>(0, left));
+        }
+        poll(fds.data(), fds.size(), timeout);
+
+        if (fds[0].revents != 0) {
+            char buffer[256];
+            while (read(wake_read, buffer, sizeof(buffer)) > 0) {}
+        }
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            batch.swap(pending);
+            if (stopping && !linger) {
+                linger = true;
+                linger_until = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(LINGER_TIME);
+            }
+        }
+
+        // Compress what was queued, once for every spectator
+        size_t dropped_now = 0;
+        for (const auto& item : batch) {
+            const auto message = std::make_shared<const std::string>(
+                compress_message(context.get(), item.json));
+            if (message->empty()) continue;
+            switch (item.kind) {
+                case Kind::Header:
+                    catch_up.clear();
+                    break;
+                case Kind::Keyframe:
+                    // A spectator joining now only needs the header first
+                    catch_up.resize(std::min<size_t>(catch_up.size(), 1));
+                    break;
+                default:
+                    break;
+            }
+            catch_up.push_back(message);
+            for (auto& spectator : spectators) {
+                if (spectator.socket == -1) continue;
+                if (spectator.queued_bytes + message->size() > max_backlog) {
+                    close(spectator.socket);
+                    spectator.socket = -1;
+                    dropped_now++;
+                    continue;
+                }
+                spectator.queue.push_back(message);
+                spectator.queued_bytes += message->size();
+            }
+        }
+        batch.clear();
+
+        // Spectators only ever read, so anything they send is discarded;
+        // an end of file or error means they are gone
+        for (size_t i = 0; i < spectators.size(); i++) {
+            auto& spectator = spectators[i];
+            if (spectator.socket == -1) continue;
+            bool gone = false;
+            const auto revents = i + 2 < fds.size() ? fds[i + 2].revents : 0;
+            if (revents & POLLIN) {
+                char buffer[256];
+                ssize_t bytes;
+                while ((bytes = recv(spectator.socket, buffer, sizeof(buffer), 0)) > 0) {}
+                gone = bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+            }
+            if (!gone && (revents & (POLLERR | POLLHUP))) gone = true;
+            if (gone || !send_queued(spectator)) {
+                close(spectator.socket);
+                spectator.socket = -1;
+            }
+        }
+        spectators.erase(std::remove_if(spectators.begin(), spectators.end(),
+                                        [](const Spectator& spectator) {
+                                            return spectator.socket == -1;
+                                        }),
+                         spectators.end());
+        if (dropped_now > 0) {
+            std::lock_guard<std::mutex> guard(mutex);
+            num_dropped += dropped_now;
+        }
+
+        if (!linger && (fds[1].revents & POLLIN)) {
+            accept_spectators();
+            for (auto& spectator : spectators) {
+                if (!send_queued(spectator)) {
+                    close(spectator.socket);
+                    spectator.socket = -1;
+                }
+            }
+        }
+
+        if (linger) {
+            const auto all_sent = std::all_of(
+                spectators.begin(), spectators.end(),
+                [](const Spectator& spectator) { return spectator.queue.empty(); });
+            if (all_sent || std::chrono::steady_clock::now() >= linger_until) return;
+        }
+    }
+}
+#endif
@@ -0,0 +1,108 @@
+#ifndef HALITE_LIVESTREAM_HPP
+#define HALITE_LIVESTREAM_HPP
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A game streamed to spectators while it is played, rather than once its
+ * replay is written.
+ *
+ * Spectators connect to the address the stream listens on ("unix:PATH" or
+ * "HOST:PORT", as for listen_socket) and only read. Every message is a
+ * 4-byte little-endian length, then that many bytes of one zstd frame,
+ * which holds a JSON object:
+ *
+ *  - {"type": "header", ...}: the replay header, as far as it is known
+ *    (see Replay::live_header).
+ *  - {"type": "frame", "turn": N, "frame": ...}: the state at the end of
+ *    turn N, as a keyframe every KEYFRAME_INTERVAL turns and as a delta
+ *    frame from the turn before otherwise, both as in a replay with delta
+ *    frames (see Replay::write_live_frame).
+ *  - {"type": "end", "results": ...}: the game's results, as the
+ *    environment prints them with -q.
+ *
+ * A spectator that joins late is sent the header, the last keyframe and
+ * the delta frames since, so it can pick up from there.
+ *
+ * The game only queues each message; a thread of the stream's own
+ * compresses it (once, for every spectator) and sends it. A spectator that
+ * falls more than max_backlog bytes behind is disconnected, so the game
+ * never waits on one.
+ *
+ * POSIX only; on Windows, the constructor throws std::runtime_error.
+ */
+class LiveStream {
+public:
+    //! What a spectator may have waiting to be sent before it is dropped.
+    constexpr static size_t MAX_BACKLOG = 8 << 20;
+    constexpr static unsigned int KEYFRAME_INTERVAL = 30;
+    //! Frames are small and sent right away, so compress them quickly.
+    constexpr static int COMPRESSION_LEVEL = 3;
+    //! How long (in ms) the stream keeps sending what spectators have
+    //! yet to receive once it is destroyed.
+    constexpr static int LINGER_TIME = 2000;
+
+    //! Throws std::runtime_error if address can't be listened on.
+    explicit LiveStream(const std::string& address_, size_t max_backlog_ = MAX_BACKLOG);
+    ~LiveStream();
+    LiveStream(const LiveStream&) = delete;
+    auto operator=(const LiveStream&) -> LiveStream& = delete;
+
+    //! Start streaming a game (replacing the one before), from its header.
+    auto start_game(std::string header) -> void;
+    //! Stream the JSON of a frame of the game.
+    auto add_frame(std::string frame, bool keyframe) -> void;
+    auto end_game(std::string results) -> void;
+
+    //! The number of spectators disconnected for falling behind so far.
+    auto dropped() -> uint64_t;
+
+private:
+    enum class Kind { Header, Keyframe, Delta, End };
+    struct Pending {
+        Kind kind;
+        std::string json;
+    };
+    //! A compressed message with its length, shared by every spectator.
+    using Message = std::shared_ptr<const std::string>;
+    struct Spectator {
+        int socket;
+        std::deque<Message> queue;
+        //! How much of the first message was sent.
+        size_t offset;
+        size_t queued_bytes;
+    };
+
+    const size_t max_backlog;
+    int listener = -1;
+    std::string unix_path;
+    bool tcp = false;
+    //! A pipe that wakes the sender up when messages are queued.
+    int wake_read = -1, wake_write = -1;
+
+    std::mutex mutex;
+    std::vector<Pending> pending;
+    bool stopping = false;
+    uint64_t num_dropped = 0;
+
+    //! What a spectator that joins now is sent first: the header, the
+    //! last keyframe and the frames since. Only used by the sender.
+    std::vector<Message> catch_up;
+    std::vector<Spectator> spectators;
+    std::thread sender;
+
+    auto queue(Kind kind, std::string json) -> void;
+    auto run() -> void;
+    //! Send what the socket takes without blocking. Returns false if the
+    //! spectator has gone.
+    auto send_queued(Spectator& spectator) -> bool;
+    auto accept_spectators() -> void;
+};
+
+#endif //HALITE_LIVESTREAM_HPP
@@ -0,0 +1,193 @@
+#include "LocalGameApi.hpp"
+
+#include <memory>
+#include <random>
+#include <stdexcept>
+
+#include "Halite.hpp"
+#include "../networking/BotInputError.hpp"
+#include "../networking/BuiltinBot.hpp"
+
+struct HaliteLocalGame {
+    std::unique_ptr<Halite> game;
+    GameOptions options;
+    //! Only for reading commands, as it does those of its bots.
+    Networking networking;
+    //! The built-in bot of each player that has one.
+    std::vector<std::unique_ptr<BuiltinBot>> builtins;
+    bool started = false;
+    hlt::MoveQueue moves;
+
+    //! The players out of the game so far, worst first, and who was
+    //! still in it after the last step, as run_game keeps them.
+    std::vector<hlt::PlayerId> rankings;
+    std::vector<bool> alive;
+    std::mt19937 rng;
+    std::vector<unsigned int> last_turn_alive;
+
+    std::string frame;
+    std::string error;
+};
+
+namespace {
+    thread_local std::string create_error;
+
+    //! Add the players that went out since alive was taken to rankings,
+    //! as run_game does after every turn.
+    auto rank_newly_out(const HaliteLocalGame& game, std::vector<hlt::PlayerId>& rankings,
+                        std::vector<bool>& alive, std::mt19937& rng) -> void {
+        const auto& now_alive = game.game->get_living_players();
+        std::vector<hlt::PlayerId> out;
+        for (hlt::PlayerId player = 0; player < game.game->get_player_count(); player++) {
+            if (alive[player] && !now_alive[player]) out.push_back(player);
+        }
+        game.game->rank_together(out, rng);
+        rankings.insert(rankings.end(), out.begin(), out.end());
+        alive = now_alive;
+    }
+
+    auto reset_moves(HaliteLocalGame& game) -> void {
+        const auto ids = game.game->get_map().ship_index_limit();
+        for (auto& queue : game.moves) {
+            queue.reset(ids, game.options.constants.MAX_QUEUED_MOVES);
+        }
+    }
+}
+
+HaliteLocalGame* halite_local_game_create(unsigned int width, unsigned int height,
+                                          unsigned int seed, unsigned int num_players) {
+    try {
+        if (num_players == 0 || num_players > hlt::MAX_PLAYERS) {
+            throw std::invalid_argument("A game is for 1 to " + std::to_string(hlt::MAX_PLAYERS) + " players.");
+        }
+        std::unique_ptr<HaliteLocalGame> local(new HaliteLocalGame);
+        local->game.reset(new Halite(static_cast<unsigned short>(width),
+                                     static_cast<unsigned short>(height),
+                                     seed, static_cast<unsigned short>(num_players),
+                                     local->options));
+        local->networking.set_constants(local->options.constants);
+        local->builtins.resize(num_players);
+        local->moves.resize(num_players);
+        reset_moves(*local);
+        local->alive = local->game->get_living_players();
+        local->rng = std::mt19937(seed);
+        local->last_turn_alive.assign(num_players, 0);
+        return local.release();
+    }
+    catch (const std::exception& e) {
+        create_error = e.what();
+        return nullptr;
+    }
+}
+
+void halite_local_game_destroy(HaliteLocalGame* game) {
+    delete game;
+}
+
+int halite_local_game_set_builtin(HaliteLocalGame* game, unsigned int player,
+                                  const char* command) {
+    if (player >= game->builtins.size() || game->started) {
+        game->error = "Built-in bots are set for players of the game before it starts.";
+        return 1;
+    }
+    try {
+        game->builtins[player].reset(new BuiltinBot(BuiltinBot::policy_of(command)));
+    }
+    catch (const std::invalid_argument& e) {
+        game->error = e.what();
+        return 1;
+    }
+    return 0;
+}
+
+const char* halite_local_game_frame(HaliteLocalGame* game) {
+    serialize_text_map(game->game->get_map(), game->game->get_player_count(), game->frame);
+    return game->frame.c_str();
+}
+
+int halite_local_game_set_moves(HaliteLocalGame* game, unsigned int player,
+                                const char* moves) {
+    if (player >= game->moves.size()) {
+        game->error = "No such player.";
+        return 1;
+    }
+    const auto& map = game->game->get_map();
+    auto& queue = game->moves[player];
+    queue.reset(map.ship_index_limit(), game->options.constants.MAX_QUEUED_MOVES);
+    std::string line(moves);
+    try {
+        game->networking.deserialize_move_set(static_cast<hlt::PlayerId>(player), line, map, queue);
+    }
+    catch (const BotInputError& e) {
+        game->error = e.what();
+        queue.reset(map.ship_index_limit(), game->options.constants.MAX_QUEUED_MOVES);
+        halite_local_game_eliminate(game, player);
+        return 1;
+    }
+    return 0;
+}
+
+void halite_local_game_eliminate(HaliteLocalGame* game, unsigned int player) {
+    if (player < game->game->get_player_count() && game->game->get_living_players()[player]) {
+        game->game->eliminate_player(static_cast<hlt::PlayerId>(player));
+    }
+}
+
+int halite_local_game_step(HaliteLocalGame* game) {
+    const auto& map = game->game->get_map();
+    const auto& alive = game->game->get_living_players();
+    for (hlt::PlayerId player = 0; player < game->game->get_player_count(); player++) {
+        auto& builtin = game->builtins[player];
+        if (!builtin || !alive[player]) continue;
+        if (!game->started) builtin->init(player, map);
+        builtin->queue_moves(player, map, game->options.constants, game->moves[player]);
+    }
+    game->started = true;
+
+    game->game->step(game->moves);
+    rank_newly_out(*game, game->rankings, game->alive, game->rng);
+    for (hlt::PlayerId player = 0; player < game->game->get_player_count(); player++) {
+        if (game->alive[player]) game->last_turn_alive[player] = game->game->get_turn_number();
+    }
+    reset_moves(*game);
+    return game->game->is_over() ? 1 : 0;
+}
+
+unsigned int halite_local_game_turn(const HaliteLocalGame* game) {
+    return game->game->get_turn_number();
+}
+
+int halite_local_game_is_over(const HaliteLocalGame* game) {
+    return game->game->is_over() ? 1 : 0;
+}
+
+int halite_local_game_is_alive(const HaliteLocalGame* game, unsigned int player) {
+    return player < game->game->get_player_count() && game->game->get_living_players()[player] ? 1 : 0;
+}
+
+void halite_local_game_results(HaliteLocalGame* game, HaliteLocalGameResult* results) {
+    // Ranked on copies, so that asking doesn't change how the game goes on
+    auto rankings = game->rankings;
+    auto alive = game->alive;
+    auto rng = game->rng;
+    rank_newly_out(*game, rankings, alive, rng);
+    std::vector<hlt::PlayerId> remaining;
+    for (hlt::PlayerId player = 0; player < game->game->get_player_count(); player++) {
+        if (alive[player]) remaining.push_back(player);
+    }
+    game->game->rank_together(remaining, rng);
+    rankings.insert(rankings.end(), remaining.begin(), remaining.end());
+
+    for (size_t i = 0; i < rankings.size(); i++) {
+        const auto player = rankings[i];
+        auto& result = results[player];
+        result.rank = static_cast<unsigned int>(rankings.size() - i);
+        result.last_turn_alive = game->last_turn_alive[player];
+        result.total_ship_count = game->game->get_total_ship_count(player);
+        result.damage_dealt = game->game->get_damage_dealt(player);
+    }
+}
+
+const char* halite_local_game_error(const HaliteLocalGame* game) {
+    return game != nullptr ? game->error.c_str() : create_error.c_str();
+}
@@ -0,0 +1,99 @@
+#ifndef HALITE_LOCALGAMEAPI_HPP
+#define HALITE_LOCALGAMEAPI_HPP
+
+/**
+ * A C interface to in-process games played the way bots play them: each
+ * turn, every player is given the text frame a bot would be sent and
+ * answers with the line of commands a bot would reply with, which is
+ * checked as the game checks a bot's. Players can also be built-in bots
+ * (see BuiltinBot), which move inside the engine.
+ *
+ * This is for tuning bots by playing many games without processes or
+ * pipes, mainly from the C++ starter kit (see its hlt/local_game.hpp).
+ * Nothing C++ crosses it, so the kit's types don't have to agree with the
+ * engine's, though they share names. There are no time limits.
+ *
+ * A game is used from one thread at a time, but different games can be
+ * played on different threads. Functions that can fail return null or
+ * nonzero, and leave a message for halite_local_game_error, like those of
+ * SimulationApi.hpp. Strings returned stay valid until the next call with
+ * the same game.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HaliteLocalGame HaliteLocalGame;
+
+/**
+ * Start a game on a map generated from seed, as halite -d "WIDTH HEIGHT"
+ * -s SEED would for num_players, with the game's default constants; or
+ * return null.
+ */
+HaliteLocalGame* halite_local_game_create(unsigned int width, unsigned int height,
+                                          unsigned int seed, unsigned int num_players);
+void halite_local_game_destroy(HaliteLocalGame* game);
+
+/**
+ * Have a built-in bot play for a player, given its command (e.g.
+ * "builtin:rush"), before the first step. Returns nonzero if there is no
+ * such bot.
+ */
+int halite_local_game_set_builtin(HaliteLocalGame* game, unsigned int player,
+                                  const char* command);
+
+/**
+ * The current map, as the text frame bots are sent each turn (without the
+ * newline).
+ */
+const char* halite_local_game_frame(HaliteLocalGame* game);
+/**
+ * Queue a player's commands for the next step, as a bot's reply line (a
+ * later call replaces them). Returns nonzero if the line is invalid, in
+ * which case the player is out of the game, as a bot would be.
+ */
+int halite_local_game_set_moves(HaliteLocalGame* game, unsigned int player,
+                                const char* moves);
+//! Take a player out of the game before the next step, as when its bot errors.
+void halite_local_game_eliminate(HaliteLocalGame* game, unsigned int player);
+/**
+ * Play a turn: the built-in bots move, then everything is simulated with
+ * the moves queued. Returns whether the game is over.
+ */
+int halite_local_game_step(HaliteLocalGame* game);
+
+unsigned int halite_local_game_turn(const HaliteLocalGame* game);
+int halite_local_game_is_over(const HaliteLocalGame* game);
+int halite_local_game_is_alive(const HaliteLocalGame* game, unsigned int player);
+
+//! What a player achieved in a game, as halite reports it.
+typedef struct HaliteLocalGameResult {
+    //! 1 for the winner. Only final once the game is over.
+    unsigned int rank;
+    //! The last turn the player had ships on.
+    unsigned int last_turn_alive;
+    //! The ships the player has had (its first ones included).
+    unsigned int total_ship_count;
+    unsigned int damage_dealt;
+} HaliteLocalGameResult;
+
+/**
+ * Write each player's result into results, which has room for every
+ * player. The players still in the game are ranked as if it ended now,
+ * the way halite ranks them at the end.
+ */
+void halite_local_game_results(HaliteLocalGame* game, HaliteLocalGameResult* results);
+
+/**
+ * What went wrong in the last call that failed with the given game, or
+ * (given null) in the last halite_local_game_create on this thread that
+ * did.
+ */
+const char* halite_local_game_error(const HaliteLocalGame* game);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //HALITE_LOCALGAMEAPI_HPP
@@ -0,0 +1,216 @@
+#include "OutputWriter.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "json.hpp"
+#include "ReplaySink.hpp"
+
+namespace {
+#ifdef _WIN32
+    constexpr char SEPARATOR = '\\';
+#else
+    constexpr char SEPARATOR = '/';
+#endif
+
+    //! Spreads consecutive game IDs evenly over the shards.
+    auto hash_id(uint32_t id) -> uint32_t {
+        id ^= id >> 16;
+        id *= 0x7feb352dU;
+        id ^= id >> 15;
+        id *= 0x846ca68bU;
+        id ^= id >> 16;
+        return id;
+    }
+
+    //! Write what the system holds of a closed file to the disk.
+    auto sync_file(const std::string& filename) -> bool {
+#ifdef _WIN32
+        // _commit needs a handle it can write through
+        const int fd = _open(filename.c_str(), _O_WRONLY | _O_BINARY);
+        if (fd < 0) return false;
+        const bool synced = _commit(fd) == 0;
+        _close(fd);
+#else
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        const bool synced = fsync(fd) == 0;
+        ::close(fd);
+#endif
+        return synced;
+    }
+}
+
+OutputWriter::OutputWriter(const OutputOptions& options)
+    : output_options(options), thread(&OutputWriter::run, this) {}
+
+OutputWriter::~OutputWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_one();
+    thread.join();
+    close_archive_files();
+}
+
+auto OutputWriter::game_directory(const std::string& directory, unsigned int id) -> std::string {
+    if (output_options.shards == 0) return directory;
+
+    // In hex, with as many digits as the last shard needs
+    size_t digits = 1;
+    for (auto last = output_options.shards - 1; last >= 16; last /= 16) digits++;
+    std::string shard(digits, '0');
+    auto value = hash_id(id) % output_options.shards;
+    for (auto digit = digits; digit-- > 0; value /= 16) {
+        shard[digit] = "0123456789abcdef"[value % 16];
+    }
+    const auto path = directory + shard;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (directories.insert(path).second) {
+        // An existing directory is fine; any other failure shows when
+        // the game's files are opened
+#ifdef _WIN32
+        _mkdir(path.c_str());
+#else
+        mkdir(path.c_str(), 0777);
+#endif
+    }
+    return path + SEPARATOR;
+}
+
+auto OutputWriter::close(std::unique_ptr<std::ofstream> file, const std::string& filename) -> void {
+    const std::shared_ptr<std::ofstream> open_file(std::move(file));
+    const auto sync = output_options.sync;
+    queue([open_file, filename, sync]() {
+        open_file->close();
+        if (!*open_file || (sync && !sync_file(filename))) {
+            std::cerr << "Could not write " << filename << '\n';
+        }
+    });
+}
+
+auto OutputWriter::close(std::unique_ptr<ReplaySink> file, const std::string& filename) -> void {
+    const std::shared_ptr<ReplaySink> open_file(std::move(file));
+    const auto sync = output_options.sync;
+    queue([open_file, filename, sync]() {
+        try {
+            open_file->close();
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << "Could not write replay " << filename << ": " << e.what() << '\n';
+            return;
+        }
+        if (sync && !sync_file(filename)) {
+            std::cerr << "Could not sync replay " << filename << '\n';
+        }
+    });
+}
+
+auto OutputWriter::discard(std::unique_ptr<std::ofstream> file, const std::string& filename) -> void {
+    const std::shared_ptr<std::ofstream> open_file(std::move(file));
+    queue([open_file, filename]() {
+        open_file->close();
+        std::remove(filename.c_str());
+    });
+}
+
+auto OutputWriter::sync(const std::string& filename) -> void {
+    if (!output_options.sync) return;
+    queue([filename]() {
+        if (!sync_file(filename)) {
+            std::cerr << "Could not sync " << filename << '\n';
+        }
+    });
+}
+
+auto OutputWriter::archive(const std::string& name, std::string contents) -> std::string {
+    const auto shared_contents = std::make_shared<std::string>(std::move(contents));
+    const auto size = shared_contents->size();
+    // Space is reserved in the order the logs are queued, so it is
+    // also the order they are appended in
+    std::lock_guard<std::mutex> lock(mutex);
+    if (archive_offset > 0 && archive_offset + size > output_options.archive_size) {
+        archive_number++;
+        archive_offset = 0;
+    }
+    const auto number = archive_number;
+    const auto offset = archive_offset;
+    archive_offset += size;
+    work.push_back([this, number, offset, name, shared_contents]() {
+        if (open_archive != static_cast<long>(number)) open_archive_files(number);
+        archive_file.write(shared_contents->data(),
+                           static_cast<std::streamsize>(shared_contents->size()));
+        archive_index << nlohmann::json{
+            { "name", name }, { "offset", offset }, { "size", shared_contents->size() },
+        }.dump() << '\n';
+        if (!archive_file || !archive_index) {
+            std::cerr << "Could not write " << name << " to " << archive_name(number, ".logs") << '\n';
+        }
+    });
+    work_ready.notify_one();
+    return archive_name(number, ".logs") + '#' + name;
+}
+
+auto OutputWriter::queue(std::function<void()> job) -> void {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        work.push_back(std::move(job));
+    }
+    work_ready.notify_one();
+}
+
+auto OutputWriter::run() -> void {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [this]() { return stopping || !work.empty(); });
+        if (work.empty()) return;
+        auto job = std::move(work.front());
+        work.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+auto OutputWriter::archive_name(unsigned int number, const char* extension) const -> std::string {
+    return output_options.log_archive + '-' + std::to_string(number) + extension;
+}
+
+auto OutputWriter::open_archive_files(unsigned int number) -> void {
+    close_archive_files();
+    open_archive = number;
+    // Offsets start from 0 in each archive, so one left by an earlier run
+    // is written over
+    archive_file.open(archive_name(number, ".logs"), std::ios::binary | std::ios::trunc);
+    archive_index.open(archive_name(number, ".index"), std::ios::binary | std::ios::trunc);
+}
+
+auto OutputWriter::close_archive_files() -> void {
+    if (open_archive < 0) return;
+    const auto number = static_cast<unsigned int>(open_archive);
+    archive_file.close();
+    archive_index.close();
+    if (output_options.sync) {
+        for (const auto& filename : { archive_name(number, ".logs"), archive_name(number, ".index") }) {
+            if (!sync_file(filename)) {
+                std::cerr << "Could not sync " << filename << '\n';
+            }
+        }
+    }
+    archive_file.clear();
+    archive_index.clear();
+    open_archive = -1;
+}
@@ -0,0 +1,109 @@
+#ifndef HALITE_OUTPUTWRITER_HPP
+#define HALITE_OUTPUTWRITER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+class ReplaySink;
+
+//! How the games of a process write their replays and player logs.
+struct OutputOptions {
+    /**
+     * If nonzero, the replays and logs of each game go into one of this
+     * many subdirectories (of the replay directory, and of the working
+     * directory for logs), picked by a hash of the game's ID, so that a
+     * batch of thousands of games doesn't put them all in one directory.
+     */
+    unsigned int shards = 0;
+    //! fsync every replay and log once it is written.
+    bool sync = false;
+    /**
+     * If set, player logs are appended to rolling archive files
+     * LOG_ARCHIVE-N.logs (see OutputWriter::archive) instead of each
+     * being a file of its own. A new archive is started once one would
+     * go over archive_size bytes.
+     */
+    std::string log_archive;
+    uint64_t archive_size = uint64_t(256) << 20;
+};
+
+/**
+ * A thread that finishes writing the files of games (closing them,
+ * flushing what they have left and fsyncing them), and appends player logs
+ * to archives, so that the threads playing games don't wait on the disk.
+ * Any number of games may use it at once.
+ *
+ * Work is done in the order it is queued; the destructor waits for all of
+ * it. Files that can't be written are reported on stderr, as replays
+ * written in the background are.
+ */
+class OutputWriter {
+public:
+    explicit OutputWriter(const OutputOptions& options);
+    //! Finishes the work queued, then closes (and syncs) the archive.
+    ~OutputWriter();
+    OutputWriter(const OutputWriter&) = delete;
+    auto operator=(const OutputWriter&) -> OutputWriter& = delete;
+
+    auto options() const -> const OutputOptions& { return output_options; }
+
+    /**
+     * The directory the files of game id go into under directory (which
+     * is empty, or ends with a separator): a shard of it if
+     * options().shards is set, created the first time it is asked for.
+     * If it can't be created, opening a file in it fails.
+     */
+    auto game_directory(const std::string& directory, unsigned int id) -> std::string;
+
+    //! Close a file written to filename (and sync it) on the thread.
+    auto close(std::unique_ptr<std::ofstream> file, const std::string& filename) -> void;
+    auto close(std::unique_ptr<ReplaySink> file, const std::string& filename) -> void;
+    //! Close a file and delete it, for one that isn't wanted after all.
+    auto discard(std::unique_ptr<std::ofstream> file, const std::string& filename) -> void;
+    //! Sync a file already closed, if options().sync.
+    auto sync(const std::string& filename) -> void;
+
+    /**
+     * Append the contents of a log to the archive, recording in its index
+     * (LOG_ARCHIVE-N.index, a JSON object per line) the name of the log,
+     * and the offset and size of its contents in the archive. Returns
+     * where it will be, as ARCHIVE#NAME.
+     */
+    auto archive(const std::string& name, std::string contents) -> std::string;
+
+private:
+    OutputOptions output_options;
+
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::deque<std::function<void()>> work;
+    bool stopping = false;
+    //! The shard directories made so far.
+    std::set<std::string> directories;
+
+    //! The archive logs are reserved space in (under mutex), and the one
+    //! open on the thread, with its index (-1 before the first).
+    unsigned int archive_number = 0;
+    uint64_t archive_offset = 0;
+    long open_archive = -1;
+    std::ofstream archive_file, archive_index;
+
+    std::thread thread;
+
+    auto queue(std::function<void()> job) -> void;
+    auto run() -> void;
+    auto archive_name(unsigned int number, const char* extension) const -> std::string;
+    //! Open archive number, closing the one before it.
+    auto open_archive_files(unsigned int number) -> void;
+    auto close_archive_files() -> void;
+};
+
+#endif //HALITE_OUTPUTWRITER_HPP
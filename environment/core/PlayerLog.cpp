@@ -0,0 +1,56 @@
+#include "PlayerLog.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+
+#include "json.hpp"
+#include "OutputWriter.hpp"
+
+PlayerLog::PlayerLog(const std::string& filename, OutputWriter* writer)
+    : name(filename), writer(writer) {
+    if (writer != nullptr && !writer->options().log_archive.empty()) return;
+    file.reset(new std::ofstream(filename, std::ios_base::binary));
+    if (!file->is_open()) {
+        throw std::runtime_error("Could not open log file " + filename);
+    }
+}
+
+auto PlayerLog::write(const nlohmann::json& entry) -> void {
+    write(entry.dump());
+}
+
+auto PlayerLog::write(const std::string& entry) -> void {
+    if (file) {
+        *file << entry << '\n';
+    }
+    else {
+        contents += entry;
+        contents += '\n';
+    }
+}
+
+auto PlayerLog::close() -> void {
+    if (!file) {
+        name = writer->archive(name, std::move(contents));
+        contents.clear();
+    }
+    else if (writer != nullptr) {
+        writer->close(std::move(file), name);
+    }
+    else {
+        file->close();
+    }
+}
+
+auto PlayerLog::discard() -> void {
+    if (!file) {
+        contents.clear();
+    }
+    else if (writer != nullptr) {
+        writer->discard(std::move(file), name);
+    }
+    else {
+        file->close();
+        std::remove(name.c_str());
+    }
+}
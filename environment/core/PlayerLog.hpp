@@ -0,0 +1,59 @@
+#ifndef HALITE_PLAYERLOG_HPP
+#define HALITE_PLAYERLOG_HPP
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "json_fwd.hpp"
+
+class OutputWriter;
+
+//! How much of every turn the player logs record (--log-detail).
+enum class LogDetail {
+    //! Nothing; logs only have the init entry and the error.
+    None,
+    //! How long the bot took to respond.
+    Timing,
+    //! Also the commands it sent.
+    Commands,
+    //! Also its ships and planets at the end of the turn.
+    Full,
+};
+
+/**
+ * The log of one player, written to its file as the game goes, one JSON
+ * object per line: the init entry (with the player's ID and name), then an
+ * entry for every turn, then the error, if there was one, and the end of
+ * what the bot wrote to its stderr, if anything ("Stderr", with
+ * "StderrDropped" bytes that came before it; see
+ * Networking::stderr_output).
+ *
+ * With an OutputWriter, the file is closed (or deleted) on its thread, and
+ * if it has a log archive, the log is kept in memory until closed, then
+ * appended there instead of being a file.
+ */
+class PlayerLog {
+public:
+    //! Throws std::runtime_error if the file can't be opened.
+    explicit PlayerLog(const std::string& filename, OutputWriter* writer = nullptr);
+
+    //! Where the log is; once closed into an archive, ARCHIVE#FILENAME.
+    auto filename() const -> const std::string& { return name; }
+    //! Write an entry, as a line.
+    auto write(const nlohmann::json& entry) -> void;
+    //! Write an entry already serialized, without its newline.
+    auto write(const std::string& entry) -> void;
+    auto close() -> void;
+    //! Close and delete the file, for a log that isn't wanted after all.
+    auto discard() -> void;
+
+private:
+    std::string name;
+    OutputWriter* writer;
+    //! The file, or if archived, what was written.
+    std::unique_ptr<std::ofstream> file;
+    std::string contents;
+};
+
+#endif //HALITE_PLAYERLOG_HPP
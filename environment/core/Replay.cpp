@@ -1,5 +1,27 @@
 #include "Replay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#define ZSTD_STATIC_LINKING_ONLY
+#include "../zstd-1.3.0/lib/zstd.h"
+#include "../zstd-1.3.0/lib/compress/zstdmt_compress.h"
+#include "../zstd-1.3.0/lib/dictBuilder/zdict.h"
 #include "../version.hpp"
+#include "ConsoleLog.hpp"
+#include "json.hpp"
+
+auto replay_extension(ReplayFormat format) -> const char* {
+    switch (format) {
+        case ReplayFormat::Binary: return ".hltb";
+        case ReplayFormat::Moves: return ".hltm";
+        default: return ".hlt";
+    }
+}
 
 /**
  * Build up the in-memory representation of the header of the replay.
@@ -7,7 +29,12 @@
  * @param replay
  */
 auto Replay::output_header(nlohmann::json& replay) -> void {
-    replay["version"] = 31;
+    const bool delta_frames = options.keyframe_interval > 0 &&
+                              options.format == ReplayFormat::Json;
+    replay["version"] = delta_frames ? DELTA_REPLAY_VERSION : REPLAY_VERSION;
+    if (delta_frames) {
+        replay["keyframe_interval"] = options.keyframe_interval;
+    }
     replay["engine_version"] = HALITE_VERSION;
     replay["seed"] = seed;
     replay["map_generator"] = map_generator;
@@ -22,16 +49,16 @@ auto Replay::output_header(nlohmann::json& replay) -> void {
     replay["player_names"] = nlohmann::json(player_names);
 
     // Encode the constants used to run this particular game iteration.
-    replay["constants"] = hlt::GameConstants::get().to_json();
+    replay["constants"] = constants.to_json();
 
     // Encode the planet map. This information doesn't change between frames,
     // so there's no need to re-encode it every time.
     auto planets = std::vector<nlohmann::json>();
-    const auto& initial_map = full_frames[0];
+    const auto& initial_planets = full_frames.initial_planets();
     for (hlt::EntityIndex planet_index = 0;
-         planet_index < initial_map.planets.size();
+         planet_index < initial_planets.size();
          planet_index++) {
-        const auto& planet = initial_map.planets[planet_index];
+        const auto& planet = initial_planets[planet_index];
         planets.push_back(nlohmann::json{
             { "id", planet_index },
             { "x", planet.location.pos_x },
@@ -44,136 +71,965 @@ auto Replay::output_header(nlohmann::json& replay) -> void {
     }
     replay["planets"] = planets;
     replay["poi"] = points_of_interest;
-}
 
-auto Replay::output(std::string filename, bool enable_compression) -> void {
-    std::ofstream gameFile;
-    gameFile.open(filename, std::ios_base::binary);
-    if (!gameFile.is_open())
-        throw std::runtime_error("Could not open file for replay");
+    // For checking that an engine plays the game out the same
+    auto state_hashes = std::vector<std::string>();
+    for (size_t i = 0; i < full_frames.size(); i++) {
+        state_hashes.push_back(hlt::state_hash_string(full_frames.state_hash(i)));
+    }
+    replay["state_hashes"] = state_hashes;
+}
 
+auto Replay::output_checkpoint(std::ostream& file, const nlohmann::json& checkpoint) -> size_t {
     nlohmann::json j;
     output_header(j);
-    j["stats"] = stats;
-
-    // Encode the frames.
-    std::vector<nlohmann::json> frames;
-    std::vector<nlohmann::json> moves;
-    frames.reserve(full_frames.size());
-    moves.reserve(full_frames.size() - 1);
+    j["checkpoint"] = checkpoint;
+    const auto peak = output_moves(file, j);
+    file.flush();
+    return peak;
+}
 
-    for (const auto& frame_map : full_frames) {
-        nlohmann::json frame_planets;
-        nlohmann::json frame_ships;
+auto Replay::live_header() -> nlohmann::json {
+    nlohmann::json header;
+    output_header(header);
+    header.erase("num_frames");
+    header.erase("state_hashes");
+    return header;
+}
 
-        for (hlt::PlayerId player_idx = 0; player_idx < number_of_players; player_idx++) {
-            const auto& player_ships = frame_map.ships[player_idx];
-            auto frame_player_ships = nlohmann::json::object();
+auto Replay::write_live_frame(JsonWriter& json, size_t frame_idx, bool keyframe) -> void {
+    // Frame 0 has no turn before it
+    const auto events_idx = frame_idx > 0 ? frame_idx - 1 : full_frame_events.num_frames();
+    if (keyframe || frame_idx == 0) {
+        write_frame(json, frame_idx, events_idx, true);
+    }
+    else {
+        write_delta_frame(json, frame_idx, events_idx);
+    }
+}
 
-            for (const auto& ship_pair : player_ships) {
-                const auto ship_idx = ship_pair.first;
-                const auto& ship = ship_pair.second;
+namespace {
+    //! In the order a JSON object keyed by their IDs lists them.
+    template<typename Entities, typename T>
+    auto sorted_by_id(const Entities& entities, std::vector<const T*>& result) -> void {
+        result.clear();
+        for (const auto& entity : entities) {
+            result.push_back(&entity);
+        }
+        std::sort(result.begin(), result.end(), [](const T* a, const T* b) -> bool {
+            return decimal_key_less(a->id, b->id);
+        });
+    }
 
-                frame_player_ships[std::to_string(ship_idx)] =
-                    ship.output_json(player_idx, ship_idx);
+    /**
+     * Compare two lists in the order of sorted_by_id, collecting the
+     * entities of current that are new or changed, and the IDs of those of
+     * previous that are gone.
+     */
+    template<typename T, typename Same>
+    auto diff_by_id(const std::vector<const T*>& previous,
+                    const std::vector<const T*>& current, Same same,
+                    std::vector<const T*>& changed,
+                    std::vector<uint32_t>& destroyed) -> void {
+        changed.clear();
+        destroyed.clear();
+        size_t i = 0, j = 0;
+        while (i < previous.size() || j < current.size()) {
+            if (j == current.size() ||
+                (i < previous.size() && decimal_key_less(previous[i]->id, current[j]->id))) {
+                destroyed.push_back(previous[i++]->id);
             }
+            else if (i == previous.size() ||
+                     decimal_key_less(current[j]->id, previous[i]->id)) {
+                changed.push_back(current[j++]);
+            }
+            else {
+                if (!same(*previous[i], *current[j])) {
+                    changed.push_back(current[j]);
+                }
+                i++;
+                j++;
+            }
+        }
+    }
 
-            frame_ships[std::to_string(player_idx)] = frame_player_ships;
+    //! Player tags 0 up to num_players, in the order a JSON object keyed
+    //! by them lists them ("10" comes before "2").
+    auto players_in_key_order(size_t num_players) -> std::vector<hlt::PlayerId> {
+        std::vector<hlt::PlayerId> players;
+        for (size_t player = 0; player < num_players; player++) {
+            players.push_back(static_cast<hlt::PlayerId>(player));
         }
+        std::sort(players.begin(), players.end(), decimal_key_less);
+        return players;
+    }
+}
 
-        for (hlt::EntityIndex planet_index = 0;
-             planet_index < frame_map.planets.size();
-             planet_index++) {
-            const auto& planet = frame_map.planets[planet_index];
-            if (!planet.is_alive()) {
-                continue;
-            }
+auto Replay::write_frame(JsonWriter& json, size_t frame_idx, size_t events_idx,
+                         bool keyframe) -> void {
+    const auto& frame_map = full_frames[frame_idx];
+    std::vector<const hlt::ShipSnapshot*> ships;
+    std::vector<const hlt::PlanetSnapshot*> planets;
+
+    json.begin_object();
+    // Save the frame events. This is added to the frame data, alongside
+    // ships and planets.
+    if (events_idx < full_frame_events.num_frames()) {
+        json.key("events");
+        full_frame_events.write_frame_json(json, events_idx);
+    }
+    if (keyframe) {
+        json.key("keyframe").value(true);
+    }
+
+    // Without living planets, this has always been null rather than empty
+    json.key("planets");
+    if (frame_map.num_planets == 0) {
+        json.null();
+    }
+    else {
+        json.begin_object();
+        sorted_by_id(frame_map.living_planets(), planets);
+        for (const auto planet : planets) {
+            json.key(planet->id);
+            planet->write_json(json);
+        }
+        json.end_object();
+    }
+
+    json.key("ships").begin_object();
+    for (const auto player_idx : players_in_key_order(number_of_players)) {
+        json.key(player_idx).begin_object();
+        sorted_by_id(frame_map.player_ships(player_idx), ships);
+        for (const auto ship : ships) {
+            json.key(ship->id);
+            ship->write_json(json);
+        }
+        json.end_object();
+    }
+    json.end_object();
+    json.end_object();
+}
+
+auto Replay::write_delta_frame(JsonWriter& json, size_t frame_idx, size_t events_idx) -> void {
+    const auto& previous = full_frames[frame_idx - 1];
+    const auto& current = full_frames[frame_idx];
+    std::vector<const hlt::ShipSnapshot*> previous_ships, current_ships;
+    std::vector<const hlt::PlanetSnapshot*> previous_planets, current_planets;
+
+    std::vector<const hlt::PlanetSnapshot*> changed_planets;
+    std::vector<uint32_t> destroyed_planets;
+    sorted_by_id(previous.living_planets(), previous_planets);
+    sorted_by_id(current.living_planets(), current_planets);
+    diff_by_id(previous_planets, current_planets,
+               [&](const hlt::PlanetSnapshot& before, const hlt::PlanetSnapshot& after) {
+                   return before.same_json(after);
+               },
+               changed_planets, destroyed_planets);
+
+    std::vector<std::vector<const hlt::ShipSnapshot*>> changed_ships(number_of_players);
+    std::vector<std::vector<uint32_t>> destroyed_ships(number_of_players);
+    for (hlt::PlayerId player_idx = 0; player_idx < number_of_players; player_idx++) {
+        sorted_by_id(previous.player_ships(player_idx), previous_ships);
+        sorted_by_id(current.player_ships(player_idx), current_ships);
+        diff_by_id(previous_ships, current_ships,
+                   [](const hlt::ShipSnapshot& before, const hlt::ShipSnapshot& after) {
+                       return before.same_json(after);
+                   },
+                   changed_ships[player_idx], destroyed_ships[player_idx]);
+    }
 
-            frame_planets[std::to_string(planet_index)] =
-                planet.output_json(planet_index);
+    json.begin_object();
+    json.key("destroyed_planets").begin_array();
+    for (const auto id : destroyed_planets) {
+        json.value(id);
+    }
+    json.end_array();
+    const auto players = players_in_key_order(number_of_players);
+    json.key("destroyed_ships").begin_object();
+    for (const auto player_idx : players) {
+        json.key(player_idx).begin_array();
+        for (const auto id : destroyed_ships[player_idx]) {
+            json.value(id);
+        }
+        json.end_array();
+    }
+    json.end_object();
+    if (events_idx < full_frame_events.num_frames()) {
+        json.key("events");
+        full_frame_events.write_frame_json(json, events_idx);
+    }
+    json.key("planets").begin_object();
+    for (const auto planet : changed_planets) {
+        json.key(planet->id);
+        planet->write_json(json);
+    }
+    json.end_object();
+    json.key("ships").begin_object();
+    for (const auto player_idx : players) {
+        json.key(player_idx).begin_object();
+        for (const auto ship : changed_ships[player_idx]) {
+            json.key(ship->id);
+            ship->write_json(json);
         }
+        json.end_object();
+    }
+    json.end_object();
+    json.end_object();
+}
 
-        frames.push_back(nlohmann::json{
-            { "ships", frame_ships },
-            { "planets", frame_planets },
+auto Replay::write_moves(JsonWriter& json, size_t frame_idx) -> void {
+    // Each entry maps player ID to move set. Each player move set is an
+    // array of queued moves, and each set of queued moves is an object
+    // mapping ship ID to move.
+    std::vector<const hlt::RecordedMove*> moves;
+    for (const auto& recorded : full_player_moves[frame_idx]) {
+        if (recorded.move.type != hlt::MoveType::Noop) {
+            moves.push_back(&recorded);
+        }
+    }
+    std::stable_sort(
+        moves.begin(), moves.end(),
+        [](const hlt::RecordedMove* a, const hlt::RecordedMove* b) -> bool {
+            if (a->player != b->player) return decimal_key_less(a->player, b->player);
+            if (a->move_no != b->move_no) return a->move_no < b->move_no;
+            return decimal_key_less(a->move.shipId, b->move.shipId);
         });
+
+    // Every player up to CLASSIC_MAX_PLAYERS has an entry, as always
+    auto next = moves.begin();
+    json.begin_object();
+    for (const auto player_id : players_in_key_order(
+             std::max<size_t>(number_of_players, hlt::CLASSIC_MAX_PLAYERS))) {
+        json.key(player_id).begin_array();
+        for (auto move_no = 0; move_no < static_cast<int>(constants.MAX_QUEUED_MOVES); move_no++) {
+            json.begin_object();
+            for (; next != moves.end() && (*next)->player == player_id &&
+                   (*next)->move_no == move_no; ++next) {
+                // Of several moves for one ship, the last one counts, as
+                // it would overwrite the others in a JSON object
+                const auto following = next + 1;
+                if (following != moves.end() && (*following)->player == player_id &&
+                    (*following)->move_no == move_no &&
+                    (*following)->move.shipId == (*next)->move.shipId) {
+                    continue;
+                }
+                json.key((*next)->move.shipId);
+                (*next)->move.write_json(json, player_id, move_no);
+            }
+            json.end_object();
+        }
+        json.end_array();
     }
+    json.end_object();
+}
 
-    // Save the frame events. This is added to the frame data, alongside
-    // ships and planets.
-    for (auto frame_idx = 0; frame_idx < full_frame_events.size(); frame_idx++) {
-        auto& frame_events = full_frame_events[frame_idx];
-        auto& frame_data = frames.at(frame_idx);
+auto Replay::write_preview_frame(JsonWriter& json, size_t frame_idx,
+                                 size_t events_from) -> void {
+    const auto& frame_map = full_frames[frame_idx];
+    EventTally tally(static_cast<hlt::PlayerId>(number_of_players));
+    const auto events_to = std::min(frame_idx + 1, full_frame_events.num_frames());
+    for (auto i = events_from; i < events_to; i++) {
+        full_frame_events.tally_frame(i, tally);
+    }
+    auto position = [](double coordinate) -> long {
+        return std::lround(coordinate * PREVIEW_POSITION_SCALE);
+    };
+    auto per_player = [&](const std::vector<uint32_t>& counts) {
+        json.begin_array();
+        for (hlt::PlayerId player_idx = 0; player_idx < number_of_players; player_idx++) {
+            json.value(counts[player_idx]);
+        }
+        json.end_array();
+    };
 
-        std::vector<nlohmann::json> event_record;
+    json.begin_object();
+    json.key("events").begin_object();
+    json.key("attacks").value(tally.attacks);
+    json.key("contentions").value(tally.contentions);
+    json.key("planets_destroyed").begin_array();
+    for (const auto planet_id : tally.planets_destroyed) {
+        json.value(planet_id);
+    }
+    json.end_array();
+    json.key("ships_destroyed");
+    per_player(tally.ships_destroyed);
+    json.key("ships_spawned");
+    per_player(tally.ships_spawned);
+    json.end_object();
 
-        for (auto& event : frame_events) {
-            event_record.push_back(event->serialize());
+    json.key("frame").value(frame_idx);
+
+    json.key("planets").begin_array();
+    for (const auto& planet : frame_map.living_planets()) {
+        json.begin_array();
+        json.value(planet.id);
+        json.value(planet.owned ? static_cast<int>(planet.owner) : -1);
+        json.value(planet.health);
+        json.value(planet.num_docked);
+        json.end_array();
+    }
+    json.end_array();
+
+    json.key("ships").begin_array();
+    for (hlt::PlayerId player_idx = 0; player_idx < number_of_players; player_idx++) {
+        json.begin_array();
+        for (const auto& ship : frame_map.player_ships(player_idx)) {
+            json.begin_array();
+            json.value(ship.id);
+            json.value(position(ship.x));
+            json.value(position(ship.y));
+            json.value(ship.health);
+            json.value(static_cast<int>(ship.docking_status));
+            json.end_array();
         }
+        json.end_array();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+auto Replay::binary_frame(size_t frame_idx, binary_replay::Frame& frame) -> void {
+    frame.clear();
+    const auto& frame_map = full_frames[frame_idx];
 
-        frame_data["events"] = nlohmann::json(event_record);
+    auto& ships = frame.ships;
+    for (const auto& ship : frame_map.all_ships()) {
+        ships.id.push_back(ship.id);
+        ships.owner.push_back(ship.owner);
+        ships.x.push_back(ship.x);
+        ships.y.push_back(ship.y);
+        ships.vel_x.push_back(ship.vel_x);
+        ships.vel_y.push_back(ship.vel_y);
+        ships.health.push_back(ship.health);
+        ships.cooldown.push_back(ship.weapon_cooldown);
+        ships.docking_status.push_back(
+            static_cast<binary_replay::DockingStatus>(ship.docking_status));
+        ships.docked_planet.push_back(ship.docked_planet);
+        ships.docking_progress.push_back(ship.docking_progress);
     }
 
-    // Serialize moves. Note that there is no moves field for the last frame.
-    for (const auto& current_moves : full_player_moves) {
-        // Each entry is a map of player ID to move set
-        nlohmann::json frame_moves;
+    auto& planets = frame.planets;
+    for (const auto& planet : frame_map.living_planets()) {
+        planets.id.push_back(planet.id);
+        planets.owner.push_back(planet.owned ? planet.owner : binary_replay::NO_OWNER);
+        planets.health.push_back(planet.health);
+        planets.remaining_production.push_back(planet.remaining_production);
+        planets.current_production.push_back(planet.current_production);
+        planets.docked_ships.insert(
+            planets.docked_ships.end(),
+            planet.docked_ships, planet.docked_ships + planet.num_docked);
+        planets.docked_offset.push_back(
+            static_cast<uint32_t>(planets.docked_ships.size()));
+    }
 
-        for (hlt::PlayerId player_id = 0; player_id < current_moves.size();
-             player_id++) {
-            // Each player move set is an array of queued moves
-            std::vector<nlohmann::json> all_player_moves;
-            for (auto move_no = 0; move_no < hlt::MAX_QUEUED_MOVES; move_no++) {
-                // Each set of queued moves is an object mapping ship ID to move
-                auto player_moves = nlohmann::json::object();
-                for (const auto& move_pair : current_moves[player_id][move_no]) {
-                    const auto& move = move_pair.second;
-                    if (move.type == hlt::MoveType::Noop){
+    if (frame_idx < full_frame_events.num_frames()) {
+        full_frame_events.add_frame_to(frame_idx, frame.events);
+    }
+
+    if (frame_idx < full_player_moves.size()) {
+        const auto current_moves = full_player_moves[frame_idx];
+        auto& moves = frame.moves;
+        // Listed by player, then queue number
+        for (hlt::PlayerId player_id = 0; player_id < number_of_players; player_id++) {
+            for (auto move_no = 0; move_no < static_cast<int>(constants.MAX_QUEUED_MOVES); move_no++) {
+                for (const auto& recorded : current_moves) {
+                    if (recorded.player != player_id || recorded.move_no != move_no) {
                         continue;
                     }
+                    const auto& move = recorded.move;
+                    uint32_t magnitude_or_planet = 0;
+                    uint32_t angle = 0;
+                    binary_replay::MoveType type;
+                    switch (move.type) {
+                        case hlt::MoveType::Thrust:
+                            type = binary_replay::MoveType::Thrust;
+                            magnitude_or_planet = move.move.thrust.thrust;
+                            angle = move.move.thrust.angle;
+                            break;
+                        case hlt::MoveType::Dock:
+                            type = binary_replay::MoveType::Dock;
+                            magnitude_or_planet = static_cast<uint32_t>(move.move.dock_to);
+                            break;
+                        case hlt::MoveType::Undock:
+                            type = binary_replay::MoveType::Undock;
+                            break;
+                        default:
+                            continue;
+                    }
 
-                    player_moves[std::to_string(move.shipId)] =
-                        move.output_json(player_id, move_no);
+                    moves.owner.push_back(player_id);
+                    moves.ship_id.push_back(static_cast<uint32_t>(move.shipId));
+                    moves.queue_number.push_back(static_cast<uint8_t>(move_no));
+                    moves.type.push_back(type);
+                    moves.magnitude_or_planet.push_back(magnitude_or_planet);
+                    moves.angle.push_back(angle);
                 }
-                all_player_moves.push_back(std::move(player_moves));
             }
+        }
+    }
+}
 
-            frame_moves[std::to_string(player_id)] = all_player_moves;
+/**
+ * Writes a file, optionally compressing it with zstd as it goes, through
+ * fixed-size buffers.
+ */
+class ReplayWriter {
+public:
+    //! Compression parameters are picked for a replay of at most this
+    //! size, which bounds the memory zstd uses (about 100 MB at the highest
+    //! level), however long the game.
+    constexpr static unsigned long long MAX_SIZE_HINT = 8 << 20;
+
+    //! size_hint is roughly how large the uncompressed replay will be. It
+    //! doesn't matter with a dictionary, which fixes the parameters.
+    ReplayWriter(std::ostream& file, const ReplayOptions& options,
+                 unsigned long long size_hint)
+        : file(file), options(options), stream(nullptr), mt_stream(nullptr), peak(0) {
+        if (!options.enable_compression) return;
+
+        auto level = options.compression_level != 0
+                     ? options.compression_level : ZSTD_maxCLevel();
+        const auto hint = size_hint < MAX_SIZE_HINT ? size_hint : MAX_SIZE_HINT;
+        params = ZSTD_getParams(level, hint, 0);
+        const auto contexts = std::max(1u, options.compression_threads);
+        while (options.memory_budget > 0 && level > 1 &&
+               ZSTD_estimateCStreamSize_advanced(params.cParams) * contexts >
+                   options.memory_budget) {
+            level--;
+            params = ZSTD_getParams(level, hint, 0);
+        }
+        if (options.compression_threads > 1) {
+            mt_stream = ZSTDMT_createCCtx(options.compression_threads);
+            if (mt_stream != nullptr) {
+                // By default, sections are much larger than a replay, so
+                // nothing would run in parallel
+                ZSTDMT_setMTCtxParameter(
+                    mt_stream, ZSTDMT_p_sectionSize,
+                    static_cast<unsigned>(size_hint / options.compression_threads));
+            }
+        }
+        else {
+            stream = ZSTD_createCStream();
+        }
+        if ((stream == nullptr && mt_stream == nullptr) || ZSTD_isError(start())) {
+            if (!options.quiet_output) {
+                ConsoleLog::instance().write(LogLevel::Error, "",
+                                             "Error: could not compress replay file!");
+            }
+            ZSTD_freeCStream(stream);
+            ZSTDMT_freeCCtx(mt_stream);
+            stream = nullptr;
+            mt_stream = nullptr;
+            return;
+        }
+        output.resize(ZSTD_CStreamOutSize());
+    }
+
+    ~ReplayWriter() {
+        ZSTD_freeCStream(stream);
+        ZSTDMT_freeCCtx(mt_stream);
+    }
+
+    //! held is the memory the caller holds for what it will write next,
+    //! for peak_memory.
+    auto write(const std::string& data, size_t held = 0) -> void {
+        peak = std::max(peak, memory_usage() + data.capacity() + held);
+        if (stream == nullptr && mt_stream == nullptr) {
+            file.write(data.data(), data.size());
+            return;
         }
 
-        moves.push_back(frame_moves);
+        ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+        while (input.pos < input.size) {
+            ZSTD_outBuffer out = { &output[0], output.size(), 0 };
+            check(stream != nullptr
+                  ? ZSTD_compressStream(stream, &out, &input)
+                  : ZSTDMT_compressStream(mt_stream, &out, &input));
+            file.write(output.data(), out.pos);
+        }
     }
 
-    j["frames"] = nlohmann::json(frames);
-    j["moves"] = nlohmann::json(moves);
+    //! Flush the end of the compressed data.
+    auto finish() -> void {
+        if (stream == nullptr && mt_stream == nullptr) return;
 
-    std::string data = j.dump();
-    auto data_size = data.size();
-    auto bin_data = reinterpret_cast<const unsigned char*>(data.data());
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out = { &output[0], output.size(), 0 };
+            remaining = check(stream != nullptr
+                              ? ZSTD_endStream(stream, &out)
+                              : ZSTDMT_endStream(mt_stream, &out));
+            file.write(output.data(), out.pos);
+        } while (remaining > 0);
+    }
 
-    // Use zstd to further compress replay file
-    if (enable_compression) {
-        auto compressed_length = ZSTD_compressBound(data_size);
-        auto compressed_data = reinterpret_cast<uint8_t*>(std::malloc(compressed_length));
-        auto result = ZSTD_compress(compressed_data, compressed_length,
-                                    bin_data, data_size, ZSTD_maxCLevel());
-        if (!ZSTD_isError(result)) {
-            gameFile.write(reinterpret_cast<const char*>(compressed_data),
-                           result * sizeof(uint8_t));
+    /**
+     * End the current zstd frame and start another, so that what follows
+     * can be decompressed on its own.
+     */
+    auto end_frame() -> void {
+        if (stream == nullptr && mt_stream == nullptr) return;
+        finish();
+        check(start());
+    }
+
+    //! Write data as is, even when compressing (for skippable frames).
+    auto write_raw(const std::string& data) -> void {
+        peak = std::max(peak, memory_usage() + data.capacity());
+        file.write(data.data(), data.size());
+    }
+
+    /**
+     * The most memory the compression context, the output buffer and the
+     * data written at once took together so far, in bytes: about what
+     * writing the replay costs, since it is written a frame at a time.
+     */
+    auto peak_memory() const -> size_t { return peak; }
+
+private:
+    std::ostream& file;
+    const ReplayOptions& options;
+    ZSTD_parameters params;
+    //! At most one of these is set, depending on the number of threads.
+    ZSTD_CStream* stream;
+    ZSTDMT_CCtx* mt_stream;
+    std::vector<char> output;
+    size_t peak;
+
+    auto memory_usage() const -> size_t {
+        const auto context = stream != nullptr ? ZSTD_sizeof_CStream(stream)
+            : mt_stream != nullptr ? ZSTDMT_sizeof_CCtx(mt_stream) : 0;
+        return context + output.capacity();
+    }
+
+    //! Start a zstd frame.
+    auto start() -> size_t {
+        if (mt_stream != nullptr) {
+            return options.dictionary != nullptr
+                ? ZSTDMT_initCStream_usingCDict(
+                      mt_stream, options.dictionary->get(), params.fParams, 0)
+                : ZSTDMT_initCStream_advanced(mt_stream, nullptr, 0, params, 0);
         }
-        else {
-            if (!quiet_output) {
-                std::cout << "Error: could not compress replay file!\n";
+        return options.dictionary != nullptr
+            ? ZSTD_initCStream_usingCDict(stream, options.dictionary->get())
+            : ZSTD_initCStream_advanced(stream, nullptr, 0, params, 0);
+    }
+
+    static auto check(size_t result) -> size_t {
+        if (ZSTD_isError(result)) {
+            throw std::runtime_error(
+                std::string("Could not compress replay: ") + ZSTD_getErrorName(result));
+        }
+        return result;
+    }
+};
+
+/**
+ * Serialize elements 0 up to size with encode (given the element and the
+ * index of the thread it runs on), and pass each to write in order, with
+ * the memory held by those still to be written.
+ *
+ * On one thread, each element is serialized only when it is written. On
+ * more, batches of BATCH_PER_THREAD elements for each thread are
+ * serialized in parallel, each into a buffer of its own, before they are
+ * written, which bounds the memory it takes however long the game.
+ */
+static auto encode_in_order(
+    size_t size, unsigned int threads,
+    const std::function<void(std::string&, size_t, unsigned int)>& encode,
+    const std::function<void(const std::string&, size_t, size_t)>& write) -> void {
+    constexpr size_t BATCH_PER_THREAD = 32;
+    if (threads <= 1 || size <= BATCH_PER_THREAD) {
+        std::string buffer;
+        for (size_t i = 0; i < size; i++) {
+            buffer.clear();
+            encode(buffer, i, 0);
+            write(buffer, i, 0);
+        }
+        return;
+    }
+
+    const size_t batch_size = BATCH_PER_THREAD * threads;
+    std::vector<std::string> buffers(std::min(batch_size, size));
+    std::vector<std::exception_ptr> errors(threads);
+    for (size_t start = 0; start < size; start += batch_size) {
+        const auto end = std::min(size, start + batch_size);
+        // Interleaved, since later frames tend to be larger
+        auto encode_batch = [&](unsigned int thread) -> void {
+            try {
+                for (auto i = start + thread; i < end; i += threads) {
+                    auto& buffer = buffers[i - start];
+                    buffer.clear();
+                    encode(buffer, i, thread);
+                }
+            }
+            catch (...) {
+                errors[thread] = std::current_exception();
             }
-            gameFile.write(reinterpret_cast<const char*>(data.data()), data_size);
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned int thread = 1; thread < threads; thread++) {
+            workers.emplace_back(encode_batch, thread);
+        }
+        encode_batch(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (auto& error : errors) {
+            if (error) std::rethrow_exception(error);
         }
 
-        std::free(compressed_data);
+        size_t held = 0;
+        for (const auto& buffer : buffers) {
+            held += buffer.capacity();
+        }
+        for (auto i = start; i < end; i++) {
+            const auto& buffer = buffers[i - start];
+            held -= buffer.capacity();
+            write(buffer, i, held);
+        }
     }
-    else {
-        gameFile.write(reinterpret_cast<const char*>(data.data()), data_size);
+}
+
+//! Write a JSON array, serializing each element only when it is written
+//! (or a batch at a time, on several threads; see encode_in_order).
+static auto write_array(ReplayWriter& writer, size_t size,
+                        const std::function<void(JsonWriter&, size_t)>& element,
+                        unsigned int threads = 1) -> void {
+    writer.write("[");
+    encode_in_order(
+        size, threads,
+        [&](std::string& buffer, size_t i, unsigned int) {
+            if (i > 0) buffer += ',';
+            JsonWriter json(buffer);
+            element(json, i);
+        },
+        [&](const std::string& buffer, size_t, size_t held) {
+            writer.write(buffer, held);
+        });
+    writer.write("]");
+}
+
+/**
+ * Write a JSON object, letting stream write the value of each member
+ * instead (the frames and moves, given placeholder values so that they are
+ * written in the right place among the sorted keys). It returns false for
+ * the members to write as they are.
+ */
+static auto write_object(ReplayWriter& writer, const nlohmann::json& object,
+                         const std::function<bool(const std::string&)>& stream) -> void {
+    writer.write("{");
+    for (auto it = object.begin(); it != object.end(); ++it) {
+        if (it != object.begin()) writer.write(",");
+        writer.write(nlohmann::json(it.key()).dump() + ":");
+        if (!stream(it.key())) {
+            writer.write(it.value().dump());
+        }
     }
+    writer.write("}");
+}
+
+auto Replay::output_binary(std::ostream& file, const nlohmann::json& header) -> size_t {
+    // Every ship takes about 60 bytes a frame; the rest is small in comparison
+    const unsigned long long SHIP_SIZE = 60;
+    unsigned long long size_hint = header.dump().size();
+    for (size_t i = 0; i < full_frames.size(); i++) {
+        size_hint += full_frames[i].all_ships().size() * SHIP_SIZE;
+    }
+
+    ReplayWriter writer(file, options, size_hint);
+    std::string data;
+    binary_replay::append_header(data, header, static_cast<uint32_t>(full_frames.size()));
+    writer.write(data);
+
+    // Each chunk of frames is a zstd frame of its own, so that readers can
+    // start decompressing at any chunk (see binary_replay::Reader::seek)
+    const auto chunk_frames = options.keyframe_interval > 0
+                              ? options.keyframe_interval
+                              : binary_replay::DEFAULT_CHUNK_FRAMES;
+    std::vector<uint64_t> chunk_offsets;
+    const auto threads = std::max(1u, options.encoding_threads);
+    std::vector<binary_replay::Frame> frames(threads);
+    encode_in_order(
+        full_frames.size(), threads,
+        [&](std::string& buffer, size_t i, unsigned int thread) {
+            auto& frame = frames[thread];
+            binary_frame(i, frame);
+            binary_replay::append_frame(buffer, frame);
+        },
+        [&](const std::string& buffer, size_t i, size_t held) {
+            if (i % chunk_frames == 0) {
+                writer.end_frame();
+                chunk_offsets.push_back(static_cast<uint64_t>(file.tellp()));
+            }
+            writer.write(buffer, held);
+        });
+    writer.finish();
+
+    data.clear();
+    binary_replay::append_index(data, chunk_frames, chunk_offsets);
+    writer.write_raw(data);
+    return writer.peak_memory();
+}
+
+auto Replay::output(std::ostream& file) -> size_t {
+    return output(file, nlohmann::json(stats));
+}
+
+auto Replay::output(std::ostream& file, const nlohmann::json& stats_json) -> size_t {
+    if (full_frames.is_summarized() && options.format != ReplayFormat::Moves) {
+        throw std::runtime_error("Only a moves-only replay can be written from frame summaries");
+    }
+    nlohmann::json j;
+    output_header(j);
+    j["stats"] = stats_json;
 
-    gameFile.flush();
-    gameFile.close();
+    if (options.format == ReplayFormat::Binary) {
+        const auto peak = output_binary(file, j);
+        file.flush();
+        return peak;
+    }
+    if (options.format == ReplayFormat::Moves) {
+        const auto peak = output_moves(file, j);
+        file.flush();
+        return peak;
+    }
+    // Placeholders, so that the frames and moves are written in the same
+    // place among the (sorted) keys as if they were part of the header
+    j["frames"] = nullptr;
+    j["moves"] = nullptr;
+
+    // Estimate the size of the replay from a few frames, so that small
+    // games don't get a compression context sized for large ones
+    const size_t SAMPLED_FRAMES = 8;
+    unsigned long long size_hint = j.dump().size();
+    if (options.enable_compression) {
+        const auto step = std::max<size_t>(1, full_frames.size() / SAMPLED_FRAMES);
+        std::string sampled;
+        size_t samples = 0;
+        for (size_t i = 0; i < full_frames.size(); i += step, samples++) {
+            JsonWriter json(sampled);
+            write_frame(json, i, i, false);
+            if (i < full_player_moves.size()) {
+                JsonWriter moves(sampled);
+                write_moves(moves, i);
+            }
+        }
+        const auto sampled_size = sampled.size();
+        if (samples > 0) {
+            size_hint += sampled_size / samples * full_frames.size();
+        }
+    }
+
+    ReplayWriter writer(file, options, size_hint);
+    const auto threads = std::max(1u, options.encoding_threads);
+    write_object(writer, j, [&](const std::string& key) {
+        if (key == "frames" && options.keyframe_interval > 0) {
+            write_array(writer, full_frames.size(), [this](JsonWriter& json, size_t i) {
+                if (i % options.keyframe_interval == 0) {
+                    write_frame(json, i, i, true);
+                }
+                else {
+                    write_delta_frame(json, i, i);
+                }
+            }, threads);
+        }
+        else if (key == "frames") {
+            write_array(writer, full_frames.size(), [this](JsonWriter& json, size_t i) {
+                write_frame(json, i, i, false);
+            }, threads);
+        }
+        else if (key == "moves") {
+            // Note that there is no moves entry for the last frame.
+            write_array(writer, full_player_moves.size(), [this](JsonWriter& json, size_t i) {
+                write_moves(json, i);
+            }, threads);
+        }
+        else {
+            return false;
+        }
+        return true;
+    });
+    writer.finish();
+
+    file.flush();
+    return writer.peak_memory();
+}
+
+auto Replay::output_moves(std::ostream& file, nlohmann::json& header) -> size_t {
+    header["version"] = MOVES_REPLAY_VERSION;
+    header.erase("keyframe_interval");
+    header["moves"] = nullptr;
+    auto eliminations = nlohmann::json::array();
+    for (const auto& elimination : full_player_moves.eliminations()) {
+        eliminations.push_back(nlohmann::json{
+            { "player", elimination.player },
+            { "turn", elimination.turn },
+        });
+    }
+    header["eliminations"] = eliminations;
+    auto checksums = std::vector<uint32_t>();
+    for (size_t i = 0; i < full_frames.size(); i++) {
+        checksums.push_back(full_frames.checksum(i));
+    }
+    header["checksums"] = checksums;
+
+    // The moves are most of it, at about 40 bytes each
+    const unsigned long long MOVE_SIZE = 40;
+    unsigned long long size_hint = header.dump().size();
+    for (size_t i = 0; i < full_player_moves.size(); i++) {
+        size_hint += full_player_moves[i].size() * MOVE_SIZE;
+    }
+
+    ReplayWriter writer(file, options, size_hint);
+    write_object(writer, header, [&](const std::string& key) {
+        if (key != "moves") return false;
+        write_array(writer, full_player_moves.size(), [this](JsonWriter& json, size_t i) {
+            write_moves(json, i);
+        });
+        return true;
+    });
+    writer.finish();
+    return writer.peak_memory();
+}
+
+auto Replay::output_preview(std::ostream& file) -> size_t {
+    if (full_frames.is_summarized()) {
+        throw std::runtime_error("A preview can't be written from frame summaries");
+    }
+    nlohmann::json j;
+    output_header(j);
+    j.erase("version");
+    j.erase("keyframe_interval");
+    j.erase("state_hashes");
+    j["preview_version"] = PREVIEW_REPLAY_VERSION;
+    j["preview_interval"] = options.preview_interval;
+    j["position_scale"] = PREVIEW_POSITION_SCALE;
+    j["stats"] = stats;
+    j["frames"] = nullptr;
+
+    // The last frame is always kept, so that the preview ends where the
+    // game does
+    std::vector<size_t> preview_frames;
+    for (size_t i = 0; i < full_frames.size(); i += options.preview_interval) {
+        preview_frames.push_back(i);
+    }
+    if (!preview_frames.empty() && preview_frames.back() != full_frames.size() - 1) {
+        preview_frames.push_back(full_frames.size() - 1);
+    }
+
+    // Each ship takes about 20 bytes a frame
+    const unsigned long long SHIP_SIZE = 20;
+    unsigned long long size_hint = j.dump().size();
+    for (const auto i : preview_frames) {
+        size_hint += full_frames[i].all_ships().size() * SHIP_SIZE;
+    }
+
+    ReplayWriter writer(file, options, size_hint);
+    write_object(writer, j, [&](const std::string& key) {
+        if (key != "frames") return false;
+        write_array(writer, preview_frames.size(), [&](JsonWriter& json, size_t i) {
+            write_preview_frame(json, preview_frames[i],
+                                i == 0 ? 0 : preview_frames[i - 1] + 1);
+        });
+        return true;
+    });
+    writer.finish();
+
+    file.flush();
+    return writer.peak_memory();
+}
+
+auto read_replay_file(const std::string& filename) -> std::string {
+    std::ifstream file(filename, std::ios_base::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open " + filename);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    const auto data = contents.str();
+
+    if (!ZSTD_isFrame(data.data(), data.size())) {
+        return data;
+    }
+
+    // Streamed replays don't record their decompressed size
+    const auto stream = ZSTD_createDStream();
+    if (stream == nullptr || ZSTD_isError(ZSTD_initDStream(stream))) {
+        ZSTD_freeDStream(stream);
+        throw std::runtime_error("Could not decompress " + filename);
+    }
+    std::string result;
+    std::vector<char> output(ZSTD_DStreamOutSize());
+    ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+    while (input.pos < input.size) {
+        ZSTD_outBuffer out = { &output[0], output.size(), 0 };
+        const auto error = ZSTD_decompressStream(stream, &out, &input);
+        if (ZSTD_isError(error)) {
+            ZSTD_freeDStream(stream);
+            throw std::runtime_error("Could not decompress " + filename + ": " +
+                                     ZSTD_getErrorName(error));
+        }
+        result.append(output.data(), out.pos);
+    }
+    ZSTD_freeDStream(stream);
+    return result;
+}
+
+ReplayDictionary::ReplayDictionary(const std::string& filename,
+                                   int compression_level) {
+    std::ifstream file(filename, std::ios_base::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open replay dictionary " + filename);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    const auto data = contents.str();
+
+    // The parameters are fixed for every replay compressed with the
+    // dictionary, so pick them for large replays, like ReplayWriter does
+    const auto params = ZSTD_getCParams(
+        compression_level, ReplayWriter::MAX_SIZE_HINT, data.size());
+    dictionary = ZSTD_createCDict_advanced(
+        data.data(), data.size(), 0, ZSTD_dm_auto, params, ZSTD_defaultCMem);
+    if (dictionary == nullptr) {
+        throw std::runtime_error("Could not load replay dictionary " + filename);
+    }
+}
+
+ReplayDictionary::~ReplayDictionary() {
+    ZSTD_freeCDict(dictionary);
+}
+
+auto ReplayDictionary::train(const std::vector<std::string>& replays,
+                             const std::string& output) -> void {
+    // Whole replays are too few and too large to train on, so cut them
+    // into samples
+    const size_t SAMPLE_SIZE = 16 << 10;
+    std::string samples;
+    std::vector<size_t> sample_sizes;
+    for (const auto& filename : replays) {
+        const auto data = read_replay_file(filename);
+        samples += data;
+        for (size_t offset = 0; offset < data.size(); offset += SAMPLE_SIZE) {
+            sample_sizes.push_back(std::min(SAMPLE_SIZE, data.size() - offset));
+        }
+    }
+
+    std::vector<char> result(MAX_SIZE);
+    const auto size = ZDICT_trainFromBuffer(
+        &result[0], result.size(), samples.data(),
+        sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()));
+    if (ZDICT_isError(size)) {
+        throw std::runtime_error(std::string("Could not train replay dictionary: ") +
+                                 ZDICT_getErrorName(size));
+    }
+
+    std::ofstream file(output, std::ios_base::binary);
+    file.write(result.data(), size);
+    if (!file) {
+        throw std::runtime_error("Could not write replay dictionary " + output);
+    }
 }
@@ -2,19 +2,174 @@
 #define HALITE_REPLAY_HPP
 
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <string>
 
-#include "json.hpp"
+#include "json_fwd.hpp"
 #include "../zstd-1.3.0/lib/zstd.h"
 
+#include "BinaryReplay.hpp"
 #include "Constants.hpp"
 #include "Entity.hpp"
+#include "FrameHistory.hpp"
 #include "hlt.hpp"
 #include "GameEvent.hpp"
+#include "JsonWriter.hpp"
 #include "Statistics.hpp"
 #include "mapgen/Generator.hpp"
 
+constexpr auto REPLAY_VERSION = 31;
+//! The version of replays with delta frames (see ReplayOptions::keyframe_interval).
+constexpr auto DELTA_REPLAY_VERSION = 32;
+
+//! The version of moves-only replays (see ReplayFormat::Moves).
+constexpr auto MOVES_REPLAY_VERSION = 33;
+//! The version of replay previews (see ReplayOptions::preview_interval),
+//! written as "preview_version"; it is numbered apart from replays.
+constexpr auto PREVIEW_REPLAY_VERSION = 1;
+//! Positions in replay previews are in units of 1/PREVIEW_POSITION_SCALE.
+constexpr auto PREVIEW_POSITION_SCALE = 10;
+
+/**
+ * Every format's header holds "state_hashes", the Map::state_hash of every
+ * frame (see hlt::state_hash_string), for comparing games without
+ * comparing their frames.
+ */
+enum class ReplayFormat {
+    Json,
+    //! See BinaryReplay.hpp.
+    Binary,
+    /**
+     * A JSON replay (version 33) without "frames": the engine plays the
+     * game again from the header and the moves to rebuild them (see
+     * expand_replay). Besides "moves", it holds "eliminations", the
+     * players taken out of the game by errors or timeouts, as {"player",
+     * "turn"} (taken out before the moves of that turn), and "checksums",
+     * the FrameHistory::Frame::checksum of every frame.
+     */
+    Moves,
+};
+
+//! The extension of replay files in the given format, with its dot.
+auto replay_extension(ReplayFormat format) -> const char*;
+
+/**
+ * A zstd dictionary trained on earlier replays (see train). Short replays
+ * are very alike, so with a dictionary they compress at a moderate level
+ * to about the size they would have at the maximum level, in a fraction
+ * of the time. Long replays come out somewhat larger. Replays can only be
+ * decompressed with the same dictionary (for example, zstd -d -D file).
+ */
+class ReplayDictionary {
+public:
+    //! The compression level used with a dictionary, unless another one
+    //! is given.
+    constexpr static int DEFAULT_COMPRESSION_LEVEL = 12;
+    //! The largest dictionary train writes.
+    constexpr static size_t MAX_SIZE = 112640;
+
+    /**
+     * Load a dictionary for compressing at the given level (which is
+     * fixed once the dictionary is loaded). Throws std::runtime_error if
+     * it can't be read.
+     */
+    explicit ReplayDictionary(const std::string& filename,
+                              int compression_level = DEFAULT_COMPRESSION_LEVEL);
+    ~ReplayDictionary();
+    ReplayDictionary(const ReplayDictionary&) = delete;
+    auto operator=(const ReplayDictionary&) -> ReplayDictionary& = delete;
+
+    auto get() const -> const ZSTD_CDict* { return dictionary; }
+
+    /**
+     * Train a dictionary on the given replays (compressed or not, in any
+     * format) and write it to output. Throws std::runtime_error if there
+     * aren't enough samples, or the files can't be read or written.
+     */
+    static auto train(const std::vector<std::string>& replays,
+                      const std::string& output) -> void;
+
+private:
+    ZSTD_CDict* dictionary;
+};
+
+struct ReplayOptions {
+    bool enable_compression = true;
+    //! The zstd level, or 0 for the maximum level. Ignored with a
+    //! dictionary, which has a level of its own.
+    int compression_level = 0;
+    //! With more than one, sections of the replay are compressed in
+    //! parallel, at some cost in size.
+    unsigned int compression_threads = 1;
+    //! With more than one, the frames and moves of the replay are
+    //! serialized on this many threads, a batch of them at a time, before
+    //! they are compressed (in order, so the replay is the same).
+    unsigned int encoding_threads = 1;
+    /**
+     * If nonzero, compress at the highest level up to compression_level
+     * whose zstd contexts should fit in this many bytes: at the highest
+     * levels they take far more memory than the game itself. Ignored with
+     * a dictionary.
+     */
+    uint64_t memory_budget = 0;
+    /**
+     * Write the replay on a background thread, so that the game's results
+     * can be reported before compression finishes (see
+     * Halite::take_replay_job).
+     */
+    bool asynchronous = false;
+    /**
+     * If nonzero, only every keyframe_interval-th frame (starting with the
+     * first) is written in full, with "keyframe": true. The others only
+     * hold what changed since the frame before:
+     *
+     *  - "ships": for each player, the ships that were created or changed;
+     *  - "destroyed_ships": for each player, the IDs of ships that are gone;
+     *  - "planets": the planets that changed;
+     *  - "destroyed_planets": the IDs of planets that are gone;
+     *  - "events", as in full frames.
+     *
+     * Entities are always written in full. This is replay version 32; see
+     * DELTA_REPLAY_VERSION.
+     */
+    unsigned int keyframe_interval = 0;
+    //! Binary replays are instead split into chunks of keyframe_interval
+    //! frames that can be decompressed on their own (see BinaryReplay.hpp).
+    ReplayFormat format = ReplayFormat::Json;
+    //! If set, compress with this dictionary instead of on its own.
+    const ReplayDictionary* dictionary = nullptr;
+    /**
+     * If nonzero, a preview of the replay is also written (see
+     * Replay::output_preview), with every preview_interval-th frame and the
+     * last. It is a small JSON replay, compressed like the full one, that
+     * a visualizer can show while it loads the full replay. Besides the
+     * header of a replay (with "preview_version" and "preview_interval"
+     * instead of "version"), it holds "frames", each an object of:
+     *
+     *  - "frame": the index of the frame in the full replay;
+     *  - "ships": for each player, the ships as [id, x, y, health,
+     *    docking_status], with x and y in units of 1/"position_scale";
+     *  - "planets": the living planets as [id, owner (-1 if unowned),
+     *    health, number of docked ships];
+     *  - "events": the number of "attacks" and "contentions", the
+     *    "ships_destroyed" and "ships_spawned" of each player, and the IDs
+     *    of the "planets_destroyed", since the previous preview frame.
+     */
+    unsigned int preview_interval = 0;
+    /**
+     * If set, replays (and previews) are piped into this shell command
+     * instead of being written to files, one run of it for each (see
+     * ReplaySink::command), and GameStatistics::output_filename is just
+     * the name the file would have had. A command that uploads its input
+     * (say, curl -T - or gsutil cp -) sends the replay straight to
+     * storage.
+     */
+    std::string sink_command;
+    //! Don't report problems compressing the replay on stdout.
+    bool quiet_output = false;
+};
+
 struct Replay {
     GameStatistics& stats;
 
@@ -27,16 +182,82 @@ struct Replay {
 
     unsigned short map_width;
     unsigned short map_height;
+    //! The constants the game was played with.
+    const hlt::GameConstants& constants;
+
+    const hlt::FrameHistory& full_frames;
+    const EventLog& full_frame_events;
+    const hlt::MoveHistory& full_player_moves;
 
-    std::vector<hlt::Map>& full_frames;
-    std::vector<std::vector<std::unique_ptr<Event>>>& full_frame_events;
-    std::vector<hlt::MoveQueue>& full_player_moves;
+    const ReplayOptions& options;
 
-    auto output(std::string filename, bool enable_compression) -> void;
+    /**
+     * Write the replay to the given stream (usually a ReplaySink's), and
+     * flush it. The frames and moves are
+     * serialized and written (or compressed) one at a time, rather than
+     * building the JSON for the whole replay first.
+     *
+     * Once full_frames only keeps summaries (see
+     * FrameHistory::keep_summaries_only), only ReplayFormat::Moves can be
+     * written; other formats throw std::runtime_error.
+     *
+     * @return The most memory writing it held at once, in bytes (see
+     * MemoryReport).
+     */
+    auto output(std::ostream& file) -> size_t;
+    //! Write the replay with the given "stats" instead (as when it is
+    //! rebuilt from a moves-only replay).
+    auto output(std::ostream& file, const nlohmann::json& stats_json) -> size_t;
+    //! Write the preview of the replay (see ReplayOptions::preview_interval)
+    //! to the given stream, returning the memory it took like output.
+    auto output_preview(std::ostream& file) -> size_t;
+
+    /**
+     * Write a checkpoint of the game so far: a moves-only replay (see
+     * ReplayFormat::Moves, whatever options.format is) with the given
+     * "checkpoint" in place of "stats" (see Halite::resume_from).
+     */
+    auto output_checkpoint(std::ostream& file, const nlohmann::json& checkpoint) -> size_t;
+    //! The header of the replay, as far as it is known while the game is
+    //! played (without "num_frames" and "state_hashes"), for a LiveStream.
+    auto live_header() -> nlohmann::json;
+    /**
+     * Write a frame for a LiveStream: a keyframe if asked for (and for
+     * frame 0), else a delta frame from the frame before it. Unlike in the
+     * replay, a frame comes with the events of the turn that led to it,
+     * as those of the next turn aren't known yet when it is sent.
+     */
+    auto write_live_frame(JsonWriter& json, size_t frame_idx, bool keyframe) -> void;
 
 private:
     auto output_header(nlohmann::json& replay) -> void;
+    //! Write the JSON for one frame, with the events of frame events_idx
+    //! (and "keyframe": true if it is one).
+    auto write_frame(JsonWriter& json, size_t frame_idx, size_t events_idx,
+                     bool keyframe) -> void;
+    /**
+     * Write a frame as a delta frame (see ReplayOptions::keyframe_interval)
+     * from the frame before it, with the events of frame events_idx.
+     */
+    auto write_delta_frame(JsonWriter& json, size_t frame_idx, size_t events_idx) -> void;
+    //! Fill in a binary replay frame (with the moves made after it).
+    auto binary_frame(size_t frame_idx, binary_replay::Frame& frame) -> void;
+    auto output_binary(std::ostream& file, const nlohmann::json& header) -> size_t;
+    //! Write a preview frame, with the events of frames events_from up
+    //! to it.
+    auto write_preview_frame(JsonWriter& json, size_t frame_idx,
+                             size_t events_from) -> void;
+    //! See ReplayFormat::Moves.
+    auto output_moves(std::ostream& file, nlohmann::json& header) -> size_t;
+    //! Write the JSON for the moves made after one frame.
+    auto write_moves(JsonWriter& json, size_t frame_idx) -> void;
 };
 
 
+/**
+ * The contents of a replay file, decompressed if it is a zstd stream.
+ * Throws std::runtime_error if it can't be read or decompressed.
+ */
+auto read_replay_file(const std::string& filename) -> std::string;
+
 #endif //HALITE_REPLAY_HPP
@@ -0,0 +1,505 @@
+#include "ReplayBenchmark.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+#include "Halite.hpp"
+#include "ReplayPlayback.hpp"
+#include "../networking/Networking.hpp"
+#include "../zstd-1.3.0/lib/dictBuilder/zdict.h"
+
+namespace {
+    /**
+     * A replay, with every frame in full as the JSON replays store for its
+     * ships and living planets: {"ships": {owner: {id: ship}}, "planets":
+     * {id: planet}}. Events are left out.
+     */
+    struct RecordedGame {
+        nlohmann::json header;
+        std::vector<nlohmann::json> frames;
+        //! The moves made after each frame but the last.
+        std::vector<std::vector<RecordedMove>> moves;
+    };
+
+    //! The member of a JSON object, or an empty object if it is missing or
+    //! null (as in frames without ships or planets).
+    auto member(const nlohmann::json& json, const std::string& key) -> nlohmann::json {
+        const auto it = json.find(key);
+        return it != json.end() && it->is_object() ? *it : nlohmann::json::object();
+    }
+
+    //! Apply a delta frame (see ReplayOptions::keyframe_interval).
+    auto apply_delta(nlohmann::json& frame, const nlohmann::json& delta) -> void {
+        auto& ships = frame["ships"];
+        const auto changed_ships = member(delta, "ships");
+        for (auto player = changed_ships.begin(); player != changed_ships.end(); ++player) {
+            for (auto ship = player.value().begin(); ship != player.value().end(); ++ship) {
+                ships[player.key()][ship.key()] = ship.value();
+            }
+        }
+        const auto destroyed_ships = member(delta, "destroyed_ships");
+        for (auto player = destroyed_ships.begin(); player != destroyed_ships.end(); ++player) {
+            for (const auto& id : player.value()) {
+                ships[player.key()].erase(std::to_string(id.get<unsigned int>()));
+            }
+        }
+
+        auto& planets = frame["planets"];
+        const auto changed_planets = member(delta, "planets");
+        for (auto planet = changed_planets.begin(); planet != changed_planets.end(); ++planet) {
+            planets[planet.key()] = planet.value();
+        }
+        const auto destroyed = delta.find("destroyed_planets");
+        if (destroyed != delta.end()) {
+            for (const auto& id : *destroyed) {
+                planets.erase(std::to_string(id.get<unsigned int>()));
+            }
+        }
+    }
+
+    auto read_json_replay(nlohmann::json replay, RecordedGame& game) -> void {
+        nlohmann::json frame;
+        for (const auto& replay_frame : replay.at("frames")) {
+            if (game.frames.empty() || replay_frame.value("keyframe", false) ||
+                replay.value("version", 0) < DELTA_REPLAY_VERSION) {
+                frame = nlohmann::json{
+                    { "ships", member(replay_frame, "ships") },
+                    { "planets", member(replay_frame, "planets") },
+                };
+            }
+            else {
+                apply_delta(frame, replay_frame);
+            }
+            game.frames.push_back(frame);
+        }
+
+        for (const auto& replay_moves : replay.at("moves")) {
+            game.moves.emplace_back();
+            read_turn_moves(replay_moves, game.moves.back());
+        }
+
+        replay.erase("frames");
+        replay.erase("moves");
+        game.header = std::move(replay);
+    }
+
+    //! A binary replay frame as the JSON of a replay frame.
+    auto binary_frame_json(const binary_replay::Frame& frame) -> nlohmann::json {
+        auto ships = nlohmann::json::object();
+        const auto& ship_table = frame.ships;
+        for (size_t i = 0; i < ship_table.size(); i++) {
+            hlt::ShipSnapshot ship;
+            ship.x = ship_table.x[i];
+            ship.y = ship_table.y[i];
+            ship.vel_x = ship_table.vel_x[i];
+            ship.vel_y = ship_table.vel_y[i];
+            ship.id = ship_table.id[i];
+            ship.docked_planet = ship_table.docked_planet[i];
+            ship.docking_progress = ship_table.docking_progress[i];
+            ship.weapon_cooldown = ship_table.cooldown[i];
+            ship.health = static_cast<uint16_t>(ship_table.health[i]);
+            ship.owner = ship_table.owner[i];
+            ship.docking_status = static_cast<hlt::DockingStatus>(ship_table.docking_status[i]);
+            ships[std::to_string(ship.owner)][std::to_string(ship.id)] = ship.output_json();
+        }
+
+        auto planets = nlohmann::json::object();
+        const auto& planet_table = frame.planets;
+        for (size_t i = 0; i < planet_table.size(); i++) {
+            hlt::PlanetSnapshot planet;
+            planet.id = planet_table.id[i];
+            planet.docked_ships = planet_table.docked_ships.data() + planet_table.docked_offset[i];
+            planet.num_docked = static_cast<uint16_t>(
+                planet_table.docked_offset[i + 1] - planet_table.docked_offset[i]);
+            planet.health = static_cast<uint16_t>(planet_table.health[i]);
+            planet.remaining_production = static_cast<uint16_t>(planet_table.remaining_production[i]);
+            planet.current_production = static_cast<uint16_t>(planet_table.current_production[i]);
+            planet.owned = planet_table.owner[i] != binary_replay::NO_OWNER;
+            planet.owner = planet.owned ? planet_table.owner[i] : 0;
+            planets[std::to_string(planet.id)] = planet.output_json();
+        }
+
+        return nlohmann::json{ { "ships", ships }, { "planets", planets } };
+    }
+
+    auto read_binary_replay(const std::string& filename, RecordedGame& game) -> void {
+        std::vector<binary_replay::Frame> frames;
+        binary_replay::read_all(filename, game.header, frames);
+        for (size_t i = 0; i < frames.size(); i++) {
+            game.frames.push_back(binary_frame_json(frames[i]));
+            // The last frame has no moves after it
+            if (i + 1 == frames.size()) break;
+
+            game.moves.emplace_back();
+            const auto& moves = frames[i].moves;
+            for (size_t j = 0; j < moves.size(); j++) {
+                hlt::Move move = {};
+                move.shipId = moves.ship_id[j];
+                switch (moves.type[j]) {
+                    case binary_replay::MoveType::Thrust:
+                        move.type = hlt::MoveType::Thrust;
+                        move.move.thrust.thrust = static_cast<unsigned short>(moves.magnitude_or_planet[j]);
+                        move.move.thrust.angle = static_cast<unsigned short>(moves.angle[j]);
+                        break;
+                    case binary_replay::MoveType::Dock:
+                        move.type = hlt::MoveType::Dock;
+                        move.move.dock_to = moves.magnitude_or_planet[j];
+                        break;
+                    case binary_replay::MoveType::Undock:
+                        move.type = hlt::MoveType::Undock;
+                        break;
+                    default:
+                        throw std::runtime_error("Unknown move type in replay");
+                }
+                game.moves.back().push_back(
+                    make_recorded_move(moves.owner[j], moves.queue_number[j], move));
+            }
+        }
+    }
+
+    auto read_replay(const std::string& filename) -> RecordedGame {
+        RecordedGame game;
+        try {
+            const auto data = read_replay_file(filename);
+            if (data.size() >= sizeof(binary_replay::MAGIC) &&
+                std::memcmp(data.data(), binary_replay::MAGIC, sizeof(binary_replay::MAGIC)) == 0) {
+                read_binary_replay(filename, game);
+            }
+            else {
+                read_json_replay(nlohmann::json::parse(data), game);
+            }
+        }
+        catch (const std::logic_error& e) {
+            // What the JSON library throws for malformed replays
+            throw std::runtime_error("Invalid replay " + filename + ": " + e.what());
+        }
+
+        if (game.frames.empty() || game.moves.size() + 1 != game.frames.size()) {
+            throw std::runtime_error("Invalid replay " + filename + ": frames and moves don't match up");
+        }
+        return game;
+    }
+
+    //! The current state of a game, as the JSON of a replay frame.
+    auto map_frame_json(const hlt::Map& map, unsigned short num_players,
+                        hlt::FrameHistory& history) -> nlohmann::json {
+        history.record(map);
+        const auto& frame = history.back();
+
+        auto ships = nlohmann::json::object();
+        for (hlt::PlayerId player = 0; player < num_players; player++) {
+            auto& player_ships = ships[std::to_string(player)] = nlohmann::json::object();
+            for (const auto& ship : frame.player_ships(player)) {
+                player_ships[std::to_string(ship.id)] = ship.output_json();
+            }
+        }
+
+        auto planets = nlohmann::json::object();
+        for (const auto& planet : frame.living_planets()) {
+            planets[std::to_string(planet.id)] = planet.output_json();
+        }
+
+        return nlohmann::json{ { "ships", ships }, { "planets", planets } };
+    }
+
+    //! The first difference between two sets of entities ({id: entity}),
+    //! or an empty string.
+    auto compare_entities(const std::string& what, const nlohmann::json& expected,
+                          const nlohmann::json& actual) -> std::string {
+        for (auto it = expected.begin(); it != expected.end(); ++it) {
+            const auto found = actual.find(it.key());
+            if (found == actual.end()) {
+                return what + it.key() + " is missing (the replay has " + it.value().dump() + ")";
+            }
+            if (*found != it.value()) {
+                return what + it.key() + " is " + found->dump() +
+                    ", but the replay has " + it.value().dump();
+            }
+        }
+        for (auto it = actual.begin(); it != actual.end(); ++it) {
+            if (expected.find(it.key()) == expected.end()) {
+                return what + it.key() + " is not in the replay (it is " + it.value().dump() + ")";
+            }
+        }
+        return "";
+    }
+
+    //! The first difference between two frames, or an empty string.
+    auto compare_frames(const nlohmann::json& expected, const nlohmann::json& actual) -> std::string {
+        const auto expected_ships = member(expected, "ships");
+        const auto actual_ships = member(actual, "ships");
+        // A player with no ships may be missing from either
+        for (const auto* ships : { &expected_ships, &actual_ships }) {
+            for (auto player = ships->begin(); player != ships->end(); ++player) {
+                const auto difference = compare_entities(
+                    "player " + player.key() + "'s ship ",
+                    member(expected_ships, player.key()), member(actual_ships, player.key()));
+                if (!difference.empty()) return difference;
+            }
+        }
+        return compare_entities("planet ", member(expected, "planets"), member(actual, "planets"));
+    }
+
+    //! The players with ships on the map that have none in the given frame.
+    auto vanished_players(const hlt::Map& map, unsigned short num_players,
+                          const nlohmann::json& frame) -> std::vector<hlt::PlayerId> {
+        const auto ships = member(frame, "ships");
+        std::vector<hlt::PlayerId> vanished;
+        for (hlt::PlayerId player = 0; player < num_players; player++) {
+            if (!map.ships[player].empty() && member(ships, std::to_string(player)).empty()) {
+                vanished.push_back(player);
+            }
+        }
+        return vanished;
+    }
+
+    //! A recorded game played again once with every frame checked, ready to
+    //! be played again from the start.
+    struct CheckedGame {
+        unsigned short num_players = 0;
+        std::unique_ptr<Halite> halite;
+        Halite::Snapshot start;
+        //! The moves of each turn, and the players eliminated before it.
+        std::vector<hlt::MoveQueue> turn_moves;
+        std::vector<std::vector<hlt::PlayerId>> eliminated;
+        //! Where the game first came out differently, or empty.
+        std::string mismatch;
+    };
+
+    /**
+     * Play a recorded game again from the start, comparing every frame
+     * against the replay and finding out which players were eliminated
+     * when. on_frame is called with the map of every frame that matched,
+     * the first included.
+     */
+    auto check_game(const RecordedGame& game, const std::string& filename,
+                    unsigned int event_threads,
+                    const std::function<void(const hlt::Map&)>& on_frame) -> CheckedGame {
+        const auto& header = game.header;
+        const auto turns = static_cast<unsigned int>(game.moves.size());
+        CheckedGame result;
+
+        RecordedSetup setup;
+        try {
+            setup = read_recorded_setup(header);
+        }
+        catch (const std::runtime_error& e) {
+            throw std::runtime_error("Invalid replay " + filename + ": " + e.what());
+        }
+        const auto num_players = result.num_players = setup.num_players;
+        GameOptions options;
+        options.event_threads = event_threads;
+        options.constants = setup.constants;
+        const auto& constants = options.constants;
+
+        // Single-player maps are made for more players, which replays don't
+        // record, so try each number the map generators support
+        const auto map_players = num_players == 1
+            ? std::vector<unsigned short>{ 2, 4 }
+            : std::vector<unsigned short>{ num_players };
+        hlt::FrameHistory history;
+        history.keep_latest_only();
+        auto& halite = result.halite;
+        for (const auto effective_players : map_players) {
+            std::unique_ptr<Halite> candidate(new Halite(
+                mapgen::generate_map(mapgen::MapKey::current(
+                    setup.generator, setup.seed, setup.width, setup.height, num_players,
+                    effective_players, constants),
+                    constants),
+                options));
+            result.mismatch = compare_frames(
+                game.frames.front(), map_frame_json(candidate->get_map(), num_players, history));
+            if (result.mismatch.empty()) {
+                halite = std::move(candidate);
+                break;
+            }
+        }
+        if (!halite) {
+            result.mismatch = "frame 0: " + result.mismatch;
+            return result;
+        }
+        on_frame(halite->get_map());
+
+        Halite::Snapshot before_turn;
+        halite->save(result.start);
+        result.turn_moves.resize(turns);
+        result.eliminated.resize(turns);
+        for (unsigned int turn = 0; turn < turns; turn++) {
+            auto& moves = result.turn_moves[turn];
+            queue_moves(game.moves[turn], halite->get_map(), moves);
+            const auto& expected = game.frames[turn + 1];
+            const auto vanished = vanished_players(halite->get_map(), num_players, expected);
+            if (!vanished.empty()) {
+                halite->save(before_turn);
+            }
+
+            halite->step(moves);
+            auto mismatch = compare_frames(
+                expected, map_frame_json(halite->get_map(), num_players, history));
+
+            // Try eliminating every combination of the players whose ships
+            // vanished (others may have lost them in battle)
+            for (unsigned int subset = 1; !mismatch.empty() && subset < (1U << vanished.size()); subset++) {
+                std::vector<hlt::PlayerId> players;
+                for (size_t i = 0; i < vanished.size(); i++) {
+                    if (subset & (1U << i)) players.push_back(vanished[i]);
+                }
+
+                halite->restore(before_turn);
+                for (const auto player : players) {
+                    halite->eliminate_player(player);
+                }
+                halite->step(moves);
+                if (compare_frames(expected, map_frame_json(
+                        halite->get_map(), num_players, history)).empty()) {
+                    mismatch.clear();
+                    result.eliminated[turn] = players;
+                }
+            }
+
+            if (!mismatch.empty()) {
+                result.mismatch = "frame " + std::to_string(turn + 1) + ": " + mismatch;
+                return result;
+            }
+            on_frame(halite->get_map());
+        }
+        return result;
+    }
+}
+
+auto ReplayBenchmark::turns_per_second() const -> double {
+    return seconds > 0 ? turns * repetitions / seconds : 0;
+}
+
+auto benchmark_replay(const std::string& filename, unsigned int repetitions,
+                      unsigned int event_threads) -> ReplayBenchmark {
+    const auto game = read_replay(filename);
+
+    ReplayBenchmark result;
+    result.turns = static_cast<unsigned int>(game.moves.size());
+    result.repetitions = repetitions;
+
+    auto checked = check_game(game, filename, event_threads, [](const hlt::Map&) {});
+    if (!checked.mismatch.empty()) {
+        result.mismatch = checked.mismatch;
+        return result;
+    }
+    auto& halite = checked.halite;
+
+    // Repetitions have to end in exactly the same state as the checked
+    // run, which the replay can't tell apart at its precision
+    hlt::FrameHistory history;
+    history.keep_latest_only();
+    const auto final_hash = halite->get_map().state_hash();
+    for (unsigned int repetition = 0; repetition < repetitions; repetition++) {
+        halite->restore(checked.start);
+        const auto begin = std::chrono::steady_clock::now();
+        for (unsigned int turn = 0; turn < result.turns; turn++) {
+            for (const auto player : checked.eliminated[turn]) {
+                halite->eliminate_player(player);
+            }
+            halite->step(checked.turn_moves[turn]);
+        }
+        result.seconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+
+        auto mismatch = compare_frames(
+            game.frames.back(), map_frame_json(halite->get_map(), checked.num_players, history));
+        if (mismatch.empty() && halite->get_map().state_hash() != final_hash) {
+            mismatch = "state hash differs from the first run";
+        }
+        if (!mismatch.empty()) {
+            result.mismatch = "repetition " + std::to_string(repetition + 1) +
+                ", frame " + std::to_string(result.turns) + ": " + mismatch;
+            return result;
+        }
+    }
+    return result;
+}
+
+auto export_replay_frames(const std::string& filename, unsigned int event_threads) -> std::string {
+    const auto game = read_replay(filename);
+
+    auto output_filename = filename;
+    const auto dot = output_filename.rfind('.');
+    const auto slash = output_filename.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        output_filename.resize(dot);
+    }
+    output_filename += FRAME_FILE_EXTENSION;
+
+    std::ofstream output(output_filename, std::ios::binary);
+    if (!output) {
+        throw std::runtime_error("Could not write " + output_filename);
+    }
+    std::string frame;
+    unsigned short num_players = 0;
+    const auto checked = check_game(game, filename, event_threads, [&](const hlt::Map& map) {
+        if (num_players == 0) {
+            // check_game has read the header by the first frame
+            num_players = read_recorded_setup(game.header).num_players;
+            output << FRAME_FILE_MAGIC << '\n' << map.map_width << ' ' << map.map_height << '\n';
+        }
+        serialize_text_map(map, num_players, frame);
+        output << frame << '\n';
+    });
+    if (!checked.mismatch.empty()) {
+        output.close();
+        std::remove(output_filename.c_str());
+        throw std::runtime_error("The game did not play out as in the replay, at " + checked.mismatch);
+    }
+
+    output.close();
+    if (!output) {
+        throw std::runtime_error("Could not write " + output_filename);
+    }
+    return output_filename;
+}
+
+auto train_frame_dictionary(const std::vector<std::string>& filenames,
+                            const std::string& output_filename,
+                            unsigned int event_threads) -> size_t {
+    // Every frame of every game is a sample, as it would be sent (with its
+    // newline), back to back
+    std::string samples;
+    std::vector<size_t> sample_sizes;
+    std::string frame;
+    for (const auto& filename : filenames) {
+        const auto game = read_replay(filename);
+        unsigned short num_players = 0;
+        const auto checked = check_game(game, filename, event_threads, [&](const hlt::Map& map) {
+            if (num_players == 0) {
+                num_players = read_recorded_setup(game.header).num_players;
+            }
+            serialize_text_map(map, num_players, frame);
+            samples += frame;
+            samples += '\n';
+            sample_sizes.push_back(frame.size() + 1);
+        });
+        if (!checked.mismatch.empty()) {
+            throw std::runtime_error(filename + " did not play out as in the replay, at " + checked.mismatch);
+        }
+    }
+
+    std::string dictionary(FRAME_DICTIONARY_CAPACITY, '\0');
+    const auto size = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(), samples.data(),
+                                            sample_sizes.data(),
+                                            static_cast<unsigned int>(sample_sizes.size()));
+    if (ZDICT_isError(size)) {
+        throw std::runtime_error(std::string("Could not train a frame dictionary: ") +
+                                 ZDICT_getErrorName(size));
+    }
+
+    std::ofstream output(output_filename, std::ios::binary);
+    output.write(dictionary.data(), static_cast<std::streamsize>(size));
+    output.close();
+    if (!output) {
+        throw std::runtime_error("Could not write " + output_filename);
+    }
+    return size;
+}
@@ -0,0 +1,85 @@
+#ifndef HALITE_REPLAYBENCHMARK_HPP
+#define HALITE_REPLAYBENCHMARK_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * The outcome of playing a recorded game again from its replay (see
+ * benchmark_replay).
+ */
+struct ReplayBenchmark {
+    //! The turns in the replay, played once per repetition.
+    unsigned int turns = 0;
+    unsigned int repetitions = 0;
+    //! Time spent in Halite::step over all repetitions.
+    double seconds = 0;
+    //! Where the game first came out differently from the replay, or
+    //! empty if every frame matched.
+    std::string mismatch;
+
+    auto matches() const -> bool { return mismatch.empty(); }
+    auto turns_per_second() const -> double;
+};
+
+/**
+ * Play a recorded game (a JSON or binary replay, compressed or not) again
+ * in-process, with the moves from the replay instead of bots.
+ *
+ * The game is regenerated from the seed, map generator, size and
+ * constants in the replay's header (which become the current game
+ * constants). It is first played once comparing every frame against the
+ * replay, which doubles as a check that the engine is still
+ * deterministic; then it is played repetitions more times from the start
+ * (checking only the last frame, and that its Map::state_hash is the
+ * same as the first time), timing nothing but the turns.
+ *
+ * A bot that errored or timed out shows up as its ships disappearing
+ * between two frames, so a player whose ships all vanish from one frame to
+ * the next is also tried as eliminated before that turn.
+ *
+ * Throws std::runtime_error if the replay can't be read or is malformed.
+ */
+auto benchmark_replay(const std::string& filename, unsigned int repetitions,
+                      unsigned int event_threads) -> ReplayBenchmark;
+
+//! The first line of a frame file (see export_replay_frames).
+constexpr const char* FRAME_FILE_MAGIC = "halite-frames 1";
+constexpr const char* FRAME_FILE_EXTENSION = ".frames";
+
+/**
+ * Play a recorded game again, checking it as benchmark_replay does, and
+ * write every frame of it out as bots are sent them, for replaying to a
+ * bot offline (see the C++ starter kit's bench.hpp).
+ *
+ * A frame file is text: FRAME_FILE_MAGIC, then the map's width and height
+ * (as the second line bots are sent at the start of a game), then a line
+ * per frame, the initial one first, each in the text format of
+ * Networking::serialize_map.
+ *
+ * The file goes next to the replay, with FRAME_FILE_EXTENSION instead of
+ * its extension; its name is returned. Throws std::runtime_error if the
+ * replay can't be read, doesn't play out as it did, or if the file can't
+ * be written.
+ */
+auto export_replay_frames(const std::string& filename, unsigned int event_threads) -> std::string;
+
+//! The most a dictionary from train_frame_dictionary takes up (zstd's
+//! usual size).
+constexpr size_t FRAME_DICTIONARY_CAPACITY = 110 << 10;
+
+/**
+ * Play recorded games again, checking them as benchmark_replay does, and
+ * train a zstd dictionary on their frames as text, for compressing the
+ * frames sent to remote bots (see ZSTD_FRAMES_OPTION). It is written to
+ * output_filename, and its size returned.
+ *
+ * Throws std::runtime_error if a replay can't be read or doesn't play out
+ * as it did, if zstd can't make a dictionary of the frames (say, there are
+ * too few), or if the file can't be written.
+ */
+auto train_frame_dictionary(const std::vector<std::string>& filenames,
+                            const std::string& output_filename,
+                            unsigned int event_threads) -> size_t;
+
+#endif //HALITE_REPLAYBENCHMARK_HPP
@@ -0,0 +1,233 @@
+#include "ReplayPlayback.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "Halite.hpp"
+#include "json.hpp"
+#include "mapgen/Generator.hpp"
+
+auto read_recorded_setup(const nlohmann::json& header) -> RecordedSetup {
+    RecordedSetup setup;
+    try {
+        setup.seed = header.at("seed").get<unsigned int>();
+        setup.width = header.at("width").get<unsigned short>();
+        setup.height = header.at("height").get<unsigned short>();
+        setup.num_players = header.at("num_players").get<unsigned short>();
+        setup.generator = header.value("map_generator", std::string(mapgen::DEFAULT_GENERATOR));
+        if (header.find("constants") != header.end()) {
+            setup.constants.from_json(header.at("constants"));
+        }
+    }
+    catch (const std::logic_error& e) {
+        throw std::runtime_error(e.what());
+    }
+    if (setup.num_players == 0 || setup.num_players > hlt::MAX_PLAYERS) {
+        throw std::runtime_error("bad number of players");
+    }
+    return setup;
+}
+
+auto make_recorded_move(hlt::PlayerId owner, int queue_number, hlt::Move move) -> RecordedMove {
+    if (owner >= hlt::MAX_PLAYERS || queue_number < 0 ||
+        queue_number >= hlt::MAX_QUEUED_MOVES_LIMIT) {
+        throw std::runtime_error("Invalid move in replay");
+    }
+    return RecordedMove{ owner, queue_number, move };
+}
+
+auto read_turn_moves(const nlohmann::json& turn, std::vector<RecordedMove>& moves) -> void {
+    for (auto player = turn.begin(); player != turn.end(); ++player) {
+        const auto owner = static_cast<hlt::PlayerId>(std::stoi(player.key()));
+        for (size_t queue_number = 0; queue_number < player.value().size(); queue_number++) {
+            const auto& queued = player.value()[queue_number];
+            for (auto it = queued.begin(); it != queued.end(); ++it) {
+                const auto& json = it.value();
+                hlt::Move move = {};
+                move.shipId = json.at("shipId").get<hlt::EntityIndex>();
+                const auto type = json.at("type").get<std::string>();
+                if (type == "thrust") {
+                    move.type = hlt::MoveType::Thrust;
+                    move.move.thrust.thrust = json.at("magnitude").get<unsigned short>();
+                    move.move.thrust.angle = json.at("angle").get<unsigned short>();
+                }
+                else if (type == "dock") {
+                    move.type = hlt::MoveType::Dock;
+                    move.move.dock_to = json.at("planet_id").get<hlt::EntityIndex>();
+                }
+                else if (type == "undock") {
+                    move.type = hlt::MoveType::Undock;
+                }
+                else {
+                    throw std::runtime_error("Unknown move type in replay: " + type);
+                }
+                moves.push_back(make_recorded_move(owner, static_cast<int>(queue_number), move));
+            }
+        }
+    }
+}
+
+auto queue_moves(const std::vector<RecordedMove>& recorded, const hlt::Map& map,
+                 hlt::MoveQueue& moves) -> void {
+    // As deep as the replay's queues go (its game's MAX_QUEUED_MOVES, or
+    // less if no ship used them all)
+    int depth = 1;
+    for (const auto& move : recorded) {
+        depth = std::max(depth, move.queue_number + 1);
+    }
+    moves.resize(map.player_count());
+    for (auto& queue : moves) {
+        queue.reset(map.ship_index_limit(), static_cast<unsigned int>(depth));
+    }
+    for (int move_no = 0; move_no < depth; move_no++) {
+        for (const auto& move : recorded) {
+            if (move.queue_number != move_no) continue;
+
+            // No-ops aren't recorded, but still take their place in
+            // the queue
+            if (move.owner >= moves.size()) {
+                throw std::runtime_error("Move for a player not in the game in replay");
+            }
+            auto& queue = moves[move.owner];
+            for (int earlier = 0; earlier < move_no; earlier++) {
+                if (queue.find(move.move.shipId, earlier) == nullptr) {
+                    hlt::Move noop = {};
+                    noop.type = hlt::MoveType::Noop;
+                    noop.shipId = move.move.shipId;
+                    queue.push(noop);
+                }
+            }
+            queue.push(move.move);
+        }
+    }
+}
+
+auto read_recorded_moves(const nlohmann::json& replay, unsigned short num_players)
+    -> RecordedMoves {
+    RecordedMoves recorded;
+    try {
+        for (const auto& turn : replay.at("moves")) {
+            recorded.moves.emplace_back();
+            read_turn_moves(turn, recorded.moves.back());
+        }
+        recorded.checksums = replay.at("checksums").get<std::vector<uint32_t>>();
+        recorded.eliminated.resize(recorded.moves.size());
+        for (const auto& elimination : replay.at("eliminations")) {
+            const auto turn = elimination.at("turn").get<size_t>();
+            const auto player = elimination.at("player").get<unsigned int>();
+            if (turn >= recorded.moves.size() || player >= num_players) {
+                throw std::runtime_error("bad elimination");
+            }
+            recorded.eliminated[turn].push_back(static_cast<hlt::PlayerId>(player));
+        }
+    }
+    catch (const std::logic_error& e) {
+        // What the JSON library throws for malformed replays
+        throw std::runtime_error(e.what());
+    }
+    if (recorded.checksums.size() != recorded.moves.size() + 1) {
+        throw std::runtime_error("frames and moves don't match up");
+    }
+    return recorded;
+}
+
+auto read_checkpoint(const std::string& filename) -> nlohmann::json {
+    nlohmann::json checkpoint;
+    try {
+        checkpoint = nlohmann::json::parse(read_replay_file(filename));
+    }
+    catch (const std::logic_error& e) {
+        throw std::runtime_error("Invalid checkpoint " + filename + ": " + e.what());
+    }
+    if (!checkpoint.is_object() || checkpoint.value("version", 0) != MOVES_REPLAY_VERSION ||
+        checkpoint.find("checkpoint") == checkpoint.end()) {
+        throw std::runtime_error(filename + " is not a checkpoint");
+    }
+    return checkpoint;
+}
+
+auto expand_replay(const std::string& filename, const ReplayOptions& options) -> std::string {
+    if (options.format == ReplayFormat::Moves) {
+        throw std::runtime_error("A replay can only be expanded into a format with frames");
+    }
+
+    RecordedSetup setup;
+    RecordedMoves recorded;
+    std::vector<std::string> names;
+    nlohmann::json stats;
+    try {
+        const auto replay = nlohmann::json::parse(read_replay_file(filename));
+        if (replay.value("version", 0) != MOVES_REPLAY_VERSION) {
+            throw std::runtime_error("not a moves-only replay");
+        }
+        setup = read_recorded_setup(replay);
+        recorded = read_recorded_moves(replay, setup.num_players);
+        names = replay.at("player_names").get<std::vector<std::string>>();
+        stats = replay.value("stats", nlohmann::json::object());
+    }
+    catch (const std::logic_error& e) {
+        // What the JSON library throws for malformed replays
+        throw std::runtime_error("Invalid replay " + filename + ": " + e.what());
+    }
+    catch (const std::runtime_error& e) {
+        throw std::runtime_error("Invalid replay " + filename + ": " + e.what());
+    }
+
+    // As in benchmark_replay, single-player maps may have been made for 2
+    // or 4 players; the first frame tells which
+    GameOptions game_options;
+    game_options.constants = setup.constants;
+    const auto map_players = setup.num_players == 1
+        ? std::vector<unsigned short>{ 2, 4 }
+        : std::vector<unsigned short>{ setup.num_players };
+    hlt::FrameHistory history;
+    history.keep_latest_only();
+    std::unique_ptr<Halite> halite;
+    for (const auto effective_players : map_players) {
+        std::unique_ptr<Halite> candidate(new Halite(
+            mapgen::generate_map(mapgen::MapKey::current(
+                setup.generator, setup.seed, setup.width, setup.height,
+                setup.num_players, effective_players, setup.constants),
+                setup.constants),
+            game_options));
+        history.record(candidate->get_map());
+        if (history.back().checksum() == recorded.checksums.front()) {
+            halite = std::move(candidate);
+            break;
+        }
+    }
+    if (!halite) {
+        throw std::runtime_error("Could not expand " + filename + ": frame 0 does not match its checksum");
+    }
+
+    halite->record_replay();
+    hlt::MoveQueue queue;
+    for (size_t turn = 0; turn < recorded.moves.size(); turn++) {
+        for (const auto player : recorded.eliminated[turn]) {
+            halite->eliminate_player(player);
+        }
+        queue_moves(recorded.moves[turn], halite->get_map(), queue);
+        halite->step(queue);
+        history.record(halite->get_map());
+        if (history.back().checksum() != recorded.checksums[turn + 1]) {
+            throw std::runtime_error(
+                "Could not expand " + filename + ": frame " + std::to_string(turn + 1) +
+                " does not match its checksum");
+        }
+    }
+
+    const std::string moves_extension = replay_extension(ReplayFormat::Moves);
+    auto output_filename = filename;
+    if (output_filename.size() > moves_extension.size() &&
+        output_filename.compare(output_filename.size() - moves_extension.size(),
+                                moves_extension.size(), moves_extension) == 0) {
+        output_filename.resize(output_filename.size() - moves_extension.size());
+    }
+    output_filename += replay_extension(options.format);
+
+    auto file = ReplaySink::file(output_filename);
+    halite->write_replay(file->stream(), options, names, stats);
+    file->close();
+    return output_filename;
+}
@@ -0,0 +1,97 @@
+#ifndef HALITE_REPLAYPLAYBACK_HPP
+#define HALITE_REPLAYPLAYBACK_HPP
+
+#include <string>
+#include <vector>
+
+#include "json_fwd.hpp"
+
+#include "Constants.hpp"
+#include "Replay.hpp"
+#include "hlt.hpp"
+
+/**
+ * What playing a recorded game again needs from its replay: the game it
+ * was, and the moves made each turn. Used by benchmark_replay and the
+ * simulation API (see SimulationApi.hpp).
+ */
+
+//! A move from a replay, and its place in its ship's queue.
+struct RecordedMove {
+    hlt::PlayerId owner;
+    int queue_number;
+    hlt::Move move;
+};
+
+//! The game a replay header describes.
+struct RecordedSetup {
+    unsigned int seed;
+    unsigned short width, height, num_players;
+    std::string generator;
+    //! The game's constants, or the defaults if the replay has none.
+    hlt::GameConstants constants;
+};
+
+/**
+ * Read the seed, size, number of players, map generator and constants of
+ * a replay header. Throws std::runtime_error if any are missing or bad.
+ */
+auto read_recorded_setup(const nlohmann::json& header) -> RecordedSetup;
+
+//! Throws std::runtime_error if the player or queue number is out of range.
+auto make_recorded_move(hlt::PlayerId owner, int queue_number, hlt::Move move) -> RecordedMove;
+
+/**
+ * Add the moves of one turn, as a JSON replay stores them ({player: [{id:
+ * move} for each queued move]}), to moves. Throws std::runtime_error
+ * (or what nlohmann::json throws) if they are malformed.
+ */
+auto read_turn_moves(const nlohmann::json& turn, std::vector<RecordedMove>& moves) -> void;
+
+//! The turns of a moves-only replay (see ReplayFormat::Moves).
+struct RecordedMoves {
+    //! The moves of each turn.
+    std::vector<std::vector<RecordedMove>> moves;
+    //! The players taken out before each turn.
+    std::vector<std::vector<hlt::PlayerId>> eliminated;
+    //! Frame::checksum of every frame, one more than there are turns.
+    std::vector<uint32_t> checksums;
+};
+
+/**
+ * Read the moves, eliminations and checksums of a moves-only replay of a
+ * game of num_players. Throws std::runtime_error if they are malformed or
+ * don't match up.
+ */
+auto read_recorded_moves(const nlohmann::json& replay, unsigned short num_players)
+    -> RecordedMoves;
+
+/**
+ * Read a checkpoint (see GameOptions::checkpoint_file): a moves-only
+ * replay with a "checkpoint" (see Halite::resume_from). Throws
+ * std::runtime_error if it can't be read or isn't one.
+ */
+auto read_checkpoint(const std::string& filename) -> nlohmann::json;
+
+/**
+ * Queue up a turn of recorded moves for the given map, with a queue for
+ * each of its players. Throws std::runtime_error for a move of a player
+ * the map doesn't have.
+ */
+auto queue_moves(const std::vector<RecordedMove>& recorded, const hlt::Map& map,
+                 hlt::MoveQueue& moves) -> void;
+
+/**
+ * Play a moves-only replay (see ReplayFormat::Moves) again, checking each
+ * frame against its checksum, and write it out in full, in the format of
+ * options (which can't be ReplayFormat::Moves). The file goes next to the
+ * moves-only one, with the extension of its format instead of .hltm; its
+ * name is returned.
+ *
+ * Throws std::runtime_error if the replay can't be read, if the game
+ * doesn't play out as it did (the engine isn't the one that played it,
+ * or isn't deterministic), or if the replay can't be written.
+ */
+auto expand_replay(const std::string& filename, const ReplayOptions& options) -> std::string;
+
+#endif //HALITE_REPLAYPLAYBACK_HPP
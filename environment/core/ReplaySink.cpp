@@ -0,0 +1,101 @@
+#include "ReplaySink.hpp"
+
+#include <csignal>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    //! Writes through a stdio stream, which does the buffering.
+    class PipeBuffer : public std::streambuf {
+    public:
+        explicit PipeBuffer(std::FILE* pipe) : pipe(pipe) {}
+
+    protected:
+        auto overflow(int_type c) -> int_type override {
+            if (traits_type::eq_int_type(c, traits_type::eof())) {
+                return traits_type::not_eof(c);
+            }
+            return std::fputc(c, pipe) == EOF ? traits_type::eof() : c;
+        }
+
+        auto xsputn(const char* data, std::streamsize size) -> std::streamsize override {
+            return static_cast<std::streamsize>(
+                std::fwrite(data, 1, static_cast<size_t>(size), pipe));
+        }
+
+        auto sync() -> int override {
+            return std::fflush(pipe) == 0 ? 0 : -1;
+        }
+
+    private:
+        std::FILE* pipe;
+    };
+}
+
+ReplaySink::ReplaySink() : out(nullptr) {}
+
+auto ReplaySink::file(const std::string& filename) -> std::unique_ptr<ReplaySink> {
+    std::unique_ptr<std::filebuf> file(new std::filebuf);
+    if (file->open(filename, std::ios_base::out | std::ios_base::binary) == nullptr) {
+        throw std::runtime_error("Could not open " + filename);
+    }
+    std::unique_ptr<ReplaySink> sink(new ReplaySink);
+    sink->buffer = std::move(file);
+    sink->out.rdbuf(sink->buffer.get());
+    sink->description = filename;
+    return sink;
+}
+
+auto ReplaySink::command(const std::string& command,
+                         const std::string& name) -> std::unique_ptr<ReplaySink> {
+    // Replay names only have letters, digits and "+-.", so need no quoting
+#ifdef _WIN32
+    const auto full_command = "set \"HALITE_REPLAY_NAME=" + name + "\" && " + command;
+    const auto pipe = _popen(full_command.c_str(), "wb");
+#else
+    // The command may exit before reading everything, which is reported
+    // by close rather than killing the engine
+    std::signal(SIGPIPE, SIG_IGN);
+    const auto full_command = "HALITE_REPLAY_NAME='" + name + "'; export HALITE_REPLAY_NAME; " + command;
+    const auto pipe = popen(full_command.c_str(), "w");
+#endif
+    if (pipe == nullptr) {
+        throw std::runtime_error("Could not start " + command);
+    }
+    std::unique_ptr<ReplaySink> sink(new ReplaySink);
+    sink->pipe = pipe;
+    sink->buffer.reset(new PipeBuffer(pipe));
+    sink->out.rdbuf(sink->buffer.get());
+    sink->description = "the command " + command;
+    return sink;
+}
+
+ReplaySink::~ReplaySink() {
+    try {
+        close();
+    }
+    catch (const std::runtime_error&) {
+    }
+}
+
+auto ReplaySink::close() -> void {
+    if (!buffer) return;
+    out.flush();
+    auto failed = !out;
+    if (pipe != nullptr) {
+#ifdef _WIN32
+        failed = _pclose(pipe) != 0 || failed;
+#else
+        failed = pclose(pipe) != 0 || failed;
+#endif
+        pipe = nullptr;
+    }
+    else {
+        failed = static_cast<std::filebuf*>(buffer.get())->close() == nullptr || failed;
+    }
+    out.rdbuf(nullptr);
+    buffer.reset();
+    if (failed) {
+        throw std::runtime_error("Could not write the replay to " + description);
+    }
+}
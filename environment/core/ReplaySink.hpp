@@ -0,0 +1,53 @@
+#ifndef HALITE_REPLAYSINK_HPP
+#define HALITE_REPLAYSINK_HPP
+
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+/**
+ * Where a replay (or its preview) is written: a file, or the standard
+ * input of a shell command (see ReplayOptions::sink_command), which can
+ * upload the replay to storage as it is compressed instead of it going
+ * through the disk.
+ */
+class ReplaySink {
+public:
+    //! Throws std::runtime_error if the file can't be opened.
+    static auto file(const std::string& filename) -> std::unique_ptr<ReplaySink>;
+    /**
+     * Start a shell command (with sh, or cmd on Windows) and write into
+     * it, with the environment variable HALITE_REPLAY_NAME set to the name
+     * the replay would have as a file. Throws std::runtime_error if the
+     * command can't be started.
+     */
+    static auto command(const std::string& command,
+                        const std::string& name) -> std::unique_ptr<ReplaySink>;
+
+    //! Closes the sink if close wasn't called, ignoring errors.
+    ~ReplaySink();
+    ReplaySink(const ReplaySink&) = delete;
+    ReplaySink& operator=(const ReplaySink&) = delete;
+
+    auto stream() -> std::ostream& { return out; }
+    /**
+     * Finish writing: close the file, or wait for the command to exit.
+     * Throws std::runtime_error if something couldn't be written or the
+     * command failed.
+     */
+    auto close() -> void;
+
+private:
+    ReplaySink();
+
+    std::unique_ptr<std::streambuf> buffer;
+    std::ostream out;
+    //! The command's standard input, if it is one.
+    std::FILE* pipe = nullptr;
+    //! The file or command, for error messages.
+    std::string description;
+};
+
+#endif //HALITE_REPLAYSINK_HPP
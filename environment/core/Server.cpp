@@ -0,0 +1,189 @@
+#include "Server.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+#ifndef _WIN32
+namespace {
+    /**
+     * A client's connection, closed once the client has stopped sending
+     * requests and the last of its games has been answered.
+     */
+    class Client {
+    public:
+        explicit Client(int socket) : socket(socket) {}
+        Client(const Client&) = delete;
+        Client& operator=(const Client&) = delete;
+        ~Client() {
+            close(socket);
+        }
+
+        //! Send a line of JSON. A client that has gone away just misses it.
+        auto send(const nlohmann::json& reply) -> void {
+            auto line = reply.dump();
+            line += '\n';
+            std::lock_guard<std::mutex> guard(write_mutex);
+            size_t written = 0;
+            while (written < line.size()) {
+                const auto bytes = write(socket, line.data() + written, line.size() - written);
+                if (bytes < 0 && errno == EINTR) continue;
+                if (bytes <= 0) return;
+                written += static_cast<size_t>(bytes);
+            }
+        }
+
+        const int socket;
+
+    private:
+        std::mutex write_mutex;
+    };
+
+    //! A requested game, waiting for a worker.
+    struct Request {
+        BatchGame game;
+        //! What the client called the request, if anything.
+        nlohmann::json name;
+        std::shared_ptr<Client> client;
+    };
+
+    //! The games waiting to be played, from every client.
+    class RequestQueue {
+    public:
+        auto push(Request request) -> void {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                requests.push_back(std::move(request));
+            }
+            available.notify_one();
+        }
+
+        auto pop() -> Request {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this]() { return !requests.empty(); });
+            auto request = std::move(requests.front());
+            requests.pop_front();
+            return request;
+        }
+
+    private:
+        std::deque<Request> requests;
+        std::mutex mutex;
+        std::condition_variable available;
+    };
+
+    //! Read a client's requests, one per line, until it closes its end.
+    auto read_requests(std::shared_ptr<Client> client, RequestQueue& queue,
+                       std::atomic<unsigned int>& next_id) -> void {
+        std::string received;
+        char buffer[4096];
+        while (true) {
+            const auto bytes = read(client->socket, buffer, sizeof(buffer));
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) break;
+            received.append(buffer, static_cast<size_t>(bytes));
+
+            size_t start = 0, newline;
+            while ((newline = received.find('\n', start)) != std::string::npos) {
+                const auto line = received.substr(start, newline - start);
+                start = newline + 1;
+                if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+                Request request;
+                request.client = client;
+                try {
+                    const auto json = nlohmann::json::parse(line);
+                    if (json.is_object() && json.count("request") != 0) {
+                        request.name = json["request"];
+                    }
+                    from_json(json, request.game);
+                }
+                catch (const std::exception& e) {
+                    nlohmann::json reply;
+                    reply["error"] = std::string("Invalid game request: ") + e.what();
+                    if (!request.name.is_null()) reply["request"] = request.name;
+                    client->send(reply);
+                    continue;
+                }
+                fill_batch_defaults(request.game, next_id++);
+                queue.push(std::move(request));
+            }
+            received.erase(0, start);
+        }
+    }
+}
+
+auto run_server(const ServerOptions& options, std::ostream& log) -> int {
+    // A client hanging up must only fail the write to it
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string unix_path;
+    bool tcp = false;
+    int listener;
+    try {
+        listener = listen_socket(options.address, unix_path, tcp);
+    }
+    catch (const std::runtime_error& e) {
+        log << e.what() << '\n';
+        return 1;
+    }
+
+    RequestQueue queue;
+    std::atomic<unsigned int> next_id(options.first_id);
+    BotPool bot_pool;
+    const auto domains = options.batch_options.pin_games ? cpu_domains() : std::vector<CpuDomain>();
+    auto play_games = [&](unsigned int thread) -> void {
+        CpuDomain domain;
+        const auto thread_options = place_batch_thread(options.batch_options, domains,
+                                                       thread, domain);
+        // As in run_batch, the last replay is written while the next game
+        // is played
+        std::future<void> last_replay;
+        while (true) {
+            auto request = queue.pop();
+            std::future<void> replay;
+            auto result = play_batch_game(request.game, thread_options,
+                                          bot_pool, replay);
+            if (!request.name.is_null()) result["request"] = request.name;
+            if (!domain.cpus.empty()) result["cpu_domain"] = domain;
+            request.client->send(result);
+            // Let the connection close before the replay is waited on
+            request.client.reset();
+            last_replay = std::move(replay);
+        }
+    };
+
+    const auto num_threads = std::max(1U, options.batch_options.threads);
+    for (unsigned int i = 0; i < num_threads; i++) {
+        std::thread(play_games, i).detach();
+    }
+    log << "Serving games on " << options.address << " with "
+        << num_threads << " threads" << std::endl;
+
+    // Serve until the process is stopped
+    while (true) {
+        const int socket = accept(listener, nullptr, nullptr);
+        if (socket == -1) {
+            // Out of descriptors, say: let games finish to free some
+            if (errno != EINTR && errno != ECONNABORTED) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+        fcntl(socket, F_SETFD, FD_CLOEXEC);
+        if (tcp) {
+            const int on = 1;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        std::thread(read_requests, std::make_shared<Client>(socket),
+                    std::ref(queue), std::ref(next_id)).detach();
+    }
+}
+#else
+auto run_server(const ServerOptions& options, std::ostream& log) -> int {
+    log << "Server mode is not supported on Windows.\n";
+    return 1;
+}
+#endif
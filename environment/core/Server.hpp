@@ -0,0 +1,43 @@
+#ifndef HALITE_SERVER_HPP
+#define HALITE_SERVER_HPP
+
+#include <iostream>
+#include <string>
+
+#include "Batch.hpp"
+
+/**
+ * Settings of a game server (see run_server).
+ */
+struct ServerOptions {
+    //! Where clients connect: "HOST:PORT" or "unix:PATH".
+    std::string address;
+    //! How games are played; threads is the number played at once.
+    BatchOptions batch_options;
+    //! IDs of games that didn't ask for one are numbered from here.
+    unsigned int first_id;
+};
+
+/**
+ * Serve games to any number of clients until the process is stopped.
+ *
+ * A client connects to options.address and sends game requests, one JSON
+ * object per line, in the same form as the lines of a batch manifest (see
+ * read_batch_manifest). Every game is queued, and played as soon as one of
+ * options.batch_options.threads workers is free, whichever client it came
+ * from. Its results are sent back to the client that asked for it as one
+ * line of JSON, as for run_batch, so possibly out of order: "id" (and
+ * "request", which echoes that of the request if it had one) tell them
+ * apart. An invalid request gets a line with just an "error" (and its
+ * "request") instead.
+ *
+ * A client can send all of its requests at once and close its end for
+ * writing; the server closes the connection once all of them were played.
+ *
+ * POSIX only.
+ *
+ * @return Nonzero if the server could not be started.
+ */
+auto run_server(const ServerOptions& options, std::ostream& log) -> int;
+
+#endif //HALITE_SERVER_HPP
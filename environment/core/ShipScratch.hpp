@@ -0,0 +1,88 @@
+#ifndef HALITE_SHIPSCRATCH_HPP
+#define HALITE_SHIPSCRATCH_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Constants.hpp"
+#include "Entity.hpp"
+
+namespace hlt {
+    /**
+     * A value for some of the ships, kept from one use to the next so that
+     * it doesn't allocate once it has grown to fit the game.
+     *
+     * Values are stored in flat arrays indexed by ship ID, each stamped
+     * with the generation it was added in, so clear() only has to bump the
+     * generation. The ships added are listed in the order they were added.
+     */
+    template<typename T>
+    class ShipScratch {
+    public:
+        //! Forget every ship. Their values are left as they were, for
+        //! add() to reuse.
+        auto clear() -> void {
+            added.clear();
+            if (++generation == 0) {
+                // Wrapped around; old stamps could look current again
+                for (auto& player_slots : slots) {
+                    for (auto& slot : player_slots) slot.generation = 0;
+                }
+                generation = 1;
+            }
+        }
+
+        auto contains(EntityId id) const -> bool {
+            if (id.player_id() >= slots.size()) return false;
+            const auto& player_slots = slots[id.player_id()];
+            return id.entity_index() < player_slots.size() &&
+                player_slots[id.entity_index()].generation == generation;
+        }
+
+        /**
+         * Add the given ship, unless it has been added since the last
+         * clear(). Returns its value, and whether it was just added; in
+         * that case the value is whatever the slot last held, and should be
+         * reset by the caller.
+         */
+        auto add(EntityId id) -> std::pair<T&, bool> {
+            if (id.player_id() >= slots.size()) {
+                slots.resize(id.player_id() + 1u);
+            }
+            auto& player_slots = slots[id.player_id()];
+            if (id.entity_index() >= player_slots.size()) {
+                player_slots.resize(id.entity_index() + 1);
+            }
+            auto& slot = player_slots[id.entity_index()];
+            const auto is_new = slot.generation != generation;
+            if (is_new) {
+                slot.generation = generation;
+                added.push_back(id);
+            }
+            return { slot.value, is_new };
+        }
+
+        //! The value of a ship that has been added.
+        auto at(EntityId id) -> T& {
+            return slots[id.player_id()][id.entity_index()].value;
+        }
+
+        //! The ships added since the last clear(), in order.
+        auto ships() const -> const std::vector<EntityId>& { return added; }
+
+    private:
+        struct Slot {
+            //! Starts out older than any generation.
+            uint32_t generation = 0;
+            T value{};
+        };
+
+        uint32_t generation = 1;
+        //! By player, for the players that have had a ship added.
+        std::vector<std::vector<Slot>> slots;
+        std::vector<EntityId> added;
+    };
+}
+
+#endif //HALITE_SHIPSCRATCH_HPP
@@ -0,0 +1,134 @@
+#include "SimulationApi.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "Halite.hpp"
+#include "JsonWriter.hpp"
+#include "ReplayPlayback.hpp"
+#include "json.hpp"
+
+struct HaliteSimulation {
+    std::unique_ptr<Halite> game;
+    std::vector<RecordedMove> recorded;
+    hlt::MoveQueue moves;
+    hlt::FrameHistory history;
+    std::string frame;
+    std::string state_hash;
+    std::string error;
+};
+
+namespace {
+    //! Only touched by callers that create simulations on one thread,
+    //! as JavaScript does.
+    std::string create_error;
+
+    template<typename Entities, typename T>
+    auto sort_by_id(const Entities& entities, std::vector<const T*>& sorted) -> void {
+        sorted.clear();
+        for (const auto& entity : entities) {
+            sorted.push_back(&entity);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const T* a, const T* b) -> bool {
+            return decimal_key_less(a->id, b->id);
+        });
+    }
+}
+
+HaliteSimulation* halite_simulation_create(const char* header_json,
+                                           unsigned int map_players) {
+    try {
+        const auto setup = read_recorded_setup(nlohmann::json::parse(header_json));
+        GameOptions options;
+        options.constants = setup.constants;
+        const auto effective_players = map_players != 0
+            ? static_cast<unsigned short>(map_players) : setup.num_players;
+
+        std::unique_ptr<HaliteSimulation> simulation(new HaliteSimulation);
+        simulation->game.reset(new Halite(
+            mapgen::generate_map(mapgen::MapKey::current(
+                setup.generator, setup.seed, setup.width, setup.height,
+                setup.num_players, effective_players, options.constants),
+                options.constants),
+            options));
+        simulation->history.keep_latest_only();
+        return simulation.release();
+    }
+    catch (const std::exception& e) {
+        create_error = e.what();
+        return nullptr;
+    }
+}
+
+void halite_simulation_destroy(HaliteSimulation* simulation) {
+    delete simulation;
+}
+
+int halite_simulation_step(HaliteSimulation* simulation, const char* moves_json) {
+    try {
+        simulation->recorded.clear();
+        read_turn_moves(nlohmann::json::parse(moves_json), simulation->recorded);
+    }
+    catch (const std::exception& e) {
+        simulation->error = e.what();
+        return 1;
+    }
+    queue_moves(simulation->recorded, simulation->game->get_map(), simulation->moves);
+    simulation->game->step(simulation->moves);
+    return 0;
+}
+
+void halite_simulation_eliminate(HaliteSimulation* simulation, unsigned int player) {
+    if (player < simulation->game->get_player_count()) {
+        simulation->game->eliminate_player(static_cast<hlt::PlayerId>(player));
+    }
+}
+
+const char* halite_simulation_frame(HaliteSimulation* simulation) {
+    simulation->history.record(simulation->game->get_map());
+    const auto& frame = simulation->history.back();
+    std::vector<const hlt::PlanetSnapshot*> planets;
+    std::vector<const hlt::ShipSnapshot*> ships;
+
+    simulation->frame.clear();
+    JsonWriter json(simulation->frame);
+    json.begin_object();
+    json.key("planets").begin_object();
+    sort_by_id(frame.living_planets(), planets);
+    for (const auto planet : planets) {
+        json.key(planet->id);
+        planet->write_json(json);
+    }
+    json.end_object();
+    json.key("ships").begin_object();
+    for (hlt::PlayerId player = 0; player < simulation->game->get_player_count(); player++) {
+        json.key(player).begin_object();
+        sort_by_id(frame.player_ships(player), ships);
+        for (const auto ship : ships) {
+            json.key(ship->id);
+            ship->write_json(json);
+        }
+        json.end_object();
+    }
+    json.end_object();
+    json.end_object();
+    return simulation->frame.c_str();
+}
+
+const char* halite_simulation_state_hash(HaliteSimulation* simulation) {
+    simulation->state_hash = hlt::state_hash_string(simulation->game->get_map().state_hash());
+    return simulation->state_hash.c_str();
+}
+
+unsigned int halite_simulation_turn(const HaliteSimulation* simulation) {
+    return simulation->game->get_turn_number();
+}
+
+int halite_simulation_is_over(const HaliteSimulation* simulation) {
+    return simulation->game->is_over() ? 1 : 0;
+}
+
+const char* halite_simulation_error(const HaliteSimulation* simulation) {
+    return simulation != nullptr ? simulation->error.c_str() : create_error.c_str();
+}
@@ -0,0 +1,68 @@
+#ifndef HALITE_SIMULATIONAPI_HPP
+#define HALITE_SIMULATIONAPI_HPP
+
+/**
+ * A C interface to in-process games (see Halite::step), for programs that
+ * can't use the C++ one: mainly the WebAssembly build of the engine (see
+ * make_emscripten_engine.sh), with which a visualizer rebuilds the frames
+ * of a replay from its header and moves instead of downloading them.
+ *
+ * Everything goes in and out as JSON text in the replay's own format.
+ * Functions that can fail return null or nonzero, and leave a message for
+ * halite_simulation_error. Strings returned stay valid until the next
+ * call with the same simulation.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HaliteSimulation HaliteSimulation;
+
+/**
+ * Start a game as the header of a replay describes it (its "seed",
+ * "width", "height", "num_players", "map_generator" and "constants"; the
+ * frames and moves, if there, are ignored), or return null.
+ *
+ * Maps for a single player are generated for 2 or 4; map_players says
+ * which, or is 0 to use num_players.
+ */
+HaliteSimulation* halite_simulation_create(const char* header_json,
+                                           unsigned int map_players);
+void halite_simulation_destroy(HaliteSimulation* simulation);
+
+/**
+ * Play a turn with the moves of a replay's "moves" entry for it, returning
+ * 0, or nonzero if they couldn't be read (in which case nothing is
+ * played).
+ */
+int halite_simulation_step(HaliteSimulation* simulation, const char* moves_json);
+//! Take a player out before the next step, as when its bot errors.
+void halite_simulation_eliminate(HaliteSimulation* simulation, unsigned int player);
+
+/**
+ * The current frame, as a replay frame without its events:
+ * {"planets": {id: planet}, "ships": {player: {id: ship}}}.
+ */
+const char* halite_simulation_frame(HaliteSimulation* simulation);
+/**
+ * The Map::state_hash of the current state, as 16 hex digits (as in a
+ * replay's "state_hashes"), for telling states apart without comparing
+ * frames.
+ */
+const char* halite_simulation_state_hash(HaliteSimulation* simulation);
+unsigned int halite_simulation_turn(const HaliteSimulation* simulation);
+//! Whether the game has ended, as the engine would decide.
+int halite_simulation_is_over(const HaliteSimulation* simulation);
+
+/**
+ * What went wrong in the last call that failed with the given simulation,
+ * or (given null) in the last halite_simulation_create that did.
+ */
+const char* halite_simulation_error(const HaliteSimulation* simulation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //HALITE_SIMULATIONAPI_HPP
@@ -1,5 +1,13 @@
 #include "SimulationEvent.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HALITE_SCREEN_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HALITE_SCREEN_NEON
+#endif
+
 auto operator<<(std::ostream& os, const SimulationEventType& ty) -> std::ostream& {
     switch (ty) {
         case SimulationEventType::Attack:
@@ -39,66 +47,396 @@ auto test_aabb_circle(
     return std::pow(dx, 2) + std::pow(dy, 2) <= std::pow(radius, 2);
 }
 
+CollisionMap::CollisionMap()
+    : cell_size(MIN_CELL_SIZE), width(0), height(0), num_active_cells(0) {
+}
+
 CollisionMap::CollisionMap(const hlt::Map& game_map,
-                           const std::function<double(const hlt::Ship&)> radius_func) {
-    width = static_cast<int>(std::ceil(static_cast<double>(game_map.map_width) / CELL_SIZE));
-    height = static_cast<int>(std::ceil(static_cast<double>(game_map.map_height) / CELL_SIZE));
+                           const std::function<double(const hlt::Ship&)> radius_func,
+                           double max_query_radius)
+    : CollisionMap() {
+    update(game_map, radius_func, max_query_radius);
+}
 
-    std::vector<std::vector<hlt::EntityId>> row(height, std::vector<hlt::EntityId>());
-    cells.resize(width, row);
+auto CollisionMap::resize(const hlt::Map& game_map, double max_radius,
+                          size_t num_ships) -> bool {
+    // Aim for circles covering about 2x2 cells...
+    auto size = std::max(static_cast<double>(MIN_CELL_SIZE),
+                         std::ceil(2 * max_radius));
+    // ...but don't make the grid much finer than the ships are dense.
+    const auto max_cells = std::max<size_t>(
+        MIN_MAX_CELLS, MAX_CELLS_PER_SHIP * num_ships);
+    const auto area = static_cast<double>(game_map.map_width) * game_map.map_height;
+    size = std::max(size, std::ceil(std::sqrt(area / max_cells)));
 
-    rebuild(game_map, radius_func);
+    const auto new_cell_size = static_cast<int>(size);
+    const auto new_width = static_cast<int>(std::ceil(static_cast<double>(game_map.map_width) / new_cell_size));
+    const auto new_height = static_cast<int>(std::ceil(static_cast<double>(game_map.map_height) / new_cell_size));
+    if (new_cell_size == cell_size && new_width == width && new_height == height &&
+        cells.size() == static_cast<size_t>(width * height)) {
+        return false;
+    }
+
+    cell_size = new_cell_size;
+    width = new_width;
+    height = new_height;
+    clear();
+    cells.resize(width * height);
+    return true;
+}
+
+auto CollisionMap::clear() -> void {
+    for (auto& cell : cells) cell.clear();
+    std::fill(active.begin(), active.end(), 0);
+    num_active_cells = 0;
+    overflow.clear();
+    for (const auto index : placed) placements[index].num_cells = 0;
+    placed.clear();
 }
 
 auto CollisionMap::rebuild(const hlt::Map& game_map,
-                           const std::function<double(const hlt::Ship&)> radius_func) -> void {
+                           const std::function<double(const hlt::Ship&)> radius_func,
+                           double max_query_radius) -> void {
+    clear();
+    update(game_map, radius_func, max_query_radius);
+}
+
+auto CollisionMap::update(const hlt::Map& game_map,
+                          const std::function<double(const hlt::Ship&)> radius_func,
+                          double max_query_radius) -> void {
+    overflow.clear();
+    pending.clear();
+    if (++update_stamp == 0) {
+        // Wrapped around; old stamps could look current again
+        for (auto& placement : placements) placement.seen = 0;
+        update_stamp = 1;
+    }
+
+    // First rank every ship in the map's order, as the cells list them
+    auto max_radius = max_query_radius;
     hlt::PlayerId player = 0;
+    uint32_t rank = 0;
     for (const auto& player_ships : game_map.ships) {
         for (const auto& ship_pair : player_ships) {
-            const auto& location = ship_pair.second.location;
-            const auto id = hlt::EntityId::for_ship(player, ship_pair.first);
+            const auto radius = radius_func(ship_pair.second);
+            pending.push_back(PendingShip{
+                hlt::EntityId::for_ship(player, ship_pair.first),
+                &ship_pair.second, radius,
+            });
+            max_radius = std::max(max_radius, radius);
 
-            add(location, radius_func(ship_pair.second), id);
+            if (ship_pair.first >= placements.size()) {
+                placements.resize(ship_pair.first + 1);
+            }
+            auto& placement = placements[ship_pair.first];
+            placement.seen = update_stamp;
+            placement.rank = rank++;
         }
 
         player++;
     }
+
+    const auto resized = resize(game_map, max_radius, pending.size());
+    if (!resized) {
+        // Take out the ships that are gone
+        still_placed.clear();
+        for (const auto index : placed) {
+            auto& placement = placements[index];
+            if (placement.seen == update_stamp) {
+                still_placed.push_back(index);
+            }
+            else {
+                unplace(placement);
+            }
+        }
+        placed.swap(still_placed);
+    }
+
+    // Then move the ships whose cells changed. Ships are visited in rank
+    // order, so when the grid is rebuilt they are simply appended.
+    for (const auto& ship : pending) {
+        auto& placement = placements[ship.id.entity_index()];
+        placement.moving = ship.ship->velocity.vel_x != 0 || ship.ship->velocity.vel_y != 0;
+        overlapping_cells(ship.ship->location, ship.radius, scratch.cells);
+        assert(scratch.cells.size() <= MAX_CELLS_PER_ENTRY);
+
+        if (placement.num_cells != 0) {
+            if (placement.id == ship.id &&
+                std::equal(scratch.cells.begin(), scratch.cells.end(), placement.cells) &&
+                scratch.cells.size() == placement.num_cells) {
+                continue;
+            }
+            unplace(placement);
+        }
+        else {
+            placed.push_back(ship.id.entity_index());
+        }
+
+        placement.id = ship.id;
+        placement.num_cells = static_cast<unsigned char>(scratch.cells.size());
+        for (size_t i = 0; i < scratch.cells.size(); i++) {
+            const auto cell = scratch.cells[i];
+            placement.cells[i] = cell;
+            auto& ids = cells[cell];
+            const auto position = std::upper_bound(
+                ids.begin(), ids.end(), placement.rank,
+                [this](uint32_t rank, hlt::EntityId id) -> bool {
+                    return rank < placements[id.entity_index()].rank;
+                });
+            ids.insert(position, ship.id);
+        }
+    }
+
+    mark_active_cells();
+    update_store(resized || ++updates_since_sort >= STORE_SORT_INTERVAL);
+}
+
+//! The low 16 bits of x, spread out to the even bits.
+static auto spread_bits(uint32_t x) -> uint32_t {
+    x &= 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+auto CollisionMap::update_store(bool sort) -> void {
+    if (store_slots.size() < placements.size()) {
+        // Cast so that NO_SLOT (which has no definition) isn't bound to a
+        // reference
+        store_slots.resize(placements.size(), static_cast<uint32_t>(NO_SLOT));
+    }
+
+    if (sort) {
+        for (const auto index : stored) store_slots[index] = NO_SLOT;
+        stored.clear();
+        store_order.clear();
+        for (size_t i = 0; i < pending.size(); i++) {
+            const auto& location = pending[i].ship->location;
+            const auto cell_x = std::min(std::max(static_cast<int>(
+                static_cast<double>(location.pos_x) / cell_size), 0), width - 1);
+            const auto cell_y = std::min(std::max(static_cast<int>(
+                static_cast<double>(location.pos_y) / cell_size), 0), height - 1);
+            const uint64_t code = spread_bits(static_cast<uint32_t>(cell_x)) |
+                (spread_bits(static_cast<uint32_t>(cell_y)) << 1);
+            store_order.push_back(code << 32 | i);
+        }
+        std::sort(store_order.begin(), store_order.end());
+        for (const auto key : store_order) {
+            const auto index = pending[static_cast<uint32_t>(key)].id.entity_index();
+            store_slots[index] = static_cast<uint32_t>(stored.size());
+            stored.push_back(index);
+        }
+        updates_since_sort = 0;
+    }
+    else {
+        for (const auto& ship : pending) {
+            const auto index = ship.id.entity_index();
+            if (store_slots[index] == NO_SLOT) {
+                store_slots[index] = static_cast<uint32_t>(stored.size());
+                stored.push_back(index);
+            }
+        }
+    }
+
+    store.pos_x.resize(stored.size());
+    store.pos_y.resize(stored.size());
+    store.vel_x.resize(stored.size());
+    store.vel_y.resize(stored.size());
+    store.radius.resize(stored.size());
+    for (const auto& ship : pending) {
+        const auto slot = store_slots[ship.id.entity_index()];
+        store.pos_x[slot] = static_cast<double>(ship.ship->location.pos_x);
+        store.pos_y[slot] = static_cast<double>(ship.ship->location.pos_y);
+        store.vel_x[slot] = static_cast<double>(ship.ship->velocity.vel_x);
+        store.vel_y[slot] = static_cast<double>(ship.ship->velocity.vel_y);
+        store.radius[slot] = ship.ship->radius;
+    }
+}
+
+auto CollisionMap::gather_candidates(const std::vector<hlt::EntityId>& ids,
+                                     const hlt::Map& game_map,
+                                     CandidateBatch& batch) const -> void {
+    for (const auto id : ids) {
+        const auto index = id.entity_index();
+        const auto slot = index < store_slots.size() ? store_slots[index] : NO_SLOT;
+        if (slot == NO_SLOT) {
+            batch.push_back(game_map.get_ship(id.player_id(), index));
+            continue;
+        }
+        batch.pos_x.push_back(store.pos_x[slot]);
+        batch.pos_y.push_back(store.pos_y[slot]);
+        batch.vel_x.push_back(store.vel_x[slot]);
+        batch.vel_y.push_back(store.vel_y[slot]);
+        batch.radius.push_back(store.radius[slot]);
+    }
+}
+
+auto CollisionMap::unplace(Placement& placement) -> void {
+    for (unsigned char i = 0; i < placement.num_cells; i++) {
+        auto& ids = cells[placement.cells[i]];
+        ids.erase(std::find(ids.begin(), ids.end(), placement.id));
+    }
+    placement.num_cells = 0;
+}
+
+auto CollisionMap::mark_active_cells() -> void {
+    const auto rank_less = [this](hlt::EntityId id1, hlt::EntityId id2) -> bool {
+        return placements[id1.entity_index()].rank < placements[id2.entity_index()].rank;
+    };
+
+    active.assign(cells.size(), 0);
+    num_active_cells = 0;
+    for (size_t cell = 0; cell < cells.size(); cell++) {
+        auto& ids = cells[cell];
+        if (ids.size() < 2) {
+            continue;
+        }
+        // Ships keep their relative order in the map as others come and
+        // go, so this is only a check, unless the map reordered them
+        if (!std::is_sorted(ids.begin(), ids.end(), rank_less)) {
+            std::sort(ids.begin(), ids.end(), rank_less);
+        }
+        const auto owner = ids.front().player_id();
+        for (const auto id : ids) {
+            if (id.player_id() != owner || placements[id.entity_index()].moving) {
+                active[cell] = 1;
+                num_active_cells++;
+                break;
+            }
+        }
+    }
+}
+
+auto CollisionMap::overlapping_cells(const hlt::Location& location, double radius,
+                                     std::vector<int>& result) const -> void {
+    result.clear();
+
+    // Only consider the cells covered by the circle's bounding box. A circle
+    // exactly touching the far edge of a cell still counts as overlapping it
+    // (see test_aabb_circle), so the low end of the range uses ceil - 1
+    // rather than floor.
+    const auto low_x = std::ceil((location.pos_x - radius) / cell_size) - 1;
+    const auto low_y = std::ceil((location.pos_y - radius) / cell_size) - 1;
+    const auto high_x = std::floor((location.pos_x + radius) / cell_size);
+    const auto high_y = std::floor((location.pos_y + radius) / cell_size);
+
+    if (high_x < 0 || high_y < 0 || low_x >= width || low_y >= height) {
+        return;
+    }
+
+    const auto min_x = static_cast<int>(std::max<hlt::Scalar>(0, low_x));
+    const auto min_y = static_cast<int>(std::max<hlt::Scalar>(0, low_y));
+    const auto max_x = static_cast<int>(std::min<hlt::Scalar>(width - 1, high_x));
+    const auto max_y = static_cast<int>(std::min<hlt::Scalar>(height - 1, high_y));
+
+    for (auto cell_x = min_x; cell_x <= max_x; cell_x++) {
+        for (auto cell_y = min_y; cell_y <= max_y; cell_y++) {
+            if (test_aabb_circle(cell_x * cell_size, cell_y * cell_size,
+                                 cell_size, cell_size,
+                                 location, radius)) {
+                result.push_back(cell_x * height + cell_y);
+            }
+        }
+    }
+}
+
+auto CollisionMap::append_cell(int cell, std::vector<hlt::EntityId>& result) const -> void {
+    result.insert(result.end(), cells[cell].begin(), cells[cell].end());
+    for (const auto& entry : overflow) {
+        if (entry.first == cell) {
+            result.push_back(entry.second);
+        }
+    }
 }
 
 auto CollisionMap::add(const hlt::Location& location, double radius,
                        hlt::EntityId id) -> void {
     // Add the entity ID to all grid cells that the entity overlaps
-    for (auto cell_x = 0; cell_x < width; cell_x++) {
-        for (auto cell_y = 0; cell_y < height; cell_y++) {
-            if (test_aabb_circle(cell_x * CELL_SIZE, cell_y * CELL_SIZE,
-                                 CELL_SIZE, CELL_SIZE,
-                                 location, radius)) {
-                cells.at(cell_x).at(cell_y).push_back(id);
-            }
+    overlapping_cells(location, radius, scratch.cells);
+    for (const auto cell : scratch.cells) {
+        overflow.emplace_back(cell, id);
+        if (!active[cell]) {
+            active[cell] = 1;
+            num_active_cells++;
         }
     }
 }
 
 auto CollisionMap::test(const hlt::Location& location, double radius,
                         std::vector<hlt::EntityId>& potential_collisions) -> void {
+    test(location, radius, potential_collisions, scratch);
+}
+
+auto CollisionMap::test(const hlt::Location& location, double radius,
+                        std::vector<hlt::EntityId>& potential_collisions,
+                        QueryScratch& query_scratch) const -> void {
     // Add all IDs of any cell that overlaps the circle
-    for (auto cell_x = 0; cell_x < width; cell_x++) {
-        for (auto cell_y = 0; cell_y < height; cell_y++) {
-            if (test_aabb_circle(cell_x * CELL_SIZE, cell_y * CELL_SIZE,
-                                 CELL_SIZE, CELL_SIZE,
-                                 location, radius)) {
-                const auto& cell = cells.at(cell_x).at(cell_y);
-                potential_collisions.insert(
-                    potential_collisions.end(),
-                    cell.begin(), cell.end()
-                );
-            }
+    overlapping_cells(location, radius, query_scratch.cells);
+    for (const auto cell : query_scratch.cells) {
+        append_cell(cell, potential_collisions);
+    }
+}
+
+auto CollisionMap::query_into(const hlt::Location& location, double radius,
+                              std::vector<hlt::EntityId>& potential_collisions) -> void {
+    query_into(location, radius, potential_collisions, scratch);
+}
+
+auto CollisionMap::query_into(const hlt::Location& location, double radius,
+                              std::vector<hlt::EntityId>& potential_collisions,
+                              QueryScratch& query_scratch) const -> void {
+    query_cells(location, radius, potential_collisions, query_scratch, false);
+}
+
+auto CollisionMap::query_active_into(const hlt::Location& location, double radius,
+                                     std::vector<hlt::EntityId>& potential_collisions,
+                                     QueryScratch& query_scratch) const -> void {
+    query_cells(location, radius, potential_collisions, query_scratch, true);
+}
+
+auto CollisionMap::query_cells(const hlt::Location& location, double radius,
+                               std::vector<hlt::EntityId>& potential_collisions,
+                               QueryScratch& query_scratch,
+                               bool active_only) const -> void {
+    auto& marks = query_scratch.marks;
+    auto& stamp = query_scratch.stamp;
+    stamp++;
+    if (stamp == 0) {
+        // Stamp wrapped around; forget all previous marks
+        std::fill(marks.begin(), marks.end(), 0);
+        stamp = 1;
+    }
+
+    const auto first_new = potential_collisions.size();
+    overlapping_cells(location, radius, query_scratch.cells);
+    for (const auto cell : query_scratch.cells) {
+        if (!active_only || active[cell]) {
+            append_cell(cell, potential_collisions);
         }
     }
+
+    // Compact the newly added IDs in place, dropping repeats. Ship indices
+    // are unique across players, so they can index the marks directly.
+    auto out = first_new;
+    for (auto i = first_new; i < potential_collisions.size(); i++) {
+        const auto id = potential_collisions[i];
+        const auto index = id.entity_index();
+        if (index >= marks.size()) {
+            marks.resize(index + 1, 0);
+        }
+        if (marks[index] == stamp) {
+            continue;
+        }
+        marks[index] = stamp;
+        potential_collisions[out++] = id;
+    }
+    potential_collisions.resize(out, hlt::EntityId::invalid());
 }
 
 auto collision_time(
-    long double r,
+    hlt::Scalar r,
     const hlt::Location& loc1, const hlt::Location& loc2,
     const hlt::Velocity& vel1, const hlt::Velocity& vel2
 ) -> std::pair<bool, double> {
@@ -111,6 +449,23 @@ auto collision_time(
     //    they could be)
     // 3. Solve the resulting quadratic
 
+#ifdef HALITE_FIXED_POINT
+    // The terms, in units of 2^-64, are exact: differences of 32.32 numbers
+    // within the map take at most 42 bits, and so their squares and products
+    // fit in 128. The solutions don't depend on the units.
+    __extension__ typedef __int128 Wide;
+    const Wide dx = loc1.pos_x.raw() - loc2.pos_x.raw();
+    const Wide dy = loc1.pos_y.raw() - loc2.pos_y.raw();
+    const Wide dvx = vel1.vel_x.raw() - vel2.vel_x.raw();
+    const Wide dvy = vel1.vel_y.raw() - vel2.vel_y.raw();
+    const Wide radius = r.raw();
+
+    const auto a = static_cast<double>(dvx * dvx + dvy * dvy);
+    const auto b = static_cast<double>(2 * (dx * dvx + dy * dvy));
+    const auto c = static_cast<double>(dx * dx + dy * dy - radius * radius);
+
+    const auto disc = b * b - 4 * a * c;
+#else
     const auto dx = loc1.pos_x - loc2.pos_x;
     const auto dy = loc1.pos_y - loc2.pos_y;
     const auto dvx = vel1.vel_x - vel2.vel_x;
@@ -122,6 +477,7 @@ auto collision_time(
     const auto c = std::pow(dx, 2) + std::pow(dy, 2) - std::pow(r, 2);
 
     const auto disc = std::pow(b, 2) - 4 * a * c;
+#endif
 
     if (a == 0.0) {
         if (b == 0.0) {
@@ -159,25 +515,34 @@ auto collision_time(
     }
 }
 
-auto collision_time(long double r, const hlt::Ship& ship1, const hlt::Ship& ship2) -> std::pair<bool, long double> {
+auto collision_time(hlt::Scalar r, const hlt::Ship& ship1, const hlt::Ship& ship2) -> std::pair<bool, hlt::Scalar> {
     return collision_time(r,
                           ship1.location, ship2.location,
                           ship1.velocity, ship2.velocity);
 }
 
-auto collision_time(long double r, const hlt::Ship& ship1, const hlt::Planet& planet) -> std::pair<bool, long double> {
+auto collision_time(hlt::Scalar r, const hlt::Ship& ship1, const hlt::Planet& planet) -> std::pair<bool, hlt::Scalar> {
     return collision_time(r,
                           ship1.location, planet.location,
                           ship1.velocity, { 0, 0 });
 }
 
-auto might_attack(long double distance, const hlt::Ship& ship1, const hlt::Ship& ship2) -> bool {
+template<typename Constants>
+auto might_attack(hlt::Scalar distance, const hlt::Ship& ship1, const hlt::Ship& ship2,
+                  const Constants& constants) -> bool {
     return distance <= ship1.velocity.magnitude() + ship2.velocity.magnitude()
         + ship1.radius + ship2.radius
-        + hlt::GameConstants::get().WEAPON_RADIUS;
+        + constants.get().WEAPON_RADIUS;
 }
 
-auto might_collide(long double distance, const hlt::Ship& ship1, const hlt::Ship& ship2) -> bool {
+template auto might_attack<hlt::TournamentConstants>(
+    hlt::Scalar distance, const hlt::Ship& ship1, const hlt::Ship& ship2,
+    const hlt::TournamentConstants& constants) -> bool;
+template auto might_attack<hlt::ConfiguredConstants>(
+    hlt::Scalar distance, const hlt::Ship& ship1, const hlt::Ship& ship2,
+    const hlt::ConfiguredConstants& constants) -> bool;
+
+auto might_collide(hlt::Scalar distance, const hlt::Ship& ship1, const hlt::Ship& ship2) -> bool {
     return distance <= ship1.velocity.magnitude() + ship2.velocity.magnitude() +
         ship1.radius + ship2.radius;
 }
@@ -186,27 +551,265 @@ auto round_event_time(double t) -> double {
     return std::round(t * EVENT_TIME_PRECISION) / EVENT_TIME_PRECISION;
 }
 
+auto CandidateBatch::clear() -> void {
+    pos_x.clear();
+    pos_y.clear();
+    vel_x.clear();
+    vel_y.clear();
+    radius.clear();
+    reachable.clear();
+}
+
+auto CandidateBatch::push_back(const hlt::Ship& ship) -> void {
+    pos_x.push_back(static_cast<double>(ship.location.pos_x));
+    pos_y.push_back(static_cast<double>(ship.location.pos_y));
+    vel_x.push_back(static_cast<double>(ship.velocity.vel_x));
+    vel_y.push_back(static_cast<double>(ship.velocity.vel_y));
+    radius.push_back(ship.radius);
+}
+
+// Slack added to the screening radius, to cover the difference between
+// double and hlt::Scalar (possibly long double) arithmetic. Positions are
+// at most a few hundred units, so the actual error is many orders of
+// magnitude smaller.
+static constexpr double SCREEN_RELATIVE_MARGIN = 1e-9;
+static constexpr double SCREEN_ABSOLUTE_MARGIN = 1e-6;
+// Keeps the division for the time of closest approach finite when the
+// relative velocity is zero (in which case the numerator is zero too).
+static constexpr double SCREEN_MIN_SPEED2 = 1e-300;
+
+//! Whether two circles whose centers start dx, dy apart and move at
+//! dvx, dvy relative to each other come within reach during [0, 1].
+static auto screen_pair(double dx, double dy, double dvx, double dvy,
+                        double reach) -> bool {
+    const auto a = dvx * dvx + dvy * dvy;
+    const auto b = dx * dvx + dy * dvy;
+    const auto t = std::min(std::max(-b / std::max(a, SCREEN_MIN_SPEED2), 0.0), 1.0);
+    const auto closest_x = dx + t * dvx;
+    const auto closest_y = dy + t * dvy;
+    return closest_x * closest_x + closest_y * closest_y <= reach * reach;
+}
+
+auto screen_candidates(const hlt::Ship& ship, double extra_radius,
+                       CandidateBatch& batch) -> void {
+    const auto count = batch.size();
+    batch.reachable.resize(count);
+
+    const auto ship_x = static_cast<double>(ship.location.pos_x);
+    const auto ship_y = static_cast<double>(ship.location.pos_y);
+    const auto ship_vx = static_cast<double>(ship.velocity.vel_x);
+    const auto ship_vy = static_cast<double>(ship.velocity.vel_y);
+    const auto base_radius = ship.radius + extra_radius;
+    const auto scale = 1 + SCREEN_RELATIVE_MARGIN;
+
+    size_t i = 0;
+#if defined(HALITE_SCREEN_SSE2)
+    const auto sx = _mm_set1_pd(ship_x);
+    const auto sy = _mm_set1_pd(ship_y);
+    const auto svx = _mm_set1_pd(ship_vx);
+    const auto svy = _mm_set1_pd(ship_vy);
+    const auto base = _mm_set1_pd(base_radius);
+    const auto vscale = _mm_set1_pd(scale);
+    const auto margin = _mm_set1_pd(SCREEN_ABSOLUTE_MARGIN);
+    const auto min_speed2 = _mm_set1_pd(SCREEN_MIN_SPEED2);
+    const auto zero = _mm_setzero_pd();
+    const auto one = _mm_set1_pd(1.0);
+    for (; i + 2 <= count; i += 2) {
+        const auto dx = _mm_sub_pd(sx, _mm_loadu_pd(&batch.pos_x[i]));
+        const auto dy = _mm_sub_pd(sy, _mm_loadu_pd(&batch.pos_y[i]));
+        const auto dvx = _mm_sub_pd(svx, _mm_loadu_pd(&batch.vel_x[i]));
+        const auto dvy = _mm_sub_pd(svy, _mm_loadu_pd(&batch.vel_y[i]));
+        const auto a = _mm_add_pd(_mm_mul_pd(dvx, dvx), _mm_mul_pd(dvy, dvy));
+        const auto b = _mm_add_pd(_mm_mul_pd(dx, dvx), _mm_mul_pd(dy, dvy));
+        auto t = _mm_div_pd(_mm_sub_pd(zero, b), _mm_max_pd(a, min_speed2));
+        t = _mm_min_pd(_mm_max_pd(t, zero), one);
+        const auto closest_x = _mm_add_pd(dx, _mm_mul_pd(t, dvx));
+        const auto closest_y = _mm_add_pd(dy, _mm_mul_pd(t, dvy));
+        const auto dist2 = _mm_add_pd(_mm_mul_pd(closest_x, closest_x),
+                                      _mm_mul_pd(closest_y, closest_y));
+        const auto reach = _mm_add_pd(
+            _mm_mul_pd(_mm_add_pd(base, _mm_loadu_pd(&batch.radius[i])), vscale),
+            margin);
+        const auto hit = _mm_movemask_pd(
+            _mm_cmple_pd(dist2, _mm_mul_pd(reach, reach)));
+        batch.reachable[i] = static_cast<unsigned char>(hit & 1);
+        batch.reachable[i + 1] = static_cast<unsigned char>((hit >> 1) & 1);
+    }
+#elif defined(HALITE_SCREEN_NEON)
+    const auto sx = vdupq_n_f64(ship_x);
+    const auto sy = vdupq_n_f64(ship_y);
+    const auto svx = vdupq_n_f64(ship_vx);
+    const auto svy = vdupq_n_f64(ship_vy);
+    const auto base = vdupq_n_f64(base_radius);
+    const auto vscale = vdupq_n_f64(scale);
+    const auto margin = vdupq_n_f64(SCREEN_ABSOLUTE_MARGIN);
+    const auto min_speed2 = vdupq_n_f64(SCREEN_MIN_SPEED2);
+    const auto zero = vdupq_n_f64(0.0);
+    const auto one = vdupq_n_f64(1.0);
+    for (; i + 2 <= count; i += 2) {
+        const auto dx = vsubq_f64(sx, vld1q_f64(&batch.pos_x[i]));
+        const auto dy = vsubq_f64(sy, vld1q_f64(&batch.pos_y[i]));
+        const auto dvx = vsubq_f64(svx, vld1q_f64(&batch.vel_x[i]));
+        const auto dvy = vsubq_f64(svy, vld1q_f64(&batch.vel_y[i]));
+        const auto a = vaddq_f64(vmulq_f64(dvx, dvx), vmulq_f64(dvy, dvy));
+        const auto b = vaddq_f64(vmulq_f64(dx, dvx), vmulq_f64(dy, dvy));
+        auto t = vdivq_f64(vsubq_f64(zero, b), vmaxq_f64(a, min_speed2));
+        t = vminq_f64(vmaxq_f64(t, zero), one);
+        const auto closest_x = vaddq_f64(dx, vmulq_f64(t, dvx));
+        const auto closest_y = vaddq_f64(dy, vmulq_f64(t, dvy));
+        const auto dist2 = vaddq_f64(vmulq_f64(closest_x, closest_x),
+                                     vmulq_f64(closest_y, closest_y));
+        const auto reach = vaddq_f64(
+            vmulq_f64(vaddq_f64(base, vld1q_f64(&batch.radius[i])), vscale),
+            margin);
+        const auto hit = vcleq_f64(dist2, vmulq_f64(reach, reach));
+        batch.reachable[i] = static_cast<unsigned char>(vgetq_lane_u64(hit, 0) & 1);
+        batch.reachable[i + 1] = static_cast<unsigned char>(vgetq_lane_u64(hit, 1) & 1);
+    }
+#endif
+    for (; i < count; i++) {
+        const auto reach = (base_radius + batch.radius[i]) * scale
+            + SCREEN_ABSOLUTE_MARGIN;
+        batch.reachable[i] = static_cast<unsigned char>(screen_pair(
+            ship_x - batch.pos_x[i], ship_y - batch.pos_y[i],
+            ship_vx - batch.vel_x[i], ship_vy - batch.vel_y[i],
+            reach));
+    }
+}
+
+auto screen_planet(const hlt::Ship& ship, const hlt::Planet& planet) -> bool {
+    const auto reach = (ship.radius + planet.radius) * (1 + SCREEN_RELATIVE_MARGIN)
+        + SCREEN_ABSOLUTE_MARGIN;
+    return screen_pair(
+        static_cast<double>(ship.location.pos_x) - static_cast<double>(planet.location.pos_x),
+        static_cast<double>(ship.location.pos_y) - static_cast<double>(planet.location.pos_y),
+        static_cast<double>(ship.velocity.vel_x), static_cast<double>(ship.velocity.vel_y),
+        reach);
+}
+
+auto EventQueue::clear() -> void {
+    while (!times.empty()) {
+        release(times.back());
+        times.pop_back();
+    }
+    num_seen = 0;
+    if (++generation == 0) {
+        // Wrapped around; old stamps could look current again
+        for (auto& slot : seen) slot.generation = 0;
+        for (auto& step : steps) step.generation = 0;
+        generation = 1;
+    }
+}
+
+auto EventQueue::push(const SimulationEvent& event) -> void {
+    const auto low = std::min(event.id1, event.id2);
+    const auto high = std::max(event.id1, event.id2);
+    if (!insert_seen(event.type, low, high)) return;
+    bucket_for(event.time).events.push_back(event);
+    num_events++;
+}
+
+auto EventQueue::bucket_for(double time) -> Bucket& {
+    // Rounded times map to steps; any others are looked for among the
+    // queued buckets, which is slow but never happens in a game
+    auto step = NO_STEP;
+    const auto scaled = time * EVENT_TIME_PRECISION;
+    if (scaled >= 0 && scaled <= EVENT_TIME_PRECISION) {
+        step = static_cast<size_t>(std::llround(scaled));
+        if (steps.empty()) steps.resize(EVENT_TIME_PRECISION + 1);
+        const auto& entry = steps[step];
+        if (entry.generation == generation) {
+            if (buckets[entry.bucket].time == time) return buckets[entry.bucket];
+            // Taken by another time that rounds the same way
+            step = NO_STEP;
+        }
+    }
+    if (step == NO_STEP) {
+        for (const auto index : times) {
+            if (buckets[index].time == time) return buckets[index];
+        }
+    }
+
+    size_t index;
+    if (free_buckets.empty()) {
+        index = buckets.size();
+        buckets.push_back(Bucket());
+    }
+    else {
+        index = free_buckets.back();
+        free_buckets.pop_back();
+    }
+    auto& bucket = buckets[index];
+    bucket.time = time;
+    bucket.step = step;
+    if (step != NO_STEP) {
+        steps[step].bucket = index;
+        steps[step].generation = generation;
+    }
+    times.push_back(index);
+    std::push_heap(times.begin(), times.end(), Later{ buckets });
+    return bucket;
+}
+
+auto EventQueue::release(size_t index) -> void {
+    auto& bucket = buckets[index];
+    num_events -= bucket.events.size();
+    bucket.events.clear();
+    if (bucket.step != NO_STEP) steps[bucket.step].generation = 0;
+    free_buckets.push_back(index);
+}
+
+auto EventQueue::insert_seen(SimulationEventType type,
+                             hlt::EntityId low, hlt::EntityId high) -> bool {
+    // Keep the table at most half full
+    if ((num_seen + 1) * 2 > seen.size()) {
+        std::vector<Seen> old(std::max<size_t>(64, seen.size() * 2));
+        old.swap(seen);
+        num_seen = 0;
+        for (const auto& slot : old) {
+            if (slot.generation == generation) insert_seen(slot.type, slot.low, slot.high);
+        }
+    }
+
+    const std::hash<hlt::EntityId> hash;
+    const auto mask = seen.size() - 1;
+    auto index = (hash(low) * 31 + hash(high) + static_cast<size_t>(type)) & mask;
+    while (seen[index].generation == generation) {
+        const auto& slot = seen[index];
+        if (slot.type == type && slot.low == low && slot.high == high) return false;
+        index = (index + 1) & mask;
+    }
+    seen[index].low = low;
+    seen[index].high = high;
+    seen[index].type = type;
+    seen[index].generation = generation;
+    num_seen++;
+    return true;
+}
+
+template<typename Constants>
 auto find_events(
-    std::unordered_set<SimulationEvent>& unsorted_events,
+    std::vector<SimulationEvent>& unsorted_events,
     const hlt::EntityId id1, const hlt::EntityId& id2,
-    const hlt::Ship& ship1, const hlt::Ship& ship2) -> void {
+    const hlt::Ship& ship1, const hlt::Ship& ship2,
+    const Constants& constants) -> void {
     const auto distance = ship1.location.distance(ship2.location);
     const auto player1 = id1.player_id();
     const auto player2 = id2.player_id();
 
-    if (player1 != player2 && might_attack(distance, ship1, ship2)) {
+    if (player1 != player2 && might_attack(distance, ship1, ship2, constants)) {
         // Combat event
         const auto attack_radius = ship1.radius +
-            ship2.radius + hlt::GameConstants::get().WEAPON_RADIUS;
+            ship2.radius + constants.get().WEAPON_RADIUS;
         const auto t = collision_time(attack_radius, ship1, ship2);
         if (t.first && t.second >= 0 && t.second <= 1) {
-            unsorted_events.insert(SimulationEvent{
+            unsorted_events.push_back(SimulationEvent{
                 SimulationEventType::Attack,
                 id1, id2, round_event_time(t.second),
             });
         }
         else if (distance < attack_radius) {
-            unsorted_events.insert(SimulationEvent{
+            unsorted_events.push_back(SimulationEvent{
                 SimulationEventType::Attack,
                 id1, id2, 0
             });
@@ -219,7 +822,7 @@ auto find_events(
         const auto t = collision_time(collision_radius, ship1, ship2);
         if (t.first) {
             if (t.second >= 0 && t.second <= 1) {
-                unsorted_events.insert(SimulationEvent{
+                unsorted_events.push_back(SimulationEvent{
                     SimulationEventType::Collision,
                     id1, id2, round_event_time(t.second),
                 });
@@ -231,3 +834,14 @@ auto find_events(
         }
     }
 }
+
+template auto find_events<hlt::TournamentConstants>(
+    std::vector<SimulationEvent>& unsorted_events,
+    const hlt::EntityId id1, const hlt::EntityId& id2,
+    const hlt::Ship& ship1, const hlt::Ship& ship2,
+    const hlt::TournamentConstants& constants) -> void;
+template auto find_events<hlt::ConfiguredConstants>(
+    std::vector<SimulationEvent>& unsorted_events,
+    const hlt::EntityId id1, const hlt::EntityId& id2,
+    const hlt::Ship& ship1, const hlt::Ship& ship2,
+    const hlt::ConfiguredConstants& constants) -> void;
@@ -1,10 +1,11 @@
 #ifndef ENVIRONMENT_SIMULATIONEVENT_HPP
 #define ENVIRONMENT_SIMULATIONEVENT_HPP
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <functional>
 #include <iostream>
-#include <unordered_set>
 #include <vector>
 
 #include "Entity.hpp"
@@ -24,26 +25,197 @@ enum class SimulationEventType {
 
 auto operator<<(std::ostream& os, const SimulationEventType& ty) -> std::ostream&;
 
+struct CandidateBatch;
+
 /**
- * This structure is INVALID as soon as the underlying game map is
- * mutated.
+ * A uniform grid of ship IDs, used to find candidates for collisions and
+ * attacks.
+ *
+ * The grid persists: update() moves only the ships whose cells changed
+ * since the last update (ships that moved over a cell boundary, or whose
+ * radius changed, and ships that spawned or died), as long as the cell
+ * size it picks stays the same. Each cell lists its ships in the order the
+ * map lists them, as a grid built from nothing would, so queries report
+ * ships in the same order either way.
+ *
+ * The contents are INVALID as soon as the underlying game map is
+ * mutated, until the next update.
  */
 struct CollisionMap {
-    constexpr static auto CELL_SIZE = 32;
-
-    std::vector<std::vector<std::vector<hlt::EntityId>>> cells;
+    //! Lower bound for the adaptive cell size.
+    constexpr static auto MIN_CELL_SIZE = 4;
+    //! The grid is kept to at most this many cells per inserted ship (with
+    //! a fixed minimum), so sparse maps don't pay for clearing empty cells.
+    constexpr static auto MAX_CELLS_PER_SHIP = 4;
+    constexpr static auto MIN_MAX_CELLS = 16;
+    //! The most cells a ship can overlap: cells are at least twice as wide
+    //! as any ship inserted, so a ship spans at most three per axis (when
+    //! it exactly touches cell edges).
+    constexpr static auto MAX_CELLS_PER_ENTRY = 9;
 
+    //! Side length of a cell, chosen on every update.
+    int cell_size;
     int width, height;
 
+    //! The ships overlapping each cell.
+    std::vector<std::vector<hlt::EntityId>> cells;
+    //! Entries added after the last update, as (cell, ID) pairs. These
+    //! are few (e.g. newly spawned ships), so they are scanned linearly.
+    std::vector<std::pair<int, hlt::EntityId>> overflow;
+    /**
+     * Per cell: nonzero if some two of its ships may interact, that is if
+     * it holds ships of several players, or several ships of which one is
+     * moving. Two stationary ships of one player can neither shoot nor hit
+     * each other, so pairs that only share inactive cells need not be
+     * tested (see query_active_into). Set by update; cells touched by add
+     * are conservatively marked active.
+     */
+    std::vector<unsigned char> active;
+    size_t num_active_cells;
+
+    /**
+     * Per-caller working space for queries. The const query methods only
+     * touch the grid through this, so several threads may query one grid
+     * at once as long as each brings its own scratch.
+     */
+    struct QueryScratch {
+        std::vector<int> cells;
+        //! Per-ship stamp of the last query_into call that reported it, so
+        //! that ships overlapping several cells are only reported once.
+        std::vector<unsigned int> marks;
+        unsigned int stamp = 0;
+    };
+
+    CollisionMap();
     CollisionMap(const hlt::Map& game_map,
-                 const std::function<double(const hlt::Ship&)> radius_func);
+                 const std::function<double(const hlt::Ship&)> radius_func,
+                 double max_query_radius = 0);
 
+    //! Remove all entries, keeping the allocated storage.
+    auto clear() -> void;
+    /**
+     * Bring the grid up to date with every ship of the given map, each
+     * inserted with the radius radius_func gives it.
+     *
+     * The cell size is picked so that the largest circle inserted or queried
+     * (max_query_radius) spans about two cells, unless that would make the
+     * grid too fine for the number of ships. If that changes the grid,
+     * every ship is inserted again; the results are the same either way.
+     */
+    auto update(const hlt::Map& game_map,
+                const std::function<double(const hlt::Ship&)> radius_func,
+                double max_query_radius = 0) -> void;
+    //! Like update, but always inserting every ship again.
     auto rebuild(const hlt::Map& game_map,
-                 const std::function<double(const hlt::Ship&)> radius_func) -> void;
+                 const std::function<double(const hlt::Ship&)> radius_func,
+                 double max_query_radius = 0) -> void;
     auto test(const hlt::Location& location, double radius,
               std::vector<hlt::EntityId>& potential_collisions) -> void;
+    auto test(const hlt::Location& location, double radius,
+              std::vector<hlt::EntityId>& potential_collisions,
+              QueryScratch& scratch) const -> void;
+    /**
+     * Like test, but each ID is reported at most once per call, in
+     * the order of its first occurrence.
+     */
+    auto query_into(const hlt::Location& location, double radius,
+                    std::vector<hlt::EntityId>& potential_collisions) -> void;
+    auto query_into(const hlt::Location& location, double radius,
+                    std::vector<hlt::EntityId>& potential_collisions,
+                    QueryScratch& scratch) const -> void;
+    //! Like query_into, but only looking at active cells.
+    auto query_active_into(const hlt::Location& location, double radius,
+                           std::vector<hlt::EntityId>& potential_collisions,
+                           QueryScratch& scratch) const -> void;
     auto add(const hlt::Location& location, double radius,
              hlt::EntityId id) -> void;
+    /**
+     * Add the ships with the given IDs (e.g. from a query) to a batch for
+     * screen_candidates, as they were at the last update. Ships added
+     * since (see add) are looked up in game_map.
+     */
+    auto gather_candidates(const std::vector<hlt::EntityId>& ids, const hlt::Map& game_map,
+                           CandidateBatch& batch) const -> void;
+
+private:
+    //! The updates between sorts of the ship store.
+    constexpr static uint32_t STORE_SORT_INTERVAL = 8;
+    constexpr static uint32_t NO_SLOT = std::numeric_limits<uint32_t>::max();
+
+    //! Where a ship was inserted, by ship index (which is unique across
+    //! players, see query_into).
+    struct Placement {
+        hlt::EntityId id = hlt::EntityId::invalid();
+        int cells[MAX_CELLS_PER_ENTRY];
+        unsigned char num_cells = 0;
+        bool moving = false;
+        //! The update that last found the ship in the map.
+        uint32_t seen = 0;
+        //! Its position in the map's order of ships, as of that update.
+        uint32_t rank = 0;
+    };
+    std::vector<Placement> placements;
+    //! The indices of the ships inserted.
+    std::vector<hlt::EntityIndex> placed, still_placed;
+    uint32_t update_stamp = 0;
+
+    //! Scratch space for update, and for queries made through the
+    //! non-const methods.
+    struct PendingShip {
+        hlt::EntityId id;
+        const hlt::Ship* ship;
+        double radius;
+    };
+    std::vector<PendingShip> pending;
+    QueryScratch scratch;
+
+    /**
+     * The position, velocity and radius of every ship at the last update,
+     * for gather_candidates. They are in Morton order of the cell of each
+     * ship's center rather than in the map's order (which is spawn order),
+     * so that the ships a query finds, which are near each other on the
+     * map, are mostly near each other in memory too. Ships keep their
+     * slot (by ship index, in store_slots) until the store is sorted
+     * again, every STORE_SORT_INTERVAL updates or when the grid changes;
+     * ships spawned in between are appended.
+     */
+    struct ShipStore {
+        std::vector<double> pos_x, pos_y;
+        std::vector<double> vel_x, vel_y;
+        std::vector<double> radius;
+    };
+    ShipStore store;
+    std::vector<uint32_t> store_slots;
+    //! The indices of the ships with a slot, by slot.
+    std::vector<hlt::EntityIndex> stored;
+    //! Scratch space for sorting: Morton code, then position in pending.
+    std::vector<uint64_t> store_order;
+    uint32_t updates_since_sort = 0;
+
+    //! Pick the cell size for the given map. Returns whether the grid
+    //! changed, in which case it is emptied.
+    auto resize(const hlt::Map& game_map, double max_radius,
+                size_t num_ships) -> bool;
+    /**
+     * Find the indices of all cells overlapping the given circle, in
+     * column-major order.
+     */
+    auto overlapping_cells(const hlt::Location& location, double radius,
+                           std::vector<int>& result) const -> void;
+    //! Append the contents of the given cell to the result.
+    auto append_cell(int cell, std::vector<hlt::EntityId>& result) const -> void;
+    //! Take a ship out of the cells it was inserted in.
+    auto unplace(Placement& placement) -> void;
+    //! Find which cells are active, once all ships are inserted, and put
+    //! any cell whose ships are out of order back in order.
+    auto mark_active_cells() -> void;
+    //! Bring the ship store up to date with pending, sorting it again first
+    //! if sort is set.
+    auto update_store(bool sort) -> void;
+    //! The body of query_into, optionally skipping inactive cells.
+    auto query_cells(const hlt::Location& location, double radius,
+                     std::vector<hlt::EntityId>& potential_collisions,
+                     QueryScratch& scratch, bool active_only) const -> void;
 };
 
 struct SimulationEvent {
@@ -70,30 +242,154 @@ struct SimulationEvent {
     }
 };
 
-namespace std {
-    template<> struct hash<SimulationEvent> {
-        auto operator()(const SimulationEvent& ev) const -> std::size_t {
-            return std::hash<hlt::EntityId>{}(ev.id1) ^
-                std::hash<hlt::EntityId>{}(ev.id2) ^
-                static_cast<size_t>(ev.type);
-        }
-    };
-}
-
 auto collision_time(
     double r,
     const hlt::Location& loc1, const hlt::Location& loc2,
     const hlt::Velocity& vel1, const hlt::Velocity& vel2
 ) -> std::pair<bool, double>;
-auto collision_time(long double r, const hlt::Ship& ship1, const hlt::Ship& ship2) -> std::pair<bool, long double>;
-auto collision_time(long double r, const hlt::Ship& ship1, const hlt::Planet& ship2) -> std::pair<bool, long double>;
-auto might_attack(long double distance, const hlt::Ship& ship1, const hlt::Ship& ship2) -> bool;
-auto might_collide(long double distance, const hlt::Ship& ship1, const hlt::Ship& ship2) -> bool;
+auto collision_time(hlt::Scalar r, const hlt::Ship& ship1, const hlt::Ship& ship2) -> std::pair<bool, hlt::Scalar>;
+auto collision_time(hlt::Scalar r, const hlt::Ship& ship1, const hlt::Planet& ship2) -> std::pair<bool, hlt::Scalar>;
+//! Constants is one of the policies from Constants.hpp; the same goes for
+//! find_events. Both are instantiated for either policy.
+template<typename Constants>
+auto might_attack(hlt::Scalar distance, const hlt::Ship& ship1, const hlt::Ship& ship2,
+                  const Constants& constants) -> bool;
+auto might_collide(hlt::Scalar distance, const hlt::Ship& ship1, const hlt::Ship& ship2) -> bool;
 auto round_event_time(double t) -> double;
 
+/**
+ * The candidate ships for one ship's event search, in structure-of-arrays
+ * form so that they can be screened several at a time.
+ */
+struct CandidateBatch {
+    std::vector<double> pos_x, pos_y;
+    std::vector<double> vel_x, vel_y;
+    std::vector<double> radius;
+    //! Output of screen_candidates: nonzero if candidate i may be involved
+    //! in an event.
+    std::vector<unsigned char> reachable;
+
+    auto clear() -> void;
+    auto push_back(const hlt::Ship& ship) -> void;
+    auto size() const -> size_t { return pos_x.size(); }
+};
+
+/**
+ * Flag every candidate that comes within ship.radius + candidate radius +
+ * extra_radius of the given ship at some time in [0, 1].
+ *
+ * This is computed in double precision (with SSE2 or NEON where available)
+ * using a small safety margin, so it never rejects a pair for which the
+ * exact collision_time would report an event. Flagged pairs
+ * still have to go through find_events.
+ */
+auto screen_candidates(const hlt::Ship& ship, double extra_radius,
+                       CandidateBatch& batch) -> void;
+//! Like screen_candidates, whether a ship may collide with a planet.
+auto screen_planet(const hlt::Ship& ship, const hlt::Planet& planet) -> bool;
+
+/**
+ * The events of a substep, earliest first. Duplicates (as defined by
+ * SimulationEvent::operator==, whatever their times) are dropped as they are
+ * pushed, keeping the first; simultaneous events come out in the order they
+ * were pushed.
+ *
+ * Events are bucketed by time, and a binary heap orders the buckets, so
+ * pushing costs a table lookup and popping is linear in the events popped
+ * (most of a battle's events are attacks at time 0, and there are only
+ * EVENT_TIME_PRECISION + 1 rounded times in a turn). Events can also be
+ * pushed between pops, as long as they are later than the last group
+ * popped. Events made stale by earlier groups are dropped as their group
+ * comes up, without being looked at again. Storage is kept across clear().
+ */
+class EventQueue {
+public:
+    //! Forget every event, including those pushed before (for duplicates).
+    auto clear() -> void;
+    //! Queue an event, unless a duplicate was pushed since the last clear().
+    auto push(const SimulationEvent& event) -> void;
+    auto empty() const -> bool { return times.empty(); }
+    //! The number of events queued.
+    auto size() const -> size_t { return num_events; }
+
+    /**
+     * Remove the earliest events, all at the same time, and put those for
+     * which is_stale returns false into group (clearing it first).
+     *
+     * @return False if there were no events left.
+     */
+    template<typename Stale>
+    auto pop_simultaneous(std::vector<SimulationEvent>& group, Stale is_stale) -> bool {
+        if (times.empty()) return false;
+        std::pop_heap(times.begin(), times.end(), Later{ buckets });
+        const auto index = times.back();
+        times.pop_back();
+
+        group.clear();
+        for (const auto& event : buckets[index].events) {
+            if (!is_stale(event)) group.push_back(event);
+        }
+        release(index);
+        return true;
+    }
+
+private:
+    //! The events queued at one time, in the order they were pushed.
+    struct Bucket {
+        double time;
+        std::vector<SimulationEvent> events;
+        //! Its entry in steps, or NO_STEP.
+        size_t step;
+    };
+    static const size_t NO_STEP = static_cast<size_t>(-1);
+    //! Every bucket, queued or kept for reuse.
+    std::vector<Bucket> buckets;
+    std::vector<size_t> free_buckets;
+    //! The queued buckets, as a heap with the earliest at the front.
+    std::vector<size_t> times;
+    struct Later {
+        const std::vector<Bucket>& buckets;
+        auto operator()(size_t b1, size_t b2) const -> bool {
+            return buckets[b1].time > buckets[b2].time;
+        }
+    };
+    size_t num_events = 0;
+
+    //! For each rounded time (see round_event_time), its queued bucket, if
+    //! the generation is current.
+    struct Step {
+        size_t bucket = 0;
+        uint32_t generation = 0;
+    };
+    std::vector<Step> steps;
+
+    //! An event pushed since the last clear(), by type and unordered pair of
+    //! IDs, in an open addressing table.
+    struct Seen {
+        hlt::EntityId low = hlt::EntityId::invalid();
+        hlt::EntityId high = hlt::EntityId::invalid();
+        SimulationEventType type = SimulationEventType::Attack;
+        uint32_t generation = 0;
+    };
+    std::vector<Seen> seen;
+    size_t num_seen = 0;
+    //! Stamps of steps and seen from before the last clear() are older,
+    //! so clearing them is free.
+    uint32_t generation = 1;
+
+    //! Record an event, returning false if a duplicate was already there.
+    auto insert_seen(SimulationEventType type, hlt::EntityId low, hlt::EntityId high) -> bool;
+    //! The queued bucket for the given time, added if there is none.
+    auto bucket_for(double time) -> Bucket&;
+    //! Unqueue a bucket that is no longer in times, keeping its storage.
+    auto release(size_t index) -> void;
+};
+
+template<typename Constants>
 auto find_events(
-    std::unordered_set<SimulationEvent>& unsorted_events,
+    std::vector<SimulationEvent>& unsorted_events,
     const hlt::EntityId id1, const hlt::EntityId& id2,
-    const hlt::Ship& ship1, const hlt::Ship& ship2) -> void;
+    const hlt::Ship& ship1, const hlt::Ship& ship2,
+    const Constants& constants) -> void;
 
 #endif //ENVIRONMENT_SIMULATIONEVENT_HPP
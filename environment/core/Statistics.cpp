@@ -1,6 +1,184 @@
 #include "Statistics.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "json.hpp"
+
+LatencyHistogram::LatencyHistogram() : samples(0), total(0), max_value(0) {
+    buckets.fill(0);
+}
+
+auto LatencyHistogram::bucket_of(uint64_t value) -> int {
+    if (value < SUB_BUCKETS) return static_cast<int>(value);
+
+    int top_bit = 0;
+    while ((value >> top_bit) > 1) top_bit++;
+
+    // The bits just below the top one pick the bucket within the octave
+    const auto sub_bucket = (value >> (top_bit - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (top_bit - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + static_cast<int>(sub_bucket);
+}
+
+auto LatencyHistogram::bucket_top(int bucket) -> uint64_t {
+    if (bucket < SUB_BUCKETS) return static_cast<uint64_t>(bucket);
+
+    const int top_bit = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    const uint64_t sub_bucket = bucket % SUB_BUCKETS;
+    const int shift = top_bit - SUB_BUCKET_BITS;
+    const uint64_t bottom = (uint64_t(1) << top_bit) | (sub_bucket << shift);
+    return bottom + ((uint64_t(1) << shift) - 1);
+}
+
+auto LatencyHistogram::add(long micros) -> void {
+    const auto value = static_cast<uint64_t>(std::max(micros, 0L));
+    buckets[bucket_of(value)]++;
+    samples++;
+    total += value;
+    max_value = std::max(max_value, static_cast<long>(value));
+}
+
+auto LatencyHistogram::average() const -> double {
+    return samples == 0 ? 0 : total / double(samples);
+}
+
+auto LatencyHistogram::quantile(double q) const -> long {
+    if (samples == 0) return 0;
+
+    // The rank (1-based) of the sample to find
+    const auto rank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(q * samples + 0.5));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return static_cast<long>(std::min<uint64_t>(
+                bucket_top(bucket), static_cast<uint64_t>(max_value)));
+        }
+    }
+    return max_value;
+}
+
+auto LatencyHistogram::to_checkpoint() const -> nlohmann::json {
+    // Most buckets are empty, so only the others are listed
+    auto counts = nlohmann::json::array();
+    for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        if (buckets[bucket] != 0) counts.push_back({ bucket, buckets[bucket] });
+    }
+    return nlohmann::json{
+        { "buckets", counts },
+        { "samples", samples },
+        { "total", total },
+        { "max", max_value },
+    };
+}
+
+auto LatencyHistogram::from_checkpoint(const nlohmann::json& json) -> LatencyHistogram {
+    LatencyHistogram histogram;
+    for (const auto& count : json.at("buckets")) {
+        const auto bucket = count.at(0).get<int>();
+        if (bucket < 0 || bucket >= NUM_BUCKETS) {
+            throw std::out_of_range("bad histogram bucket " + std::to_string(bucket));
+        }
+        histogram.buckets[bucket] = count.at(1).get<uint64_t>();
+    }
+    histogram.samples = json.at("samples").get<uint64_t>();
+    histogram.total = json.at("total").get<uint64_t>();
+    histogram.max_value = json.at("max").get<long>();
+    return histogram;
+}
+
+auto to_json(nlohmann::json& json, const LatencyHistogram& histogram) -> void {
+    json = nlohmann::json{
+        { "count", histogram.count() },
+        { "average", histogram.average() },
+        { "p50", histogram.quantile(0.5) },
+        { "p95", histogram.quantile(0.95) },
+        { "p99", histogram.quantile(0.99) },
+        { "max", histogram.max() },
+    };
+}
+
+auto TurnSeries::memory_usage() const -> size_t {
+    return (ships.capacity() + health.capacity() + planets.capacity() +
+            ships_produced.capacity() + damage_dealt.capacity()) * sizeof(uint32_t);
+}
+
+auto MemoryReport::add(const MemoryUsage& usage) -> void {
+    peak.history = std::max(peak.history, usage.history);
+    peak.logs = std::max(peak.logs, usage.logs);
+    peak.replay = std::max(peak.replay, usage.replay);
+    peak.networking = std::max(peak.networking, usage.networking);
+    peak_total = std::max(peak_total, usage.total());
+}
+
+auto to_json(nlohmann::json& json, const MemoryReport& report) -> void {
+    // In bytes
+    json = nlohmann::json{
+        { "history", report.peak.history },
+        { "logs", report.peak.logs },
+        { "replay", report.peak.replay },
+        { "networking", report.peak.networking },
+        { "total", report.peak_total },
+    };
+    if (report.cap > 0) {
+        json["cap"] = report.cap;
+        json["lean_turn"] = report.lean_turn;
+    }
+}
+
+auto to_json(nlohmann::json& json, const OverheadReport& report) -> void {
+    // In microseconds
+    const std::pair<const char*, uint32_t TurnOverhead::*> stages[] = {
+        { "serialize", &TurnOverhead::serialize },
+        { "send", &TurnOverhead::send },
+        { "receive", &TurnOverhead::receive },
+        { "simulate", &TurnOverhead::simulate },
+        { "capture", &TurnOverhead::capture },
+    };
+    LatencyHistogram totals;
+    std::vector<uint32_t> total_series;
+    total_series.reserve(report.turns.size());
+    for (const auto& turn : report.turns) {
+        totals.add(turn.total());
+        total_series.push_back(turn.total());
+    }
+    json = nlohmann::json{
+        { "total", totals },
+        { "budget", report.budget },
+        { "turns_over_budget", report.turns_over_budget },
+    };
+    auto& series = json["turns"];
+    series["total"] = total_series;
+    for (const auto& stage : stages) {
+        LatencyHistogram histogram;
+        std::vector<uint32_t> values;
+        values.reserve(report.turns.size());
+        for (const auto& turn : report.turns) {
+            histogram.add(turn.*stage.second);
+            values.push_back(turn.*stage.second);
+        }
+        json[stage.first] = histogram;
+        series[stage.first] = values;
+    }
+}
+
 auto to_json(nlohmann::json& json, const GameStatistics& stats) -> void {
+    const auto& turns = stats.turns;
+    // A player's entries of one of the series
+    auto player_series = [&](const std::vector<uint32_t>& series,
+                             hlt::PlayerId player) -> nlohmann::json {
+        std::vector<uint32_t> values;
+        if (player < turns.num_players) {
+            values.reserve(turns.num_frames());
+            for (size_t frame = 0; frame < turns.num_frames(); frame++) {
+                values.push_back(turns.at(series, frame, player));
+            }
+        }
+        return values;
+    };
+
     for (hlt::PlayerId player_id = 0;
          player_id < stats.player_statistics.size(); player_id++) {
         auto& player_stats = stats.player_statistics[player_id];
@@ -12,6 +190,19 @@ auto to_json(nlohmann::json& json, const GameStatistics& stats) -> void {
             { "init_response_time", player_stats.init_response_time },
             { "average_frame_response_time", player_stats.average_frame_response_time },
             { "max_frame_response_time", player_stats.max_frame_response_time },
+            // In microseconds
+            { "frame_think_time", player_stats.frame_think_times },
+            { "frame_send_time", player_stats.frame_send_times },
+            // In seconds
+            { "cpu_time", player_stats.cpu_time },
+            // By frame
+            { "turns", {
+                { "ships", player_series(turns.ships, player_id) },
+                { "health", player_series(turns.health, player_id) },
+                { "planets", player_series(turns.planets, player_id) },
+                { "ships_produced", player_series(turns.ships_produced, player_id) },
+                { "damage_dealt", player_series(turns.damage_dealt, player_id) },
+            } },
         };
     }
 }
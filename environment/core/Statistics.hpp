@@ -1,12 +1,59 @@
 #ifndef HALITE_STATISTICS_HPP
 #define HALITE_STATISTICS_HPP
 
+#include <array>
+#include <cstdint>
 #include <set>
 #include <string>
 #include <vector>
 
-#include "json.hpp"
+#include "json_fwd.hpp"
 #include "Entity.hpp"
+#include "TurnProfile.hpp"
+
+/**
+ * A histogram of latencies in microseconds, with logarithmic buckets: each
+ * power of two is split into SUB_BUCKETS equal buckets, so a quantile is
+ * off by at most 1/SUB_BUCKETS of its value.
+ */
+class LatencyHistogram {
+public:
+    constexpr static int SUB_BUCKET_BITS = 2;
+    constexpr static int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    LatencyHistogram();
+
+    auto add(long micros) -> void;
+    auto count() const -> uint64_t { return samples; }
+    auto max() const -> long { return max_value; }
+    auto average() const -> double;
+    /**
+     * An upper bound on the q-th quantile (q in [0, 1]): the top of the
+     * bucket holding it, capped at the largest value added. 0 if empty.
+     */
+    auto quantile(double q) const -> long;
+
+    //! Everything it holds, for a checkpoint (see Halite::resume_from),
+    //! and back. from_checkpoint throws what nlohmann::json throws for
+    //! malformed JSON.
+    auto to_checkpoint() const -> nlohmann::json;
+    static auto from_checkpoint(const nlohmann::json& json) -> LatencyHistogram;
+
+private:
+    //! Values below 2^SUB_BUCKET_BITS get a bucket each; every larger power
+    //! of two of a 64-bit value gets SUB_BUCKETS.
+    constexpr static int NUM_BUCKETS = SUB_BUCKETS * (65 - SUB_BUCKET_BITS);
+
+    std::array<uint64_t, NUM_BUCKETS> buckets;
+    uint64_t samples;
+    uint64_t total;
+    long max_value;
+
+    static auto bucket_of(uint64_t value) -> int;
+    static auto bucket_top(int bucket) -> uint64_t;
+};
+
+auto to_json(nlohmann::json& json, const LatencyHistogram& histogram) -> void;
 
 struct PlayerStatistics {
     int tag;
@@ -15,15 +62,145 @@ struct PlayerStatistics {
     int init_response_time;
     double average_frame_response_time;
     int max_frame_response_time;
+    //! Time from each frame being sent until the bot's reply was read.
+    LatencyHistogram frame_think_times;
+    //! Time the engine spent sending each frame to the bot.
+    LatencyHistogram frame_send_times;
     int total_ship_count;
     int damage_dealt;
+    //! CPU time the bot's processes used during the game, in seconds, or
+    //! -1 if unknown (see Networking::cpu_time).
+    double cpu_time;
+};
+
+/**
+ * What each player had at the end of every frame of the game (the first
+ * being the initial state), so that consumers of the results and the
+ * replay don't have to work it out from the frames. Each series holds
+ * num_players entries for each frame, player by player.
+ */
+struct TurnSeries {
+    hlt::PlayerId num_players = 0;
+    //! The living ships, and their total health.
+    std::vector<uint32_t> ships;
+    std::vector<uint32_t> health;
+    //! The living planets owned.
+    std::vector<uint32_t> planets;
+    //! Running totals, as in PlayerStatistics::total_ship_count and
+    //! PlayerStatistics::damage_dealt.
+    std::vector<uint32_t> ships_produced;
+    std::vector<uint32_t> damage_dealt;
+
+    auto num_frames() const -> size_t {
+        return num_players == 0 ? 0 : ships.size() / num_players;
+    }
+    //! The entry of a player for a frame, in one of the series.
+    auto at(const std::vector<uint32_t>& series, size_t frame,
+            hlt::PlayerId player) const -> uint32_t {
+        return series[frame * num_players + player];
+    }
+    //! The memory held, in bytes (see MemoryReport).
+    auto memory_usage() const -> size_t;
 };
 
+/**
+ * The memory the parts of a game hold, in bytes, as counted by the parts
+ * themselves: the capacity of their buffers and arrays, not counting what
+ * the allocator adds or the map itself (which is the same whatever is
+ * recorded).
+ */
+struct MemoryUsage {
+    //! The frames, events and moves kept for the replay (see FrameHistory).
+    uint64_t history = 0;
+    //! The player log entries being built (they are written as they go).
+    uint64_t logs = 0;
+    //! Writing the replay (see Replay::output), which comes after the game.
+    uint64_t replay = 0;
+    //! The frames serialized for the bots and what was read from them.
+    uint64_t networking = 0;
+
+    auto total() const -> uint64_t { return history + logs + replay + networking; }
+};
+
+/**
+ * The high-water marks of a game's memory, checked once a turn and while
+ * the replay is written.
+ */
+struct MemoryReport {
+    //! The most each part held at once (not all at the same time).
+    MemoryUsage peak;
+    //! The most all parts held together at once.
+    uint64_t peak_total = 0;
+    //! The soft cap the game was played with, or 0 (see
+    //! GameOptions::memory_cap).
+    uint64_t cap = 0;
+    //! The turn the game went over the cap and turned lean, or 0 if it
+    //! never did.
+    unsigned int lean_turn = 0;
+
+    auto add(const MemoryUsage& usage) -> void;
+};
+
+auto to_json(nlohmann::json& json, const MemoryReport& report) -> void;
+
+/**
+ * The wall time the engine added to a turn beyond the think time of the
+ * bot it waited for (the last to reply), in microseconds, by the stages on
+ * the turn's critical path.
+ */
+struct TurnOverhead {
+    //! Serializing the frame for the bots.
+    uint32_t serialize = 0;
+    //! From sending the first frame until the bot waited for had its own.
+    uint32_t send = 0;
+    //! From that bot's reply being read until every reply was parsed and
+    //! checked (and the built-in bots moved, if no bot replied).
+    uint32_t receive = 0;
+    uint32_t simulate = 0;
+    //! Recording the frame, the player logs, the statistics and the
+    //! profile.
+    uint32_t capture = 0;
+
+    auto total() const -> uint32_t { return serialize + send + receive + simulate + capture; }
+};
+
+//! Every turn's overhead (see GameOptions::measure_overhead).
+struct OverheadReport {
+    //! By turn, the first being turn 1.
+    std::vector<TurnOverhead> turns;
+    //! The budget turns were held to, or 0, and how many went over it.
+    unsigned int budget = 0;
+    unsigned int turns_over_budget = 0;
+};
+
+//! Percentiles of each stage and of the total, and each as a series by
+//! turn.
+auto to_json(nlohmann::json& json, const OverheadReport& report) -> void;
+
 struct GameStatistics {
     std::vector<PlayerStatistics> player_statistics;
     std::string output_filename;
+    //! The replay preview, if one was written (see
+    //! ReplayOptions::preview_interval).
+    std::string preview_filename;
     std::set<unsigned short> error_tags;
     std::vector<std::string> log_filenames;
+    //! Whether the game was ended early because its ranking was decided
+    //! (see GameOptions::adjudicate_games).
+    bool adjudicated = false;
+    //! Where the engine's time went, if the game was profiled (see
+    //! GameOptions::profile_turns).
+    bool profiled = false;
+    GameProfile profile;
+    //! What the game's memory came to. The replay's part is left at 0 if it
+    //! was written in the background (see ReplayOptions::asynchronous).
+    MemoryReport memory;
+    //! Each player's "turns" in the JSON, as arrays by frame.
+    TurnSeries turns;
+    //! The engine's overhead on every turn, if it was measured (see
+    //! GameOptions::measure_overhead).
+    bool measured_overhead = false;
+    OverheadReport overhead;
 };
 
 auto to_json(nlohmann::json& json, const GameStatistics& stats) -> void;
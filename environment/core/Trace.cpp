@@ -0,0 +1,64 @@
+#include "Trace.hpp"
+
+#include <stdexcept>
+
+#include "json.hpp"
+
+//! All events are of the one process.
+constexpr int TRACE_PID = 1;
+
+TraceFile::TraceFile(const std::string& filename)
+    : file(filename), origin(clock::now()), first_event(true) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open trace file " + filename);
+    }
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    write_event(nlohmann::json{
+        { "name", "process_name" }, { "ph", "M" }, { "pid", TRACE_PID },
+        { "args", { { "name", "halite" } } },
+    });
+}
+
+TraceFile::~TraceFile() {
+    file << "\n]}\n";
+}
+
+auto TraceFile::name_thread(int thread, const std::string& name) -> void {
+    write_event(nlohmann::json{
+        { "name", "thread_name" }, { "ph", "M" }, { "pid", TRACE_PID }, { "tid", thread },
+        { "args", { { "name", name } } },
+    });
+    // Keep the tracks in order of their numbers rather than of activity
+    write_event(nlohmann::json{
+        { "name", "thread_sort_index" }, { "ph", "M" }, { "pid", TRACE_PID }, { "tid", thread },
+        { "args", { { "sort_index", thread } } },
+    });
+}
+
+auto TraceFile::span(int thread, const std::string& name,
+                     clock::time_point start, clock::time_point end) -> void {
+    span(thread, name, start, end, nullptr);
+}
+
+auto TraceFile::span(int thread, const std::string& name,
+                     clock::time_point start, clock::time_point end,
+                     const nlohmann::json& args) -> void {
+    auto event = nlohmann::json{
+        { "name", name }, { "ph", "X" }, { "pid", TRACE_PID }, { "tid", thread },
+        { "ts", timestamp(start) }, { "dur", timestamp(end) - timestamp(start) },
+    };
+    if (!args.is_null()) {
+        event["args"] = args;
+    }
+    write_event(event);
+}
+
+auto TraceFile::write_event(const nlohmann::json& event) -> void {
+    if (!first_event) file << ",\n";
+    first_event = false;
+    file << event.dump();
+}
+
+auto TraceFile::timestamp(clock::time_point time) const -> double {
+    return std::chrono::duration<double, std::micro>(time - origin).count();
+}
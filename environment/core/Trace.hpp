@@ -0,0 +1,54 @@
+#ifndef HALITE_TRACE_HPP
+#define HALITE_TRACE_HPP
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#include "json_fwd.hpp"
+
+/**
+ * A timeline of a game in the Chrome Trace Event format (--trace-file),
+ * which chrome://tracing and Perfetto can open. Spans are written as they
+ * are added, as "complete" events on numbered threads, which the viewers
+ * show as one track each.
+ *
+ * Not thread-safe: spans are only added from the thread running the game.
+ */
+class TraceFile {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    //! The track of the engine's turns and phases; bot p is on bot_thread(p).
+    constexpr static int ENGINE_THREAD = 0;
+    static auto bot_thread(int player) -> int { return player + 1; }
+
+    //! Start writing a trace. Throws std::runtime_error if the file can't
+    //! be opened.
+    explicit TraceFile(const std::string& filename);
+    //! Finish the trace, closing the JSON.
+    ~TraceFile();
+    TraceFile(const TraceFile&) = delete;
+    auto operator=(const TraceFile&) -> TraceFile& = delete;
+
+    //! Label a track.
+    auto name_thread(int thread, const std::string& name) -> void;
+    //! A span of time on a track.
+    auto span(int thread, const std::string& name,
+              clock::time_point start, clock::time_point end) -> void;
+    //! A span of time on a track, with arguments shown with it.
+    auto span(int thread, const std::string& name,
+              clock::time_point start, clock::time_point end,
+              const nlohmann::json& args) -> void;
+
+private:
+    std::ofstream file;
+    //! Timestamps are in microseconds since the trace was started.
+    clock::time_point origin;
+    bool first_event;
+
+    auto write_event(const nlohmann::json& event) -> void;
+    auto timestamp(clock::time_point time) const -> double;
+};
+
+#endif //HALITE_TRACE_HPP
@@ -0,0 +1,260 @@
+#include "TurnProfile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "json.hpp"
+
+#ifdef HALITE_COUNT_ALLOCATIONS
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> live_bytes(0);
+//! Where the thread's allocations are counted (see count_allocations_in).
+static thread_local PhaseAllocations* current_phase = nullptr;
+
+// Every block starts with its size, so that delete knows how much is freed;
+// the header keeps the block as aligned as malloc's
+namespace {
+    union BlockHeader {
+        std::size_t size;
+        std::max_align_t alignment;
+    };
+}
+
+// Kept out of line: where GCC sees operator delete inlined down to the free
+// of a block operator new returned, it warns of a mismatched deallocation
+#if defined(__GNUC__)
+#define COUNTED_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define COUNTED_NOINLINE __declspec(noinline)
+#else
+#define COUNTED_NOINLINE
+#endif
+
+COUNTED_NOINLINE static auto counted_malloc(std::size_t size) -> void* {
+    const auto block = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + size));
+    if (block == nullptr) return nullptr;
+    block->size = size;
+
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    const auto live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    if (const auto phase = current_phase) {
+        phase->count++;
+        phase->bytes += size;
+        phase->peak_live_bytes = std::max(phase->peak_live_bytes, live);
+    }
+    return block + 1;
+}
+
+COUNTED_NOINLINE static auto counted_free(void* pointer) -> void {
+    if (pointer == nullptr) return;
+    const auto block = static_cast<BlockHeader*>(pointer) - 1;
+    live_bytes.fetch_sub(block->size, std::memory_order_relaxed);
+    std::free(block);
+}
+
+auto operator new(std::size_t size) -> void* {
+    if (size == 0) size = 1;
+    while (true) {
+        if (const auto result = counted_malloc(size)) return result;
+        const auto handler = std::get_new_handler();
+        if (handler == nullptr) throw std::bad_alloc();
+        handler();
+    }
+}
+
+auto operator new[](std::size_t size) -> void* {
+    return operator new(size);
+}
+
+// The standard library may allocate these with malloc itself otherwise,
+// which counted_free can't free
+auto operator new(std::size_t size, const std::nothrow_t&) noexcept -> void* {
+    try {
+        return operator new(size);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+auto operator new[](std::size_t size, const std::nothrow_t&) noexcept -> void* {
+    return operator new(size, std::nothrow);
+}
+
+auto operator delete(void* pointer) noexcept -> void {
+    counted_free(pointer);
+}
+
+auto operator delete[](void* pointer) noexcept -> void {
+    counted_free(pointer);
+}
+
+auto operator delete(void* pointer, std::size_t) noexcept -> void {
+    counted_free(pointer);
+}
+
+auto operator delete[](void* pointer, std::size_t) noexcept -> void {
+    counted_free(pointer);
+}
+
+auto operator delete(void* pointer, const std::nothrow_t&) noexcept -> void {
+    counted_free(pointer);
+}
+
+auto operator delete[](void* pointer, const std::nothrow_t&) noexcept -> void {
+    counted_free(pointer);
+}
+
+auto allocation_count() -> uint64_t {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+auto live_allocation_bytes() -> uint64_t {
+    return live_bytes.load(std::memory_order_relaxed);
+}
+
+auto count_allocations_in(PhaseAllocations* phase) -> PhaseAllocations* {
+    const auto previous = current_phase;
+    current_phase = phase;
+    return previous;
+}
+#else
+auto allocation_count() -> uint64_t {
+    return 0;
+}
+
+auto live_allocation_bytes() -> uint64_t {
+    return 0;
+}
+
+auto count_allocations_in(PhaseAllocations*) -> PhaseAllocations* {
+    return nullptr;
+}
+#endif
+
+auto PhaseAllocations::add(const PhaseAllocations& other) -> void {
+    count += other.count;
+    bytes += other.bytes;
+    peak_live_bytes = std::max(peak_live_bytes, other.peak_live_bytes);
+}
+
+auto turn_phase_name(TurnPhase phase) -> const char* {
+    switch (phase) {
+        case TurnPhase::SerializeFrame: return "serialize_frame";
+        case TurnPhase::RetrieveMoves: return "retrieve_moves";
+        case TurnPhase::Docking: return "docking";
+        case TurnPhase::Moves: return "moves";
+        case TurnPhase::DockFighting: return "dock_fighting";
+        case TurnPhase::EventDetection: return "event_detection";
+        case TurnPhase::EventResolution: return "event_resolution";
+        case TurnPhase::Movement: return "movement";
+        case TurnPhase::Production: return "production";
+        case TurnPhase::FrameRecord: return "frame_record";
+        case TurnPhase::TurnLog: return "turn_log";
+    }
+    return "unknown";
+}
+
+auto TurnProfile::clear() -> void {
+    phase_nanos.fill(0);
+    events_found = 0;
+    candidates_tested = 0;
+    candidates_solved = 0;
+    planets_tested = 0;
+    planets_solved = 0;
+    allocations = 0;
+    phase_allocations.fill(PhaseAllocations());
+}
+
+auto GameProfile::add(const TurnProfile& turn) -> void {
+    turns++;
+    for (size_t i = 0; i < NUM_TURN_PHASES; i++) {
+        total_nanos[i] += turn.phase_nanos[i];
+        max_nanos[i] = std::max(max_nanos[i], turn.phase_nanos[i]);
+    }
+    totals.events_found += turn.events_found;
+    totals.candidates_tested += turn.candidates_tested;
+    totals.candidates_solved += turn.candidates_solved;
+    totals.planets_tested += turn.planets_tested;
+    totals.planets_solved += turn.planets_solved;
+    totals.allocations += turn.allocations;
+    for (size_t i = 0; i < NUM_TURN_PHASES; i++) {
+        totals.phase_allocations[i].add(turn.phase_allocations[i]);
+    }
+}
+
+auto to_json(nlohmann::json& json, const GameProfile& profile) -> void {
+    auto phases = nlohmann::json::object();
+    for (size_t i = 0; i < NUM_TURN_PHASES; i++) {
+        // In microseconds, like the latency histograms
+        auto& phase = phases[turn_phase_name(static_cast<TurnPhase>(i))];
+        phase = nlohmann::json{
+            { "total", profile.total_nanos[i] / 1000.0 },
+            { "average", profile.turns > 0
+                         ? profile.total_nanos[i] / 1000.0 / profile.turns : 0.0 },
+            { "max", profile.max_nanos[i] / 1000.0 },
+        };
+        if (COUNTS_ALLOCATIONS) {
+            const auto& allocations = profile.totals.phase_allocations[i];
+            phase["allocations"] = allocations.count;
+            phase["allocated_bytes"] = allocations.bytes;
+            phase["peak_live_bytes"] = allocations.peak_live_bytes;
+        }
+    }
+
+    json = nlohmann::json{
+        { "turns", profile.turns },
+        { "phases", phases },
+        { "events_found", profile.totals.events_found },
+        { "candidates_tested", profile.totals.candidates_tested },
+        { "candidates_solved", profile.totals.candidates_solved },
+        { "planets_tested", profile.totals.planets_tested },
+        { "planets_solved", profile.totals.planets_solved },
+    };
+    if (COUNTS_ALLOCATIONS) {
+        json["allocations"] = profile.totals.allocations;
+    }
+}
+
+auto turn_profile_csv_header() -> std::string {
+    std::string header = "turn";
+    for (size_t i = 0; i < NUM_TURN_PHASES; i++) {
+        header += ',';
+        header += turn_phase_name(static_cast<TurnPhase>(i));
+        header += "_ns";
+    }
+    header += ",events_found,candidates_tested,candidates_solved,planets_tested,planets_solved";
+    if (COUNTS_ALLOCATIONS) {
+        header += ",allocations";
+        for (size_t i = 0; i < NUM_TURN_PHASES; i++) {
+            const std::string name = turn_phase_name(static_cast<TurnPhase>(i));
+            header += ',' + name + "_allocations," + name + "_bytes," + name + "_peak_live_bytes";
+        }
+    }
+    return header;
+}
+
+auto turn_profile_csv_row(unsigned int turn, const TurnProfile& profile) -> std::string {
+    auto row = std::to_string(turn);
+    for (const auto nanos : profile.phase_nanos) {
+        row += ',';
+        row += std::to_string(nanos);
+    }
+    row += ',' + std::to_string(profile.events_found);
+    row += ',' + std::to_string(profile.candidates_tested);
+    row += ',' + std::to_string(profile.candidates_solved);
+    row += ',' + std::to_string(profile.planets_tested);
+    row += ',' + std::to_string(profile.planets_solved);
+    if (COUNTS_ALLOCATIONS) {
+        row += ',' + std::to_string(profile.allocations);
+        for (const auto& allocations : profile.phase_allocations) {
+            row += ',' + std::to_string(allocations.count);
+            row += ',' + std::to_string(allocations.bytes);
+            row += ',' + std::to_string(allocations.peak_live_bytes);
+        }
+    }
+    return row;
+}
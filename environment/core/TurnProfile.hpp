@@ -0,0 +1,163 @@
+#ifndef HALITE_TURNPROFILE_HPP
+#define HALITE_TURNPROFILE_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "json_fwd.hpp"
+
+#include "Trace.hpp"
+
+/**
+ * The parts of a turn timed by --profile, in the order they run.
+ */
+enum class TurnPhase {
+    //! Serializing the map for the bots.
+    SerializeFrame,
+    //! Sending the frame to the bots and waiting for their moves.
+    RetrieveMoves,
+    Docking,
+    Moves,
+    DockFighting,
+    //! Building the collision map and finding every ship's events.
+    EventDetection,
+    //! Carrying out the events found, in order of time.
+    EventResolution,
+    //! Moving ships, with drag and weapon cooldowns (see Halite::update_ships).
+    Movement,
+    Production,
+    //! Recording the frame for the replay and player logs.
+    FrameRecord,
+    //! Building and writing the player log entries.
+    TurnLog,
+};
+
+constexpr auto NUM_TURN_PHASES = static_cast<size_t>(TurnPhase::TurnLog) + 1;
+
+//! The name of a phase in profiles, e.g. "event_detection".
+auto turn_phase_name(TurnPhase phase) -> const char*;
+
+/**
+ * Whether heap allocations are counted (the HALITE_COUNT_ALLOCATIONS build
+ * option, which replaces the global operator new and delete). Each
+ * allocation is then also counted for the phase its thread is timing, if
+ * any (see PhaseTimer), which game threads are, but not the threads they
+ * start (e.g. for event detection or the replay).
+ */
+#ifdef HALITE_COUNT_ALLOCATIONS
+constexpr bool COUNTS_ALLOCATIONS = true;
+#else
+constexpr bool COUNTS_ALLOCATIONS = false;
+#endif
+
+//! Heap allocations made so far by the whole program, on any thread (0
+//! without COUNTS_ALLOCATIONS).
+auto allocation_count() -> uint64_t;
+//! The bytes allocated and not yet freed by the whole program (0 without
+//! COUNTS_ALLOCATIONS).
+auto live_allocation_bytes() -> uint64_t;
+
+//! The heap allocations of a phase, on the thread timing it.
+struct PhaseAllocations {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    //! The most the whole program had allocated at once (see
+    //! live_allocation_bytes), as of the phase's allocations.
+    uint64_t peak_live_bytes = 0;
+
+    auto add(const PhaseAllocations& other) -> void;
+};
+
+/**
+ * Count the calling thread's allocations in the given phase from now on
+ * (or nowhere, if null), returning where they were counted before. Does
+ * nothing without COUNTS_ALLOCATIONS.
+ */
+auto count_allocations_in(PhaseAllocations* phase) -> PhaseAllocations*;
+
+//! Where the time of one turn went, and how much work it did.
+struct TurnProfile {
+    std::array<uint64_t, NUM_TURN_PHASES> phase_nanos;
+    //! Events found by detection, before dropping those of dead ships.
+    uint64_t events_found;
+    //! Pairs of ships near enough to be screened for events, and the pairs
+    //! screening let through to the exact solver.
+    uint64_t candidates_tested;
+    uint64_t candidates_solved;
+    //! The same for pairs of a ship and a planet.
+    uint64_t planets_tested;
+    uint64_t planets_solved;
+    uint64_t allocations;
+    //! The allocations of each phase (with COUNTS_ALLOCATIONS).
+    std::array<PhaseAllocations, NUM_TURN_PHASES> phase_allocations;
+    //! If set, every phase timed is also added to this trace, as a span on
+    //! its engine thread. Kept by clear.
+    TraceFile* trace = nullptr;
+
+    TurnProfile() { clear(); }
+    auto clear() -> void;
+};
+
+/**
+ * Times a phase of the turn, from construction until finish or the end of
+ * the scope, adding to profile (and its trace). Does nothing if profile is
+ * null, which is how profiling is turned off.
+ */
+class PhaseTimer {
+public:
+    PhaseTimer(TurnProfile* profile, TurnPhase phase) : profile(profile), phase(phase) {
+        if (profile == nullptr) return;
+        if (COUNTS_ALLOCATIONS) {
+            outer_allocations = count_allocations_in(
+                &profile->phase_allocations[static_cast<size_t>(phase)]);
+        }
+        start = TraceFile::clock::now();
+    }
+    ~PhaseTimer() { finish(); }
+    PhaseTimer(const PhaseTimer&) = delete;
+    auto operator=(const PhaseTimer&) -> PhaseTimer& = delete;
+
+    //! Stop timing before the end of the scope.
+    auto finish() -> void {
+        if (profile == nullptr) return;
+        const auto end = TraceFile::clock::now();
+        if (COUNTS_ALLOCATIONS) count_allocations_in(outer_allocations);
+        profile->phase_nanos[static_cast<size_t>(phase)] += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        if (profile->trace != nullptr) {
+            profile->trace->span(TraceFile::ENGINE_THREAD, turn_phase_name(phase), start, end);
+        }
+        profile = nullptr;
+    }
+
+private:
+    TurnProfile* profile;
+    TurnPhase phase;
+    TraceFile::clock::time_point start;
+    //! Where allocations were counted before, e.g. the phase this one is
+    //! part of.
+    PhaseAllocations* outer_allocations = nullptr;
+};
+
+//! The profiles of every turn of a game, summed up.
+struct GameProfile {
+    unsigned int turns = 0;
+    //! The total and the slowest turn of each phase.
+    std::array<uint64_t, NUM_TURN_PHASES> total_nanos{};
+    std::array<uint64_t, NUM_TURN_PHASES> max_nanos{};
+    //! The allocations of each phase over every turn, with their peaks
+    //! the highest of any turn.
+    TurnProfile totals;
+
+    auto add(const TurnProfile& turn) -> void;
+};
+
+auto to_json(nlohmann::json& json, const GameProfile& profile) -> void;
+
+//! The header of a per-turn profile CSV (see --profile-file), with a
+//! column for each phase in nanoseconds and for each counter.
+auto turn_profile_csv_header() -> std::string;
+auto turn_profile_csv_row(unsigned int turn, const TurnProfile& profile) -> std::string;
+
+#endif //HALITE_TURNPROFILE_HPP
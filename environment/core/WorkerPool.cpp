@@ -0,0 +1,77 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int threads) {
+    for (size_t index = 1; index < std::max(1U, threads); index++) {
+        workers.emplace_back(&WorkerPool::work, this, index);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+auto WorkerPool::run(size_t parts, const std::function<void(size_t)>& part) -> void {
+    parts = std::min<size_t>(parts, size());
+    if (parts > 1) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &part;
+            job_parts = parts;
+            job_number++;
+            remaining = parts - 1;
+            error = nullptr;
+        }
+        job_ready.notify_all();
+    }
+
+    std::exception_ptr own_error;
+    if (parts > 0) {
+        try {
+            part(0);
+        }
+        catch (...) {
+            own_error = std::current_exception();
+        }
+    }
+
+    if (parts > 1) {
+        std::unique_lock<std::mutex> lock(mutex);
+        job_done.wait(lock, [this]() { return remaining == 0; });
+        job = nullptr;
+        if (!own_error) own_error = error;
+    }
+    if (own_error) std::rethrow_exception(own_error);
+}
+
+auto WorkerPool::work(size_t index) -> void {
+    uint64_t last_job = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        job_ready.wait(lock, [&]() { return stopping || job_number != last_job; });
+        if (stopping) return;
+        last_job = job_number;
+        if (index >= job_parts) continue;
+
+        const auto& part = *job;
+        lock.unlock();
+        std::exception_ptr part_error;
+        try {
+            part(index);
+        }
+        catch (...) {
+            part_error = std::current_exception();
+        }
+        lock.lock();
+        if (part_error && !error) error = part_error;
+        if (--remaining == 0) job_done.notify_one();
+    }
+}
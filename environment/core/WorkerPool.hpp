@@ -0,0 +1,57 @@
+#ifndef HALITE_WORKERPOOL_HPP
+#define HALITE_WORKERPOOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Threads that are started once, for a game or a batch of games, and then
+ * run the parts of every job they are given, so that work split across
+ * threads every substep (e.g. event detection) doesn't start and join
+ * threads each time.
+ *
+ * The thread calling run does part 0 itself, and waits for the others on
+ * a countdown of the parts left, like a latch. A pool of one thread starts
+ * none.
+ */
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned int threads);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    auto operator=(const WorkerPool&) -> WorkerPool& = delete;
+
+    //! How many parts a job can be run in at once, counting the caller.
+    auto size() const -> unsigned int { return static_cast<unsigned int>(workers.size()) + 1; }
+
+    /**
+     * Call part(index) for every index below parts (at most size()), each
+     * on a thread of its own, and return once all have. If any throw, one
+     * of the exceptions is rethrown here. Not to be called from more than
+     * one thread at a time.
+     */
+    auto run(size_t parts, const std::function<void(size_t)>& part) -> void;
+
+private:
+    std::mutex mutex;
+    std::condition_variable job_ready, job_done;
+    //! The job being run, and which one it is, for workers to tell a new
+    //! job from the one they just did.
+    const std::function<void(size_t)>* job = nullptr;
+    size_t job_parts = 0;
+    uint64_t job_number = 0;
+    //! The parts on other threads not done yet.
+    size_t remaining = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    auto work(size_t index) -> void;
+};
+
+#endif //HALITE_WORKERPOOL_HPP
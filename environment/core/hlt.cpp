@@ -7,42 +7,238 @@
 #endif
 
 #include <cmath>
+#include <stdexcept>
 #include "hlt.hpp"
 
 namespace hlt {
-    auto Move::output_json(hlt::PlayerId player_id, int move_no) const -> nlohmann::json {
-        auto record = nlohmann::json{
-            { "owner", player_id },
-            { "queue_number", move_no },
-            { "shipId", shipId },
-        };
+    auto PlayerMoveQueue::reset(EntityIndex num_ids, unsigned int max_moves_) -> void {
+        for (const auto ship_id : queued) {
+            depths[ship_id] = 0;
+        }
+        queued.clear();
+        other_ids.clear();
+
+        // No ship has moves now, so the slots can be laid out afresh
+        max_moves = max_moves_;
+        if (depths.size() < num_ids) {
+            depths.resize(num_ids, 0);
+        }
+        if (slots.size() < depths.size() * max_moves) {
+            slots.resize(depths.size() * max_moves);
+        }
+    }
+
+    auto PlayerMoveQueue::push(const Move& move) -> bool {
+        if (move.shipId >= depths.size()) {
+            auto& ship_moves = other_ids[move.shipId];
+            if (ship_moves.size() >= max_moves) return false;
+            ship_moves.push_back(move);
+            return true;
+        }
+
+        auto& depth = depths[move.shipId];
+        if (depth >= max_moves) return false;
+        if (depth == 0) queued.push_back(move.shipId);
+        slots[move.shipId * max_moves + depth] = move;
+        depth++;
+        return true;
+    }
+
+    auto PlayerMoveQueue::find(EntityIndex ship_id, int move_no) const -> const Move* {
+        if (ship_id >= depths.size()) {
+            const auto ship_moves = other_ids.find(ship_id);
+            if (ship_moves == other_ids.end() || move_no >= ship_moves->second.size()) {
+                return nullptr;
+            }
+            return &ship_moves->second[move_no];
+        }
+
+        if (move_no >= depths[ship_id]) return nullptr;
+        return &slots[ship_id * max_moves + move_no];
+    }
+
+    auto PlayerMoveQueue::empty() const -> bool {
+        return queued.empty() && other_ids.empty();
+    }
+
+    auto ShipTable::at(EntityIndex id) -> Ship& {
+        const auto entry = find(id);
+        if (entry == end()) throw std::out_of_range("No such ship");
+        return entry->second;
+    }
+
+    auto ShipTable::at(EntityIndex id) const -> const Ship& {
+        const auto entry = find(id);
+        if (entry == end()) throw std::out_of_range("No such ship");
+        return entry->second;
+    }
 
+    auto ShipTable::insert(EntityIndex id, const Ship& ship) -> Ship& {
+        assert(entries.empty() || entries.back().first < id);
+        if (slots.size() <= id) {
+            // Cast so that NONE (which has no definition) isn't bound to a
+            // reference
+            slots.resize(std::max<size_t>(id + 1, slots.size() * 2),
+                         static_cast<uint32_t>(NONE));
+        }
+        slots[id] = static_cast<uint32_t>(entries.size());
+        entries.emplace_back(id, ship);
+        return entries.back().second;
+    }
+
+    auto ShipTable::erase(EntityIndex id) -> size_t {
+        const auto entry = find(id);
+        if (entry == end()) return 0;
+        entries.erase(entries.begin() + (entry - begin()));
+        slots[id] = NONE;
+        for (size_t i = entry - begin(); i < entries.size(); i++) {
+            slots[entries[i].first] = static_cast<uint32_t>(i);
+        }
+        return 1;
+    }
+
+    auto ShipTable::kill(EntityIndex id) -> void {
+        const auto entry = find(id);
+        if (entry == end()) throw std::out_of_range("No such ship");
+        entry->second.kill();
+        first_dead = std::min(first_dead, slots[id]);
+    }
+
+    auto ShipTable::remove_dead() -> void {
+        if (first_dead == NONE) return;
+
+        size_t kept = first_dead;
+        for (size_t i = first_dead; i < entries.size(); i++) {
+            if (!entries[i].second.is_alive()) {
+                slots[entries[i].first] = NONE;
+                continue;
+            }
+            if (kept != i) {
+                entries[kept] = entries[i];
+                slots[entries[kept].first] = static_cast<uint32_t>(kept);
+            }
+            kept++;
+        }
+        entries.resize(kept);
+        first_dead = NONE;
+    }
+
+    auto Move::write_json(JsonWriter& json, hlt::PlayerId player_id, int move_no) const -> void {
+        json.begin_object();
         switch (type) {
             case hlt::MoveType::Noop:
                 assert(false);
             case hlt::MoveType::Thrust:
-                record["type"] = "thrust";
-                record["magnitude"] = move.thrust.thrust;
-                record["angle"] = move.thrust.angle;
+                json.key("angle").value(move.thrust.angle);
+                json.key("magnitude").value(move.thrust.thrust);
+                json.key("owner").value(player_id);
+                json.key("queue_number").value(move_no);
+                json.key("shipId").value(shipId);
+                json.key("type").value("thrust");
                 break;
             case hlt::MoveType::Dock:
-                record["type"] = "dock";
-                record["planet_id"] = move.dock_to;
+                json.key("owner").value(player_id);
+                json.key("planet_id").value(move.dock_to);
+                json.key("queue_number").value(move_no);
+                json.key("shipId").value(shipId);
+                json.key("type").value("dock");
                 break;
             case hlt::MoveType::Undock:
-                record["type"] = "undock";
+                json.key("owner").value(player_id);
+                json.key("queue_number").value(move_no);
+                json.key("shipId").value(shipId);
+                json.key("type").value("undock");
                 break;
             case hlt::MoveType::Error:
                 assert(false);
+                json.key("owner").value(player_id);
+                json.key("queue_number").value(move_no);
+                json.key("shipId").value(shipId);
+                break;
+        }
+        json.end_object();
+    }
+
+    PlanetIndex::PlanetIndex()
+        : cell_size(MIN_CELL_SIZE), width(0), height(0), max_radius(0),
+          indexed_count(0), indexed_width(0), indexed_height(0) {
+        offsets.assign(1, 0);
+    }
+
+    auto PlanetIndex::is_built_for(const std::vector<Planet>& planets,
+                                   unsigned short map_width,
+                                   unsigned short map_height) const -> bool {
+        return indexed_count == planets.size() &&
+            indexed_width == map_width && indexed_height == map_height;
+    }
+
+    auto PlanetIndex::rebuild(const std::vector<Planet>& planets,
+                              unsigned short map_width,
+                              unsigned short map_height) -> void {
+        max_radius = 0;
+        for (const auto& planet : planets) {
+            max_radius = std::max(max_radius, planet.radius);
+        }
+
+        cell_size = std::max(MIN_CELL_SIZE, static_cast<int>(std::ceil(2 * max_radius)));
+        width = std::max(1, static_cast<int>(std::ceil(static_cast<double>(map_width) / cell_size)));
+        height = std::max(1, static_cast<int>(std::ceil(static_cast<double>(map_height) / cell_size)));
+
+        const auto cell_of = [&](const Planet& planet) -> int {
+            const auto cell_x = std::min(width - 1, std::max(0,
+                static_cast<int>(std::floor(planet.location.pos_x / cell_size))));
+            const auto cell_y = std::min(height - 1, std::max(0,
+                static_cast<int>(std::floor(planet.location.pos_y / cell_size))));
+            return cell_x * height + cell_y;
+        };
+
+        // Counting sort by cell; planets stay in index order within a cell
+        offsets.assign(width * height + 1, 0);
+        for (const auto& planet : planets) {
+            offsets[cell_of(planet) + 1]++;
+        }
+        for (size_t cell = 1; cell < offsets.size(); cell++) {
+            offsets[cell] += offsets[cell - 1];
+        }
+
+        entries.resize(planets.size());
+        auto cursor = std::vector<unsigned int>(offsets.begin(), offsets.end() - 1);
+        for (EntityIndex planet_idx = 0; planet_idx < planets.size(); planet_idx++) {
+            entries[cursor[cell_of(planets[planet_idx])]++] = planet_idx;
+        }
+
+        indexed_count = planets.size();
+        indexed_width = map_width;
+        indexed_height = map_height;
+    }
+
+    auto PlanetIndex::candidates(const Location& location, double radius,
+                                 std::vector<EntityIndex>& result) const -> void {
+        result.clear();
+
+        const auto reach = radius + max_radius;
+        const auto min_x = std::max(0, static_cast<int>(std::floor((location.pos_x - reach) / cell_size)));
+        const auto min_y = std::max(0, static_cast<int>(std::floor((location.pos_y - reach) / cell_size)));
+        const auto max_x = std::min(width - 1, static_cast<int>(std::floor((location.pos_x + reach) / cell_size)));
+        const auto max_y = std::min(height - 1, static_cast<int>(std::floor((location.pos_y + reach) / cell_size)));
+
+        for (auto cell_x = min_x; cell_x <= max_x; cell_x++) {
+            for (auto cell_y = min_y; cell_y <= max_y; cell_y++) {
+                const auto cell = cell_x * height + cell_y;
+                result.insert(result.end(),
+                              entries.begin() + offsets[cell],
+                              entries.begin() + offsets[cell + 1]);
+            }
         }
 
-        return record;
+        // Callers rely on seeing planets in the same order as a linear scan
+        std::sort(result.begin(), result.end());
     }
 
     Map::Map() {
         map_width = 0;
         map_height = 0;
-        ships = { {} };
+        ships = std::vector<ShipTable>();
         planets = std::vector<Planet>();
         next_index = 0;
     }
@@ -55,9 +251,10 @@ namespace hlt {
         next_index = other_map.next_index;
     }
 
-    Map::Map(unsigned short width, unsigned short height) : Map() {
+    Map::Map(unsigned short width, unsigned short height, PlayerId num_players) : Map() {
         map_width = width;
         map_height = height;
+        ships.resize(num_players);
     }
 
     auto Map::within_bounds(const Location& location) const -> bool {
@@ -66,41 +263,77 @@ namespace hlt {
     }
 
     auto Map::is_valid(EntityId entity_id) -> bool {
-        switch (entity_id.type) {
+        switch (entity_id.type()) {
             case EntityType::InvalidEntity:
                 return false;
             case EntityType::PlanetEntity:
                 return entity_id.entity_index() < planets.size() && planets[entity_id.entity_index()].is_alive();
             case EntityType::ShipEntity:
-                return ships.at(entity_id.player_id()).count(entity_id.entity_index()) > 0;
+            {
+                // Killed ships stay in the table until cleanup_entities
+                const auto& player_ships = ships.at(entity_id.player_id());
+                const auto ship = player_ships.find(entity_id.entity_index());
+                return ship != player_ships.end() && ship->second.is_alive();
+            }
             default:
                 throw std::string("Unknown entity id type");
         }
     }
 
-    auto Map::get_ship(PlayerId player, EntityIndex entity) -> Ship& {
-        return ships.at(player).at(entity);
-    }
+    auto Map::check_consistency() const -> void {
+        auto fail = [](const std::string& what, EntityIndex index) {
+            throw std::logic_error(what + " (entity " + std::to_string(index) + ")");
+        };
 
-    auto Map::get_ship(PlayerId player, EntityIndex entity) const -> const Ship& {
-        return ships.at(player).at(entity);
-    }
+        for (EntityIndex planet_index = 0; planet_index < planets.size(); planet_index++) {
+            const auto& planet = planets[planet_index];
+            if (!planet.is_alive()) continue;
+            if (planet.docked_ships.size() > planet.docking_spots) {
+                fail("Planet has more ships than docking spots", planet_index);
+            }
+            if (!planet.docked_ships.empty() &&
+                (!planet.owned || planet.owner >= ships.size())) {
+                fail("Planet with docked ships has no owner", planet_index);
+            }
 
-    auto Map::get_ship(EntityId entity_id) -> Ship& {
-        assert(entity_id.is_valid());
-        assert(entity_id.type == EntityType::ShipEntity);
-        return get_ship(entity_id.player_id(), entity_id.entity_index());
-    }
+            unsigned short fully_docked = 0;
+            for (const auto ship_index : planet.docked_ships) {
+                const auto& owner_ships = ships[planet.owner];
+                const auto entry = owner_ships.find(ship_index);
+                if (entry == owner_ships.end() || !entry->second.is_alive()) {
+                    fail("Planet lists a ship its owner doesn't have", planet_index);
+                }
+                const auto& ship = entry->second;
+                if (ship.docking_status == DockingStatus::Undocked ||
+                    ship.docked_planet != planet_index) {
+                    fail("Planet lists a ship not docked to it", planet_index);
+                }
+                if (ship.docking_status == DockingStatus::Docked) fully_docked++;
+            }
+            if (fully_docked != planet.num_fully_docked) {
+                fail("Planet miscounts its fully docked ships", planet_index);
+            }
+        }
 
-    auto Map::get_planet(EntityId entity_id) -> Planet& {
-        assert(entity_id.is_valid());
-        assert(entity_id.type == EntityType::PlanetEntity);
-        assert(entity_id.entity_index() < planets.size());
-        return planets[entity_id.entity_index()];
+        for (PlayerId player = 0; player < ships.size(); player++) {
+            for (const auto& pair : ships[player]) {
+                const auto& ship = pair.second;
+                if (!ship.is_alive() || ship.docking_status == DockingStatus::Undocked) continue;
+                if (ship.docked_planet >= planets.size()) {
+                    fail("Ship is docked to no planet", pair.first);
+                }
+                const auto& planet = planets[ship.docked_planet];
+                if (!planet.is_alive() || !planet.owned || planet.owner != player ||
+                    std::find(planet.docked_ships.begin(), planet.docked_ships.end(),
+                              pair.first) == planet.docked_ships.end()) {
+                    fail("Ship is docked to a planet that doesn't list it", pair.first);
+                }
+            }
+        }
     }
 
     auto Map::get_entity(EntityId entity_id) -> Entity& {
-        switch (entity_id.type) {
+        switch (entity_id.type()) {
             case EntityType::InvalidEntity:
                 throw std::string("Can't get entity from invalid ID");
             case EntityType::PlanetEntity:
@@ -138,13 +371,12 @@ namespace hlt {
     }
 
     auto Map::kill_entity(EntityId entity_id) -> void {
-        switch (entity_id.type) {
+        switch (entity_id.type()) {
             case EntityType::PlanetEntity: {
                 planets[entity_id.entity_index()].kill();
                 break;
             }
             case EntityType::ShipEntity: {
-                ships[entity_id.player_id()][entity_id.entity_index()].kill();
                 ships[entity_id.player_id()].erase(entity_id.entity_index());
                 break;
             }
@@ -155,9 +387,9 @@ namespace hlt {
     }
 
     auto Map::unsafe_kill_entity(EntityId entity_id) -> void {
-        switch (entity_id.type) {
+        switch (entity_id.type()) {
             case EntityType::ShipEntity: {
-                ships[entity_id.player_id()][entity_id.entity_index()].kill();
+                ships[entity_id.player_id()].kill(entity_id.entity_index());
                 break;
             }
             default:
@@ -166,48 +398,159 @@ namespace hlt {
         }
     }
 
-    auto Map::cleanup_entities() -> void {
-        for (auto& player_ships : ships) {
-            for (auto it = player_ships.begin(); it != player_ships.end();) {
-                if (!it->second.is_alive()) {
-                    it = player_ships.erase(it);
-                }
-                else {
-                    ++it;
-                }
-            }
+    namespace {
+        //! The finalizer of SplitMix64, which spreads every bit of the
+        //! input over the output.
+        auto mix64(uint64_t value) -> uint64_t {
+            value ^= value >> 30;
+            value *= 0xbf58476d1ce4e5b9ull;
+            value ^= value >> 27;
+            value *= 0x94d049bb133111ebull;
+            value ^= value >> 31;
+            return value;
         }
-    }
-
-    auto Map::test(const Location& location, double radius, double time) -> std::vector<EntityId> {
-        std::vector<EntityId> result;
 
-        test_planets(location, radius, result);
+        auto add_to_hash(uint64_t hash, uint64_t value) -> uint64_t {
+            return mix64(hash ^ value) + 0x9e3779b97f4a7c15ull;
+        }
 
-        for (hlt::PlayerId player_id = 0; player_id < MAX_PLAYERS; player_id++) {
-            const auto& player_ships = ships[player_id];
+        //! Add the exact value of a coordinate, the same on every platform
+        //! with the same Scalar. (Copying out the bytes of a long double
+        //! would pick up its padding.)
+        auto add_scalar_to_hash(uint64_t hash, Scalar value) -> uint64_t {
+#if defined(HALITE_FIXED_POINT)
+            return add_to_hash(hash, static_cast<uint64_t>(value.raw()));
+#else
+            int exponent = 0;
+            const auto mantissa = std::frexp(value, &exponent);
+            // A long double mantissa has at most 64 bits, so this is exact
+            hash = add_to_hash(hash, static_cast<uint64_t>(std::ldexp(std::fabs(mantissa), 64)));
+            return add_to_hash(hash, (static_cast<uint64_t>(static_cast<uint32_t>(exponent)) << 1) |
+                                     (mantissa < 0 ? 1 : 0));
+#endif
+        }
+    }
 
-            for (const auto& ship_pair : player_ships) {
-                const auto& ship = ship_pair.second;
-                if (!ship.is_alive()) {
-                    continue;
-                }
+    auto Map::ship_state_hash(PlayerId owner, EntityIndex id, const Ship& ship) -> uint64_t {
+        auto hash = add_to_hash(0x5348495053ull, owner);
+        hash = add_to_hash(hash, id);
+        hash = add_scalar_to_hash(hash, ship.location.pos_x);
+        hash = add_scalar_to_hash(hash, ship.location.pos_y);
+        hash = add_scalar_to_hash(hash, ship.velocity.vel_x);
+        hash = add_scalar_to_hash(hash, ship.velocity.vel_y);
+        hash = add_to_hash(hash, ship.health);
+        hash = add_to_hash(hash, ship.weapon_cooldown);
+        hash = add_to_hash(hash, static_cast<uint64_t>(ship.docking_status));
+        if (ship.docking_status != DockingStatus::Undocked) {
+            hash = add_to_hash(hash, ship.docked_planet);
+            hash = add_to_hash(hash, ship.docking_progress);
+        }
+        return mix64(hash);
+    }
 
-                // Need to forecast ship position
-                auto location2 = ship.location;
-                location2.move_by(ship.velocity, time);
+    auto Map::planet_state_hash(EntityIndex id, const Planet& planet) -> uint64_t {
+        // Which ships are docked is part of their hashes, and the owner of
+        // an unowned planet means nothing
+        auto hash = add_to_hash(0x504c414e4554ull, id);
+        hash = add_to_hash(hash, planet.health);
+        hash = add_to_hash(hash, planet.remaining_production);
+        hash = add_to_hash(hash, planet.current_production);
+        hash = add_to_hash(hash, planet.owned ? planet.owner + 1u : 0);
+        return mix64(hash);
+    }
 
-                if (location.distance2(ship.location) <= std::pow(radius + ship.radius, 2)) {
-                    result.push_back(EntityId::for_ship(player_id, ship_pair.first));
-                }
+    auto Map::state_hash() const -> uint64_t {
+        uint64_t hash = 0;
+        for (PlayerId player = 0; player < player_count(); player++) {
+            for (const auto& ship_pair : ships[player]) {
+                if (!ship_pair.second.is_alive()) continue;
+                hash += ship_state_hash(player, ship_pair.first, ship_pair.second);
             }
         }
+        for (EntityIndex planet_index = 0; planet_index < planets.size(); planet_index++) {
+            if (!planets[planet_index].is_alive()) continue;
+            hash += planet_state_hash(planet_index, planets[planet_index]);
+        }
+        return hash;
+    }
 
+    auto state_hash_string(uint64_t hash) -> std::string {
+        static const char DIGITS[] = "0123456789abcdef";
+        std::string result(16, '0');
+        for (auto digit = result.rbegin(); digit != result.rend(); ++digit, hash >>= 4) {
+            *digit = DIGITS[hash & 0xf];
+        }
         return result;
     }
 
+    auto Map::save(MapSnapshot& snapshot) const -> void {
+        snapshot.next_index = next_index;
+        snapshot.ships = ships;
+        snapshot.planets.clear();
+        snapshot.docked_ships.clear();
+        for (const auto& planet : planets) {
+            snapshot.planets.push_back(MapSnapshot::PlanetState{
+                planet.health,
+                planet.remaining_production,
+                planet.current_production,
+                planet.owner,
+                planet.owned,
+                planet.frozen,
+                static_cast<uint32_t>(snapshot.docked_ships.size()),
+                static_cast<uint32_t>(planet.docked_ships.size()),
+                planet.num_fully_docked,
+            });
+            snapshot.docked_ships.insert(snapshot.docked_ships.end(),
+                                         planet.docked_ships.begin(),
+                                         planet.docked_ships.end());
+        }
+    }
+
+    auto Map::restore(const MapSnapshot& snapshot) -> void {
+        assert(snapshot.planets.size() == planets.size());
+        next_index = snapshot.next_index;
+        ships = snapshot.ships;
+        for (size_t i = 0; i < planets.size(); i++) {
+            const auto& state = snapshot.planets[i];
+            auto& planet = planets[i];
+            planet.health = state.health;
+            planet.remaining_production = state.remaining_production;
+            planet.current_production = state.current_production;
+            planet.owner = state.owner;
+            planet.owned = state.owned;
+            planet.frozen = state.frozen;
+            const auto docked = snapshot.docked_ships.begin() + state.docked_offset;
+            planet.docked_ships.assign(docked, docked + state.num_docked);
+            planet.num_fully_docked = state.num_fully_docked;
+        }
+    }
+
+    auto Map::cleanup_entities() -> void {
+        for (auto& player_ships : ships) {
+            player_ships.remove_dead();
+        }
+    }
+
+    auto Map::prepare_planet_index() -> void {
+        if (!planet_index.is_built_for(planets, map_width, map_height)) {
+            planet_index.rebuild(planets, map_width, map_height);
+        }
+    }
+
+    auto Map::planets_near(const Location& location, double radius) -> const std::vector<EntityIndex>& {
+        prepare_planet_index();
+        planet_index.candidates(location, radius, planet_candidates);
+        return planet_candidates;
+    }
+
+    auto Map::planets_near(const Location& location, double radius,
+                           std::vector<EntityIndex>& result) const -> void {
+        assert(planet_index.is_built_for(planets, map_width, map_height));
+        planet_index.candidates(location, radius, result);
+    }
+
     auto Map::test_planets(const Location& location, double radius, std::vector<EntityId>& collisions) -> void {
-        for (hlt::EntityIndex planet_idx = 0; planet_idx < planets.size(); planet_idx++) {
+        for (const auto planet_idx : planets_near(location, radius)) {
             const auto& planet = planets[planet_idx];
             if (!planet.is_alive()){
                 continue;
@@ -251,7 +594,7 @@ namespace hlt {
     }
 
     auto Map::any_planet_collision(const Location& location, double radius) -> bool {
-        for (hlt::EntityIndex planet_idx = 0; planet_idx < planets.size(); planet_idx++) {
+        for (const auto planet_idx : planets_near(location, radius)) {
             const auto& planet = planets[planet_idx];
             if (!planet.is_alive()){
                 continue;
@@ -265,12 +608,12 @@ namespace hlt {
         return false;
     }
 
-    auto Map::spawn_ship(const Location& location, PlayerId owner) -> EntityIndex {
+    auto Map::spawn_ship(const Location& location, PlayerId owner,
+                         const GameConstants& constants) -> EntityIndex {
         auto& player_ships = ships[owner];
         auto new_id = next_index;
 
-        player_ships[new_id] = Ship{};
-        player_ships[new_id].revive(location);
+        player_ships.insert(new_id, Ship{}).revive(location, constants);
 
         next_index++;
 
@@ -10,15 +10,28 @@
 #include <fstream>
 #include <assert.h>
 #include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 #include <unordered_map>
 
 #include "Constants.hpp"
 #include "Entity.hpp"
+#include "JsonWriter.hpp"
 
-#include "json.hpp"
+#include "json_fwd.hpp"
 
-extern bool quiet_output;
-extern bool always_log;
+/**
+ * In HALITE_VALIDATE builds, throw std::logic_error with the given message
+ * unless the condition holds. Other builds don't evaluate it at all, so it
+ * is for checks of the engine's own invariants, not of what bots send.
+ */
+#ifdef HALITE_VALIDATE
+#define HALITE_CHECK(condition, message) \
+    do { if (!(condition)) throw std::logic_error(message); } while (false)
+#else
+#define HALITE_CHECK(condition, message) do {} while (false)
+#endif
 
 namespace hlt {
     enum class MoveType {
@@ -45,14 +58,187 @@ namespace hlt {
             EntityIndex dock_to;
         } move;
 
+        //! The move as recorded in replays and player logs.
+        auto write_json(JsonWriter& json, hlt::PlayerId player_id, int move_no) const -> void;
         auto output_json(hlt::PlayerId player_id, int move_no) const -> nlohmann::json;
     };
 
     template<typename T>
     using entity_map = std::unordered_map<EntityIndex, T>;
 
-    typedef std::array<entity_map<hlt::Move>, MAX_QUEUED_MOVES> PlayerMoveQueue;
-    typedef std::array<PlayerMoveQueue, MAX_PLAYERS> MoveQueue;
+    /**
+     * A player's moves for one turn: up to a game's MAX_QUEUED_MOVES per
+     * ship, in the order they were queued.
+     *
+     * Moves are stored flat and indexed by ship ID, so neither queueing nor
+     * looking up a move hashes, and reset keeps the storage for the next
+     * turn. Moves for IDs no ship has had yet (which a bot may still send)
+     * go into a map instead.
+     */
+    class PlayerMoveQueue {
+    public:
+        //! Forget all moves, sizing the flat storage for ship IDs below
+        //! num_ids, with up to max_moves_ each.
+        auto reset(EntityIndex num_ids, unsigned int max_moves_ = 1) -> void;
+        //! Queue a move for move.shipId. Returns false if that ship already
+        //! has max_moves.
+        auto push(const Move& move) -> bool;
+        //! The move_no'th move queued for a ship, or nullptr.
+        auto find(EntityIndex ship_id, int move_no) const -> const Move*;
+        //! Whether no moves are queued at all.
+        auto empty() const -> bool;
+
+    private:
+        unsigned int max_moves = 1;
+        //! The moves of ship i start at i * max_moves.
+        std::vector<Move> slots;
+        std::vector<unsigned char> depths;
+        //! Ships with a move in the flat storage, to reset only those.
+        std::vector<EntityIndex> queued;
+        entity_map<std::vector<Move>> other_ids;
+    };
+    //! The moves of every player in a game, by the player's tag.
+    typedef std::vector<PlayerMoveQueue> MoveQueue;
+
+    /**
+     * A uniform grid over planet centers. Planets never move, so this is
+     * built once per game; dead planets stay in the grid and are filtered
+     * out by the callers, which check Planet::is_alive anyways.
+     */
+    struct PlanetIndex {
+        //! Lower bound for the cell size.
+        constexpr static auto MIN_CELL_SIZE = 8;
+
+        int cell_size;
+        int width, height;
+        //! The radius of the largest planet. Queries are expanded by this,
+        //! since each planet is only stored in the cell of its center.
+        double max_radius;
+        //! The number of planets (and map dimensions) this index was built for.
+        size_t indexed_count;
+        unsigned short indexed_width, indexed_height;
+
+        //! Planet indices of all cells, CSR-style: cell i spans
+        //! [offsets[i], offsets[i + 1]).
+        std::vector<unsigned int> offsets;
+        std::vector<EntityIndex> entries;
+
+        PlanetIndex();
+
+        auto is_built_for(const std::vector<Planet>& planets,
+                          unsigned short map_width, unsigned short map_height) const -> bool;
+        auto rebuild(const std::vector<Planet>& planets,
+                     unsigned short map_width, unsigned short map_height) -> void;
+        /**
+         * Find the indices of all planets that could overlap the given
+         * circle, in ascending order. Dead planets are included.
+         */
+        auto candidates(const Location& location, double radius,
+                        std::vector<EntityIndex>& result) const -> void;
+    };
+
+    /**
+     * The ships of one player, stored contiguously in ascending ID order,
+     * with a table from ship ID to position so that lookups don't hash.
+     * Iterating visits (ID, ship) pairs, like an entity_map. Ship is
+     * trivially copyable, so copying a table copies a few flat arrays.
+     *
+     * Like a vector, adding or removing ships invalidates references to
+     * the others.
+     */
+    class ShipTable {
+    public:
+        typedef std::pair<EntityIndex, Ship> value_type;
+        typedef value_type* iterator;
+        typedef const value_type* const_iterator;
+
+        auto begin() -> iterator { return entries.data(); }
+        auto end() -> iterator { return entries.data() + entries.size(); }
+        auto begin() const -> const_iterator { return entries.data(); }
+        auto end() const -> const_iterator { return entries.data() + entries.size(); }
+        auto size() const -> size_t { return entries.size(); }
+        auto empty() const -> bool { return entries.empty(); }
+
+        //! The entry of the given ship, or end().
+        auto find(EntityIndex id) -> iterator {
+            return id < slots.size() && slots[id] != NONE ? begin() + slots[id] : end();
+        }
+        auto find(EntityIndex id) const -> const_iterator {
+            return id < slots.size() && slots[id] != NONE ? begin() + slots[id] : end();
+        }
+        auto count(EntityIndex id) const -> size_t { return find(id) != end() ? 1 : 0; }
+        //! Throws std::out_of_range if there is no such ship.
+        auto at(EntityIndex id) -> Ship&;
+        auto at(EntityIndex id) const -> const Ship&;
+        //! The given ship, which must be in the table (unchecked, unlike at,
+        //! except in HALITE_VALIDATE builds).
+        auto get(EntityIndex id) -> Ship& {
+#ifdef HALITE_VALIDATE
+            return at(id);
+#else
+            return entries[slots[id]].second;
+#endif
+        }
+        auto get(EntityIndex id) const -> const Ship& {
+#ifdef HALITE_VALIDATE
+            return at(id);
+#else
+            return entries[slots[id]].second;
+#endif
+        }
+
+        //! Add a ship, whose ID must be above that of every ship so far.
+        auto insert(EntityIndex id, const Ship& ship) -> Ship&;
+        //! Remove the given ship, if it is there, keeping the others in
+        //! order. Returns the number of ships removed.
+        auto erase(EntityIndex id) -> size_t;
+        //! Kill the given ship, leaving it in the table (where it can be
+        //! told apart by its health) until remove_dead.
+        auto kill(EntityIndex id) -> void;
+        /**
+         * Remove the ships killed since the last call, keeping the others
+         * in order. Only the ships after the first one killed are moved,
+         * and nothing is done if none were.
+         */
+        auto remove_dead() -> void;
+
+    private:
+        constexpr static uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+        std::vector<value_type> entries;
+        //! The position of each ship ID in entries, or NONE.
+        std::vector<uint32_t> slots;
+        //! The lowest position of a ship killed since remove_dead, or NONE.
+        uint32_t first_dead = NONE;
+    };
+
+    /**
+     * The parts of a Map that change as a game is played, for saving a
+     * state and coming back to it (see Map::save). Ship tables are flat
+     * arrays of plain structs, and planets only keep the fields that
+     * change, so saving into the same snapshot again copies a few
+     * contiguous blocks without allocating.
+     */
+    struct MapSnapshot {
+        struct PlanetState {
+            unsigned short health;
+            unsigned short remaining_production;
+            unsigned short current_production;
+            PlayerId owner;
+            bool owned;
+            bool frozen;
+            //! The planet's docked ships are entries docked_offset up to
+            //! docked_offset + num_docked of MapSnapshot::docked_ships.
+            uint32_t docked_offset;
+            uint32_t num_docked;
+            unsigned short num_fully_docked;
+        };
+
+        EntityIndex next_index;
+        std::vector<ShipTable> ships;
+        std::vector<PlanetState> planets;
+        std::vector<EntityIndex> docked_ships;
+    };
 
     /**
      * Represents the state of the game map during a given turn.
@@ -64,12 +250,19 @@ namespace hlt {
          */
         EntityIndex next_index;
 
+        //! Built lazily the first time planets are queried (the map
+        //! generators add planets directly to Map::planets). Not copied
+        //! along with the map.
+        PlanetIndex planet_index;
+        std::vector<EntityIndex> planet_candidates;
+
     public:
         /**
-         * A map of all the ships in the game, keyed by the player's tag and
-         * the ship's index.
+         * All the ships in the game, by the player's tag, then the ship's
+         * index. There is a table for every player in the game, and no
+         * more.
          */
-        std::array<entity_map<Ship>, MAX_PLAYERS> ships;
+        std::vector<ShipTable> ships;
         /**
          * A map of all the planets in the game, keyed by the planet's
          * index. Planets which have died are still in this array.
@@ -79,15 +272,68 @@ namespace hlt {
 
         Map();
         Map(const Map& other_map);
-        Map(unsigned short width, unsigned short height);
+        Map(unsigned short width, unsigned short height, PlayerId num_players);
+
+        //! The number of players, whether or not they have ships left.
+        auto player_count() const -> PlayerId {
+            return static_cast<PlayerId>(ships.size());
+        }
+
+        /**
+         * A 64-bit hash of the state of the game: every living ship's
+         * owner, ID, position, velocity (the exact bits of both), health,
+         * cooldown and docking, and every living planet's health,
+         * production and owner. Two maps that would play out the same
+         * (given the same moves) hash the same.
+         *
+         * It is the sum of a hash of each entity, so it doesn't depend on
+         * the order the entities are stored in, and a search that
+         * changes a few entities can update it by subtracting their old
+         * hashes and adding their new ones (see ship_state_hash and
+         * planet_state_hash).
+         */
+        auto state_hash() const -> uint64_t;
+        static auto ship_state_hash(PlayerId owner, EntityIndex id, const Ship& ship) -> uint64_t;
+        static auto planet_state_hash(EntityIndex id, const Planet& planet) -> uint64_t;
+
+        auto save(MapSnapshot& snapshot) const -> void;
+        //! Go back to a snapshot saved from this map. Planets' positions
+        //! and sizes aren't saved, so it must have the same planets.
+        auto restore(const MapSnapshot& snapshot) -> void;
 
         auto is_valid(EntityId entity_id) -> bool;
+        //! Every ship spawned so far has an index below this.
+        auto ship_index_limit() const -> EntityIndex { return next_index; }
         auto within_bounds(const Location& location) const -> bool;
-        auto get_ship(PlayerId player, EntityIndex entity) -> Ship&;
-        auto get_ship(PlayerId player, EntityIndex entity) const -> const Ship&;
-        auto get_ship(EntityId entity_id) -> Ship&;
-        auto get_planet(EntityId entity_id) -> Planet&;
+        /*
+         * The entities the engine looks up must exist: these only check
+         * (throwing std::logic_error or std::out_of_range) in
+         * HALITE_VALIDATE builds. Use is_valid for IDs that may be stale.
+         */
+        auto get_ship(PlayerId player, EntityIndex entity) -> Ship& {
+            HALITE_CHECK(player < ships.size(), "No such player");
+            return ships[player].get(entity);
+        }
+        auto get_ship(PlayerId player, EntityIndex entity) const -> const Ship& {
+            HALITE_CHECK(player < ships.size(), "No such player");
+            return ships[player].get(entity);
+        }
+        auto get_ship(EntityId entity_id) -> Ship& {
+            HALITE_CHECK(entity_id.type() == EntityType::ShipEntity, "Not a ship");
+            return get_ship(entity_id.player_id(), entity_id.entity_index());
+        }
+        auto get_planet(EntityId entity_id) -> Planet& {
+            HALITE_CHECK(entity_id.type() == EntityType::PlanetEntity, "Not a planet");
+            HALITE_CHECK(entity_id.entity_index() < planets.size(), "No such planet");
+            return planets[entity_id.entity_index()];
+        }
         auto get_entity(EntityId entity_id) -> Entity&;
+        /**
+         * Check that the planets' docked ships and the ships' docking
+         * agree, throwing std::logic_error if they don't. HALITE_VALIDATE
+         * builds do after every turn.
+         */
+        auto check_consistency() const -> void;
         auto kill_entity(EntityId entity_id) -> void;
         auto unsafe_kill_entity(EntityId entity_id) -> void;
         auto cleanup_entities() -> void;
@@ -103,7 +349,25 @@ namespace hlt {
          */
         auto location_with_delta(const Location& location, double dx, double dy) -> possibly<Location>;
 
-        auto test(const Location& location, double radius, double time) -> std::vector<EntityId>;
+        /**
+         * Find the indices of all planets that could overlap the given
+         * circle, in ascending order (the order of a linear scan over
+         * Map::planets). Dead planets are included.
+         *
+         * The result is a reference to scratch storage, valid until the
+         * next call.
+         */
+        auto planets_near(const Location& location, double radius) -> const std::vector<EntityIndex>&;
+        /**
+         * Thread-safe version of planets_near, writing into the given
+         * vector. The planet index must be up to date (see
+         * prepare_planet_index).
+         */
+        auto planets_near(const Location& location, double radius,
+                          std::vector<EntityIndex>& result) const -> void;
+        //! Build the planet index if the planet list changed since last time.
+        auto prepare_planet_index() -> void;
+
         auto test_planets(const Location& location, double radius,
                           std::vector<EntityId>& collisions) -> void;
         auto test_ids(const Location& location, double radius,
@@ -112,9 +376,14 @@ namespace hlt {
         auto any_collision(const Location& location, double radius,
                            const std::vector<EntityId>& potential) -> bool;
         auto any_planet_collision(const Location& location, double radius) -> bool;
-        auto spawn_ship(const Location& location, PlayerId owner) -> EntityIndex;
+        auto spawn_ship(const Location& location, PlayerId owner,
+                        const GameConstants& constants) -> EntityIndex;
     };
 
+    //! A Map::state_hash as replays and the simulation API give it: 16
+    //! hex digits, as JavaScript numbers can't hold 64 bits.
+    auto state_hash_string(uint64_t hash) -> std::string;
+
     struct GameAbort {
         int status;
     };
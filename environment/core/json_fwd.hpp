@@ -0,0 +1,41 @@
+#ifndef HALITE_JSON_FWD_HPP
+#define HALITE_JSON_FWD_HPP
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Declares nlohmann::json without defining it, for headers that only
+ * mention it in declarations. json.hpp is over 12000 lines, so the
+ * simulation code, which never touches JSON, shouldn't have to parse it;
+ * only the translation units that build or read documents include it.
+ *
+ * The template arguments are json.hpp's defaults, which it declares on
+ * its own definitions; this has to be kept in step with it.
+ */
+namespace nlohmann {
+    template<typename, typename>
+    struct adl_serializer;
+
+    template<
+        template<typename U, typename V, typename... Args> class ObjectType,
+        template<typename U, typename... Args> class ArrayType,
+        class StringType,
+        class BooleanType,
+        class NumberIntegerType,
+        class NumberUnsignedType,
+        class NumberFloatType,
+        template<typename U> class AllocatorType,
+        template<typename T, typename SFINAE> class JSONSerializer
+    >
+    class basic_json;
+
+    using json = basic_json<std::map, std::vector, std::string, bool,
+                            std::int64_t, std::uint64_t, double,
+                            std::allocator, adl_serializer>;
+}
+
+#endif //HALITE_JSON_FWD_HPP
@@ -1,6 +1,6 @@
 #include "AsteroidCluster.hpp"
 
-#include <functional>
+#include "../util/distributions.hpp"
 
 #ifdef _WIN32
 #define _USE_MATH_DEFINES
@@ -14,20 +14,20 @@ namespace mapgen {
     auto AsteroidCluster::generate(
         hlt::Map& map,
         unsigned int num_players,
-        unsigned int effective_players) -> std::vector<PointOfInterest> {
+        unsigned int effective_players,
+        const hlt::GameConstants& constants) -> std::vector<PointOfInterest> {
 
-        auto extra_planets = hlt::GameConstants::get().EXTRA_PLANETS;
+        auto extra_planets = constants.EXTRA_PLANETS;
         const auto center_x = map.map_width / 2.0;
         const auto center_y = map.map_height / 2.0;
 
         const auto min_separation =
             std::sqrt(std::min(map.map_width, map.map_height)) / 0.5;
-        auto rand_angle = std::bind(
-            std::uniform_real_distribution<double>(0, 2 * M_PI), std::ref(rng));
+        auto angle_dist = util::uniform_real_distribution<double>(0, 2 * M_PI);
 
         auto spawn_zones = std::vector<Zone>();
 
-        auto spawn_angle_offset = rand_angle();
+        auto spawn_angle_offset = angle_dist(rng);
         const auto spawn_angle_step = 2 * M_PI / effective_players;
         const auto spawn_radius = std::min(map.map_width, map.map_height) / 2.0;
         for (int player_idx = 0; player_idx < effective_players;
@@ -76,6 +76,8 @@ namespace mapgen {
             return true;
         };
 
+        stats = Statistics();
+
         // Planet in center
         if (extra_planets > 0) {
             extra_planets--;
@@ -84,17 +86,20 @@ namespace mapgen {
             const auto small_radius =
                 std::sqrt(std::min(map.map_width, map.map_height) / 1.5);
 
+            stats.incomplete = true;
+            auto radius_dist = util::uniform_real_distribution<>(small_radius, big_radius);
             for (auto attempt = 0; attempt < 100; attempt++) {
+                stats.attempts++;
                 const auto location = hlt::Location{center_x, center_y};
-                const auto radius =
-                    std::uniform_real_distribution<>(small_radius, big_radius)(
-                        rng);
+                const auto radius = radius_dist(rng);
                 if (is_ok_location(location, radius)) {
                     map.planets.emplace_back(
                         location.pos_x,
                         location.pos_y,
-                        radius
+                        radius,
+                        constants
                     );
+                    stats.incomplete = false;
                     break;
                 }
             }
@@ -109,7 +114,7 @@ namespace mapgen {
                 map.spawn_ship(hlt::Location{
                     zone.location.pos_x,
                     zone.location.pos_y - 2 * (i - 1),
-                }, player_id);
+                }, player_id, constants);
             }
         }
 
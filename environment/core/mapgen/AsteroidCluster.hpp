@@ -4,14 +4,15 @@
 #include "Generator.hpp"
 
 namespace mapgen {
-    class AsteroidCluster : Generator {
+    class AsteroidCluster : public Generator {
     public:
         AsteroidCluster(unsigned int _seed);
 
         auto generate(
             hlt::Map& map,
             unsigned int num_players,
-            unsigned int effective_players) -> std::vector<PointOfInterest>;
+            unsigned int effective_players,
+            const hlt::GameConstants& constants) -> std::vector<PointOfInterest>;
 
         auto name() -> std::string;
     };
@@ -3,12 +3,18 @@
 //
 
 #include "Generator.hpp"
+#include "../util/distributions.hpp"
+#include "../json.hpp"
 
 namespace mapgen {
     Generator::Generator(unsigned int _seed) {
         rng = std::mt19937(_seed);
     }
 
+    auto Generator::supports_players(unsigned int effective_players) -> bool {
+        return effective_players >= 1 && effective_players <= hlt::MAX_PLAYERS;
+    }
+
     auto to_json(nlohmann::json& json, const PointOfInterest& poi) -> void {
         switch (poi.type) {
             case PointOfInterestType::Orbit:
@@ -19,4 +25,13 @@ namespace mapgen {
                 json["y_axis"] = poi.data.orbit.y_axis;
         }
     }
+
+    auto default_map_size(unsigned int seed) -> std::pair<unsigned short, unsigned short> {
+        const std::vector<unsigned short> map_size_choices =
+            { 80, 80, 88, 88, 96, 96, 96, 104, 104, 104, 104, 112, 112, 112, 120, 120, 128, 128 };
+        std::mt19937 prg(seed);
+        util::uniform_int_distribution<unsigned long> size_dist(0, map_size_choices.size() - 1);
+        const auto map_base = map_size_choices[size_dist(prg)];
+        return { 3 * map_base, 2 * map_base };
+    }
 }
@@ -10,9 +10,10 @@
 #include <cmath>
 #endif
 
+#include <memory>
 #include <random>
 #include "../hlt.hpp"
-#include "../json.hpp"
+#include "../json_fwd.hpp"
 
 namespace mapgen {
     enum class PointOfInterestType {
@@ -47,11 +48,25 @@ namespace mapgen {
      * Base class for Halite map generators.
      */
     class Generator {
+    public:
+        //! How the last call to generate went.
+        struct Statistics {
+            //! The candidate placements tried.
+            unsigned long attempts = 0;
+            //! Whether the generator gave up before placing every planet
+            //! it meant to.
+            bool incomplete = false;
+        };
+
     protected:
         std::mt19937 rng;
+        Statistics stats;
 
     public:
         Generator(unsigned int _seed);
+        virtual ~Generator() = default;
+
+        auto statistics() const -> const Statistics& { return stats; }
 
         /**
          * Get the name of this map generator.
@@ -59,20 +74,55 @@ namespace mapgen {
          */
         virtual auto name() -> std::string = 0;
 
+        /**
+         * Whether this generator can make maps for the given number of
+         * players (the effective_players of generate). Any number from 1
+         * up to hlt::MAX_PLAYERS, unless a generator says otherwise.
+         */
+        virtual auto supports_players(unsigned int effective_players) -> bool;
+
         /**
          * Given a map, fill it with planets and initial ships.
          *
          * @param map The map to use.
          * @param num_players The number of players on the map.
          * @param effective_players The number of players to generate the map for.
+         * @param constants The constants of the game the map is for.
          */
         virtual auto generate(
             hlt::Map& map,
             unsigned int num_players,
-            unsigned int effective_players) -> std::vector<PointOfInterest> = 0;
+            unsigned int effective_players,
+            const hlt::GameConstants& constants) -> std::vector<PointOfInterest> = 0;
     };
 
     auto to_json(nlohmann::json& json, const PointOfInterest& poi) -> void;
+
+    //! The generator games use unless another is picked.
+    constexpr auto DEFAULT_GENERATOR = "SolarSystem";
+
+    /**
+     * Create the generator whose Generator::name is the given one. Throws
+     * std::invalid_argument if there is none.
+     */
+    auto make_generator(const std::string& name, unsigned int seed) -> std::unique_ptr<Generator>;
+    //! The names of all generators make_generator knows, sorted.
+    auto generator_names() -> std::vector<std::string>;
+    /**
+     * Whether the named generator can make maps for effective_players
+     * players (see Generator::supports_players). Throws
+     * std::invalid_argument if there is no such generator.
+     */
+    auto supports_players(const std::string& name, unsigned int effective_players) -> bool;
+
+    /**
+     * Pick map dimensions (always with a 3:2 aspect ratio) for a game where
+     * the user did not specify any.
+     *
+     * @param seed The map seed.
+     * @return The width and height.
+     */
+    auto default_map_size(unsigned int seed) -> std::pair<unsigned short, unsigned short>;
 }
 
 #endif //HALITE_GENERATOR_H
@@ -0,0 +1,384 @@
+#include "MapCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../json.hpp"
+
+namespace mapgen {
+    //! Identifies a map file, and the version of its layout.
+    constexpr char MAP_FILE_MAGIC[8] = { 'H', 'L', 'T', 'M', 'A', 'P', '0', '1' };
+    //! Identifies the type positions are stored as: its size, plus 0x100
+    //! for fixed point (which is the size of a double).
+#ifdef HALITE_FIXED_POINT
+    constexpr uint32_t SCALAR_FORMAT = 0x100 + sizeof(hlt::Scalar);
+#else
+    constexpr uint32_t SCALAR_FORMAT = sizeof(hlt::Scalar);
+#endif
+
+    auto constants_hash(const hlt::GameConstants& constants) -> uint64_t {
+        // FNV-1a
+        auto hash = uint64_t(14695981039346656037ULL);
+        const auto mix = [&hash](const char* data, size_t size) {
+            for (size_t i = 0; i < size; i++) {
+                hash ^= static_cast<uint8_t>(data[i]);
+                hash *= uint64_t(1099511628211ULL);
+            }
+        };
+        const auto serialized = constants.to_json().dump();
+        mix(serialized.data(), serialized.size());
+        const auto scalar_format = SCALAR_FORMAT;
+        mix(reinterpret_cast<const char*>(&scalar_format), sizeof(scalar_format));
+        return hash;
+    }
+
+    auto MapKey::current(const std::string& generator,
+                         unsigned int seed, unsigned short width, unsigned short height,
+                         unsigned short num_players,
+                         unsigned short effective_players,
+                         const hlt::GameConstants& constants) -> MapKey {
+        return MapKey{
+            generator, seed, width, height,
+            num_players, effective_players,
+            mapgen::constants_hash(constants),
+        };
+    }
+
+    auto MapKey::file_name() const -> std::string {
+        std::ostringstream name;
+        name << generator << '-' << seed << '-' << width << 'x' << height
+             << "-p" << num_players << "-e" << effective_players
+             << '-' << std::hex << constants_hash << ".hltmap";
+        return name.str();
+    }
+
+    auto MapKey::operator==(const MapKey& other) const -> bool {
+        return generator == other.generator && seed == other.seed &&
+            width == other.width && height == other.height &&
+            num_players == other.num_players &&
+            effective_players == other.effective_players &&
+            constants_hash == other.constants_hash;
+    }
+
+    auto generate_map(const MapKey& key,
+                      const hlt::GameConstants& constants,
+                      Generator::Statistics* statistics) -> GeneratedMap {
+        GeneratedMap result{ key, hlt::Map(key.width, key.height, static_cast<hlt::PlayerId>(key.num_players)), {} };
+        auto generator = make_generator(key.generator, key.seed);
+        if (!generator->supports_players(key.effective_players)) {
+            throw std::invalid_argument("The " + key.generator + " map generator can't make maps for " +
+                                        std::to_string(key.effective_players) + " players");
+        }
+        result.points_of_interest = generator->generate(
+            result.map, key.num_players, key.effective_players, constants);
+        if (statistics) *statistics = generator->statistics();
+        return result;
+    }
+
+    // Map files are read back on the machine (or at least the platform)
+    // that wrote them, so everything is stored in native layout.
+    template<typename T>
+    static auto put(std::string& out, const T& value) -> void {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    //! The bytes of a Scalar that hold its value: x87 long doubles are 10
+    //! bytes padded to 12 or 16, and the padding is left undefined.
+    constexpr size_t SCALAR_BYTES =
+        std::numeric_limits<hlt::Scalar>::digits == 64 && sizeof(hlt::Scalar) > 10
+        ? 10 : sizeof(hlt::Scalar);
+
+    static auto put(std::string& out, const hlt::Scalar& value) -> void {
+        out.append(reinterpret_cast<const char*>(&value), SCALAR_BYTES);
+    }
+
+    static auto put(std::string& out, const hlt::Location& location) -> void {
+        put(out, location.pos_x);
+        put(out, location.pos_y);
+    }
+
+    //! Reads values in order from a map file, checking it's long enough.
+    class MapReader {
+    public:
+        MapReader(const char* data_, size_t size_) : data(data_), size(size_) {}
+
+        template<typename T>
+        auto get(T& value) -> void {
+            need(sizeof(value));
+            std::memcpy(&value, data + offset, sizeof(value));
+            offset += sizeof(value);
+        }
+
+        auto get(hlt::Scalar& value) -> void {
+            need(SCALAR_BYTES);
+            value = 0;
+            std::memcpy(&value, data + offset, SCALAR_BYTES);
+            offset += SCALAR_BYTES;
+        }
+
+        auto get(hlt::Location& location) -> void {
+            get(location.pos_x);
+            get(location.pos_y);
+        }
+
+        auto get(std::string& value, size_t length) -> void {
+            need(length);
+            value.assign(data + offset, length);
+            offset += length;
+        }
+
+    private:
+        const char* data;
+        size_t size;
+        size_t offset = 0;
+
+        auto need(size_t bytes) const -> void {
+            if (size - offset < bytes) {
+                throw std::runtime_error("Map file is truncated");
+            }
+        }
+    };
+
+    auto write_map_file(const std::string& path, const GeneratedMap& map) -> void {
+        std::string out(MAP_FILE_MAGIC, sizeof(MAP_FILE_MAGIC));
+        put(out, SCALAR_FORMAT);
+        put(out, map.key.constants_hash);
+        put(out, static_cast<uint32_t>(map.key.seed));
+        put(out, static_cast<uint16_t>(map.key.width));
+        put(out, static_cast<uint16_t>(map.key.height));
+        put(out, static_cast<uint16_t>(map.key.num_players));
+        put(out, static_cast<uint16_t>(map.key.effective_players));
+        put(out, static_cast<uint32_t>(map.key.generator.size()));
+        out += map.key.generator;
+
+        put(out, static_cast<uint32_t>(map.map.planets.size()));
+        for (const auto& planet : map.map.planets) {
+            put(out, planet.location);
+            put(out, planet.radius);
+            put(out, static_cast<uint16_t>(planet.health));
+            put(out, static_cast<uint16_t>(planet.docking_spots));
+            put(out, static_cast<uint16_t>(planet.remaining_production));
+        }
+
+        // Ships are stored in ID order, so that spawning them again gives
+        // them the same IDs
+        std::vector<std::pair<hlt::EntityIndex, std::pair<hlt::PlayerId, hlt::Location>>> ships;
+        for (hlt::PlayerId player = 0; player < map.map.player_count(); player++) {
+            for (const auto& ship_pair : map.map.ships[player]) {
+                ships.push_back({ ship_pair.first, { player, ship_pair.second.location } });
+            }
+        }
+        std::sort(ships.begin(), ships.end(),
+                  [](const decltype(ships)::value_type& a, const decltype(ships)::value_type& b) {
+                      return a.first < b.first;
+                  });
+        put(out, static_cast<uint32_t>(ships.size()));
+        for (const auto& ship : ships) {
+            put(out, static_cast<uint32_t>(ship.first));
+            put(out, static_cast<uint8_t>(ship.second.first));
+            put(out, ship.second.second);
+        }
+
+        put(out, static_cast<uint32_t>(map.points_of_interest.size()));
+        for (const auto& poi : map.points_of_interest) {
+            put(out, static_cast<uint8_t>(poi.type));
+            put(out, poi.data.orbit.location);
+            put(out, static_cast<int32_t>(poi.data.orbit.x_axis));
+            put(out, static_cast<int32_t>(poi.data.orbit.y_axis));
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), out.size());
+        if (!file) {
+            throw std::runtime_error("Could not write map file " + path);
+        }
+    }
+
+    static auto parse_map_file(const char* data, size_t size,
+                               const hlt::GameConstants& constants) -> GeneratedMap {
+        MapReader reader(data, size);
+
+        std::string magic;
+        reader.get(magic, sizeof(MAP_FILE_MAGIC));
+        if (magic != std::string(MAP_FILE_MAGIC, sizeof(MAP_FILE_MAGIC))) {
+            throw std::runtime_error("Not a map file");
+        }
+        uint32_t scalar_format;
+        reader.get(scalar_format);
+        if (scalar_format != SCALAR_FORMAT) {
+            throw std::runtime_error("Map file was written with a different position precision");
+        }
+
+        GeneratedMap result;
+        uint32_t seed, name_length;
+        uint16_t width, height, num_players, effective_players;
+        reader.get(result.key.constants_hash);
+        reader.get(seed);
+        reader.get(width);
+        reader.get(height);
+        reader.get(num_players);
+        reader.get(effective_players);
+        reader.get(name_length);
+        reader.get(result.key.generator, name_length);
+        result.key.seed = seed;
+        result.key.width = width;
+        result.key.height = height;
+        result.key.num_players = num_players;
+        result.key.effective_players = effective_players;
+        if (result.key.constants_hash != mapgen::constants_hash(constants)) {
+            throw std::runtime_error("Map file was written with different game constants");
+        }
+        if (num_players > hlt::MAX_PLAYERS) {
+            throw std::runtime_error("Map file has too many players");
+        }
+
+        result.map = hlt::Map(width, height, static_cast<hlt::PlayerId>(num_players));
+        uint32_t num_planets;
+        reader.get(num_planets);
+        result.map.planets.reserve(num_planets);
+        for (uint32_t i = 0; i < num_planets; i++) {
+            hlt::Location location;
+            double radius;
+            uint16_t health, docking_spots, remaining_production;
+            reader.get(location);
+            reader.get(radius);
+            reader.get(health);
+            reader.get(docking_spots);
+            reader.get(remaining_production);
+
+            result.map.planets.emplace_back(0, 0, radius, constants);
+            auto& planet = result.map.planets.back();
+            planet.location = location;
+            planet.health = health;
+            planet.docking_spots = docking_spots;
+            planet.remaining_production = remaining_production;
+        }
+
+        uint32_t num_ships;
+        reader.get(num_ships);
+        for (uint32_t i = 0; i < num_ships; i++) {
+            uint32_t id;
+            uint8_t owner;
+            hlt::Location location;
+            reader.get(id);
+            reader.get(owner);
+            reader.get(location);
+            if (owner >= num_players || result.map.spawn_ship(location, owner, constants) != id) {
+                throw std::runtime_error("Map file has invalid ships");
+            }
+        }
+
+        uint32_t num_points;
+        reader.get(num_points);
+        for (uint32_t i = 0; i < num_points; i++) {
+            uint8_t type;
+            hlt::Location location;
+            int32_t x_axis, y_axis;
+            reader.get(type);
+            reader.get(location);
+            reader.get(x_axis);
+            reader.get(y_axis);
+            if (type != static_cast<uint8_t>(PointOfInterestType::Orbit)) {
+                throw std::runtime_error("Map file has an unknown point of interest");
+            }
+            result.points_of_interest.emplace_back(location, x_axis, y_axis);
+        }
+
+        return result;
+    }
+
+    auto read_map_file(const std::string& path,
+                       const hlt::GameConstants& constants) -> GeneratedMap {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Could not open map file " + path);
+        }
+        std::string contents((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+        return parse_map_file(contents.data(), contents.size(), constants);
+#else
+        const auto fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open map file " + path);
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("Could not read map file " + path);
+        }
+        const auto size = static_cast<size_t>(status.st_size);
+        auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Could not map map file " + path);
+        }
+
+        try {
+            auto result = parse_map_file(static_cast<const char*>(data), size, constants);
+            munmap(data, size);
+            return result;
+        }
+        catch (...) {
+            munmap(data, size);
+            throw;
+        }
+#endif
+    }
+
+    MapCache::MapCache(std::string directory_) : directory(std::move(directory_)) {
+#ifdef _WIN32
+        if (!directory.empty() && directory.back() != '\\') directory.push_back('\\');
+#else
+        if (!directory.empty() && directory.back() != '/') directory.push_back('/');
+#endif
+    }
+
+    auto MapCache::get(const MapKey& key,
+                       const hlt::GameConstants& constants) const -> GeneratedMap {
+        const auto path = directory + key.file_name();
+        {
+            std::ifstream exists(path);
+            if (exists) {
+                try {
+                    auto cached = read_map_file(path, constants);
+                    if (cached.key == key) return cached;
+                }
+                catch (const std::runtime_error&) {
+                    // Regenerate it below
+                }
+            }
+        }
+
+        auto generated = generate_map(key, constants);
+        std::ostringstream temporary;
+        temporary << path << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id());
+#ifndef _WIN32
+        temporary << '.' << getpid();
+#endif
+        try {
+            write_map_file(temporary.str(), generated);
+            if (std::rename(temporary.str().c_str(), path.c_str()) != 0) {
+                std::remove(temporary.str().c_str());
+            }
+        }
+        catch (const std::runtime_error&) {
+            std::remove(temporary.str().c_str());
+        }
+        return generated;
+    }
+}
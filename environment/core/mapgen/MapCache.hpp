@@ -0,0 +1,100 @@
+#ifndef HALITE_MAPCACHE_H
+#define HALITE_MAPCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Generator.hpp"
+
+namespace mapgen {
+    /**
+     * Everything a generated map depends on. Two maps with the same key are
+     * identical, so the key names the map's file in a MapCache.
+     */
+    struct MapKey {
+        std::string generator;
+        unsigned int seed;
+        unsigned short width, height;
+        //! The players in the game, and the players the map was made for
+        //! (more than the game's in single-player mode).
+        unsigned short num_players, effective_players;
+        //! See constants_hash.
+        uint64_t constants_hash;
+
+        //! The key of the map the given generator makes for these
+        //! parameters, with the given game constants.
+        static auto current(const std::string& generator,
+                            unsigned int seed, unsigned short width, unsigned short height,
+                            unsigned short num_players,
+                            unsigned short effective_players,
+                            const hlt::GameConstants& constants) -> MapKey;
+
+        //! A file name unique to this key.
+        auto file_name() const -> std::string;
+
+        auto operator==(const MapKey& other) const -> bool;
+    };
+
+    /**
+     * A hash of the game constants (which decide planet sizes and ship
+     * health, among others) and of the precision positions are stored in
+     * (see hlt::Scalar), since map files store them as is.
+     */
+    auto constants_hash(const hlt::GameConstants& constants) -> uint64_t;
+
+    //! A map ready to play, with its initial ships.
+    struct GeneratedMap {
+        MapKey key;
+        hlt::Map map;
+        std::vector<PointOfInterest> points_of_interest;
+    };
+
+    /**
+     * Run the map generator for a key, with the constants the key was made
+     * with, optionally reporting how it went. Throws std::invalid_argument
+     * if there is no such generator, or it can't make maps for the key's
+     * effective_players.
+     */
+    auto generate_map(const MapKey& key,
+                      const hlt::GameConstants& constants,
+                      Generator::Statistics* statistics = nullptr) -> GeneratedMap;
+
+    /**
+     * Write a map file: the planets and ships of a freshly generated map
+     * and its points of interest, behind a header holding the key. Throws
+     * std::runtime_error if the file can't be written.
+     */
+    auto write_map_file(const std::string& path, const GeneratedMap& map) -> void;
+    /**
+     * Read a map file written by write_map_file (memory-mapping it where
+     * possible), for a game with the given constants. Throws
+     * std::runtime_error if the file can't be read, is malformed, or was
+     * written with different constants or precision.
+     */
+    auto read_map_file(const std::string& path,
+                       const hlt::GameConstants& constants) -> GeneratedMap;
+
+    /**
+     * A directory of map files, so that games on the same maps (e.g. a
+     * ladder's evaluation seeds) don't regenerate them. Safe to use from
+     * several games at once: files are written under a temporary name and
+     * then renamed into place.
+     */
+    class MapCache {
+    public:
+        explicit MapCache(std::string directory_);
+
+        /**
+         * The map for a key, read from the cache, or generated (with the
+         * constants the key was made with) and stored there if it isn't in
+         * it yet (or can't be read). Failing to store a map is not an error.
+         */
+        auto get(const MapKey& key, const hlt::GameConstants& constants) const -> GeneratedMap;
+
+    private:
+        std::string directory;
+    };
+}
+
+#endif //HALITE_MAPCACHE_H
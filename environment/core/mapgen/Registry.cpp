@@ -0,0 +1,57 @@
+#include "Generator.hpp"
+
+#include <functional>
+#include <map>
+#include <stdexcept>
+
+#include "AsteroidCluster.hpp"
+#include "SolarSystem.hpp"
+#include "SparseField.hpp"
+#include "SymmetricSystem.hpp"
+
+namespace mapgen {
+    typedef std::function<std::unique_ptr<Generator>(unsigned int)> GeneratorFactory;
+
+    template<typename T>
+    static auto factory() -> GeneratorFactory {
+        return [](unsigned int seed) -> std::unique_ptr<Generator> {
+            return std::unique_ptr<Generator>(new T(seed));
+        };
+    }
+
+    //! Every generator, keyed by its name.
+    static auto registry() -> const std::map<std::string, GeneratorFactory>& {
+        static const auto generators = []() {
+            std::map<std::string, GeneratorFactory> result;
+            for (const auto& make : { factory<SolarSystem>(),
+                                      factory<AsteroidCluster>(),
+                                      factory<SparseField>(),
+                                      factory<SymmetricSystem>() }) {
+                result[make(0)->name()] = make;
+            }
+            return result;
+        }();
+        return generators;
+    }
+
+    auto make_generator(const std::string& name, unsigned int seed) -> std::unique_ptr<Generator> {
+        const auto& generators = registry();
+        const auto generator = generators.find(name);
+        if (generator == generators.end()) {
+            throw std::invalid_argument("Unknown map generator " + name);
+        }
+        return generator->second(seed);
+    }
+
+    auto generator_names() -> std::vector<std::string> {
+        std::vector<std::string> names;
+        for (const auto& generator : registry()) {
+            names.push_back(generator.first);
+        }
+        return names;
+    }
+
+    auto supports_players(const std::string& name, unsigned int effective_players) -> bool {
+        return make_generator(name, 0)->supports_players(effective_players);
+    }
+}
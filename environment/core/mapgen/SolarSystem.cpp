@@ -1,6 +1,6 @@
 #include "SolarSystem.hpp"
 
-#include <functional>
+#include <algorithm>
 
 #ifdef _WIN32
 #define _USE_MATH_DEFINES
@@ -8,13 +8,61 @@
 #endif
 
 namespace mapgen {
+    PlanetGrid::PlanetGrid(double width, double height, double cell_size_)
+        : cell_size(cell_size_),
+          columns(std::max(1, static_cast<int>(std::ceil(width / cell_size_)))),
+          rows(std::max(1, static_cast<int>(std::ceil(height / cell_size_)))),
+          cells(static_cast<size_t>(columns * rows)) {}
+
+    auto PlanetGrid::column_of(double x) const -> int {
+        return std::min(columns - 1, std::max(0, static_cast<int>(std::floor(x / cell_size))));
+    }
+
+    auto PlanetGrid::row_of(double y) const -> int {
+        return std::min(rows - 1, std::max(0, static_cast<int>(std::floor(y / cell_size))));
+    }
+
+    auto PlanetGrid::index(const hlt::Map& map) -> void {
+        for (; indexed < map.planets.size(); indexed++) {
+            const auto& planet = map.planets[indexed];
+            cells[row_of(planet.location.pos_y) * columns +
+                  column_of(planet.location.pos_x)].push_back(indexed);
+            max_planet_radius = std::max(max_planet_radius, planet.radius);
+        }
+    }
+
+    auto PlanetGrid::any_within(const hlt::Map& map, const hlt::Location& location,
+                                double radius, double separation) const -> bool {
+        // No planet further than this along either axis can be close enough
+        const auto reach = max_planet_radius + radius + separation;
+        const auto min_column = column_of(location.pos_x - reach);
+        const auto max_column = column_of(location.pos_x + reach);
+        const auto min_row = row_of(location.pos_y - reach);
+        const auto max_row = row_of(location.pos_y + reach);
+
+        for (auto row = min_row; row <= max_row; row++) {
+            for (auto column = min_column; column <= max_column; column++) {
+                for (const auto planet_idx : cells[row * columns + column]) {
+                    const auto& planet = map.planets[planet_idx];
+                    const auto min_distance = planet.radius + radius + separation;
+                    if (map.get_distance(planet.location, location)
+                        <= min_distance) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
     SolarSystem::SolarSystem(unsigned int _seed)
         : Generator(_seed) {}
 
     auto SolarSystem::generate(
         hlt::Map& map,
         unsigned int num_players,
-        unsigned int effective_players) -> std::vector<PointOfInterest> {
+        unsigned int effective_players,
+        const hlt::GameConstants& constants) -> std::vector<PointOfInterest> {
         assert(effective_players == 2 || effective_players == 4);
         assert(num_players <= effective_players);
 
@@ -70,9 +118,9 @@ namespace mapgen {
         }
 
         const auto planets_per_player =
-            hlt::GameConstants::get().PLANETS_PER_PLAYER;
+            constants.PLANETS_PER_PLAYER;
         const auto total_planets = effective_players * planets_per_player;
-        auto extra_planets = hlt::GameConstants::get().EXTRA_PLANETS;
+        auto extra_planets = constants.EXTRA_PLANETS;
         const auto center_x = map.map_width / 2.0;
         const auto center_y = map.map_height / 2.0;
 
@@ -82,23 +130,29 @@ namespace mapgen {
             std::max(5.0, std::sqrt(std::min(map.map_width, map.map_height)));
         const auto min_separation =
             std::sqrt(std::min(map.map_width, map.map_height)) / 1.5;
-        auto rand_x_axis = std::bind(
-            util::uniform_int_distribution<int>(1, map.map_width / 2 - 1), std::ref(rng));
-        auto rand_y_axis = std::bind(
-            util::uniform_int_distribution<int>(1, map.map_height / 2 - 1), std::ref(rng));
-        auto rand_angle = std::bind(
-            util::uniform_real_distribution<double>(0, 2 * M_PI), std::ref(rng));
-        auto rand_radius =
-            std::bind(util::uniform_real_distribution<double>(min_radius, max_radius), std::ref(rng));
-        auto rand_planets_generated =
-            std::bind(util::uniform_int_distribution<>(2, std::max(2, planets_per_player / 2)), std::ref(rng));
+        // Distributions are only their bounds, so these are made once and
+        // drawn from directly, rather than through std::bind
+        auto x_axis_dist = util::uniform_int_distribution<int>(1, map.map_width / 2 - 1);
+        auto y_axis_dist = util::uniform_int_distribution<int>(1, map.map_height / 2 - 1);
+        auto angle_dist = util::uniform_real_distribution<double>(0, 2 * M_PI);
+        auto radius_dist = util::uniform_real_distribution<double>(min_radius, max_radius);
+        auto planets_generated_dist =
+            util::uniform_int_distribution<>(2, std::max(2, planets_per_player / 2));
+        auto line_choice_dist = util::uniform_int_distribution<>(1, 2);
+        auto vertical_offset_dist =
+            util::uniform_real_distribution<>(max_radius, map.map_height / 2 - max_radius);
+        auto horizontal_offset_dist =
+            util::uniform_real_distribution<>(max_radius, map.map_width / 2 - max_radius);
 
         // Temporary storage for the planets created in a particular orbit
         auto planets = std::vector<Zone>();
+        // Planets already on the map, picked up as they are placed
+        auto planet_grid = PlanetGrid(map.map_width, map.map_height,
+                                      2 * max_radius + min_separation);
 
         auto is_ok_location = [&](const hlt::Location& location, double radius) -> bool {
             // Make sure the entirety of the docking area is within map bounds
-            radius += hlt::GameConstants::get().DOCK_RADIUS;
+            radius += constants.DOCK_RADIUS;
             if (location.pos_x - radius < 0 || location.pos_x + radius > map.map_width ||
                 location.pos_y - radius < 0 || location.pos_y + radius > map.map_height) {
                 return false;
@@ -120,14 +174,8 @@ namespace mapgen {
                 }
             }
 
-            for (const auto& planet : map.planets) {
-                const auto min_distance = planet.radius + radius + min_separation;
-                if (map.get_distance(planet.location, location)
-                    <= min_distance) {
-                    return false;
-                }
-            }
-            return true;
+            planet_grid.index(map);
+            return !planet_grid.any_within(map, location, radius, min_separation);
         };
 
         if (extra_planets > 0) {
@@ -137,7 +185,7 @@ namespace mapgen {
                 std::max(2.0, std::sqrt(std::min(map.map_width, map.map_height)) / 3);
             // Stick one planet in the center
             if (extra_planets == 1) {
-                map.planets.emplace_back(center_x, center_y, big_radius * 1.5);
+                map.planets.emplace_back(center_x, center_y, big_radius * 1.5, constants);
             }
             // Generate a cluster of small planets in the center
             // Cluster helps make sure trivial bots don't get stuck from all
@@ -146,7 +194,7 @@ namespace mapgen {
                 const auto radius =
                     util::uniform_real_distribution<>(small_radius, big_radius)(rng);
                 const auto distance_from_center = 2 * radius +
-                    2 * hlt::GameConstants::get().SHIP_RADIUS;
+                    2 * constants.SHIP_RADIUS;
 
                 for (auto i = 0; i < 4; i++) {
                     const auto angle = i * M_PI / 2 + (M_PI / 4);
@@ -155,7 +203,7 @@ namespace mapgen {
                         center_y + distance_from_center * std::sin(angle),
                     };
 
-                    map.planets.emplace_back(location.pos_x, location.pos_y, radius);
+                    map.planets.emplace_back(location.pos_x, location.pos_y, radius, constants);
                 }
             }
         }
@@ -167,7 +215,7 @@ namespace mapgen {
         auto total_attempts = 0;
         while (map.planets.size() < total_planets && total_attempts < MAX_TOTAL_ATTEMPTS) {
             // Planets to generate per player this iteration
-            auto planets_to_generate = rand_planets_generated() * 2;
+            auto planets_to_generate = planets_generated_dist(rng) * 2;
             if (map.planets.size() + planets_to_generate > total_planets) {
                 planets_to_generate = 4;
             }
@@ -176,11 +224,11 @@ namespace mapgen {
                 planets.clear();
                 total_attempts++;
 
-                const auto ellipse_x_axis = rand_x_axis();
-                const auto ellipse_y_axis = rand_y_axis();
-                const auto offset = rand_angle();
+                const auto ellipse_x_axis = x_axis_dist(rng);
+                const auto ellipse_y_axis = y_axis_dist(rng);
+                const auto offset = angle_dist(rng);
                 const auto step = 2.0 * M_PI / planets_to_generate;
-                const auto radius = rand_radius();
+                const auto radius = radius_dist(rng);
 
                 for (auto planet_index = 0;
                      planet_index < planets_to_generate;
@@ -200,7 +248,7 @@ namespace mapgen {
                 for (const auto& zone : planets) {
                     map.planets.emplace_back(zone.location.pos_x,
                                              zone.location.pos_y,
-                                             zone.radius);
+                                             zone.radius, constants);
                 }
 
                 orbits.push_back({ hlt::Location{center_x, center_y,},
@@ -215,11 +263,11 @@ namespace mapgen {
         while (extra_planets > 0 && total_attempts < MAX_TOTAL_ATTEMPTS) {
             total_attempts++;
 
-            const auto choice = util::uniform_int_distribution<>(1, 2)(rng);
+            const auto choice = line_choice_dist(rng);
             if (choice == 1) {
                 // Line of planets down vertical axis
-                auto offset = util::uniform_real_distribution<>(max_radius, map.map_height / 2 - max_radius)(rng);
-                auto radius = rand_radius();
+                auto offset = vertical_offset_dist(rng);
+                auto radius = radius_dist(rng);
                 auto location1 = hlt::Location{center_x, center_y + offset};
                 auto location2 = hlt::Location{center_x, center_y - offset};
                 if (is_ok_location(location1, radius) &&
@@ -234,8 +282,8 @@ namespace mapgen {
             }
             else if (choice == 2) {
                 // Line of planets down horizontal axis
-                auto offset = util::uniform_real_distribution<>(max_radius, map.map_width / 2 - max_radius)(rng);
-                auto radius = rand_radius();
+                auto offset = horizontal_offset_dist(rng);
+                auto radius = radius_dist(rng);
                 auto location1 = hlt::Location{center_x + offset, center_y};
                 auto location2 = hlt::Location{center_x - offset, center_y};
 
@@ -263,7 +311,7 @@ namespace mapgen {
             const auto radius =
                 util::uniform_real_distribution<>(small_radius, big_radius)(rng);
             const auto distance_from_center = 2 * radius +
-                2 * hlt::GameConstants::get().SHIP_RADIUS;
+                2 * constants.SHIP_RADIUS;
 
             std::vector<hlt::Location> candidates;
 
@@ -288,12 +336,15 @@ namespace mapgen {
                 place_corner({map.map_width - 5 * radius, map.map_height - 5 * radius}, M_PI / 3 - M_PI / 4)
             )) {
                 for (const auto location : candidates) {
-                    map.planets.emplace_back(location.pos_x, location.pos_y, radius);
+                    map.planets.emplace_back(location.pos_x, location.pos_y, radius, constants);
                 }
             }
         }
 
-        const size_t ship_count = hlt::GameConstants::get().SHIPS_PER_PLAYER;
+        stats.attempts = static_cast<unsigned long>(total_attempts);
+        stats.incomplete = map.planets.size() < total_planets || extra_planets > 0;
+
+        const size_t ship_count = constants.SHIPS_PER_PLAYER;
         for (hlt::PlayerId player_id = 0; player_id < num_players;
              player_id++) {
             // Spread out ships to make it less likely they'll collide
@@ -305,7 +356,7 @@ namespace mapgen {
                 map.spawn_ship(hlt::Location{
                     zone.location.pos_x,
                     zone.location.pos_y + offset,
-                }, player_id);
+                }, player_id, constants);
                 offset = (offset >= 0) ? -offset - base_offset : -offset;
             }
         }
@@ -316,4 +367,8 @@ namespace mapgen {
     auto SolarSystem::name() -> std::string {
         return "SolarSystem";
     }
+
+    auto SolarSystem::supports_players(unsigned int effective_players) -> bool {
+        return effective_players == 2 || effective_players == 4;
+    }
 }
@@ -6,21 +6,55 @@
 
 namespace mapgen {
     constexpr auto MAX_TOTAL_ATTEMPTS = 75000;
+
+    /**
+     * A uniform grid over the planets of a map, bucketed by the cell their
+     * center falls in, so that checking a candidate location against the
+     * planets placed so far only looks at the few nearby cells.
+     */
+    class PlanetGrid {
+    public:
+        PlanetGrid(double width, double height, double cell_size_);
+
+        //! Add any planets of the map placed since the last call.
+        auto index(const hlt::Map& map) -> void;
+
+        /**
+         * Whether an indexed planet has its center no further than its
+         * radius plus radius plus separation from location.
+         */
+        auto any_within(const hlt::Map& map, const hlt::Location& location,
+                        double radius, double separation) const -> bool;
+
+    private:
+        double cell_size;
+        int columns, rows;
+        std::vector<std::vector<hlt::EntityIndex>> cells;
+        hlt::EntityIndex indexed = 0;
+        double max_planet_radius = 0;
+
+        auto column_of(double x) const -> int;
+        auto row_of(double y) const -> int;
+    };
+
     /**
      * Map generator using a "solar system" model. This generates random orbits
      * around the center of the map, placing planets evenly spaced along those
      * orbits.
      */
-    class SolarSystem : Generator {
+    class SolarSystem : public Generator {
     public:
         SolarSystem(unsigned int _seed);
 
         auto generate(
             hlt::Map& map,
             unsigned int num_players,
-            unsigned int effective_players) -> std::vector<PointOfInterest>;
+            unsigned int effective_players,
+            const hlt::GameConstants& constants) -> std::vector<PointOfInterest>;
 
         auto name() -> std::string;
+        //! Only 2 or 4, which its maps are laid out for.
+        auto supports_players(unsigned int effective_players) -> bool override;
     };
 
 }
@@ -0,0 +1,118 @@
+#include "SparseField.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#include <cmath>
+#endif
+
+#include "SolarSystem.hpp"
+
+namespace mapgen {
+    SparseField::SparseField(unsigned int _seed)
+        : Generator(_seed), engine(_seed) {}
+
+    auto SparseField::generate(
+        hlt::Map& map,
+        unsigned int num_players,
+        unsigned int effective_players,
+        const hlt::GameConstants& constants) -> std::vector<PointOfInterest> {
+        assert(num_players <= effective_players);
+        stats = Statistics();
+
+        const auto center_x = map.map_width / 2.0;
+        const auto center_y = map.map_height / 2.0;
+        const auto short_side = static_cast<double>(std::min(map.map_width, map.map_height));
+
+        // Ships sit on a square grid, far enough apart not to collide
+        const auto ships_per_player = static_cast<int>(std::max(1, constants.SHIPS_PER_PLAYER));
+        const auto formation_side = static_cast<int>(std::ceil(std::sqrt(ships_per_player)));
+        const auto ship_spacing = 2 * constants.SHIP_RADIUS + 1;
+        const auto formation_radius = formation_side * ship_spacing / std::sqrt(2.0);
+
+        auto spawn_zones = std::vector<Zone>();
+        const auto spawn_ring = std::max(0.0, short_side / 2 - formation_radius - 2);
+        auto spawn_angle = util::uniform_real_distribution<double>(0, 2 * M_PI)(engine);
+        for (unsigned int player = 0; player < effective_players; player++) {
+            spawn_zones.emplace_back(
+                hlt::Location{
+                    center_x + std::min(spawn_ring, short_side * 0.35) * std::cos(spawn_angle),
+                    center_y + std::min(spawn_ring, short_side * 0.35) * std::sin(spawn_angle),
+                },
+                formation_radius);
+            spawn_angle += 2 * M_PI / effective_players;
+        }
+
+        const auto total_planets = static_cast<size_t>(
+            effective_players * constants.PLANETS_PER_PLAYER + constants.EXTRA_PLANETS);
+        const auto min_radius = 2.0;
+        const auto max_radius = std::max(3.0, std::sqrt(short_side) / 2);
+        const auto min_separation = std::sqrt(short_side) / 2;
+
+        // About two cells per planet, so that planets end up all over the
+        // map rather than packed into its first rows
+        const auto cell_size = std::max(
+            2 * (max_radius + constants.DOCK_RADIUS) + min_separation,
+            std::sqrt(map.map_width * map.map_height / (2.0 * std::max<size_t>(1, total_planets))));
+        const auto columns = std::max(1, static_cast<int>(map.map_width / cell_size));
+        const auto rows = std::max(1, static_cast<int>(map.map_height / cell_size));
+        std::vector<int> cells(static_cast<size_t>(columns * rows));
+        for (size_t i = 0; i < cells.size(); i++) cells[i] = static_cast<int>(i);
+        // Fisher-Yates, with the portable distributions
+        for (auto i = cells.size(); i > 1; i--) {
+            const auto j = util::uniform_int_distribution<size_t>(0, i - 1)(engine);
+            std::swap(cells[i - 1], cells[j]);
+        }
+
+        auto planet_grid = PlanetGrid(map.map_width, map.map_height, cell_size);
+        util::uniform_real_distribution<double> unit(0, 1);
+        util::uniform_real_distribution<double> rand_radius(min_radius, max_radius);
+
+        for (const auto cell : cells) {
+            if (map.planets.size() >= total_planets) break;
+            stats.attempts++;
+
+            const auto radius = rand_radius(engine);
+            const auto location = hlt::Location{
+                ((cell % columns) + unit(engine)) * cell_size,
+                ((cell / columns) + unit(engine)) * cell_size,
+            };
+
+            const auto reach = radius + constants.DOCK_RADIUS;
+            if (location.pos_x - reach < 0 || location.pos_x + reach > map.map_width ||
+                location.pos_y - reach < 0 || location.pos_y + reach > map.map_height) {
+                continue;
+            }
+            const auto near_spawn = std::any_of(
+                spawn_zones.begin(), spawn_zones.end(), [&](const Zone& zone) {
+                    return map.get_distance(zone.location, location) <=
+                        zone.radius + reach + min_separation;
+                });
+            if (near_spawn) continue;
+
+            planet_grid.index(map);
+            if (planet_grid.any_within(map, location, reach, min_separation)) continue;
+
+            map.planets.emplace_back(location.pos_x, location.pos_y, radius, constants);
+        }
+        stats.incomplete = map.planets.size() < total_planets;
+
+        for (hlt::PlayerId player_id = 0; player_id < num_players; player_id++) {
+            const auto& zone = spawn_zones[player_id];
+            const auto first = -(formation_side - 1) * ship_spacing / 2;
+            for (int i = 0; i < ships_per_player; i++) {
+                map.spawn_ship(hlt::Location{
+                    zone.location.pos_x + first + (i % formation_side) * ship_spacing,
+                    zone.location.pos_y + first + (i / formation_side) * ship_spacing,
+                }, player_id, constants);
+            }
+        }
+
+        return {};
+    }
+
+    auto SparseField::name() -> std::string {
+        return "SparseField";
+    }
+}
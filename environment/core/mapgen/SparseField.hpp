@@ -0,0 +1,35 @@
+#ifndef HALITE_SPARSEFIELD_H
+#define HALITE_SPARSEFIELD_H
+
+#include "Generator.hpp"
+#include "../util/distributions.hpp"
+
+namespace mapgen {
+    /**
+     * Map generator for large maps and large fleets (e.g. stress tests with
+     * a high SHIPS_PER_PLAYER). Planets are scattered over a jittered grid
+     * spanning the whole map, and each player's ships start in a square
+     * formation around a spawn point on a ring about the center, so that
+     * any number of ships fit without overlapping.
+     *
+     * Draws from a xoshiro256** engine rather than Generator::rng, since
+     * it is meant for generating many large maps.
+     */
+    class SparseField : public Generator {
+    private:
+        util::xoshiro256starstar engine;
+
+    public:
+        SparseField(unsigned int _seed);
+
+        auto generate(
+            hlt::Map& map,
+            unsigned int num_players,
+            unsigned int effective_players,
+            const hlt::GameConstants& constants) -> std::vector<PointOfInterest>;
+
+        auto name() -> std::string;
+    };
+}
+
+#endif //HALITE_SPARSEFIELD_H
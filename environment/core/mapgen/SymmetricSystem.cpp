@@ -0,0 +1,187 @@
+#include "SymmetricSystem.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#include <cmath>
+#endif
+
+#include "SolarSystem.hpp"
+
+namespace mapgen {
+    //! Shrink the largest planet radius after this many failed samples in
+    //! a row.
+    constexpr auto FAILURES_BEFORE_SHRINKING = 100;
+    //! How close together planets may end up when making room.
+    constexpr auto MIN_SEPARATION = 1.0;
+
+    SymmetricSystem::SymmetricSystem(unsigned int _seed)
+        : Generator(_seed) {}
+
+    auto SymmetricSystem::generate(
+        hlt::Map& map,
+        unsigned int num_players,
+        unsigned int effective_players,
+        const hlt::GameConstants& constants) -> std::vector<PointOfInterest> {
+        assert(effective_players == 2 || effective_players == 4);
+        assert(num_players <= effective_players);
+        stats = Statistics();
+
+        const auto width = static_cast<double>(map.map_width);
+        const auto height = static_cast<double>(map.map_height);
+        const auto center_x = width / 2;
+        const auto center_y = height / 2;
+
+        // Which axes the map is mirrored across. The fundamental domain is
+        // the part with x below center_x (if mirrored in x) and y below
+        // center_y (if mirrored in y).
+        bool mirror_x, mirror_y;
+        auto spawn_zones = std::vector<Zone>();
+        if (effective_players == 2) {
+            mirror_x = rng() % 2 == 0;
+            mirror_y = !mirror_x;
+            if (mirror_x) {
+                spawn_zones.emplace_back(hlt::Location{ width / 4, center_y }, 1);
+                spawn_zones.emplace_back(hlt::Location{ 3 * width / 4, center_y }, 1);
+            }
+            else {
+                spawn_zones.emplace_back(hlt::Location{ center_x, height / 4 }, 1);
+                spawn_zones.emplace_back(hlt::Location{ center_x, 3 * height / 4 }, 1);
+            }
+        }
+        else {
+            mirror_x = mirror_y = true;
+            spawn_zones.emplace_back(hlt::Location{ width / 4, height / 4 }, 1);
+            spawn_zones.emplace_back(hlt::Location{ 3 * width / 4, height / 4 }, 1);
+            spawn_zones.emplace_back(hlt::Location{ width / 4, 3 * height / 4 }, 1);
+            spawn_zones.emplace_back(hlt::Location{ 3 * width / 4, 3 * height / 4 }, 1);
+        }
+
+        //! The images of a location in every domain, itself first.
+        const auto images = [&](const hlt::Location& location) -> std::vector<hlt::Location> {
+            std::vector<hlt::Location> result = { location };
+            if (mirror_x) result.push_back({ width - location.pos_x, location.pos_y });
+            if (mirror_y) result.push_back({ location.pos_x, height - location.pos_y });
+            if (mirror_x && mirror_y) {
+                result.push_back({ width - location.pos_x, height - location.pos_y });
+            }
+            return result;
+        };
+
+        const auto short_side = std::min(width, height);
+        const auto min_radius = std::max(4.0, std::sqrt(short_side) / 4);
+        auto max_radius = std::max(5.0, std::sqrt(short_side));
+        auto min_separation = std::sqrt(short_side) / 1.5;
+
+        // The same center cluster as SolarSystem, which is symmetric
+        // either way
+        const auto extra_planets = constants.EXTRA_PLANETS;
+        if (extra_planets == 1) {
+            map.planets.emplace_back(center_x, center_y, std::max(4.0, std::sqrt(short_side) / 2) * 1.5, constants);
+        }
+        else if (extra_planets > 1) {
+            const auto big_radius = std::max(4.0, std::sqrt(short_side) / 2);
+            const auto small_radius = std::max(2.0, std::sqrt(short_side) / 3);
+            const auto radius = util::uniform_real_distribution<>(small_radius, big_radius)(rng);
+            const auto distance_from_center = 2 * radius + 2 * constants.SHIP_RADIUS;
+            for (auto i = 0; i < 4; i++) {
+                const auto angle = i * M_PI / 2 + (M_PI / 4);
+                map.planets.emplace_back(center_x + distance_from_center * std::cos(angle),
+                                         center_y + distance_from_center * std::sin(angle),
+                                         radius, constants);
+            }
+        }
+
+        // Sized for the largest planets, so still correct as they shrink
+        auto planet_grid = PlanetGrid(width, height, 2 * max_radius + min_separation);
+        const auto is_ok_location = [&](const hlt::Location& location, double radius) -> bool {
+            // Make sure the entirety of the docking area is within the
+            // domain (and so within the map), so the planet can't overlap
+            // its own images
+            const auto reach = radius + constants.DOCK_RADIUS;
+            const auto domain_width = mirror_x ? center_x - min_separation / 2 : width;
+            const auto domain_height = mirror_y ? center_y - min_separation / 2 : height;
+            if (location.pos_x - reach < 0 || location.pos_x + reach > domain_width ||
+                location.pos_y - reach < 0 || location.pos_y + reach > domain_height) {
+                return false;
+            }
+
+            for (const auto& zone : spawn_zones) {
+                if (map.get_distance(zone.location, location) <=
+                    zone.radius + reach + min_separation) {
+                    return false;
+                }
+            }
+
+            // Planets in other domains are images of ones in this domain,
+            // so checking against the whole map finds the ones that cross
+            // the mirror lines too
+            planet_grid.index(map);
+            return !planet_grid.any_within(map, location, reach, min_separation);
+        };
+
+        const auto total_planets = map.planets.size() +
+            effective_players * static_cast<size_t>(std::max(0, constants.PLANETS_PER_PLAYER));
+        const auto domain_x = mirror_x ? center_x : width;
+        const auto domain_y = mirror_y ? center_y : height;
+        auto x_dist = util::uniform_real_distribution<double>(0, domain_x);
+        auto y_dist = util::uniform_real_distribution<double>(0, domain_y);
+
+        const auto max_attempts = MAX_TOTAL_ATTEMPTS / effective_players;
+        auto failures = 0;
+        while (map.planets.size() + effective_players <= total_planets &&
+               stats.attempts < max_attempts) {
+            stats.attempts++;
+
+            const auto radius = util::uniform_real_distribution<double>(min_radius, max_radius)(rng);
+            const auto location = hlt::Location{ x_dist(rng), y_dist(rng) };
+            if (!is_ok_location(location, radius)) {
+                if (++failures >= FAILURES_BEFORE_SHRINKING) {
+                    // Make room: first for smaller planets, then for
+                    // planets closer together
+                    failures = 0;
+                    if (max_radius > min_radius) {
+                        max_radius = std::max(min_radius, max_radius * 0.9);
+                    }
+                    else {
+                        min_separation = std::max(MIN_SEPARATION, min_separation * 0.9);
+                    }
+                }
+                continue;
+            }
+
+            failures = 0;
+            for (const auto& image : images(location)) {
+                map.planets.emplace_back(image.pos_x, image.pos_y, radius, constants);
+            }
+        }
+        stats.incomplete = map.planets.size() + effective_players <= total_planets;
+
+        const size_t ship_count = constants.SHIPS_PER_PLAYER;
+        for (hlt::PlayerId player_id = 0; player_id < num_players; player_id++) {
+            // Spread out ships like SolarSystem, symmetrically about the
+            // spawn point
+            const auto& zone = spawn_zones[player_id];
+            const int base_offset = 3;
+            int offset = 0;
+            for (size_t i = 0; i < ship_count; i++) {
+                map.spawn_ship(hlt::Location{
+                    zone.location.pos_x,
+                    zone.location.pos_y + offset,
+                }, player_id, constants);
+                offset = (offset >= 0) ? -offset - base_offset : -offset;
+            }
+        }
+
+        return {};
+    }
+
+    auto SymmetricSystem::name() -> std::string {
+        return "SymmetricSystem";
+    }
+
+    auto SymmetricSystem::supports_players(unsigned int effective_players) -> bool {
+        return effective_players == 2 || effective_players == 4;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef HALITE_SYMMETRICSYSTEM_H
+#define HALITE_SYMMETRICSYSTEM_H
+
+#include "Generator.hpp"
+
+namespace mapgen {
+    /**
+     * Map generator that is symmetric by construction: planets are only
+     * sampled in one fundamental domain of the map (the half on one side
+     * of the line between the spawns with two players, a quadrant with
+     * four) and then mirrored into the others.
+     *
+     * Each accepted sample places a planet for every player, so there are
+     * as many times fewer attempts as there are players, and a rejected
+     * sample never throws away a whole orbit as with SolarSystem. When
+     * samples keep failing, the largest planet radius (and then the
+     * separation between planets) shrinks, so dense maps still get all
+     * their planets rather than running out of attempts.
+     */
+    class SymmetricSystem : public Generator {
+    public:
+        SymmetricSystem(unsigned int _seed);
+
+        auto generate(
+            hlt::Map& map,
+            unsigned int num_players,
+            unsigned int effective_players,
+            const hlt::GameConstants& constants) -> std::vector<PointOfInterest>;
+
+        auto name() -> std::string;
+        //! Only 2 or 4, which its maps are laid out for.
+        auto supports_players(unsigned int effective_players) -> bool override;
+    };
+}
+
+#endif //HALITE_SYMMETRICSYSTEM_H
@@ -1,3 +1,6 @@
+#ifndef HALITE_DISTRIBUTIONS_HPP
+#define HALITE_DISTRIBUTIONS_HPP
+
 //===----------------------------------------------------------------------===//
 //
 //                     The LLVM Compiler Infrastructure
@@ -483,4 +486,53 @@ namespace util {
             * ::util::generate_canonical<_RealType, std::numeric_limits<_RealType>::digits>(__g)
             + __p.a();
     }
+
+    /**
+     * xoshiro256** (Blackman and Vigna), a small and fast engine for the
+     * distributions above: its whole state is four words, against the 2.5KB
+     * of std::mt19937, and it is fully specified, so it gives the same
+     * numbers with every compiler. Seeded through splitmix64, as its
+     * authors recommend.
+     *
+     * Existing generators keep std::mt19937, since switching would change
+     * the map of every seed.
+     */
+    class xoshiro256starstar {
+    public:
+        typedef uint64_t result_type;
+
+        explicit xoshiro256starstar(uint64_t seed = 0) {
+            for (auto& word : state) {
+                seed += 0x9e3779b97f4a7c15ULL;
+                auto z = seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                word = z ^ (z >> 31);
+            }
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+        result_type operator()() {
+            const auto result = rotl(state[1] * 5, 7) * 9;
+            const auto t = state[1] << 17;
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = rotl(state[3], 45);
+            return result;
+        }
+
+    private:
+        uint64_t state[4];
+
+        static uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+    };
 }
+
+#endif // HALITE_DISTRIBUTIONS_HPP
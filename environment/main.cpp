@@ -1,12 +1,25 @@
 #ifdef _WIN32
 #define _USE_MATH_DEFINES
 #endif
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <list>
 
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
 #include "version.hpp"
+#include "core/Batch.hpp"
+#include "core/ConsoleLog.hpp"
+#include "core/CpuTopology.hpp"
 #include "core/Halite.hpp"
-#include "core/util/distributions.hpp"
+#include "core/LiveStream.hpp"
+#include "core/OutputWriter.hpp"
+#include "core/ReplayBenchmark.hpp"
+#include "core/ReplayPlayback.hpp"
+#include "core/Server.hpp"
 
 inline std::istream& operator>>(std::istream& i,
                                 std::pair<signed int, signed int>& p) {
@@ -29,17 +42,12 @@ namespace TCLAP {
     };
 }
 
-bool quiet_output =
-    false; //Need to be passed to a bunch of classes; extern is cleaner.
-
-bool always_log =
-    false; //Flag to always log game state (regardless of whether bots are error-ing out)
-
 Halite*
     my_game; //Is a pointer to avoid problems with assignment, dynamic memory, and default constructors.
 
 Networking promptNetworking();
 void promptDimensions(unsigned short& w, unsigned short& h);
+nlohmann::json resource_usage(double wall_seconds);
 
 int main(int argc, char** argv) {
     srand(time(NULL)); //For all non-seeded randomness.
@@ -68,7 +76,7 @@ int main(int argc, char** argv) {
                                    cmd,
                                    false);
     TCLAP::SwitchArg noReplaySwitch
-        ("r", "noreplay", "Turns off the replay generation.", cmd, false);
+        ("r", "noreplay", "Turns off the replay generation. Unless --log is given, error logs then only hold the error, not the state of each turn.", cmd, false);
 
     //Value Args
     TCLAP::ValueArg<unsigned int> nPlayersArg("n",
@@ -76,7 +84,7 @@ int main(int argc, char** argv) {
                                               "Create a map that will accommodate n players [SINGLE PLAYER MODE ONLY].",
                                               false,
                                               1,
-                                              "{1,2,3,4,5,6}",
+                                              "n",
                                               cmd);
     TCLAP::ValueArg<std::pair<signed int, signed int> > dimensionArgs("d",
                                                                       "dimensions",
@@ -126,19 +134,577 @@ int main(int argc, char** argv) {
         false
     );
 
+    TCLAP::ValueArg<unsigned int> keyframeIntervalArg(
+        "",
+        "replay-keyframe-interval",
+        "Write replay frames as changes from the frame before, except for every Nth frame (replay version 32). 0 writes every frame in full.",
+        false,
+        0,
+        "non-negative integer",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> previewIntervalArg(
+        "",
+        "replay-preview-interval",
+        "Also write a small preview of each replay (name ending in .preview.hlt) with every Nth frame, rounded positions and event counts, for visualizers to show while the full replay loads. 0 writes none.",
+        false,
+        0,
+        "non-negative integer",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> replayCommandArg(
+        "",
+        "replay-command",
+        "Pipe each replay (and preview) into the given shell command instead of writing it to a file, with HALITE_REPLAY_NAME set to the file's name, for example to upload it as it is compressed. The results give that name as the replay's.",
+        false,
+        "",
+        "shell command",
+        cmd
+    );
+
+    std::vector<std::string> logLevels = { "debug", "info", "warning", "error" };
+    TCLAP::ValuesConstraint<std::string> logLevelConstraint(logLevels);
+    TCLAP::ValueArg<std::string> logLevelArg(
+        "",
+        "log-level",
+        "Least severe of what the engine prints about a game to show: info (turns, launches), warning (bots that time out, error or die) or error (the engine's own problems).",
+        false,
+        "info",
+        &logLevelConstraint,
+        cmd
+    );
+
+    std::vector<std::string> replayFormats = { "json", "binary", "moves" };
+    TCLAP::ValuesConstraint<std::string> replayFormatConstraint(replayFormats);
+    TCLAP::ValueArg<std::string> replayFormatArg(
+        "",
+        "replay-format",
+        "Format of replay files: json, binary (columnar, for analysis tools; see core/BinaryReplay.hpp) or moves (only the moves, with checksums; see --expand-replay).",
+        false,
+        "json",
+        &replayFormatConstraint,
+        cmd
+    );
+
+    TCLAP::ValueArg<int> compressionLevelArg(
+        "",
+        "replay-compression-level",
+        "zstd level (1-22) to compress replays at. Defaults to the maximum, or 12 with --replay-dictionary.",
+        false,
+        0,
+        "integer",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> compressionThreadsArg(
+        "",
+        "replay-compression-threads",
+        "Number of threads used to compress each replay. More than one makes replays slightly larger.",
+        false,
+        1,
+        "positive integer",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> encodingThreadsArg(
+        "",
+        "replay-encoding-threads",
+        "Number of threads used to serialize the frames of each replay before it is compressed. The replay is the same either way.",
+        false,
+        1,
+        "positive integer",
+        cmd
+    );
+
+    TCLAP::SwitchArg asyncReplaySwitch(
+        "",
+        "async-replay",
+        "Write replays in the background, reporting results (and, in batch mode, starting the next game) before compression finishes.",
+        cmd,
+        false
+    );
+
+    TCLAP::ValueArg<std::string> replayDictionaryArg(
+        "",
+        "replay-dictionary",
+        "Compress replays with a zstd dictionary (see --train-replay-dictionary). Much faster, but replays then need the dictionary to be decompressed.",
+        false,
+        "",
+        "path to file",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> trainDictionaryArg(
+        "",
+        "train-replay-dictionary",
+        "Train a replay dictionary on the replay files given instead of bots, write it to the given file and exit.",
+        false,
+        "",
+        "path to file",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> benchmarkReplayArg(
+        "",
+        "benchmark-replay",
+        "Play the moves of the given replay again without bots, check that every frame comes out the same, time the simulation and exit.",
+        false,
+        "",
+        "path to replay",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> exportFramesArg(
+        "",
+        "export-frames",
+        "Play the moves of the given replay again without bots, checking every frame, write the frames next to it as bots are sent them (a .frames file, for the C++ starter kit's bench) and exit.",
+        false,
+        "",
+        "path to replay",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> trainFrameDictionaryArg(
+        "",
+        "train-frame-dictionary",
+        "Play the moves of the replays given in place of bots again, checking every frame, train a zstd dictionary on their frames for --frame-dictionary, write it to this file and exit.",
+        false,
+        "",
+        "path to dictionary",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> frameDictionaryArg(
+        "",
+        "frame-dictionary",
+        "Compress frames for the bots that ask for it (zstd-frames, meant for remote bots) with this zstd dictionary, e.g. one from --train-frame-dictionary.",
+        false,
+        "",
+        "path to dictionary",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> expandReplayArg(
+        "",
+        "expand-replay",
+        "Play the game of a moves-only replay (--replay-format moves) again, checking it against the replay's checksums, write it next to it as a full replay (in the --replay-format given, json by default) and exit.",
+        false,
+        "",
+        "path to replay",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> benchmarkRepetitionsArg(
+        "",
+        "benchmark-repetitions",
+        "How many times --benchmark-replay times the game, after checking it.",
+        false,
+        10,
+        "positive integer",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> initTimeLimitArg(
+        "",
+        "init-time-limit",
+        "Milliseconds bots have to initialize (60000 by default). The game starts as soon as every bot has replied; a lower limit only cuts short bots that hang.",
+        false,
+        static_cast<unsigned int>(std::chrono::milliseconds(INIT_TIME_LIMIT).count()),
+        "milliseconds",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> frameTimeLimitArg(
+        "",
+        "frame-time-limit",
+        "Milliseconds bots have to reply each turn (2000 by default).",
+        false,
+        static_cast<unsigned int>(FRAME_TIME_LIMIT.count()),
+        "milliseconds",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> timeBankArg(
+        "",
+        "time-bank",
+        "Let bots save up time they don't use, up to this many milliseconds, to spend on later turns on top of the frame time limit.",
+        false,
+        0,
+        "milliseconds",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> fastForwardArg(
+        "",
+        "fast-forward-turns",
+        "Stop asking a bot for moves once it has sent none for this many turns in a row, and play out the turns without it. Can change results if bots wake up again.",
+        false,
+        0,
+        "turns",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> eventThreadsArg(
+        "",
+        "event-threads",
+        "Number of threads used to detect collisions and attacks. Results are identical for any value.",
+        false,
+        1,
+        "positive integer",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> memoryCapArg(
+        "",
+        "memory-cap",
+        "Soft cap on the memory each game holds. A game over it keeps only what a moves-only replay needs from then on, writes that instead of the replay asked for, and logs only timing. Replays are compressed within what is left of it. Peaks are reported under \"memory\" in quiet mode.",
+        false,
+        0,
+        "megabytes",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> batchArg(
+        "",
+        "batch",
+        "Play all games listed in a manifest (one JSON object per line, '-' for stdin), printing one line of results per game. Implies quiet mode.",
+        false,
+        "",
+        "path to file",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> serverArg(
+        "",
+        "server",
+        "Serve games to clients connecting to this address (HOST:PORT or unix:PATH) until stopped. Clients send one game per line, as in a batch manifest, and get each game's results back as a line. Implies quiet mode (POSIX only).",
+        false,
+        "",
+        "address",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> batchThreadsArg(
+        "",
+        "batch-threads",
+        "Number of batch or server games played at once (default: one per core).",
+        false,
+        0,
+        "positive integer",
+        cmd
+    );
+
+    TCLAP::SwitchArg persistentBotsSwitch(
+        "",
+        "persistent-bots",
+        "In batch mode, keep bots running between games. Bots must reset when sent a NEW_GAME line.",
+        cmd,
+        false
+    );
+
+    TCLAP::SwitchArg duplicateSwitch(
+        "",
+        "duplicate",
+        "In batch mode, play every game once per rotation of its seats, on the same map, so that each bot plays from each seat.",
+        cmd,
+        false
+    );
+
+    TCLAP::SwitchArg pinGamesSwitch(
+        "",
+        "pin-games",
+        "In batch and server modes, pin each game and its bots to one L3 cache domain (or NUMA node), spreading threads over them (Linux and Windows).",
+        cmd,
+        false
+    );
+
+    TCLAP::SwitchArg sharedMemorySwitch(
+        "",
+        "shared-memory",
+        "Offer bots a shared memory transport for frames and moves (Linux only).",
+        cmd,
+        false
+    );
+
+    TCLAP::ValueArg<std::string> botCpusArg(
+        "",
+        "bot-cpus",
+        "Pin each bot to one of these CPUs, taking them in turn, e.g. 2-5,8 (Linux only).",
+        false,
+        "",
+        "list of CPUs",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> botMemoryLimitArg(
+        "",
+        "bot-memory-limit",
+        "Limit the memory each bot process may map (POSIX only).",
+        false,
+        0,
+        "megabytes",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> botCpuTimeLimitArg(
+        "",
+        "bot-cpu-time-limit",
+        "Limit the CPU time each bot process may use over the game; bots over it are killed (POSIX only).",
+        false,
+        0,
+        "seconds",
+        cmd
+    );
+
+    TCLAP::SwitchArg directExecSwitch(
+        "",
+        "direct-exec",
+        "Run bot commands directly rather than through /bin/sh. Quotes group words, but no other shell syntax works (POSIX only).",
+        cmd,
+        false
+    );
+
+    TCLAP::ValueArg<unsigned int> remoteBotsArg(
+        "",
+        "remote-bots",
+        "Also play this many bots running elsewhere, which connect to the --listen address and send the --game-token on a line of their own before playing as usual (POSIX only).",
+        false,
+        0,
+        "count",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> listenArg(
+        "",
+        "listen",
+        "Where remote bots connect: HOST:PORT for TCP, or unix:PATH.",
+        false,
+        "",
+        "address",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> liveStreamArg(
+        "",
+        "live-stream",
+        "Stream the game to spectators as it is played, who connect to this address (HOST:PORT for TCP, or unix:PATH) and are sent zstd-compressed frames (see core/LiveStream.hpp; POSIX only).",
+        false,
+        "",
+        "address",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> checkpointArg(
+        "",
+        "checkpoint",
+        "Write a checkpoint of the game to this file every --checkpoint-interval turns, to pick it up from with --resume if the environment is stopped.",
+        false,
+        "",
+        "path",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> checkpointIntervalArg(
+        "",
+        "checkpoint-interval",
+        "The turns between checkpoints (see --checkpoint).",
+        false,
+        100,
+        "turns",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> resumeArg(
+        "",
+        "resume",
+        "Pick up the game from this checkpoint (see --checkpoint), with the same bots: its seed, size, map generator and constants are used, and the bots are sent the map as it was then to initialize with.",
+        false,
+        "",
+        "path",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> gameTokenArg(
+        "",
+        "game-token",
+        "The token remote bots must send to join this game.",
+        false,
+        "",
+        "string",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> connectTimeoutArg(
+        "",
+        "connect-timeout",
+        "How long remote bots have to connect.",
+        false,
+        60000,
+        "milliseconds",
+        cmd
+    );
+
     //Remaining Args, be they start commands and/or override names. Description only includes start commands since it will only be seen on local testing.
     TCLAP::UnlabeledMultiArg<std::string> otherArgs("NonspecifiedArgs",
-                                                    "Start commands for bots.",
+                                                    "Start commands for bots, or builtin:random, builtin:rush or builtin:idle for a bot moved inside the engine.",
                                                     false,
                                                     "Array of strings",
                                                     cmd);
 
+    TCLAP::SwitchArg adjudicateSwitch(
+        "",
+        "adjudicate",
+        "End a game as soon as no moves the bots make can change its ranking (no player but the last can still be eliminated, and none can catch up in ships produced), instead of playing on to the turn limit.",
+        cmd,
+        false
+    );
+
+    TCLAP::ValueArg<std::string> resultsFileArg(
+        "",
+        "results-file",
+        "Write the results, as -q prints them, to the given file, along with a profile of the game and the engine's resource usage, and print nothing (implies -q and --profile).",
+        false,
+        "",
+        "path to file",
+        cmd
+    );
+
+    TCLAP::SwitchArg profileSwitch(
+        "",
+        "profile",
+        "Time each phase of every turn and count the work done, and report the totals with the results.",
+        cmd,
+        false
+    );
+
+    TCLAP::ValueArg<std::string> profileFileArg(
+        "",
+        "profile-file",
+        "Also write the profile of every turn to the given CSV file (implies --profile).",
+        false,
+        "",
+        "path to file",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> overheadBudgetArg(
+        "",
+        "overhead-budget",
+        "Measure the time the engine adds to every turn beyond the think time of the slowest bot, report it with the results, and warn about turns that take longer than the given number of microseconds (0 to only measure).",
+        false,
+        0,
+        "microseconds",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> traceFileArg(
+        "",
+        "trace-file",
+        "Write a timeline of the game (each turn's phases, and each bot's send, think and receive times) to the given file, in the Chrome trace format that chrome://tracing and Perfetto open (implies --profile).",
+        false,
+        "",
+        "path to file",
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> mapCacheArg(
+        "",
+        "map-cache",
+        "Directory of generated maps: games on a map already there load it instead of generating it, and new maps are added to it.",
+        false,
+        "",
+        "path to directory",
+        cmd
+    );
+
+    auto generator_names = mapgen::generator_names();
+    TCLAP::ValuesConstraint<std::string> generatorConstraint(generator_names);
+    TCLAP::ValueArg<std::string> mapGeneratorArg(
+        "",
+        "map-generator",
+        "The map generator to use.",
+        false,
+        mapgen::DEFAULT_GENERATOR,
+        &generatorConstraint,
+        cmd
+    );
+
+    TCLAP::ValueArg<std::string> mapFileArg(
+        "",
+        "map-file",
+        "Play on a map from a map cache file instead of generating one. The seed and dimensions are those of the map.",
+        false,
+        "",
+        "path to file",
+        cmd
+    );
+
     TCLAP::SwitchArg logSwitch("",
                                "log",
                                "Always produce game logs, instead of only in case of errors",
                                cmd,
                                false);
 
+    std::vector<std::string> logDetails = { "none", "timing", "commands", "full" };
+    TCLAP::ValuesConstraint<std::string> logDetailConstraint(logDetails);
+    TCLAP::ValueArg<std::string> logDetailArg(
+        "",
+        "log-detail",
+        "What game logs record every turn: none, timing (response times), commands (and the commands sent), or full (and the bot's ships and planets). Logs have one JSON object per line.",
+        false,
+        "full",
+        &logDetailConstraint,
+        cmd
+    );
+
+    TCLAP::SwitchArg ioThreadSwitch(
+        "",
+        "io-thread",
+        "Close (and flush) replays and logs on a background thread rather than on the thread playing the game. Implied by the options below.",
+        cmd,
+        false
+    );
+
+    TCLAP::ValueArg<unsigned int> outputShardsArg(
+        "",
+        "output-shards",
+        "Spread replays and logs over this many subdirectories (of the replay directory, and of the working directory for logs), picked by a hash of the game ID, so that large batches don't put every file in one directory.",
+        false,
+        0,
+        "count",
+        cmd
+    );
+
+    TCLAP::SwitchArg syncOutputSwitch(
+        "",
+        "sync-output",
+        "fsync every replay and log once written, on the background thread.",
+        cmd,
+        false
+    );
+
+    TCLAP::ValueArg<std::string> logArchiveArg(
+        "",
+        "log-archive",
+        "Append game logs to rolling files PREFIX-N.logs instead of writing a file for each, with the offset and size of every log in PREFIX-N.index (a JSON object per line). Logs are then reported as PREFIX-N.logs#NAME.",
+        false,
+        "",
+        "prefix",
+        cmd
+    );
+
+    TCLAP::ValueArg<unsigned int> logArchiveSizeArg(
+        "",
+        "log-archive-size",
+        "The size a log archive is kept within before the next one is started.",
+        false,
+        256,
+        "megabytes",
+        cmd
+    );
+
     cmd.parse(argc, argv);
 
     unsigned short mapWidth = dimensionArgs.getValue().first;
@@ -153,23 +719,196 @@ int main(int argc, char** argv) {
 
     unsigned short n_players_for_map_creation = nPlayersArg.getValue();
 
-    quiet_output = quietSwitch.getValue();
-    always_log = logSwitch.getValue();
+    const auto& log_level = logLevelArg.getValue();
+    ConsoleLog::instance().set_level(log_level == "debug" ? LogLevel::Debug
+                                     : log_level == "warning" ? LogLevel::Warning
+                                     : log_level == "error" ? LogLevel::Error
+                                     : LogLevel::Info);
+
+    GameOptions game_options;
+    game_options.quiet_output = quietSwitch.getValue() || resultsFileArg.isSet() ||
+                                batchArg.isSet() || serverArg.isSet();
+    game_options.always_log = logSwitch.getValue();
+    game_options.adjudicate_games = adjudicateSwitch.getValue();
+    game_options.ignore_timeout = timeoutSwitch.getValue();
+    game_options.init_time_limit = std::chrono::milliseconds(initTimeLimitArg.getValue());
+    game_options.frame_time_limit = std::chrono::milliseconds(frameTimeLimitArg.getValue());
+    game_options.time_bank = std::chrono::milliseconds(timeBankArg.getValue());
+    game_options.fast_forward_turns = fastForwardArg.getValue();
+    game_options.event_threads = eventThreadsArg.getValue();
+    game_options.memory_cap = uint64_t(memoryCapArg.getValue()) << 20;
+    game_options.profile_turns = profileSwitch.getValue() || profileFileArg.isSet() ||
+                                 traceFileArg.isSet() || resultsFileArg.isSet();
+    game_options.profile_file = profileFileArg.getValue();
+    game_options.trace_file = traceFileArg.getValue();
+    game_options.measure_overhead = overheadBudgetArg.isSet();
+    game_options.overhead_budget = overheadBudgetArg.getValue();
+    game_options.map_cache_directory = mapCacheArg.getValue();
+    game_options.map_generator_name = mapGeneratorArg.getValue();
+    game_options.checkpoint_file = checkpointArg.getValue();
+    game_options.checkpoint_interval = checkpointIntervalArg.getValue();
+    if (!parse_cpu_list(botCpusArg.getValue(), game_options.sandbox.cpus)) {
+        std::cerr << "Invalid CPU list: " << botCpusArg.getValue() << '\n';
+        return 1;
+    }
+    game_options.sandbox.memory_limit = uint64_t(botMemoryLimitArg.getValue()) << 20;
+    game_options.sandbox.cpu_time_limit = botCpuTimeLimitArg.getValue();
+    game_options.sandbox.direct_exec = directExecSwitch.getValue();
+    const bool quiet_output = game_options.quiet_output;
+    networking.set_quiet(quiet_output);
+    networking.set_sandbox(game_options.sandbox);
+    const auto& log_detail_name = logDetailArg.getValue();
+    game_options.log_detail = log_detail_name == "none" ? LogDetail::None
+        : log_detail_name == "timing" ? LogDetail::Timing
+        : log_detail_name == "commands" ? LogDetail::Commands
+        : LogDetail::Full;
     bool override_names = overrideSwitch.getValue();
-    bool ignore_timeout = timeoutSwitch.getValue();
 
     if (printConstantsSwitch.getValue()) {
-        std::cout << hlt::GameConstants::get().to_json().dump(4) << '\n';
+        std::cout << hlt::GameConstants{}.to_json().dump(4) << '\n';
         return 0;
     }
 
+    if (trainDictionaryArg.isSet()) {
+        try {
+            ReplayDictionary::train(otherArgs.getValue(), trainDictionaryArg.getValue());
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
+    ReplayOptions replay_options;
+    replay_options.quiet_output = quiet_output;
+    replay_options.enable_compression = !noCompressionSwitch.getValue();
+    replay_options.compression_level = compressionLevelArg.getValue();
+    replay_options.compression_threads = compressionThreadsArg.getValue();
+    replay_options.encoding_threads = encodingThreadsArg.getValue();
+    replay_options.asynchronous = asyncReplaySwitch.getValue();
+    replay_options.keyframe_interval = keyframeIntervalArg.getValue();
+    replay_options.preview_interval = previewIntervalArg.getValue();
+    replay_options.sink_command = replayCommandArg.getValue();
+    replay_options.format = replayFormatArg.getValue() == "binary"
+                            ? ReplayFormat::Binary
+                            : replayFormatArg.getValue() == "moves"
+                            ? ReplayFormat::Moves : ReplayFormat::Json;
+    std::unique_ptr<ReplayDictionary> replay_dictionary;
+    if (replayDictionaryArg.isSet()) {
+        try {
+            replay_dictionary.reset(new ReplayDictionary(
+                replayDictionaryArg.getValue(),
+                compressionLevelArg.getValue() != 0
+                ? compressionLevelArg.getValue()
+                : ReplayDictionary::DEFAULT_COMPRESSION_LEVEL));
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        replay_options.dictionary = replay_dictionary.get();
+    }
+
+    if (expandReplayArg.isSet()) {
+        auto expand_options = replay_options;
+        if (expand_options.format == ReplayFormat::Moves) {
+            expand_options.format = ReplayFormat::Json;
+        }
+        // Nothing else is going on, so writing in the background gains nothing
+        expand_options.asynchronous = false;
+        try {
+            const auto output = expand_replay(expandReplayArg.getValue(), expand_options);
+            if (!quiet_output) {
+                std::cout << "Wrote " << output << '\n';
+            }
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
+    if (exportFramesArg.isSet()) {
+        try {
+            const auto output = export_replay_frames(exportFramesArg.getValue(),
+                                                     eventThreadsArg.getValue());
+            if (!quiet_output) {
+                std::cout << "Wrote " << output << '\n';
+            }
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
+    if (trainFrameDictionaryArg.isSet()) {
+        try {
+            const auto size = train_frame_dictionary(otherArgs.getValue(),
+                                                     trainFrameDictionaryArg.getValue(),
+                                                     eventThreadsArg.getValue());
+            if (!quiet_output) {
+                std::cout << "Wrote a " << size << " byte dictionary to "
+                          << trainFrameDictionaryArg.getValue() << '\n';
+            }
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
+    if (benchmarkReplayArg.isSet()) {
+        ReplayBenchmark result;
+        try {
+            result = benchmark_replay(benchmarkReplayArg.getValue(),
+                                      benchmarkRepetitionsArg.getValue(),
+                                      eventThreadsArg.getValue());
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+
+        if (quiet_output) {
+            std::cout << nlohmann::json{
+                { "turns", result.turns },
+                { "repetitions", result.repetitions },
+                { "seconds", result.seconds },
+                { "turns_per_second", result.turns_per_second() },
+                { "matches", result.matches() },
+                { "mismatch", result.mismatch },
+            }.dump(4) << '\n';
+        }
+        else if (result.matches()) {
+            std::cout
+                << "Every frame of " << result.turns << " turns matched the replay.\n"
+                << "Played " << result.repetitions << " times in " << result.seconds
+                << " s: " << result.turns_per_second() << " turns per second.\n";
+        }
+        else {
+            std::cout << "The game did not play out as in the replay, at " << result.mismatch << '\n';
+        }
+        return result.matches() ? 0 : 1;
+    }
+
     // Update the game constants.
+    auto& constants = game_options.constants;
     if (constantsArg.isSet()) {
         std::ifstream constants_file(constantsArg.getValue());
         nlohmann::json constants_json;
         constants_file >> constants_json;
-        auto& constants = hlt::GameConstants::get_mut();
-        constants.from_json(constants_json);
+        try {
+            constants.from_json(constants_json);
+        }
+        catch (const std::invalid_argument& e) {
+            std::cerr << "Invalid constants file: " << e.what() << '\n';
+            return 1;
+        }
 
         if (!quiet_output) {
             std::cout
@@ -183,6 +922,169 @@ int main(int argc, char** argv) {
         }
     }
 
+    // A resumed game is set up as the one checkpointed was
+    nlohmann::json checkpoint;
+    if (resumeArg.isSet()) {
+        if (batchArg.isSet() || serverArg.isSet() || mapFileArg.isSet()) {
+            std::cout << "--resume can't be used with --batch, --server or --map-file.\n";
+            return 1;
+        }
+        try {
+            checkpoint = read_checkpoint(resumeArg.getValue());
+            const auto setup = read_recorded_setup(checkpoint);
+            seed = setup.seed;
+            mapWidth = setup.width;
+            mapHeight = setup.height;
+            constants = setup.constants;
+            game_options.map_generator_name = setup.generator;
+            if (setup.num_players == 1) {
+                n_players_for_map_creation =
+                    checkpoint.at("checkpoint").at("map_players").get<unsigned short>();
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << e.what() << '\n';
+            return 1;
+        }
+    }
+    if (checkpointArg.isSet() && (batchArg.isSet() || serverArg.isSet())) {
+        std::cout << "--checkpoint can't be used with --batch or --server.\n";
+        return 1;
+    }
+
+    if (frameDictionaryArg.isSet()) {
+        try {
+            networking.set_frame_dictionary(frameDictionaryArg.getValue());
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    if (sharedMemorySwitch.getValue()) {
+#ifdef HALITE_SHARED_MEMORY
+        if (!networking.enable_shared_memory()) {
+            std::cout << "Could not set up shared memory.\n";
+            return 1;
+        }
+#else
+        std::cout << "Shared memory is only supported on Linux.\n";
+        return 1;
+#endif
+    }
+
+    const auto remote_bots = remoteBotsArg.getValue();
+    if (remote_bots > 0) {
+        if (batchArg.isSet() || serverArg.isSet() || override_names) {
+            std::cout << "--remote-bots can't be used with --batch, --server or --override.\n";
+            return 1;
+        }
+        if (!listenArg.isSet()) {
+            std::cout << "--remote-bots needs a --listen address.\n";
+            return 1;
+        }
+    }
+
+    // Declared before the game, so that spectators get the end of it
+    // before the stream is closed
+    std::unique_ptr<LiveStream> live_stream;
+    if (liveStreamArg.isSet()) {
+        if (batchArg.isSet() || serverArg.isSet()) {
+            std::cout << "--live-stream can't be used with --batch or --server.\n";
+            return 1;
+        }
+        try {
+            live_stream.reset(new LiveStream(liveStreamArg.getValue()));
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << e.what() << '\n';
+            return 1;
+        }
+        game_options.live_stream = live_stream.get();
+    }
+
+    // Declared before the games, whose files it finishes writing
+    std::unique_ptr<OutputWriter> output_writer;
+    if (ioThreadSwitch.getValue() || outputShardsArg.getValue() > 0 ||
+        syncOutputSwitch.getValue() || logArchiveArg.isSet()) {
+        OutputOptions output_options;
+        output_options.shards = outputShardsArg.getValue();
+        output_options.sync = syncOutputSwitch.getValue();
+        output_options.log_archive = logArchiveArg.getValue();
+        output_options.archive_size = uint64_t(logArchiveSizeArg.getValue()) << 20;
+        output_writer.reset(new OutputWriter(output_options));
+        game_options.output_writer = output_writer.get();
+    }
+
+    auto make_batch_options = [&]() -> BatchOptions {
+        BatchOptions options;
+        options.threads = batchThreadsArg.getValue() != 0
+                          ? batchThreadsArg.getValue()
+                          : std::max(1U, std::thread::hardware_concurrency());
+        options.game_options = game_options;
+        options.enable_replay = !noReplaySwitch.getValue();
+        options.replay_options = replay_options;
+        options.replay_directory = replayDirectoryArg.getValue();
+        options.persistent_bots = persistentBotsSwitch.getValue();
+        options.shared_memory = sharedMemorySwitch.getValue();
+        options.duplicate = duplicateSwitch.getValue();
+        options.pin_games = pinGamesSwitch.getValue();
+#ifdef _WIN32
+        if (options.replay_directory.back() != '\\') options.replay_directory.push_back('\\');
+#else
+        if (options.replay_directory.back() != '/') options.replay_directory.push_back('/');
+#endif
+        return options;
+    };
+
+    if (serverArg.isSet()) {
+        if (profileFileArg.isSet() || traceFileArg.isSet()) {
+            std::cerr << "--profile-file and --trace-file can't be used with --server, whose games all run at once.\n";
+            return 1;
+        }
+        if (resultsFileArg.isSet()) {
+            std::cerr << "--results-file can't be used with --server, which reports each game to its client.\n";
+            return 1;
+        }
+        ServerOptions options;
+        options.address = serverArg.getValue();
+        options.batch_options = make_batch_options();
+        options.first_id = static_cast<unsigned int>(id);
+        return run_server(options, std::cerr);
+    }
+
+    if (batchArg.isSet()) {
+        if (profileFileArg.isSet() || traceFileArg.isSet()) {
+            std::cerr << "--profile-file and --trace-file can't be used with --batch, whose games all run at once.\n";
+            return 1;
+        }
+        if (resultsFileArg.isSet()) {
+            std::cerr << "--results-file can't be used with --batch, which reports each game on its own line.\n";
+            return 1;
+        }
+        std::vector<BatchGame> games;
+        try {
+            if (batchArg.getValue() == "-") {
+                games = read_batch_manifest(std::cin, id);
+            }
+            else {
+                std::ifstream manifest(batchArg.getValue());
+                if (!manifest) {
+                    std::cerr << "Could not open batch manifest " << batchArg.getValue() << '\n';
+                    return 1;
+                }
+                games = read_batch_manifest(manifest, id);
+            }
+        }
+        catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+
+        return run_batch(games, make_batch_options(), std::cout) == 0 ? 0 : 1;
+    }
+
     std::vector<std::string> unlabeledArgsVector = otherArgs.getValue();
     std::list<std::string> unlabeledArgs;
     for (auto arg : unlabeledArgsVector) {
@@ -190,28 +1092,33 @@ int main(int argc, char** argv) {
     }
 
     if (mapWidth == 0 && mapHeight == 0) {
-        // Always generate a 3:2 aspect ratio
-        std::vector<unsigned short> mapSizeChoices =
-            { 80, 80, 88, 88, 96, 96, 96, 104, 104, 104, 104, 112, 112, 112, 120, 120, 128, 128 };
-        std::mt19937 prg(seed);
-        util::uniform_int_distribution<unsigned long> size_dist(0, mapSizeChoices.size() - 1);
-        auto mapBase = mapSizeChoices[size_dist(prg)];
-        mapWidth = 3 * mapBase;
-        mapHeight = 2 * mapBase;
+        const auto size = mapgen::default_map_size(seed);
+        mapWidth = size.first;
+        mapHeight = size.second;
     }
 
     const auto override_factor = overrideSwitch.getValue() ? 2 : 1;
-    if (unlabeledArgs.size() != 1 &&
-        unlabeledArgs.size() != 2 * override_factor &&
-        unlabeledArgs.size() != 4 * override_factor) {
-        std::cout << "Must have either 2 or 4 players, or a solo player.\n";
+    const auto player_args = unlabeledArgs.size() + remote_bots;
+    if (player_args != 1 &&
+        (player_args % override_factor != 0 ||
+         player_args / override_factor < 2 ||
+         player_args / override_factor > hlt::MAX_PLAYERS)) {
+        std::cout << "Must have between 2 and " << hlt::MAX_PLAYERS << " players, or a solo player.\n";
         return 1;
     }
 
-    if (unlabeledArgs.size() == 1 && n_players_for_map_creation != 2 &&
-        n_players_for_map_creation != 4) {
-        // Limiation of solar system map generator used
-        std::cout << "Must have either 2 or 4 players for map creation.\n";
+    if (player_args == 1 && n_players_for_map_creation < 2) {
+        std::cout << "Must have at least 2 players for map creation.\n";
+        return 1;
+    }
+
+    // Only what the chosen generator lays its maps out for
+    const auto map_players = player_args == 1
+        ? n_players_for_map_creation : static_cast<unsigned int>(player_args / override_factor);
+    if (!mapFileArg.isSet() &&
+        !mapgen::supports_players(game_options.map_generator_name, map_players)) {
+        std::cout << "The " << game_options.map_generator_name
+                  << " map generator can't make maps for " << map_players << " players.\n";
         return 1;
     }
 
@@ -232,6 +1139,7 @@ int main(int argc, char** argv) {
                 }
             }
             catch (...) {
+                ConsoleLog::instance().flush();
                 std::cout
                     << "Invalid player parameters with override switch enabled.  Override intended for server use only."
                     << std::endl;
@@ -241,7 +1149,7 @@ int main(int argc, char** argv) {
             }
         }
     } else {
-        if (unlabeledArgs.size() < 1) {
+        if (unlabeledArgs.empty() && remote_bots == 0) {
             std::cout
                 << "Please provide the launch command string for at least one bot."
                 << std::endl
@@ -255,6 +1163,7 @@ int main(int argc, char** argv) {
             }
         }
         catch (...) {
+            ConsoleLog::instance().flush();
             std::cout
                 << "One or more of your bot launch command strings failed.  Please check for correctness and try again."
                 << std::endl;
@@ -262,6 +1171,30 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (remote_bots > 0) {
+#ifdef _WIN32
+        std::cout << "Remote bots are not supported on Windows.\n";
+        exit(1);
+#else
+        try {
+            const auto connected = networking.accept_remote_bots(
+                listenArg.getValue(), gameTokenArg.getValue(), remote_bots,
+                std::chrono::milliseconds(connectTimeoutArg.getValue()));
+            if (connected < remote_bots) {
+                std::cout << "Only " << connected << " of " << remote_bots
+                          << " remote bots connected in time.\n";
+                exit(1);
+            }
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << e.what() << '\n';
+            exit(1);
+        }
+#endif
+    }
+    // What the bots' launches printed goes before anything printed here
+    ConsoleLog::instance().flush();
+
     if (networking.player_count() > 1 && n_players_for_map_creation != 1) {
         std::cout << std::endl
                   << "Only single-player mode enables specified n-player maps.  When entering multiple bots, please do not try to specify n."
@@ -272,9 +1205,9 @@ int main(int argc, char** argv) {
     if (networking.player_count() > 1)
         n_players_for_map_creation = networking.player_count();
 
-    if (n_players_for_map_creation > 6 || n_players_for_map_creation < 1) {
+    if (n_players_for_map_creation > hlt::MAX_PLAYERS || n_players_for_map_creation < 1) {
         std::cout << std::endl
-                  << "A map can only accommodate between 1 and 6 players."
+                  << "A map can only accommodate between 1 and " << hlt::MAX_PLAYERS << " players."
                   << std::endl << std::endl;
         exit(1);
     }
@@ -282,12 +1215,49 @@ int main(int argc, char** argv) {
 
 
     //Create game. Null parameters will be ignored.
-    my_game = new Halite(mapWidth,
-                         mapHeight,
-                         seed,
-                         n_players_for_map_creation,
-                         networking,
-                         ignore_timeout);
+    if (mapFileArg.isSet()) {
+        mapgen::GeneratedMap map;
+        try {
+            map = mapgen::read_map_file(mapFileArg.getValue(), constants);
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << e.what() << '\n';
+            return 1;
+        }
+        if (map.key.num_players != networking.player_count()) {
+            std::cout << "The map file is for " << map.key.num_players
+                      << " players, not " << networking.player_count() << ".\n";
+            return 1;
+        }
+        if (!quiet_output) {
+            std::cout
+                << "Map file: " << mapFileArg.getValue()
+                << " Seed: " << map.key.seed
+                << " Dimensions: " << map.key.width << 'x' << map.key.height << std::endl;
+        }
+        my_game = new Halite(std::move(map),
+                             std::move(networking),
+                             game_options);
+    }
+    else {
+        my_game = new Halite(mapWidth,
+                             mapHeight,
+                             seed,
+                             n_players_for_map_creation,
+                             std::move(networking),
+                             game_options);
+    }
+
+    if (resumeArg.isSet()) {
+        try {
+            my_game->resume_from(checkpoint);
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << "Could not resume from " << resumeArg.getValue() << ": " << e.what() << '\n';
+            delete my_game;
+            return 1;
+        }
+    }
 
     std::string outputFilename = replayDirectoryArg.getValue();
 #ifdef _WIN32
@@ -295,13 +1265,32 @@ int main(int argc, char** argv) {
 #else
     if (outputFilename.back() != '/') outputFilename.push_back('/');
 #endif
+    const auto game_start = std::chrono::steady_clock::now();
     GameStatistics stats = my_game->run_game(names,
                                              id,
                                              !noReplaySwitch.getValue(),
-                                             !noCompressionSwitch.getValue(),
+                                             replay_options,
                                              outputFilename);
     if (names != NULL) delete names;
 
+    if (resultsFileArg.isSet()) {
+        auto results = my_game->results_json(stats);
+        results["resources"] = resource_usage(std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - game_start).count());
+        std::ofstream results_file(resultsFileArg.getValue());
+        results_file << results.dump(4) << '\n';
+        results_file.close();
+        if (!results_file) {
+            std::cerr << "Could not write " << resultsFileArg.getValue() << '\n';
+            delete my_game;
+            return 1;
+        }
+    }
+    else if (quiet_output) {
+        // Write out machine-readable log of what happened
+        std::cout << my_game->results_json(stats).dump(4) << std::endl;
+    }
+
     std::string victoryOut;
     if (!quiet_output) {
         for (unsigned int player_id = 0;
@@ -317,9 +1306,84 @@ int main(int argc, char** argv) {
                 << " and dealing " << player_stats.damage_dealt << " damage"
                 << "!\n";
         }
+
+        if (stats.profiled) {
+            const auto& profile = stats.profile;
+            std::cout << "Profile of " << profile.turns << " turns (total ms, average and max us per turn):\n";
+            for (size_t i = 0; i < NUM_TURN_PHASES; i++) {
+                std::cout
+                    << "  " << turn_phase_name(static_cast<TurnPhase>(i)) << ": "
+                    << profile.total_nanos[i] / 1e6 << ", "
+                    << profile.total_nanos[i] / 1e3 / std::max(1U, profile.turns) << ", "
+                    << profile.max_nanos[i] / 1e3;
+                if (COUNTS_ALLOCATIONS) {
+                    const auto& allocations = profile.totals.phase_allocations[i];
+                    std::cout << " (" << allocations.count << " allocations, "
+                              << allocations.bytes << " bytes, peak "
+                              << allocations.peak_live_bytes << " bytes live)";
+                }
+                std::cout << '\n';
+            }
+            // The share of pairs screening spared the exact solver
+            const auto rejected = [](uint64_t tested, uint64_t solved) -> double {
+                return tested > 0 ? 100.0 * (tested - solved) / tested : 0.0;
+            };
+            const auto& totals = profile.totals;
+            std::cout
+                << "  " << totals.events_found << " events found, "
+                << totals.candidates_tested << " candidate pairs screened, "
+                << totals.candidates_solved << " solved ("
+                << rejected(totals.candidates_tested, totals.candidates_solved)
+                << "% rejected), "
+                << totals.planets_tested << " ship-planet pairs screened, "
+                << totals.planets_solved << " solved ("
+                << rejected(totals.planets_tested, totals.planets_solved)
+                << "% rejected)";
+            if (COUNTS_ALLOCATIONS) {
+                std::cout << ", " << profile.totals.allocations << " allocations";
+            }
+            std::cout << '\n';
+        }
+
+        if (stats.measured_overhead) {
+            const auto& overhead = stats.overhead;
+            LatencyHistogram totals;
+            for (const auto& turn : overhead.turns) {
+                totals.add(turn.total());
+            }
+            std::cout << "Engine overhead per turn beyond bot think time (us): p50 "
+                      << totals.quantile(0.5) << ", p95 " << totals.quantile(0.95)
+                      << ", p99 " << totals.quantile(0.99) << ", max " << totals.max();
+            if (overhead.budget > 0) {
+                std::cout << "; " << overhead.turns_over_budget << " of " << overhead.turns.size()
+                          << " turns over the budget of " << overhead.budget << " us";
+            }
+            std::cout << '\n';
+        }
     }
 
     delete my_game;
 
     return 0;
 }
+
+//! What the engine process used (not counting the bots) for a game that
+//! took the given time: CPU seconds and the peak resident size in KiB.
+nlohmann::json resource_usage(double wall_seconds) {
+    nlohmann::json usage;
+    usage["wall_time"] = wall_seconds;
+#ifndef _WIN32
+    rusage self;
+    if (getrusage(RUSAGE_SELF, &self) == 0) {
+        usage["user_cpu_time"] = self.ru_utime.tv_sec + self.ru_utime.tv_usec / 1e6;
+        usage["system_cpu_time"] = self.ru_stime.tv_sec + self.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+        // In bytes there
+        usage["max_resident_kb"] = self.ru_maxrss / 1024;
+#else
+        usage["max_resident_kb"] = self.ru_maxrss;
+#endif
+    }
+#endif
+    return usage;
+}
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+# Script to build JavaScript/Emscripten version of the simulation core, for
+# rebuilding the frames of a replay from its moves in the browser (see
+# core/SimulationApi.hpp).
+#
+# It is built in fixed point: frames only come out as in the replay if the
+# game was played by a HALITE_FIXED_POINT build of the engine, the one mode
+# whose results don't depend on the platform.
+
+mkdir -p emscripten_build
+cd ./emscripten_build
+
+# zstd is C; without ZSTD_MULTITHREAD, replays are compressed on one thread
+emcc -O2 -c ../zstd-1.3.0/lib/common/*.c ../zstd-1.3.0/lib/compress/*.c \
+     ../zstd-1.3.0/lib/decompress/*.c ../zstd-1.3.0/lib/dictBuilder/*.c \
+     -I../zstd-1.3.0/lib -I../zstd-1.3.0/lib/common
+
+# Everything but the front ends (main.cpp, batches and the game server)
+em++ -std=c++11 -O2 -DHALITE_FIXED_POINT -ffp-contract=off \
+     -I.. -I../core -I../core/mapgen -I../networking -I../zstd-1.3.0/lib \
+     $(ls ../core/*.cpp ../core/mapgen/*.cpp ../networking/*.cpp |
+       grep -v -e 'Batch' -e 'Server.cpp') \
+     ./*.o --memory-init-file 0 \
+     -s 'EXPORT_NAME="libhalite"' \
+     -s 'EXPORTED_FUNCTIONS=["_halite_simulation_create", "_halite_simulation_destroy", "_halite_simulation_step", "_halite_simulation_eliminate", "_halite_simulation_frame", "_halite_simulation_state_hash", "_halite_simulation_turn", "_halite_simulation_is_over", "_halite_simulation_error"]' \
+     -s 'EXTRA_EXPORTED_RUNTIME_METHODS=["cwrap", "UTF8ToString"]' \
+     -s 'DISABLE_EXCEPTION_CATCHING=0' \
+     -s 'MODULARIZE=1' -s 'ALLOW_MEMORY_GROWTH=1' -o ../libhalite.js
@@ -8,5 +8,5 @@ cd ..
 emcc shim.c -o shim.bc
 emcc ./lib/libzstd.bc ./shim.bc -O2 --memory-init-file 0 \
      -s 'EXPORT_NAME="libzstd"' \
-     -s 'EXPORTED_FUNCTIONS=["_ZSTD_versionNumber", "_ZSTD_decompress", "_ZSTD_getFrameContentSize", "_ZSTD_isError", "_ZSTD_DStreamInSize", "_ZSTD_DStreamOutSize", "_ZSTD_createDStream", "_ZSTD_initDStream", "_ZSTD_decompressStream", "_ZSTD_freeDStream", "_ZSTDshim_makeInBuffer", "_ZSTDshim_makeOutBuffer", "_ZSTDshim_inBufferExhausted", "_ZSTDshim_outBufferPos", "_ZSTD_getErrorName", "_ZSTDshim_decompress"]' \
+     -s 'EXPORTED_FUNCTIONS=["_ZSTD_versionNumber", "_ZSTD_decompress", "_ZSTD_getFrameContentSize", "_ZSTD_isError", "_ZSTD_DStreamInSize", "_ZSTD_DStreamOutSize", "_ZSTD_createDStream", "_ZSTD_initDStream", "_ZSTD_decompressStream", "_ZSTD_freeDStream", "_ZSTDshim_makeInBuffer", "_ZSTDshim_makeOutBuffer", "_ZSTDshim_inBufferExhausted", "_ZSTDshim_outBufferPos", "_ZSTD_getErrorName", "_ZSTDshim_decompress", "_ZSTDshim_decompress_usingDict"]' \
      -s 'MODULARIZE=1' -s 'ALLOW_MEMORY_GROWTH=1' -o ../libzstd.js
@@ -0,0 +1,196 @@
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "version.hpp"
+#include "core/json.hpp"
+#include "core/mapgen/MapCache.hpp"
+
+#include <tclap/CmdLine.h>
+
+/**
+ * Generates the maps for a range of seeds on several threads, writing them
+ * as map files (a directory usable with halite --map-cache), and reports
+ * how long generation took and how often it fell short of placing every
+ * planet.
+ */
+
+//! Totals over the maps made by one generator.
+struct GeneratorTotals {
+    unsigned long maps = 0;
+    unsigned long incomplete = 0;
+    unsigned long attempts = 0;
+    double total_milliseconds = 0;
+    double max_milliseconds = 0;
+
+    auto add(const GeneratorTotals& other) -> void {
+        maps += other.maps;
+        incomplete += other.incomplete;
+        attempts += other.attempts;
+        total_milliseconds += other.total_milliseconds;
+        max_milliseconds = std::max(max_milliseconds, other.max_milliseconds);
+    }
+};
+
+int main(int argc, char** argv) {
+    TCLAP::CmdLine cmd("Halite Map Generator", ' ', HALITE_VERSION);
+
+    TCLAP::ValueArg<unsigned int> firstSeedArg(
+        "s", "seed", "The first seed to generate a map for.",
+        false, 1, "positive integer", cmd);
+    TCLAP::ValueArg<unsigned int> countArg(
+        "c", "count", "The number of consecutive seeds to generate maps for.",
+        false, 1000, "positive integer", cmd);
+    TCLAP::ValueArg<unsigned int> nPlayersArg(
+        "n", "nplayers", "The number of players the maps are for.",
+        false, 2, "positive integer", cmd);
+    TCLAP::ValueArg<unsigned int> widthArg(
+        "", "width", "The width of the maps (default: picked from each seed, like halite does).",
+        false, 0, "positive integer", cmd);
+    TCLAP::ValueArg<unsigned int> heightArg(
+        "", "height", "The height of the maps (default: picked from each seed).",
+        false, 0, "positive integer", cmd);
+    TCLAP::ValueArg<unsigned int> threadsArg(
+        "", "threads", "Number of maps generated at once (default: one per core).",
+        false, 0, "positive integer", cmd);
+    TCLAP::ValueArg<std::string> outputArg(
+        "o", "output", "Directory to write map files to. Without one, maps are only generated.",
+        false, "", "path to directory", cmd);
+    TCLAP::ValueArg<std::string> constantsArg(
+        "", "constantsfile", "JSON file containing runtime constants to use.",
+        false, "", "path to file", cmd);
+    auto generator_names = mapgen::generator_names();
+    TCLAP::ValuesConstraint<std::string> generatorConstraint(generator_names);
+    TCLAP::MultiArg<std::string> generatorArg(
+        "g", "generator", "A map generator to run for every seed (may be repeated; default: the one games use).",
+        false, &generatorConstraint, cmd);
+
+    cmd.parse(argc, argv);
+
+    const auto num_players = nPlayersArg.getValue();
+    if (num_players < 2 || num_players > hlt::MAX_PLAYERS) {
+        std::cerr << "Maps can only be generated for 2 up to " << hlt::MAX_PLAYERS << " players.\n";
+        return 1;
+    }
+    if ((widthArg.getValue() == 0) != (heightArg.getValue() == 0)) {
+        std::cerr << "Give both --width and --height, or neither.\n";
+        return 1;
+    }
+
+    hlt::GameConstants constants;
+    if (constantsArg.isSet()) {
+        std::ifstream constants_file(constantsArg.getValue());
+        nlohmann::json constants_json;
+        constants_file >> constants_json;
+        constants.from_json(constants_json);
+    }
+
+    std::string directory = outputArg.getValue();
+#ifdef _WIN32
+    if (!directory.empty() && directory.back() != '\\') directory.push_back('\\');
+#else
+    if (!directory.empty() && directory.back() != '/') directory.push_back('/');
+#endif
+
+    auto generators = generatorArg.getValue();
+    if (generators.empty()) {
+        generators.push_back(mapgen::DEFAULT_GENERATOR);
+    }
+    for (const auto& generator : generators) {
+        if (!mapgen::supports_players(generator, num_players)) {
+            std::cerr << "The " << generator << " map generator can't make maps for "
+                      << num_players << " players.\n";
+            return 1;
+        }
+    }
+
+    const auto first_seed = firstSeedArg.getValue();
+    const auto count = countArg.getValue() * static_cast<unsigned int>(generators.size());
+    std::atomic<unsigned int> next(0);
+    std::atomic<unsigned int> write_failures(0);
+    std::map<std::string, GeneratorTotals> totals;
+    std::mutex totals_mutex;
+
+    auto generate_maps = [&]() -> void {
+        std::map<std::string, GeneratorTotals> thread_totals;
+        while (true) {
+            const auto index = next++;
+            if (index >= count) break;
+
+            const auto seed = first_seed + index / static_cast<unsigned int>(generators.size());
+            const auto& generator = generators[index % generators.size()];
+            auto size = std::make_pair(static_cast<unsigned short>(widthArg.getValue()),
+                                       static_cast<unsigned short>(heightArg.getValue()));
+            if (size.first == 0) {
+                size = mapgen::default_map_size(seed);
+            }
+            const auto key = mapgen::MapKey::current(
+                generator, seed, size.first, size.second, num_players, num_players, constants);
+
+            mapgen::Generator::Statistics statistics;
+            const auto start = std::chrono::steady_clock::now();
+            const auto map = mapgen::generate_map(key, constants, &statistics);
+            const auto milliseconds = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+
+            auto& generator_totals = thread_totals[key.generator];
+            generator_totals.maps++;
+            generator_totals.incomplete += statistics.incomplete ? 1 : 0;
+            generator_totals.attempts += statistics.attempts;
+            generator_totals.total_milliseconds += milliseconds;
+            generator_totals.max_milliseconds =
+                std::max(generator_totals.max_milliseconds, milliseconds);
+
+            if (!directory.empty()) {
+                try {
+                    mapgen::write_map_file(directory + key.file_name(), map);
+                }
+                catch (const std::runtime_error&) {
+                    write_failures++;
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(totals_mutex);
+        for (const auto& generator_totals : thread_totals) {
+            totals[generator_totals.first].add(generator_totals.second);
+        }
+    };
+
+    const auto num_threads = std::max(1U, std::min(
+        count, threadsArg.getValue() != 0
+               ? threadsArg.getValue()
+               : std::max(1U, std::thread::hardware_concurrency())));
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < num_threads; i++) {
+        workers.emplace_back(generate_maps);
+    }
+    generate_maps();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (const auto& generator_totals : totals) {
+        const auto& generator = generator_totals.second;
+        std::cout
+            << generator_totals.first << ": " << generator.maps << " maps, "
+            << generator.incomplete << " with planets left unplaced, "
+            << generator.attempts / generator.maps << " placement attempts per map, "
+            << generator.total_milliseconds / generator.maps << " ms per map (max "
+            << generator.max_milliseconds << " ms)\n";
+    }
+
+    if (write_failures > 0) {
+        std::cerr << "Could not write " << write_failures << " map files to "
+                  << outputArg.getValue() << '\n';
+        return 1;
+    }
+    return 0;
+}
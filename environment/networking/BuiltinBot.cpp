@@ -0,0 +1,104 @@
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+#include "BuiltinBot.hpp"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+const std::string BuiltinBot::PREFIX = "builtin:";
+
+namespace {
+    //! The thrust angle toward a target, in the whole degrees moves take.
+    auto degrees_to(const hlt::Location& from, const hlt::Location& to) -> unsigned short {
+        const auto degrees = static_cast<int>(std::round(from.angle_to(to) * 180 / M_PI));
+        return static_cast<unsigned short>((degrees % 360 + 360) % 360);
+    }
+
+    auto thrust_move(hlt::EntityIndex ship, unsigned short thrust,
+                     unsigned short angle) -> hlt::Move {
+        hlt::Move move = {};
+        move.type = hlt::MoveType::Thrust;
+        move.shipId = ship;
+        move.move.thrust.thrust = thrust;
+        move.move.thrust.angle = angle;
+        return move;
+    }
+
+    //! The nearest ship of another player, or nullptr if there is none.
+    auto nearest_enemy(const hlt::Map& map, hlt::PlayerId player,
+                       const hlt::Ship& ship) -> const hlt::Ship* {
+        const hlt::Ship* nearest = nullptr;
+        auto nearest_distance = std::numeric_limits<double>::infinity();
+        for (hlt::PlayerId other = 0; other < map.ships.size(); other++) {
+            if (other == player) continue;
+            for (const auto& enemy_pair : map.ships[other]) {
+                const auto distance = static_cast<double>(
+                    ship.location.distance2(enemy_pair.second.location));
+                if (distance < nearest_distance) {
+                    nearest = &enemy_pair.second;
+                    nearest_distance = distance;
+                }
+            }
+        }
+        return nearest;
+    }
+}
+
+auto BuiltinBot::policy_names() -> std::vector<std::string> {
+    return { "random", "rush", "idle" };
+}
+
+auto BuiltinBot::is_builtin(const std::string& command) -> bool {
+    return command.compare(0, PREFIX.size(), PREFIX) == 0;
+}
+
+auto BuiltinBot::policy_of(const std::string& command) -> Policy {
+    const auto name = is_builtin(command) ? command.substr(PREFIX.size()) : command;
+    if (name == "random") return Policy::Random;
+    if (name == "rush") return Policy::Rush;
+    if (name == "idle") return Policy::Idle;
+    throw std::invalid_argument("Unknown built-in bot " + command);
+}
+
+BuiltinBot::BuiltinBot(Policy policy) : policy(policy) {}
+
+auto BuiltinBot::name() const -> std::string {
+    return PREFIX + policy_names()[static_cast<size_t>(policy)];
+}
+
+auto BuiltinBot::init(hlt::PlayerId player, const hlt::Map& map) -> void {
+    engine = util::xoshiro256starstar(map.state_hash() + player);
+}
+
+auto BuiltinBot::queue_moves(hlt::PlayerId player, const hlt::Map& map,
+                             const hlt::GameConstants& constants,
+                             hlt::PlayerMoveQueue& moves) -> void {
+    if (policy == Policy::Idle) return;
+
+    const auto max_thrust = static_cast<unsigned short>(constants.MAX_ACCELERATION);
+    util::uniform_int_distribution<unsigned short> thrust_dist(0, max_thrust);
+    util::uniform_int_distribution<unsigned short> angle_dist(0, 359);
+
+    for (const auto& ship_pair : map.ships[player]) {
+        const auto id = ship_pair.first;
+        const auto& ship = ship_pair.second;
+        if (ship.docking_status != hlt::DockingStatus::Undocked) continue;
+
+        if (policy == Policy::Random) {
+            moves.push(thrust_move(id, thrust_dist(engine), angle_dist(engine)));
+            continue;
+        }
+
+        const auto target = nearest_enemy(map, player, ship);
+        if (target == nullptr) continue;
+        // Close in to half the weapon range rather than ramming
+        const auto gap = static_cast<double>(ship.location.distance(target->location)) -
+            constants.WEAPON_RADIUS / 2;
+        const auto thrust = static_cast<unsigned short>(
+            std::max(0.0, std::min<double>(max_thrust, std::floor(gap))));
+        if (thrust == 0) continue;
+        moves.push(thrust_move(id, thrust, degrees_to(ship.location, target->location)));
+    }
+}
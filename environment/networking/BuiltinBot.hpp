@@ -0,0 +1,62 @@
+#ifndef HALITE_BUILTINBOT_HPP
+#define HALITE_BUILTINBOT_HPP
+
+#include <string>
+#include <vector>
+
+#include "../core/Constants.hpp"
+#include "../core/hlt.hpp"
+#include "../core/util/distributions.hpp"
+
+/**
+ * What a bot launched as "builtin:NAME" is: a policy that moves its ships
+ * inside the engine, from the map it would have been sent, instead of a
+ * process. They are for load generation, when the bots' own time would
+ * only get in the way of measuring the engine's:
+ *
+ *     halite -d "240 160" builtin:rush builtin:rush builtin:random builtin:idle
+ */
+class BuiltinBot {
+public:
+    //! The prefix that makes a bot command a built-in bot.
+    static const std::string PREFIX;
+
+    enum class Policy {
+        //! Every ship thrusts in a random direction at a random speed.
+        Random,
+        //! Every ship heads for the nearest enemy ship at full speed, and
+        //! stops in weapon range of it, for dense combat.
+        Rush,
+        //! No moves at all.
+        Idle,
+    };
+
+    //! The names the policies go by, after the prefix.
+    static auto policy_names() -> std::vector<std::string>;
+    //! Whether a bot command names a built-in bot (known or not).
+    static auto is_builtin(const std::string& command) -> bool;
+    /**
+     * The policy a built-in bot command names. Throws
+     * std::invalid_argument if there is no such policy.
+     */
+    static auto policy_of(const std::string& command) -> Policy;
+
+    explicit BuiltinBot(Policy policy);
+
+    auto name() const -> std::string;
+    /**
+     * Start a game on the initial map. The random policy is seeded from
+     * the map and player, so that the same map plays out the same way.
+     */
+    auto init(hlt::PlayerId player, const hlt::Map& map) -> void;
+    //! Queue this turn's moves for the player's ships.
+    auto queue_moves(hlt::PlayerId player, const hlt::Map& map,
+                     const hlt::GameConstants& constants,
+                     hlt::PlayerMoveQueue& moves) -> void;
+
+private:
+    Policy policy;
+    util::xoshiro256starstar engine;
+};
+
+#endif //HALITE_BUILTINBOT_HPP
@@ -1,12 +1,23 @@
 #include "Networking.hpp"
 #include "BotInputError.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <fstream>
+#include <future>
 #include <sstream>
+#include <stdexcept>
 #include <thread>
 #include <core/hlt.hpp>
 
-std::mutex coutMutex;
+#define ZSTD_STATIC_LINKING_ONLY
+#include "../zstd-1.3.0/lib/zstd.h"
 
 std::string serializeMapSize(const hlt::Map& map) {
     std::string returnString = "";
@@ -16,45 +27,337 @@ std::string serializeMapSize(const hlt::Map& map) {
     return returnString;
 }
 
+//! Append a non-negative integer in decimal.
+static void append_integer(std::string& out, unsigned long value) {
+    char digits[24];
+    int length = 0;
+    do {
+        digits[length++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (length > 0) {
+        out += digits[--length];
+    }
+}
+
+/**
+ * Append a floating point value as the shortest decimal that parses back to
+ * the same double (trying 15, then 16, then 17 significant digits).
+ *
+ * The result is always in fixed notation with a decimal point (e.g. "64.0"
+ * rather than "64" or "6.4e1"), since some starter kits only accept that.
+ */
+static void append_decimal(std::string& out, double value) {
+    if (value == 0) {
+        out += "0.0";
+        return;
+    }
+    if (!std::isfinite(value)) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+        out += buffer;
+        return;
+    }
+
+    // Get the significant digits and exponent in scientific notation,
+    // e.g. "-1.2345e+02"
+    char buffer[32];
+    for (int precision = 15; precision <= SERIALIZATION_PRECISION; precision++) {
+        std::snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, value);
+        if (precision == SERIALIZATION_PRECISION ||
+            std::strtod(buffer, nullptr) == value) {
+            break;
+        }
+    }
+
+    const char* cursor = buffer;
+    if (*cursor == '-') {
+        out += '-';
+        cursor++;
+    }
+    char digits[24];
+    int num_digits = 0;
+    for (; *cursor != 'e'; cursor++) {
+        if (*cursor != '.') digits[num_digits++] = *cursor;
+    }
+    const int exponent = std::atoi(cursor + 1);
+    while (num_digits > 1 && digits[num_digits - 1] == '0') {
+        num_digits--;
+    }
+
+    // Lay the digits out around the decimal point
+    if (exponent < 0) {
+        out += "0.";
+        out.append(-exponent - 1, '0');
+        out.append(digits, num_digits);
+        return;
+    }
+    const int integer_digits = exponent + 1;
+    if (num_digits <= integer_digits) {
+        out.append(digits, num_digits);
+        out.append(integer_digits - num_digits, '0');
+        out += ".0";
+    }
+    else {
+        out.append(digits, integer_digits);
+        out += '.';
+        out.append(digits + integer_digits, num_digits - integer_digits);
+    }
+}
+
 std::string Networking::serialize_map(const hlt::Map& map) {
-    std::string returnString = "";
-    std::ostringstream oss;
+    std::string result;
+    serialize_map(map, result);
+    return result;
+}
+
+//! Append a ship's record, as in a text frame.
+static void append_ship(std::string& out, hlt::EntityIndex ship_id,
+                        const hlt::Ship& ship) {
+    out += ' ';
+    append_integer(out, ship_id);
+    out += ' ';
+    append_decimal(out, ship.location.pos_x);
+    out += ' ';
+    append_decimal(out, ship.location.pos_y);
+    out += ' ';
+    append_integer(out, ship.health);
+    out += ' ';
+    append_decimal(out, ship.velocity.vel_x);
+    out += ' ';
+    append_decimal(out, ship.velocity.vel_y);
+    out += ' ';
+    append_integer(out, static_cast<int>(ship.docking_status));
+    out += ' ';
+    append_integer(out, ship.docked_planet);
+    out += ' ';
+    append_integer(out, ship.docking_progress);
+    out += ' ';
+    append_integer(out, ship.weapon_cooldown);
+}
+
+//! Append a planet's record, as in a text frame.
+static void append_planet(std::string& out, hlt::EntityIndex planet_id,
+                          const hlt::Planet& planet) {
+    out += ' ';
+    append_integer(out, planet_id);
+    out += ' ';
+    append_decimal(out, planet.location.pos_x);
+    out += ' ';
+    append_decimal(out, planet.location.pos_y);
+    out += ' ';
+    append_integer(out, planet.health);
+    out += ' ';
+    append_decimal(out, planet.radius);
+    out += ' ';
+    append_integer(out, planet.docking_spots);
+    out += ' ';
+    append_integer(out, planet.current_production);
+    out += ' ';
+    append_integer(out, planet.remaining_production);
+    if (planet.owned) {
+        out += " 1 ";
+        append_integer(out, planet.owner);
+    }
+    else {
+        out += " 0 0";
+    }
+    out += ' ';
+    append_integer(out, planet.docked_ships.size());
+    for (const auto docked : planet.docked_ships) {
+        out += ' ';
+        append_integer(out, docked);
+    }
+}
+
+//! Whether a ship would be serialized any differently than before.
+static bool ship_changed(const hlt::Ship& before, const hlt::Ship& after) {
+    return static_cast<double>(before.location.pos_x) != static_cast<double>(after.location.pos_x)
+        || static_cast<double>(before.location.pos_y) != static_cast<double>(after.location.pos_y)
+        || static_cast<double>(before.velocity.vel_x) != static_cast<double>(after.velocity.vel_x)
+        || static_cast<double>(before.velocity.vel_y) != static_cast<double>(after.velocity.vel_y)
+        || before.health != after.health
+        || before.docking_status != after.docking_status
+        || before.docked_planet != after.docked_planet
+        || before.docking_progress != after.docking_progress
+        || before.weapon_cooldown != after.weapon_cooldown;
+}
+
+//! Whether a planet would be serialized any differently than before.
+static bool planet_changed(const hlt::Planet& before, const hlt::Planet& after) {
+    return static_cast<double>(before.location.pos_x) != static_cast<double>(after.location.pos_x)
+        || static_cast<double>(before.location.pos_y) != static_cast<double>(after.location.pos_y)
+        || static_cast<double>(before.radius) != static_cast<double>(after.radius)
+        || before.health != after.health
+        || before.docking_spots != after.docking_spots
+        || before.current_production != after.current_production
+        || before.remaining_production != after.remaining_production
+        || before.owned != after.owned
+        || (after.owned && before.owner != after.owner)
+        || before.docked_ships != after.docked_ships;
+}
+
+void Networking::serialize_map(const hlt::Map& map, std::string& out) {
+    serialize_text_map(map, player_count(), out);
+}
+
+void serialize_text_map(const hlt::Map& map, int num_players, std::string& out) {
+    out.clear();
 
     // Encode individual ships
-    oss << ' ' << player_count();
-    oss << std::setprecision(SERIALIZATION_PRECISION);
-    oss << std::fixed;
+    out += ' ';
+    append_integer(out, num_players);
+
+    // Ships are stored by ID already
+    for (hlt::PlayerId player_id = 0; player_id < num_players;
+         player_id++) {
+        out += ' ';
+        append_integer(out, player_id);
+
+        out += ' ';
+        append_integer(out, map.ships[player_id].size());
+
+        for (const auto& pair : map.ships[player_id]) {
+            append_ship(out, pair.first, pair.second);
+        }
+    }
 
+    auto num_planets = std::count_if(
+        map.planets.begin(),
+        map.planets.end(),
+        [](const hlt::Planet& planet) -> bool {
+            return planet.is_alive();
+        }
+    );
+
+    out += ' ';
+    append_integer(out, num_planets);
+
+    for (hlt::EntityIndex planet_id = 0; planet_id < map.planets.size();
+         planet_id++) {
+        const auto& planet = map.planets[planet_id];
+        if (!planet.is_alive()) continue;
+
+        append_planet(out, planet_id, planet);
+    }
+}
+
+void Networking::serialize_delta_map(const hlt::Map& before,
+                                     const hlt::Map& map, std::string& out) {
+    out.clear();
+
+    out += ' ';
+    append_integer(out, player_count());
+
+    // Both maps store ships by ID, so these lists come out sorted
+    std::vector<hlt::EntityIndex> removed;
+    std::vector<std::pair<hlt::EntityIndex, const hlt::Ship*>> changed;
     for (hlt::PlayerId player_id = 0; player_id < player_count();
          player_id++) {
-        oss << ' ' << (int) player_id;
+        const auto& old_ships = before.ships[player_id];
+        const auto& ships = map.ships[player_id];
 
-        auto num_ships = map.ships[player_id].size();
+        removed.clear();
+        for (const auto& pair : old_ships) {
+            if (ships.find(pair.first) == ships.end()) {
+                removed.push_back(pair.first);
+            }
+        }
 
-        oss << ' ' << num_ships;
+        changed.clear();
+        for (const auto& pair : ships) {
+            const auto old_ship = old_ships.find(pair.first);
+            if (old_ship == old_ships.end() ||
+                ship_changed(old_ship->second, pair.second)) {
+                changed.emplace_back(pair.first, &pair.second);
+            }
+        }
 
-        auto player_ships = std::vector<std::pair<hlt::EntityIndex, hlt::Ship>>(
-            map.ships[player_id].begin(),
-            map.ships[player_id].end());
-        std::sort(player_ships.begin(), player_ships.end(),
-        [](const std::pair<hlt::EntityIndex, hlt::Ship> s1,
-           const std::pair<hlt::EntityIndex, hlt::Ship> s2) -> bool {
-            return s1.first < s2.first;
-        });
+        out += ' ';
+        append_integer(out, player_id);
+        out += ' ';
+        append_integer(out, removed.size());
+        for (const auto ship_id : removed) {
+            out += ' ';
+            append_integer(out, ship_id);
+        }
+        out += ' ';
+        append_integer(out, changed.size());
+        for (const auto& pair : changed) {
+            append_ship(out, pair.first, *pair.second);
+        }
+    }
 
-        for (const auto& pair : player_ships) {
+    // Planets are never added, only destroyed
+    removed.clear();
+    std::vector<hlt::EntityIndex> changed_planets;
+    for (hlt::EntityIndex planet_id = 0; planet_id < map.planets.size();
+         planet_id++) {
+        const auto& planet = map.planets[planet_id];
+        const bool was_alive = planet_id < before.planets.size()
+            && before.planets[planet_id].is_alive();
+        if (!planet.is_alive()) {
+            if (was_alive) removed.push_back(planet_id);
+        }
+        else if (!was_alive || planet_changed(before.planets[planet_id], planet)) {
+            changed_planets.push_back(planet_id);
+        }
+    }
+
+    out += ' ';
+    append_integer(out, removed.size());
+    for (const auto planet_id : removed) {
+        out += ' ';
+        append_integer(out, planet_id);
+    }
+    out += ' ';
+    append_integer(out, changed_planets.size());
+    for (const auto planet_id : changed_planets) {
+        append_planet(out, planet_id, map.planets[planet_id]);
+    }
+}
+
+//! Append an unsigned 32-bit integer, little-endian.
+static void append_u32(std::string& out, uint32_t value) {
+    for (int byte = 0; byte < 4; byte++) {
+        out += static_cast<char>((value >> (8 * byte)) & 0xff);
+    }
+}
+
+//! Append a double as its IEEE 754 bits, little-endian.
+static void append_f64(std::string& out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int byte = 0; byte < 8; byte++) {
+        out += static_cast<char>((bits >> (8 * byte)) & 0xff);
+    }
+}
+
+void Networking::serialize_binary_map(const hlt::Map& map, std::string& out) {
+    out.clear();
+    // Length of the payload, filled in at the end
+    append_u32(out, 0);
+
+    append_u32(out, player_count());
+
+    for (hlt::PlayerId player_id = 0; player_id < player_count();
+         player_id++) {
+        append_u32(out, player_id);
+        append_u32(out, map.ships[player_id].size());
+
+        for (const auto& pair : map.ships[player_id]) {
             const auto& ship = pair.second;
 
-            oss << ' ' << pair.first;
-            oss << ' ' << ship.location.pos_x;
-            oss << ' ' << ship.location.pos_y;
-            oss << ' ' << ship.health;
-            oss << ' ' << ship.velocity.vel_x;
-            oss << ' ' << ship.velocity.vel_y;
-            oss << ' ' << static_cast<int>(ship.docking_status);
-            oss << ' ' << static_cast<int>(ship.docked_planet);
-            oss << ' ' << ship.docking_progress;
-            oss << ' ' << ship.weapon_cooldown;
+            append_u32(out, pair.first);
+            append_u32(out, ship.health);
+            append_f64(out, ship.location.pos_x);
+            append_f64(out, ship.location.pos_y);
+            append_f64(out, ship.velocity.vel_x);
+            append_f64(out, ship.velocity.vel_y);
+            append_u32(out, static_cast<uint32_t>(ship.docking_status));
+            append_u32(out, ship.docked_planet);
+            append_u32(out, ship.docking_progress);
+            append_u32(out, ship.weapon_cooldown);
         }
     }
 
@@ -66,36 +369,33 @@ std::string Networking::serialize_map(const hlt::Map& map) {
         }
     );
 
-    oss << ' ' << num_planets;
+    append_u32(out, num_planets);
 
     for (hlt::EntityIndex planet_id = 0; planet_id < map.planets.size();
          planet_id++) {
         const auto& planet = map.planets[planet_id];
         if (!planet.is_alive()) continue;
 
-        oss << ' ' << planet_id;
-        oss << ' ' << planet.location.pos_x;
-        oss << ' ' << planet.location.pos_y;
-        oss << ' ' << planet.health;
-        oss << ' ' << planet.radius;
-        oss << ' ' << planet.docking_spots;
-        oss << ' ' << planet.current_production;
-        oss << ' ' << planet.remaining_production;
-        if (planet.owned) {
-            oss << ' ' << 1 << ' ' << (int) planet.owner;
-        }
-        else {
-            oss << ' ' << 0 << ' ' << 0;
-        }
-        oss << ' ' << planet.docked_ships.size();
+        append_u32(out, planet_id);
+        append_u32(out, planet.health);
+        append_f64(out, planet.location.pos_x);
+        append_f64(out, planet.location.pos_y);
+        append_f64(out, planet.radius);
+        append_u32(out, planet.docking_spots);
+        append_u32(out, planet.current_production);
+        append_u32(out, planet.remaining_production);
+        append_u32(out, planet.owned ? 1 : 0);
+        append_u32(out, planet.owned ? planet.owner : 0);
+        append_u32(out, planet.docked_ships.size());
         for (const auto docked : planet.docked_ships) {
-            oss << ' ' << docked;
+            append_u32(out, docked);
         }
     }
 
-    returnString = oss.str();
-
-    return returnString;
+    const auto length = static_cast<uint32_t>(out.size() - 4);
+    for (int byte = 0; byte < 4; byte++) {
+        out[byte] = static_cast<char>((length >> (8 * byte)) & 0xff);
+    }
 }
 
 auto is_valid_move_character(const char& c) -> bool {
@@ -108,12 +408,49 @@ auto is_valid_move_character(const char& c) -> bool {
         || c == 'q';
 }
 
-auto eject_bot(std::string message) -> std::string {
-    if (!quiet_output) {
-        std::lock_guard<std::mutex> guard(coutMutex);
-        std::cout << message;
+/**
+ * Read an unsigned integer at the cursor, the way std::istream reads one
+ * with libstdc++: after any spaces, an optional minus sign (negating modulo
+ * 2^n), then decimal digits. If there are no digits, the value is 0; if it
+ * does not fit, the type's maximum.
+ *
+ * @return Whether the value was read without either problem.
+ */
+template<typename T>
+static bool parse_unsigned(const char*& cursor, const char* end, T& value) {
+    while (cursor != end && *cursor == ' ') cursor++;
+
+    const bool negative = cursor != end && *cursor == '-';
+    if (negative) cursor++;
+
+    const char* digits = cursor;
+    T result = 0;
+    bool overflow = false;
+    for (; cursor != end && *cursor >= '0' && *cursor <= '9'; cursor++) {
+        const T digit = static_cast<T>(*cursor - '0');
+        if (result > (std::numeric_limits<T>::max() - digit) / 10) {
+            overflow = true;
+        }
+        result = static_cast<T>(result * 10 + digit);
+    }
+
+    if (cursor == digits) {
+        value = 0;
+        return false;
     }
-    return message;
+    if (overflow) {
+        value = std::numeric_limits<T>::max();
+        return false;
+    }
+    value = negative ? static_cast<T>(-result) : result;
+    return true;
+}
+
+//! Read a field of a move, unless an earlier field could not be read.
+template<typename T>
+static void read_move_field(const char*& cursor, const char* end,
+                            bool& failed, T& value) {
+    if (!failed) failed = !parse_unsigned(cursor, end, value);
 }
 
 void Networking::deserialize_move_set(hlt::PlayerId player_tag,
@@ -134,40 +471,46 @@ void Networking::deserialize_move_set(hlt::PlayerId player_tag,
         throw BotInputError(player_tag, inputString, message, index);
     }
 
-    std::stringstream iss(inputString);
+    const char* const begin = inputString.data();
+    const char* const end = begin + inputString.size();
+    const char* cursor = begin;
 
-    hlt::Move move;
-    // Keep track of how many queued commands each ship has
-    hlt::entity_map<int> queue_depth;
+    // As with a stream, reading stops after the first field that could not
+    // be read, which becomes 0 (and any later fields of its move too)
+    bool failed = false;
 
-    char command;
-    while (iss >> command) {
+    while (!failed) {
+        while (cursor != end && *cursor == ' ') cursor++;
+        if (cursor == end) break;
+        const char command = *cursor++;
+
+        hlt::Move move = {};
         switch (command) {
             case 't': {
                 move.type = hlt::MoveType::Thrust;
-                iss >> move.shipId;
-                iss >> move.move.thrust.thrust;
-                iss >> move.move.thrust.angle;
+                read_move_field(cursor, end, failed, move.shipId);
+                read_move_field(cursor, end, failed, move.move.thrust.thrust);
+                read_move_field(cursor, end, failed, move.move.thrust.angle);
                 const auto thrust = move.move.thrust.thrust;
-                const auto max_accel = hlt::GameConstants::get().MAX_ACCELERATION;
+                const auto max_accel = constants.MAX_ACCELERATION;
                 if (thrust > max_accel) {
                     std::stringstream message;
                     message << "Invalid thrust " << move.move.thrust.thrust
                             << " for ship " << move.shipId
                             << " (maximum is " << max_accel << ").";
-                    throw BotInputError(player_tag, inputString, message.str(), iss.tellg());
+                    throw BotInputError(player_tag, inputString, message.str(), cursor - begin);
                 }
                 break;
             }
             case 'd': {
                 move.type = hlt::MoveType::Dock;
-                iss >> move.shipId;
-                iss >> move.move.dock_to;
+                read_move_field(cursor, end, failed, move.shipId);
+                read_move_field(cursor, end, failed, move.move.dock_to);
                 break;
             }
             case 'u': {
                 move.type = hlt::MoveType::Undock;
-                iss >> move.shipId;
+                read_move_field(cursor, end, failed, move.shipId);
                 break;
             }
             case 'q': {
@@ -181,158 +524,794 @@ void Networking::deserialize_move_set(hlt::PlayerId player_tag,
             default:
                 std::stringstream message;
                 message << "Unknown command " << command << " for ship " << move.shipId;
-                throw BotInputError(player_tag, inputString, message.str(), iss.tellg());
-        }
-
-        if (queue_depth.count(move.shipId) == 0) {
-            queue_depth[move.shipId] = 0;
+                throw BotInputError(player_tag, inputString, message.str(), cursor - begin);
         }
 
-        auto queue_index = queue_depth.at(move.shipId);
-        if (queue_index < hlt::MAX_QUEUED_MOVES) {
-            moves.at(queue_index)[move.shipId] = move;
-            queue_depth.at(move.shipId)++;
-        } else {
+        if (!moves.push(move)) {
             std::stringstream message;
             message << "Tried to queue too many commands for ship " << move.shipId;
-            throw BotInputError(player_tag, inputString, message.str(), iss.tellg());
+            throw BotInputError(player_tag, inputString, message.str(), cursor - begin);
+        }
+    }
+}
+
+void Networking::set_delta_base(const hlt::Map& map) {
+    delta_base = map;
+}
+
+void Networking::set_constants(const hlt::GameConstants& constants_) {
+    constants = constants_;
+}
+
+void Networking::set_quiet(bool quiet_output_) {
+    quiet_output = quiet_output_;
+}
+
+void Networking::set_log_tag(const std::string& log_tag_) {
+    log_tag = log_tag_;
+}
+
+void Networking::log(LogLevel level, const std::string& message) {
+    if (!quiet_output) ConsoleLog::instance().write(level, log_tag, message);
+}
+
+void Networking::serialize_frame(const hlt::Map& map, SerializedFrame& frame) {
+    auto uses_format = [&](FrameFormat format) -> bool {
+        return std::find(frame_formats.begin(), frame_formats.end(), format)
+            != frame_formats.end();
+    };
+
+    // Only serialize the formats some bot will actually be sent
+    if (uses_format(FrameFormat::Text)) {
+        serialize_map(map, frame.text);
+        frame.text += '\n';
+    }
+    if (uses_format(FrameFormat::Binary)) {
+        serialize_binary_map(map, frame.binary);
+    }
+    if (uses_format(FrameFormat::Delta)) {
+        // Every living bot replied to the last frame, or it would have been
+        // killed, so they all share the same base
+        serialize_delta_map(delta_base, map, frame.delta);
+        frame.delta += '\n';
+        delta_base = map;
+    }
+
+    // Once per stream, however many bots share it
+    frame.compressed.resize(compression_streams.size());
+    for (size_t i = 0; i < compression_streams.size(); i++) {
+        if (std::find(frame_compression.begin(), frame_compression.end(), static_cast<int>(i))
+            == frame_compression.end()) {
+            frame.compressed[i].clear();
+            continue;
+        }
+        auto& stream = compression_streams[i];
+        switch (stream.format) {
+            case FrameFormat::Binary:
+                compress_frame(stream, frame.binary, frame.compressed[i]);
+                break;
+            case FrameFormat::Delta:
+                compress_frame(stream, frame.delta, frame.compressed[i]);
+                break;
+            default:
+                compress_frame(stream, frame.text, frame.compressed[i]);
+                break;
+        }
+    }
+
+#ifdef HALITE_SHARED_MEMORY
+    publish_shared_frame(frame);
+#endif
+}
+
+void Networking::send_frame(hlt::PlayerId player_tag,
+                            const SerializedFrame& frame) {
+#ifdef HALITE_SHARED_MEMORY
+    if (shared_channels[player_tag].active) {
+        // serialize_frame has already published it
+        if (!shared_frame_fits) {
+            throw BotInputError(player_tag, "", "Could not fit the frame in shared memory.", 0);
+        }
+        const uint64_t signal = 1;
+        if (write(shared_channels[player_tag].frame_ready, &signal, sizeof(signal))
+            != sizeof(signal)) {
+            throw BotInputError(player_tag, "", "Could not signal the bot that its frame is ready.", 0);
+        }
+        return;
+    }
+#endif
+    start_write(player_tag, frame_for(player_tag, frame));
+}
+
+const std::string& Networking::frame_for(hlt::PlayerId player_tag,
+                                         const SerializedFrame& frame) const {
+    if (frame_compression[player_tag] >= 0) {
+        return frame.compressed[frame_compression[player_tag]];
+    }
+    switch (frame_formats[player_tag]) {
+        case FrameFormat::Binary:
+            return frame.binary;
+        case FrameFormat::Delta:
+            return frame.delta;
+        default:
+            return frame.text;
+    }
+}
+
+int Networking::compression_stream(FrameFormat format, int level) {
+    for (size_t i = 0; i < compression_streams.size(); i++) {
+        if (compression_streams[i].format == format && compression_streams[i].level == level) {
+            return static_cast<int>(i);
+        }
+    }
+
+    CompressionStream stream{ format, level, { ZSTD_createCStream(), ZSTD_freeCStream } };
+    if (stream.stream == nullptr ||
+        ZSTD_isError(ZSTD_initCStream_usingDict(stream.stream.get(), frame_dictionary.data(),
+                                                frame_dictionary.size(), level))) {
+        throw std::runtime_error("Could not start compressing frames");
+    }
+    compression_streams.push_back(std::move(stream));
+    return static_cast<int>(compression_streams.size() - 1);
+}
+
+void Networking::compress_frame(CompressionStream& stream, const std::string& frame,
+                                std::string& out) {
+    // Flushed rather than ended, so that the bot can decompress the whole
+    // frame now, and the next is still compressed against this one
+    out.resize(4 + ZSTD_compressBound(frame.size()));
+    ZSTD_inBuffer input = { frame.data(), frame.size(), 0 };
+    ZSTD_outBuffer output = { &out[4], out.size() - 4, 0 };
+    while (true) {
+        if (output.pos == output.size) {
+            out.resize(out.size() * 2);
+            output.dst = &out[4];
+            output.size = out.size() - 4;
         }
-        move = {};
+        const bool compressing = input.pos < input.size;
+        const auto result = compressing
+            ? ZSTD_compressStream(stream.stream.get(), &output, &input)
+            : ZSTD_flushStream(stream.stream.get(), &output);
+        if (ZSTD_isError(result)) {
+            throw std::runtime_error(std::string("Could not compress a frame: ") +
+                                     ZSTD_getErrorName(result));
+        }
+        if (!compressing && result == 0) break;
+    }
+
+    const auto length = static_cast<uint32_t>(output.pos);
+    for (int byte = 0; byte < 4; byte++) {
+        out[byte] = static_cast<char>((length >> (8 * byte)) & 0xff);
     }
+    out.resize(4 + output.pos);
+}
+
+void Networking::set_frame_dictionary(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    if (!file) {
+        throw std::runtime_error("Could not read the frame dictionary " + filename);
+    }
+    frame_dictionary = contents.str();
 }
 
 void Networking::send_string(hlt::PlayerId player_tag,
-                             std::string& sendString) {
-    // End message with newline character
-    sendString += '\n';
+                             const std::string& sendString,
+                             long timeout_millis) {
+    static const std::string NEWLINE = "\n";
+    start_write(player_tag, sendString, &NEWLINE);
+    finish_write(player_tag, timeout_millis);
+}
 
-#ifdef _WIN32
-    WinConnection connection = connections[player_tag];
+//! At least the given time, in whole milliseconds, for poll.
+static long ceil_millis(std::chrono::microseconds time) {
+    return static_cast<long>((time.count() + 999) / 1000);
+}
 
-    DWORD charsWritten;
-    bool success;
-    success = WriteFile(connection.write, sendString.c_str(), sendString.length(), &charsWritten, NULL);
-    if(!success || charsWritten == 0) {
-        if(!quiet_output) std::cout << "Problem writing to pipe\n";
-        throw 1;
+void Networking::start_write(hlt::PlayerId player_tag,
+                             const std::string& data,
+                             const std::string* more) {
+    if (write_pending(player_tag)) {
+        throw BotInputError(player_tag, "", "Started a write before the last one finished.", 0);
     }
-#else
-    UniConnection connection = connections[player_tag];
+    PendingWrite& pending = pending_writes[player_tag];
+    pending.data[0] = data.data();
+    pending.size[0] = data.size();
+    pending.data[1] = more == nullptr ? nullptr : more->data();
+    pending.size[1] = more == nullptr ? 0 : more->size();
+    continue_write(player_tag);
+}
+
+bool Networking::write_pending(hlt::PlayerId player_tag) const {
+    return !pending_writes[player_tag].done();
+}
 
-    ssize_t charsWritten =
-        write(connection.write, sendString.c_str(), sendString.length());
-    if (charsWritten == -1) {
-        std::stringstream error_msg;
-        if (errno == EWOULDBLOCK || errno == EAGAIN) {
-            error_msg
-                << "Could not send map to bot: blocked writing to pipe.\n"
-                << "This usually happens if the bot is not reading STDIN,\n"
-                << "or is accidentally putting all commands on newlines.";
+void Networking::continue_write(hlt::PlayerId player_tag) {
+    PendingWrite& pending = pending_writes[player_tag];
+#ifdef _WIN32
+    // One part is written at a time. WriteFile returns once what fits in
+    // the pipe is queued, and the event is signalled when it is written,
+    // whether that was at once or not.
+    PipeIo& io = *pipe_io[player_tag];
+    const HANDLE pipe = connections[player_tag].write;
+    while (!pending.done()) {
+        if (!io.writing) {
+            const int part = pending.size[0] != 0 ? 0 : 1;
+            io.write.Offset = io.write.OffsetHigh = 0;
+            if (WriteFile(pipe, pending.data[part],
+                          static_cast<DWORD>(std::min<size_t>(pending.size[part], MAXDWORD)),
+                          NULL, &io.write) || GetLastError() == ERROR_IO_PENDING) {
+                io.writing = true;
+            }
         }
-        else {
-            error_msg
-                << "Encountered an error while writing to pipe: " << errno;
+
+        DWORD written = 0;
+        if (!io.writing || !GetOverlappedResult(pipe, &io.write, &written, FALSE)) {
+            const DWORD error = GetLastError();
+            // The pipe is full: the rest waits until the bot reads some
+            if (io.writing && error == ERROR_IO_INCOMPLETE) return;
+            io.writing = false;
+            pending = PendingWrite();
+            std::stringstream error_msg;
+            error_msg << "Encountered an error while writing to pipe: " << error;
+            throw BotInputError(player_tag, "", error_msg.str(), 0);
+        }
+        io.writing = false;
+        size_t left = static_cast<size_t>(written);
+        for (int i = 0; i < 2; i++) {
+            const size_t taken = std::min(left, pending.size[i]);
+            pending.data[i] += taken;
+            pending.size[i] -= taken;
+            left -= taken;
         }
-        throw BotInputError(player_tag, "", error_msg.str(), 0);
     }
-    else if (charsWritten < sendString.length()) {
-        std::stringstream error_msg;
-        error_msg << "Could not send map to bot: could not fit map in pipe buffer.\n"
-                  << "This usually happens if the bot is not reading STDIN,\n"
-                  << "or we could not increase the pipe buffer size appropriately.";
-        throw BotInputError(player_tag, "", error_msg.str(), 0);
+#else
+    while (!pending.done()) {
+        struct iovec parts[2];
+        int count = 0;
+        for (int i = 0; i < 2; i++) {
+            if (pending.size[i] == 0) continue;
+            parts[count].iov_base = const_cast<char*>(pending.data[i]);
+            parts[count].iov_len = pending.size[i];
+            count++;
+        }
+        const ssize_t written = writev(connections[player_tag].write, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            // The pipe is full: the rest waits until the bot reads some
+            if (errno == EWOULDBLOCK || errno == EAGAIN) return;
+            const int error = errno;
+            pending = PendingWrite();
+            std::stringstream error_msg;
+            error_msg << "Encountered an error while writing to pipe: " << error;
+            throw BotInputError(player_tag, "", error_msg.str(), 0);
+        }
+        size_t left = static_cast<size_t>(written);
+        for (int i = 0; i < 2; i++) {
+            const size_t taken = std::min(left, pending.size[i]);
+            pending.data[i] += taken;
+            pending.size[i] -= taken;
+            left -= taken;
+        }
     }
 #endif
 }
 
-std::string Networking::get_string(hlt::PlayerId player_tag,
-                                   unsigned int timeout_millis) {
+#ifndef _WIN32
+//! In write_slots, for a bot with nothing left to write.
+static const size_t NO_WRITE_SLOT = static_cast<size_t>(-1);
+
+void Networking::poll_pending_writes(const std::vector<hlt::PlayerId>& waiting,
+                                     std::vector<struct pollfd>& fds,
+                                     std::vector<size_t>& write_slots) {
+    write_slots.assign(waiting.size(), NO_WRITE_SLOT);
+    for (size_t i = 0; i < waiting.size(); i++) {
+        if (!write_pending(waiting[i])) continue;
+        struct pollfd fd;
+        fd.fd = connections[waiting[i]].write;
+        fd.events = POLLOUT;
+        fd.revents = 0;
+        write_slots[i] = fds.size();
+        fds.push_back(fd);
+    }
+}
 
-    std::string newString;
-    int timeoutMillisRemaining = timeout_millis;
-    std::chrono::high_resolution_clock::time_point
-        tp = std::chrono::high_resolution_clock::now();
+std::exception_ptr Networking::continue_polled_write(hlt::PlayerId player_tag,
+                                                     const std::vector<struct pollfd>& fds,
+                                                     size_t write_slot) {
+    if (write_slot == NO_WRITE_SLOT || fds[write_slot].revents == 0) return nullptr;
+    try {
+        continue_write(player_tag);
+    }
+    catch (...) {
+        return std::current_exception();
+    }
+    return nullptr;
+}
+#endif
 
+void Networking::finish_write(hlt::PlayerId player_tag, long timeout_millis) {
+    const auto deadline = std::chrono::steady_clock::now()
+                          + std::chrono::milliseconds(timeout_millis);
+    while (write_pending(player_tag)) {
+        const long left = ceil_millis(std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - std::chrono::steady_clock::now()));
 #ifdef _WIN32
-    WinConnection connection = connections[player_tag];
+        wait_events.assign(1, pipe_io[player_tag]->write.hEvent);
+        if (left <= 0 || wait_events_with_stderr(
+                wait_events, static_cast<DWORD>(std::min<long>(left, 2147483647))) != WAIT_OBJECT_0) {
+            throw write_timeout_error(player_tag);
+        }
+#else
+        struct pollfd fd;
+        fd.fd = connections[player_tag].write;
+        fd.events = POLLOUT;
+        fd.revents = 0;
+        poll_fds.assign(1, fd);
+        const int result = left > 0
+                           ? poll_with_stderr(poll_fds, static_cast<int>(std::min<long>(left, 2147483647)))
+                           : 0;
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) throw write_timeout_error(player_tag);
+#endif
+        continue_write(player_tag);
+    }
+}
 
-    DWORD charsRead;
-    bool success;
-    char buffer;
+auto Networking::ReadBuffer::compact() -> void {
+    // Drop consumed bytes, so the buffer doesn't grow without bound
+    if (start == data.size()) {
+        data.clear();
+        start = 0;
+    }
+    else if (start > data.size() / 2) {
+        data.erase(data.begin(), data.begin() + start);
+        start = 0;
+    }
+}
 
-    // Keep reading char by char until a newline
-    while(true) {
-        timeoutMillisRemaining = timeout_millis - std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - tp).count();
-        if(timeoutMillisRemaining < 0) throw newString;
-        // Check to see that there are bytes in the pipe before reading
-        // Throw error if no bytes in alloted time
-        // Check for bytes before sampling clock, because reduces latency (vast majority the pipe is alread full)
-        DWORD bytesAvailable = 0;
-        PeekNamedPipe(connection.read, NULL, 0, NULL, &bytesAvailable, NULL);
-        if(bytesAvailable < 1) {
-            std::chrono::high_resolution_clock::time_point initialTime = std::chrono::high_resolution_clock::now();
-            while (bytesAvailable < 1) {
-                if(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - initialTime).count() > timeoutMillisRemaining) throw newString;
-                PeekNamedPipe(connection.read, NULL, 0, NULL, &bytesAvailable, NULL);
-            }
+int Networking::fill_read_buffer(hlt::PlayerId player_tag,
+                                 int timeout_millis) {
+#ifdef _WIN32
+    if (!start_read(player_tag)) return READ_FAILED;
+    wait_events.assign(1, pipe_io[player_tag]->read.hEvent);
+    if (wait_events_with_stderr(wait_events, static_cast<DWORD>(std::max(timeout_millis, 0)))
+        != WAIT_OBJECT_0) {
+        return 0;
+    }
+    return finish_read(player_tag);
+#else
+    struct pollfd fd;
+    fd.fd = input_fd(player_tag);
+    fd.events = POLLIN;
+    fd.revents = 0;
+    poll_fds.assign(1, fd);
+    const int pollResult = poll_with_stderr(poll_fds, timeout_millis);
+    if (pollResult <= 0) return pollResult;
+
+    return read_available(player_tag);
+#endif
+}
+
+#ifndef _WIN32
+int Networking::input_fd(hlt::PlayerId player_tag) const {
+#ifdef HALITE_SHARED_MEMORY
+    if (shared_channels[player_tag].active) {
+        return shared_channels[player_tag].moves_ready;
+    }
+#endif
+    return connections[player_tag].read;
+}
+
+int Networking::read_available(hlt::PlayerId player_tag) {
+    auto& buffer = read_buffers[player_tag];
+    buffer.compact();
+    const auto old_size = buffer.data.size();
+
+#ifdef HALITE_SHARED_MEMORY
+    const auto& channel = shared_channels[player_tag];
+    if (channel.active) {
+        // The bot has written its moves to its slot; hand them on as a line
+        uint64_t signals;
+        if (read(channel.moves_ready, &signals, sizeof(signals)) != sizeof(signals)) {
+            return READ_FAILED;
+        }
+        uint32_t length;
+        std::memcpy(&length, channel.moves, sizeof(length));
+        if (length > SHARED_MOVES_CAPACITY - sizeof(length)) {
+            return READ_FAILED;
+        }
+        buffer.data.insert(buffer.data.end(), channel.moves + sizeof(length),
+                           channel.moves + sizeof(length) + length);
+        buffer.data.push_back('\n');
+        return static_cast<int>(length + 1);
+    }
+#endif
+
+    buffer.data.resize(old_size + READ_CHUNK_SIZE);
+    const auto bytes_read = read(connections[player_tag].read,
+                                 &buffer.data[old_size], READ_CHUNK_SIZE);
+    if (bytes_read <= 0) {
+        buffer.data.resize(old_size);
+        return READ_FAILED;
+    }
+    buffer.data.resize(old_size + bytes_read);
+    return static_cast<int>(bytes_read);
+}
+
+void Networking::read_stderr(hlt::PlayerId player_tag) {
+    int& fd = connections[player_tag].error_read;
+    char buffer[READ_CHUNK_SIZE];
+    while (fd != -1) {
+        const ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        if (bytes > 0) {
+            stderr_captures[player_tag].append(buffer, static_cast<size_t>(bytes));
+            // The rest waits for the next poll, so a bot writing without
+            // pause can't hold up the others
+            if (static_cast<size_t>(bytes) < sizeof(buffer)) return;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        close(fd);
+        fd = -1;
+    }
+}
+
+int Networking::poll_with_stderr(std::vector<struct pollfd>& fds, int timeout_millis) {
+    const auto count = fds.size();
+    const auto deadline = std::chrono::steady_clock::now()
+                          + std::chrono::milliseconds(timeout_millis);
+    while (true) {
+        stderr_players.clear();
+        for (hlt::PlayerId player_tag = 0; player_tag < connections.size(); player_tag++) {
+            if (connections[player_tag].error_read == -1) continue;
+            struct pollfd fd;
+            fd.fd = connections[player_tag].error_read;
+            fd.events = POLLIN;
+            fd.revents = 0;
+            fds.push_back(fd);
+            stderr_players.push_back(player_tag);
         }
 
-        success = ReadFile(connection.read, &buffer, 1, &charsRead, NULL);
-        if(!success || charsRead < 1) {
-            if(!quiet_output) {
-                std::string errorMessage = "Bot #" + std::to_string(player_tag) + " timed out or errored (Windows)\n";
-                std::lock_guard<std::mutex> guard(coutMutex);
-                std::cout << errorMessage;
+        int result = poll(fds.data(), fds.size(), timeout_millis);
+        if (result > 0 && !stderr_players.empty()) {
+            for (size_t i = 0; i < stderr_players.size(); i++) {
+                if (fds[count + i].revents == 0) continue;
+                read_stderr(stderr_players[i]);
+                result--;
             }
-            throw newString;
         }
-        if(buffer == '\n') break;
-        else newString += buffer;
+        fds.resize(count);
+        if (result != 0) return result;
+
+        // Only stderr was ready: keep waiting for the rest
+        timeout_millis = static_cast<int>(ceil_millis(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now())));
+        if (timeout_millis <= 0) return 0;
     }
+}
+
+void Networking::wait_for_bots(const std::vector<hlt::PlayerId>& waiting,
+                               long timeout_millis,
+                               std::vector<std::exception_ptr>& errors) {
+    errors.assign(waiting.size(), nullptr);
+    poll_fds.clear();
+    for (const auto player_tag : waiting) {
+        struct pollfd fd;
+        fd.fd = input_fd(player_tag);
+        fd.events = POLLIN;
+        fd.revents = 0;
+        poll_fds.push_back(fd);
+    }
+    poll_pending_writes(waiting, poll_fds, poll_write_slots);
+
+    // A few bots will be waited on at most, so the linear scan is cheap
+    if (poll_with_stderr(poll_fds, static_cast<int>(std::min<long>(timeout_millis, 2147483647))) <= 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < waiting.size(); i++) {
+        const auto player_tag = waiting[i];
+        errors[i] = continue_polled_write(player_tag, poll_fds, poll_write_slots[i]);
+        if (errors[i]) continue;
+        if (poll_fds[i].revents != 0 && read_available(player_tag) == READ_FAILED) {
+            errors[i] = std::make_exception_ptr(read_failed_error(player_tag));
+        }
+    }
+}
 #else
-    UniConnection connection = connections[player_tag];
+Networking::PipeIo::PipeIo() {
+    ZeroMemory(&read, sizeof(read));
+    ZeroMemory(&write, sizeof(write));
+    ZeroMemory(&error, sizeof(error));
+    // Manual reset: ReadFile and WriteFile reset them when they start
+    read.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    write.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    error.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+Networking::PipeIo::~PipeIo() {
+    for (const HANDLE event : { read.hEvent, write.hEvent, error.hEvent }) {
+        if (event != NULL) CloseHandle(event);
+    }
+}
+
+bool Networking::start_read(hlt::PlayerId player_tag) {
+    PipeIo& io = *pipe_io[player_tag];
+    if (io.reading) return true;
+    io.read.Offset = io.read.OffsetHigh = 0;
+    // Whether the read finishes now or later, the event says when
+    io.reading = ReadFile(connections[player_tag].read, io.chunk, READ_CHUNK_SIZE,
+                          NULL, &io.read) || GetLastError() == ERROR_IO_PENDING;
+    return io.reading;
+}
+
+int Networking::finish_read(hlt::PlayerId player_tag) {
+    PipeIo& io = *pipe_io[player_tag];
+    DWORD bytes_read = 0;
+    const bool success = GetOverlappedResult(connections[player_tag].read, &io.read,
+                                             &bytes_read, FALSE);
+    if (!success && GetLastError() == ERROR_IO_INCOMPLETE) return 0;
+    io.reading = false;
+    if (!success || bytes_read == 0) return READ_FAILED;
+
+    auto& buffer = read_buffers[player_tag];
+    buffer.compact();
+    buffer.data.insert(buffer.data.end(), io.chunk, io.chunk + bytes_read);
+    return static_cast<int>(bytes_read);
+}
 
-    fd_set set;
-    FD_ZERO(&set); /* clear the set */
-    if (connection.read > FD_SETSIZE) assert(false);
-    FD_SET(connection.read, &set); /* add our file descriptor to the set */
-    char buffer;
+void Networking::cancel_io(hlt::PlayerId player_tag) {
+    if (pipe_io[player_tag] == nullptr) return;
+    PipeIo& io = *pipe_io[player_tag];
+    const WinConnection& connection = connections[player_tag];
+    DWORD bytes = 0;
+    if (io.writing) {
+        CancelIoEx(connection.write, &io.write);
+        GetOverlappedResult(connection.write, &io.write, &bytes, TRUE);
+        io.writing = false;
+    }
+    // A read that finished before it could be cancelled still counts
+    if (io.reading) {
+        CancelIoEx(connection.read, &io.read);
+        if (GetOverlappedResult(connection.read, &io.read, &bytes, TRUE) && bytes > 0) {
+            auto& buffer = read_buffers[player_tag];
+            buffer.data.insert(buffer.data.end(), io.chunk, io.chunk + bytes);
+        }
+        io.reading = false;
+    }
+    if (io.error_reading) {
+        CancelIoEx(connection.error_read, &io.error);
+        if (GetOverlappedResult(connection.error_read, &io.error, &bytes, TRUE) && bytes > 0) {
+            stderr_captures[player_tag].append(io.error_chunk, bytes);
+        }
+        io.error_reading = false;
+    }
+}
 
-    // Keep reading char by char until a newline
+void Networking::continue_stderr(hlt::PlayerId player_tag) {
+    PipeIo& io = *pipe_io[player_tag];
+    HANDLE& pipe = connections[player_tag].error_read;
+    if (pipe == NULL) return;
+    if (io.error_reading) {
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(pipe, &io.error, &bytes, FALSE)) {
+            if (GetLastError() == ERROR_IO_INCOMPLETE) return;
+            bytes = 0;
+        }
+        io.error_reading = false;
+        if (bytes == 0) {
+            CloseHandle(pipe);
+            pipe = NULL;
+            return;
+        }
+        stderr_captures[player_tag].append(io.error_chunk, bytes);
+    }
+
+    // Only one read at a time, so a bot writing without pause can't hold
+    // up the others
+    io.error.Offset = io.error.OffsetHigh = 0;
+    if (!ReadFile(pipe, io.error_chunk, READ_CHUNK_SIZE, NULL, &io.error) &&
+        GetLastError() != ERROR_IO_PENDING) {
+        CloseHandle(pipe);
+        pipe = NULL;
+        return;
+    }
+    io.error_reading = true;
+}
+
+DWORD Networking::wait_events_with_stderr(std::vector<HANDLE>& events, DWORD timeout_millis) {
+    const auto count = events.size();
+    const auto deadline = std::chrono::steady_clock::now()
+                          + std::chrono::milliseconds(timeout_millis);
     while (true) {
+        for (hlt::PlayerId player_tag = 0; player_tag < connections.size(); player_tag++) {
+            if (pipe_io[player_tag] == nullptr) continue;
+            if (!pipe_io[player_tag]->error_reading) continue_stderr(player_tag);
+            if (pipe_io[player_tag]->error_reading) {
+                events.push_back(pipe_io[player_tag]->error.hEvent);
+            }
+        }
 
-        // Check if there are bytes in the pipe
-        timeoutMillisRemaining = timeout_millis
-            - std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::high_resolution_clock::now() - tp).count();
-        if (timeoutMillisRemaining < 0) throw newString;
-        struct timeval timeout;
-        timeout.tv_sec = timeoutMillisRemaining / 1000.0;
-        timeout.tv_usec = (timeoutMillisRemaining % 1000) * 1000;
-        int selectionResult =
-            select(connection.read + 1, &set, NULL, NULL, &timeout);
+        const DWORD result = WaitForMultipleObjects(
+            static_cast<DWORD>(events.size()), events.data(), FALSE, timeout_millis);
+        events.resize(count);
+        if (result == WAIT_TIMEOUT || result == WAIT_FAILED || result < WAIT_OBJECT_0 + count) {
+            return result;
+        }
 
-        if (selectionResult > 0) {
-            const size_t bytes_read = read(connection.read, &buffer, 1);
-            if (bytes_read != 1) {
-                throw BotInputError(player_tag, newString, std::string(
-                    "Panic: select() was positive but read() for 1 byte did not return 1."), 0);
+        // Only stderr was ready: keep what came, and keep waiting for the rest
+        for (hlt::PlayerId player_tag = 0; player_tag < connections.size(); player_tag++) {
+            if (pipe_io[player_tag] != nullptr && pipe_io[player_tag]->error_reading &&
+                HasOverlappedIoCompleted(&pipe_io[player_tag]->error)) {
+                continue_stderr(player_tag);
             }
+        }
+        const long left = ceil_millis(std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - std::chrono::steady_clock::now()));
+        if (left <= 0) return WAIT_TIMEOUT;
+        timeout_millis = static_cast<DWORD>(left);
+    }
+}
 
-            if (buffer == '\n') break;
-            else newString += buffer;
+void Networking::wait_for_bots(const std::vector<hlt::PlayerId>& waiting,
+                               long timeout_millis,
+                               std::vector<std::exception_ptr>& errors) {
+    errors.assign(waiting.size(), nullptr);
+    // At most three events (with stderr) for each of hlt::MAX_PLAYERS
+    // bots, within MAXIMUM_WAIT_OBJECTS
+    wait_events.clear();
+    bool failed = false;
+    for (size_t i = 0; i < waiting.size(); i++) {
+        const auto player_tag = waiting[i];
+        if (!start_read(player_tag)) {
+            errors[i] = std::make_exception_ptr(read_failed_error(player_tag));
+            failed = true;
+            continue;
         }
-        else {
-            std::stringstream error_msg;
-            error_msg << "Timeout reading commands for bot; select() result: "
-                      << selectionResult
-                      << " (max time: " << timeout_millis << " milliseconds).";
-            throw BotInputError(player_tag, newString, error_msg.str(), 0);
+        wait_events.push_back(pipe_io[player_tag]->read.hEvent);
+        if (write_pending(player_tag)) wait_events.push_back(pipe_io[player_tag]->write.hEvent);
+    }
+    if (failed) return;
+
+    const DWORD result = wait_events_with_stderr(
+        wait_events, static_cast<DWORD>(std::max<long>(0, std::min<long>(timeout_millis, 2147483647))));
+    if (result == WAIT_TIMEOUT || result == WAIT_FAILED) return;
+
+    // Only the first event signalled is reported, so check on every bot
+    for (size_t i = 0; i < waiting.size(); i++) {
+        const auto player_tag = waiting[i];
+        PipeIo& io = *pipe_io[player_tag];
+        if (io.writing && HasOverlappedIoCompleted(&io.write)) {
+            try {
+                continue_write(player_tag);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+                continue;
+            }
+        }
+        if (io.reading && HasOverlappedIoCompleted(&io.read) && finish_read(player_tag) == READ_FAILED) {
+            errors[i] = std::make_exception_ptr(read_failed_error(player_tag));
         }
     }
+}
 #endif
+
+bool Networking::take_buffered_line(hlt::PlayerId player_tag, std::string& line) {
+    auto& buffer = read_buffers[player_tag];
+    const auto available = buffer.data.size() - buffer.start;
+    const char* begin = buffer.data.data() + buffer.start;
+    const auto newline = available == 0 ? nullptr : static_cast<const char*>(
+        std::memchr(begin, '\n', available));
+    if (newline == nullptr) return false;
+
+    line.assign(begin, newline);
+    buffer.start += newline - begin + 1;
     // Python turns \n into \r\n
-    if (newString.back() == '\r') newString.pop_back();
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    return true;
+}
+
+std::string Networking::take_buffered_input(hlt::PlayerId player_tag) {
+    auto& buffer = read_buffers[player_tag];
+    std::string result(buffer.data.begin() + buffer.start, buffer.data.end());
+    buffer.data.clear();
+    buffer.start = 0;
+    return result;
+}
+
+auto Networking::StderrCapture::append(const char* data, size_t size) -> void {
+    total += size;
+    // Of a long write, only the end is kept
+    if (size >= STDERR_CAPTURE_SIZE) {
+        ring.assign(data + size - STDERR_CAPTURE_SIZE, data + size);
+        next = 0;
+        return;
+    }
+    if (ring.size() < STDERR_CAPTURE_SIZE) {
+        const size_t taken = std::min(size, STDERR_CAPTURE_SIZE - ring.size());
+        ring.insert(ring.end(), data, data + taken);
+        data += taken;
+        size -= taken;
+    }
+    while (size > 0) {
+        const size_t taken = std::min(size, STDERR_CAPTURE_SIZE - next);
+        std::memcpy(&ring[next], data, taken);
+        next = (next + taken) % STDERR_CAPTURE_SIZE;
+        data += taken;
+        size -= taken;
+    }
+}
+
+auto Networking::StderrCapture::contents() const -> std::string {
+    // Until the ring is full, next stays at the start
+    std::string result(ring.begin() + next, ring.end());
+    result.append(ring.begin(), ring.begin() + next);
+    return result;
+}
+
+std::string Networking::stderr_output(hlt::PlayerId player_tag, uint64_t* dropped) const {
+    if (player_tag >= stderr_captures.size()) {
+        if (dropped != nullptr) *dropped = 0;
+        return std::string();
+    }
+    const auto& capture = stderr_captures[player_tag];
+    if (dropped != nullptr) *dropped = capture.total - capture.ring.size();
+    return capture.contents();
+}
+
+BotInputError Networking::timeout_error(hlt::PlayerId player_tag,
+                                        int poll_result, int timeout_millis) {
+    std::stringstream error_msg;
+    error_msg << "Timeout reading commands for bot; poll() result: "
+              << poll_result
+              << " (max time: " << timeout_millis << " milliseconds).";
+    return BotInputError(player_tag, take_buffered_input(player_tag), error_msg.str(), 0);
+}
+
+BotInputError Networking::write_timeout_error(hlt::PlayerId player_tag) {
+#ifdef _WIN32
+    cancel_io(player_tag);
+#endif
+    pending_writes[player_tag] = PendingWrite();
+    std::stringstream error_msg;
+    error_msg << "Timeout sending the frame to bot: blocked writing to pipe.\n"
+              << "This usually happens if the bot is not reading STDIN,\n"
+              << "or is accidentally putting all commands on newlines.";
+    return BotInputError(player_tag, take_buffered_input(player_tag), error_msg.str(), 0);
+}
+
+BotInputError Networking::read_failed_error(hlt::PlayerId player_tag) {
+    return BotInputError(player_tag, take_buffered_input(player_tag), std::string(
+        "Panic: poll() was positive but read() did not return any data."), 0);
+}
+
+std::string Networking::get_string(hlt::PlayerId player_tag,
+                                   unsigned int timeout_millis) {
+
+    std::string newString;
+    int timeoutMillisRemaining = timeout_millis;
+    std::chrono::high_resolution_clock::time_point
+        tp = std::chrono::high_resolution_clock::now();
+
+    // Keep reading chunks until there is a newline
+    while (!take_buffered_line(player_tag, newString)) {
+
+        timeoutMillisRemaining = timeout_millis
+            - std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - tp).count();
+        if (timeoutMillisRemaining < 0) throw take_buffered_input(player_tag);
+
+        const int readResult = fill_read_buffer(player_tag, timeoutMillisRemaining);
+        if (readResult > 0) continue;
+
+        if (readResult == READ_FAILED) throw read_failed_error(player_tag);
+        throw timeout_error(player_tag, readResult, timeout_millis);
+    }
 
     return newString;
 }
@@ -355,31 +1334,358 @@ std::string Networking::read_trailing_input(hlt::PlayerId player_tag, long max_l
 }
 
 
+#ifdef HALITE_SHARED_MEMORY
+//! Create an anonymous shared memory file of the given size, and map it.
+static char* map_shared_file(const char* name, size_t size, int& fd) {
+    fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd == -1) return nullptr;
+    if (ftruncate(fd, size) == -1) {
+        close(fd);
+        fd = -1;
+        return nullptr;
+    }
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        fd = -1;
+        return nullptr;
+    }
+    return static_cast<char*>(data);
+}
+
+bool Networking::enable_shared_memory() {
+    if (shared_frame != nullptr) return true;
+
+    int fd;
+    shared_frame = map_shared_file("halite-frame", SHARED_FRAME_CAPACITY, fd);
+    if (shared_frame == nullptr) return false;
+
+    // Bots only get to read the frame
+    const auto path = "/proc/self/fd/" + std::to_string(fd);
+    shared_frame_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    close(fd);
+    if (shared_frame_fd == -1) {
+        munmap(shared_frame, SHARED_FRAME_CAPACITY);
+        shared_frame = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Networking::publish_shared_frame(const SerializedFrame& frame) {
+    if (shared_frame == nullptr ||
+        std::none_of(shared_channels.begin(), shared_channels.end(),
+                     [](const SharedChannel& channel) { return channel.active; })) {
+        return;
+    }
+
+    SharedFrameHeader header;
+    header.sequence = ++shared_frame_sequence;
+    uint32_t offset = sizeof(header);
+    shared_frame_fits = offset + frame.text.size() + frame.binary.size()
+        + frame.delta.size() <= SHARED_FRAME_CAPACITY;
+    if (!shared_frame_fits) return;
+
+    auto place = [&](const std::string& section, uint32_t& section_offset,
+                     uint32_t& section_length) {
+        std::memcpy(shared_frame + offset, section.data(), section.size());
+        section_offset = offset;
+        section_length = static_cast<uint32_t>(section.size());
+        offset += section_length;
+    };
+    place(frame.text, header.text_offset, header.text_length);
+    place(frame.binary, header.binary_offset, header.binary_length);
+    place(frame.delta, header.delta_offset, header.delta_length);
+    std::memcpy(shared_frame, &header, sizeof(header));
+}
+
+void Networking::close_shared_channel(hlt::PlayerId player_tag) {
+    auto& channel = shared_channels[player_tag];
+    if (channel.moves != nullptr) munmap(channel.moves, SHARED_MOVES_CAPACITY);
+    for (const auto fd : { channel.moves_fd, channel.frame_ready, channel.moves_ready }) {
+        if (fd != -1) close(fd);
+    }
+    channel = SharedChannel();
+
+    // Once every bot is gone, so is the frame
+    if (shared_frame != nullptr &&
+        std::all_of(processes.begin(), processes.end(),
+                    [](int process) { return process == -1; })) {
+        munmap(shared_frame, SHARED_FRAME_CAPACITY);
+        close(shared_frame_fd);
+        shared_frame = nullptr;
+        shared_frame_fd = -1;
+    }
+}
+#endif
+
+#ifndef _WIN32
+//! The process of a remote bot (see Networking::accept_remote_bots), which
+//! has none here to signal or reap.
+static constexpr int REMOTE_PROCESS = -2;
+//! The longest token line a remote bot may send.
+static constexpr size_t MAX_TOKEN_LINE = 4096;
+
+bool remove_socket_file(const std::string& path) {
+    struct stat status;
+    if (lstat(path.c_str(), &status) == -1) return errno == ENOENT;
+    if (!S_ISSOCK(status.st_mode)) return false;
+    return unlink(path.c_str()) == 0 || errno == ENOENT;
+}
+
+int listen_socket(const std::string& address, std::string& unix_path, bool& tcp) {
+    const std::string unix_prefix = "unix:";
+    int fd = -1;
+    if (address.compare(0, unix_prefix.size(), unix_prefix) == 0) {
+        sockaddr_un unix_address;
+        std::memset(&unix_address, 0, sizeof(unix_address));
+        unix_path = address.substr(unix_prefix.size());
+        if (unix_path.empty() || unix_path.size() >= sizeof(unix_address.sun_path)) {
+            throw std::runtime_error("Invalid socket path: " + unix_path);
+        }
+        unix_address.sun_family = AF_UNIX;
+        std::memcpy(unix_address.sun_path, unix_path.c_str(), unix_path.size());
+
+        // Replace a socket left behind by an earlier game, but nothing else
+        if (!remove_socket_file(unix_path)) {
+            throw std::runtime_error("Not listening on " + unix_path + ", which is not a socket.");
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd != -1 &&
+            (bind(fd, reinterpret_cast<sockaddr*>(&unix_address), sizeof(unix_address)) == -1 ||
+             listen(fd, SOMAXCONN) == -1)) {
+            close(fd);
+            fd = -1;
+        }
+        tcp = false;
+    }
+    else {
+        const auto colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::runtime_error("Invalid address (expected HOST:PORT or unix:PATH): " + address);
+        }
+        auto host = address.substr(0, colon);
+        const auto port = address.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+
+        // Only numeric addresses, as looking names up would need the
+        // system's resolver libraries at run time, which a static build
+        // can't bring along
+        char* port_end = nullptr;
+        const auto port_number = std::strtoul(port.c_str(), &port_end, 10);
+        if (port.empty() || *port_end != '\0' || port_number > 65535) {
+            throw std::runtime_error("Invalid port in " + address);
+        }
+        if (host == "localhost") host = "127.0.0.1";
+
+        sockaddr_in ipv4;
+        std::memset(&ipv4, 0, sizeof(ipv4));
+        ipv4.sin_family = AF_INET;
+        ipv4.sin_port = htons(static_cast<uint16_t>(port_number));
+        sockaddr_in6 ipv6;
+        std::memset(&ipv6, 0, sizeof(ipv6));
+        ipv6.sin6_family = AF_INET6;
+        ipv6.sin6_port = htons(static_cast<uint16_t>(port_number));
+        // Every interface is tried as IPv4, then IPv6
+        std::vector<std::pair<sockaddr*, socklen_t>> candidates;
+        if (host.empty() || host == "*") {
+            ipv4.sin_addr.s_addr = htonl(INADDR_ANY);
+            ipv6.sin6_addr = in6addr_any;
+            candidates.emplace_back(reinterpret_cast<sockaddr*>(&ipv4), sizeof(ipv4));
+            candidates.emplace_back(reinterpret_cast<sockaddr*>(&ipv6), sizeof(ipv6));
+        }
+        else if (inet_pton(AF_INET, host.c_str(), &ipv4.sin_addr) == 1) {
+            candidates.emplace_back(reinterpret_cast<sockaddr*>(&ipv4), sizeof(ipv4));
+        }
+        else if (inet_pton(AF_INET6, host.c_str(), &ipv6.sin6_addr) == 1) {
+            candidates.emplace_back(reinterpret_cast<sockaddr*>(&ipv6), sizeof(ipv6));
+        }
+        else {
+            throw std::runtime_error("Invalid host in " + address +
+                                     " (expected an IP address, localhost or *)");
+        }
+
+        for (const auto& candidate : candidates) {
+            if (fd != -1) break;
+            fd = socket(candidate.first->sa_family, SOCK_STREAM, 0);
+            if (fd == -1) continue;
+            const int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (bind(fd, candidate.first, candidate.second) == -1 ||
+                listen(fd, SOMAXCONN) == -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        tcp = true;
+    }
+
+    if (fd == -1) {
+        throw std::runtime_error("Could not listen on " + address + ": " + std::strerror(errno));
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+/**
+ * Split a bot command into words for BotSandbox::direct_exec: words are
+ * separated by whitespace, and single or double quotes keep what they
+ * enclose (including whitespace) in one word.
+ */
+static std::vector<std::string> split_command(const std::string& command) {
+    std::vector<std::string> words;
+    std::string word;
+    bool in_word = false;
+    char quote = 0;
+    for (const char c : command) {
+        if (quote != 0) {
+            if (c == quote) quote = 0;
+            else word += c;
+        }
+        else if (c == '\'' || c == '"') {
+            quote = c;
+            in_word = true;
+        }
+        else if (std::isspace(static_cast<unsigned char>(c))) {
+            if (in_word) words.push_back(std::move(word));
+            word.clear();
+            in_word = false;
+        }
+        else {
+            word += c;
+            in_word = true;
+        }
+    }
+    if (in_word) words.push_back(std::move(word));
+    return words;
+}
+#endif
+
+#ifdef __linux__
+/**
+ * The CPU time used by every process in a process group, including the
+ * children they have waited for, in seconds; -1 if /proc can't be read.
+ */
+static double process_group_cpu_time(pid_t group) {
+    DIR* proc = opendir("/proc");
+    if (proc == nullptr) return -1;
+
+    unsigned long long ticks = 0;
+    while (const dirent* entry = readdir(proc)) {
+        if (!std::isdigit(static_cast<unsigned char>(entry->d_name[0]))) continue;
+
+        std::ifstream stat(std::string("/proc/") + entry->d_name + "/stat");
+        std::string line;
+        if (!std::getline(stat, line)) continue;
+        // The command name is in parentheses and may contain anything,
+        // so the fields are counted from the last closing one.
+        const auto name_end = line.rfind(')');
+        if (name_end == std::string::npos) continue;
+        std::istringstream fields(line.substr(name_end + 1));
+        std::string state;
+        long parent, process_group;
+        fields >> state >> parent >> process_group;
+        if (!fields || process_group != group) continue;
+
+        // Skip session, tty_nr, tpgid, flags and the four fault counts
+        std::string skipped;
+        for (int i = 0; i < 8; i++) fields >> skipped;
+        unsigned long long utime, stime, cutime, cstime;
+        if (fields >> utime >> stime >> cutime >> cstime) {
+            ticks += utime + stime + cutime + cstime;
+        }
+    }
+    closedir(proc);
+    return static_cast<double>(ticks) / sysconf(_SC_CLK_TCK);
+}
+#endif
+
+#ifdef _WIN32
+/**
+ * Create a pipe between us and a bot. Anonymous pipes can't do overlapped
+ * I/O, so this is a named pipe, which only our end is opened for; the
+ * bot's end is inherited, and ours isn't.
+ *
+ * @param inbound Whether we read from the pipe, rather than write to it.
+ * @return Whether both ends could be opened.
+ */
+static bool create_overlapped_pipe(bool inbound, SECURITY_ATTRIBUTES* child_attributes,
+                                   HANDLE& ours, HANDLE& childs) {
+    static std::atomic<unsigned long> pipe_serial(0);
+    char name[MAX_PATH];
+    std::snprintf(name, sizeof(name), "\\\\.\\pipe\\halite-%lu-%lu",
+                  static_cast<unsigned long>(GetCurrentProcessId()), pipe_serial++);
+
+    // The same buffer size as a Linux pipe
+    const DWORD buffer_size = 65536;
+    ours = CreateNamedPipeA(
+        name,
+        (inbound ? PIPE_ACCESS_INBOUND : PIPE_ACCESS_OUTBOUND)
+            | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        1, buffer_size, buffer_size, 0, NULL);
+    if (ours == INVALID_HANDLE_VALUE) {
+        ours = NULL;
+        return false;
+    }
+    childs = CreateFileA(name, inbound ? GENERIC_WRITE : GENERIC_READ, 0,
+                         child_attributes, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (childs == INVALID_HANDLE_VALUE) {
+        CloseHandle(ours);
+        ours = childs = NULL;
+        return false;
+    }
+    return true;
+}
+#endif
+
 void Networking::launch_bot(std::string command) {
+    if (BuiltinBot::is_builtin(command)) {
+        add_builtin_bot(command);
+        return;
+    }
+
 #ifdef _WIN32
 
     command = "/C " + command;
 
-    WinConnection parentConnection, childConnection;
+    WinConnection connection;
 
     SECURITY_ATTRIBUTES saAttr;
     saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
     saAttr.bInheritHandle = TRUE;
     saAttr.lpSecurityDescriptor = NULL;
 
-    // Child stdout pipe
-    if(!CreatePipe(&parentConnection.read, &childConnection.write, &saAttr, 0)) {
-        if(!quiet_output) std::cout << "Could not create pipe\n";
+    // Child stdout pipe, child stdin pipe, then child stderr pipe
+    HANDLE child_error;
+    if (!create_overlapped_pipe(true, &saAttr, connection.read, connection.child_write) ||
+        !create_overlapped_pipe(false, &saAttr, connection.write, connection.child_read) ||
+        !create_overlapped_pipe(true, &saAttr, connection.error_read, child_error)) {
+        log(LogLevel::Error, "Could not create pipe");
         throw 1;
     }
-    if(!SetHandleInformation(parentConnection.read, HANDLE_FLAG_INHERIT, 0)) throw 1;
 
-    // Child stdin pipe
-    if(!CreatePipe(&childConnection.read, &parentConnection.write, &saAttr, 0)) {
-        if(!quiet_output) std::cout << "Could not create pipe\n";
+    // Killing the job kills the bot too, not just cmd.exe; so does the
+    // engine exiting, as the job is closed then
+    HANDLE job = CreateJobObject(NULL, NULL);
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+    ZeroMemory(&limits, sizeof(limits));
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    for (const auto cpu : sandbox.cpu_domain) {
+        if (cpu < static_cast<int>(sizeof(ULONG_PTR) * 8)) {
+            limits.BasicLimitInformation.Affinity |= ULONG_PTR(1) << cpu;
+        }
+    }
+    if (limits.BasicLimitInformation.Affinity != 0) {
+        limits.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_AFFINITY;
+    }
+    if (job == NULL || !SetInformationJobObject(job, JobObjectExtendedLimitInformation,
+                                                &limits, sizeof(limits))) {
+        log(LogLevel::Error, "Could not create job object");
         throw 1;
     }
-    if(!SetHandleInformation(parentConnection.write, HANDLE_FLAG_INHERIT, 0)) throw 1;
 
     // MAKE SURE THIS MEMORY IS ERASED
     PROCESS_INFORMATION piProcInfo;
@@ -388,9 +1694,9 @@ void Networking::launch_bot(std::string command) {
     STARTUPINFO siStartInfo;
     ZeroMemory(&siStartInfo, sizeof(STARTUPINFO));
     siStartInfo.cb = sizeof(STARTUPINFO);
-    siStartInfo.hStdError = childConnection.write;
-    siStartInfo.hStdOutput = childConnection.write;
-    siStartInfo.hStdInput = childConnection.read;
+    siStartInfo.hStdError = child_error;
+    siStartInfo.hStdOutput = connection.child_write;
+    siStartInfo.hStdInput = connection.child_read;
     siStartInfo.dwFlags |= STARTF_USESTDHANDLES;
 
     // C:/xampp/htdocs/Halite/Halite/Debug/ExampleBot.exe
@@ -402,43 +1708,132 @@ void Networking::launch_bot(std::string command) {
         NULL,          // process security attributes
         NULL,          // primary thread security attributes
         TRUE,          // handles are inherited
-        0,             // creation flags
+        CREATE_SUSPENDED, // started once it is in the job
         NULL,          // use parent's environment
         NULL,          // use parent's current directory
         &siStartInfo,  // STARTUPINFO pointer
         &piProcInfo
     ); // receives PROCESS_INFORMATION
+    if (success && !AssignProcessToJobObject(job, piProcInfo.hProcess)) {
+        TerminateProcess(piProcInfo.hProcess, 0);
+        CloseHandle(piProcInfo.hProcess);
+        CloseHandle(piProcInfo.hThread);
+        success = false;
+    }
     if(!success) {
-        if(!quiet_output) std::cout << "Could not start process\n";
+        log(LogLevel::Error, "Could not start process");
         throw 1;
     }
     else {
+        ResumeThread(piProcInfo.hThread);
         CloseHandle(piProcInfo.hProcess);
         CloseHandle(piProcInfo.hThread);
+        // Only the bot writes to its stderr, so it ends when the bot exits
+        CloseHandle(child_error);
 
-        processes.push_back(piProcInfo.hProcess);
-        connections.push_back(parentConnection);
+        processes.push_back(job);
+        connections.push_back(connection);
+        pipe_io.emplace_back(new PipeIo());
     }
 
 #else
 
-    if (!quiet_output) std::cout << command << std::endl;
+    log(LogLevel::Info, command);
+
+    // A bot that exits while we write to it must only fail that write
+    // (with EPIPE), not kill the process and every other game in it.
+    static std::once_flag ignore_sigpipe;
+    std::call_once(ignore_sigpipe, []() { signal(SIGPIPE, SIG_IGN); });
 
     pid_t pid;
     int writePipe[2];
     int readPipe[2];
+    int errorPipe[2];
 
+    // Close the pipes on exec, so that bots launched concurrently (batch
+    // mode) don't inherit each other's pipes. dup2 clears the flag on
+    // the bot's own stdin, stdout and stderr.
+#ifdef __linux__
+    if (pipe2(writePipe, O_CLOEXEC)) {
+        log(LogLevel::Error, "Error creating pipe");
+        throw 1;
+    }
+    if (pipe2(readPipe, O_CLOEXEC)) {
+        log(LogLevel::Error, "Error creating pipe");
+        throw 1;
+    }
+    if (pipe2(errorPipe, O_CLOEXEC)) {
+        log(LogLevel::Error, "Error creating pipe");
+        throw 1;
+    }
+#else
     if (pipe(writePipe)) {
-        if (!quiet_output) std::cout << "Error creating pipe\n";
+        log(LogLevel::Error, "Error creating pipe");
         throw 1;
     }
     if (pipe(readPipe)) {
-        if (!quiet_output) std::cout << "Error creating pipe\n";
+        log(LogLevel::Error, "Error creating pipe");
+        throw 1;
+    }
+    if (pipe(errorPipe)) {
+        log(LogLevel::Error, "Error creating pipe");
         throw 1;
     }
+    for (const auto fd : { writePipe[0], writePipe[1], readPipe[0], readPipe[1],
+                           errorPipe[0], errorPipe[1] }) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
 
-    // Make the write pipe nonblocking
+    // Make the write pipe nonblocking, and the stderr pipe, which is
+    // drained of whatever is there whenever the bots are waited on
     fcntl(writePipe[1], F_SETFL, O_NONBLOCK);
+    fcntl(errorPipe[0], F_SETFL, O_NONBLOCK);
+
+#ifdef HALITE_SHARED_MEMORY
+    SharedChannel channel;
+    std::string channel_description;
+    if (shared_frame != nullptr) {
+        channel.moves = map_shared_file("halite-moves", SHARED_MOVES_CAPACITY, channel.moves_fd);
+        channel.frame_ready = eventfd(0, EFD_CLOEXEC);
+        channel.moves_ready = eventfd(0, EFD_CLOEXEC);
+        if (channel.moves == nullptr || channel.frame_ready == -1 || channel.moves_ready == -1) {
+            log(LogLevel::Error, "Error creating shared memory channel");
+            throw 1;
+        }
+        channel_description = std::to_string(shared_frame_fd) + ' ' +
+            std::to_string(channel.moves_fd) + ' ' +
+            std::to_string(channel.frame_ready) + ' ' +
+            std::to_string(channel.moves_ready);
+    }
+#endif
+
+    // Everything the child needs is prepared before forking: other
+    // threads (batch mode) may hold locks the child could never take.
+    std::vector<std::string> words;
+    std::vector<char*> argv;
+    if (sandbox.direct_exec) {
+        words = split_command(command);
+        if (words.empty()) {
+            log(LogLevel::Error, "Empty bot command");
+            throw 1;
+        }
+        for (auto& word : words) argv.push_back(&word[0]);
+        argv.push_back(nullptr);
+    }
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (!sandbox.cpus.empty()) {
+        static std::atomic<size_t> next_cpu{0};
+        CPU_SET(sandbox.cpus[next_cpu++ % sandbox.cpus.size()], &cpu_set);
+    }
+    else {
+        for (const auto cpu : sandbox.cpu_domain) {
+            if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpu_set);
+        }
+    }
+#endif
 
     pid_t ppid_before_fork = getpid();
 
@@ -448,24 +1843,6 @@ void Networking::launch_bot(std::string command) {
         setpgid(getpid(), getpid());
 
 #ifdef __linux__
-        // Increase the size of the write pipe buffer, so that we do not
-        // terminate the bot if the serialized game state is too large.
-        std::ifstream pipeMaxSize;
-        pipeMaxSize.open("/proc/sys/fs/pipe-max-size");
-        if (!pipeMaxSize) {
-            if (!quiet_output) std::cout << "Error opening pipe buffer max size file\n";
-        }
-        else {
-            int maxSize;
-            pipeMaxSize >> maxSize;
-            if (pipeMaxSize.fail()) {
-                if (!quiet_output) std::cout << "Error reading pipe buffer max size\n";
-            }
-            else {
-                fcntl(writePipe[1], F_SETPIPE_SZ, maxSize);
-            }
-        }
-
         // install a parent death signal
         // http://stackoverflow.com/a/36945270
         int r = prctl(PR_SET_PDEATHSIG, SIGTERM);
@@ -481,78 +1858,272 @@ void Networking::launch_bot(std::string command) {
         dup2(writePipe[0], STDIN_FILENO);
 
         dup2(readPipe[1], STDOUT_FILENO);
-        dup2(readPipe[1], STDERR_FILENO);
+        dup2(errorPipe[1], STDERR_FILENO);
+
+#ifdef HALITE_SHARED_MEMORY
+        // Let the bot inherit its shared memory channel
+        if (channel.moves != nullptr) {
+            for (const auto fd : { shared_frame_fd, channel.moves_fd,
+                                   channel.frame_ready, channel.moves_ready }) {
+                fcntl(fd, F_SETFD, 0);
+            }
+            setenv(SHARED_MEMORY_VARIABLE, channel_description.c_str(), 1);
+        }
+#endif
+
+        // Apply the sandbox once the bot's stderr goes to its log, so
+        // that it says why the bot didn't start
+#ifdef __linux__
+        if ((!sandbox.cpus.empty() || !sandbox.cpu_domain.empty()) &&
+            sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == -1) {
+            perror("Error pinning bot to its CPU");
+            exit(1);
+        }
+#endif
+        if (sandbox.memory_limit != 0) {
+            const auto bytes = static_cast<rlim_t>(sandbox.memory_limit);
+            const rlimit limit = { bytes, bytes };
+            if (setrlimit(RLIMIT_AS, &limit) == -1) {
+                perror("Error limiting bot memory");
+                exit(1);
+            }
+        }
+        if (sandbox.cpu_time_limit != 0) {
+            const auto seconds = static_cast<rlim_t>(sandbox.cpu_time_limit);
+            const rlimit limit = { seconds, seconds };
+            if (setrlimit(RLIMIT_CPU, &limit) == -1) {
+                perror("Error limiting bot CPU time");
+                exit(1);
+            }
+        }
 
-        execl("/bin/sh", "sh", "-c", command.c_str(), (char*) NULL);
+        // Ignored signals stay ignored across exec
+        signal(SIGPIPE, SIG_DFL);
+        if (sandbox.direct_exec) {
+            execvp(argv[0], argv.data());
+            perror("Error starting bot");
+        }
+        else {
+            execl("/bin/sh", "sh", "-c", command.c_str(), (char*) NULL);
+        }
 
-        //Nothing past the execl should be run
+        //Nothing past the exec should be run
 
         exit(1);
     } else if (pid < 0) {
-        if (!quiet_output) std::cout << "Fork failed\n";
+        log(LogLevel::Error, "Fork failed");
         throw 1;
     }
 
     UniConnection connection;
     connection.read = readPipe[0];
     connection.write = writePipe[1];
+    connection.child_read = writePipe[0];
+    connection.child_write = readPipe[1];
+    // Only the bot writes to its stderr, so it ends when the bot exits
+    close(errorPipe[1]);
+    connection.error_read = errorPipe[0];
 
     connections.push_back(connection);
     processes.push_back(pid);
+#ifdef HALITE_SHARED_MEMORY
+    shared_channels.push_back(channel);
+#endif
 
 #endif
 
     player_logs.push_back(std::string());
+    read_buffers.push_back(ReadBuffer());
+    stderr_captures.push_back(StderrCapture());
+    pending_writes.push_back(PendingWrite());
+    frame_formats.push_back(FrameFormat::Text);
+    frame_compression.push_back(-1);
+    cpu_time_start.push_back(0);
+    cpu_time_end.push_back(-1);
+}
+
+//! The lines of the init message before the map: the bot's ID and the map size.
+static std::string init_header(hlt::PlayerId player_tag, const hlt::Map& m) {
+    return std::to_string(player_tag) + '\n' + serializeMapSize(m) + '\n';
+}
+
+void Networking::send_init(hlt::PlayerId player_tag,
+                           const std::string& header,
+                           const std::string& map_line) {
+    start_write(player_tag, header, &map_line);
+    log(LogLevel::Info,
+        "Init Message sent to player " + std::to_string(int(player_tag)) + ".");
 }
 
-int Networking::handle_init_networking(hlt::PlayerId player_tag,
-                                       const hlt::Map& m,
-                                       bool ignoreTimeout,
-                                       std::string* playerName) {
-    const int ALLOTTED_MILLIS = ignoreTimeout ? 2147483647 : 60000;
+std::vector<int> Networking::handle_inits_networking(const hlt::Map& m,
+                                                     bool ignoreTimeout,
+                                                     std::chrono::milliseconds init_time_limit,
+                                                     std::vector<std::string>& player_names) {
+    const auto num_players = static_cast<hlt::PlayerId>(player_count());
+    const long time_limit = ignoreTimeout
+        ? 2147483647 : static_cast<long>(init_time_limit.count());
+    std::vector<int> times(num_players, -1);
+    player_names.resize(std::max<size_t>(player_names.size(), num_players));
+
+    typedef std::chrono::steady_clock clock;
+
+    // Every bot gets the same map, so it is only serialized once; what
+    // doesn't fit in a bot's pipe is written as the bot reads it
+    const std::string map_line = serialize_map(m) + '\n';
+    std::vector<std::string> headers(num_players);
+    std::vector<hlt::PlayerId> waiting;
+    for (hlt::PlayerId player_tag = 0; player_tag < num_players; player_tag++) {
+        if (builtin_bots.count(player_tag) != 0) {
+            times[player_tag] = handle_builtin_init(player_tag, m, &player_names[player_tag]);
+            continue;
+        }
+
+        std::exception_ptr error;
+        try {
+            headers[player_tag] = init_header(player_tag, m);
+            send_init(player_tag, headers[player_tag], map_line);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        if (error) {
+            times[player_tag] = handle_init_response(
+                player_tag, &player_names[player_tag],
+                [&](std::string&) -> long { std::rethrow_exception(error); });
+            continue;
+        }
+        waiting.push_back(player_tag);
+    }
+
+    // Every bot gets the same deadline, and the game starts as soon as the
+    // last one has replied or errored
+    const auto sent_at = clock::now();
+    std::vector<std::exception_ptr> errors;
+    std::string response;
+    while (!waiting.empty()) {
+        const auto now = clock::now();
+        const long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - sent_at).count();
+
+        for (size_t i = 0; i < waiting.size();) {
+            const auto player_tag = waiting[i];
+            // A bot must have read its whole init message before its reply counts
+            const bool replied = !write_pending(player_tag)
+                                 && take_buffered_line(player_tag, response);
+            if (!replied && elapsed < time_limit) {
+                i++;
+                continue;
+            }
+
+            times[player_tag] = handle_init_response(
+                player_tag, &player_names[player_tag],
+                [&](std::string& result) -> long {
+                    if (write_pending(player_tag)) throw write_timeout_error(player_tag);
+                    if (!replied) throw timeout_error(player_tag, 0, time_limit);
+                    result.swap(response);
+                    return elapsed;
+                });
+            waiting.erase(waiting.begin() + i);
+        }
+        if (waiting.empty()) break;
+
+        wait_for_bots(waiting, time_limit - elapsed, errors);
+
+        std::vector<hlt::PlayerId> still_waiting;
+        for (size_t i = 0; i < waiting.size(); i++) {
+            const auto player_tag = waiting[i];
+            if (errors[i]) {
+                times[player_tag] = handle_init_response(
+                    player_tag, &player_names[player_tag],
+                    [&](std::string&) -> long { std::rethrow_exception(errors[i]); });
+                continue;
+            }
+            still_waiting.push_back(player_tag);
+        }
+        waiting.swap(still_waiting);
+    }
+
+    return times;
+}
 
+int Networking::handle_init_response(hlt::PlayerId player_tag,
+                                     std::string* playerName,
+                                     const std::function<long(std::string&)>& exchange) {
     std::string response;
     nlohmann::json init_log_json;
     try {
-        std::string playerTagString = std::to_string(player_tag),
-            mapSizeString = serializeMapSize(m), mapString = serialize_map(m);
-        send_string(player_tag, playerTagString);
-        send_string(player_tag, mapSizeString);
-        send_string(player_tag, mapString);
-        std::string outMessage =
-            "Init Message sent to player " + std::to_string(int(player_tag))
-                + ".\n";
-        if (!quiet_output) std::cout << outMessage;
-
-        std::chrono::high_resolution_clock::time_point
-            initialTime = std::chrono::high_resolution_clock::now();
-        response = get_string(player_tag, ALLOTTED_MILLIS);
-        unsigned int millisTaken =
-            std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::high_resolution_clock::now()
-                    - initialTime).count();
+        const auto millisTaken = static_cast<unsigned int>(exchange(response));
 
         init_log_json["Time"] = millisTaken;
         init_log_json["Turn"] = 0;
 
-        *playerName = response.substr(0, 30);
-        if (!quiet_output) {
-            std::string inMessage = "Init Message received from player "
-                + std::to_string(int(player_tag)) + ", " + *playerName + ".\n";
-            std::cout << inMessage;
+        // The bot may ask for protocol options after its name, separated
+        // by tabs
+        int compression_level = 0;
+        for (auto option = response.rfind('\t'); option != std::string::npos;
+             option = response.rfind('\t')) {
+            const auto requested = response.substr(option + 1);
+            if (requested == BINARY_FRAMES_OPTION) {
+                frame_formats[player_tag] = FrameFormat::Binary;
+            }
+            else if (requested == DELTA_FRAMES_OPTION) {
+                frame_formats[player_tag] = FrameFormat::Delta;
+            }
+            else if (requested.compare(0, std::strlen(ZSTD_FRAMES_OPTION), ZSTD_FRAMES_OPTION) == 0 &&
+                     (requested.size() == std::strlen(ZSTD_FRAMES_OPTION) ||
+                      requested[std::strlen(ZSTD_FRAMES_OPTION)] == '=')) {
+                compression_level = DEFAULT_FRAME_COMPRESSION_LEVEL;
+                if (requested.size() > std::strlen(ZSTD_FRAMES_OPTION)) {
+                    compression_level = std::atoi(
+                        requested.c_str() + std::strlen(ZSTD_FRAMES_OPTION) + 1);
+                }
+                compression_level = std::max(1, std::min(compression_level, ZSTD_maxCLevel()));
+            }
+            else if (requested == SHARED_MEMORY_OPTION) {
+#ifdef HALITE_SHARED_MEMORY
+                // Only if the bot was actually offered shared memory. Its
+                // moves no longer come through its output, so drop anything
+                // else it has written there
+                shared_channels[player_tag].active =
+                    shared_channels[player_tag].moves != nullptr;
+                if (shared_channels[player_tag].active) {
+                    read_buffers[player_tag] = ReadBuffer();
+                }
+#endif
+            }
+            else {
+                break;
+            }
+            response.erase(option);
+        }
+#ifdef HALITE_SHARED_MEMORY
+        if (shared_channels[player_tag].active) compression_level = 0;
+#endif
+        if (compression_level > 0) {
+            frame_compression[player_tag] =
+                compression_stream(frame_formats[player_tag], compression_level);
         }
+        init_log_json["CompressionLevel"] = compression_level;
+        init_log_json["BinaryFrames"] =
+            frame_formats[player_tag] == FrameFormat::Binary;
+        init_log_json["DeltaFrames"] =
+            frame_formats[player_tag] == FrameFormat::Delta;
+#ifdef HALITE_SHARED_MEMORY
+        init_log_json["SharedMemory"] = shared_channels[player_tag].active;
+#endif
+
+        *playerName = response.substr(0, 30);
+        log(LogLevel::Info, "Init Message received from player "
+            + std::to_string(int(player_tag)) + ", " + *playerName + ".");
 
-        player_logs_json[player_tag]["Frames"] += init_log_json;
+        player_logs_json[player_tag]["Init"] = init_log_json;
         player_logs_json[player_tag]["PlayerID"] = player_tag;
         player_logs_json[player_tag]["PlayerName"] = *playerName;
 
         return millisTaken;
     }
     catch (BotInputError err) {
-        if (!quiet_output) {
-            std::lock_guard<std::mutex> guard(coutMutex);
-            std::cout << err.what() << std::endl;
-        }
+        log(LogLevel::Warning, err.what());
         player_logs_json[player_tag]["Error"]["Message"] = err.what();
         player_logs_json[player_tag]["Error"]["Turn"] = 0;
 
@@ -573,52 +2144,226 @@ int Networking::handle_init_networking(hlt::PlayerId player_tag,
             "Bot #" + std::to_string(player_tag) + "; timed out during Init";
     }
 
-    player_logs_json[player_tag]["Frames"] += init_log_json;
+    player_logs_json[player_tag]["Init"] = init_log_json;
 
     return -1;
 }
 
+void Networking::set_time_limits(std::chrono::milliseconds frame_limit_,
+                                 std::chrono::milliseconds time_bank_limit_) {
+    frame_limit = frame_limit_;
+    time_bank_limit = time_bank_limit_;
+    time_banks.clear();
+}
+
+void Networking::set_sandbox(const BotSandbox& sandbox_) {
+    sandbox = sandbox_;
+}
+
+auto Networking::frame_allowance(hlt::PlayerId player_tag, bool ignoreTimeout)
+    -> std::chrono::microseconds {
+    if (ignoreTimeout) return UNLIMITED_TIME;
+    if (time_banks.size() <= player_tag) {
+        time_banks.resize(player_tag + 1, std::chrono::microseconds::zero());
+    }
+    return frame_limit + time_banks[player_tag];
+}
+
+void Networking::spend_time(hlt::PlayerId player_tag,
+                            std::chrono::microseconds allowance,
+                            std::chrono::microseconds used) {
+    if (time_bank_limit <= std::chrono::microseconds::zero()) return;
+    time_banks[player_tag] = std::max(std::chrono::microseconds::zero(),
+                                      std::min(time_bank_limit, allowance - used));
+}
+
+//! Record that a bot has been sent its whole frame.
+static void mark_sent(Networking::ResponseTiming& timing,
+                      std::chrono::steady_clock::time_point sent) {
+    timing.sent = sent;
+    timing.send_micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        sent - timing.send_start).count();
+}
+
 int Networking::handle_frame_networking(hlt::PlayerId player_tag,
                                         const unsigned short& turnNumber,
                                         const hlt::Map& m,
+                                        const SerializedFrame& frame,
                                         bool ignoreTimeout,
-                                        hlt::PlayerMoveQueue& moves) {
+                                        hlt::PlayerMoveQueue& moves,
+                                        ResponseTiming& timing) {
+    if (is_process_dead(player_tag)) {
+        return -1;
+    }
 
-    const int ALLOTTED_MILLIS = ignoreTimeout ? 2147483647 : 2000;
+    typedef std::chrono::steady_clock clock;
+    const auto time = handle_frame_response(
+        player_tag, turnNumber, m, moves,
+        [&](std::string& response) -> long {
+            //Send this bot the game map and the messages addressed to this bot
+            const auto send_start = clock::now();
+            timing.send_start = send_start;
+            // Sending counts against the bot's time, like thinking
+            const auto allowance = frame_allowance(player_tag, ignoreTimeout);
+            send_frame(player_tag, frame);
+            finish_write(player_tag, std::min<long>(ceil_millis(allowance), 2147483647));
+
+            const auto initialTime = clock::now();
+            timing.sent = initialTime;
+            const auto left = allowance - std::chrono::duration_cast<std::chrono::microseconds>(
+                initialTime - send_start);
+            response = get_string(player_tag, static_cast<unsigned int>(
+                std::max<long>(std::min<long>(ceil_millis(left), 2147483647), 0)));
+            const auto finalTime = clock::now();
+            timing.reply_read = finalTime;
+            spend_time(player_tag, allowance,
+                       std::chrono::duration_cast<std::chrono::microseconds>(finalTime - send_start));
+
+            timing.send_micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                initialTime - send_start).count();
+            timing.think_micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                finalTime - initialTime).count();
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                finalTime - send_start).count();
+        });
+    if (time != -1) timing.reply_parsed = clock::now();
+    return time;
+}
 
-    std::string response;
-    nlohmann::json log_json;
-    try {
-        if (is_process_dead(player_tag)) {
-            return -1;
+std::vector<int> Networking::handle_frames_networking(const unsigned short& turnNumber,
+                                                      const hlt::Map& m,
+                                                      const SerializedFrame& frame,
+                                                      const std::vector<bool>& alive,
+                                                      bool ignoreTimeout,
+                                                      hlt::MoveQueue& moves,
+                                                      std::vector<ResponseTiming>& timings) {
+    std::vector<int> times(alive.size(), -1);
+    timings.assign(alive.size(), ResponseTiming());
+    play_builtin_bots(m, alive, moves, times);
+
+    typedef std::chrono::steady_clock clock;
+
+#ifndef _WIN32
+    collect_teardowns(0);
+#endif
+
+    // Start sending every bot its frame first, so that they all think at
+    // once. What doesn't fit in a bot's pipe is written as the bot reads
+    // it, and that counts against its time like thinking does
+    std::vector<hlt::PlayerId> waiting;
+    std::vector<clock::time_point> sent_at(alive.size());
+    // What each bot may use this turn, with its time bank
+    std::vector<std::chrono::microseconds> allowances(alive.size());
+    for (hlt::PlayerId player_tag = 0; player_tag < alive.size(); player_tag++) {
+        if (!alive[player_tag] || is_process_dead(player_tag) ||
+            builtin_bots.count(player_tag) != 0) {
+            continue;
+        }
+
+        std::exception_ptr error;
+        const auto send_start = clock::now();
+        try {
+            send_frame(player_tag, frame);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        if (error) {
+            handle_frame_response(
+                player_tag, turnNumber, m, moves.at(player_tag),
+                [&](std::string&) -> long { std::rethrow_exception(error); });
+            continue;
         }
 
-        //Send this bot the game map and the messages addressed to this bot
-        std::string mapString = serialize_map(m);
-        send_string(player_tag, mapString);
+        sent_at[player_tag] = send_start;
+        allowances[player_tag] = frame_allowance(player_tag, ignoreTimeout);
+        timings[player_tag].send_start = send_start;
+        if (!write_pending(player_tag)) mark_sent(timings[player_tag], clock::now());
+        waiting.push_back(player_tag);
+    }
+
+    // Then wait on all of them together, finishing each bot as soon as it
+    // has read its whole frame and sent a full line, or run out of time
+    std::vector<std::exception_ptr> errors;
+    std::string response;
+    while (!waiting.empty()) {
+        const auto now = clock::now();
+        long wait_millis = 2147483647;
+
+        for (size_t i = 0; i < waiting.size();) {
+            const auto player_tag = waiting[i];
+            const auto used = std::chrono::duration_cast<std::chrono::microseconds>(
+                now - sent_at[player_tag]);
+            const long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(used).count();
+            const bool replied = !write_pending(player_tag)
+                                 && take_buffered_line(player_tag, response);
+            if (!replied && used < allowances[player_tag]) {
+                wait_millis = std::min(wait_millis, ceil_millis(allowances[player_tag] - used));
+                i++;
+                continue;
+            }
 
+            if (replied) spend_time(player_tag, allowances[player_tag], used);
+            times[player_tag] = handle_frame_response(
+                player_tag, turnNumber, m, moves.at(player_tag),
+                [&](std::string& result) -> long {
+                    if (write_pending(player_tag)) throw write_timeout_error(player_tag);
+                    if (!replied) {
+                        throw timeout_error(player_tag, 0, static_cast<int>(std::min<long>(
+                            ceil_millis(allowances[player_tag]), 2147483647)));
+                    }
+                    result.swap(response);
+                    timings[player_tag].reply_read = now;
+                    timings[player_tag].think_micros =
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            now - timings[player_tag].sent).count();
+                    return elapsed;
+                });
+            if (times[player_tag] != -1) {
+                timings[player_tag].reply_parsed = clock::now();
+            }
+            waiting.erase(waiting.begin() + i);
+        }
+        if (waiting.empty()) break;
+
+        wait_for_bots(waiting, wait_millis, errors);
+
+        std::vector<hlt::PlayerId> still_waiting;
+        for (size_t i = 0; i < waiting.size(); i++) {
+            const auto player_tag = waiting[i];
+            if (errors[i]) {
+                handle_frame_response(
+                    player_tag, turnNumber, m, moves.at(player_tag),
+                    [&](std::string&) -> long { std::rethrow_exception(errors[i]); });
+                continue;
+            }
+            // Its frame was still being written until now
+            if (timings[player_tag].sent == clock::time_point() && !write_pending(player_tag)) {
+                mark_sent(timings[player_tag], clock::now());
+            }
+            still_waiting.push_back(player_tag);
+        }
+        waiting.swap(still_waiting);
+    }
 
-        std::chrono::high_resolution_clock::time_point
-            initialTime = std::chrono::high_resolution_clock::now();
-        response = get_string(player_tag, ALLOTTED_MILLIS);
-        const auto millisTaken =
-            std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::high_resolution_clock::now()
-                    - initialTime).count();
+    return times;
+}
 
+int Networking::handle_frame_response(hlt::PlayerId player_tag,
+                                      const unsigned short& turnNumber,
+                                      const hlt::Map& m,
+                                      hlt::PlayerMoveQueue& moves,
+                                      const std::function<long(std::string&)>& exchange) {
+    std::string response;
+    try {
+        const auto millisTaken = exchange(response);
 
-        log_json["Time"] = millisTaken;
         deserialize_move_set(player_tag, response, m, moves);
 
-        player_logs_json[player_tag]["Frames"] += log_json;
-
         return millisTaken;
     }
     catch (BotInputError err) {
-        if (!quiet_output) {
-            std::lock_guard<std::mutex> guard(coutMutex);
-            std::cout << err.what() << std::endl;
-        }
+        log(LogLevel::Warning, err.what());
         std::string error_string = response + read_trailing_input(player_tag);
         player_logs_json[player_tag]["Error"]["Message"] = "ERRORED! Got Exception (if any): " + std::string(err.what()) + "; Response received (if any): " + error_string;
         player_logs_json[player_tag]["Error"]["Turn"] = turnNumber;
@@ -635,109 +2380,310 @@ int Networking::handle_frame_networking(hlt::PlayerId player_tag,
         player_logs_json[player_tag]["Error"]["Turn"] = turnNumber;
     }
 
-    player_logs_json[player_tag]["Frames"] += log_json;
-
     return -1;
 }
 
+void Networking::print_killed_output(hlt::PlayerId player_tag, const std::string& output) {
+    if (output.empty()) return;
+    // One message, so that its lines aren't interleaved with another game's
+    log(LogLevel::Warning,
+        "Bot " + std::to_string(int(player_tag)) + " was killed.\n"
+        "Here is the rest of its output (if any):\n"
+        + output + (output.back() != '\n' ? "\n" : "")
+        + "--- End bot output ---");
+}
+
 void Networking::kill_player(hlt::PlayerId player_tag) {
+    // A built-in bot has nothing to tear down
+    if (builtin_bots.erase(player_tag) != 0) return;
     if (is_process_dead(player_tag)) return;
 
-    std::string newString;
-    const int PER_CHAR_WAIT = 10; // millis
-    const int MAX_READ_TIME = 1000; // millis
+#ifdef HALITE_SHARED_MEMORY
+    // Show what the bot wrote to its output, not to its moves slot
+    shared_channels[player_tag].active = false;
+#endif
 
+    // Its compression stream needn't be kept up for it
+    frame_compression[player_tag] = -1;
+    cpu_time_end[player_tag] = measure_cpu_time(player_tag);
 #ifdef _WIN32
+    // A write can't be left in flight once what it writes is dropped
+    cancel_io(player_tag);
+#endif
+    pending_writes[player_tag] = PendingWrite();
+    std::string newString = take_buffered_input(player_tag);
 
-    // Try to read entire contents of pipe.
+#ifdef _WIN32
     WinConnection connection = connections[player_tag];
-    DWORD charsRead;
-    bool success;
-    char buffer;
-    std::chrono::high_resolution_clock::time_point tp = std::chrono::high_resolution_clock::now();
-    while(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - tp).count() < MAX_READ_TIME) {
-        DWORD bytesAvailable = 0;
-        PeekNamedPipe(connection.read, NULL, 0, NULL, &bytesAvailable, NULL);
-        if(bytesAvailable < 1) {
-            std::chrono::high_resolution_clock::time_point initialTime = std::chrono::high_resolution_clock::now();
-            while(bytesAvailable < 1) {
-                if(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - initialTime).count() > PER_CHAR_WAIT) break;
-                PeekNamedPipe(connection.read, NULL, 0, NULL, &bytesAvailable, NULL);
-            }
-            if(bytesAvailable < 1) break; // Took too long to get a character; breaking.
-        }
-
-        success = ReadFile(connection.read, &buffer, 1, &charsRead, NULL);
-        if(!success || charsRead < 1) {
-            if(!quiet_output) {
-                std::string errorMessage = "Bot #" + std::to_string(player_tag) + " timed out or errored (Windows)\n";
-                std::lock_guard<std::mutex> guard(coutMutex);
-                std::cout << errorMessage;
-            }
-            break;
+
+    // Kill the bot first, then read what it left in its pipe, which ends
+    // once the bot's processes and our ends of its pipes are gone.
+    TerminateJobObject(processes[player_tag], 0);
+    CloseHandle(connection.child_read);
+    CloseHandle(connection.child_write);
+    if (!quiet_output) {
+        const auto deadline = std::chrono::steady_clock::now() + TEARDOWN_TIME_LIMIT;
+        while (true) {
+            const long left = ceil_millis(std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now()));
+            if (left <= 0 || fill_read_buffer(player_tag, static_cast<int>(left)) <= 0) break;
+            newString += take_buffered_input(player_tag);
         }
-        newString += buffer;
     }
+    cancel_io(player_tag);
+    newString += take_buffered_input(player_tag);
+    pipe_io[player_tag].reset();
 
-    HANDLE process = processes[player_tag];
-
-    TerminateProcess(process, 0);
+    CloseHandle(connection.read);
+    CloseHandle(connection.write);
+    if (connections[player_tag].error_read != NULL) CloseHandle(connections[player_tag].error_read);
+    CloseHandle(processes[player_tag]);
 
     processes[player_tag] = NULL;
-    connections[player_tag].read = NULL;
-    connections[player_tag].write = NULL;
-
-    std::string deadMessage = "Player " + std::to_string(player_tag) + " is dead\n";
-    if(!quiet_output) std::cout << deadMessage;
+    connections[player_tag] = WinConnection{ NULL, NULL, NULL, NULL, NULL };
 
+    log(LogLevel::Warning, "Player " + std::to_string(player_tag) + " is dead");
+    print_killed_output(player_tag, newString);
 #else
-
-    // Try to read entire contents of pipe.
     UniConnection connection = connections[player_tag];
-    fd_set set;
-    FD_ZERO(&set); /* clear the set */
-    FD_SET(connection.read, &set); /* add our file descriptor to the set */
-    char buffer;
-    std::chrono::high_resolution_clock::time_point
-        tp = std::chrono::high_resolution_clock::now();
-    while (std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::high_resolution_clock::now() - tp).count()
-        < MAX_READ_TIME) {
-        struct timeval timeout;
-        timeout.tv_sec = PER_CHAR_WAIT / 1000;
-        timeout.tv_usec = (PER_CHAR_WAIT % 1000) * 1000;
-        int selectionResult =
-            select(connection.read + 1, &set, NULL, NULL, &timeout);
-        if (selectionResult > 0) {
-            const size_t bytes_read = read(connection.read, &buffer, 1);
-            if (bytes_read != 1) {
-                break;
-            }
-            newString += buffer;
-        } else break;
-    }
 
-    kill(-processes[player_tag], SIGKILL);
+    // Kill the bot first: its pipe keeps what it wrote, and reading it
+    // ends as soon as the bot's processes are gone, rather than waiting
+    // on a bot that's still running.
+    const bool remote = processes[player_tag] == REMOTE_PROCESS;
+    if (!remote) kill(-processes[player_tag], SIGKILL);
+
+    close(connection.write);
+    if (connection.child_read != -1) close(connection.child_read);
+    if (connection.child_write != -1) close(connection.child_write);
+    // Keep what it wrote to stderr before it was killed
+    read_stderr(player_tag);
+    if (connections[player_tag].error_read != -1) close(connections[player_tag].error_read);
+    if (remote) {
+        // Disconnecting is all a remote bot gets; its output is its own
+        close(connection.read);
+        print_killed_output(player_tag, newString);
+    }
+    else if (quiet_output) {
+        close(connection.read);
+        unreaped.push_back(processes[player_tag]);
+    }
+    else {
+        Teardown teardown;
+        teardown.player_tag = player_tag;
+        teardown.read = connection.read;
+        teardown.process = processes[player_tag];
+        teardown.output = std::move(newString);
+        teardown.deadline = std::chrono::steady_clock::now() + TEARDOWN_TIME_LIMIT;
+        teardowns.push_back(std::move(teardown));
+    }
 
     processes[player_tag] = -1;
     connections[player_tag].read = -1;
     connections[player_tag].write = -1;
+    connections[player_tag].child_read = -1;
+    connections[player_tag].child_write = -1;
+    connections[player_tag].error_read = -1;
+#ifdef HALITE_SHARED_MEMORY
+    close_shared_channel(player_tag);
+#endif
 #endif
+}
+
+#ifndef _WIN32
+void Networking::collect_teardowns(int timeout_millis) {
+    if (!teardowns.empty()) {
+        std::vector<struct pollfd> fds(teardowns.size());
+        for (size_t i = 0; i < teardowns.size(); i++) {
+            fds[i].fd = teardowns[i].read;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        poll(fds.data(), fds.size(), timeout_millis);
+
+        const auto now = std::chrono::steady_clock::now();
+        size_t kept = 0;
+        for (size_t i = 0; i < teardowns.size(); i++) {
+            auto& teardown = teardowns[i];
+            bool done = now >= teardown.deadline;
+            if (fds[i].revents != 0) {
+                char buffer[READ_CHUNK_SIZE];
+                const ssize_t bytes = read(teardown.read, buffer, sizeof(buffer));
+                if (bytes > 0) {
+                    teardown.output.append(buffer, static_cast<size_t>(bytes));
+                }
+                else if (bytes == 0 || (errno != EINTR && errno != EAGAIN)) {
+                    done = true;
+                }
+            }
 
-    if (!newString.empty()) {
-        if (!quiet_output) {
-            std::cout << "Bot " << (int) player_tag << " was killed.\n";
-            std::cout << "Here is the rest of its output (if any):\n";
-            std::cout << newString;
-            if (newString.back() != '\n') {
-                std::cout << '\n';
+            if (done) {
+                close(teardown.read);
+                print_killed_output(teardown.player_tag, teardown.output);
+                unreaped.push_back(teardown.process);
+            }
+            else {
+                teardowns[kept++] = std::move(teardown);
             }
-            std::cout << "--- End bot output ---\n";
         }
+        teardowns.resize(kept);
+    }
+
+    unreaped.erase(std::remove_if(unreaped.begin(), unreaped.end(), [](int process) {
+        return waitpid(process, nullptr, WNOHANG) != 0;
+    }), unreaped.end());
+}
+#endif
+
+void Networking::finish_teardowns() {
+#ifndef _WIN32
+    while (!teardowns.empty()) {
+        auto deadline = teardowns.front().deadline;
+        for (const auto& teardown : teardowns) {
+            deadline = std::min(deadline, teardown.deadline);
+        }
+        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        collect_teardowns(static_cast<int>(std::max<long long>(0, wait + 1)));
+    }
+    // SIGKILL can't be caught, so this doesn't wait long
+    for (const int process : unreaped) {
+        waitpid(process, nullptr, 0);
+    }
+    unreaped.clear();
+#endif
+}
+
+hlt::possibly<Networking::BotProcess> Networking::release_bot(hlt::PlayerId player_tag) {
+    // A built-in bot costs nothing to start again
+    if (is_process_dead(player_tag) || builtin_bots.count(player_tag) != 0) {
+        return { BotProcess(), false };
+    }
+#ifdef HALITE_SHARED_MEMORY
+    // Its channel belongs to this game
+    if (shared_channels[player_tag].active) return { BotProcess(), false };
+#endif
+    // So does its compression stream, which it can't be told apart from
+    if (frame_compression[player_tag] >= 0) return { BotProcess(), false };
+
+    try {
+        send_string(player_tag, NEW_GAME_SENTINEL,
+                    std::min<long>(ceil_millis(frame_limit), 2147483647));
+    }
+    catch (...) {
+        // Leave the bot to be killed along with the rest of the game
+        return { BotProcess(), false };
+    }
+
+    cpu_time_end[player_tag] = measure_cpu_time(player_tag);
+#ifndef _WIN32
+    // What it wrote to stderr so far belongs to this game's log
+    read_stderr(player_tag);
+#endif
+    BotProcess bot;
+    bot.connection = connections[player_tag];
+    bot.process = processes[player_tag];
+
+#ifdef _WIN32
+    // Nothing more may be read into this game's buffers
+    cancel_io(player_tag);
+    pipe_io[player_tag].reset();
+    processes[player_tag] = NULL;
+    connections[player_tag] = WinConnection{ NULL, NULL, NULL, NULL, NULL };
+#else
+    processes[player_tag] = -1;
+    connections[player_tag].read = -1;
+    connections[player_tag].write = -1;
+    connections[player_tag].child_read = -1;
+    connections[player_tag].child_write = -1;
+    connections[player_tag].error_read = -1;
+#ifdef HALITE_SHARED_MEMORY
+    close_shared_channel(player_tag);
+#endif
+#endif
+
+    return { bot, true };
+}
+
+void Networking::adopt_bot(const BotProcess& bot) {
+    connections.push_back(bot.connection);
+    processes.push_back(bot.process);
+#ifdef _WIN32
+    pipe_io.emplace_back(new PipeIo());
+#endif
+#ifdef HALITE_SHARED_MEMORY
+    // Released bots stop using their shared memory channel
+    shared_channels.push_back(SharedChannel());
+#endif
+    player_logs.push_back(std::string());
+    read_buffers.push_back(ReadBuffer());
+    stderr_captures.push_back(StderrCapture());
+    pending_writes.push_back(PendingWrite());
+    frame_formats.push_back(FrameFormat::Text);
+    frame_compression.push_back(-1);
+    // Only count what the bot uses from now on
+    cpu_time_start.push_back(-1);
+    cpu_time_end.push_back(-1);
+    cpu_time_start.back() = std::max(0.0, measure_cpu_time(player_count() - 1));
+}
+
+void Networking::add_builtin_bot(const std::string& command) {
+    BuiltinBot::Policy policy;
+    try {
+        policy = BuiltinBot::policy_of(command);
+    }
+    catch (const std::invalid_argument& e) {
+        log(LogLevel::Error, e.what());
+        throw 1;
+    }
+    log(LogLevel::Info, command);
+
+    builtin_bots.emplace(static_cast<hlt::PlayerId>(player_count()), BuiltinBot(policy));
+#ifdef _WIN32
+    connections.push_back(WinConnection{ NULL, NULL, NULL, NULL, NULL });
+    processes.push_back(NULL);
+    pipe_io.emplace_back();
+#else
+    connections.push_back(UniConnection{ -1, -1, -1, -1, -1 });
+    processes.push_back(-1);
+#endif
+#ifdef HALITE_SHARED_MEMORY
+    shared_channels.push_back(SharedChannel());
+#endif
+    player_logs.push_back(std::string());
+    read_buffers.push_back(ReadBuffer());
+    stderr_captures.push_back(StderrCapture());
+    pending_writes.push_back(PendingWrite());
+    frame_formats.push_back(FrameFormat::None);
+    frame_compression.push_back(-1);
+    cpu_time_start.push_back(0);
+    cpu_time_end.push_back(-1);
+}
+
+int Networking::handle_builtin_init(hlt::PlayerId player_tag, const hlt::Map& m,
+                                    std::string* playerName) {
+    auto& bot = builtin_bots.at(player_tag);
+    bot.init(player_tag, m);
+    return handle_init_response(player_tag, playerName, [&](std::string& response) -> long {
+        response = bot.name();
+        return 0;
+    });
+}
+
+void Networking::play_builtin_bots(const hlt::Map& m,
+                                   const std::vector<bool>& alive,
+                                   hlt::MoveQueue& moves,
+                                   std::vector<int>& times) {
+    for (auto& builtin : builtin_bots) {
+        const auto player_tag = builtin.first;
+        if (!alive[player_tag]) continue;
+        builtin.second.queue_moves(player_tag, m, constants, moves.at(player_tag));
+        times[player_tag] = 0;
     }
 }
 
 bool Networking::is_process_dead(hlt::PlayerId player_tag) {
+    if (builtin_bots.count(player_tag) != 0) return false;
 #ifdef _WIN32
     return processes[player_tag] == NULL;
 #else
@@ -752,3 +2698,159 @@ int Networking::player_count() {
     return connections.size();
 #endif
 }
+
+double Networking::measure_cpu_time(hlt::PlayerId player_tag) {
+#ifdef __linux__
+    if (is_process_dead(player_tag) || processes[player_tag] == REMOTE_PROCESS ||
+        builtin_bots.count(player_tag) != 0) {
+        return -1;
+    }
+    return process_group_cpu_time(processes[player_tag]);
+#else
+    return -1;
+#endif
+}
+
+double Networking::cpu_time(hlt::PlayerId player_tag) {
+    // In-process games have no bots
+    if (player_tag >= cpu_time_start.size()) return -1;
+    const auto end = is_process_dead(player_tag)
+        ? cpu_time_end[player_tag] : measure_cpu_time(player_tag);
+    if (end < 0) return -1;
+    return std::max(0.0, end - cpu_time_start[player_tag]);
+}
+
+size_t Networking::memory_usage() const {
+    size_t bytes = read_buffers.capacity() * sizeof(ReadBuffer);
+    for (const auto& buffer : read_buffers) {
+        bytes += buffer.data.capacity();
+    }
+    bytes += stderr_captures.capacity() * sizeof(StderrCapture);
+    for (const auto& capture : stderr_captures) {
+        bytes += capture.ring.capacity();
+    }
+#ifndef _WIN32
+    for (const auto& teardown : teardowns) {
+        bytes += sizeof(Teardown) + teardown.output.capacity();
+    }
+#endif
+    return bytes;
+}
+
+#ifndef _WIN32
+unsigned int Networking::accept_remote_bots(const std::string& address,
+                                            const std::string& token,
+                                            unsigned int count,
+                                            std::chrono::milliseconds timeout) {
+    std::string unix_path;
+    bool tcp = false;
+    const int listener = listen_socket(address, unix_path, tcp);
+    log(LogLevel::Info, "Waiting for " + std::to_string(count) + " remote bots on " + address);
+
+    // Connections that haven't sent their token yet. They are read
+    // without blocking, so that one slow bot doesn't hold up the others.
+    struct PendingBot {
+        int socket;
+        std::string received;
+    };
+    std::vector<PendingBot> pending;
+    unsigned int accepted = 0;
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (accepted < count) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) break;
+
+        std::vector<struct pollfd> fds(pending.size() + 1);
+        fds[0].fd = listener;
+        for (size_t i = 0; i < pending.size(); i++) fds[i + 1].fd = pending[i].socket;
+        for (auto& fd : fds) {
+            fd.events = POLLIN;
+            fd.revents = 0;
+        }
+        if (poll(fds.data(), fds.size(), static_cast<int>(remaining)) <= 0) continue;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < pending.size(); i++) {
+            auto& bot = pending[i];
+            bool waiting = true;
+            if (fds[i + 1].revents != 0) {
+                char buffer[512];
+                const ssize_t bytes = read(bot.socket, buffer, sizeof(buffer));
+                if (bytes > 0) bot.received.append(buffer, static_cast<size_t>(bytes));
+                const auto newline = bot.received.find('\n');
+
+                if (newline != std::string::npos) {
+                    auto line = bot.received.substr(0, newline);
+                    if (!line.empty() && line.back() == '\r') line.pop_back();
+                    if (line == token && accepted < count) {
+                        add_remote_bot(bot.socket, tcp, bot.received.substr(newline + 1));
+                        accepted++;
+                    }
+                    else {
+                        log(LogLevel::Warning, "A remote bot sent the wrong token");
+                        close(bot.socket);
+                    }
+                    waiting = false;
+                }
+                else if (bytes == 0 || bot.received.size() > MAX_TOKEN_LINE ||
+                         (bytes < 0 && errno != EINTR && errno != EAGAIN)) {
+                    close(bot.socket);
+                    waiting = false;
+                }
+            }
+            if (waiting) pending[kept++] = std::move(bot);
+        }
+        pending.resize(kept);
+
+        if (fds[0].revents & POLLIN) {
+            const int socket = accept(listener, nullptr, nullptr);
+            if (socket != -1) {
+                fcntl(socket, F_SETFD, FD_CLOEXEC);
+                fcntl(socket, F_SETFL, O_NONBLOCK);
+                pending.push_back(PendingBot{ socket, std::string() });
+            }
+        }
+    }
+
+    for (const auto& bot : pending) close(bot.socket);
+    close(listener);
+    if (!unix_path.empty()) remove_socket_file(unix_path);
+    return accepted;
+}
+
+void Networking::add_remote_bot(int socket, bool tcp, const std::string& received) {
+    // The socket stays non-blocking: replies are only read once poll() has
+    // found them, and frames are written as the bot reads them, as for a
+    // pipe (see start_write)
+    if (tcp) {
+        // Frames and moves are single messages that are waited on
+        const int on = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    UniConnection connection;
+    connection.read = socket;
+    // Its own descriptor, so that both ends are closed like a pipe's
+    connection.write = fcntl(socket, F_DUPFD_CLOEXEC, 0);
+    connection.child_read = -1;
+    connection.child_write = -1;
+    connection.error_read = -1;
+
+    connections.push_back(connection);
+    processes.push_back(REMOTE_PROCESS);
+#ifdef HALITE_SHARED_MEMORY
+    // Shared memory only reaches bots on this machine
+    shared_channels.push_back(SharedChannel());
+#endif
+    player_logs.push_back(std::string());
+    read_buffers.push_back(ReadBuffer());
+    pending_writes.push_back(PendingWrite());
+    read_buffers.back().data.assign(received.begin(), received.end());
+    stderr_captures.push_back(StderrCapture());
+    frame_formats.push_back(FrameFormat::Text);
+    frame_compression.push_back(-1);
+    cpu_time_start.push_back(0);
+    cpu_time_end.push_back(-1);
+}
+#endif
@@ -1,8 +1,12 @@
 #ifndef NETWORKING_H
 #define NETWORKING_H
 
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
 
 #ifdef _WIN32
@@ -14,23 +18,44 @@
 #include <signal.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <fcntl.h>
-#include <sys/select.h>
+#include <poll.h>
 
 #ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/prctl.h>
+#include <sched.h>
+// memfd_create and eventfd are Linux-only
+#define HALITE_SHARED_MEMORY
 #endif
 #include <unistd.h>
 
 #endif
 
+#include "../core/ConsoleLog.hpp"
 #include "../core/hlt.hpp"
+#include "../core/json.hpp"
+#include "BuiltinBot.hpp"
 
-extern bool quiet_output;
+class BotInputError;
+//! zstd's compression context (ZSTD_CCtx), which is also its ZSTD_CStream.
+struct ZSTD_CCtx_s;
 
 /**
- * How many digits of precision to send to the client.
+ * The most significant digits sent to the client for a floating point value.
+ * Values are sent with the fewest digits (but at least 15) that parse back
+ * to the same double.
  */
 constexpr auto SERIALIZATION_PRECISION = std::numeric_limits<double>::max_digits10;
 
@@ -38,24 +63,351 @@ constexpr auto INIT_TIME_LIMIT = std::chrono::seconds{60};
 constexpr auto FRAME_TIME_LIMIT = std::chrono::milliseconds{2000};
 constexpr auto UNLIMITED_TIME = std::chrono::hours{24};
 // Well, close enough to unlimited anyways.
+//! How long after a bot is killed its last output is still read for.
+constexpr auto TEARDOWN_TIME_LIMIT = std::chrono::milliseconds{1000};
+//! The most of a bot's stderr kept for its log; what came before is dropped.
+constexpr size_t STDERR_CAPTURE_SIZE = 64 * 1024;
+
+/**
+ * Sent to a persistent bot (see Networking::release_bot) after a game has
+ * ended. The bot should reset its state and wait for the next game's
+ * initialization, the same as after startup.
+ */
+constexpr auto NEW_GAME_SENTINEL = "NEW_GAME";
+
+/**
+ * A bot can ask for binary frames by following its name in its init
+ * response with a tab and this option. The initial map is still sent as
+ * text; every frame after that is binary.
+ *
+ * A binary frame is a little-endian uint32 length, followed by that many
+ * bytes of payload. The payload is laid out like the text map, except that
+ * every integer is a little-endian uint32 and every floating point value a
+ * little-endian IEEE 754 double:
+ *
+ *     num_players
+ *     per player: player_id num_ships
+ *         per ship (56 bytes): id health x y vel_x vel_y docking_status
+ *                              docked_planet docking_progress weapon_cooldown
+ *     num_planets
+ *     per planet (56 bytes): id health x y radius docking_spots
+ *                            current_production remaining_production
+ *                            owned owner num_docked_ships
+ *         followed by num_docked_ships ship IDs
+ *
+ * There is no trailing newline. Moves are still sent back as text.
+ */
+constexpr auto BINARY_FRAMES_OPTION = "binary-frames";
+
+/**
+ * Like BINARY_FRAMES_OPTION, a bot can ask for delta frames instead. Every
+ * frame after the initial map then only lists what changed since the
+ * previous frame, in the same text records as the full map:
+ *
+ *     num_players
+ *     per player: player_id
+ *                 num_destroyed_ships [ship IDs]
+ *                 num_changed_ships [ship records]
+ *     num_destroyed_planets [planet IDs]
+ *     num_changed_planets [planet records]
+ *
+ * A changed record replaces the previous one with the same ID, or is a new
+ * ship. Anything not listed is as it was.
+ */
+constexpr auto DELTA_FRAMES_OPTION = "delta-frames";
+
+/**
+ * A bot can also ask for its frames to be compressed, in whichever format
+ * it asked for, with this option, or with "zstd-frames=LEVEL" for a zstd
+ * compression level other than DEFAULT_FRAME_COMPRESSION_LEVEL. It's meant
+ * for remote bots (see Networking::accept_remote_bots), whose frames cross
+ * the network.
+ *
+ * The initial map is still sent as is. Every frame after it is sent as a
+ * little-endian uint32 length, followed by that many bytes of a zstd stream
+ * that runs through the whole game. The stream is flushed after every
+ * frame, so decompressing those bytes gives exactly the frame as it would
+ * have been sent uncompressed; later frames are compressed against the
+ * earlier ones. With a frame dictionary (see
+ * Networking::set_frame_dictionary) the stream uses it, naming it by its
+ * ID, and the bot must decompress with the same dictionary.
+ *
+ * Bots that asked for the same format and level share a stream, so each
+ * frame is compressed once for all of them. Frames through shared memory
+ * are not compressed.
+ */
+constexpr auto ZSTD_FRAMES_OPTION = "zstd-frames";
+constexpr int DEFAULT_FRAME_COMPRESSION_LEVEL = 3;
+
+/**
+ * With shared memory enabled (Linux only, see
+ * Networking::enable_shared_memory), every bot is started with
+ * SHARED_MEMORY_VARIABLE set to four file descriptors, separated by spaces:
+ *
+ *     frame moves frame_ready moves_ready
+ *
+ * frame is a read-only shared memory file of SHARED_FRAME_CAPACITY bytes,
+ * common to all bots, that starts with a SharedFrameHeader. moves is the
+ * bot's own shared memory file of SHARED_MOVES_CAPACITY bytes. The other
+ * two are eventfds.
+ *
+ * A bot that wants to use them adds SHARED_MEMORY_OPTION to its init
+ * response, like BINARY_FRAMES_OPTION. After the initial map, the game
+ * then writes 1 to frame_ready instead of sending each frame through
+ * stdin; the frame is in the section of the shared frame for the format
+ * the bot asked for, exactly as it would be sent through the pipe. The bot
+ * replies by writing the length of its moves (a native uint32) and then the
+ * moves (without a newline) to the start of its moves file, and writing 1
+ * to moves_ready. Its output is then only read once it has been killed, so
+ * it should not write much there.
+ */
+constexpr auto SHARED_MEMORY_OPTION = "shared-memory";
+constexpr auto SHARED_MEMORY_VARIABLE = "HALITE_SHARED_MEMORY";
+constexpr size_t SHARED_FRAME_CAPACITY = 64 << 20;
+constexpr size_t SHARED_MOVES_CAPACITY = 1 << 20;
+
+//! The start of the shared frame. All fields are native uint32s; offsets
+//! are from the start of the shared frame.
+struct SharedFrameHeader {
+    //! Incremented for every frame.
+    uint32_t sequence;
+    uint32_t text_offset, text_length;
+    uint32_t binary_offset, binary_length;
+    uint32_t delta_offset, delta_length;
+};
+
+/**
+ * Limits on the bots a Networking launches (see Networking::set_sandbox).
+ * Each is off when left at its default. They apply on POSIX systems only;
+ * CPU pinning needs Linux.
+ */
+struct BotSandbox {
+    //! CPUs to pin bots to, one each: every bot launched in the process
+    //! takes the next CPU in the list, wrapping around.
+    std::vector<int> cpus;
+    //! CPUs every bot may run on, all of them, if cpus is empty: those of
+    //! the cache domain its game was placed on (see --pin-games).
+    std::vector<int> cpu_domain;
+    //! The most memory (address space) each bot process may map, in bytes.
+    uint64_t memory_limit = 0;
+    //! The most CPU time each bot process may use over its lifetime, in
+    //! seconds. A bot over the limit is killed by the system.
+    unsigned int cpu_time_limit = 0;
+    //! Run bot commands directly instead of through /bin/sh. The command
+    //! is split into words at whitespace, and quotes group words, but no
+    //! other shell syntax is understood.
+    bool direct_exec = false;
+};
+
+/**
+ * Serialize the map as a text frame for a game of num_players (without the
+ * newline), as Networking::serialize_map does for the bots it has.
+ */
+void serialize_text_map(const hlt::Map& map, int num_players, std::string& out);
+
+#ifndef _WIN32
+/**
+ * Create a socket listening on address, either "unix:PATH" or "HOST:PORT"
+ * (see Networking::accept_remote_bots). tcp says which it was; the path of
+ * a Unix socket is left in unix_path, for the caller to remove when done.
+ *
+ * Throws std::runtime_error if the address can't be listened on.
+ */
+int listen_socket(const std::string& address, std::string& unix_path, bool& tcp);
+/**
+ * Delete the Unix socket at path, if that is what is there. Anything else
+ * (say, a file a mistyped address named) is left alone, and false returned.
+ */
+bool remove_socket_file(const std::string& path);
+#endif
 
 class Networking {
 public:
+    //! A turn's map, serialized once in each format bots asked for.
+    struct SerializedFrame {
+        std::string text;
+        std::string binary;
+        std::string delta;
+        //! For each compression stream (see ZSTD_FRAMES_OPTION), what its
+        //! bots are sent, length first.
+        std::vector<std::string> compressed;
+    };
+
+    //! How long a bot's response to a frame took, in microseconds.
+    struct ResponseTiming {
+        //! Time spent writing the frame to the bot.
+        long send_micros = 0;
+        //! Time from the frame being sent until the bot's reply was read.
+        long think_micros = 0;
+        /**
+         * When sending the frame started and ended, and when the reply was
+         * read and then parsed, for traces. Those the bot didn't get to
+         * (e.g. after timing out) are left at the epoch.
+         */
+        std::chrono::steady_clock::time_point send_start, sent, reply_read, reply_parsed;
+    };
+
+    /**
+     * Start a bot as the next player. A command starting with
+     * BuiltinBot::PREFIX is a built-in bot, which moves inside the engine
+     * and has no process.
+     */
     void launch_bot(std::string command);
-    int handle_init_networking(hlt::PlayerId player_tag,
-                               const hlt::Map& m,
-                               bool ignoreTimeout,
-                               std::string* playerName);
+#ifndef _WIN32
+    /**
+     * Listen on address, either "unix:PATH" or "HOST:PORT" (TCP; HOST is
+     * an IP address or localhost, and an empty HOST or * listens on every
+     * interface), for count bots running elsewhere, and add them as the
+     * next players in the order they connect. A bot first sends token on
+     * a line of its own; after that, the socket takes the place of its
+     * stdin and stdout, with the same messages in the same formats. Bots
+     * that send the wrong token are disconnected. Gives up once timeout
+     * has passed.
+     *
+     * Throws std::runtime_error if the address can't be listened on.
+     *
+     * @return The number of bots that connected.
+     */
+    unsigned int accept_remote_bots(const std::string& address,
+                                    const std::string& token,
+                                    unsigned int count,
+                                    std::chrono::milliseconds timeout);
+#endif
+    /**
+     * Send every bot the initial map, then wait on all of their replies
+     * together, up to init_time_limit after the last was sent (or without
+     * limit, with ignoreTimeout). Returns as soon as every bot has replied
+     * or errored, with the player names (or why a bot has none) in
+     * player_names.
+     *
+     * @return For each bot, the milliseconds it took, or -1 if it errored.
+     */
+    std::vector<int> handle_inits_networking(const hlt::Map& m,
+                                             bool ignoreTimeout,
+                                             std::chrono::milliseconds init_time_limit,
+                                             std::vector<std::string>& player_names);
+    /**
+     * Serialize the map as sent to bots each turn. The result is the same
+     * for every player, so it only needs to be computed once per turn.
+     * Reusing the same buffers across turns avoids reallocating them.
+     */
+    void serialize_frame(const hlt::Map& map, SerializedFrame& frame);
+    //! Serialize the map as a text frame (without the newline), whatever
+    //! format the bots asked for.
+    void serialize_map(const hlt::Map& map, std::string& out);
+    /**
+     * Parse a line of bot commands, queueing them into moves. Throws
+     * BotInputError if the line is invalid.
+     */
+    void deserialize_move_set(hlt::PlayerId player_tag,
+                              std::string& inputString,
+                              const hlt::Map& m,
+                              hlt::PlayerMoveQueue& moves);
+    //! Set the map that the first delta frame is relative to, i.e. the
+    //! initial map sent by handle_inits_networking.
+    void set_delta_base(const hlt::Map& map);
+    //! Set the constants of the game, which bot commands are checked
+    //! against (the tournament ones until then).
+    void set_constants(const hlt::GameConstants& constants_);
+    //! Don't print what the bots are up to (launches, timeouts, errors).
+    void set_quiet(bool quiet_output_);
+    //! Prefix what is printed with the given tag, e.g. which game it's from.
+    void set_log_tag(const std::string& log_tag_);
+    /**
+     * Give bots frame_limit_ to reply each turn (FRAME_TIME_LIMIT until
+     * then). With a nonzero time_bank_limit_, what a bot leaves unused on
+     * a turn is added to what it may use on the next, keeping at most
+     * time_bank_limit_ in hand; every bot's bank starts out empty.
+     */
+    void set_time_limits(std::chrono::milliseconds frame_limit_,
+                         std::chrono::milliseconds time_bank_limit_);
+    //! Launch bots from now on with the given limits.
+    void set_sandbox(const BotSandbox& sandbox_);
+    /**
+     * Compress frames for the bots that ask for it (see ZSTD_FRAMES_OPTION)
+     * with the zstd dictionary in the given file, e.g. one written by
+     * train_frame_dictionary. Must be set before handle_inits_networking.
+     *
+     * Throws std::runtime_error if the file can't be read.
+     */
+    void set_frame_dictionary(const std::string& filename);
+#ifdef HALITE_SHARED_MEMORY
+    /**
+     * Offer every bot launched from now on a shared memory transport (see
+     * SHARED_MEMORY_OPTION). Frames are then copied once into memory shared
+     * by all bots that accept.
+     *
+     * @return Whether the shared frame could be created.
+     */
+    bool enable_shared_memory();
+#endif
+    //! Send a frame (from serialize_frame) to a bot, and read its moves.
     int handle_frame_networking(hlt::PlayerId player_tag,
                                 const unsigned short& turnNumber,
                                 const hlt::Map& m,
+                                const SerializedFrame& frame,
                                 bool ignoreTimeout,
-                                hlt::PlayerMoveQueue& moves);
+                                hlt::PlayerMoveQueue& moves,
+                                ResponseTiming& timing);
+    /**
+     * Send a frame to every living bot, and read all of their moves.
+     *
+     * The bots are waited on together, each against its own deadline, so a
+     * turn takes as long as the slowest bot rather than needing a thread
+     * per bot.
+     *
+     * @return The time each bot took in milliseconds (as from
+     * handle_frame_networking), or -1 if it is dead or errored. The
+     * microsecond timings of the bots that replied are written to timings.
+     */
+    std::vector<int> handle_frames_networking(const unsigned short& turnNumber,
+                                              const hlt::Map& m,
+                                              const SerializedFrame& frame,
+                                              const std::vector<bool>& alive,
+                                              bool ignoreTimeout,
+                                              hlt::MoveQueue& moves,
+                                              std::vector<ResponseTiming>& timings);
+    /**
+     * Kill a bot, without waiting for it: what it had written is read and
+     * printed later, as part of handle_frames_networking or
+     * finish_teardowns (only if not quiet). On Windows, it is read before
+     * this returns, for up to TEARDOWN_TIME_LIMIT.
+     */
     void kill_player(hlt::PlayerId player_tag);
+    /**
+     * Wait until the bots killed so far are gone: their last output read
+     * (up to TEARDOWN_TIME_LIMIT after each was killed) and their
+     * processes reaped.
+     */
+    void finish_teardowns();
     bool is_process_dead(hlt::PlayerId player_tag);
     int player_count();
+    /**
+     * The CPU time a bot's processes have used while playing this game, in
+     * seconds: until now, or until it was killed or released.
+     *
+     * @return The time, or -1 if it can't be measured (outside Linux).
+     */
+    double cpu_time(hlt::PlayerId player_tag);
+    /**
+     * What a bot has written to its stderr in this game: the last
+     * STDERR_CAPTURE_SIZE bytes of it. Its stderr has a pipe of its own,
+     * read along with its output whenever the bots are waited on, so it
+     * neither mixes into the bot's moves nor blocks the bot.
+     *
+     * @param dropped If given, set to how many bytes came before those.
+     */
+    std::string stderr_output(hlt::PlayerId player_tag, uint64_t* dropped = nullptr) const;
+    /**
+     * The memory held by what was read from the bots and not yet handled,
+     * in bytes (see MemoryReport). Frames are serialized by the game, which
+     * counts them itself.
+     */
+    size_t memory_usage() const;
 
     std::vector<std::string> player_logs;
+    //! For each player, its "PlayerID", "PlayerName", "Init" entry and
+    //! "Error" (if it errored), for its log (see PlayerLog).
     nlohmann::json player_logs_json;
 
     bool is_single_player() {
@@ -65,28 +417,405 @@ public:
 private:
 #ifdef _WIN32
     struct WinConnection {
+        //! Our ends of the pipes, open for overlapped I/O.
         HANDLE write, read;
+        //! The bot's ends of the pipes, kept open until the bot is killed
+        //! (see UniConnection).
+        HANDLE child_read, child_write;
+        //! Our end of the bot's stderr pipe, or NULL once it has closed.
+        HANDLE error_read;
     };
     std::vector<WinConnection> connections;
+    //! The job object holding each bot's processes, so that killing it
+    //! also kills what cmd.exe started.
     std::vector<HANDLE> processes;
 #else
     struct UniConnection {
         int read, write;
+        //! The bot's ends of the pipes. These are kept open until the bot
+        //! is killed, so that a bot exiting shows up as a timeout.
+        int child_read, child_write;
+        //! Our end of the bot's stderr pipe (nonblocking), or -1 if it has
+        //! none or it has closed.
+        int error_read;
     };
     std::vector<UniConnection> connections;
     std::vector<int> processes;
+
+    //! A killed bot whose pipe is still being read (see kill_player).
+    struct Teardown {
+        hlt::PlayerId player_tag;
+        int read;
+        int process;
+        std::string output;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    std::vector<Teardown> teardowns;
+    //! Killed bots that hadn't exited when last checked on.
+    std::vector<int> unreaped;
+
+    //! Add a bot that connected to accept_remote_bots, and said what's in
+    //! received after its token.
+    void add_remote_bot(int socket, bool tcp, const std::string& received);
+
+    /**
+     * Read what the killed bots have left in their pipes, waiting up to
+     * timeout_millis for any of them, then print the output of those at
+     * the end of their pipe or past their deadline, and reap what exited.
+     */
+    void collect_teardowns(int timeout_millis);
 #endif
 
+public:
+    //! A running bot process, not attached to any game.
+    struct BotProcess {
+#ifdef _WIN32
+        WinConnection connection;
+        HANDLE process;
+#else
+        UniConnection connection;
+        int process;
+#endif
+    };
+
+    /**
+     * Detach a bot that is still running from this game, telling it with
+     * NEW_GAME_SENTINEL that another game will follow. The player is then
+     * treated as dead here, and the process can be given to another
+     * Networking with adopt_bot.
+     *
+     * @return The process, if the bot was still running and could be told.
+     */
+    hlt::possibly<BotProcess> release_bot(hlt::PlayerId player_tag);
+    //! Add a previously released bot as the next player, like launch_bot.
+    void adopt_bot(const BotProcess& bot);
+
+private:
     std::string serialize_map(const hlt::Map& map);
-    void deserialize_move_set(hlt::PlayerId player_tag,
-                              std::string& inputString,
-                              const hlt::Map& m,
-                              hlt::PlayerMoveQueue& moves);
+    //! Serialize the map as a binary frame (see BINARY_FRAMES_OPTION).
+    void serialize_binary_map(const hlt::Map& map, std::string& out);
+    //! Serialize the changes from before to map (see DELTA_FRAMES_OPTION).
+    void serialize_delta_map(const hlt::Map& before, const hlt::Map& map,
+                             std::string& out);
+
+    enum class FrameFormat {
+        Text,
+        Binary,
+        Delta,
+        //! Built-in bots are sent nothing.
+        None,
+    };
+    //! The built-in players (see launch_bot), until they are killed.
+    std::map<hlt::PlayerId, BuiltinBot> builtin_bots;
+    //! Add a built-in bot as the next player. Throws 1 for an unknown one,
+    //! like launch_bot.
+    void add_builtin_bot(const std::string& command);
+    //! Start a built-in bot's game, as handle_inits_networking would.
+    int handle_builtin_init(hlt::PlayerId player_tag, const hlt::Map& m,
+                            std::string* playerName);
+    //! Queue the moves of the living built-in bots, which take no time.
+    void play_builtin_bots(const hlt::Map& m,
+                           const std::vector<bool>& alive,
+                           hlt::MoveQueue& moves,
+                           std::vector<int>& times);
+    //! Print a message through the console log, unless quiet.
+    void log(LogLevel level, const std::string& message);
+    void print_killed_output(hlt::PlayerId player_tag, const std::string& output);
+    //! The map as of the last frame sent, for delta frames.
+    hlt::Map delta_base;
+    hlt::GameConstants constants;
+    bool quiet_output = false;
+    std::string log_tag;
+    std::chrono::microseconds frame_limit = FRAME_TIME_LIMIT;
+    std::chrono::microseconds time_bank_limit = std::chrono::microseconds::zero();
+    //! The time each bot has saved up (see set_time_limits).
+    std::vector<std::chrono::microseconds> time_banks;
+    BotSandbox sandbox;
+    //! The CPU time each bot had used when it joined the game, and when it
+    //! left it (-1 while it's playing).
+    std::vector<double> cpu_time_start, cpu_time_end;
+    //! The CPU time a running bot has used since it was launched, or -1.
+    double measure_cpu_time(hlt::PlayerId player_tag);
+
+    //! How long a bot may take to reply this turn.
+    auto frame_allowance(hlt::PlayerId player_tag, bool ignoreTimeout)
+        -> std::chrono::microseconds;
+    //! Update a bot's time bank, after it replied in used of allowance.
+    void spend_time(hlt::PlayerId player_tag,
+                    std::chrono::microseconds allowance,
+                    std::chrono::microseconds used);
+    //! The format each bot asked for in its init response.
+    std::vector<FrameFormat> frame_formats;
+
+    //! The zstd stream frames of one format are compressed into at one
+    //! level, for the bots that asked for that (see ZSTD_FRAMES_OPTION).
+    struct CompressionStream {
+        FrameFormat format;
+        int level;
+        std::unique_ptr<ZSTD_CCtx_s, size_t (*)(ZSTD_CCtx_s*)> stream;
+    };
+    std::vector<CompressionStream> compression_streams;
+    //! Each bot's compression stream, or -1 if it is sent frames as they are.
+    std::vector<int> frame_compression;
+    //! The dictionary compression streams start with, if any.
+    std::string frame_dictionary;
+    //! The compression stream for a format and level, started if new.
+    //! Throws std::runtime_error if zstd can't start one.
+    int compression_stream(FrameFormat format, int level);
+    //! Compress the next frame of a stream into out, its length first.
+    void compress_frame(CompressionStream& stream, const std::string& frame,
+                        std::string& out);
+    //! The part of a serialized frame to send to the given bot.
+    const std::string& frame_for(hlt::PlayerId player_tag,
+                                 const SerializedFrame& frame) const;
+    //! Start sending a bot its part of a frame, through its pipe (see
+    //! start_write) or shared memory.
+    void send_frame(hlt::PlayerId player_tag, const SerializedFrame& frame);
+
+#ifdef HALITE_SHARED_MEMORY
+    struct SharedChannel {
+        //! The bot's moves file, and where it is mapped.
+        int moves_fd = -1;
+        char* moves = nullptr;
+        int frame_ready = -1, moves_ready = -1;
+        //! Whether the bot accepted the channel in its init response.
+        bool active = false;
+    };
+    //! Each bot's channel; moves is null if it was not offered one.
+    std::vector<SharedChannel> shared_channels;
+    //! The shared frame, and the read-only descriptor given to bots.
+    char* shared_frame = nullptr;
+    int shared_frame_fd = -1;
+    uint32_t shared_frame_sequence = 0;
+    //! Whether the last frame fit into SHARED_FRAME_CAPACITY.
+    bool shared_frame_fits = true;
+
+    //! Copy a frame into shared memory, if any bot accepted its channel.
+    void publish_shared_frame(const SerializedFrame& frame);
+    //! Free a dead or released bot's channel (and the shared frame, once
+    //! no bots are left).
+    void close_shared_channel(hlt::PlayerId player_tag);
+#endif
+    /**
+     * Send a line, then its newline (written after it rather than appended
+     * to a copy), waiting up to timeout_millis for the bot to read what
+     * does not fit in its pipe.
+     */
+    void send_string(hlt::PlayerId player_tag, const std::string& sendString,
+                     long timeout_millis);
 
-    void send_string(hlt::PlayerId player_tag, std::string& sendString);
+    /**
+     * What is left to write to a bot: the rest of data, then the rest of
+     * more. Both point into strings owned by the caller of start_write,
+     * which must outlive the write.
+     */
+    struct PendingWrite {
+        const char* data[2] = {nullptr, nullptr};
+        size_t size[2] = {0, 0};
+
+        auto done() const -> bool { return size[0] + size[1] == 0; }
+    };
+    std::vector<PendingWrite> pending_writes;
+
+    /**
+     * Write as much of data (followed by more, if given) as the bot's pipe
+     * takes without blocking, and leave the rest pending, for the I/O loop
+     * to write once the pipe has room (see wait_for_bots). Throws if a
+     * write is already pending.
+     */
+    void start_write(hlt::PlayerId player_tag, const std::string& data,
+                     const std::string* more = nullptr);
+    //! Whether part of a bot's last write is still pending.
+    bool write_pending(hlt::PlayerId player_tag) const;
+    //! Write more of a bot's pending write; throws if the pipe is broken.
+    void continue_write(hlt::PlayerId player_tag);
+    //! Wait up to timeout_millis for a bot's pending write to finish.
+    void finish_write(hlt::PlayerId player_tag, long timeout_millis);
     std::string get_string(hlt::PlayerId player_tag,
                            unsigned int timeout_millis);
     std::string read_trailing_input(hlt::PlayerId player_tag, long max_lines=20);
+
+    //! How much to read from a bot at once.
+    static constexpr int READ_CHUNK_SIZE = 16384;
+    //! Returned by fill_read_buffer if the pipe could not be read.
+    static constexpr int READ_FAILED = -2;
+
+    /**
+     * Bytes read from a bot that have not been returned yet. Bytes before
+     * start have already been consumed.
+     */
+    struct ReadBuffer {
+        std::vector<char> data;
+        size_t start = 0;
+
+        //! Drop consumed bytes once they make up most of the buffer.
+        auto compact() -> void;
+    };
+    std::vector<ReadBuffer> read_buffers;
+
+    //! The tail of what a bot wrote to its stderr (see stderr_output).
+    struct StderrCapture {
+        //! Grows up to STDERR_CAPTURE_SIZE, then wraps around at next.
+        std::vector<char> ring;
+        size_t next = 0;
+        //! Everything the bot wrote, including what was dropped.
+        uint64_t total = 0;
+
+        auto append(const char* data, size_t size) -> void;
+        //! What is kept, oldest first.
+        auto contents() const -> std::string;
+    };
+    std::vector<StderrCapture> stderr_captures;
+
+    /**
+     * Wait up to timeout_millis for output from a bot, and append whatever
+     * is available (up to READ_CHUNK_SIZE bytes) to its read buffer.
+     *
+     * @return The number of bytes read, 0 on timeout, or a negative value
+     * on error (READ_FAILED if the bot closed its output).
+     */
+    int fill_read_buffer(hlt::PlayerId player_tag, int timeout_millis);
+    /**
+     * Wait up to timeout_millis for output from any of the waiting bots, or
+     * for room in the pipe of one with a pending write, then read what
+     * they wrote and continue their writes. The error each bot's pipe hit
+     * is left in errors, which follows waiting (null if there was none).
+     */
+    void wait_for_bots(const std::vector<hlt::PlayerId>& waiting,
+                       long timeout_millis,
+                       std::vector<std::exception_ptr>& errors);
+    //! The error for a bot that did not reply within timeout_millis.
+    BotInputError timeout_error(hlt::PlayerId player_tag,
+                                int poll_result, int timeout_millis);
+    //! The error for a bot that did not read all of what it was sent in
+    //! time. Drops the pending write.
+    BotInputError write_timeout_error(hlt::PlayerId player_tag);
+    //! The error for a bot whose output could not be read.
+    BotInputError read_failed_error(hlt::PlayerId player_tag);
+#ifdef _WIN32
+    /**
+     * The reads and writes in flight on a bot's pipes. Each has its own
+     * event, which is signalled once it completes; the kernel writes into
+     * the OVERLAPPED and chunk until then, so they must not move.
+     */
+    struct PipeIo {
+        OVERLAPPED read, write, error;
+        bool reading = false, writing = false, error_reading = false;
+        char chunk[READ_CHUNK_SIZE];
+        char error_chunk[READ_CHUNK_SIZE];
+
+        PipeIo();
+        ~PipeIo();
+    };
+    //! Each bot's, or null for built-in (or dead) bots.
+    std::vector<std::unique_ptr<PipeIo>> pipe_io;
+    //! The events wait_for_bots waits on.
+    std::vector<HANDLE> wait_events;
+
+    /**
+     * Make sure a read from a bot's pipe into its chunk is in flight.
+     *
+     * @return Whether it is; false if the pipe is broken.
+     */
+    bool start_read(hlt::PlayerId player_tag);
+    //! Append what a completed read gave to the bot's read buffer.
+    //! Returns like fill_read_buffer.
+    int finish_read(hlt::PlayerId player_tag);
+    //! Cancel a bot's reads and writes in flight, and wait until they are
+    //! done with its buffers. Whatever was already read is kept.
+    void cancel_io(hlt::PlayerId player_tag);
+    //! Keep what a completed stderr read gave, and start the next one.
+    //! Closes the pipe once it has ended.
+    void continue_stderr(hlt::PlayerId player_tag);
+    /**
+     * Wait on events, along with the stderr pipes of every bot, until one
+     * of events is signalled or timeout_millis has passed. Keeps what each
+     * bot writes to stderr meanwhile.
+     *
+     * @return Like WaitForMultipleObjects, for events only.
+     */
+    DWORD wait_events_with_stderr(std::vector<HANDLE>& events, DWORD timeout_millis);
+#else
+    //! What wait_for_bots polls.
+    std::vector<struct pollfd> poll_fds;
+    std::vector<size_t> poll_write_slots;
+    //! Whose stderr pipe each entry poll_with_stderr adds is.
+    std::vector<hlt::PlayerId> stderr_players;
+
+    //! Keep whatever a bot has written to stderr, without blocking.
+    //! Closes the pipe once it has ended.
+    void read_stderr(hlt::PlayerId player_tag);
+    /**
+     * poll() fds, along with the stderr pipes of every bot, until one of
+     * fds is ready or timeout_millis has passed. Keeps what each bot
+     * writes to stderr meanwhile.
+     *
+     * @return Like poll(), for fds only.
+     */
+    int poll_with_stderr(std::vector<struct pollfd>& fds, int timeout_millis);
+    //! What to poll() for the bot's replies: its output pipe, or its
+    //! moves_ready eventfd.
+    int input_fd(hlt::PlayerId player_tag) const;
+    //! Append whatever a bot has written (up to READ_CHUNK_SIZE bytes, or
+    //! its moves slot as a line) to its read buffer, once poll() has
+    //! reported it readable.
+    int read_available(hlt::PlayerId player_tag);
+    /**
+     * Add a POLLOUT entry to fds for each waiting bot with a pending write,
+     * after the input entries, and note where it is in write_slots (which
+     * follows waiting).
+     */
+    void poll_pending_writes(const std::vector<hlt::PlayerId>& waiting,
+                             std::vector<struct pollfd>& fds,
+                             std::vector<size_t>& write_slots);
+    //! If poll() reported a bot's pipe writable at write_slot, write more,
+    //! returning the error if that failed.
+    std::exception_ptr continue_polled_write(hlt::PlayerId player_tag,
+                                             const std::vector<struct pollfd>& fds,
+                                             size_t write_slot);
+#endif
+    /**
+     * Remove the first complete line from a bot's read buffer, without the
+     * line ending.
+     *
+     * @return Whether there was a complete line.
+     */
+    bool take_buffered_line(hlt::PlayerId player_tag, std::string& line);
+    //! Remove and return everything in a bot's read buffer.
+    std::string take_buffered_input(hlt::PlayerId player_tag);
+
+    /**
+     * Read a bot's moves for a turn using the given exchange, which fills
+     * in the bot's response and returns the milliseconds taken, or
+     * throws. Errors are recorded in the bot's log.
+     *
+     * @return The milliseconds taken, or -1 if the bot errored.
+     */
+    int handle_frame_response(hlt::PlayerId player_tag,
+                              const unsigned short& turnNumber,
+                              const hlt::Map& m,
+                              hlt::PlayerMoveQueue& moves,
+                              const std::function<long(std::string&)>& exchange);
+
+    /**
+     * Start sending a bot its ID, the map size and the initial map. The
+     * map is the same for every bot, so it is serialized once, with its
+     * newline, into map_line. header holds the ID and map size lines.
+     * Both must outlive the write.
+     */
+    void send_init(hlt::PlayerId player_tag, const std::string& header,
+                   const std::string& map_line);
+    /**
+     * Handle a bot's init response, like handle_frame_response: exchange
+     * gets the response (or throws if there is none) and returns the
+     * milliseconds the bot took. Records the bot's name and the protocol
+     * options it asked for.
+     *
+     * @return The milliseconds taken, or -1 if the bot errored.
+     */
+    int handle_init_response(hlt::PlayerId player_tag,
+                             std::string* playerName,
+                             const std::function<long(std::string&)>& exchange);
 };
 
 #endif
@@ -0,0 +1,152 @@
+"""Batches of in-process Halite games, for learners in Python.
+
+A thin ctypes wrapper around the engine's C interface (core/BatchApi.hpp),
+built as the shared library libhalite with -DHALITE_SHARED_LIBRARY=ON:
+
+    cmake -DHALITE_SHARED_LIBRARY=ON .. && make halite_shared
+
+The engine stays the only simulator. Nothing is serialized between it and
+Python: moves go in as arrays of integers, and observations are a view of
+the array the engine writes them to, which is updated in place by every
+step and reset (so copy it to keep an observation). ctypes releases the
+GIL while the engine steps, and the games of a batch are stepped on up to
+`threads` threads.
+
+    batch = Batch(num_games=64, width=240, height=160, num_players=2)
+    obs = batch.observations()     # games x floats, no copy
+    batch.step([(game, player, ship, THRUST, 7, 90), ...])
+"""
+
+import ctypes
+import os
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+# Command types, as hlt::MoveType
+THRUST = 1
+DOCK = 2
+UNDOCK = 3
+
+# The values of each command: game, player, ship, type, then the thrust and
+# angle, or the planet to dock to
+MOVE_FIELDS = 6
+
+# The columns of a ship's row, a planet's row and the values after them, as
+# BatchHalite::ShipFeature, PlanetFeature and GameFeature
+SHIP_FEATURES = ("present", "id", "owner", "x", "y", "vel_x", "vel_y",
+                 "health", "docking_status", "docked_planet",
+                 "weapon_cooldown")
+PLANET_FEATURES = ("alive", "x", "y", "radius", "health", "owned", "owner",
+                   "docked_ships", "docking_spots", "remaining_production",
+                   "current_production")
+GAME_FEATURES = ("turn", "over", "ships")  # then one "alive" per seat
+
+
+def _load_library(path=None):
+    if path is None:
+        path = os.environ.get("HALITE_LIBRARY", "libhalite.so")
+    library = ctypes.CDLL(path)
+
+    batch_p = ctypes.c_void_p
+    library.halite_batch_create.restype = batch_p
+    library.halite_batch_create.argtypes = [ctypes.c_uint] * 8
+    library.halite_batch_destroy.argtypes = [batch_p]
+    library.halite_batch_size.restype = ctypes.c_uint
+    library.halite_batch_size.argtypes = [batch_p]
+    library.halite_batch_layout.argtypes = [batch_p, ctypes.POINTER(ctypes.c_size_t)]
+    library.halite_batch_observations.restype = ctypes.POINTER(ctypes.c_float)
+    library.halite_batch_observations.argtypes = [batch_p]
+    library.halite_batch_step.restype = ctypes.c_int
+    library.halite_batch_step.argtypes = [batch_p, ctypes.POINTER(ctypes.c_int32),
+                                          ctypes.c_size_t]
+    library.halite_batch_reset.restype = ctypes.c_int
+    library.halite_batch_reset.argtypes = [batch_p, ctypes.c_uint, ctypes.c_uint]
+    library.halite_batch_error.restype = ctypes.c_char_p
+    library.halite_batch_error.argtypes = [batch_p]
+    return library
+
+
+class Batch(object):
+    """num_games games, with seeds first_seed, first_seed + 1 and so on.
+
+    Observations have room for max_ships ships (of all players together)
+    and max_planets planets per game, as with BatchHalite. library is the
+    path to libhalite, or $HALITE_LIBRARY, or libhalite.so on the library
+    path.
+    """
+
+    def __init__(self, num_games, width, height, num_players, first_seed=0,
+                 max_ships=256, max_planets=32, threads=1, library=None):
+        self._library = _load_library(library)
+        self._batch = self._library.halite_batch_create(
+            num_games, width, height, num_players, first_seed,
+            max_ships, max_planets, threads)
+        if not self._batch:
+            raise RuntimeError(self._library.halite_batch_error(None).decode())
+
+        layout = (ctypes.c_size_t * 6)()
+        self._library.halite_batch_layout(self._batch, layout)
+        (self.observation_size, self.ship_rows, self.ship_features,
+         self.planet_rows, self.planet_features, self.game_features) = layout
+        self.num_games = self._library.halite_batch_size(self._batch)
+        self._observations = self._library.halite_batch_observations(self._batch)
+
+    def close(self):
+        if self._batch:
+            self._library.halite_batch_destroy(self._batch)
+            self._batch = None
+
+    def __del__(self):
+        self.close()
+
+    def observations(self):
+        """Every game's observation, as a num_games x observation_size
+        NumPy array (a memoryview without NumPy) over the engine's own
+        array. Slice it with ship_slice, planet_slice and game_slice."""
+        count = self.num_games * self.observation_size
+        array = ctypes.cast(self._observations,
+                            ctypes.POINTER(ctypes.c_float * count)).contents
+        if numpy is not None:
+            return numpy.frombuffer(array, dtype=numpy.float32).reshape(
+                self.num_games, self.observation_size)
+        return memoryview(array).cast("B").cast(
+            "f", (self.num_games, self.observation_size))
+
+    def ship_slice(self):
+        return slice(0, self.ship_rows * self.ship_features)
+
+    def planet_slice(self):
+        start = self.ship_rows * self.ship_features
+        return slice(start, start + self.planet_rows * self.planet_features)
+
+    def game_slice(self):
+        return slice(self.observation_size - self.game_features,
+                     self.observation_size)
+
+    def step(self, moves):
+        """Play a turn of every game that isn't over.
+
+        moves is a sequence of (game, player, ship, type, arg1, arg2)
+        commands, or an int32 NumPy array of them (taken without copying),
+        with type one of THRUST (arg1 the thrust, arg2 the angle), DOCK
+        (arg1 the planet) and UNDOCK.
+        """
+        if numpy is not None and isinstance(moves, numpy.ndarray):
+            commands = numpy.ascontiguousarray(moves, dtype=numpy.int32)
+            count = commands.size // MOVE_FIELDS
+            pointer = commands.ctypes.data_as(ctypes.POINTER(ctypes.c_int32))
+        else:
+            flat = [int(value) for command in moves for value in command]
+            count = len(flat) // MOVE_FIELDS
+            commands = (ctypes.c_int32 * len(flat))(*flat)
+            pointer = ctypes.cast(commands, ctypes.POINTER(ctypes.c_int32))
+        if self._library.halite_batch_step(self._batch, pointer, count) != 0:
+            raise ValueError(self._library.halite_batch_error(self._batch).decode())
+
+    def reset(self, index, seed):
+        """Start a new game in slot index."""
+        if self._library.halite_batch_reset(self._batch, index, seed) != 0:
+            raise IndexError(self._library.halite_batch_error(self._batch).decode())
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#define ZSTD_STATIC_LINKING_ONLY
 #include "lib/zstd.h"
 
 ZSTD_inBuffer* ZSTDshim_makeInBuffer(void* buffIn, size_t size) {
@@ -26,7 +27,10 @@ size_t ZSTDshim_outBufferPos(ZSTD_outBuffer *buffer) {
   return buffer->pos;
 }
 
-char* ZSTDshim_decompress(void* buff, size_t size, size_t* outputSize) {
+/* dict may be NULL (with dictSize 0) for replays compressed without one. */
+char* ZSTDshim_decompress_usingDict(void* buff, size_t size,
+                                    const void* dict, size_t dictSize,
+                                    size_t* outputSize) {
   void* buffIn = malloc(ZSTD_DStreamInSize());
   void* buffOut = malloc(ZSTD_DStreamOutSize());
   size_t pos = 0;
@@ -36,7 +40,7 @@ char* ZSTDshim_decompress(void* buff, size_t size, size_t* outputSize) {
     return NULL;
   }
 
-  size_t const initResult = ZSTD_initDStream(dstream);
+  size_t const initResult = ZSTD_initDStream_usingDict(dstream, dict, dictSize);
   if (ZSTD_isError(initResult)) {
     return NULL;
   }
@@ -73,3 +77,7 @@ char* ZSTDshim_decompress(void* buff, size_t size, size_t* outputSize) {
   *outputSize = resultSize;
   return result;
 }
+
+char* ZSTDshim_decompress(void* buff, size_t size, size_t* outputSize) {
+  return ZSTDshim_decompress_usingDict(buff, size, NULL, 0, outputSize);
+}
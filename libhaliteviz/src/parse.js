@@ -1,7 +1,55 @@
 const parseWorker = require("worker-loader?inline!./parseWorker");
 import {TextDecoder} from 'text-encoding';
 
-export function parseReplay(buffer) {
+/**
+ * Turn the delta frames of a replay (version 32 and up, when it has a
+ * keyframe_interval) back into full frames, in place. Each delta frame only
+ * holds the ships and planets that changed since the frame before, and the
+ * IDs of those destroyed.
+ */
+export function expandDeltaFrames(replay) {
+    if (!replay.keyframe_interval) {
+        return replay;
+    }
+
+    const frames = [];
+    for (const frame of replay.frames) {
+        if (frame.keyframe) {
+            frames.push(frame);
+            continue;
+        }
+
+        const previous = frames[frames.length - 1];
+        const ships = {};
+        for (const playerId of Object.keys(previous.ships || {})) {
+            ships[playerId] = Object.assign(
+                {}, previous.ships[playerId], frame.ships[playerId]);
+            for (const shipId of frame.destroyed_ships[playerId] || []) {
+                delete ships[playerId][shipId];
+            }
+        }
+
+        const planets = Object.assign({}, previous.planets, frame.planets);
+        for (const planetId of frame.destroyed_planets) {
+            delete planets[planetId];
+        }
+
+        const expanded = { ships: ships, planets: planets };
+        if (frame.events) {
+            expanded.events = frame.events;
+        }
+        frames.push(expanded);
+    }
+
+    replay.frames = frames;
+    return replay;
+}
+
+/**
+ * Decode a replay. Replays compressed with a zstd dictionary (halite
+ * --replay-dictionary) need the same dictionary, as an ArrayBuffer.
+ */
+export function parseReplay(buffer, dictionary) {
     return new Promise((resolve, reject) => {
         try {
             const startTime = Date.now();
@@ -16,12 +64,17 @@ export function parseReplay(buffer) {
                     return;
                 }
                 const decoded = new TextDecoder("utf-8").decode(arr);
-                const replay = JSON.parse(decoded);
+                const replay = expandDeltaFrames(JSON.parse(decoded));
                 const finishTime = Date.now();
                 console.info(`Decoded compressed replay in ${finishTime - startTime}ms, inflating took ${inflatedTime - startTime}ms, decoding took ${finishTime - inflatedTime}ms.`);
                 resolve(replay);
             };
-            worker.postMessage(buffer, [buffer]);
+            if (dictionary) {
+                worker.postMessage({ buffer, dictionary }, [buffer]);
+            }
+            else {
+                worker.postMessage(buffer, [buffer]);
+            }
             if (buffer.byteLength) {
                 console.warn("Transferrables not supported, could not decode without copying data!");
             }
@@ -28,6 +28,13 @@ const ZSTDshim_decompress = libzstdInstance.cwrap(
     "number",
     ["number", "number", "number"]
 );
+// Only in libzstd.js builds from make_emscripten_zstd.sh that export it
+const ZSTDshim_decompress_usingDict =
+    libzstdInstance._ZSTDshim_decompress_usingDict ? libzstdInstance.cwrap(
+        "ZSTDshim_decompress_usingDict",
+        "number",
+        ["number", "number", "number", "number", "number"]
+    ) : null;
 
 
 function malloc(size) {
@@ -38,8 +45,11 @@ function malloc(size) {
 }
 
 
+// Messages are either the replay's ArrayBuffer, or {buffer, dictionary}
+// for replays compressed with a dictionary (halite --replay-dictionary).
 addEventListener("message", (e) => {
-    const buffer = e.data;
+    const buffer = e.data instanceof ArrayBuffer ? e.data : e.data.buffer;
+    const dictionary = e.data instanceof ArrayBuffer ? null : e.data.dictionary;
     try {
         const inflated = pako.inflate(buffer);
         console.log("Replay was gzipped");
@@ -60,7 +70,23 @@ addEventListener("message", (e) => {
         heapBufferView.set(new Uint8Array(buffer));
 
         const [resultSize, resultSizeView] = malloc(4);
-        const result = ZSTDshim_decompress(heapBufferView.byteOffset, byteView.length, resultSizeView.byteOffset);
+        let result;
+        if (dictionary) {
+            if (!ZSTDshim_decompress_usingDict) {
+                throw new Error("libzstd.js was built without dictionary support");
+            }
+            const dictionaryView = new Uint8Array(dictionary);
+            const [heapDictionary, heapDictionaryView] = malloc(dictionaryView.length);
+            heapDictionaryView.set(dictionaryView);
+            result = ZSTDshim_decompress_usingDict(
+                heapBufferView.byteOffset, byteView.length,
+                heapDictionaryView.byteOffset, dictionaryView.length,
+                resultSizeView.byteOffset);
+            libzstdInstance._free(heapDictionary);
+        }
+        else {
+            result = ZSTDshim_decompress(heapBufferView.byteOffset, byteView.length, resultSizeView.byteOffset);
+        }
         if (result === 0) {
             // TODO: get error
             console.error("Could not decompress replay.");
@@ -12,10 +12,13 @@
 #      See the License for the specific language governing permissions and
 #      limitations under the License.
 
+import os
+import queue
 import random
 import sys
 import math
 import argparse
+import threading
 
 import skills
 from skills import trueskill
@@ -49,20 +52,32 @@ class Manager:
         self.keep_logs = True
         self.priority_sigma = True
         self.exclude_inactive = False
+        self.jobs = 1
+        self.slow_turn_ms = 0
+        self.verify_replays = False
         self.db = database.Database(db_filename)
 
-    def run_round(self, contestants, width, height, seed):
-        m = match.Match(contestants, width, height, seed, 2 * len(contestants) * max_match_rounds(width, height), self.keep_replays, self.keep_logs)
+    def record_round(self, m):
+        """ Rate a match that has been played, and store its results """
         print(m)
         try:
-            m.run_match(self.halite_binary)
+            if m.error:
+                print("Match not rated: " + m.error)
+                return
+            slow = m.slow_phases(self.slow_turn_ms) if self.slow_turn_ms > 0 else []
+            if slow:
+                print("Slow match (engine turns over %g ms): %s" % (self.slow_turn_ms, ", ".join(slow)))
+            if self.verify_replays and not m.verify_replay(self.halite_binary):
+                print("Match not rated: its replay does not play out the same")
+                return
+            m.finish()
             print(m)
-            self.save_players(contestants)
+            self.save_players(m.players)
             self.db.update_player_ranks()
             self.db.add_match(m)
             self.show_ranks()
         except Exception as e:
-            print("Exception in run_round:")
+            print("Exception in record_round:")
             print(e)
 
     def save_players(self, players):
@@ -95,13 +110,53 @@ class Manager:
     def run_rounds_unix(self, player_dist, map_dist):
         from keyboard_detection import keyboard_detection
         with keyboard_detection() as key_pressed:
-            while not key_pressed() and ((self.rounds < 0) or (self.round_count < self.rounds)):
-                self.setup_round(player_dist, map_dist)
+            self.run_concurrent_rounds(player_dist, map_dist, key_pressed)
 
     def run_rounds_windows(self, player_dist, map_dist):
         import msvcrt
-        while not  msvcrt.kbhit()and ((self.rounds < 0) or (self.round_count < self.rounds)):
-            self.setup_round(player_dist, map_dist)
+        self.run_concurrent_rounds(player_dist, map_dist, msvcrt.kbhit)
+
+    def run_concurrent_rounds(self, player_dist, map_dist, stop_requested):
+        """ Keep up to self.jobs matches running, each pinned to its own share
+        of the cores. Matches are rated in the order they were started, not
+        the order they finish in, so the ratings only depend on the random
+        seed and the results. """
+        results = queue.Queue()
+        free_slots = list(range(self.jobs))
+        started = 0
+        recorded = 0
+        finished = {}
+
+        def play(index, slot, m):
+            try:
+                m.play(self.halite_binary, self.slot_cpus(slot), self.slow_turn_ms > 0)
+            except Exception as e:
+                m.error = "Exception while playing: " + str(e)
+            results.put((index, slot, m))
+
+        while True:
+            while free_slots and not stop_requested() and ((self.rounds < 0) or (started < self.rounds)):
+                m = self.setup_round(player_dist, map_dist)
+                threading.Thread(target=play, args=(started, free_slots.pop(), m), daemon=True).start()
+                started += 1
+            if recorded == started:
+                break
+            index, slot, m = results.get()
+            free_slots.append(slot)
+            finished[index] = m
+            while recorded in finished:
+                self.record_round(finished.pop(recorded))
+                recorded += 1
+                self.round_count += 1
+
+    def slot_cpus(self, slot):
+        """ The cores the matches of a slot run on: every jobs'th one """
+        if not hasattr(os, "sched_getaffinity") or self.jobs < 2:
+            return None
+        cpus = sorted(os.sched_getaffinity(0))
+        if len(cpus) < self.jobs:
+            return {cpus[slot % len(cpus)]}
+        return set(cpus[slot::self.jobs])
 
     def setup_round (self, player_dist, map_dist):
         if self.players_max > 3:
@@ -114,9 +169,8 @@ class Manager:
         size_w = random.choice(map_dist) * 3
         size_h = int((size_w / 3) * 2)
         seed = random.randint(10000, 2073741824)
-        print ("\n------------------- running new match... -------------------\n")
-        self.run_round(contestants, size_w, size_h, seed)
-        self.round_count += 1
+        print ("\n------------------- starting new match... -------------------\n")
+        return match.Match(contestants, size_w, size_h, seed, 2 * len(contestants) * max_match_rounds(size_w, size_h), self.keep_replays, self.keep_logs)
 
     def add_player(self, name, path):
         p = self.db.get_player((name,))
@@ -260,6 +314,22 @@ class Commandline:
                                  action = "store", default = "db.sqlite3",
                                  help = 'Specify the database filename')
 
+        self.parser.add_argument('-j', '--jobs', dest = 'jobs', type = int,
+                                 action = 'store', default = 1,
+                                 help = 'Number of matches played at once, each on its own share of the cores')
+
+        self.parser.add_argument('--seed', dest = 'seed', type = int,
+                                 action = 'store', default = None,
+                                 help = 'Seed for picking contestants, maps and seeds, to repeat a run')
+
+        self.parser.add_argument('--slow-turn-ms', dest = 'slow_turn_ms', type = float,
+                                 action = 'store', default = 50.0,
+                                 help = 'Report matches whose engine turns take longer than this on average (0 to turn off)')
+
+        self.parser.add_argument('--verify-replays', dest = 'verify_replays',
+                                 action = 'store_true', default = False,
+                                 help = 'Only rate matches whose replay plays out the same in the engine')
+
         self.parser.add_argument('--edit', dest = 'editBot',
                                  action = 'store', default = '',
                                  help = 'Edit the path of the named bot')
@@ -317,6 +387,12 @@ class Commandline:
             print("keep_logs = False")
             self.manager.keep_logs= False
             
+        self.manager.jobs = max(1, self.cmds.jobs)
+        self.manager.slow_turn_ms = self.cmds.slow_turn_ms
+        self.manager.verify_replays = self.cmds.verify_replays
+        if self.cmds.seed is not None:
+            random.seed(self.cmds.seed)
+
         if self.cmds.equalPriority:
             print("priority_sigma = False")
             self.manager.priority_sigma = False
@@ -3,6 +3,8 @@ import os
 import copy
 import json
 import shutil
+import signal
+import subprocess
 import skills
 from skills import trueskill
 from subprocess import Popen, PIPE, call
@@ -46,6 +48,8 @@ class Match:
         self.parameters = None
         self.logs = None
         self.map_generator = None
+        self.profile = None
+        self.error = None
 
     def __repr__(self):
         title1 = "Match between " + ", ".join([p.name for p in self.players]) + "\n"
@@ -55,21 +59,75 @@ class Match:
         replay = self.replay_file + "\n" #\n"
         return title1 + title2 + dims + results + replay
 
-    def get_command(self, halite_binary):
+    def get_command(self, halite_binary, profile=False):
         dims = "-d " + str(self.map_width) + " " + str(self.map_height)
         quiet = "-q"
         seed = "-s " + str(self.map_seed)
         result = [halite_binary, dims, quiet, seed]
+        if profile:
+            result.append("--profile")
         return result + self.paths
 
     def run_match(self, halite_binary):
-        command = self.get_command(halite_binary)
+        self.play(halite_binary)
+        if self.error:
+            raise RuntimeError(self.error)
+        self.finish()
+
+    def play(self, halite_binary, cpus=None, profile=False):
+        """ Run the game and read its results, without touching the ratings,
+        so that several matches can be played at once on different threads.
+        If cpus is given, the engine and its bots only run on those cores.
+        Sets self.error if the game did not finish in time or failed. """
+        command = self.get_command(halite_binary, profile)
         print("Command = " + str(command))
-        p = Popen(command, stdin=None, stdout=PIPE, stderr=None)
-        results, _ = p.communicate(None, self.total_time_limit)
+
+        def pin():
+            if cpus:
+                os.sched_setaffinity(0, cpus)
+        can_pin = cpus and hasattr(os, "sched_setaffinity")
+        # In its own session, so a hung match can be killed with its bots
+        p = Popen(command, stdin=None, stdout=PIPE, stderr=None,
+                  preexec_fn=pin if can_pin else None,
+                  start_new_session=(os.name == "posix"))
+        try:
+            results, _ = p.communicate(None, self.total_time_limit)
+        except subprocess.TimeoutExpired:
+            if os.name == "posix":
+                os.killpg(p.pid, signal.SIGKILL)
+            else:
+                p.kill()
+            p.communicate()
+            self.error = "Match hung: no result after %d seconds" % self.total_time_limit
+            return
         self.results_string = results.decode('ascii')
         self.return_code = p.returncode
-        self.parse_results_string()
+        try:
+            self.parse_results_string()
+        except ValueError:
+            self.error = "Engine exited with code %s and no results" % str(self.return_code)
+
+    def slow_phases(self, turn_ms):
+        """ If the engine's turns (from its --profile output, not counting the
+        wait for bots) took more than turn_ms on average, its slowest phases """
+        if not self.profile:
+            return []
+        phases = sorted(((timing['average'] / 1000.0, name)
+                         for name, timing in self.profile['phases'].items()
+                         if name != 'retrieve_moves'), reverse=True)
+        if sum(average for average, _ in phases) <= turn_ms:
+            return []
+        return ["%s %.2f ms" % (name, average) for average, name in phases[:3]]
+
+    def verify_replay(self, halite_binary):
+        """ Play the replay again in the engine and check every frame matches """
+        result = call([halite_binary, "--benchmark-replay", self.replay_file,
+                       "--benchmark-repetitions", "1"],
+                      stdout=subprocess.DEVNULL)
+        return result == 0
+
+    def finish(self):
+        """ Update the ratings and keep or delete the files of a played match """
         update_skills(self.players, copy.deepcopy(self.results))
         if self.keep_replay:
             print("Keeping replay\n")
@@ -119,6 +177,7 @@ class Match:
         self.map_seed = data['map_seed']
         self.map_generator = data['map_generator']
         self.replay_file = data['replay']
+        self.profile = data.get('profile')
         stats = data['stats']
         for player_index_string in stats:
             player_index = int(player_index_string)